@@ -71,6 +71,15 @@
 #define VARLENA_ATT_IS_PACKABLE(att) \
 	((att)->attstorage != 'p')
 
+/*
+ * Element access for the batch deforming routines, which can fill either
+ * columnar arrays (indexed by attribute, then tuple) or per-tuple arrays.
+ */
+#define BATCH_VALUE(i, attnum) \
+	(*(columnar ? &values[attnum][i] : &values[i][attnum]))
+#define BATCH_ISNULL(i, attnum) \
+	(*(columnar ? &isnull[attnum][i] : &isnull[i][attnum]))
+
 
 /* ----------------------------------------------------------------
  *						misc support routines
@@ -1331,6 +1340,237 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 		values[attnum] = getmissingattr(tupleDesc, attnum + 1, &isnull[attnum]);
 }
 
+/*
+ * Number of tuples heap_deform_tuples_internal examines at a time.  This
+ * bounds the size of its local arrays.
+ */
+#define DEFORM_BATCH_CHUNK	64
+
+/*
+ * Deform attributes startatt .. natts-1 of one tuple, beginning at offset
+ * off in the tuple data, with the given "slow" state (see heap_deform_tuple).
+ * Attributes the tuple doesn't have are filled in from the tuple descriptor.
+ * Returns the offset just past the last attribute physically present.
+ */
+static pg_attribute_always_inline uint32
+heap_deform_tuple_range(TupleDesc tupleDesc, HeapTupleHeader tup,
+						bool hasnulls, int startatt, int natts,
+						uint32 off, bool slow,
+						Datum **values, bool **isnull, int i,
+						bool columnar)
+{
+	bits8	   *bp = tup->t_bits;
+	char	   *tp = (char *) tup + tup->t_hoff;
+	int			tupnatts = Min(HeapTupleHeaderGetNatts(tup), natts);
+	int			attnum;
+
+	for (attnum = startatt; attnum < tupnatts; attnum++)
+	{
+		Form_pg_attribute thisatt = TupleDescAttr(tupleDesc, attnum);
+
+		if (hasnulls && att_isnull(attnum, bp))
+		{
+			BATCH_VALUE(i, attnum) = (Datum) 0;
+			BATCH_ISNULL(i, attnum) = true;
+			slow = true;		/* can't use attcacheoff anymore */
+			continue;
+		}
+
+		BATCH_ISNULL(i, attnum) = false;
+
+		if (!slow && thisatt->attcacheoff >= 0)
+			off = thisatt->attcacheoff;
+		else if (thisatt->attlen == -1)
+		{
+			/* see heap_deform_tuple */
+			if (!slow &&
+				off == att_align_nominal(off, thisatt->attalign))
+				thisatt->attcacheoff = off;
+			else
+			{
+				off = att_align_pointer(off, thisatt->attalign, -1,
+										tp + off);
+				slow = true;
+			}
+		}
+		else
+		{
+			/* not varlena, so safe to use att_align_nominal */
+			off = att_align_nominal(off, thisatt->attalign);
+
+			if (!slow)
+				thisatt->attcacheoff = off;
+		}
+
+		BATCH_VALUE(i, attnum) = fetchatt(thisatt, tp + off);
+
+		off = att_addlength_pointer(off, thisatt->attlen, tp + off);
+
+		if (thisatt->attlen <= 0)
+			slow = true;		/* can't use attcacheoff anymore */
+	}
+
+	for (; attnum < natts; attnum++)
+		BATCH_VALUE(i, attnum) = getmissingattr(tupleDesc, attnum + 1,
+												&BATCH_ISNULL(i, attnum));
+
+	return off;
+}
+
+/*
+ * Workhorse for heap_deform_tuples and heap_deform_tuples_rowwise.
+ *
+ * The leading run of fixed-width attributes is at the same offset in every
+ * tuple that has no nulls, so for those tuples we extract that run one
+ * attribute at a time across the whole chunk, using the cached offsets and
+ * a loop specialized for the attribute's width.  Everything else is done a
+ * tuple at a time, as in heap_deform_tuple.
+ */
+static pg_attribute_always_inline void
+heap_deform_tuples_internal(TupleDesc tupleDesc, int ntuples,
+							HeapTuple *tuples, int natts,
+							Datum **values, bool **isnull, uint32 *offsets,
+							bool columnar)
+{
+	int			nfixed;
+	uint32		fixedoff;
+	int			start;
+
+	Assert(natts <= tupleDesc->natts);
+
+	/*
+	 * Determine the leading fixed-width attributes, setting their cached
+	 * offsets if nobody has yet.
+	 */
+	fixedoff = 0;
+	for (nfixed = 0; nfixed < natts; nfixed++)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupleDesc, nfixed);
+
+		if (att->attlen <= 0)
+			break;
+		fixedoff = att_align_nominal(fixedoff, att->attalign);
+		if (att->attcacheoff < 0)
+			att->attcacheoff = fixedoff;
+		Assert(att->attcacheoff == fixedoff);
+		fixedoff += att->attlen;
+	}
+
+	for (start = 0; start < ntuples; start += DEFORM_BATCH_CHUNK)
+	{
+		int			n = Min(ntuples - start, DEFORM_BATCH_CHUNK);
+		char	   *tps[DEFORM_BATCH_CHUNK];
+		int			fastidx[DEFORM_BATCH_CHUNK];
+		bool		fast[DEFORM_BATCH_CHUNK];
+		int			nfast = 0;
+		int			i;
+		int			j;
+		int			k;
+
+		for (i = 0; i < n; i++)
+		{
+			HeapTupleHeader tup = tuples[start + i]->t_data;
+
+			tps[i] = (char *) tup + tup->t_hoff;
+			fast[i] = (nfixed > 0 && !HeapTupleHasNulls(tuples[start + i]) &&
+					   HeapTupleHeaderGetNatts(tup) >= nfixed);
+			if (fast[i])
+				fastidx[nfast++] = i;
+		}
+
+		/* Column-at-a-time extraction of the fixed-offset attributes */
+		for (j = 0; j < nfixed && nfast > 0; j++)
+		{
+			Form_pg_attribute att = TupleDescAttr(tupleDesc, j);
+			int			attoff = att->attcacheoff;
+
+#define DEFORM_FIXED_LOOP(expr) \
+			for (k = 0; k < nfast; k++) \
+			{ \
+				char	   *p = tps[fastidx[k]] + attoff; \
+				BATCH_VALUE(start + fastidx[k], j) = (expr); \
+				BATCH_ISNULL(start + fastidx[k], j) = false; \
+			}
+
+			if (!att->attbyval)
+				DEFORM_FIXED_LOOP(PointerGetDatum(p))
+			else if (att->attlen == sizeof(char))
+				DEFORM_FIXED_LOOP(CharGetDatum(*p))
+			else if (att->attlen == sizeof(int16))
+				DEFORM_FIXED_LOOP(Int16GetDatum(*(int16 *) p))
+			else if (att->attlen == sizeof(int32))
+				DEFORM_FIXED_LOOP(Int32GetDatum(*(int32 *) p))
+			else
+				DEFORM_FIXED_LOOP(fetchatt(att, p))
+
+#undef DEFORM_FIXED_LOOP
+		}
+
+		/* The rest a tuple at a time */
+		for (i = 0; i < n; i++)
+		{
+			HeapTuple	tuple = tuples[start + i];
+			uint32		off;
+
+			if (fast[i])
+				off = heap_deform_tuple_range(tupleDesc, tuple->t_data,
+											  false, nfixed, natts,
+											  fixedoff, false,
+											  values, isnull, start + i,
+											  columnar);
+			else
+				off = heap_deform_tuple_range(tupleDesc, tuple->t_data,
+											  HeapTupleHasNulls(tuple),
+											  0, natts, 0, false,
+											  values, isnull, start + i,
+											  columnar);
+			if (offsets)
+				offsets[start + i] = off;
+		}
+	}
+}
+
+/*
+ * heap_deform_tuples
+ *		Extract the first natts attributes of an array of tuples into
+ *		columnar values/isnull arrays.
+ *
+ *		values[attnum][i] and isnull[attnum][i] receive attribute attnum
+ *		(counting from zero) of tuples[i].  Storage is provided by the
+ *		caller.  If offsets isn't NULL, offsets[i] is set to the offset in
+ *		tuples[i]'s data just past the last attribute extracted, which
+ *		allows extraction of further attributes to resume from there.
+ *
+ *		This is meant for callers that process many tuples of the same
+ *		descriptor at once, such as the tuples of a heap page: compared to
+ *		calling heap_deform_tuple for each tuple, it avoids re-interpreting
+ *		the descriptor for every tuple for the common case of a leading run
+ *		of fixed-width, non-null attributes.  As with heap_deform_tuple,
+ *		pass-by-reference values point into the tuples.
+ */
+void
+heap_deform_tuples(TupleDesc tupleDesc, int ntuples, HeapTuple *tuples,
+				   int natts, Datum **values, bool **isnull,
+				   uint32 *offsets)
+{
+	heap_deform_tuples_internal(tupleDesc, ntuples, tuples, natts,
+								values, isnull, offsets, true);
+}
+
+/*
+ * heap_deform_tuples_rowwise
+ *		As heap_deform_tuples, but values[i] and isnull[i] are arrays
+ *		receiving the attributes of tuples[i], as for heap_deform_tuple.
+ */
+void
+heap_deform_tuples_rowwise(TupleDesc tupleDesc, int ntuples,
+						   HeapTuple *tuples, int natts,
+						   Datum **values, bool **isnull, uint32 *offsets)
+{
+	heap_deform_tuples_internal(tupleDesc, ntuples, tuples, natts,
+								values, isnull, offsets, false);
+}
+
 /*
  * heap_freetuple
  */
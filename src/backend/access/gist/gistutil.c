@@ -21,6 +21,7 @@
 #include "catalog/pg_opclass.h"
 #include "storage/indexfsm.h"
 #include "storage/lmgr.h"
+#include "storage/procarray.h"
 #include "utils/float.h"
 #include "utils/syscache.h"
 #include "utils/snapmgr.h"
@@ -884,7 +885,7 @@ gistPageRecyclable(Page page)
 {
 	return PageIsNew(page) ||
 		(GistPageIsDeleted(page) &&
-		 TransactionIdPrecedes(GistPageGetDeleteXid(page), RecentGlobalXmin));
+		 TransactionIdPrecedesRecentGlobalXmin(GistPageGetDeleteXid(page)));
 }
 
 bytea *
@@ -54,6 +54,7 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "port/atomics.h"
+#include "storage/aio.h"
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
@@ -70,6 +71,7 @@
 #include "utils/spccache.h"
 
 
+static void heap_scan_readahead(HeapScanDesc scan, BlockNumber page);
 static HeapTuple heap_prepare_insert(Relation relation, HeapTuple tup,
 									 TransactionId xid, CommandId cid, int options);
 static XLogRecPtr log_heap_update(Relation reln, Buffer oldbuf,
@@ -302,6 +304,20 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 	scan->rs_cbuf = InvalidBuffer;
 	scan->rs_cblock = InvalidBlockNumber;
 
+	/*
+	 * Serial sequential scans read ahead asynchronously, if the I/O method
+	 * supports that.  Parallel scans don't know which pages they will get
+	 * next, and local buffers can't be read by other processes.
+	 */
+	if ((scan->rs_base.rs_flags & SO_TYPE_SEQSCAN) &&
+		scan->rs_base.rs_parallel == NULL &&
+		!RelationUsesLocalBuffers(scan->rs_base.rs_rd))
+		scan->rs_readahead_distance =
+			pgaio_readahead_distance(scan->rs_strategy != NULL);
+	else
+		scan->rs_readahead_distance = 0;
+	scan->rs_readahead = 0;
+
 	/* page-at-a-time fields are always invalid when not rs_inited */
 
 	/*
@@ -341,6 +357,60 @@ heap_setscanlimits(TableScanDesc sscan, BlockNumber startBlk, BlockNumber numBlk
 	scan->rs_numblocks = numBlks;
 }
 
+/*
+ * heap_scan_readahead - start reading the pages a forward scan needs next
+ *
+ * Called by heapgetpage() before it reads "page".  We keep up to
+ * rs_readahead_distance pages beyond the current one queued for asynchronous
+ * reading, topping the window up by one page whenever the scan advances.
+ * Backward scans and jumps to unrelated pages just reset the window.
+ */
+static void
+heap_scan_readahead(HeapScanDesc scan, BlockNumber page)
+{
+	BlockNumber nblocks = scan->rs_nblocks;
+	BlockNumber remaining;
+	BlockNumber target;
+
+	if (scan->rs_cblock == InvalidBlockNumber && page == scan->rs_startblock)
+	{
+		/* first page of the scan */
+		scan->rs_readahead = 0;
+	}
+	else if (scan->rs_cblock != InvalidBlockNumber &&
+			 page == (scan->rs_cblock + 1) % nblocks)
+	{
+		/* advanced to the next page, which we already prefetched */
+		if (scan->rs_readahead > 0)
+			scan->rs_readahead--;
+	}
+	else
+	{
+		scan->rs_readahead = 0;
+		return;
+	}
+
+	/* How many pages will the scan read after this one? */
+	if (page >= scan->rs_startblock)
+		remaining = nblocks - (page - scan->rs_startblock) - 1;
+	else
+		remaining = scan->rs_startblock - page - 1;
+	if (scan->rs_numblocks != InvalidBlockNumber)
+		remaining = Min(remaining, scan->rs_numblocks - 1);
+
+	target = Min(remaining, (BlockNumber) scan->rs_readahead_distance);
+	while (scan->rs_readahead < target)
+	{
+		BlockNumber blkno = page + scan->rs_readahead + 1;
+
+		if (blkno >= nblocks)
+			blkno -= nblocks;
+		PrefetchBufferExtended(scan->rs_base.rs_rd, MAIN_FORKNUM, blkno,
+							   scan->rs_strategy);
+		scan->rs_readahead++;
+	}
+}
+
 /*
  * heapgetpage - subroutine for heapgettup()
  *
@@ -377,6 +447,9 @@ heapgetpage(TableScanDesc sscan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+	if (scan->rs_readahead_distance > 0)
+		heap_scan_readahead(scan, page);
+
 	/* read page using selected strategy */
 	scan->rs_cbuf = ReadBufferExtended(scan->rs_base.rs_rd, MAIN_FORKNUM, page,
 									   RBM_NORMAL, scan->rs_strategy);
@@ -1374,8 +1447,15 @@ heap_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlot *s
 
 	pgstat_count_heap_getnext(scan->rs_base.rs_rd);
 
-	ExecStoreBufferHeapTuple(&scan->rs_ctup, slot,
-							 scan->rs_cbuf);
+	/*
+	 * Store a copy of the tuple header in the slot's own workspace, rather
+	 * than pointing the slot at rs_ctup, so that the slot stays valid when
+	 * the scan moves on and returns the next tuple in another slot.
+	 */
+	Assert(TTS_IS_BUFFERTUPLE(slot));
+	((BufferHeapTupleTableSlot *) slot)->base.tupdata = scan->rs_ctup;
+	ExecStoreBufferHeapTuple(&((BufferHeapTupleTableSlot *) slot)->base.tupdata,
+							 slot, scan->rs_cbuf);
 	return true;
 }
 
@@ -1975,6 +2055,8 @@ heap_insert(Relation relation, HeapTuple tup, CommandId cid,
 			xlrec.flags |= XLH_INSERT_ALL_VISIBLE_CLEARED;
 		if (options & HEAP_INSERT_SPECULATIVE)
 			xlrec.flags |= XLH_INSERT_IS_SPECULATIVE;
+		if (IsToastRelation(relation))
+			xlrec.flags |= XLH_INSERT_ON_TOAST_RELATION;
 		Assert(ItemPointerGetBlockNumber(&heaptup->t_self) == BufferGetBlockNumber(buffer));
 
 		/*
@@ -2055,17 +2137,13 @@ heap_prepare_insert(Relation relation, HeapTuple tup, TransactionId xid,
 					CommandId cid, int options)
 {
 	/*
-	 * Parallel operations are required to be strictly read-only in a parallel
-	 * worker.  Parallel inserts are not safe even in the leader in the
-	 * general case, because group locking means that heavyweight locks for
-	 * relation extension or GIN page locks will not conflict between members
-	 * of a lock group, but we don't prohibit that case here because there are
-	 * useful special cases that we can safely allow, such as CREATE TABLE AS.
+	 * A parallel worker may insert only if the leader marked the current
+	 * command ID as used before starting the parallel operation, as parallel
+	 * COPY FROM does; GetCurrentCommandId() enforces that, since our caller
+	 * must have obtained "cid" from it.  Relation extension and GIN page
+	 * locks conflict between members of a lock group (see
+	 * LockCheckConflicts), so concurrent inserts by the members are safe.
 	 */
-	if (IsParallelWorker())
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
-				 errmsg("cannot insert tuples in a parallel worker")));
 
 	tup->t_data->t_infomask &= ~(HEAP_XACT_MASK);
 	tup->t_data->t_infomask2 &= ~(HEAP2_XACT_MASK);
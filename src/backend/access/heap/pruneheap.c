@@ -23,6 +23,7 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "storage/procarray.h"
 #include "utils/snapmgr.h"
 #include "utils/rel.h"
 
@@ -43,6 +44,7 @@ typedef struct
 } PruneState;
 
 /* Local functions */
+static TransactionId heap_prune_horizon(Relation relation);
 static int	heap_prune_chain(Relation relation, Buffer buffer,
 							 OffsetNumber rootoffnum,
 							 TransactionId OldestXmin,
@@ -98,24 +100,25 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 	 * save significant overhead in the case where the page is found not to be
 	 * prunable.
 	 */
-	if (IsCatalogRelation(relation) ||
-		RelationIsAccessibleInLogicalDecoding(relation))
-		OldestXmin = RecentGlobalXmin;
-	else
-		OldestXmin =
-			TransactionIdLimitedForOldSnapshots(RecentGlobalDataXmin,
-												relation);
-
-	Assert(TransactionIdIsValid(OldestXmin));
+	OldestXmin = heap_prune_horizon(relation);
 
 	/*
 	 * Let's see if we really need pruning.
 	 *
 	 * Forget it if page is not hinted to contain something prunable that's
-	 * older than OldestXmin.
+	 * older than OldestXmin.  GetSnapshotData() doesn't compute the horizons
+	 * afresh, so if there is something prunable that's just not old enough,
+	 * recompute them (at most once per snapshot) and check again.
 	 */
 	if (!PageIsPrunable(page, OldestXmin))
-		return;
+	{
+		if (!TransactionIdIsValid(((PageHeader) page)->pd_prune_xid) ||
+			!UpdateRecentGlobalXmin())
+			return;
+		OldestXmin = heap_prune_horizon(relation);
+		if (!PageIsPrunable(page, OldestXmin))
+			return;
+	}
 
 	/*
 	 * We prune when a previous UPDATE failed to find enough space on the page
@@ -160,6 +163,29 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 }
 
 
+/*
+ * Choose the xmin horizon for opportunistic pruning of the given relation,
+ * based on the current values of RecentGlobalXmin and RecentGlobalDataXmin.
+ */
+static TransactionId
+heap_prune_horizon(Relation relation)
+{
+	TransactionId OldestXmin;
+
+	if (IsCatalogRelation(relation) ||
+		RelationIsAccessibleInLogicalDecoding(relation))
+		OldestXmin = RecentGlobalXmin;
+	else
+		OldestXmin =
+			TransactionIdLimitedForOldSnapshots(RecentGlobalDataXmin,
+												relation);
+
+	Assert(TransactionIdIsValid(OldestXmin));
+
+	return OldestXmin;
+}
+
+
 /*
  * Prune and repair fragmentation in the specified page.
  *
@@ -30,6 +30,10 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/tuptoaster.h"
@@ -52,7 +56,8 @@
 typedef struct toast_compress_header
 {
 	int32		vl_len_;		/* varlena header (do not touch directly!) */
-	int32		rawsize;
+	uint32		tcinfo;			/* 2 bits for compression method and 30 bits
+								 * for the raw size */
 } toast_compress_header;
 
 /*
@@ -60,11 +65,27 @@ typedef struct toast_compress_header
  * toast entries.
  */
 #define TOAST_COMPRESS_HDRSZ		((int32) sizeof(toast_compress_header))
-#define TOAST_COMPRESS_RAWSIZE(ptr) (((toast_compress_header *) (ptr))->rawsize)
+#define TOAST_COMPRESS_RAWSIZE(ptr) \
+	(((toast_compress_header *) (ptr))->tcinfo & VARLENA_EXTSIZE_MASK)
+#define TOAST_COMPRESS_METHOD(ptr) \
+	(((toast_compress_header *) (ptr))->tcinfo >> VARLENA_EXTSIZE_BITS)
 #define TOAST_COMPRESS_RAWDATA(ptr) \
 	(((char *) (ptr)) + TOAST_COMPRESS_HDRSZ)
-#define TOAST_COMPRESS_SET_RAWSIZE(ptr, len) \
-	(((toast_compress_header *) (ptr))->rawsize = (len))
+#define TOAST_COMPRESS_SET_SIZE_AND_METHOD(ptr, len, cm_method) \
+	do { \
+		Assert((len) > 0 && (len) <= VARLENA_EXTSIZE_MASK); \
+		Assert((cm_method) == TOAST_PGLZ_COMPRESSION_ID || \
+			   (cm_method) == TOAST_LZ4_COMPRESSION_ID); \
+		((toast_compress_header *) (ptr))->tcinfo = \
+			(len) | ((uint32) (cm_method) << VARLENA_EXTSIZE_BITS); \
+	} while (0)
+
+#define NO_LZ4_SUPPORT() \
+	ereport(ERROR, \
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), \
+			 errmsg("compression method lz4 not supported"), \
+			 errdetail("This functionality requires the server to be built with lz4 support."), \
+			 errhint("You need to rebuild PostgreSQL using --with-lz4.")))
 
 static void toast_delete_datum(Relation rel, Datum value, bool is_speculative);
 static Datum toast_save_datum(Relation rel, Datum value,
@@ -425,7 +446,7 @@ toast_datum_size(Datum value)
 		struct varatt_external toast_pointer;
 
 		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
-		result = toast_pointer.va_extsize;
+		result = VARATT_EXTERNAL_GET_EXTSIZE(toast_pointer);
 	}
 	else if (VARATT_IS_EXTERNAL_INDIRECT(attr))
 	{
@@ -775,7 +796,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		if (TupleDescAttr(tupleDesc, i)->attstorage == 'x')
 		{
 			old_value = toast_values[i];
-			new_value = toast_compress_datum(old_value);
+			new_value = toast_compress_datum(old_value,
+											 TupleDescAttr(tupleDesc, i)->attcompression);
 
 			if (DatumGetPointer(new_value) != NULL)
 			{
@@ -916,7 +938,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		 */
 		i = biggest_attno;
 		old_value = toast_values[i];
-		new_value = toast_compress_datum(old_value);
+		new_value = toast_compress_datum(old_value,
+										 TupleDescAttr(tupleDesc, i)->attcompression);
 
 		if (DatumGetPointer(new_value) != NULL)
 		{
@@ -1348,7 +1371,10 @@ toast_build_flattened_tuple(TupleDesc tupleDesc,
 /* ----------
  * toast_compress_datum -
  *
- *	Create a compressed version of a varlena datum
+ *	Create a compressed version of a varlena datum, using compression
+ *	method cmethod (a pg_attribute.attcompression value; the default
+ *	method if InvalidCompressionMethod).  The method used is recorded in
+ *	the compressed datum's header.
  *
  *	If we fail (ie, compressed result is actually bigger than original)
  *	then return NULL.  We must not use compressed data if it'd expand
@@ -1359,28 +1385,67 @@ toast_build_flattened_tuple(TupleDesc tupleDesc,
  * ----------
  */
 Datum
-toast_compress_datum(Datum value)
+toast_compress_datum(Datum value, char cmethod)
 {
 	struct varlena *tmp;
 	int32		valsize = VARSIZE_ANY_EXHDR(DatumGetPointer(value));
 	int32		len;
+	ToastCompressionId cmid;
 
 	Assert(!VARATT_IS_EXTERNAL(DatumGetPointer(value)));
 	Assert(!VARATT_IS_COMPRESSED(DatumGetPointer(value)));
 
-	/*
-	 * No point in wasting a palloc cycle if value size is out of the allowed
-	 * range for compression
-	 */
-	if (valsize < PGLZ_strategy_default->min_input_size ||
-		valsize > PGLZ_strategy_default->max_input_size)
-		return PointerGetDatum(NULL);
+	if (!CompressionMethodIsValid(cmethod))
+		cmethod = TOAST_PGLZ_COMPRESSION;
+
+	switch (cmethod)
+	{
+		case TOAST_PGLZ_COMPRESSION:
+
+			/*
+			 * No point in wasting a palloc cycle if value size is out of the
+			 * allowed range for compression
+			 */
+			if (valsize < PGLZ_strategy_default->min_input_size ||
+				valsize > PGLZ_strategy_default->max_input_size)
+				return PointerGetDatum(NULL);
+
+			tmp = (struct varlena *) palloc(PGLZ_MAX_OUTPUT(valsize) +
+											TOAST_COMPRESS_HDRSZ);
+			len = pglz_compress(VARDATA_ANY(DatumGetPointer(value)),
+								valsize,
+								TOAST_COMPRESS_RAWDATA(tmp),
+								PGLZ_strategy_default);
+			cmid = TOAST_PGLZ_COMPRESSION_ID;
+			break;
 
-	tmp = (struct varlena *) palloc(PGLZ_MAX_OUTPUT(valsize) +
-									TOAST_COMPRESS_HDRSZ);
+		case TOAST_LZ4_COMPRESSION:
+#ifdef USE_LZ4
+			{
+				int32		max_size = LZ4_compressBound(valsize);
+
+				tmp = (struct varlena *) palloc(max_size +
+												TOAST_COMPRESS_HDRSZ);
+				len = LZ4_compress_default(VARDATA_ANY(DatumGetPointer(value)),
+										   TOAST_COMPRESS_RAWDATA(tmp),
+										   valsize, max_size);
+				if (len <= 0)
+					len = -1;	/* failure */
+				cmid = TOAST_LZ4_COMPRESSION_ID;
+			}
+#else
+			NO_LZ4_SUPPORT();
+			return PointerGetDatum(NULL);	/* keep compiler quiet */
+#endif
+			break;
+
+		default:
+			elog(ERROR, "invalid compression method \"%c\"", cmethod);
+			return PointerGetDatum(NULL);	/* keep compiler quiet */
+	}
 
 	/*
-	 * We recheck the actual size even if pglz_compress() reports success,
+	 * We recheck the actual size even if the compressor reports success,
 	 * because it might be satisfied with having saved as little as one byte
 	 * in the compressed data --- which could turn into a net loss once you
 	 * consider header and alignment padding.  Worst case, the compressed
@@ -1389,14 +1454,10 @@ toast_compress_datum(Datum value)
 	 * only one header byte and no padding if the value is short enough.  So
 	 * we insist on a savings of more than 2 bytes to ensure we have a gain.
 	 */
-	len = pglz_compress(VARDATA_ANY(DatumGetPointer(value)),
-						valsize,
-						TOAST_COMPRESS_RAWDATA(tmp),
-						PGLZ_strategy_default);
 	if (len >= 0 &&
 		len + TOAST_COMPRESS_HDRSZ < valsize - 2)
 	{
-		TOAST_COMPRESS_SET_RAWSIZE(tmp, valsize);
+		TOAST_COMPRESS_SET_SIZE_AND_METHOD(tmp, valsize, cmid);
 		SET_VARSIZE_COMPRESSED(tmp, len + TOAST_COMPRESS_HDRSZ);
 		/* successful compression */
 		return PointerGetDatum(tmp);
@@ -1409,6 +1470,78 @@ toast_compress_datum(Datum value)
 	}
 }
 
+/* ----------
+ * toast_get_compression_id -
+ *
+ *	Return the compression method recorded in a varlena datum, or
+ *	TOAST_INVALID_COMPRESSION_ID if the datum is not compressed.
+ * ----------
+ */
+ToastCompressionId
+toast_get_compression_id(struct varlena *attr)
+{
+	ToastCompressionId cmid = TOAST_INVALID_COMPRESSION_ID;
+
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+
+		if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+			cmid = VARATT_EXTERNAL_GET_COMPRESS_METHOD(toast_pointer);
+	}
+	else if (VARATT_IS_COMPRESSED(attr))
+		cmid = VARCOMPRESS_4B_C(attr);
+
+	return cmid;
+}
+
+/* ----------
+ * CompressionNameToMethod -
+ *
+ *	Return the attcompression code for the named compression method, or
+ *	InvalidCompressionMethod if the name is not recognized.  Raises an
+ *	error if the method is not supported by this build.
+ * ----------
+ */
+char
+CompressionNameToMethod(const char *compression)
+{
+	if (strcmp(compression, "pglz") == 0)
+		return TOAST_PGLZ_COMPRESSION;
+	else if (strcmp(compression, "lz4") == 0)
+	{
+#ifndef USE_LZ4
+		NO_LZ4_SUPPORT();
+#endif
+		return TOAST_LZ4_COMPRESSION;
+	}
+
+	return InvalidCompressionMethod;
+}
+
+/* ----------
+ * GetCompressionMethodName -
+ *
+ *	Return the name of a pg_attribute.attcompression code.
+ * ----------
+ */
+const char *
+GetCompressionMethodName(char method)
+{
+	switch (method)
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			return "pglz";
+		case TOAST_LZ4_COMPRESSION:
+			return "lz4";
+		default:
+			elog(ERROR, "invalid compression method \"%c\"", method);
+			return NULL;		/* keep compiler quiet */
+	}
+}
+
 
 /* ----------
  * toast_get_valid_index
@@ -1501,19 +1634,20 @@ toast_save_datum(Relation rel, Datum value,
 									&num_indexes);
 
 	/*
-	 * Get the data pointer and length, and compute va_rawsize and va_extsize.
+	 * Get the data pointer and length, and compute va_rawsize and va_extinfo.
 	 *
 	 * va_rawsize is the size of the equivalent fully uncompressed datum, so
 	 * we have to adjust for short headers.
 	 *
-	 * va_extsize is the actual size of the data payload in the toast records.
+	 * va_extinfo contains the actual size of the data payload in the toast
+	 * records, and the compression method if the data is compressed.
 	 */
 	if (VARATT_IS_SHORT(dval))
 	{
 		data_p = VARDATA_SHORT(dval);
 		data_todo = VARSIZE_SHORT(dval) - VARHDRSZ_SHORT;
 		toast_pointer.va_rawsize = data_todo + VARHDRSZ;	/* as if not short */
-		toast_pointer.va_extsize = data_todo;
+		toast_pointer.va_extinfo = data_todo;
 	}
 	else if (VARATT_IS_COMPRESSED(dval))
 	{
@@ -1521,7 +1655,8 @@ toast_save_datum(Relation rel, Datum value,
 		data_todo = VARSIZE(dval) - VARHDRSZ;
 		/* rawsize in a compressed datum is just the size of the payload */
 		toast_pointer.va_rawsize = VARRAWSIZE_4B_C(dval) + VARHDRSZ;
-		toast_pointer.va_extsize = data_todo;
+		VARATT_EXTERNAL_SET_SIZE_AND_COMPRESS_METHOD(toast_pointer, data_todo,
+													 VARCOMPRESS_4B_C(dval));
 		/* Assert that the numbers look like it's compressed */
 		Assert(VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer));
 	}
@@ -1530,7 +1665,7 @@ toast_save_datum(Relation rel, Datum value,
 		data_p = VARDATA(dval);
 		data_todo = VARSIZE(dval) - VARHDRSZ;
 		toast_pointer.va_rawsize = VARSIZE(dval);
-		toast_pointer.va_extsize = data_todo;
+		toast_pointer.va_extinfo = data_todo;
 	}
 
 	/*
@@ -1890,7 +2025,7 @@ toast_fetch_datum(struct varlena *attr)
 	/* Must copy to access aligned fields */
 	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
 
-	ressize = toast_pointer.va_extsize;
+	ressize = VARATT_EXTERNAL_GET_EXTSIZE(toast_pointer);
 	numchunks = ((ressize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
 
 	result = (struct varlena *) palloc(ressize + VARHDRSZ);
@@ -2077,7 +2212,7 @@ toast_fetch_datum_slice(struct varlena *attr, int32 sliceoffset, int32 length)
 	 */
 	Assert(!VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer));
 
-	attrsize = toast_pointer.va_extsize;
+	attrsize = VARATT_EXTERNAL_GET_EXTSIZE(toast_pointer);
 	totalchunks = ((attrsize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
 
 	if (sliceoffset >= attrsize)
@@ -2267,6 +2402,7 @@ static struct varlena *
 toast_decompress_datum(struct varlena *attr)
 {
 	struct varlena *result;
+	int32		rawsize;
 
 	Assert(VARATT_IS_COMPRESSED(attr));
 
@@ -2274,10 +2410,35 @@ toast_decompress_datum(struct varlena *attr)
 		palloc(TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
 	SET_VARSIZE(result, TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
 
-	if (pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
-						VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
-						VARDATA(result),
-						TOAST_COMPRESS_RAWSIZE(attr), true) < 0)
+	switch (TOAST_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION_ID:
+			rawsize = pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
+									  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+									  VARDATA(result),
+									  TOAST_COMPRESS_RAWSIZE(attr), true);
+			break;
+
+		case TOAST_LZ4_COMPRESSION_ID:
+#ifdef USE_LZ4
+			rawsize = LZ4_decompress_safe(TOAST_COMPRESS_RAWDATA(attr),
+										  VARDATA(result),
+										  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+										  TOAST_COMPRESS_RAWSIZE(attr));
+#else
+			NO_LZ4_SUPPORT();
+			rawsize = -1;		/* keep compiler quiet */
+#endif
+			break;
+
+		default:
+			elog(ERROR, "invalid compression method id %d",
+				 TOAST_COMPRESS_METHOD(attr));
+			rawsize = -1;		/* keep compiler quiet */
+			break;
+	}
+
+	if (rawsize < 0)
 		elog(ERROR, "compressed data is corrupted");
 
 	return result;
@@ -2301,10 +2462,35 @@ toast_decompress_datum_slice(struct varlena *attr, int32 slicelength)
 
 	result = (struct varlena *) palloc(slicelength + VARHDRSZ);
 
-	rawsize = pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
-							  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
-							  VARDATA(result),
-							  slicelength, false);
+	switch (TOAST_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION_ID:
+			rawsize = pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
+									  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+									  VARDATA(result),
+									  slicelength, false);
+			break;
+
+		case TOAST_LZ4_COMPRESSION_ID:
+#ifdef USE_LZ4
+			rawsize = LZ4_decompress_safe_partial(TOAST_COMPRESS_RAWDATA(attr),
+												  VARDATA(result),
+												  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+												  slicelength,
+												  slicelength);
+#else
+			NO_LZ4_SUPPORT();
+			rawsize = -1;		/* keep compiler quiet */
+#endif
+			break;
+
+		default:
+			elog(ERROR, "invalid compression method id %d",
+				 TOAST_COMPRESS_METHOD(attr));
+			rawsize = -1;		/* keep compiler quiet */
+			break;
+	}
+
 	if (rawsize < 0)
 		elog(ERROR, "compressed data is corrupted");
 
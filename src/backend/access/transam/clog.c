@@ -80,6 +80,9 @@
  */
 #define THRESHOLD_SUBTRANS_CLOG_OPT	5
 
+/* GUC variable: number of CLOG buffers, or 0 to size automatically */
+int			transaction_buffers = 0;
+
 /*
  * Link to shared-memory data structures for CLOG control
  */
@@ -275,15 +278,17 @@ TransactionIdSetPageStatus(TransactionId xid, int nsubxids,
 						   XLogRecPtr lsn, int pageno,
 						   bool all_xact_same_page)
 {
+	LWLock	   *lock;
+
 	/* Can't use group update when PGPROC overflows. */
 	StaticAssertStmt(THRESHOLD_SUBTRANS_CLOG_OPT <= PGPROC_MAX_CACHED_SUBXIDS,
 					 "group clog threshold less than PGPROC cached subxids");
 
 	/*
-	 * When there is contention on CLogControlLock, we try to group multiple
-	 * updates; a single leader process will perform transaction status
-	 * updates for multiple backends so that the number of times
-	 * CLogControlLock needs to be acquired is reduced.
+	 * When there is contention on the lock of the CLOG bank holding our
+	 * page, we try to group multiple updates; a single leader process will
+	 * perform transaction status updates for multiple backends so that the
+	 * number of times the bank lock needs to be acquired is reduced.
 	 *
 	 * For this optimization to be safe, the XID in MyPgXact and the subxids
 	 * in MyProc must be the same as the ones for which we're setting the
@@ -307,17 +312,18 @@ TransactionIdSetPageStatus(TransactionId xid, int nsubxids,
 		Assert(THRESHOLD_SUBTRANS_CLOG_OPT <= PGPROC_MAX_CACHED_SUBXIDS);
 
 		/*
-		 * If we can immediately acquire CLogControlLock, we update the status
+		 * If we can immediately acquire the bank lock, we update the status
 		 * of our own XID and release the lock.  If not, try use group XID
 		 * update.  If that doesn't work out, fall back to waiting for the
 		 * lock to perform an update for this transaction only.
 		 */
-		if (LWLockConditionalAcquire(CLogControlLock, LW_EXCLUSIVE))
+		lock = SimpleLruGetBankLock(ClogCtl, pageno);
+		if (LWLockConditionalAcquire(lock, LW_EXCLUSIVE))
 		{
 			/* Got the lock without waiting!  Do the update. */
 			TransactionIdSetPageStatusInternal(xid, nsubxids, subxids, status,
 											   lsn, pageno);
-			LWLockRelease(CLogControlLock);
+			LWLockRelease(lock);
 			return;
 		}
 		else if (TransactionGroupUpdateXidStatus(xid, status, lsn, pageno))
@@ -330,16 +336,17 @@ TransactionIdSetPageStatus(TransactionId xid, int nsubxids,
 	}
 
 	/* Group update not applicable, or couldn't accept this page number. */
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+	lock = SimpleLruGetBankLock(ClogCtl, pageno);
+	LWLockAcquire(lock, LW_EXCLUSIVE);
 	TransactionIdSetPageStatusInternal(xid, nsubxids, subxids, status,
 									   lsn, pageno);
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(lock);
 }
 
 /*
  * Record the final state of transaction entry in the commit log
  *
- * We don't do any locking here; caller must handle that.
+ * We don't do any locking here; caller must hold the lock of the page's bank.
  */
 static void
 TransactionIdSetPageStatusInternal(TransactionId xid, int nsubxids,
@@ -352,7 +359,8 @@ TransactionIdSetPageStatusInternal(TransactionId xid, int nsubxids,
 	Assert(status == TRANSACTION_STATUS_COMMITTED ||
 		   status == TRANSACTION_STATUS_ABORTED ||
 		   (status == TRANSACTION_STATUS_SUB_COMMITTED && !TransactionIdIsValid(xid)));
-	Assert(LWLockHeldByMeInMode(CLogControlLock, LW_EXCLUSIVE));
+	Assert(LWLockHeldByMeInMode(SimpleLruGetBankLock(ClogCtl, pageno),
+								LW_EXCLUSIVE));
 
 	/*
 	 * If we're doing an async commit (ie, lsn is valid), then we must wait
@@ -403,12 +411,12 @@ TransactionIdSetPageStatusInternal(TransactionId xid, int nsubxids,
 }
 
 /*
- * When we cannot immediately acquire CLogControlLock in exclusive mode at
+ * When we cannot immediately acquire the CLOG bank lock in exclusive mode at
  * commit time, add ourselves to a list of processes that need their XIDs
  * status update.  The first process to add itself to the list will acquire
- * CLogControlLock in exclusive mode and set transaction status as required
+ * the bank lock in exclusive mode and set transaction status as required
  * on behalf of all group members.  This avoids a great deal of contention
- * around CLogControlLock when many processes are trying to commit at once,
+ * around the bank lock when many processes are trying to commit at once,
  * since the lock need not be repeatedly handed off from one committing
  * process to the next.
  *
@@ -424,6 +432,7 @@ TransactionGroupUpdateXidStatus(TransactionId xid, XidStatus status,
 	PGPROC	   *proc = MyProc;
 	uint32		nextidx;
 	uint32		wakeidx;
+	LWLock	   *prevlock;
 
 	/* We should definitely have an XID whose status needs to be updated. */
 	Assert(TransactionIdIsValid(xid));
@@ -500,7 +509,8 @@ TransactionGroupUpdateXidStatus(TransactionId xid, XidStatus status,
 	}
 
 	/* We are the leader.  Acquire the lock on behalf of everyone. */
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+	prevlock = SimpleLruGetBankLock(ClogCtl, pageno);
+	LWLockAcquire(prevlock, LW_EXCLUSIVE);
 
 	/*
 	 * Now that we've got the lock, clear the list of processes waiting for
@@ -518,6 +528,19 @@ TransactionGroupUpdateXidStatus(TransactionId xid, XidStatus status,
 	{
 		PGPROC	   *proc = &ProcGlobal->allProcs[nextidx];
 		PGXACT	   *pgxact = &ProcGlobal->allPgXact[nextidx];
+		LWLock	   *lock = SimpleLruGetBankLock(ClogCtl,
+												proc->clogGroupMemberPage);
+
+		/*
+		 * Because of the race condition described above, a group member's
+		 * page can occasionally be in a different bank; switch locks then.
+		 */
+		if (lock != prevlock)
+		{
+			LWLockRelease(prevlock);
+			LWLockAcquire(lock, LW_EXCLUSIVE);
+			prevlock = lock;
+		}
 
 		/*
 		 * Overflowed transactions should not use group XID status update
@@ -537,7 +560,7 @@ TransactionGroupUpdateXidStatus(TransactionId xid, XidStatus status,
 	}
 
 	/* We're done with the lock now. */
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(prevlock);
 
 	/*
 	 * Now that we've released the lock, go back and wake everybody up.  We
@@ -566,7 +589,7 @@ TransactionGroupUpdateXidStatus(TransactionId xid, XidStatus status,
 /*
  * Sets the commit status of a single transaction.
  *
- * Must be called with CLogControlLock held
+ * Must be called with the lock of the page's bank held
  */
 static void
 TransactionIdSetStatusBit(TransactionId xid, XidStatus status, XLogRecPtr lsn, int slotno)
@@ -658,7 +681,7 @@ TransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 	lsnindex = GetLSNIndex(slotno, xid);
 	*lsn = ClogCtl->shared->group_lsn[lsnindex];
 
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(SimpleLruGetBankLock(ClogCtl, pageno));
 
 	return status;
 }
@@ -666,23 +689,22 @@ TransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 /*
  * Number of shared CLOG buffers.
  *
- * On larger multi-processor systems, it is possible to have many CLOG page
- * requests in flight at one time which could lead to disk access for CLOG
- * page if the required page is not found in memory.  Testing revealed that we
- * can get the best performance by having 128 CLOG buffers, more than that it
- * doesn't improve performance.
- *
- * Unconditionally keeping the number of CLOG buffers to 128 did not seem like
- * a good idea, because it would increase the minimum amount of shared memory
- * required to start, which could be a problem for people running very small
- * configurations.  The following formula seems to represent a reasonable
- * compromise: people with very low values for shared_buffers will get fewer
- * CLOG buffers as well, and everyone else will get 128.
+ * This is set by the transaction_buffers GUC.  If that's 0, we scale with
+ * shared_buffers: on larger multi-processor systems, it is possible to have
+ * many CLOG page requests in flight at one time which could lead to disk
+ * access for CLOG page if the required page is not found in memory, while
+ * people running very small configurations don't want the minimum amount of
+ * shared memory required to start to go up.  Since the buffers are divided
+ * into banks with their own locks, a large pool no longer makes lookups or
+ * lock contention any worse, so the automatic value is allowed to grow well
+ * beyond the 128 buffers that used to be the limit.
  */
 Size
 CLOGShmemBuffers(void)
 {
-	return Min(128, Max(4, NBuffers / 512));
+	if (transaction_buffers == 0)
+		return SimpleLruAutotuneBuffers(512, 1024);
+	return transaction_buffers;
 }
 
 /*
@@ -699,7 +721,8 @@ CLOGShmemInit(void)
 {
 	ClogCtl->PagePrecedes = CLOGPagePrecedes;
 	SimpleLruInit(ClogCtl, "clog", CLOGShmemBuffers(), CLOG_LSNS_PER_PAGE,
-				  CLogControlLock, "pg_xact", LWTRANCHE_CLOG_BUFFERS);
+				  NULL, "pg_xact", LWTRANCHE_CLOG_BUFFERS,
+				  LWTRANCHE_CLOG_BANKS);
 }
 
 /*
@@ -712,8 +735,9 @@ void
 BootStrapCLOG(void)
 {
 	int			slotno;
+	LWLock	   *lock = SimpleLruGetBankLock(ClogCtl, 0);
 
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+	LWLockAcquire(lock, LW_EXCLUSIVE);
 
 	/* Create and zero the first page of the commit log */
 	slotno = ZeroCLOGPage(0, false);
@@ -722,7 +746,7 @@ BootStrapCLOG(void)
 	SimpleLruWritePage(ClogCtl, slotno);
 	Assert(!ClogCtl->shared->page_dirty[slotno]);
 
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(lock);
 }
 
 /*
@@ -732,7 +756,7 @@ BootStrapCLOG(void)
  * The page is not actually written, just set up in shared memory.
  * The slot number of the new page is returned.
  *
- * Control lock must be held at entry, and will be held at exit.
+ * The page's bank lock must be held at entry, and will be held at exit.
  */
 static int
 ZeroCLOGPage(int pageno, bool writeXlog)
@@ -757,14 +781,10 @@ StartupCLOG(void)
 	TransactionId xid = XidFromFullTransactionId(ShmemVariableCache->nextFullXid);
 	int			pageno = TransactionIdToPage(xid);
 
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
-
 	/*
 	 * Initialize our idea of the latest page number.
 	 */
-	ClogCtl->shared->latest_page_number = pageno;
-
-	LWLockRelease(CLogControlLock);
+	SimpleLruSetLatestPage(ClogCtl, pageno);
 }
 
 /*
@@ -775,13 +795,14 @@ TrimCLOG(void)
 {
 	TransactionId xid = XidFromFullTransactionId(ShmemVariableCache->nextFullXid);
 	int			pageno = TransactionIdToPage(xid);
-
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+	LWLock	   *lock = SimpleLruGetBankLock(ClogCtl, pageno);
 
 	/*
 	 * Re-Initialize our idea of the latest page number.
 	 */
-	ClogCtl->shared->latest_page_number = pageno;
+	SimpleLruSetLatestPage(ClogCtl, pageno);
+
+	LWLockAcquire(lock, LW_EXCLUSIVE);
 
 	/*
 	 * Zero out the remainder of the current clog page.  Under normal
@@ -813,7 +834,7 @@ TrimCLOG(void)
 		ClogCtl->shared->page_dirty[slotno] = true;
 	}
 
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(lock);
 }
 
 /*
@@ -867,6 +888,7 @@ void
 ExtendCLOG(TransactionId newestXact)
 {
 	int			pageno;
+	LWLock	   *lock;
 
 	/*
 	 * No work except at first XID of a page.  But beware: just after
@@ -877,13 +899,14 @@ ExtendCLOG(TransactionId newestXact)
 		return;
 
 	pageno = TransactionIdToPage(newestXact);
+	lock = SimpleLruGetBankLock(ClogCtl, pageno);
 
-	LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+	LWLockAcquire(lock, LW_EXCLUSIVE);
 
 	/* Zero the page and make an XLOG entry about it */
 	ZeroCLOGPage(pageno, true);
 
-	LWLockRelease(CLogControlLock);
+	LWLockRelease(lock);
 }
 
 
@@ -1011,16 +1034,18 @@ clog_redo(XLogReaderState *record)
 	{
 		int			pageno;
 		int			slotno;
+		LWLock	   *lock;
 
 		memcpy(&pageno, XLogRecGetData(record), sizeof(int));
 
-		LWLockAcquire(CLogControlLock, LW_EXCLUSIVE);
+		lock = SimpleLruGetBankLock(ClogCtl, pageno);
+		LWLockAcquire(lock, LW_EXCLUSIVE);
 
 		slotno = ZeroCLOGPage(pageno, false);
 		SimpleLruWritePage(ClogCtl, slotno);
 		Assert(!ClogCtl->shared->page_dirty[slotno]);
 
-		LWLockRelease(CLogControlLock);
+		LWLockRelease(lock);
 	}
 	else if (info == CLOG_TRUNCATE)
 	{
@@ -1032,7 +1057,7 @@ clog_redo(XLogReaderState *record)
 		 * During XLOG replay, latest_page_number isn't set up yet; insert a
 		 * suitable value to bypass the sanity test in SimpleLruTruncate.
 		 */
-		ClogCtl->shared->latest_page_number = xlrec.pageno;
+		SimpleLruSetLatestPage(ClogCtl, xlrec.pageno);
 
 		AdvanceOldestClogXid(xlrec.oldestXact);
 
@@ -7,30 +7,39 @@
  * buffers.  Under ordinary circumstances we expect that write
  * traffic will occur mostly to the latest page (and to the just-prior
  * page, soon after a page transition).  Read traffic will probably touch
- * a larger span of pages, but in any case a fairly small number of page
- * buffers should be sufficient.  So, we just search the buffers using plain
- * linear search; there's no need for a hashtable or anything fancy.
- * The management algorithm is straight LRU except that we will never swap
- * out the latest page (since we know it's going to be hit again eventually).
+ * a larger span of pages, and some workloads (lots of subtransactions or
+ * multixacts, say) need a pool of hundreds of buffers to avoid thrashing.
  *
- * We use a control LWLock to protect the shared data structures, plus
- * per-buffer LWLocks that synchronize I/O for each buffer.  The control lock
- * must be held to examine or modify any shared state.  A process that is
- * reading in or writing out a page buffer does not hold the control lock,
- * only the per-buffer lock for the buffer it is working on.
+ * The buffers are therefore divided into banks of SLRU_BANK_SIZE slots, and
+ * a page can only be stored in the bank given by its page number modulo the
+ * number of banks.  That mapping serves as our hash table: looking up a page
+ * means a linear search of its bank only, however large the pool is.  The
+ * management algorithm is straight LRU within each bank, except that we will
+ * never swap out the latest page (since we know it's going to be hit again
+ * eventually).
  *
- * "Holding the control lock" means exclusive lock in all cases except for
+ * Each bank is protected by a bank lock, plus there are per-buffer LWLocks
+ * that synchronize I/O for each buffer.  The bank lock must be held to
+ * examine or modify any shared state of the bank's slots.  A process that is
+ * reading in or writing out a page buffer does not hold the bank lock, only
+ * the per-buffer lock for the buffer it is working on.  Callers obtain the
+ * bank lock for a page with SimpleLruGetBankLock().  An SLRU may instead be
+ * given a single control lock at initialization, which then serves as the
+ * bank lock of every bank; that is appropriate for SLRUs that are too small
+ * or too lightly used to benefit from finer-grained locking.
+ *
+ * "Holding the bank lock" means exclusive lock in all cases except for
  * SimpleLruReadPage_ReadOnly(); see comments for SlruRecentlyUsed() for
  * the implications of that.
  *
  * When initiating I/O on a buffer, we acquire the per-buffer lock exclusively
- * before releasing the control lock.  The per-buffer lock is released after
- * completing the I/O, re-acquiring the control lock, and updating the shared
+ * before releasing the bank lock.  The per-buffer lock is released after
+ * completing the I/O, re-acquiring the bank lock, and updating the shared
  * state.  (Deadlock is not possible here, because we never try to initiate
  * I/O when someone else is already doing I/O on the same buffer.)
- * To wait for I/O to complete, release the control lock, acquire the
+ * To wait for I/O to complete, release the bank lock, acquire the
  * per-buffer lock in shared mode, immediately release the per-buffer lock,
- * reacquire the control lock, and then recheck state (since arbitrary things
+ * reacquire the bank lock, and then recheck state (since arbitrary things
  * could have happened while we didn't have the lock).
  *
  * As with the regular buffer manager, it is possible for another process
@@ -58,11 +67,18 @@
 #include "storage/fd.h"
 #include "storage/shmem.h"
 #include "miscadmin.h"
+#include "utils/guc.h"
 
 
 #define SlruFileName(ctl, path, seg) \
 	snprintf(path, MAXPGPATH, "%s/%04X", (ctl)->Dir, seg)
 
+/* Bank holding a page, and the lock protecting a slot's bank */
+#define SlruPageBank(shared, pageno)	((pageno) % (shared)->num_banks)
+#define SlruSlotBankLock(ctl, slotno) \
+	((ctl)->shared->ControlLock != NULL ? (ctl)->shared->ControlLock : \
+	 &(ctl)->shared->bank_locks[(slotno) / SLRU_BANK_SIZE].lock)
+
 /*
  * During SimpleLruFlush(), we will usually not need to write/fsync more
  * than one or two physical files, but we may need to write several pages
@@ -87,13 +103,14 @@ typedef struct SlruFlushData *SlruFlush;
  *
  * The reason for the if-test is that there are often many consecutive
  * accesses to the same page (particularly the latest page).  By suppressing
- * useless increments of cur_lru_count, we reduce the probability that old
- * pages' counts will "wrap around" and make them appear recently used.
+ * useless increments of the bank's LRU counter, we reduce the probability
+ * that old pages' counts will "wrap around" and make them appear recently
+ * used.
  *
  * We allow this code to be executed concurrently by multiple processes within
  * SimpleLruReadPage_ReadOnly().  As long as int reads and writes are atomic,
  * this should not cause any completely-bogus values to enter the computation.
- * However, it is possible for either cur_lru_count or individual
+ * However, it is possible for either the bank's counter or individual
  * page_lru_count entries to be "reset" to lower values than they should have,
  * in case a process is delayed while it executes this macro.  With care in
  * SlruSelectLRUPage(), this does little harm, and in any case the absolute
@@ -102,9 +119,11 @@ typedef struct SlruFlushData *SlruFlush;
  */
 #define SlruRecentlyUsed(shared, slotno)	\
 	do { \
-		int		new_lru_count = (shared)->cur_lru_count; \
+		int	   *bank_lru_count = \
+			&(shared)->bank_cur_lru_count[(slotno) / SLRU_BANK_SIZE]; \
+		int		new_lru_count = *bank_lru_count; \
 		if (new_lru_count != (shared)->page_lru_count[slotno]) { \
-			(shared)->cur_lru_count = ++new_lru_count; \
+			*bank_lru_count = ++new_lru_count; \
 			(shared)->page_lru_count[slotno] = new_lru_count; \
 		} \
 	} while (0)
@@ -132,6 +151,8 @@ static bool SlruPhysicalWritePage(SlruCtl ctl, int pageno, int slotno,
 								  SlruFlush fdata);
 static void SlruReportIOError(SlruCtl ctl, int pageno, TransactionId xid);
 static int	SlruSelectLRUPage(SlruCtl ctl, int pageno);
+static void SlruFlushBank(SlruCtl ctl, int bankno, SlruFlush fdata,
+						  bool allow_redirtied);
 
 static bool SlruScanDirCbDeleteCutoff(SlruCtl ctl, char *filename,
 									  int segpage, void *data);
@@ -144,6 +165,7 @@ static void SlruInternalDeleteSegment(SlruCtl ctl, char *filename);
 Size
 SimpleLruShmemSize(int nslots, int nlsns)
 {
+	int			nbanks = nslots / SLRU_BANK_SIZE;
 	Size		sz;
 
 	/* we assume nslots isn't so large as to risk overflow */
@@ -153,7 +175,9 @@ SimpleLruShmemSize(int nslots, int nlsns)
 	sz += MAXALIGN(nslots * sizeof(bool));	/* page_dirty[] */
 	sz += MAXALIGN(nslots * sizeof(int));	/* page_number[] */
 	sz += MAXALIGN(nslots * sizeof(int));	/* page_lru_count[] */
+	sz += MAXALIGN(nbanks * sizeof(int));	/* bank_cur_lru_count[] */
 	sz += MAXALIGN(nslots * sizeof(LWLockPadded));	/* buffer_locks[] */
+	sz += MAXALIGN(nbanks * sizeof(LWLockPadded));	/* bank_locks[] */
 
 	if (nlsns > 0)
 		sz += MAXALIGN(nslots * nlsns * sizeof(XLogRecPtr));	/* group_lsn[] */
@@ -161,12 +185,54 @@ SimpleLruShmemSize(int nslots, int nlsns)
 	return BUFFERALIGN(sz) + BLCKSZ * nslots;
 }
 
+/*
+ * Compute the number of buffers to use for an SLRU whose buffer-count GUC is
+ * set to 0, meaning "automatic": 1/divisor of shared_buffers, but at least
+ * one bank and at most max buffers, rounded down to a whole number of banks.
+ */
+int
+SimpleLruAutotuneBuffers(int divisor, int max)
+{
+	int			nslots;
+
+	nslots = Min(max, Max(SLRU_BANK_SIZE, NBuffers / divisor));
+	return nslots - (nslots % SLRU_BANK_SIZE);
+}
+
+/*
+ * Helper for the check hooks of the SLRU buffer-count GUCs: the value must be
+ * a whole number of banks.  0 is accepted too, for those GUCs that use it to
+ * mean "automatic".
+ */
+bool
+check_slru_buffers(const char *name, int *newval)
+{
+	if (*newval % SLRU_BANK_SIZE == 0)
+		return true;
+
+	GUC_check_errdetail("\"%s\" must be a multiple of %d.", name,
+						SLRU_BANK_SIZE);
+	return false;
+}
+
+/*
+ * Initialize, or attach to, a simple LRU cache in shared memory.
+ *
+ * nslots must be a multiple of SLRU_BANK_SIZE.  If ctllock is given, it
+ * protects all of the buffers; otherwise a lock is created for each bank,
+ * in tranche bank_tranche_id.  The per-buffer I/O locks are created in
+ * tranche tranche_id.
+ */
 void
 SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
-			  LWLock *ctllock, const char *subdir, int tranche_id)
+			  LWLock *ctllock, const char *subdir, int tranche_id,
+			  int bank_tranche_id)
 {
 	SlruShared	shared;
 	bool		found;
+	int			nbanks = nslots / SLRU_BANK_SIZE;
+
+	Assert(nslots > 0 && nslots % SLRU_BANK_SIZE == 0);
 
 	shared = (SlruShared) ShmemInitStruct(name,
 										  SimpleLruShmemSize(nslots, nlsns),
@@ -178,6 +244,7 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		char	   *ptr;
 		Size		offset;
 		int			slotno;
+		int			bankno;
 
 		Assert(!found);
 
@@ -186,11 +253,11 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		shared->ControlLock = ctllock;
 
 		shared->num_slots = nslots;
+		shared->num_banks = nbanks;
 		shared->lsn_groups_per_page = nlsns;
 
-		shared->cur_lru_count = 0;
-
-		/* shared->latest_page_number will be set later */
+		/* latest_page_number will be set later */
+		pg_atomic_init_u32(&shared->latest_page_number, 0);
 
 		ptr = (char *) shared;
 		offset = MAXALIGN(sizeof(SlruSharedData));
@@ -204,10 +271,14 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		offset += MAXALIGN(nslots * sizeof(int));
 		shared->page_lru_count = (int *) (ptr + offset);
 		offset += MAXALIGN(nslots * sizeof(int));
+		shared->bank_cur_lru_count = (int *) (ptr + offset);
+		offset += MAXALIGN(nbanks * sizeof(int));
 
 		/* Initialize LWLocks */
 		shared->buffer_locks = (LWLockPadded *) (ptr + offset);
 		offset += MAXALIGN(nslots * sizeof(LWLockPadded));
+		shared->bank_locks = (LWLockPadded *) (ptr + offset);
+		offset += MAXALIGN(nbanks * sizeof(LWLockPadded));
 
 		if (nlsns > 0)
 		{
@@ -218,6 +289,17 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		Assert(strlen(name) + 1 < SLRU_MAX_NAME_LENGTH);
 		strlcpy(shared->lwlock_tranche_name, name, SLRU_MAX_NAME_LENGTH);
 		shared->lwlock_tranche_id = tranche_id;
+		snprintf(shared->bank_tranche_name, SLRU_MAX_NAME_LENGTH, "%s_bank",
+				 name);
+		shared->bank_tranche_id = bank_tranche_id;
+
+		for (bankno = 0; bankno < nbanks; bankno++)
+		{
+			if (ctllock == NULL)
+				LWLockInitialize(&shared->bank_locks[bankno].lock,
+								 shared->bank_tranche_id);
+			shared->bank_cur_lru_count[bankno] = 0;
+		}
 
 		ptr += BUFFERALIGN(offset);
 		for (slotno = 0; slotno < nslots; slotno++)
@@ -238,9 +320,12 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 	else
 		Assert(found);
 
-	/* Register SLRU tranche in the main tranches array */
+	/* Register SLRU tranches in the main tranches array */
 	LWLockRegisterTranche(shared->lwlock_tranche_id,
 						  shared->lwlock_tranche_name);
+	if (shared->ControlLock == NULL)
+		LWLockRegisterTranche(shared->bank_tranche_id,
+							  shared->bank_tranche_name);
 
 	/*
 	 * Initialize the unshared control struct, including directory path. We
@@ -257,7 +342,7 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
  * The page is not actually written, just set up in shared memory.
  * The slot number of the new page is returned.
  *
- * Control lock must be held at entry, and will be held at exit.
+ * Bank lock must be held at entry, and will be held at exit.
  */
 int
 SimpleLruZeroPage(SlruCtl ctl, int pageno)
@@ -285,7 +370,7 @@ SimpleLruZeroPage(SlruCtl ctl, int pageno)
 	SimpleLruZeroLSNs(ctl, slotno);
 
 	/* Assume this page is now the latest active page */
-	shared->latest_page_number = pageno;
+	SimpleLruSetLatestPage(ctl, pageno);
 
 	return slotno;
 }
@@ -315,18 +400,19 @@ SimpleLruZeroLSNs(SlruCtl ctl, int slotno)
  * guarantee that new I/O hasn't been started before we return, though.
  * In fact the slot might not even contain the same page anymore.)
  *
- * Control lock must be held at entry, and will be held at exit.
+ * Bank lock must be held at entry, and will be held at exit.
  */
 static void
 SimpleLruWaitIO(SlruCtl ctl, int slotno)
 {
 	SlruShared	shared = ctl->shared;
+	LWLock	   *banklock = SlruSlotBankLock(ctl, slotno);
 
 	/* See notes at top of file */
-	LWLockRelease(shared->ControlLock);
+	LWLockRelease(banklock);
 	LWLockAcquire(&shared->buffer_locks[slotno].lock, LW_SHARED);
 	LWLockRelease(&shared->buffer_locks[slotno].lock);
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
+	LWLockAcquire(banklock, LW_EXCLUSIVE);
 
 	/*
 	 * If the slot is still in an io-in-progress state, then either someone
@@ -369,13 +455,15 @@ SimpleLruWaitIO(SlruCtl ctl, int slotno)
  * Return value is the shared-buffer slot number now holding the page.
  * The buffer's LRU access info is updated.
  *
- * Control lock must be held at entry, and will be held at exit.
+ * The lock of the page's bank must be held at entry, and will be held at
+ * exit.
  */
 int
 SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 				  TransactionId xid)
 {
 	SlruShared	shared = ctl->shared;
+	LWLock	   *banklock = SimpleLruGetBankLock(ctl, pageno);
 
 	/* Outer loop handles restart if we must wait for someone else's I/O */
 	for (;;)
@@ -420,8 +508,8 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 		/* Acquire per-buffer lock (cannot deadlock, see notes at top) */
 		LWLockAcquire(&shared->buffer_locks[slotno].lock, LW_EXCLUSIVE);
 
-		/* Release control lock while doing I/O */
-		LWLockRelease(shared->ControlLock);
+		/* Release bank lock while doing I/O */
+		LWLockRelease(banklock);
 
 		/* Do the read */
 		ok = SlruPhysicalReadPage(ctl, pageno, slotno);
@@ -429,8 +517,8 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 		/* Set the LSNs for this newly read-in page to zero */
 		SimpleLruZeroLSNs(ctl, slotno);
 
-		/* Re-acquire control lock and update page state */
-		LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
+		/* Re-acquire bank lock and update page state */
+		LWLockAcquire(banklock, LW_EXCLUSIVE);
 
 		Assert(shared->page_number[slotno] == pageno &&
 			   shared->page_status[slotno] == SLRU_PAGE_READ_IN_PROGRESS &&
@@ -460,20 +548,23 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
  * Return value is the shared-buffer slot number now holding the page.
  * The buffer's LRU access info is updated.
  *
- * Control lock must NOT be held at entry, but will be held at exit.
- * It is unspecified whether the lock will be shared or exclusive.
+ * The lock of the page's bank must NOT be held at entry, but will be held
+ * at exit.  It is unspecified whether the lock will be shared or exclusive.
  */
 int
 SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
 {
 	SlruShared	shared = ctl->shared;
+	LWLock	   *banklock = SimpleLruGetBankLock(ctl, pageno);
+	int			bankstart = SlruPageBank(shared, pageno) * SLRU_BANK_SIZE;
+	int			bankend = bankstart + SLRU_BANK_SIZE;
 	int			slotno;
 
 	/* Try to find the page while holding only shared lock */
-	LWLockAcquire(shared->ControlLock, LW_SHARED);
+	LWLockAcquire(banklock, LW_SHARED);
 
 	/* See if page is already in a buffer */
-	for (slotno = 0; slotno < shared->num_slots; slotno++)
+	for (slotno = bankstart; slotno < bankend; slotno++)
 	{
 		if (shared->page_number[slotno] == pageno &&
 			shared->page_status[slotno] != SLRU_PAGE_EMPTY &&
@@ -486,8 +577,8 @@ SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
 	}
 
 	/* No luck, so switch to normal exclusive lock and do regular read */
-	LWLockRelease(shared->ControlLock);
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
+	LWLockRelease(banklock);
+	LWLockAcquire(banklock, LW_EXCLUSIVE);
 
 	return SimpleLruReadPage(ctl, pageno, true, xid);
 }
@@ -501,12 +592,14 @@ SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
  * the write).  However, we *do* attempt a fresh write even if the page
  * is already being written; this is for checkpoints.
  *
- * Control lock must be held at entry, and will be held at exit.
+ * The lock of the slot's bank must be held at entry, and will be held at
+ * exit.
  */
 static void
 SlruInternalWritePage(SlruCtl ctl, int slotno, SlruFlush fdata)
 {
 	SlruShared	shared = ctl->shared;
+	LWLock	   *banklock = SlruSlotBankLock(ctl, slotno);
 	int			pageno = shared->page_number[slotno];
 	bool		ok;
 
@@ -536,8 +629,8 @@ SlruInternalWritePage(SlruCtl ctl, int slotno, SlruFlush fdata)
 	/* Acquire per-buffer lock (cannot deadlock, see notes at top) */
 	LWLockAcquire(&shared->buffer_locks[slotno].lock, LW_EXCLUSIVE);
 
-	/* Release control lock while doing I/O */
-	LWLockRelease(shared->ControlLock);
+	/* Release bank lock while doing I/O */
+	LWLockRelease(banklock);
 
 	/* Do the write */
 	ok = SlruPhysicalWritePage(ctl, pageno, slotno, fdata);
@@ -551,8 +644,8 @@ SlruInternalWritePage(SlruCtl ctl, int slotno, SlruFlush fdata)
 			CloseTransientFile(fdata->fd[i]);
 	}
 
-	/* Re-acquire control lock and update page state */
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
+	/* Re-acquire bank lock and update page state */
+	LWLockAcquire(banklock, LW_EXCLUSIVE);
 
 	Assert(shared->page_number[slotno] == pageno &&
 		   shared->page_status[slotno] == SLRU_PAGE_WRITE_IN_PROGRESS);
@@ -964,14 +1057,18 @@ SlruReportIOError(SlruCtl ctl, int pageno, TransactionId xid)
  * any slot already holds the target page, and return that slot if so.
  * Thus, the returned slot is *either* a slot already holding the pageno
  * (could be any state except EMPTY), *or* a freeable slot (state EMPTY
- * or CLEAN).
+ * or CLEAN).  Only the slots of the page's bank are considered.
  *
- * Control lock must be held at entry, and will be held at exit.
+ * The lock of the page's bank must be held at entry, and will be held at
+ * exit.
  */
 static int
 SlruSelectLRUPage(SlruCtl ctl, int pageno)
 {
 	SlruShared	shared = ctl->shared;
+	int			bankno = SlruPageBank(shared, pageno);
+	int			bankstart = bankno * SLRU_BANK_SIZE;
+	int			bankend = bankstart + SLRU_BANK_SIZE;
 
 	/* Outer loop handles restart after I/O */
 	for (;;)
@@ -984,9 +1081,10 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		int			bestinvalidslot = 0;	/* keep compiler quiet */
 		int			best_invalid_delta = -1;
 		int			best_invalid_page_number = 0;	/* keep compiler quiet */
+		int			latest_page_number;
 
 		/* See if page already has a buffer assigned */
-		for (slotno = 0; slotno < shared->num_slots; slotno++)
+		for (slotno = bankstart; slotno < bankend; slotno++)
 		{
 			if (shared->page_number[slotno] == pageno &&
 				shared->page_status[slotno] != SLRU_PAGE_EMPTY)
@@ -1012,16 +1110,17 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		 * acquire the same lru_count values.  In that case we break ties by
 		 * choosing the furthest-back page.
 		 *
-		 * Notice that this next line forcibly advances cur_lru_count to a
-		 * value that is certainly beyond any value that will be in the
+		 * Notice that this next line forcibly advances the bank's LRU counter
+		 * to a value that is certainly beyond any value that will be in the
 		 * page_lru_count array after the loop finishes.  This ensures that
 		 * the next execution of SlruRecentlyUsed will mark the page newly
 		 * used, even if it's for a page that has the current counter value.
 		 * That gets us back on the path to having good data when there are
 		 * multiple pages with the same lru_count.
 		 */
-		cur_count = (shared->cur_lru_count)++;
-		for (slotno = 0; slotno < shared->num_slots; slotno++)
+		cur_count = (shared->bank_cur_lru_count[bankno])++;
+		latest_page_number = SimpleLruGetLatestPage(ctl);
+		for (slotno = bankstart; slotno < bankend; slotno++)
 		{
 			int			this_delta;
 			int			this_page_number;
@@ -1042,7 +1141,7 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 				this_delta = 0;
 			}
 			this_page_number = shared->page_number[slotno];
-			if (this_page_number == shared->latest_page_number)
+			if (this_page_number == latest_page_number)
 				continue;
 			if (shared->page_status[slotno] == SLRU_PAGE_VALID)
 			{
@@ -1071,11 +1170,11 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		}
 
 		/*
-		 * If all pages (except possibly the latest one) are I/O busy, we'll
-		 * have to wait for an I/O to complete and then retry.  In that
-		 * unhappy case, we choose to wait for the I/O on the least recently
-		 * used slot, on the assumption that it was likely initiated first of
-		 * all the I/Os in progress and may therefore finish first.
+		 * If all pages of the bank (except possibly the latest one) are I/O
+		 * busy, we'll have to wait for an I/O to complete and then retry.  In
+		 * that unhappy case, we choose to wait for the I/O on the least
+		 * recently used slot, on the assumption that it was likely initiated
+		 * first of all the I/Os in progress and may therefore finish first.
 		 */
 		if (best_valid_delta < 0)
 		{
@@ -1103,28 +1202,22 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 }
 
 /*
- * Flush dirty pages to disk during checkpoint or database shutdown
+ * Write out the dirty pages of one bank, for SimpleLruFlush.
  */
-void
-SimpleLruFlush(SlruCtl ctl, bool allow_redirtied)
+static void
+SlruFlushBank(SlruCtl ctl, int bankno, SlruFlush fdata, bool allow_redirtied)
 {
-	SlruShared	shared = ctl->shared;
-	SlruFlushData fdata;
+	SlruShared	shared PG_USED_FOR_ASSERTS_ONLY = ctl->shared;
+	int			bankstart = bankno * SLRU_BANK_SIZE;
+	int			bankend = bankstart + SLRU_BANK_SIZE;
+	LWLock	   *banklock = SlruSlotBankLock(ctl, bankstart);
 	int			slotno;
-	int			pageno = 0;
-	int			i;
-	bool		ok;
-
-	/*
-	 * Find and write dirty pages
-	 */
-	fdata.num_files = 0;
 
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
+	LWLockAcquire(banklock, LW_EXCLUSIVE);
 
-	for (slotno = 0; slotno < shared->num_slots; slotno++)
+	for (slotno = bankstart; slotno < bankend; slotno++)
 	{
-		SlruInternalWritePage(ctl, slotno, &fdata);
+		SlruInternalWritePage(ctl, slotno, fdata);
 
 		/*
 		 * In some places (e.g. checkpoints), we cannot assert that the slot
@@ -1137,7 +1230,32 @@ SimpleLruFlush(SlruCtl ctl, bool allow_redirtied)
 				!shared->page_dirty[slotno]));
 	}
 
-	LWLockRelease(shared->ControlLock);
+	LWLockRelease(banklock);
+}
+
+/*
+ * Flush dirty pages to disk during checkpoint or database shutdown
+ *
+ * The banks are processed one at a time, so that we never hold more than one
+ * bank lock.
+ */
+void
+SimpleLruFlush(SlruCtl ctl, bool allow_redirtied)
+{
+	SlruShared	shared = ctl->shared;
+	SlruFlushData fdata;
+	int			bankno;
+	int			pageno = 0;
+	int			i;
+	bool		ok;
+
+	/*
+	 * Find and write dirty pages
+	 */
+	fdata.num_files = 0;
+
+	for (bankno = 0; bankno < shared->num_banks; bankno++)
+		SlruFlushBank(ctl, bankno, &fdata, allow_redirtied);
 
 	/*
 	 * Now fsync and close any files that were open
@@ -1174,7 +1292,7 @@ void
 SimpleLruTruncate(SlruCtl ctl, int cutoffPage)
 {
 	SlruShared	shared = ctl->shared;
-	int			slotno;
+	int			bankno;
 
 	/*
 	 * The cutoff point is the start of the segment containing cutoffPage.
@@ -1182,63 +1300,69 @@ SimpleLruTruncate(SlruCtl ctl, int cutoffPage)
 	cutoffPage -= cutoffPage % SLRU_PAGES_PER_SEGMENT;
 
 	/*
-	 * Scan shared memory and remove any pages preceding the cutoff page, to
-	 * ensure we won't rewrite them later.  (Since this is normally called in
-	 * or just after a checkpoint, any dirty pages should have been flushed
-	 * already ... we're just being extra careful here.)
+	 * Make an important safety check: the planned cutoff point must be <= the
+	 * current endpoint page. Otherwise we have already wrapped around, and
+	 * proceeding with the truncation would risk removing the current segment.
 	 */
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
-
-restart:;
-
-	/*
-	 * While we are holding the lock, make an important safety check: the
-	 * planned cutoff point must be <= the current endpoint page. Otherwise we
-	 * have already wrapped around, and proceeding with the truncation would
-	 * risk removing the current segment.
-	 */
-	if (ctl->PagePrecedes(shared->latest_page_number, cutoffPage))
+	if (ctl->PagePrecedes(SimpleLruGetLatestPage(ctl), cutoffPage))
 	{
-		LWLockRelease(shared->ControlLock);
 		ereport(LOG,
 				(errmsg("could not truncate directory \"%s\": apparent wraparound",
 						ctl->Dir)));
 		return;
 	}
 
-	for (slotno = 0; slotno < shared->num_slots; slotno++)
+	/*
+	 * Scan shared memory and remove any pages preceding the cutoff page, to
+	 * ensure we won't rewrite them later.  (Since this is normally called in
+	 * or just after a checkpoint, any dirty pages should have been flushed
+	 * already ... we're just being extra careful here.)  Each bank is
+	 * processed under its own lock.
+	 */
+	for (bankno = 0; bankno < shared->num_banks; bankno++)
 	{
-		if (shared->page_status[slotno] == SLRU_PAGE_EMPTY)
-			continue;
-		if (!ctl->PagePrecedes(shared->page_number[slotno], cutoffPage))
-			continue;
+		int			bankstart = bankno * SLRU_BANK_SIZE;
+		int			bankend = bankstart + SLRU_BANK_SIZE;
+		LWLock	   *banklock = SlruSlotBankLock(ctl, bankstart);
+		int			slotno;
 
-		/*
-		 * If page is clean, just change state to EMPTY (expected case).
-		 */
-		if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
-			!shared->page_dirty[slotno])
+		LWLockAcquire(banklock, LW_EXCLUSIVE);
+
+restart:
+		for (slotno = bankstart; slotno < bankend; slotno++)
 		{
-			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
-			continue;
+			if (shared->page_status[slotno] == SLRU_PAGE_EMPTY)
+				continue;
+			if (!ctl->PagePrecedes(shared->page_number[slotno], cutoffPage))
+				continue;
+
+			/*
+			 * If page is clean, just change state to EMPTY (expected case).
+			 */
+			if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
+				!shared->page_dirty[slotno])
+			{
+				shared->page_status[slotno] = SLRU_PAGE_EMPTY;
+				continue;
+			}
+
+			/*
+			 * Hmm, we have (or may have) I/O operations acting on the page,
+			 * so we've got to wait for them to finish and then start again.
+			 * This is the same logic as in SlruSelectLRUPage.  (XXX if page
+			 * is dirty, wouldn't it be OK to just discard it without writing
+			 * it?  For now, keep the logic the same as it was.)
+			 */
+			if (shared->page_status[slotno] == SLRU_PAGE_VALID)
+				SlruInternalWritePage(ctl, slotno, NULL);
+			else
+				SimpleLruWaitIO(ctl, slotno);
+			goto restart;
 		}
 
-		/*
-		 * Hmm, we have (or may have) I/O operations acting on the page, so
-		 * we've got to wait for them to finish and then start again. This is
-		 * the same logic as in SlruSelectLRUPage.  (XXX if page is dirty,
-		 * wouldn't it be OK to just discard it without writing it?  For now,
-		 * keep the logic the same as it was.)
-		 */
-		if (shared->page_status[slotno] == SLRU_PAGE_VALID)
-			SlruInternalWritePage(ctl, slotno, NULL);
-		else
-			SimpleLruWaitIO(ctl, slotno);
-		goto restart;
+		LWLockRelease(banklock);
 	}
 
-	LWLockRelease(shared->ControlLock);
-
 	/* Now we can remove the old segment(s) */
 	(void) SlruScanDirectory(ctl, SlruScanDirCbDeleteCutoff, &cutoffPage);
 }
@@ -1267,55 +1391,68 @@ void
 SlruDeleteSegment(SlruCtl ctl, int segno)
 {
 	SlruShared	shared = ctl->shared;
-	int			slotno;
+	int			bankno;
 	char		path[MAXPGPATH];
-	bool		did_write;
 
 	/* Clean out any possibly existing references to the segment. */
-	LWLockAcquire(shared->ControlLock, LW_EXCLUSIVE);
-restart:
-	did_write = false;
-	for (slotno = 0; slotno < shared->num_slots; slotno++)
+	for (bankno = 0; bankno < shared->num_banks; bankno++)
 	{
-		int			pagesegno = shared->page_number[slotno] / SLRU_PAGES_PER_SEGMENT;
+		int			bankstart = bankno * SLRU_BANK_SIZE;
+		int			bankend = bankstart + SLRU_BANK_SIZE;
+		LWLock	   *banklock = SlruSlotBankLock(ctl, bankstart);
+		int			slotno;
+		bool		did_write;
 
-		if (shared->page_status[slotno] == SLRU_PAGE_EMPTY)
-			continue;
+		LWLockAcquire(banklock, LW_EXCLUSIVE);
+restart:
+		did_write = false;
+		for (slotno = bankstart; slotno < bankend; slotno++)
+		{
+			int			pagesegno = shared->page_number[slotno] / SLRU_PAGES_PER_SEGMENT;
 
-		/* not the segment we're looking for */
-		if (pagesegno != segno)
-			continue;
+			if (shared->page_status[slotno] == SLRU_PAGE_EMPTY)
+				continue;
 
-		/* If page is clean, just change state to EMPTY (expected case). */
-		if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
-			!shared->page_dirty[slotno])
-		{
-			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
-			continue;
+			/* not the segment we're looking for */
+			if (pagesegno != segno)
+				continue;
+
+			/* If page is clean, just change state to EMPTY (expected case). */
+			if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
+				!shared->page_dirty[slotno])
+			{
+				shared->page_status[slotno] = SLRU_PAGE_EMPTY;
+				continue;
+			}
+
+			/* Same logic as SimpleLruTruncate() */
+			if (shared->page_status[slotno] == SLRU_PAGE_VALID)
+				SlruInternalWritePage(ctl, slotno, NULL);
+			else
+				SimpleLruWaitIO(ctl, slotno);
+
+			did_write = true;
 		}
 
-		/* Same logic as SimpleLruTruncate() */
-		if (shared->page_status[slotno] == SLRU_PAGE_VALID)
-			SlruInternalWritePage(ctl, slotno, NULL);
-		else
-			SimpleLruWaitIO(ctl, slotno);
+		/*
+		 * Be extra careful and re-check. The IO functions release the bank
+		 * lock, so new pages could have been read in.
+		 */
+		if (did_write)
+			goto restart;
 
-		did_write = true;
+		LWLockRelease(banklock);
 	}
 
 	/*
-	 * Be extra careful and re-check. The IO functions release the control
-	 * lock, so new pages could have been read in.
+	 * The caller must ensure that no one is going to read in pages of this
+	 * segment again, so it's safe to remove the file now that the buffers
+	 * have been cleaned out.
 	 */
-	if (did_write)
-		goto restart;
-
 	snprintf(path, MAXPGPATH, "%s/%04X", ctl->Dir, segno);
 	ereport(DEBUG2,
 			(errmsg("removing file \"%s\"", path)));
 	unlink(path);
-
-	LWLockRelease(shared->ControlLock);
 }
 
 /*
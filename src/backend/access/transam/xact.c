@@ -189,6 +189,7 @@ typedef struct TransactionStateData
 	bool		prevXactReadOnly;	/* entry-time xact r/o state */
 	bool		startedInRecovery;	/* did we start in recovery? */
 	bool		didLogXid;		/* has xid been included in WAL record? */
+	bool		topXidLogged;	/* has top-level xid been logged? */
 	int			parallelModeLevel;	/* Enter/ExitParallelMode counter */
 	bool		chain;			/* start a new block after this one */
 	struct TransactionStateData *parent;	/* back link to parent */
@@ -207,6 +208,7 @@ typedef struct SerializedTransactionState
 	FullTransactionId topFullTransactionId;
 	FullTransactionId currentFullTransactionId;
 	CommandId	currentCommandId;
+	bool		currentCommandIdUsed;
 	int			nParallelCurrentXids;
 	TransactionId parallelCurrentXids[FLEXIBLE_ARRAY_MEMBER];
 } SerializedTransactionState;
@@ -513,6 +515,54 @@ MarkCurrentTransactionIdLoggedIfAny(void)
 		CurrentTransactionState->didLogXid = true;
 }
 
+/*
+ *	IsSubxactTopXidLogPending
+ *
+ * This is used to decide whether we need to WAL log the top-level XID along
+ * with the first record of a subtransaction.  Logical decoding needs that to
+ * associate subtransactions with their top-level transaction before commit,
+ * so that large in-progress transactions can be streamed.
+ */
+bool
+IsSubxactTopXidLogPending(void)
+{
+	/* check whether it is already logged */
+	if (CurrentTransactionState->topXidLogged)
+		return false;
+
+	/* wal_level has to be logical */
+	if (!XLogLogicalInfoActive())
+		return false;
+
+	/* we need to be in a transaction state */
+	if (!IsTransactionState())
+		return false;
+
+	/* it has to be a subtransaction */
+	if (!IsSubTransaction())
+		return false;
+
+	/* the subtransaction has to have a XID assigned */
+	if (!FullTransactionIdIsValid(CurrentTransactionState->fullTransactionId))
+		return false;
+
+	return true;
+}
+
+/*
+ *	MarkSubxactTopXidLogged
+ *
+ * Remember that the top-level XID has been included in a WAL record written
+ * by the current subtransaction.
+ */
+void
+MarkSubxactTopXidLogged(void)
+{
+	Assert(IsSubxactTopXidLogPending());
+
+	CurrentTransactionState->topXidLogged = true;
+}
+
 
 /*
  *	GetStableLatestTransactionId
@@ -750,11 +800,13 @@ GetCurrentCommandId(bool used)
 	{
 		/*
 		 * Forbid setting currentCommandIdUsed in a parallel worker, because
-		 * we have no provision for communicating this back to the master.  We
-		 * could relax this restriction when currentCommandIdUsed was already
-		 * true at the start of the parallel operation.
+		 * we have no provision for communicating this back to the master.
+		 * It's OK if currentCommandIdUsed was already true at the start of
+		 * the parallel operation, as it is for parallel COPY FROM, since then
+		 * there is nothing to communicate.
 		 */
-		Assert(!IsParallelWorker());
+		if (IsParallelWorker() && !currentCommandIdUsed)
+			elog(ERROR, "cannot modify data in a parallel worker");
 		currentCommandIdUsed = true;
 	}
 	return currentCommandId;
@@ -5168,6 +5220,7 @@ SerializeTransactionState(Size maxsize, char *start_address)
 	result->currentFullTransactionId =
 		CurrentTransactionState->fullTransactionId;
 	result->currentCommandId = currentCommandId;
+	result->currentCommandIdUsed = currentCommandIdUsed;
 
 	/*
 	 * If we're running in a parallel worker and launching a parallel worker
@@ -5236,6 +5289,7 @@ StartParallelWorkerTransaction(char *tstatespace)
 	CurrentTransactionState->fullTransactionId =
 		tstate->currentFullTransactionId;
 	currentCommandId = tstate->currentCommandId;
+	currentCommandIdUsed = tstate->currentCommandIdUsed;
 	nParallelCurrentXids = tstate->nParallelCurrentXids;
 	ParallelCurrentXids = &tstate->parallelCurrentXids[0];
 
@@ -0,0 +1,482 @@
+/*-------------------------------------------------------------------------
+ *
+ * xlogprefetch.c
+ *		Prefetching support for recovery.
+ *
+ * Replay is performed by a single process, which reads each data block that
+ * a WAL record references just before applying the record.  When the blocks
+ * aren't cached, replay is therefore limited by the latency of one random
+ * read at a time.  To avoid that, the startup process uses an XLogPrefetcher
+ * to decode the WAL some distance ahead of the record being replayed, and to
+ * initiate reads of the blocks that upcoming records will need.  Depending on
+ * io_method, a read is either queued for an io worker, which loads the block
+ * into shared buffers, or passed to the kernel as a hint.
+ *
+ * The prefetcher uses its own xlogreader, which reads only WAL that is
+ * already present in pg_wal; if WAL is being restored from an archive or
+ * hasn't arrived yet, we simply stop looking ahead until replay catches up.
+ * Blocks are not prefetched if they're already in shared buffers, if the
+ * record carries a full-page image or initializes the page, or if they
+ * were referenced by one of the last few records.  Nor do we prefetch
+ * blocks of relations that don't exist yet or blocks beyond the current
+ * end of a relation; such relations are filtered out until replay has
+ * caught up with the record that referenced them, since earlier records
+ * may be about to create or extend them.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *		src/backend/access/transam/xlogprefetch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogprefetch.h"
+#include "access/xlogreader.h"
+#include "catalog/pg_class.h"
+#include "lib/ilist.h"
+#include "pgstat.h"
+#include "replication/walreceiver.h"
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/smgr.h"
+#include "utils/hsearch.h"
+
+/*
+ * Number of recently prefetched blocks to remember, so that we don't keep
+ * prefetching a block that a run of records modifies in turn.
+ */
+#define XLOGPREFETCHER_RECENT_BLOCKS 8
+
+/*
+ * Initial size of the table of filtered relations.
+ */
+#define XLOGPREFETCHER_FILTER_SIZE 64
+
+/* GUC variable */
+int			max_recovery_prefetch_distance = 256 * 1024;
+
+/*
+ * A relation for which we don't prefetch blocks >= filter_from_block until
+ * the record at filter_until_replayed has been replayed.
+ */
+typedef struct XLogPrefetcherFilter
+{
+	RelFileNode rnode;			/* hash key ... must be first */
+	XLogRecPtr	filter_until_replayed;
+	BlockNumber filter_from_block;
+	dlist_node	link;
+} XLogPrefetcherFilter;
+
+/*
+ * A block that was recently considered for prefetching.
+ */
+typedef struct XLogPrefetcherRecentBlock
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+	BlockNumber blkno;
+} XLogPrefetcherRecentBlock;
+
+struct XLogPrefetcher
+{
+	/* Reader used to look ahead of replay */
+	XLogReaderState *reader;
+
+	/* The WAL segment file the reader has open, if any */
+	int			readFile;
+	XLogSegNo	readSegNo;
+	TimeLineID	readTLI;
+
+	/* Position of the record being replayed when last called */
+	XLogRecPtr	replaying_lsn;
+
+	/* Don't read ahead again until replay has reached this point */
+	XLogRecPtr	no_readahead_until;
+
+	/* Relations being filtered out, and the same ordered by LSN */
+	HTAB	   *filter_table;
+	dlist_head	filter_queue;
+
+	/* Circular buffer of recently seen blocks */
+	XLogPrefetcherRecentBlock recent[XLOGPREFETCHER_RECENT_BLOCKS];
+	int			recent_idx;
+
+	/* Counters, reported at the end of recovery */
+	uint64		prefetch;		/* reads initiated */
+	uint64		skip_hit;		/* block already in shared buffers */
+	uint64		skip_fpw;		/* record has a full-page image */
+	uint64		skip_init;		/* record initializes the page */
+	uint64		skip_new;		/* relation or block doesn't exist yet */
+	uint64		skip_seq;		/* block was referenced very recently */
+};
+
+static int	XLogPrefetcherReadPage(XLogReaderState *reader,
+								   XLogRecPtr targetPagePtr, int reqLen,
+								   XLogRecPtr targetRecPtr, char *readBuf,
+								   TimeLineID *pageTLI);
+static void XLogPrefetcherScanBlocks(XLogPrefetcher *prefetcher);
+static bool XLogPrefetcherIsRecent(XLogPrefetcher *prefetcher,
+								   DecodedBkpBlock *block);
+static void XLogPrefetcherAddFilter(XLogPrefetcher *prefetcher,
+									RelFileNode rnode, BlockNumber blkno,
+									XLogRecPtr lsn);
+static bool XLogPrefetcherIsFiltered(XLogPrefetcher *prefetcher,
+									 RelFileNode rnode, BlockNumber blkno);
+static void XLogPrefetcherCompleteFilters(XLogPrefetcher *prefetcher,
+										  XLogRecPtr replaying_lsn);
+
+/*
+ * Create a prefetcher for use by the startup process.
+ */
+XLogPrefetcher *
+XLogPrefetcherAllocate(void)
+{
+	XLogPrefetcher *prefetcher;
+	HASHCTL		hash_ctl;
+
+	prefetcher = palloc0(sizeof(XLogPrefetcher));
+	prefetcher->reader = XLogReaderAllocate(wal_segment_size,
+											XLogPrefetcherReadPage,
+											prefetcher);
+	if (prefetcher->reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed while allocating a WAL reading processor.")));
+	prefetcher->readFile = -1;
+
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = sizeof(RelFileNode);
+	hash_ctl.entrysize = sizeof(XLogPrefetcherFilter);
+	prefetcher->filter_table = hash_create("XLogPrefetcherFilterTable",
+										   XLOGPREFETCHER_FILTER_SIZE,
+										   &hash_ctl,
+										   HASH_ELEM | HASH_BLOBS);
+	dlist_init(&prefetcher->filter_queue);
+
+	return prefetcher;
+}
+
+/*
+ * Destroy a prefetcher, reporting what it achieved.
+ */
+void
+XLogPrefetcherFree(XLogPrefetcher *prefetcher)
+{
+	elog(DEBUG1,
+		 "recovery prefetch: " UINT64_FORMAT " blocks prefetched, "
+		 UINT64_FORMAT " already cached, " UINT64_FORMAT " full-page images, "
+		 UINT64_FORMAT " initialized, " UINT64_FORMAT " new, "
+		 UINT64_FORMAT " repeated",
+		 prefetcher->prefetch, prefetcher->skip_hit, prefetcher->skip_fpw,
+		 prefetcher->skip_init, prefetcher->skip_new, prefetcher->skip_seq);
+
+	if (prefetcher->readFile >= 0)
+		close(prefetcher->readFile);
+	XLogReaderFree(prefetcher->reader);
+	hash_destroy(prefetcher->filter_table);
+	pfree(prefetcher);
+}
+
+/*
+ * Called by the startup process before it replays the record starting at
+ * replaying_lsn.  Decode records ahead of that point, up to
+ * max_recovery_prefetch_distance bytes, and initiate reads of the blocks
+ * they reference.
+ */
+void
+XLogPrefetcherReadAhead(XLogPrefetcher *prefetcher, XLogRecPtr replaying_lsn)
+{
+	XLogReaderState *reader = prefetcher->reader;
+
+	prefetcher->replaying_lsn = replaying_lsn;
+	XLogPrefetcherCompleteFilters(prefetcher, replaying_lsn);
+
+	if (max_recovery_prefetch_distance <= 0)
+		return;
+
+	/* Did we recently fail to read further ahead? */
+	if (replaying_lsn < prefetcher->no_readahead_until)
+		return;
+
+	for (;;)
+	{
+		XLogRecPtr	start_lsn;
+		XLogRecord *record;
+		char	   *errormsg;
+
+		if (reader->EndRecPtr <= replaying_lsn)
+		{
+			/*
+			 * We're not ahead of replay, either because this is the first
+			 * call or because we had to stop for a while.  Resume at the
+			 * record being replayed, which is known to be a valid starting
+			 * point.
+			 */
+			start_lsn = replaying_lsn;
+		}
+		else
+		{
+			/* Stop if we're far enough ahead */
+			if (reader->EndRecPtr - replaying_lsn >=
+				(XLogRecPtr) max_recovery_prefetch_distance)
+				break;
+			start_lsn = InvalidXLogRecPtr;
+		}
+
+		record = XLogReadRecord(reader, start_lsn, &errormsg);
+		if (record == NULL)
+		{
+			/*
+			 * The next record isn't available to us, or isn't valid.  Either
+			 * way, there's no point in trying again before replay has caught
+			 * up with us.  If we couldn't even read the record being
+			 * replayed, give up for the rest of the current WAL page.
+			 */
+			if (start_lsn != InvalidXLogRecPtr)
+				prefetcher->no_readahead_until =
+					start_lsn + (XLOG_BLCKSZ - start_lsn % XLOG_BLCKSZ);
+			else
+				prefetcher->no_readahead_until = reader->EndRecPtr;
+			break;
+		}
+
+		XLogPrefetcherScanBlocks(prefetcher);
+	}
+}
+
+/*
+ * Initiate reads of the blocks referenced by the record the prefetcher's
+ * reader has just decoded, where worthwhile.
+ */
+static void
+XLogPrefetcherScanBlocks(XLogPrefetcher *prefetcher)
+{
+	XLogReaderState *reader = prefetcher->reader;
+	int			block_id;
+
+	for (block_id = 0; block_id <= reader->max_block_id; block_id++)
+	{
+		DecodedBkpBlock *block = &reader->blocks[block_id];
+		SMgrRelation reln;
+
+		if (!block->in_use)
+			continue;
+
+		/* Replay will overwrite the page without reading it */
+		if (block->has_image && block->apply_image)
+		{
+			prefetcher->skip_fpw++;
+			continue;
+		}
+		if (block->flags & BKPBLOCK_WILL_INIT)
+		{
+			prefetcher->skip_init++;
+			continue;
+		}
+
+		if (XLogPrefetcherIsRecent(prefetcher, block))
+		{
+			prefetcher->skip_seq++;
+			continue;
+		}
+
+		if (XLogPrefetcherIsFiltered(prefetcher, block->rnode, block->blkno))
+		{
+			prefetcher->skip_new++;
+			continue;
+		}
+
+		/*
+		 * If the relation or block doesn't exist yet, an earlier record is
+		 * presumably going to create it.  Leave the relation alone until
+		 * this record has been replayed.
+		 */
+		reln = smgropen(block->rnode, InvalidBackendId);
+		if (!smgrexists(reln, block->forknum))
+		{
+			XLogPrefetcherAddFilter(prefetcher, block->rnode, 0,
+									reader->ReadRecPtr);
+			prefetcher->skip_new++;
+			continue;
+		}
+		if (block->blkno >= smgrnblocks(reln, block->forknum))
+		{
+			XLogPrefetcherAddFilter(prefetcher, block->rnode, block->blkno,
+									reader->ReadRecPtr);
+			prefetcher->skip_new++;
+			continue;
+		}
+
+		/* Everything replayed is permanent, as in XLogReadBufferExtended */
+		if (PrefetchSharedBuffer(reln, RELPERSISTENCE_PERMANENT,
+								 block->forknum, block->blkno, NULL))
+			prefetcher->prefetch++;
+		else
+			prefetcher->skip_hit++;
+	}
+}
+
+/*
+ * Check whether a block was among the last few considered, and remember it
+ * if not.
+ */
+static bool
+XLogPrefetcherIsRecent(XLogPrefetcher *prefetcher, DecodedBkpBlock *block)
+{
+	XLogPrefetcherRecentBlock *recent;
+	int			i;
+
+	for (i = 0; i < XLOGPREFETCHER_RECENT_BLOCKS; i++)
+	{
+		recent = &prefetcher->recent[i];
+		if (recent->blkno == block->blkno &&
+			recent->forknum == block->forknum &&
+			RelFileNodeEquals(recent->rnode, block->rnode))
+			return true;
+	}
+
+	recent = &prefetcher->recent[prefetcher->recent_idx];
+	recent->rnode = block->rnode;
+	recent->forknum = block->forknum;
+	recent->blkno = block->blkno;
+	prefetcher->recent_idx =
+		(prefetcher->recent_idx + 1) % XLOGPREFETCHER_RECENT_BLOCKS;
+
+	return false;
+}
+
+/*
+ * Don't prefetch blocks >= blkno of a relation until the record at lsn has
+ * been replayed.
+ */
+static void
+XLogPrefetcherAddFilter(XLogPrefetcher *prefetcher, RelFileNode rnode,
+						BlockNumber blkno, XLogRecPtr lsn)
+{
+	XLogPrefetcherFilter *filter;
+	bool		found;
+
+	filter = hash_search(prefetcher->filter_table, &rnode, HASH_ENTER, &found);
+	if (!found)
+	{
+		filter->filter_until_replayed = lsn;
+		filter->filter_from_block = blkno;
+		dlist_push_tail(&prefetcher->filter_queue, &filter->link);
+	}
+	else
+	{
+		/* Records are decoded in LSN order, so keep the queue ordered */
+		filter->filter_until_replayed = lsn;
+		filter->filter_from_block = Min(filter->filter_from_block, blkno);
+		dlist_delete(&filter->link);
+		dlist_push_tail(&prefetcher->filter_queue, &filter->link);
+	}
+}
+
+/*
+ * Check whether a block is covered by a filter.
+ */
+static bool
+XLogPrefetcherIsFiltered(XLogPrefetcher *prefetcher, RelFileNode rnode,
+						 BlockNumber blkno)
+{
+	XLogPrefetcherFilter *filter;
+
+	if (dlist_is_empty(&prefetcher->filter_queue))
+		return false;
+
+	filter = hash_search(prefetcher->filter_table, &rnode, HASH_FIND, NULL);
+
+	return filter != NULL && filter->filter_from_block <= blkno;
+}
+
+/*
+ * Remove the filters whose records have now been replayed.
+ */
+static void
+XLogPrefetcherCompleteFilters(XLogPrefetcher *prefetcher,
+							  XLogRecPtr replaying_lsn)
+{
+	while (!dlist_is_empty(&prefetcher->filter_queue))
+	{
+		XLogPrefetcherFilter *filter;
+
+		filter = dlist_head_element(XLogPrefetcherFilter, link,
+									&prefetcher->filter_queue);
+		if (filter->filter_until_replayed >= replaying_lsn)
+			break;
+
+		dlist_delete(&filter->link);
+		hash_search(prefetcher->filter_table, &filter->rnode, HASH_REMOVE,
+					NULL);
+	}
+}
+
+/*
+ * xlogreader callback: read a WAL page from pg_wal.
+ *
+ * Unlike the startup process's own callback, this never waits for WAL to
+ * arrive or restores it from the archive; if the requested data isn't there,
+ * we just report failure.  While a WAL receiver is running, we don't read
+ * past what it has written, to avoid reading partially written pages.
+ */
+static int
+XLogPrefetcherReadPage(XLogReaderState *reader, XLogRecPtr targetPagePtr,
+					   int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
+					   TimeLineID *pageTLI)
+{
+	XLogPrefetcher *prefetcher = (XLogPrefetcher *) reader->private_data;
+	XLogSegNo	targetSegNo;
+	uint32		targetPageOff;
+	int			count = XLOG_BLCKSZ;
+	int			nread;
+
+	if (WalRcvRunning())
+	{
+		XLogRecPtr	receivedUpto = GetWalRcvWriteRecPtr(NULL, NULL);
+
+		if (targetPagePtr + reqLen > receivedUpto)
+			return -1;
+		if (targetPagePtr + XLOG_BLCKSZ > receivedUpto)
+			count = receivedUpto - targetPagePtr;
+	}
+
+	XLByteToSeg(targetPagePtr, targetSegNo, wal_segment_size);
+	targetPageOff = XLogSegmentOffset(targetPagePtr, wal_segment_size);
+
+	/* Switch to the right segment file, if necessary */
+	if (prefetcher->readFile < 0 ||
+		prefetcher->readSegNo != targetSegNo ||
+		prefetcher->readTLI != ThisTimeLineID)
+	{
+		char		path[MAXPGPATH];
+
+		if (prefetcher->readFile >= 0)
+			close(prefetcher->readFile);
+
+		XLogFilePath(path, ThisTimeLineID, targetSegNo, wal_segment_size);
+		prefetcher->readFile = BasicOpenFile(path, O_RDONLY | PG_BINARY);
+		if (prefetcher->readFile < 0)
+			return -1;
+		prefetcher->readSegNo = targetSegNo;
+		prefetcher->readTLI = ThisTimeLineID;
+	}
+
+	pgstat_report_wait_start(WAIT_EVENT_WAL_READ);
+	nread = pg_pread(prefetcher->readFile, readBuf, count, targetPageOff);
+	pgstat_report_wait_end();
+	if (nread < reqLen)
+		return -1;
+
+	*pageTLI = prefetcher->readTLI;
+
+	return nread;
+}
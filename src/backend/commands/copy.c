@@ -18,14 +18,17 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include "access/genam.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/sysattr.h"
 #include "access/tableam.h"
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/dependency.h"
 #include "catalog/pg_authid.h"
+#include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
@@ -39,15 +42,20 @@
 #include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "optimizer/clauses.h"
 #include "optimizer/optimizer.h"
 #include "nodes/makefuncs.h"
 #include "parser/parse_coerce.h"
 #include "parser/parse_collate.h"
 #include "parser/parse_expr.h"
 #include "parser/parse_relation.h"
+#include "pgstat.h"
 #include "port/pg_bswap.h"
+#include "postmaster/bgworker_internals.h"
 #include "rewrite/rewriteHandler.h"
+#include "storage/condition_variable.h"
 #include "storage/fd.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -57,6 +65,7 @@
 #include "utils/rel.h"
 #include "utils/rls.h"
 #include "utils/snapmgr.h"
+#include "utils/typcache.h"
 
 
 #define ISOCTAL(c) (((c) >= '0') && ((c) <= '7'))
@@ -135,6 +144,8 @@ typedef struct CopyStateData
 	copy_data_source_cb data_source_cb; /* function for reading data */
 	bool		binary;			/* binary format? */
 	bool		freeze;			/* freeze rows on loading? */
+	int			nworkers;		/* number of parallel workers for COPY FROM,
+								 * or 0 */
 	bool		csv_mode;		/* Comma Separated Value format? */
 	bool		header_line;	/* CSV header line? */
 	char	   *null_print;		/* NULL marker string (server encoding!) */
@@ -350,6 +361,84 @@ if (1) \
 
 static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 
+/*
+ * DSM keys for parallel COPY FROM.  Since we don't need to worry about DSM
+ * keys conflicting with plan_node_id we can use small integers.
+ */
+#define PARALLEL_COPY_KEY_SHARED		1
+#define PARALLEL_COPY_KEY_RANGE_TABLE	2
+#define PARALLEL_COPY_KEY_ATTNAMELIST	3
+#define PARALLEL_COPY_KEY_OPTIONS		4
+#define PARALLEL_COPY_KEY_WHERE_CLAUSE	5
+#define PARALLEL_COPY_KEY_QUERY_TEXT	6
+
+/*
+ * Size of a chunk of input handed to a parallel COPY FROM worker, and number
+ * of chunks in the ring per worker.
+ */
+#define PARALLEL_COPY_CHUNK_SIZE		65536
+#define PARALLEL_COPY_CHUNKS_PER_WORKER	4
+
+/*
+ * A chunk of input lines, in server encoding, in the ring shared between the
+ * parallel COPY FROM leader and its workers.  A chunk holds only complete
+ * lines, except that a line too long to fit is split over several
+ * consecutive chunks, all of which are processed by the worker that takes
+ * the first one.
+ */
+typedef struct ParallelCopyChunk
+{
+	bool		full;			/* filled by the leader and not yet taken? */
+	bool		partial;		/* does the last line continue in the next
+								 * chunk? */
+	bool		continued;		/* does the first line begin in the previous
+								 * chunk? */
+	int			len;			/* number of bytes of data */
+	uint64		first_lineno;	/* input line number of the first line */
+	char		data[PARALLEL_COPY_CHUNK_SIZE];
+} ParallelCopyChunk;
+
+/*
+ * Shared information for parallel COPY FROM, in the DSM segment.
+ *
+ * Chunk number n lives in chunks[n % nchunks].  The leader fills chunks in
+ * order, waiting for each slot to be taken before it reuses it.  Workers
+ * claim the chunks in order as well, except for continued chunks, which are
+ * left to the worker that claimed the chunk before.
+ */
+typedef struct ParallelCopyShared
+{
+	Oid			relid;			/* target table */
+	int			nchunks;		/* number of slots in the ring */
+
+	slock_t		mutex;			/* protects the following, and chunks' "full"
+								 * flags */
+	uint64		nfilled;		/* number of chunks filled by the leader */
+	uint64		nclaimed;		/* number of chunks claimed by workers */
+	bool		eof;			/* has the leader reached end of input? */
+
+	ConditionVariable chunk_ready_cv;	/* signaled when a chunk is filled */
+	ConditionVariable chunk_free_cv;	/* signaled when a chunk is taken */
+
+	pg_atomic_uint64 processed; /* number of tuples inserted by workers */
+
+	ParallelCopyChunk chunks[FLEXIBLE_ARRAY_MEMBER];
+} ParallelCopyShared;
+
+/* Working state of a parallel COPY FROM worker, see ParallelCopyGetData */
+typedef struct ParallelCopyWorkerState
+{
+	ParallelCopyShared *shared;
+	CopyState	cstate;			/* the worker's own COPY FROM */
+	uint64		chunkno;		/* number of the chunk last taken */
+	bool		partial;		/* does its last line continue? */
+	char	   *buf;			/* copy of its data */
+	int			len;			/* number of bytes in buf */
+	int			pos;			/* next byte of buf to return */
+} ParallelCopyWorkerState;
+
+static ParallelCopyWorkerState *ParallelCopyWorker = NULL;
+
 
 /* non-export function prototypes */
 static CopyState BeginCopy(ParseState *pstate, bool is_from, Relation rel,
@@ -378,6 +467,17 @@ static void CopyAttributeOutCSV(CopyState cstate, char *string,
 static List *CopyGetAttnums(TupleDesc tupDesc, Relation rel,
 							List *attnamelist);
 static char *limit_printout_length(const char *str);
+static bool CopyFromIsParallelSafe(CopyState cstate, const char **reason);
+static uint64 ParallelCopyFrom(CopyState cstate, List *attnamelist,
+							   List *options);
+static ParallelCopyChunk *ParallelCopyNextFreeChunk(ParallelCopyShared *shared);
+static void ParallelCopyPublishChunk(ParallelCopyShared *shared,
+									 ParallelCopyChunk *chunk,
+									 bool partial, bool eof);
+static void ParallelCopyStoreString(ParallelContext *pcxt, uint64 key,
+									const char *str);
+static bool ParallelCopyTakeChunk(ParallelCopyWorkerState *worker);
+static int	ParallelCopyGetData(void *outbuf, int minread, int maxread);
 
 /* Low-level communications functions */
 static void SendCopyBegin(CopyState cstate);
@@ -1069,7 +1169,24 @@ DoCopy(ParseState *pstate, const CopyStmt *stmt,
 		cstate = BeginCopyFrom(pstate, rel, stmt->filename, stmt->is_program,
 							   NULL, stmt->attlist, stmt->options);
 		cstate->whereClause = whereClause;
-		*processed = CopyFrom(cstate);	/* copy from file to database */
+		if (cstate->nworkers > 0)
+		{
+			const char *reason;
+
+			if (CopyFromIsParallelSafe(cstate, &reason))
+				*processed = ParallelCopyFrom(cstate, stmt->attlist,
+											  stmt->options);
+			else
+			{
+				ereport(WARNING,
+						(errmsg("disabling parallel option of COPY FROM on \"%s\"",
+								RelationGetRelationName(rel)),
+						 errdetail_internal("%s", _(reason))));
+				*processed = CopyFrom(cstate);
+			}
+		}
+		else
+			*processed = CopyFrom(cstate);	/* copy from file to database */
 		EndCopyFrom(cstate);
 	}
 	else
@@ -1114,6 +1231,7 @@ ProcessCopyOptions(ParseState *pstate,
 				   List *options)
 {
 	bool		format_specified = false;
+	bool		parallel_specified = false;
 	ListCell   *option;
 
 	/* Support external use for option sanity checking */
@@ -1276,6 +1394,25 @@ ProcessCopyOptions(ParseState *pstate,
 								defel->defname),
 						 parser_errposition(pstate, defel->location)));
 		}
+		else if (strcmp(defel->defname, "parallel") == 0)
+		{
+			int			nworkers;
+
+			if (parallel_specified)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options"),
+						 parser_errposition(pstate, defel->location)));
+			parallel_specified = true;
+			nworkers = defGetInt32(defel);
+			if (nworkers < 0 || nworkers > MAX_PARALLEL_WORKER_LIMIT)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("argument to option \"%s\" must be between 0 and %d",
+								defel->defname, MAX_PARALLEL_WORKER_LIMIT),
+						 parser_errposition(pstate, defel->location)));
+			cstate->nworkers = nworkers;
+		}
 		else if (strcmp(defel->defname, "encoding") == 0)
 		{
 			if (cstate->file_encoding >= 0)
@@ -1429,6 +1566,22 @@ ProcessCopyOptions(ParseState *pstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY force null only available using COPY FROM")));
 
+	/* Check parallel */
+	if (cstate->nworkers > 0 && !is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY parallel only available using COPY FROM")));
+
+	if (cstate->nworkers > 0 && cstate->binary)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot specify PARALLEL in BINARY mode")));
+
+	if (cstate->nworkers > 0 && cstate->freeze)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot specify both FREEZE and PARALLEL options")));
+
 	/* Don't allow the delimiter to appear in the null string. */
 	if (strchr(cstate->null_print, cstate->delim[0]) != NULL)
 		ereport(ERROR,
@@ -3374,6 +3527,575 @@ CopyFrom(CopyState cstate)
 	return processed;
 }
 
+/*
+ * Check whether COPY FROM into cstate->rel can be carried out by parallel
+ * workers.  If not, *reason is set to a (translatable) description of the
+ * obstacle.
+ *
+ * The workers run the input functions, default expressions, WHERE clause,
+ * CHECK constraints, and index expressions and predicates, so all of those
+ * must be parallel safe.  They can't queue AFTER trigger events for the
+ * leader, so the table must have no triggers and no deferred unique or
+ * exclusion constraints.
+ */
+static bool
+CopyFromIsParallelSafe(CopyState cstate, const char **reason)
+{
+	Relation	rel = cstate->rel;
+	TupleDesc	tupDesc = RelationGetDescr(rel);
+	List	   *indexoidlist;
+	ListCell   *lc;
+	int			attnum;
+	bool		safe = true;
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+	{
+		*reason = gettext_noop("Only plain tables can be loaded in parallel.");
+		return false;
+	}
+
+	if (RelationUsesLocalBuffers(rel))
+	{
+		*reason = gettext_noop("Temporary tables cannot be loaded in parallel.");
+		return false;
+	}
+
+	if (rel->trigdesc != NULL)
+	{
+		*reason = gettext_noop("Tables with triggers cannot be loaded in parallel.");
+		return false;
+	}
+
+	for (attnum = 1; attnum <= tupDesc->natts; attnum++)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupDesc, attnum - 1);
+
+		if (att->attisdropped)
+			continue;
+
+		if (list_member_int(cstate->attnumlist, attnum))
+		{
+			/* Column read from the input */
+			if (func_parallel(cstate->in_functions[attnum - 1].fn_oid) != PROPARALLEL_SAFE ||
+				DomainHasConstraints(att->atttypid))
+				safe = false;
+		}
+		else
+		{
+			/* Column filled in from its default or generation expression */
+			if (!is_parallel_safe_expr(build_column_default(rel, attnum)))
+				safe = false;
+		}
+	}
+
+	if (cstate->whereClause && !is_parallel_safe_expr(cstate->whereClause))
+		safe = false;
+
+	if (tupDesc->constr)
+	{
+		int			i;
+
+		for (i = 0; i < tupDesc->constr->num_check; i++)
+		{
+			Node	   *checkexpr = stringToNode(tupDesc->constr->check[i].ccbin);
+
+			if (!is_parallel_safe_expr(checkexpr))
+				safe = false;
+		}
+	}
+
+	if (!safe)
+	{
+		*reason = gettext_noop("The table's input functions, default expressions, WHERE clause, or CHECK constraints are not parallel safe.");
+		return false;
+	}
+
+	indexoidlist = RelationGetIndexList(rel);
+	foreach(lc, indexoidlist)
+	{
+		Relation	indexRel = index_open(lfirst_oid(lc), RowExclusiveLock);
+
+		if (!indexRel->rd_index->indimmediate)
+		{
+			*reason = gettext_noop("Tables with deferrable unique or exclusion constraints cannot be loaded in parallel.");
+			safe = false;
+		}
+		else if (!is_parallel_safe_expr((Node *) RelationGetIndexExpressions(indexRel)) ||
+				 !is_parallel_safe_expr((Node *) RelationGetIndexPredicate(indexRel)))
+		{
+			*reason = gettext_noop("The table's index expressions or predicates are not parallel safe.");
+			safe = false;
+		}
+
+		index_close(indexRel, NoLock);
+		if (!safe)
+			break;
+	}
+	list_free(indexoidlist);
+
+	return safe;
+}
+
+/*
+ * Perform COPY FROM with parallel workers.
+ *
+ * We read the input and split it into lines with CopyReadLine(), as usual,
+ * and pack the lines, converted to server encoding and each terminated by a
+ * newline, into chunks in a ring in the DSM segment.  Each worker runs an
+ * ordinary CopyFrom() that reads from the ring through ParallelCopyGetData(),
+ * so the workers do all the parsing, input conversion, and insertion, using
+ * the usual multi-insert buffers.  Returns the number of rows inserted.
+ *
+ * If no workers can be launched, we do the whole load ourselves.
+ */
+static uint64
+ParallelCopyFrom(CopyState cstate, List *attnamelist, List *options)
+{
+	ParallelContext *pcxt;
+	ParallelCopyShared *shared;
+	ParallelCopyChunk *chunk = NULL;
+	ErrorContextCallback errcallback;
+	List	   *worker_options = NIL;
+	ListCell   *lc;
+	char	   *rtablestr;
+	char	   *attnamestr;
+	char	   *optionsstr;
+	char	   *wherestr;
+	Size		est_shared;
+	int			nworkers;
+	int			nchunks;
+	int			i;
+	bool		done = false;
+	uint64		processed;
+
+	/* Like CREATE INDEX and VACUUM, obey max_parallel_maintenance_workers */
+	nworkers = Min(cstate->nworkers, max_parallel_maintenance_workers);
+	if (nworkers <= 0)
+		return CopyFrom(cstate);
+
+	/*
+	 * The workers get our options, except that we skip the header line
+	 * ourselves, and hand the data over already in server encoding.
+	 */
+	foreach(lc, options)
+	{
+		DefElem    *defel = lfirst_node(DefElem, lc);
+
+		if (strcmp(defel->defname, "header") != 0 &&
+			strcmp(defel->defname, "encoding") != 0 &&
+			strcmp(defel->defname, "parallel") != 0)
+			worker_options = lappend(worker_options, defel);
+	}
+	worker_options = lappend(worker_options,
+							 makeDefElem("encoding",
+										 (Node *) makeString(pstrdup(GetDatabaseEncodingName())),
+										 -1));
+
+	rtablestr = nodeToString(cstate->range_table);
+	attnamestr = nodeToString(attnamelist);
+	optionsstr = nodeToString(worker_options);
+	wherestr = nodeToString(cstate->whereClause);
+
+	/*
+	 * The workers insert tuples with our transaction ID and command ID, so
+	 * both have to be settled before we enter parallel mode.  Marking the
+	 * command ID as used is what allows the workers to use it too; see
+	 * GetCurrentCommandId().
+	 */
+	(void) GetCurrentTransactionId();
+	(void) GetCurrentCommandId(true);
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext("postgres", "ParallelCopyMain", nworkers);
+
+	/* Estimate size for shared information -- PARALLEL_COPY_KEY_SHARED */
+	nchunks = nworkers * PARALLEL_COPY_CHUNKS_PER_WORKER;
+	est_shared = add_size(offsetof(ParallelCopyShared, chunks),
+						  mul_size(nchunks, sizeof(ParallelCopyChunk)));
+	shm_toc_estimate_chunk(&pcxt->estimator, est_shared);
+
+	/* Estimate space for the serialized COPY parameters and query text */
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(rtablestr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(attnamestr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(optionsstr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(wherestr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(debug_query_string) + 1);
+	shm_toc_estimate_keys(&pcxt->estimator, 6);
+
+	InitializeParallelDSM(pcxt);
+
+	/* Prepare shared information */
+	shared = (ParallelCopyShared *) shm_toc_allocate(pcxt->toc, est_shared);
+	shared->relid = RelationGetRelid(cstate->rel);
+	shared->nchunks = nchunks;
+	SpinLockInit(&shared->mutex);
+	shared->nfilled = 0;
+	shared->nclaimed = 0;
+	shared->eof = false;
+	ConditionVariableInit(&shared->chunk_ready_cv);
+	ConditionVariableInit(&shared->chunk_free_cv);
+	pg_atomic_init_u64(&shared->processed, 0);
+	for (i = 0; i < nchunks; i++)
+		shared->chunks[i].full = false;
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_SHARED, shared);
+
+	ParallelCopyStoreString(pcxt, PARALLEL_COPY_KEY_RANGE_TABLE, rtablestr);
+	ParallelCopyStoreString(pcxt, PARALLEL_COPY_KEY_ATTNAMELIST, attnamestr);
+	ParallelCopyStoreString(pcxt, PARALLEL_COPY_KEY_OPTIONS, optionsstr);
+	ParallelCopyStoreString(pcxt, PARALLEL_COPY_KEY_WHERE_CLAUSE, wherestr);
+	ParallelCopyStoreString(pcxt, PARALLEL_COPY_KEY_QUERY_TEXT,
+							debug_query_string);
+
+	LaunchParallelWorkers(pcxt);
+	if (pcxt->nworkers_launched == 0)
+	{
+		/* No workers available, so do it all ourselves */
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return CopyFrom(cstate);
+	}
+
+	/*
+	 * Nothing but the workers takes chunks from the ring, so make sure that
+	 * they have all started before we begin to fill it.
+	 */
+	WaitForParallelWorkersToAttach(pcxt);
+
+	/*
+	 * Set up callback to identify error line number.  Errors reported by the
+	 * workers are rethrown with the error context stack as it was when the
+	 * parallel context was created, so they don't get our line number.
+	 */
+	errcallback.callback = CopyFromErrorCallback;
+	errcallback.arg = (void *) cstate;
+	errcallback.previous = error_context_stack;
+	error_context_stack = &errcallback;
+
+	/* On input just throw the header line away */
+	if (cstate->header_line)
+	{
+		cstate->cur_lineno++;
+		done = CopyReadLine(cstate);
+	}
+
+	while (!done)
+	{
+		char	   *data;
+		int			len;
+
+		CHECK_FOR_INTERRUPTS();
+
+		cstate->cur_lineno++;
+		done = CopyReadLine(cstate);
+
+		/* EOF at start of line means we're done */
+		if (done && cstate->line_buf.len == 0)
+			break;
+
+		/*
+		 * Restore the newline that CopyReadLine() removed.  The last line, if
+		 * it ended at EOF instead, is passed on that way too, since it's also
+		 * the end of the last chunk.
+		 */
+		if (!done)
+			appendStringInfoCharMacro(&cstate->line_buf, '\n');
+		data = cstate->line_buf.data;
+		len = cstate->line_buf.len;
+
+		/* Begin a new chunk if the line doesn't fit in the current one */
+		if (chunk != NULL && chunk->len + len > PARALLEL_COPY_CHUNK_SIZE)
+		{
+			ParallelCopyPublishChunk(shared, chunk, false, false);
+			chunk = NULL;
+		}
+
+		while (len > 0)
+		{
+			int			nbytes;
+
+			if (chunk == NULL)
+			{
+				chunk = ParallelCopyNextFreeChunk(shared);
+				chunk->first_lineno = cstate->cur_lineno;
+				chunk->continued = (data != cstate->line_buf.data);
+			}
+
+			nbytes = Min(len, PARALLEL_COPY_CHUNK_SIZE - chunk->len);
+			memcpy(chunk->data + chunk->len, data, nbytes);
+			chunk->len += nbytes;
+			data += nbytes;
+			len -= nbytes;
+
+			/* A line too long for a whole chunk continues in the next one */
+			if (len > 0)
+			{
+				ParallelCopyPublishChunk(shared, chunk, true, false);
+				chunk = NULL;
+			}
+		}
+	}
+
+	/* Hand over the last chunk, and let the workers know that's all */
+	if (chunk != NULL)
+		ParallelCopyPublishChunk(shared, chunk, false, true);
+	else
+	{
+		SpinLockAcquire(&shared->mutex);
+		shared->eof = true;
+		SpinLockRelease(&shared->mutex);
+		ConditionVariableBroadcast(&shared->chunk_ready_cv);
+	}
+
+	error_context_stack = errcallback.previous;
+
+	/*
+	 * In the old protocol, tell pqcomm that we can process normal protocol
+	 * messages again.
+	 */
+	if (cstate->copy_dest == COPY_OLD_FE)
+		pq_endmsgread();
+
+	WaitForParallelWorkersToFinish(pcxt);
+	processed = pg_atomic_read_u64(&shared->processed);
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+
+	return processed;
+}
+
+/*
+ * Wait until the slot for the next chunk in the ring is free, and return it,
+ * emptied.
+ */
+static ParallelCopyChunk *
+ParallelCopyNextFreeChunk(ParallelCopyShared *shared)
+{
+	ParallelCopyChunk *chunk;
+
+	/* Only the leader advances nfilled, so we needn't lock to read it */
+	chunk = &shared->chunks[shared->nfilled % shared->nchunks];
+
+	for (;;)
+	{
+		bool		full;
+
+		SpinLockAcquire(&shared->mutex);
+		full = chunk->full;
+		SpinLockRelease(&shared->mutex);
+
+		if (!full)
+			break;
+
+		ConditionVariableSleep(&shared->chunk_free_cv,
+							   WAIT_EVENT_PARALLEL_COPY_CHUNK_FREE);
+	}
+	ConditionVariableCancelSleep();
+
+	chunk->partial = false;
+	chunk->continued = false;
+	chunk->len = 0;
+	chunk->first_lineno = 0;
+
+	return chunk;
+}
+
+/*
+ * Make a chunk filled by the leader available to the workers.
+ */
+static void
+ParallelCopyPublishChunk(ParallelCopyShared *shared, ParallelCopyChunk *chunk,
+						 bool partial, bool eof)
+{
+	chunk->partial = partial;
+
+	SpinLockAcquire(&shared->mutex);
+	chunk->full = true;
+	shared->nfilled++;
+	shared->eof = eof;
+	SpinLockRelease(&shared->mutex);
+
+	ConditionVariableBroadcast(&shared->chunk_ready_cv);
+}
+
+/*
+ * Copy a string into the DSM segment for the workers, under the given key.
+ */
+static void
+ParallelCopyStoreString(ParallelContext *pcxt, uint64 key, const char *str)
+{
+	Size		len = strlen(str) + 1;
+	char	   *sharedstr;
+
+	sharedstr = (char *) shm_toc_allocate(pcxt->toc, len);
+	memcpy(sharedstr, str, len);
+	shm_toc_insert(pcxt->toc, key, sharedstr);
+}
+
+/*
+ * Main entry point for parallel COPY FROM workers.
+ *
+ * We set up a COPY FROM of our own, reading from the leader's chunks of
+ * input, and run it with CopyFrom().
+ */
+void
+ParallelCopyMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelCopyShared *shared;
+	ParallelCopyWorkerState worker;
+	Relation	rel;
+	List	   *range_table;
+	List	   *attnamelist;
+	List	   *options;
+	Node	   *whereClause;
+	CopyState	cstate;
+	char	   *sharedquery;
+	uint64		processed;
+
+	shared = (ParallelCopyShared *) shm_toc_lookup(toc,
+												   PARALLEL_COPY_KEY_SHARED,
+												   false);
+
+	/* Set debug_query_string for individual workers */
+	sharedquery = shm_toc_lookup(toc, PARALLEL_COPY_KEY_QUERY_TEXT, false);
+	debug_query_string = sharedquery;
+	pgstat_report_activity(STATE_RUNNING, debug_query_string);
+
+	/*
+	 * Open table.  The lock mode is the same as the leader process.  It's
+	 * okay because the lock mode does not conflict among the parallel
+	 * workers.
+	 */
+	rel = table_open(shared->relid, RowExclusiveLock);
+
+	range_table = (List *)
+		stringToNode(shm_toc_lookup(toc, PARALLEL_COPY_KEY_RANGE_TABLE, false));
+	attnamelist = (List *)
+		stringToNode(shm_toc_lookup(toc, PARALLEL_COPY_KEY_ATTNAMELIST, false));
+	options = (List *)
+		stringToNode(shm_toc_lookup(toc, PARALLEL_COPY_KEY_OPTIONS, false));
+	whereClause = (Node *)
+		stringToNode(shm_toc_lookup(toc, PARALLEL_COPY_KEY_WHERE_CLAUSE, false));
+
+	cstate = BeginCopyFrom(NULL, rel, NULL, false, ParallelCopyGetData,
+						   attnamelist, options);
+	cstate->range_table = range_table;
+	cstate->whereClause = whereClause;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.shared = shared;
+	worker.cstate = cstate;
+	worker.buf = (char *) palloc(PARALLEL_COPY_CHUNK_SIZE);
+	ParallelCopyWorker = &worker;
+
+	processed = CopyFrom(cstate);
+	pg_atomic_add_fetch_u64(&shared->processed, processed);
+
+	ParallelCopyWorker = NULL;
+	EndCopyFrom(cstate);
+	table_close(rel, RowExclusiveLock);
+}
+
+/*
+ * Take the next chunk of input for a parallel COPY FROM worker, and copy its
+ * data into the worker's buffer.  Returns false at end of input.
+ */
+static bool
+ParallelCopyTakeChunk(ParallelCopyWorkerState *worker)
+{
+	ParallelCopyShared *shared = worker->shared;
+	ParallelCopyChunk *chunk;
+	uint64		chunkno = 0;
+	bool		ready = false;
+
+	for (;;)
+	{
+		bool		eof = false;
+
+		SpinLockAcquire(&shared->mutex);
+		if (worker->partial)
+		{
+			/* The line we're in the middle of is ours to finish */
+			chunkno = worker->chunkno + 1;
+			if (chunkno < shared->nfilled)
+			{
+				ready = true;
+				if (shared->nclaimed == chunkno)
+					shared->nclaimed++;
+			}
+		}
+		else
+		{
+			/* Skip chunks continuing lines that other workers have begun */
+			while (shared->nclaimed < shared->nfilled &&
+				   shared->chunks[shared->nclaimed % shared->nchunks].continued)
+				shared->nclaimed++;
+
+			if (shared->nclaimed < shared->nfilled)
+			{
+				chunkno = shared->nclaimed++;
+				ready = true;
+			}
+			else
+				eof = shared->eof;
+		}
+		SpinLockRelease(&shared->mutex);
+
+		if (ready || eof)
+			break;
+
+		ConditionVariableSleep(&shared->chunk_ready_cv,
+							   WAIT_EVENT_PARALLEL_COPY_CHUNK_READY);
+	}
+	ConditionVariableCancelSleep();
+
+	if (!ready)
+		return false;
+
+	/* The chunk is ours until we mark it free, so we can read it unlocked */
+	chunk = &shared->chunks[chunkno % shared->nchunks];
+	memcpy(worker->buf, chunk->data, chunk->len);
+	worker->len = chunk->len;
+	worker->pos = 0;
+	worker->chunkno = chunkno;
+	worker->partial = chunk->partial;
+
+	/*
+	 * A chunk that starts with a new line is read at the beginning of a line,
+	 * so set the line number for error messages to match the input.
+	 */
+	if (!chunk->continued)
+		worker->cstate->cur_lineno = chunk->first_lineno;
+
+	SpinLockAcquire(&shared->mutex);
+	chunk->full = false;
+	SpinLockRelease(&shared->mutex);
+	ConditionVariableSignal(&shared->chunk_free_cv);
+
+	return true;
+}
+
+/*
+ * Data source callback of a parallel COPY FROM worker's CopyState.
+ */
+static int
+ParallelCopyGetData(void *outbuf, int minread, int maxread)
+{
+	ParallelCopyWorkerState *worker = ParallelCopyWorker;
+	int			nbytes;
+
+	Assert(worker != NULL);
+
+	if (worker->pos >= worker->len && !ParallelCopyTakeChunk(worker))
+		return 0;
+
+	nbytes = Min(maxread, worker->len - worker->pos);
+	memcpy(outbuf, worker->buf + worker->pos, nbytes);
+	worker->pos += nbytes;
+
+	return nbytes;
+}
+
 /*
  * Setup to read tuples from a file for COPY FROM.
  *
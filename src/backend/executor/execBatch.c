@@ -0,0 +1,278 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.c
+ *	  Support for batch-at-a-time execution of plan nodes
+ *
+ * Normally rows are pulled through the plan tree one at a time, with a call
+ * to ExecProcNode for every row at every level.  A node whose input is a
+ * large number of rows can instead pull them in batches of up to
+ * EXEC_BATCH_SIZE rows with ExecProcNodeBatch, which saves the per-row call
+ * overhead and lets the producing node do its own work, such as tuple
+ * deforming and qual evaluation, for a whole batch in a tight loop.
+ *
+ * Nodes that support this protocol set PlanState->ExecProcNodeBatch; for
+ * the others, ExecProcNodeBatch collects rows from ExecProcNode instead.
+ * Since that involves copying each row, consumers should use batch mode
+ * only for children for which ExecSupportsBatch() returns true.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execBatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/execBatch.h"
+#include "executor/executor.h"
+#include "executor/instrument.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+
+/* GUC variable */
+bool		enable_batch_execution = false;
+
+typedef struct LastScanAttrContext
+{
+	Index		varno;
+	int			natts;
+	int			last;
+} LastScanAttrContext;
+
+static TupleBatch *ExecBatchFromRows(PlanState *node, ExecProcNodeMtd fetch);
+static bool last_scan_attr_walker(Node *node, LastScanAttrContext *context);
+
+
+/*
+ * ExecInitTupleBatch
+ *		Create a batch for a node to return its rows in.
+ *
+ * If desc isn't NULL, the batch gets EXEC_BATCH_SIZE slots of its own, of
+ * the given descriptor and type.  They are registered in the estate's tuple
+ * table, so they are cleaned up with the rest of the node's slots.
+ */
+TupleBatch *
+ExecInitTupleBatch(EState *estate, TupleDesc desc,
+				   const TupleTableSlotOps *tts_ops)
+{
+	MemoryContext oldcontext;
+	TupleBatch *batch;
+
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	batch = (TupleBatch *) palloc0(sizeof(TupleBatch));
+	batch->slots = (TupleTableSlot **)
+		palloc(EXEC_BATCH_SIZE * sizeof(TupleTableSlot *));
+
+	if (desc != NULL)
+	{
+		int			i;
+
+		batch->ownslots = (TupleTableSlot **)
+			palloc(EXEC_BATCH_SIZE * sizeof(TupleTableSlot *));
+		for (i = 0; i < EXEC_BATCH_SIZE; i++)
+			batch->ownslots[i] = ExecAllocTableSlot(&estate->es_tupleTable,
+													desc, tts_ops);
+		memcpy(batch->slots, batch->ownslots,
+			   EXEC_BATCH_SIZE * sizeof(TupleTableSlot *));
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return batch;
+}
+
+/*
+ * ExecSupportsBatch
+ *		Should a consumer of node's rows fetch them in batch mode?
+ */
+bool
+ExecSupportsBatch(PlanState *node)
+{
+	return enable_batch_execution && node->ExecProcNodeBatch != NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecProcNodeBatch
+ *
+ *		Execute the given node to return a(nother) batch of rows.
+ *		Returns NULL when there are no more rows.
+ * ----------------------------------------------------------------
+ */
+TupleBatch *
+ExecProcNodeBatch(PlanState *node)
+{
+	TupleBatch *batch;
+
+	if (node->chgParam != NULL) /* something changed? */
+		ExecReScan(node);		/* let ReScan handle this */
+
+	/* Nodes without batch support are run in row mode */
+	if (node->ExecProcNodeBatch == NULL)
+		return ExecBatchFromRows(node, node->ExecProcNode);
+
+	check_stack_depth();
+
+	if (node->instrument)
+		InstrStartNode(node->instrument);
+
+	batch = node->ExecProcNodeBatch(node);
+
+	if (node->instrument)
+		InstrStopNode(node->instrument, batch ? batch->nrows : 0);
+
+	return batch;
+}
+
+/*
+ * ExecProcNodeBatchRowMode
+ *		Form a batch by running the node in row mode.
+ *
+ * For use by a node's ExecProcNodeBatch function, when it can't handle
+ * the current call in batch mode.
+ */
+TupleBatch *
+ExecProcNodeBatchRowMode(PlanState *node)
+{
+	/* ExecProcNodeBatch takes care of instrumentation */
+	return ExecBatchFromRows(node, node->ExecProcNodeReal);
+}
+
+/*
+ * Collect up to EXEC_BATCH_SIZE rows from the given row-mode function,
+ * copying them into the node's ps_ResultBatch.
+ */
+static TupleBatch *
+ExecBatchFromRows(PlanState *node, ExecProcNodeMtd fetch)
+{
+	TupleBatch *batch = node->ps_ResultBatch;
+	int			nrows = 0;
+
+	while (nrows < EXEC_BATCH_SIZE)
+	{
+		TupleTableSlot *slot = fetch(node);
+
+		if (TupIsNull(slot))
+			break;
+
+		if (batch == NULL)
+		{
+			batch = ExecInitTupleBatch(node->state, slot->tts_tupleDescriptor,
+									   ExecGetResultSlotOps(node, NULL));
+			node->ps_ResultBatch = batch;
+		}
+
+		ExecCopySlot(batch->ownslots[nrows], slot);
+		nrows++;
+	}
+
+	if (nrows == 0)
+		return NULL;
+
+	batch->nrows = nrows;
+	return batch;
+}
+
+/*
+ * ExecQualBatch
+ *		Evaluate a qual against each of an array of scan tuples.
+ *
+ * The slots that pass the qual are moved to the front of the array, in
+ * their original order, and their number is returned.  As with ExecQual,
+ * the caller is responsible for resetting econtext's per-tuple memory,
+ * which must survive for as long as the surviving rows are in use.
+ */
+int
+ExecQualBatch(ExprState *qual, ExprContext *econtext,
+			  TupleTableSlot **slots, int nrows)
+{
+	int			nkept = 0;
+	int			i;
+
+	for (i = 0; i < nrows; i++)
+	{
+		econtext->ecxt_scantuple = slots[i];
+		if (ExecQual(qual, econtext))
+			slots[nkept++] = slots[i];
+	}
+
+	return nkept;
+}
+
+/*
+ * ExecProjectBatch
+ *		Project each of an array of scan tuples into outslots.
+ *
+ * outslots must be virtual slots of the projection's result type.  They
+ * reference the scan tuples and econtext's per-tuple memory, so the caller
+ * mustn't reset it while the results are in use.
+ */
+void
+ExecProjectBatch(ProjectionInfo *projInfo, ExprContext *econtext,
+				 TupleTableSlot **inslots, int nrows,
+				 TupleTableSlot **outslots)
+{
+	int			i;
+
+	for (i = 0; i < nrows; i++)
+	{
+		TupleTableSlot *result;
+		TupleTableSlot *dst = outslots[i];
+		int			natts = dst->tts_tupleDescriptor->natts;
+
+		econtext->ecxt_scantuple = inslots[i];
+		result = ExecProject(projInfo);
+
+		Assert(result->tts_nvalid == natts);
+		ExecClearTuple(dst);
+		memcpy(dst->tts_values, result->tts_values, natts * sizeof(Datum));
+		memcpy(dst->tts_isnull, result->tts_isnull, natts * sizeof(bool));
+		ExecStoreVirtualTuple(dst);
+	}
+}
+
+/*
+ * ExecBatchLastScanAttr
+ *		Find the highest attribute number of relation varno used in exprs.
+ *
+ * A whole-row reference counts as a use of all natts attributes.  Batch-mode
+ * scans use this to decide how many attributes to deform up front.
+ */
+int
+ExecBatchLastScanAttr(List *exprs, Index varno, int natts)
+{
+	LastScanAttrContext context;
+
+	context.varno = varno;
+	context.natts = natts;
+	context.last = 0;
+
+	(void) last_scan_attr_walker((Node *) exprs, &context);
+
+	return Min(context.last, natts);
+}
+
+static bool
+last_scan_attr_walker(Node *node, LastScanAttrContext *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Var))
+	{
+		Var		   *var = (Var *) node;
+
+		if (var->varno == context->varno && var->varlevelsup == 0)
+		{
+			if (var->varattno == InvalidAttrNumber)
+				context->last = context->natts;
+			else if (var->varattno > context->last)
+				context->last = var->varattno;
+		}
+		return false;
+	}
+	return expression_tree_walker(node, last_scan_attr_walker,
+								  (void *) context);
+}
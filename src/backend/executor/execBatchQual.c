@@ -0,0 +1,875 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatchQual.c
+ *	  Vectorized evaluation of simple quals over a batch of scan tuples
+ *
+ * Most quals on large scans are comparisons of a column against a constant,
+ * such as "a > 42" or "d <= '2019-01-01'".  For fixed-width integer, date,
+ * timestamp and float columns, a batch-mode scan can evaluate such clauses
+ * for a whole batch at once: the column's values are gathered from the
+ * (already deformed) scan slots into a plain array, and compared against
+ * the constant by a tight loop that produces a bitmap of the qualifying
+ * rows.  On x86-64 CPUs that support AVX2, the loop compares 4 or 8 values
+ * per instruction.  The bitmaps of all such clauses are ANDed together, and
+ * whatever remains of the qual is then evaluated in the usual way, for the
+ * surviving rows only.
+ *
+ * Evaluating the simple clauses ahead of the rest of the qual is safe, even
+ * though the planner may have ordered them differently: the comparison
+ * functions handled here are strict, leakproof and cannot fail, so the only
+ * effect is that the remaining clauses are evaluated for fewer rows.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execBatchQual.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/execBatch.h"
+#include "executor/executor.h"
+#include "optimizer/clauses.h"
+#include "port/pg_bitutils.h"
+#include "utils/float.h"
+#include "utils/fmgrprotos.h"
+
+/*
+ * On x86-64, we can use AVX2 instructions for the comparisons, but only if
+ * we can verify that the CPU and OS support them via the cpuid instruction.
+ * The kernels are compiled for AVX2 using a function attribute, so the rest
+ * of the backend needn't be.
+ */
+#if defined(__x86_64__) && defined(HAVE__GET_CPUID) && \
+	(defined(__clang__) || \
+	 (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define USE_AVX2_BATCH_QUAL 1
+#endif
+
+#ifdef USE_AVX2_BATCH_QUAL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* Number of bitmap words needed for a batch of n rows */
+#define BATCH_QUAL_NWORDS(n)	(((n) + 63) / 64)
+
+typedef enum BatchCmpOp
+{
+	BATCH_CMP_LT,
+	BATCH_CMP_LE,
+	BATCH_CMP_EQ,
+	BATCH_CMP_NE,
+	BATCH_CMP_GE,
+	BATCH_CMP_GT
+} BatchCmpOp;
+
+/* Representation of a comparison function's argument */
+typedef enum BatchValueType
+{
+	BATCH_VAL_INT16,
+	BATCH_VAL_INT32,
+	BATCH_VAL_INT64,
+	BATCH_VAL_FLOAT4,
+	BATCH_VAL_FLOAT8
+} BatchValueType;
+
+/* Comparison functions we know how to vectorize */
+typedef struct BatchCmpFunc
+{
+	PGFunction	func;
+	BatchCmpOp	op;
+	BatchValueType lefttype;
+	BatchValueType righttype;
+} BatchCmpFunc;
+
+#define BATCH_CMP_FUNCS(prefix, lefttype, righttype) \
+	{prefix##lt, BATCH_CMP_LT, lefttype, righttype}, \
+	{prefix##le, BATCH_CMP_LE, lefttype, righttype}, \
+	{prefix##eq, BATCH_CMP_EQ, lefttype, righttype}, \
+	{prefix##ne, BATCH_CMP_NE, lefttype, righttype}, \
+	{prefix##ge, BATCH_CMP_GE, lefttype, righttype}, \
+	{prefix##gt, BATCH_CMP_GT, lefttype, righttype}
+
+static const BatchCmpFunc batch_cmp_funcs[] = {
+	BATCH_CMP_FUNCS(int2, BATCH_VAL_INT16, BATCH_VAL_INT16),
+	BATCH_CMP_FUNCS(int24, BATCH_VAL_INT16, BATCH_VAL_INT32),
+	BATCH_CMP_FUNCS(int28, BATCH_VAL_INT16, BATCH_VAL_INT64),
+	BATCH_CMP_FUNCS(int4, BATCH_VAL_INT32, BATCH_VAL_INT32),
+	BATCH_CMP_FUNCS(int42, BATCH_VAL_INT32, BATCH_VAL_INT16),
+	BATCH_CMP_FUNCS(int48, BATCH_VAL_INT32, BATCH_VAL_INT64),
+	BATCH_CMP_FUNCS(int8, BATCH_VAL_INT64, BATCH_VAL_INT64),
+	BATCH_CMP_FUNCS(int82, BATCH_VAL_INT64, BATCH_VAL_INT16),
+	BATCH_CMP_FUNCS(int84, BATCH_VAL_INT64, BATCH_VAL_INT32),
+	BATCH_CMP_FUNCS(float4, BATCH_VAL_FLOAT4, BATCH_VAL_FLOAT4),
+	BATCH_CMP_FUNCS(float48, BATCH_VAL_FLOAT4, BATCH_VAL_FLOAT8),
+	BATCH_CMP_FUNCS(float8, BATCH_VAL_FLOAT8, BATCH_VAL_FLOAT8),
+	BATCH_CMP_FUNCS(float84, BATCH_VAL_FLOAT8, BATCH_VAL_FLOAT4),
+	/* DateADT is an int32, and Timestamp and TimestampTz are int64s */
+	BATCH_CMP_FUNCS(date_, BATCH_VAL_INT32, BATCH_VAL_INT32),
+	BATCH_CMP_FUNCS(timestamp_, BATCH_VAL_INT64, BATCH_VAL_INT64)
+};
+
+/* Which kernel a clause uses; values are widened to the kernel's type */
+typedef enum BatchKernel
+{
+	BATCH_KERNEL_INT32,
+	BATCH_KERNEL_INT64,
+	BATCH_KERNEL_FLOAT8
+} BatchKernel;
+
+/* A "column op constant" clause that we evaluate vectorized */
+typedef struct BatchQualClause
+{
+	AttrNumber	attnum;			/* scan attribute compared */
+	BatchValueType coltype;		/* its representation */
+	BatchKernel kernel;			/* kernel to use */
+	BatchCmpOp	op;				/* comparison, with the column on the left */
+	union
+	{
+		int32		i32;
+		int64		i64;
+		float8		f8;
+	}			constval;		/* the constant, converted to kernel's type */
+} BatchQualClause;
+
+/*
+ * BatchQual
+ *
+ * A qual split up into the clauses we can evaluate vectorized, and an
+ * ExprState for the rest, if any.
+ */
+struct BatchQual
+{
+	int			nclauses;
+	BatchQualClause *clauses;
+	AttrNumber	lastattr;		/* highest attnum used by clauses */
+	ExprState  *residual;		/* qual for the remaining clauses, or NULL */
+};
+
+typedef void (*batch_cmp_int32_fn) (const int32 *values, int n,
+									int32 constval, BatchCmpOp op,
+									uint64 *result);
+typedef void (*batch_cmp_int64_fn) (const int64 *values, int n,
+									int64 constval, BatchCmpOp op,
+									uint64 *result);
+typedef void (*batch_cmp_float8_fn) (const float8 *values, int n,
+									 float8 constval, BatchCmpOp op,
+									 uint64 *result);
+
+static bool batch_qual_clause(Expr *clause, Index scanrelid,
+							  BatchQualClause *bqc);
+static void batch_eval_clause(BatchQualClause *bqc, TupleTableSlot **slots,
+							  int nrows, uint64 *sel);
+
+static void batch_cmp_int32_scalar(const int32 *values, int n,
+								   int32 constval, BatchCmpOp op,
+								   uint64 *result);
+static void batch_cmp_int64_scalar(const int64 *values, int n,
+								   int64 constval, BatchCmpOp op,
+								   uint64 *result);
+static void batch_cmp_float8_scalar(const float8 *values, int n,
+									float8 constval, BatchCmpOp op,
+									uint64 *result);
+static void batch_cmp_float8_nan(const float8 *values, int n,
+								 float8 constval, BatchCmpOp op,
+								 uint64 *result);
+
+#ifdef USE_AVX2_BATCH_QUAL
+static bool batch_qual_avx2_available(void);
+static void batch_qual_choose(void);
+static void batch_cmp_int32_choose(const int32 *values, int n,
+								   int32 constval, BatchCmpOp op,
+								   uint64 *result);
+static void batch_cmp_int64_choose(const int64 *values, int n,
+								   int64 constval, BatchCmpOp op,
+								   uint64 *result);
+static void batch_cmp_float8_choose(const float8 *values, int n,
+									float8 constval, BatchCmpOp op,
+									uint64 *result);
+static void batch_cmp_int32_avx2(const int32 *values, int n,
+								 int32 constval, BatchCmpOp op,
+								 uint64 *result);
+static void batch_cmp_int64_avx2(const int64 *values, int n,
+								 int64 constval, BatchCmpOp op,
+								 uint64 *result);
+static void batch_cmp_float8_avx2(const float8 *values, int n,
+								  float8 constval, BatchCmpOp op,
+								  uint64 *result);
+
+static batch_cmp_int32_fn batch_cmp_int32 = batch_cmp_int32_choose;
+static batch_cmp_int64_fn batch_cmp_int64 = batch_cmp_int64_choose;
+static batch_cmp_float8_fn batch_cmp_float8 = batch_cmp_float8_choose;
+#else
+static batch_cmp_int32_fn batch_cmp_int32 = batch_cmp_int32_scalar;
+static batch_cmp_int64_fn batch_cmp_int64 = batch_cmp_int64_scalar;
+static batch_cmp_float8_fn batch_cmp_float8 = batch_cmp_float8_scalar;
+#endif							/* USE_AVX2_BATCH_QUAL */
+
+
+/*
+ * ExecInitBatchQual
+ *		Prepare an implicit-AND qual list for vectorized evaluation.
+ *
+ * Returns NULL if none of the qual's clauses can be vectorized, in which
+ * case the caller should evaluate the qual with ExecQualBatch instead.
+ * The residual qual is initialized with the given parent, like a qual built
+ * by ExecInitQual; quals that contain subplans are left alone, since their
+ * subplans have already been set up for the original qual.
+ */
+BatchQual *
+ExecInitBatchQual(List *qual, PlanState *parent, Index scanrelid)
+{
+	MemoryContext oldcontext;
+	BatchQual  *bq;
+	List	   *residual = NIL;
+	ListCell   *lc;
+
+	if (qual == NIL || contain_subplans((Node *) qual))
+		return NULL;
+
+	oldcontext = MemoryContextSwitchTo(parent->state->es_query_cxt);
+
+	bq = (BatchQual *) palloc0(sizeof(BatchQual));
+	bq->clauses = (BatchQualClause *)
+		palloc(list_length(qual) * sizeof(BatchQualClause));
+
+	foreach(lc, qual)
+	{
+		Expr	   *clause = (Expr *) lfirst(lc);
+		BatchQualClause *bqc = &bq->clauses[bq->nclauses];
+
+		if (batch_qual_clause(clause, scanrelid, bqc))
+		{
+			bq->lastattr = Max(bq->lastattr, bqc->attnum);
+			bq->nclauses++;
+		}
+		else
+			residual = lappend(residual, clause);
+	}
+
+	if (bq->nclauses == 0)
+	{
+		pfree(bq->clauses);
+		pfree(bq);
+		list_free(residual);
+		MemoryContextSwitchTo(oldcontext);
+		return NULL;
+	}
+
+	bq->residual = ExecInitQual(residual, parent);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return bq;
+}
+
+/*
+ * Can the clause be evaluated vectorized?  If so, fill in *bqc.
+ */
+static bool
+batch_qual_clause(Expr *clause, Index scanrelid, BatchQualClause *bqc)
+{
+	OpExpr	   *opexpr;
+	Var		   *var;
+	Const	   *con;
+	FmgrInfo	finfo;
+	const BatchCmpFunc *cmpfunc = NULL;
+	BatchValueType consttype;
+	int			i;
+
+	if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+		return false;
+	opexpr = (OpExpr *) clause;
+
+	/* We need a scan column on one side, and a non-null constant on the other */
+	var = (Var *) linitial(opexpr->args);
+	con = (Const *) lsecond(opexpr->args);
+	if (IsA(var, Const) && IsA(con, Var))
+	{
+		var = (Var *) lsecond(opexpr->args);
+		con = (Const *) linitial(opexpr->args);
+	}
+	if (!IsA(var, Var) || !IsA(con, Const))
+		return false;
+	if (var->varno != scanrelid || var->varlevelsup != 0 ||
+		var->varattno <= 0)
+		return false;
+	if (con->constisnull)
+		return false;
+
+	/*
+	 * Look up the function's implementation, which also identifies functions
+	 * that share one, such as timestamp_lt and timestamptz_lt.
+	 */
+	fmgr_info(opexpr->opfuncid, &finfo);
+	for (i = 0; i < lengthof(batch_cmp_funcs); i++)
+	{
+		if (batch_cmp_funcs[i].func == finfo.fn_addr)
+		{
+			cmpfunc = &batch_cmp_funcs[i];
+			break;
+		}
+	}
+	if (cmpfunc == NULL)
+		return false;
+
+	/* Normalize to "column op constant" */
+	bqc->attnum = var->varattno;
+	if (var == linitial(opexpr->args))
+	{
+		bqc->coltype = cmpfunc->lefttype;
+		consttype = cmpfunc->righttype;
+		bqc->op = cmpfunc->op;
+	}
+	else
+	{
+		bqc->coltype = cmpfunc->righttype;
+		consttype = cmpfunc->lefttype;
+		switch (cmpfunc->op)
+		{
+			case BATCH_CMP_LT:
+				bqc->op = BATCH_CMP_GT;
+				break;
+			case BATCH_CMP_LE:
+				bqc->op = BATCH_CMP_GE;
+				break;
+			case BATCH_CMP_GE:
+				bqc->op = BATCH_CMP_LE;
+				break;
+			case BATCH_CMP_GT:
+				bqc->op = BATCH_CMP_LT;
+				break;
+			default:
+				bqc->op = cmpfunc->op;
+				break;
+		}
+	}
+
+	/*
+	 * Choose the kernel by the column's type, and convert the constant to
+	 * it.  We don't bother narrowing a wider integer constant to the
+	 * column's type; such clauses are just evaluated the normal way.
+	 */
+	switch (bqc->coltype)
+	{
+		case BATCH_VAL_INT16:
+		case BATCH_VAL_INT32:
+			bqc->kernel = BATCH_KERNEL_INT32;
+			if (consttype == BATCH_VAL_INT16)
+				bqc->constval.i32 = DatumGetInt16(con->constvalue);
+			else if (consttype == BATCH_VAL_INT32)
+				bqc->constval.i32 = DatumGetInt32(con->constvalue);
+			else
+				return false;
+			break;
+		case BATCH_VAL_INT64:
+			bqc->kernel = BATCH_KERNEL_INT64;
+			if (consttype == BATCH_VAL_INT16)
+				bqc->constval.i64 = DatumGetInt16(con->constvalue);
+			else if (consttype == BATCH_VAL_INT32)
+				bqc->constval.i64 = DatumGetInt32(con->constvalue);
+			else
+				bqc->constval.i64 = DatumGetInt64(con->constvalue);
+			break;
+		case BATCH_VAL_FLOAT4:
+		case BATCH_VAL_FLOAT8:
+			/* widening float4 to float8 is exact, and preserves order */
+			bqc->kernel = BATCH_KERNEL_FLOAT8;
+			if (consttype == BATCH_VAL_FLOAT4)
+				bqc->constval.f8 = DatumGetFloat4(con->constvalue);
+			else
+				bqc->constval.f8 = DatumGetFloat8(con->constvalue);
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * ExecBatchQualEval
+ *		Evaluate a BatchQual against each of an array of scan tuples.
+ *
+ * Works like ExecQualBatch: the qualifying slots are moved to the front of
+ * the array, in their original order, and their number is returned.
+ */
+int
+ExecBatchQualEval(BatchQual *bq, ExprContext *econtext,
+				  TupleTableSlot **slots, int nrows)
+{
+	uint64		sel[EXEC_BATCH_SIZE / 64];
+	int			nwords = BATCH_QUAL_NWORDS(nrows);
+	int			nkept = 0;
+	int			w;
+	int			i;
+
+	StaticAssertStmt(EXEC_BATCH_SIZE % 64 == 0,
+					 "EXEC_BATCH_SIZE must be a multiple of 64");
+	Assert(nrows > 0 && nrows <= EXEC_BATCH_SIZE);
+
+	/* start with all rows selected */
+	memset(sel, 0xFF, nwords * sizeof(uint64));
+	if (nrows % 64 != 0)
+		sel[nwords - 1] = (UINT64CONST(1) << (nrows % 64)) - 1;
+
+	slot_getsomeattrs_batch(slots, nrows, bq->lastattr);
+
+	for (i = 0; i < bq->nclauses; i++)
+	{
+		uint64		any = 0;
+
+		batch_eval_clause(&bq->clauses[i], slots, nrows, sel);
+
+		/* stop early if no row qualifies */
+		for (w = 0; w < nwords; w++)
+			any |= sel[w];
+		if (any == 0)
+			return 0;
+	}
+
+	/* Evaluate the rest of the qual for the surviving rows */
+	for (w = 0; w < nwords; w++)
+	{
+		uint64		bits = sel[w];
+
+		while (bits != 0)
+		{
+			int			row = w * 64 + pg_rightmost_one_pos64(bits);
+
+			bits &= bits - 1;
+
+			if (bq->residual != NULL)
+			{
+				econtext->ecxt_scantuple = slots[row];
+				if (!ExecQual(bq->residual, econtext))
+					continue;
+			}
+			slots[nkept++] = slots[row];
+		}
+	}
+
+	return nkept;
+}
+
+/*
+ * Evaluate one clause for a batch, clearing the bits of the rows that don't
+ * satisfy it in sel.
+ */
+static void
+batch_eval_clause(BatchQualClause *bqc, TupleTableSlot **slots, int nrows,
+				  uint64 *sel)
+{
+	int			attno = bqc->attnum - 1;
+	uint64		result[EXEC_BATCH_SIZE / 64];
+	uint64		nulls[EXEC_BATCH_SIZE / 64];
+	int			nwords = BATCH_QUAL_NWORDS(nrows);
+	bool		hasnulls = false;
+	int			w;
+	int			i;
+
+	memset(nulls, 0, nwords * sizeof(uint64));
+
+	/*
+	 * Gather the column's values into an array of the kernel's type.  Nulls
+	 * are stored as zero, and fail the clause, since the comparison
+	 * functions are strict.
+	 */
+#define BATCH_GATHER(array, conv) \
+	for (i = 0; i < nrows; i++) \
+	{ \
+		TupleTableSlot *slot = slots[i]; \
+		\
+		if (slot->tts_isnull[attno]) \
+		{ \
+			nulls[i / 64] |= UINT64CONST(1) << (i % 64); \
+			hasnulls = true; \
+			array[i] = 0; \
+		} \
+		else \
+			array[i] = conv(slot->tts_values[attno]); \
+	}
+
+	switch (bqc->kernel)
+	{
+		case BATCH_KERNEL_INT32:
+			{
+				int32		values[EXEC_BATCH_SIZE];
+
+				if (bqc->coltype == BATCH_VAL_INT16)
+				{
+					BATCH_GATHER(values, DatumGetInt16);
+				}
+				else
+				{
+					BATCH_GATHER(values, DatumGetInt32);
+				}
+				batch_cmp_int32(values, nrows, bqc->constval.i32, bqc->op,
+								result);
+				break;
+			}
+		case BATCH_KERNEL_INT64:
+			{
+				int64		values[EXEC_BATCH_SIZE];
+
+				if (bqc->coltype == BATCH_VAL_INT16)
+				{
+					BATCH_GATHER(values, DatumGetInt16);
+				}
+				else if (bqc->coltype == BATCH_VAL_INT32)
+				{
+					BATCH_GATHER(values, DatumGetInt32);
+				}
+				else
+				{
+					BATCH_GATHER(values, DatumGetInt64);
+				}
+				batch_cmp_int64(values, nrows, bqc->constval.i64, bqc->op,
+								result);
+				break;
+			}
+		case BATCH_KERNEL_FLOAT8:
+			{
+				float8		values[EXEC_BATCH_SIZE];
+				bool		hasnan = isnan(bqc->constval.f8);
+
+				if (bqc->coltype == BATCH_VAL_FLOAT4)
+				{
+					BATCH_GATHER(values, DatumGetFloat4);
+				}
+				else
+				{
+					BATCH_GATHER(values, DatumGetFloat8);
+				}
+
+				for (i = 0; i < nrows && !hasnan; i++)
+					hasnan = isnan(values[i]);
+
+				/*
+				 * The kernels use IEEE comparison semantics, under which a
+				 * NaN is unordered.  Postgres sorts NaNs after all other
+				 * values and considers them equal to each other, so batches
+				 * involving NaNs are left to the slower but exact version.
+				 */
+				if (hasnan)
+					batch_cmp_float8_nan(values, nrows, bqc->constval.f8,
+										 bqc->op, result);
+				else
+					batch_cmp_float8(values, nrows, bqc->constval.f8, bqc->op,
+									 result);
+				break;
+			}
+	}
+
+#undef BATCH_GATHER
+
+	for (w = 0; w < nwords; w++)
+	{
+		sel[w] &= result[w];
+		if (hasnulls)
+			sel[w] &= ~nulls[w];
+	}
+}
+
+
+/*
+ * Comparison kernels
+ *
+ * Each of these compares values[0..n-1] against constval, and sets bit
+ * (i % 64) of result[i / 64] if values[i] op constval is true.  Bits
+ * beyond n are left zero.
+ */
+
+/* Set the result bits for values[start..n-1], with a plain C comparison */
+#define BATCH_CMP_LOOP(start, cmpop) \
+	for (i = (start); i < n; i++) \
+		result[i / 64] |= (uint64) (values[i] cmpop constval) << (i % 64)
+
+#define BATCH_CMP_SWITCH(start) \
+	switch (op) \
+	{ \
+		case BATCH_CMP_LT: \
+			BATCH_CMP_LOOP(start, <); \
+			break; \
+		case BATCH_CMP_LE: \
+			BATCH_CMP_LOOP(start, <=); \
+			break; \
+		case BATCH_CMP_EQ: \
+			BATCH_CMP_LOOP(start, ==); \
+			break; \
+		case BATCH_CMP_NE: \
+			BATCH_CMP_LOOP(start, !=); \
+			break; \
+		case BATCH_CMP_GE: \
+			BATCH_CMP_LOOP(start, >=); \
+			break; \
+		case BATCH_CMP_GT: \
+			BATCH_CMP_LOOP(start, >); \
+			break; \
+	}
+
+static void
+batch_cmp_int32_scalar(const int32 *values, int n, int32 constval,
+					   BatchCmpOp op, uint64 *result)
+{
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	BATCH_CMP_SWITCH(0);
+}
+
+static void
+batch_cmp_int64_scalar(const int64 *values, int n, int64 constval,
+					   BatchCmpOp op, uint64 *result)
+{
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	BATCH_CMP_SWITCH(0);
+}
+
+/* values mustn't contain NaNs, nor constval be one */
+static void
+batch_cmp_float8_scalar(const float8 *values, int n, float8 constval,
+						BatchCmpOp op, uint64 *result)
+{
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	BATCH_CMP_SWITCH(0);
+}
+
+/* Like batch_cmp_float8_scalar, but with Postgres' NaN semantics */
+static void
+batch_cmp_float8_nan(const float8 *values, int n, float8 constval,
+					 BatchCmpOp op, uint64 *result)
+{
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	for (i = 0; i < n; i++)
+	{
+		int			cmp = float8_cmp_internal(values[i], constval);
+		bool		match = false;
+
+		switch (op)
+		{
+			case BATCH_CMP_LT:
+				match = (cmp < 0);
+				break;
+			case BATCH_CMP_LE:
+				match = (cmp <= 0);
+				break;
+			case BATCH_CMP_EQ:
+				match = (cmp == 0);
+				break;
+			case BATCH_CMP_NE:
+				match = (cmp != 0);
+				break;
+			case BATCH_CMP_GE:
+				match = (cmp >= 0);
+				break;
+			case BATCH_CMP_GT:
+				match = (cmp > 0);
+				break;
+		}
+		result[i / 64] |= (uint64) match << (i % 64);
+	}
+}
+
+#ifdef USE_AVX2_BATCH_QUAL
+
+/*
+ * Return true if CPUID indicates that the AVX2 instructions are available,
+ * and that the OS saves the YMM registers on context switches.
+ */
+static bool
+batch_qual_avx2_available(void)
+{
+	unsigned int exx[4] = {0, 0, 0, 0};
+	uint32		xcr0_lo;
+	uint32		xcr0_hi;
+
+	__get_cpuid(1, &exx[0], &exx[1], &exx[2], &exx[3]);
+	if ((exx[2] & (1 << 27)) == 0 ||	/* OSXSAVE */
+		(exx[2] & (1 << 28)) == 0)	/* AVX */
+		return false;
+
+	/* the OS must have enabled the XMM and YMM state */
+	__asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & 0x6) != 0x6)
+		return false;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return false;
+	__cpuid_count(7, 0, exx[0], exx[1], exx[2], exx[3]);
+
+	return (exx[1] & (1 << 5)) != 0;	/* AVX2 */
+}
+
+/*
+ * These functions get called on the first call to batch_cmp_int32 etc.
+ * They detect whether we can use the AVX2 implementations, and replace
+ * the function pointers so that subsequent calls are routed directly to
+ * the chosen implementation.
+ */
+static void
+batch_qual_choose(void)
+{
+	if (batch_qual_avx2_available())
+	{
+		batch_cmp_int32 = batch_cmp_int32_avx2;
+		batch_cmp_int64 = batch_cmp_int64_avx2;
+		batch_cmp_float8 = batch_cmp_float8_avx2;
+	}
+	else
+	{
+		batch_cmp_int32 = batch_cmp_int32_scalar;
+		batch_cmp_int64 = batch_cmp_int64_scalar;
+		batch_cmp_float8 = batch_cmp_float8_scalar;
+	}
+}
+
+static void
+batch_cmp_int32_choose(const int32 *values, int n, int32 constval,
+					   BatchCmpOp op, uint64 *result)
+{
+	batch_qual_choose();
+	batch_cmp_int32(values, n, constval, op, result);
+}
+
+static void
+batch_cmp_int64_choose(const int64 *values, int n, int64 constval,
+					   BatchCmpOp op, uint64 *result)
+{
+	batch_qual_choose();
+	batch_cmp_int64(values, n, constval, op, result);
+}
+
+static void
+batch_cmp_float8_choose(const float8 *values, int n, float8 constval,
+						BatchCmpOp op, uint64 *result)
+{
+	batch_qual_choose();
+	batch_cmp_float8(values, n, constval, op, result);
+}
+
+/*
+ * The AVX2 kernels.  AVX2 only has "greater than" and "equal" comparisons
+ * for integers, so the other operators are computed by swapping the
+ * operands and/or inverting the resulting mask.  Values left over after
+ * the last full vector are handled with plain comparisons.
+ */
+static void __attribute__((target("avx2")))
+batch_cmp_int32_avx2(const int32 *values, int n, int32 constval,
+					 BatchCmpOp op, uint64 *result)
+{
+	__m256i		c = _mm256_set1_epi32(constval);
+	bool		invert;
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	invert = (op == BATCH_CMP_LE || op == BATCH_CMP_NE || op == BATCH_CMP_GE);
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		__m256i		v = _mm256_loadu_si256((const __m256i *) &values[i]);
+		__m256i		m;
+		uint64		bits;
+
+		if (op == BATCH_CMP_LT || op == BATCH_CMP_GE)
+			m = _mm256_cmpgt_epi32(c, v);
+		else if (op == BATCH_CMP_GT || op == BATCH_CMP_LE)
+			m = _mm256_cmpgt_epi32(v, c);
+		else
+			m = _mm256_cmpeq_epi32(v, c);
+
+		bits = (uint64) _mm256_movemask_ps(_mm256_castsi256_ps(m));
+		if (invert)
+			bits ^= 0xFF;
+		result[i / 64] |= bits << (i % 64);
+	}
+
+	BATCH_CMP_SWITCH(i);
+}
+
+static void __attribute__((target("avx2")))
+batch_cmp_int64_avx2(const int64 *values, int n, int64 constval,
+					 BatchCmpOp op, uint64 *result)
+{
+	__m256i		c = _mm256_set1_epi64x(constval);
+	bool		invert;
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+	invert = (op == BATCH_CMP_LE || op == BATCH_CMP_NE || op == BATCH_CMP_GE);
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		__m256i		v = _mm256_loadu_si256((const __m256i *) &values[i]);
+		__m256i		m;
+		uint64		bits;
+
+		if (op == BATCH_CMP_LT || op == BATCH_CMP_GE)
+			m = _mm256_cmpgt_epi64(c, v);
+		else if (op == BATCH_CMP_GT || op == BATCH_CMP_LE)
+			m = _mm256_cmpgt_epi64(v, c);
+		else
+			m = _mm256_cmpeq_epi64(v, c);
+
+		bits = (uint64) _mm256_movemask_pd(_mm256_castsi256_pd(m));
+		if (invert)
+			bits ^= 0xF;
+		result[i / 64] |= bits << (i % 64);
+	}
+
+	BATCH_CMP_SWITCH(i);
+}
+
+/* values mustn't contain NaNs, nor constval be one */
+static void __attribute__((target("avx2")))
+batch_cmp_float8_avx2(const float8 *values, int n, float8 constval,
+					  BatchCmpOp op, uint64 *result)
+{
+	__m256d		c = _mm256_set1_pd(constval);
+	int			i;
+
+	memset(result, 0, BATCH_QUAL_NWORDS(n) * sizeof(uint64));
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		__m256d		v = _mm256_loadu_pd(&values[i]);
+		__m256d		m;
+
+		switch (op)
+		{
+			case BATCH_CMP_LT:
+				m = _mm256_cmp_pd(v, c, _CMP_LT_OQ);
+				break;
+			case BATCH_CMP_LE:
+				m = _mm256_cmp_pd(v, c, _CMP_LE_OQ);
+				break;
+			case BATCH_CMP_EQ:
+				m = _mm256_cmp_pd(v, c, _CMP_EQ_OQ);
+				break;
+			case BATCH_CMP_NE:
+				m = _mm256_cmp_pd(v, c, _CMP_NEQ_OQ);
+				break;
+			case BATCH_CMP_GE:
+				m = _mm256_cmp_pd(v, c, _CMP_GE_OQ);
+				break;
+			case BATCH_CMP_GT:
+			default:
+				m = _mm256_cmp_pd(v, c, _CMP_GT_OQ);
+				break;
+		}
+
+		result[i / 64] |= (uint64) _mm256_movemask_pd(m) << (i % 64);
+	}
+
+	BATCH_CMP_SWITCH(i);
+}
+
+#endif							/* USE_AVX2_BATCH_QUAL */
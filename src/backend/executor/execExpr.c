@@ -78,7 +78,8 @@ static void ExecInitCoerceToDomain(ExprEvalStep *scratch, CoerceToDomain *ctest,
 static void ExecBuildAggTransCall(ExprState *state, AggState *aggstate,
 								  ExprEvalStep *scratch,
 								  FunctionCallInfo fcinfo, AggStatePerTrans pertrans,
-								  int transno, int setno, int setoff, bool ishash);
+								  int transno, int setno, int setoff, bool ishash,
+								  bool nullcheck);
 
 
 /*
@@ -2908,10 +2909,17 @@ ExecInitCoerceToDomain(ExprEvalStep *scratch, CoerceToDomain *ctest,
  * check for filters, evaluate aggregate input, check that that input is not
  * NULL for a strict transition function, and then finally invoke the
  * transition for each of the concurrently computed grouping sets.
+ *
+ * If nullcheck is true, the generated code will check for a NULL pointer to
+ * the array of AggStatePerGroup, and skip evaluation if so.  This is needed
+ * once a hash aggregate has exceeded its memory limit, because tuples that
+ * don't belong to an existing group are then spilled to disk instead of
+ * being aggregated, and because spilled batches are processed for one
+ * grouping set at a time.
  */
 ExprState *
 ExecBuildAggTrans(AggState *aggstate, AggStatePerPhase phase,
-				  bool doSort, bool doHash)
+				  bool doSort, bool doHash, bool nullcheck)
 {
 	ExprState  *state = makeNode(ExprState);
 	PlanState  *parent = &aggstate->ss.ps;
@@ -3144,7 +3152,8 @@ ExecBuildAggTrans(AggState *aggstate, AggStatePerPhase phase,
 			for (setno = 0; setno < processGroupingSets; setno++)
 			{
 				ExecBuildAggTransCall(state, aggstate, &scratch, trans_fcinfo,
-									  pertrans, transno, setno, setoff, false);
+									  pertrans, transno, setno, setoff, false,
+									  nullcheck);
 				setoff++;
 			}
 		}
@@ -3162,7 +3171,8 @@ ExecBuildAggTrans(AggState *aggstate, AggStatePerPhase phase,
 			for (setno = 0; setno < numHashes; setno++)
 			{
 				ExecBuildAggTransCall(state, aggstate, &scratch, trans_fcinfo,
-									  pertrans, transno, setno, setoff, true);
+									  pertrans, transno, setno, setoff, true,
+									  nullcheck);
 				setoff++;
 			}
 		}
@@ -3210,10 +3220,12 @@ static void
 ExecBuildAggTransCall(ExprState *state, AggState *aggstate,
 					  ExprEvalStep *scratch,
 					  FunctionCallInfo fcinfo, AggStatePerTrans pertrans,
-					  int transno, int setno, int setoff, bool ishash)
+					  int transno, int setno, int setoff, bool ishash,
+					  bool nullcheck)
 {
 	int			adjust_init_jumpnull = -1;
 	int			adjust_strict_jumpnull = -1;
+	int			adjust_nullcheck_jumpnull = -1;
 	ExprContext *aggcontext;
 
 	if (ishash)
@@ -3221,6 +3233,20 @@ ExecBuildAggTransCall(ExprState *state, AggState *aggstate,
 	else
 		aggcontext = aggstate->aggcontexts[setno];
 
+	/*
+	 * If the per-group states of this grouping set may be missing (because
+	 * the input tuple was spilled instead), skip the whole transition.
+	 */
+	if (nullcheck)
+	{
+		scratch->opcode = EEOP_AGG_PLAIN_PERGROUP_NULLCHECK;
+		scratch->d.agg_plain_pergroup_nullcheck.aggstate = aggstate;
+		scratch->d.agg_plain_pergroup_nullcheck.setoff = setoff;
+		scratch->d.agg_plain_pergroup_nullcheck.jumpnull = -1;	/* adjust later */
+		ExprEvalPushStep(state, scratch);
+		adjust_nullcheck_jumpnull = state->steps_len - 1;
+	}
+
 	/*
 	 * If the initial value for the transition state doesn't exist in the
 	 * pg_aggregate table then we will let the first non-NULL value returned
@@ -3284,6 +3310,13 @@ ExecBuildAggTransCall(ExprState *state, AggState *aggstate,
 	ExprEvalPushStep(state, scratch);
 
 	/* adjust jumps so they jump till after transition invocation */
+	if (adjust_nullcheck_jumpnull != -1)
+	{
+		ExprEvalStep *as = &state->steps[adjust_nullcheck_jumpnull];
+
+		Assert(as->d.agg_plain_pergroup_nullcheck.jumpnull == -1);
+		as->d.agg_plain_pergroup_nullcheck.jumpnull = state->steps_len;
+	}
 	if (adjust_init_jumpnull != -1)
 	{
 		ExprEvalStep *as = &state->steps[adjust_init_jumpnull];
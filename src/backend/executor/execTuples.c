@@ -1887,6 +1887,105 @@ slot_getsomeattrs_int(TupleTableSlot *slot, int attnum)
 	}
 }
 
+/*
+ * Number of slots slot_getsomeattrs_batch hands to heap_deform_tuples_rowwise
+ * at a time.
+ */
+#define SLOT_DEFORM_BATCH_SIZE	64
+
+/*
+ * Deform the first attnum attributes of n heap tuple slots at once, and
+ * update the slots' deforming state accordingly.
+ */
+static void
+slot_deform_heap_batch(TupleDesc tupleDesc, HeapTupleTableSlot **hslots,
+					   int n, int attnum)
+{
+	HeapTuple	tuples[SLOT_DEFORM_BATCH_SIZE];
+	Datum	   *values[SLOT_DEFORM_BATCH_SIZE];
+	bool	   *isnull[SLOT_DEFORM_BATCH_SIZE];
+	uint32		offsets[SLOT_DEFORM_BATCH_SIZE];
+	int			i;
+
+	Assert(n <= SLOT_DEFORM_BATCH_SIZE);
+
+	for (i = 0; i < n; i++)
+	{
+		tuples[i] = hslots[i]->tuple;
+		values[i] = hslots[i]->base.tts_values;
+		isnull[i] = hslots[i]->base.tts_isnull;
+	}
+
+	heap_deform_tuples_rowwise(tupleDesc, n, tuples, attnum,
+							   values, isnull, offsets);
+
+	for (i = 0; i < n; i++)
+	{
+		/*
+		 * Missing attributes have been filled in too, so all attnum
+		 * attributes are valid now.  Since the remembered offset may not be
+		 * one that attcacheoff can be used from, force the slow path if we
+		 * ever continue deforming.
+		 */
+		hslots[i]->base.tts_nvalid = attnum;
+		hslots[i]->off = offsets[i];
+		hslots[i]->base.tts_flags |= TTS_FLAG_SLOW;
+	}
+}
+
+/*
+ * slot_getsomeattrs_batch
+ *		Like slot_getsomeattrs, for an array of slots at once.
+ *
+ * Slots holding heap tuples that haven't been deformed at all yet are
+ * deformed together by heap_deform_tuples_rowwise, which is considerably
+ * cheaper per tuple than deforming them one by one.  This is intended for
+ * scans that have fetched many tuples of the same relation.  Any other
+ * slots are simply handled by slot_getsomeattrs.
+ */
+void
+slot_getsomeattrs_batch(TupleTableSlot **slots, int nslots, int attnum)
+{
+	TupleDesc	tupleDesc = NULL;
+	HeapTupleTableSlot *hslots[SLOT_DEFORM_BATCH_SIZE];
+	int			n = 0;
+	int			i;
+
+	Assert(attnum > 0);
+
+	for (i = 0; i < nslots; i++)
+	{
+		TupleTableSlot *slot = slots[i];
+
+		if (slot->tts_nvalid >= attnum)
+			continue;
+
+		if (slot->tts_nvalid != 0 || TTS_EMPTY(slot) ||
+			!(TTS_IS_HEAPTUPLE(slot) || TTS_IS_BUFFERTUPLE(slot)) ||
+			(tupleDesc != NULL && slot->tts_tupleDescriptor != tupleDesc))
+		{
+			/* not suitable for batching, do it the regular way */
+			slot_getsomeattrs(slot, attnum);
+			continue;
+		}
+
+		if (unlikely(attnum > slot->tts_tupleDescriptor->natts))
+			elog(ERROR, "invalid attribute number %d", attnum);
+
+		tupleDesc = slot->tts_tupleDescriptor;
+		hslots[n++] = (HeapTupleTableSlot *) slot;
+
+		if (n == SLOT_DEFORM_BATCH_SIZE)
+		{
+			slot_deform_heap_batch(tupleDesc, hslots, n, attnum);
+			n = 0;
+		}
+	}
+
+	if (n > 0)
+		slot_deform_heap_batch(tupleDesc, hslots, n, attnum);
+}
+
 /* ----------------------------------------------------------------
  *		ExecTypeFromTL
  *
@@ -205,6 +205,39 @@
  *    to filter expressions having to be evaluated early, and allows to JIT
  *    the entire expression into one native function.
  *
+ *	  Spilling To Disk
+ *
+ *	  When performing hash aggregation, if the hash table memory exceeds the
+ *	  limit (see hash_agg_check_limits()), we enter "spill mode".  In spill
+ *	  mode, we advance the transition states only for groups already in the
+ *	  hash table.  For tuples that would need to create new hash table
+ *	  entries (and initialize new transition states), we instead spill them to
+ *	  disk to be processed later.  The tuples are spilled in a partitioned
+ *	  manner, so that subsequent batches are smaller and less likely to exceed
+ *	  work_mem (if a batch does exceed work_mem, it must be spilled
+ *	  recursively).
+ *
+ *	  Spilled data is written to logical tapes.  These provide better control
+ *	  over memory usage, disk space, and the number of files than if we were
+ *	  to use a BufFile for each spill.
+ *
+ *	  Note that it's possible for transition states to start small but then
+ *	  grow very large; for instance in the case of ARRAY_AGG.  In such cases,
+ *	  it's still possible to significantly exceed work_mem.  We try to avoid
+ *	  this situation by estimating what will fit in the available memory, and
+ *	  imposing a limit on the number of groups separately from the amount of
+ *	  memory consumed.
+ *
+ *	  Parallel HashAggregate
+ *
+ *	  Normally, the partial aggregates computed by parallel workers are
+ *	  gathered and then all combined by the leader.  A Finalize HashAggregate
+ *	  that is marked parallel_aware runs below the Gather instead: all of the
+ *	  participants divide their input among a set of shared partitions by the
+ *	  hash of the grouping keys, much like a spill, and then aggregate the
+ *	  partitions in parallel, each of them claimed by one participant.  See
+ *	  ParallelAggState.
+ *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -221,6 +254,7 @@
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "executor/execBatch.h"
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
 #include "miscadmin.h"
@@ -229,14 +263,151 @@
 #include "optimizer/optimizer.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "pgstat.h"
+#include "storage/barrier.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
+#include "utils/logtape.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/sharedtuplestore.h"
 #include "utils/syscache.h"
 #include "utils/tuplesort.h"
 #include "utils/datum.h"
 
+/*
+ * Control how many partitions are created when spilling HashAgg to
+ * disk.
+ *
+ * HASHAGG_PARTITION_FACTOR is multiplied by the estimated number of
+ * partitions needed such that each partition will fit in memory. The factor
+ * is set higher than one because there's not a high cost to having a few too
+ * many partitions, and it makes it less likely that a partition will need to
+ * be spilled recursively. Another benefit of having more, smaller partitions
+ * is that small hash tables may perform better than large ones due to memory
+ * caching effects.
+ *
+ * We also specify a min and max number of partitions per spill. Too few might
+ * mean a lot of wasted I/O from repeated spilling of the same tuples. Too
+ * many will result in lots of memory wasted buffering the spill files (which
+ * could instead be spent on a larger hash table).
+ */
+#define HASHAGG_PARTITION_FACTOR 1.50
+#define HASHAGG_MIN_PARTITIONS 4
+#define HASHAGG_MAX_PARTITIONS 1024
+
+/*
+ * For reading from tapes, the buffer size must be a multiple of
+ * BLCKSZ. Larger values help when reading from multiple tapes concurrently,
+ * but that doesn't happen in HashAgg, so we simply use BLCKSZ. Writing to a
+ * tape always uses a buffer of size BLCKSZ.
+ */
+#define HASHAGG_READ_BUFFER_SIZE BLCKSZ
+#define HASHAGG_WRITE_BUFFER_SIZE BLCKSZ
+
+/* minimum number of initial hash table buckets */
+#define HASHAGG_MIN_BUCKETS 256
+
+/*
+ * Number of shared partitions in a Parallel HashAggregate, per participant,
+ * and the limits on the total.  Each participant keeps a write buffer open
+ * for every partition while dividing up its input, so there shouldn't be too
+ * many; a partition that turns out not to fit in work_mem is spilled the
+ * same way as a batch of a serial hash aggregate.
+ */
+#define PARALLEL_HASHAGG_PARTITIONS_PER_PARTICIPANT 4
+#define PARALLEL_HASHAGG_MIN_PARTITIONS 8
+#define PARALLEL_HASHAGG_MAX_PARTITIONS 32
+
+/* Phases of ParallelAggState's barrier */
+#define PHAGG_PARTITIONING		0
+#define PHAGG_AGGREGATING		1
+
+/*
+ * Track all tapes needed for a HashAgg that spills. We don't know the maximum
+ * number of tapes needed at the start of the algorithm (because it can
+ * recurse), so one tape set is allocated and extended as needed for new
+ * tapes. When a particular tape is already read, rewind it for write mode and
+ * put it in the free list.
+ *
+ * Tapes' buffers can take up substantial memory when many tapes are open at
+ * once. We only need one tape open at a time in read mode (using a buffer
+ * that's a multiple of BLCKSZ); but we need one tape open in write mode (each
+ * requiring a buffer of size BLCKSZ) for each partition.
+ */
+typedef struct HashTapeInfo
+{
+	LogicalTapeSet *tapeset;
+	int			ntapes;
+	int		   *freetapes;
+	int			nfreetapes;
+	int			freetapes_alloc;
+} HashTapeInfo;
+
+/*
+ * Represents partitioned spill data for a single hashtable. Contains the
+ * necessary information to route tuples to the correct partition, and to
+ * transform the spilled data into new batches.
+ *
+ * The high bits are used for partition selection (when recursing, we ignore
+ * the bits that have already been used for partition selection at an earlier
+ * level).
+ */
+typedef struct HashAggSpill
+{
+	LogicalTapeSet *tapeset;	/* borrowed reference to tape set */
+	int			npartitions;	/* number of partitions */
+	int		   *partitions;		/* spill partition tape numbers */
+	int64	   *ntuples;		/* number of tuples in each partition */
+	uint32		mask;			/* mask to find partition from hash value */
+	int			shift;			/* after masking, shift by this amount */
+} HashAggSpill;
+
+/*
+ * Represents work to be done for one pass of hash aggregation (with only one
+ * grouping set).
+ *
+ * Also tracks the bits of the hash already used for partition selection by
+ * earlier iterations, so that this batch can use new bits. If all bits have
+ * already been used, no partitioning will be done (any spilled data will go
+ * to a single output tape).
+ */
+typedef struct HashAggBatch
+{
+	int			setno;			/* grouping set */
+	int			used_bits;		/* number of bits of hash already used */
+	LogicalTapeSet *tapeset;	/* borrowed reference to tape set */
+	int			input_tapenum;	/* input partition tape */
+	SharedTuplestoreAccessor *sts;	/* shared partition to read instead of a
+									 * tape, or NULL */
+	int64		input_tuples;	/* number of tuples in this batch */
+} HashAggBatch;
+
+/*
+ * Shared state of a Parallel HashAggregate, which finalizes the partial
+ * aggregates computed by the workers below it without funneling them all
+ * through the leader.
+ *
+ * Every participant first divides the rows from its outer plan among
+ * npartitions shared tuplestores, by the high bits of the hash of their
+ * grouping keys.  Once all of them are done, each one repeatedly claims a
+ * partition that nobody has claimed yet and aggregates it like a batch of
+ * spilled tuples.  No group spans two partitions, so the resulting groups
+ * are complete and are returned straight to the Gather above.
+ *
+ * The partitions' SharedTuplestores follow the ntuples array.
+ */
+typedef struct ParallelAggState
+{
+	Barrier		barrier;		/* are we done partitioning? */
+	int			nparticipants;	/* maximum number of participants */
+	int			npartitions;	/* number of partitions, a power of two */
+	int			partition_bits; /* log2(npartitions) */
+	pg_atomic_uint32 next_partition;	/* next partition to claim */
+	SharedFileSet fileset;		/* space for the partitions' files */
+	pg_atomic_uint64 ntuples[FLEXIBLE_ARRAY_MEMBER];	/* rows per partition */
+} ParallelAggState;
 
 static void select_current_set(AggState *aggstate, int setno, bool is_hash);
 static void initialize_phase(AggState *aggstate, int newphase);
@@ -271,12 +442,54 @@ static void finalize_aggregates(AggState *aggstate,
 static TupleTableSlot *project_aggregates(AggState *aggstate);
 static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
-static void build_hash_table(AggState *aggstate);
-static TupleHashEntryData *lookup_hash_entry(AggState *aggstate);
+static void build_hash_tables(AggState *aggstate);
+static void build_hash_table(AggState *aggstate, int setno, long nbuckets);
+static void hashagg_recompile_expressions(AggState *aggstate, bool minslot,
+										  bool nullcheck);
+static long hash_choose_num_buckets(double hashentrysize,
+									long estimated_nbuckets,
+									Size memory);
+static int	hash_choose_num_partitions(uint64 input_groups,
+									   double hashentrysize,
+									   int used_bits,
+									   int *log2_npartitions);
+static AggStatePerGroup lookup_hash_entry(AggState *aggstate, uint32 hash);
 static void lookup_hash_entries(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
+static void agg_fill_shared_partitions(AggState *aggstate);
+static bool agg_refill_hash_table(AggState *aggstate);
+static HashAggBatch *agg_claim_shared_partition(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
+static TupleTableSlot *agg_retrieve_hash_table_in_memory(AggState *aggstate);
+static void hash_agg_check_limits(AggState *aggstate);
+static void hash_agg_enter_spill_mode(AggState *aggstate);
+static void hash_agg_update_metrics(AggState *aggstate, bool from_tape,
+									int npartitions);
+static void hashagg_finish_initial_spills(AggState *aggstate);
+static void hashagg_reset_spill_state(AggState *aggstate);
+static HashAggBatch *hashagg_batch_new(LogicalTapeSet *tapeset,
+									   int input_tapenum, int setno,
+									   int64 input_tuples, int used_bits);
+static MinimalTuple hashagg_batch_read(HashAggBatch *batch, uint32 *hashp);
+static Size parallel_agg_state_size(int nparticipants, int npartitions);
+static SharedTuplestore *parallel_agg_partition(ParallelAggState *pstate,
+												int partno);
+static int	parallel_agg_num_partitions(int nparticipants);
+static void ExecAggInitializePartitions(AggState *node,
+										ParallelAggState *pstate);
+static void hashagg_spill_init(HashAggSpill *spill, HashTapeInfo *tapeinfo,
+							   int used_bits, uint64 input_tuples,
+							   double hashentrysize);
+static Size hashagg_spill_tuple(HashAggSpill *spill, TupleTableSlot *slot,
+								uint32 hash);
+static void hashagg_spill_finish(AggState *aggstate, HashAggSpill *spill,
+								 int setno);
+static void hashagg_tapeinfo_init(AggState *aggstate);
+static void hashagg_tapeinfo_assign(HashTapeInfo *tapeinfo, int *dest,
+									int ndest);
+static void hashagg_tapeinfo_release(HashTapeInfo *tapeinfo, int tapenum);
+static void hashagg_tapeinfo_recycle(HashTapeInfo *tapeinfo, int tapenum);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 									  AggState *aggstate, EState *estate,
@@ -384,6 +597,9 @@ initialize_phase(AggState *aggstate, int newphase)
  * populated by the previous phase.  Copy it to the sorter for the next phase
  * if any.
  *
+ * If the outer plan supports batch mode, we pull its rows a batch at a time
+ * and hand them out one by one from here.
+ *
  * Callers cannot rely on memory for tuple in returned slot remaining valid
  * past any subsequently fetched tuple.
  */
@@ -401,6 +617,27 @@ fetch_input_tuple(AggState *aggstate)
 			return NULL;
 		slot = aggstate->sort_slot;
 	}
+	else if (aggstate->batch_input)
+	{
+		TupleBatch *batch = aggstate->input_batch;
+
+		if (batch == NULL || aggstate->input_batch_pos >= batch->nrows)
+		{
+			/* don't call the outer plan again once it has run out */
+			if (aggstate->input_batch_done)
+				return NULL;
+
+			batch = ExecProcNodeBatch(outerPlanState(aggstate));
+			aggstate->input_batch = batch;
+			aggstate->input_batch_pos = 0;
+			if (batch == NULL)
+			{
+				aggstate->input_batch_done = true;
+				return NULL;
+			}
+		}
+		slot = batch->slots[aggstate->input_batch_pos++];
+	}
 	else
 		slot = ExecProcNode(outerPlanState(aggstate));
 
@@ -1261,39 +1498,73 @@ find_unaggregated_cols_walker(Node *node, Bitmapset **colnos)
  * they are all reset at the same time).
  */
 static void
-build_hash_table(AggState *aggstate)
+build_hash_tables(AggState *aggstate)
 {
-	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
-	Size		additionalsize;
-	int			i;
-
-	Assert(aggstate->aggstrategy == AGG_HASHED || aggstate->aggstrategy == AGG_MIXED);
-
-	additionalsize = aggstate->numtrans * sizeof(AggStatePerGroupData);
+	int			setno;
 
-	for (i = 0; i < aggstate->num_hashes; ++i)
+	for (setno = 0; setno < aggstate->num_hashes; ++setno)
 	{
-		AggStatePerHash perhash = &aggstate->perhash[i];
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+		long		nbuckets;
+		Size		memory;
+
+		if (perhash->hashtable != NULL)
+		{
+			ResetTupleHashTable(perhash->hashtable);
+			continue;
+		}
 
 		Assert(perhash->aggnode->numGroups > 0);
 
-		if (perhash->hashtable)
-			ResetTupleHashTable(perhash->hashtable);
-		else
-			perhash->hashtable = BuildTupleHashTableExt(&aggstate->ss.ps,
-														perhash->hashslot->tts_tupleDescriptor,
-														perhash->numCols,
-														perhash->hashGrpColIdxHash,
-														perhash->eqfuncoids,
-														perhash->hashfunctions,
-														perhash->aggnode->grpCollations,
-														perhash->aggnode->numGroups,
-														additionalsize,
-														aggstate->ss.ps.state->es_query_cxt,
-														aggstate->hashcontext->ecxt_per_tuple_memory,
-														tmpmem,
-														DO_AGGSPLIT_SKIPFINAL(aggstate->aggsplit));
+		memory = aggstate->hash_mem_limit / aggstate->num_hashes;
+
+		/* choose reasonable number of buckets per hashtable */
+		nbuckets = hash_choose_num_buckets(aggstate->hashentrysize,
+										   perhash->aggnode->numGroups,
+										   memory);
+
+		build_hash_table(aggstate, setno, nbuckets);
 	}
+
+	aggstate->hash_ngroups_current = 0;
+}
+
+/*
+ * Build a single hashtable for this grouping set.
+ */
+static void
+build_hash_table(AggState *aggstate, int setno, long nbuckets)
+{
+	AggStatePerHash perhash = &aggstate->perhash[setno];
+	MemoryContext metacxt = aggstate->hash_metacxt;
+	MemoryContext hashcxt = aggstate->hashcontext->ecxt_per_tuple_memory;
+	MemoryContext tmpcxt = aggstate->tmpcontext->ecxt_per_tuple_memory;
+	Size		additionalsize;
+
+	Assert(aggstate->aggstrategy == AGG_HASHED ||
+		   aggstate->aggstrategy == AGG_MIXED);
+
+	/*
+	 * Used to make sure initial hash table allocation does not exceed
+	 * work_mem. Note that the estimate does not include space for
+	 * pass-by-reference transition data values, nor for the representative
+	 * tuple of each group.
+	 */
+	additionalsize = aggstate->numtrans * sizeof(AggStatePerGroupData);
+
+	perhash->hashtable = BuildTupleHashTableExt(&aggstate->ss.ps,
+												perhash->hashslot->tts_tupleDescriptor,
+												perhash->numCols,
+												perhash->hashGrpColIdxHash,
+												perhash->eqfuncoids,
+												perhash->hashfunctions,
+												perhash->aggnode->grpCollations,
+												nbuckets,
+												additionalsize,
+												metacxt,
+												hashcxt,
+												tmpcxt,
+												DO_AGGSPLIT_SKIPFINAL(aggstate->aggsplit));
 }
 
 /*
@@ -1455,21 +1726,343 @@ hash_agg_entry_size(int numAggs)
 }
 
 /*
- * Find or create a hashtable entry for the tuple group containing the current
- * tuple (already set in tmpcontext's outertuple slot), in the current grouping
- * set (which the caller must have selected - note that initialize_aggregate
- * depends on this).
+ * hashagg_recompile_expressions()
  *
- * When called, CurrentMemoryContext should be the per-query context.
+ * Identifies the right phase, compiles the right expression given the
+ * arguments, and then sets phase->evalfunc to that expression.
+ *
+ * Different versions of the compiled expression are needed depending on
+ * whether hash aggregation has spilled or not, and whether it's reading from
+ * the outer plan or a tape. Before spilling to disk, the expression reads
+ * from the outer plan and does not need to perform a NULL check. After
+ * HashAgg begins to spill, new groups will not be created in the hash table,
+ * and the AggStatePerGroup array may be NULL; therefore we need to add a null
+ * pointer check to the expression. Then, when reading spilled data from a
+ * tape, we change the outer slot type to be a fixed minimal tuple slot.
+ *
+ * It would be wasteful to recompile every time, so cache the compiled
+ * expressions in the AggStatePerPhase, and reuse when appropriate.
+ */
+static void
+hashagg_recompile_expressions(AggState *aggstate, bool minslot, bool nullcheck)
+{
+	AggStatePerPhase phase;
+	int			i = minslot ? 1 : 0;
+	int			j = nullcheck ? 1 : 0;
+
+	Assert(aggstate->aggstrategy == AGG_HASHED ||
+		   aggstate->aggstrategy == AGG_MIXED);
+
+	if (aggstate->aggstrategy == AGG_HASHED)
+		phase = &aggstate->phases[0];
+	else						/* AGG_MIXED */
+		phase = &aggstate->phases[1];
+
+	if (phase->evaltrans_cache[i][j] == NULL)
+	{
+		const TupleTableSlotOps *outerops = aggstate->ss.ps.outerops;
+		bool		outerfixed = aggstate->ss.ps.outeropsfixed;
+		bool		dohash = true;
+		bool		dosort;
+
+		/*
+		 * In AGG_MIXED mode, the sorted grouping sets are advanced along with
+		 * the hashed ones while reading the outer plan.  Spilled tuples are
+		 * only ever read back (as minimal tuples) once all sorted output is
+		 * done, so the expression used for that mustn't touch the sorted
+		 * grouping sets' transition states.
+		 */
+		dosort = (aggstate->aggstrategy == AGG_MIXED && !minslot);
+
+		/* temporarily change the outerops while compiling the expression */
+		if (minslot)
+		{
+			aggstate->ss.ps.outerops = &TTSOpsMinimalTuple;
+			aggstate->ss.ps.outeropsfixed = true;
+		}
+
+		phase->evaltrans_cache[i][j] = ExecBuildAggTrans(aggstate, phase,
+														 dosort, dohash,
+														 nullcheck);
+
+		/* change back */
+		aggstate->ss.ps.outerops = outerops;
+		aggstate->ss.ps.outeropsfixed = outerfixed;
+	}
+
+	phase->evaltrans = phase->evaltrans_cache[i][j];
+}
+
+/*
+ * Set limits that trigger spilling to avoid exceeding work_mem. Consider the
+ * number of partitions we expect to create (if we do spill).
+ *
+ * There are two limits: a memory limit, and also an ngroups limit. The
+ * ngroups limit becomes important when we expect transition values to grow
+ * substantially larger than the initial value.
+ */
+void
+hash_agg_set_limits(double hashentrysize, uint64 input_groups, int used_bits,
+					Size *mem_limit, uint64 *ngroups_limit,
+					int *num_partitions)
+{
+	int			npartitions;
+	Size		partition_mem;
+
+	/* if not expected to spill, use all of work_mem */
+	if (input_groups * hashentrysize < work_mem * 1024L)
+	{
+		if (num_partitions != NULL)
+			*num_partitions = 0;
+		*mem_limit = work_mem * 1024L;
+		*ngroups_limit = *mem_limit / hashentrysize;
+		return;
+	}
+
+	/*
+	 * Calculate expected memory requirements for spilling, which is the size
+	 * of the buffers needed for all the tapes that need to be open at once.
+	 * Then, subtract that from the memory available for holding hash tables.
+	 */
+	npartitions = hash_choose_num_partitions(input_groups,
+											 hashentrysize,
+											 used_bits,
+											 NULL);
+	if (num_partitions != NULL)
+		*num_partitions = npartitions;
+
+	partition_mem =
+		HASHAGG_READ_BUFFER_SIZE +
+		HASHAGG_WRITE_BUFFER_SIZE * npartitions;
+
+	/*
+	 * Don't set the limit below 3/4 of work_mem. In that case, we are at the
+	 * minimum number of partitions, so we aren't going to dramatically exceed
+	 * work mem anyway.
+	 */
+	if (work_mem * 1024L > 4 * partition_mem)
+		*mem_limit = work_mem * 1024L - partition_mem;
+	else
+		*mem_limit = work_mem * 1024L * 0.75;
+
+	if (*mem_limit > hashentrysize)
+		*ngroups_limit = *mem_limit / hashentrysize;
+	else
+		*ngroups_limit = 1;
+}
+
+/*
+ * hash_agg_check_limits
+ *
+ * After adding a new group to the hash table, check whether we need to enter
+ * spill mode. Allocations may happen without adding new groups (for instance,
+ * if the transition state size grows), so this check is imperfect.
+ */
+static void
+hash_agg_check_limits(AggState *aggstate)
+{
+	uint64		ngroups = aggstate->hash_ngroups_current;
+	Size		meta_mem = MemoryContextMemAllocated(aggstate->hash_metacxt,
+													 true);
+	Size		hash_mem = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+													 true);
+
+	/*
+	 * Don't spill unless there's at least one group in the hash table so we
+	 * can be sure to make progress even in edge cases.
+	 */
+	if (aggstate->hash_ngroups_current > 0 &&
+		(meta_mem + hash_mem > aggstate->hash_mem_limit ||
+		 ngroups > aggstate->hash_ngroups_limit))
+	{
+		hash_agg_enter_spill_mode(aggstate);
+	}
+}
+
+/*
+ * Enter "spill mode", meaning that no new groups are added to any of the hash
+ * tables. Tuples that would create a new group are instead spilled, and
+ * processed later.
+ */
+static void
+hash_agg_enter_spill_mode(AggState *aggstate)
+{
+	aggstate->hash_spill_mode = true;
+	hashagg_recompile_expressions(aggstate, aggstate->table_filled, true);
+
+	if (!aggstate->hash_ever_spilled)
+	{
+		int			setno;
+
+		Assert(aggstate->hash_tapeinfo == NULL);
+		Assert(aggstate->hash_spills == NULL);
+
+		aggstate->hash_ever_spilled = true;
+
+		hashagg_tapeinfo_init(aggstate);
+
+		/*
+		 * A Parallel HashAggregate doesn't add any groups while reading its
+		 * outer plan, so it can first run out of memory while aggregating a
+		 * shared partition.  agg_refill_hash_table() sets up the spill for
+		 * that.
+		 */
+		if (aggstate->table_filled)
+			return;
+
+		aggstate->hash_spills = palloc(sizeof(HashAggSpill) * aggstate->num_hashes);
+
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			AggStatePerHash perhash = &aggstate->perhash[setno];
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+
+			hashagg_spill_init(spill, aggstate->hash_tapeinfo, 0,
+							   perhash->aggnode->numGroups,
+							   aggstate->hashentrysize);
+		}
+	}
+}
+
+/*
+ * Update metrics after filling the hash table.
+ *
+ * If reading from the outer plan, from_tape should be false; if reading from
+ * another tape, from_tape should be true.
+ */
+static void
+hash_agg_update_metrics(AggState *aggstate, bool from_tape, int npartitions)
+{
+	Size		meta_mem;
+	Size		hash_mem;
+	Size		buffer_mem;
+	Size		total_mem;
+
+	if (aggstate->aggstrategy != AGG_MIXED &&
+		aggstate->aggstrategy != AGG_HASHED)
+		return;
+
+	/* memory for the hash table itself */
+	meta_mem = MemoryContextMemAllocated(aggstate->hash_metacxt, true);
+
+	/* memory for the group keys and transition states */
+	hash_mem = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+										 true);
+
+	/* memory for read/write tape buffers, if spilled */
+	buffer_mem = npartitions * HASHAGG_WRITE_BUFFER_SIZE;
+	if (from_tape)
+		buffer_mem += HASHAGG_READ_BUFFER_SIZE;
+
+	/* update peak mem */
+	total_mem = meta_mem + hash_mem + buffer_mem;
+	if (total_mem > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = total_mem;
+
+	/* update disk usage */
+	if (aggstate->hash_tapeinfo != NULL)
+	{
+		uint64		disk_used = LogicalTapeSetBlocks(aggstate->hash_tapeinfo->tapeset) * (BLCKSZ / 1024);
+
+		if (aggstate->hash_disk_used < disk_used)
+			aggstate->hash_disk_used = disk_used;
+	}
+
+	/* update hashentrysize estimate based on contents */
+	if (aggstate->hash_ngroups_current > 0)
+	{
+		aggstate->hashentrysize =
+			sizeof(TupleHashEntryData) +
+			(hash_mem / (double) aggstate->hash_ngroups_current);
+	}
+}
+
+/*
+ * Choose a reasonable number of buckets for the initial hash table size.
+ */
+static long
+hash_choose_num_buckets(double hashentrysize, long ngroups, Size memory)
+{
+	long		max_nbuckets;
+	long		nbuckets = ngroups;
+
+	max_nbuckets = memory / hashentrysize;
+
+	/*
+	 * Leave room for slop to avoid a case where the initial hash table size
+	 * exceeds the memory limit (though that may still happen in edge cases).
+	 */
+	max_nbuckets *= 0.75;
+
+	if (nbuckets > max_nbuckets)
+		nbuckets = max_nbuckets;
+	if (nbuckets < HASHAGG_MIN_BUCKETS)
+		nbuckets = HASHAGG_MIN_BUCKETS;
+	return nbuckets;
+}
+
+/*
+ * Determine the number of partitions to create when spilling, which will
+ * always be a power of two. If log2_npartitions is non-NULL, set
+ * *log2_npartitions to the log2() of the number of partitions.
+ */
+static int
+hash_choose_num_partitions(uint64 input_groups, double hashentrysize,
+						   int used_bits, int *log2_npartitions)
+{
+	Size		mem_wanted;
+	int			partition_limit;
+	int			npartitions;
+	int			partition_bits;
+
+	/*
+	 * Avoid creating so many partitions that the memory requirements of the
+	 * open partition files are greater than 1/4 of work_mem.
+	 */
+	partition_limit =
+		(work_mem * 1024L * 0.25 - HASHAGG_READ_BUFFER_SIZE) /
+		HASHAGG_WRITE_BUFFER_SIZE;
+
+	mem_wanted = HASHAGG_PARTITION_FACTOR * input_groups * hashentrysize;
+
+	/* make enough partitions so that each one is likely to fit in memory */
+	npartitions = 1 + (mem_wanted / (work_mem * 1024L));
+
+	if (npartitions > partition_limit)
+		npartitions = partition_limit;
+
+	if (npartitions < HASHAGG_MIN_PARTITIONS)
+		npartitions = HASHAGG_MIN_PARTITIONS;
+	if (npartitions > HASHAGG_MAX_PARTITIONS)
+		npartitions = HASHAGG_MAX_PARTITIONS;
+
+	/* ceil(log2(npartitions)) */
+	partition_bits = my_log2(npartitions);
+
+	/* make sure that we don't exhaust the hash bits */
+	if (partition_bits + used_bits >= 32)
+		partition_bits = 32 - used_bits;
+
+	if (log2_npartitions != NULL)
+		*log2_npartitions = partition_bits;
+
+	/* number of partitions will be a power of two */
+	npartitions = 1L << partition_bits;
+
+	return npartitions;
+}
+
+/*
+ * Extract the grouping columns of the current input tuple (already set in
+ * tmpcontext's outertuple slot) into the hashslot of the current grouping
+ * set, ready for hashing and hash table lookups.
  */
-static TupleHashEntryData *
-lookup_hash_entry(AggState *aggstate)
+static inline void
+prepare_hash_slot(AggState *aggstate)
 {
 	TupleTableSlot *inputslot = aggstate->tmpcontext->ecxt_outertuple;
 	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
 	TupleTableSlot *hashslot = perhash->hashslot;
-	TupleHashEntryData *entry;
-	bool		isnew;
 	int			i;
 
 	/* transfer just the needed columns into hashslot */
@@ -1484,15 +2077,49 @@ lookup_hash_entry(AggState *aggstate)
 		hashslot->tts_isnull[i] = inputslot->tts_isnull[varNumber];
 	}
 	ExecStoreVirtualTuple(hashslot);
+}
+
+/*
+ * Find or create a hashtable entry for the tuple group containing the current
+ * tuple (already set in tmpcontext's outertuple slot, and extracted into the
+ * hashslot by prepare_hash_slot()), in the current grouping set (which the
+ * caller must have selected - note that initialize_aggregate depends on
+ * this).
+ *
+ * When called, CurrentMemoryContext should be the per-query context. The
+ * already-calculated hash value for the tuple must be specified.
+ *
+ * If in "spill mode", then only find existing hashtable entries; don't create
+ * new ones. If a tuple's group is not already present in the hash table for
+ * the current grouping set, return NULL and the caller will spill it to disk.
+ */
+static AggStatePerGroup
+lookup_hash_entry(AggState *aggstate, uint32 hash)
+{
+	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
+	TupleTableSlot *hashslot = perhash->hashslot;
+	TupleHashEntryData *entry;
+	bool		isnew = false;
+	bool	   *p_isnew;
+
+	/* if hash table already spilled, don't create new entries */
+	p_isnew = aggstate->hash_spill_mode ? NULL : &isnew;
 
 	/* find or create the hashtable entry using the filtered tuple */
-	entry = LookupTupleHashEntry(perhash->hashtable, hashslot, &isnew);
+	entry = LookupTupleHashEntryHash(perhash->hashtable, hashslot, p_isnew,
+									 hash);
+
+	if (entry == NULL)
+		return NULL;
 
 	if (isnew)
 	{
 		AggStatePerGroup pergroup;
 		int			transno;
 
+		aggstate->hash_ngroups_current++;
+		hash_agg_check_limits(aggstate);
+
 		pergroup = (AggStatePerGroup)
 			MemoryContextAlloc(perhash->hashtable->tablecxt,
 							   sizeof(AggStatePerGroupData) * aggstate->numtrans);
@@ -1511,7 +2138,7 @@ lookup_hash_entry(AggState *aggstate)
 		}
 	}
 
-	return entry;
+	return entry->additional;
 }
 
 /*
@@ -1519,6 +2146,18 @@ lookup_hash_entry(AggState *aggstate)
  * returning an array of pergroup pointers suitable for advance_aggregates.
  *
  * Be aware that lookup_hash_entry can reset the tmpcontext.
+ *
+ * Some entries may be left NULL if we are in "spill mode". The same tuple
+ * will belong to different groups for each grouping set, so may match a group
+ * already in memory for one set and match a group not in memory for another
+ * set. When in "spill mode", the tuple will be spilled for each grouping set
+ * where it doesn't match a group in memory.
+ *
+ * NB: It's possible to spill the same tuple for several different grouping
+ * sets. This may seem wasteful, but it's actually a trade-off: if we spill
+ * the tuple multiple times for multiple grouping sets, it can be partitioned
+ * for each grouping set, making the refilling of the hash table very
+ * efficient.
  */
 static void
 lookup_hash_entries(AggState *aggstate)
@@ -1529,8 +2168,27 @@ lookup_hash_entries(AggState *aggstate)
 
 	for (setno = 0; setno < numHashes; setno++)
 	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+		uint32		hash;
+
 		select_current_set(aggstate, setno, true);
-		pergroup[setno] = lookup_hash_entry(aggstate)->additional;
+		prepare_hash_slot(aggstate);
+		hash = TupleHashTableHash(perhash->hashtable, perhash->hashslot);
+		pergroup[setno] = lookup_hash_entry(aggstate, hash);
+
+		/* check to see if we need to spill the tuple for this grouping set */
+		if (pergroup[setno] == NULL)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+			TupleTableSlot *slot = aggstate->tmpcontext->ecxt_outertuple;
+
+			if (spill->partitions == NULL)
+				hashagg_spill_init(spill, aggstate->hash_tapeinfo, 0,
+								   perhash->aggnode->numGroups,
+								   aggstate->hashentrysize);
+
+			hashagg_spill_tuple(spill, slot, hash);
+		}
 	}
 }
 
@@ -1853,6 +2511,12 @@ agg_retrieve_direct(AggState *aggstate)
 					if (TupIsNull(outerslot))
 					{
 						/* no more outer-plan tuples available */
+
+						/* if we built hash tables, finalize any spills */
+						if (aggstate->aggstrategy == AGG_MIXED &&
+							aggstate->current_phase == 1)
+							hashagg_finish_initial_spills(aggstate);
+
 						if (hasGroupingSets)
 						{
 							aggstate->input_done = true;
@@ -1929,6 +2593,12 @@ agg_fill_hash_table(AggState *aggstate)
 	TupleTableSlot *outerslot;
 	ExprContext *tmpcontext = aggstate->tmpcontext;
 
+	if (aggstate->parallel_state != NULL)
+	{
+		agg_fill_shared_partitions(aggstate);
+		return;
+	}
+
 	/*
 	 * Process each outer-plan tuple, and then fetch the next one, until we
 	 * exhaust the outer plan.
@@ -1955,6 +2625,9 @@ agg_fill_hash_table(AggState *aggstate)
 		ResetExprContext(aggstate->tmpcontext);
 	}
 
+	/* finalize spills, if any */
+	hashagg_finish_initial_spills(aggstate);
+
 	aggstate->table_filled = true;
 	/* Initialize to walk the first hash table */
 	select_current_set(aggstate, 0, true);
@@ -1963,27 +2636,343 @@ agg_fill_hash_table(AggState *aggstate)
 }
 
 /*
- * ExecAgg for hashed case: retrieving groups from hash table
+ * ExecAgg for Parallel HashAggregate: divide the input among the shared
+ * partitions
+ *
+ * The hash table is left empty; the groups are formed one partition at a time
+ * by agg_refill_hash_table().
  */
-static TupleTableSlot *
-agg_retrieve_hash_table(AggState *aggstate)
+static void
+agg_fill_shared_partitions(AggState *aggstate)
 {
-	ExprContext *econtext;
-	AggStatePerAgg peragg;
-	AggStatePerGroup pergroup;
-	TupleHashEntryData *entry;
-	TupleTableSlot *firstSlot;
-	TupleTableSlot *result;
-	AggStatePerHash perhash;
+	ParallelAggState *pstate = aggstate->parallel_state;
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+
+	Assert(aggstate->num_hashes == 1);
 
 	/*
-	 * get state info from node.
-	 *
-	 * econtext is the per-output-tuple expression context.
+	 * A participant that shows up after partitioning is over has no input
+	 * left to read, as its outer plan is a parallel scan that the others have
+	 * run to completion.
 	 */
-	econtext = aggstate->ss.ps.ps_ExprContext;
-	peragg = aggstate->peragg;
-	firstSlot = aggstate->ss.ss_ScanTupleSlot;
+	if (BarrierAttach(&pstate->barrier) == PHAGG_PARTITIONING)
+	{
+		int			shift = 32 - pstate->partition_bits;
+		int64	   *ntuples;
+		int			partno;
+
+		ntuples = palloc0(sizeof(int64) * pstate->npartitions);
+
+		select_current_set(aggstate, 0, true);
+
+		for (;;)
+		{
+			TupleTableSlot *outerslot;
+			MinimalTuple tuple;
+			bool		shouldFree;
+			uint32		hash;
+
+			outerslot = fetch_input_tuple(aggstate);
+			if (TupIsNull(outerslot))
+				break;
+
+			tmpcontext->ecxt_outertuple = outerslot;
+			prepare_hash_slot(aggstate);
+			hash = TupleHashTableHash(perhash->hashtable, perhash->hashslot);
+
+			/* the high bits pick the partition, like a spill would */
+			partno = hash >> shift;
+
+			tuple = ExecFetchSlotMinimalTuple(outerslot, &shouldFree);
+			sts_puttuple(aggstate->partition_sts[partno], &hash, tuple);
+			ntuples[partno]++;
+
+			if (shouldFree)
+				pfree(tuple);
+
+			ResetExprContext(tmpcontext);
+		}
+
+		for (partno = 0; partno < pstate->npartitions; partno++)
+		{
+			sts_end_write(aggstate->partition_sts[partno]);
+			if (ntuples[partno] > 0)
+				pg_atomic_add_fetch_u64(&pstate->ntuples[partno],
+										ntuples[partno]);
+		}
+		pfree(ntuples);
+
+		/* wait for everyone else to finish writing */
+		BarrierArriveAndWait(&pstate->barrier,
+							 WAIT_EVENT_HASHAGG_PARTITIONING);
+	}
+	BarrierDetach(&pstate->barrier);
+
+	aggstate->table_filled = true;
+	/* Initialize to walk the (empty) hash table */
+	select_current_set(aggstate, 0, true);
+	ResetTupleHashIterator(aggstate->perhash[0].hashtable,
+						   &aggstate->perhash[0].hashiter);
+}
+
+/*
+ * Claim the next shared partition of a Parallel HashAggregate that has any
+ * rows in it, and return a batch to read it.  Returns NULL once all of the
+ * partitions have been claimed.
+ */
+static HashAggBatch *
+agg_claim_shared_partition(AggState *aggstate)
+{
+	ParallelAggState *pstate = aggstate->parallel_state;
+
+	for (;;)
+	{
+		uint32		partno;
+		uint64		ntuples;
+		HashAggBatch *batch;
+
+		partno = pg_atomic_fetch_add_u32(&pstate->next_partition, 1);
+		if (partno >= pstate->npartitions)
+			return NULL;
+
+		ntuples = pg_atomic_read_u64(&pstate->ntuples[partno]);
+		if (ntuples == 0)
+			continue;
+
+		batch = hashagg_batch_new(NULL, -1, 0, ntuples,
+								  pstate->partition_bits);
+		batch->sts = aggstate->partition_sts[partno];
+		aggstate->hash_batches_used++;
+
+		return batch;
+	}
+}
+
+/*
+ * If any data was spilled during hash aggregation, reset the hash table and
+ * reprocess one batch of spilled data. After reprocessing a batch, the hash
+ * table will again contain data, ready to be consumed by
+ * agg_retrieve_hash_table_in_memory().
+ *
+ * Should only be called after all in memory hash table entries have been
+ * finalized and emitted.
+ *
+ * Return false when input is exhausted and there's no more work to be done;
+ * otherwise return true.
+ */
+static bool
+agg_refill_hash_table(AggState *aggstate)
+{
+	HashAggBatch *batch;
+	HashAggSpill spill;
+	uint64		ngroups_estimate;
+	bool		spill_initialized = false;
+	int			setno;
+
+	/*
+	 * In a Parallel HashAggregate, finish off our own spilled batches before
+	 * claiming another shared partition.
+	 */
+	if (aggstate->hash_batches != NIL)
+	{
+		batch = linitial(aggstate->hash_batches);
+		aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+	}
+	else if (aggstate->parallel_state != NULL)
+	{
+		batch = agg_claim_shared_partition(aggstate);
+		if (batch == NULL)
+			return false;
+	}
+	else
+		return false;
+
+	/*
+	 * Estimate the number of groups for this batch as the total number of
+	 * tuples in its input file. Although that's a worst case, it's not bad
+	 * here for two reasons: (1) overestimating is better than
+	 * underestimating; and (2) we've already scanned the relation once, so
+	 * it's likely that we've already finalized many of the common values.
+	 */
+	ngroups_estimate = batch->input_tuples;
+
+	hash_agg_set_limits(aggstate->hashentrysize, ngroups_estimate,
+						batch->used_bits, &aggstate->hash_mem_limit,
+						&aggstate->hash_ngroups_limit, NULL);
+
+	/*
+	 * There could be residual pergroup pointers for the other grouping sets;
+	 * clear them, so that their transitions are skipped.
+	 */
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+		aggstate->hash_pergroup[setno] = NULL;
+
+	/* free memory and reset hash tables */
+	ReScanExprContext(aggstate->hashcontext);
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+		ResetTupleHashTable(aggstate->perhash[setno].hashtable);
+
+	aggstate->hash_ngroups_current = 0;
+
+	/*
+	 * In AGG_MIXED mode, hash aggregation happens in phase 1 and the output
+	 * happens in phase 0. So, we switch to phase 1 when processing a batch,
+	 * and back to phase 0 after the batch is done.
+	 */
+	Assert(aggstate->current_phase == 0);
+	if (aggstate->aggstrategy == AGG_MIXED)
+	{
+		aggstate->current_phase = 1;
+		aggstate->phase = &aggstate->phases[aggstate->current_phase];
+	}
+
+	select_current_set(aggstate, batch->setno, true);
+
+	/*
+	 * Spilled tuples are always read back as MinimalTuples, which may be
+	 * different from the outer plan, so recompile the aggregate expressions.
+	 *
+	 * We still need the NULL check, because we are only processing one
+	 * grouping set at a time and the rest will be NULL.
+	 */
+	hashagg_recompile_expressions(aggstate, true, true);
+
+	if (batch->sts != NULL)
+		sts_begin_parallel_scan(batch->sts);
+	else
+		LogicalTapeRewindForRead(batch->tapeset, batch->input_tapenum,
+								 HASHAGG_READ_BUFFER_SIZE);
+	for (;;)
+	{
+		TupleTableSlot *slot = aggstate->hash_spill_slot;
+		MinimalTuple tuple;
+		uint32		hash;
+
+		CHECK_FOR_INTERRUPTS();
+
+		tuple = hashagg_batch_read(batch, &hash);
+		if (tuple == NULL)
+			break;
+
+		/* tuples read from a shared partition belong to the tuplestore */
+		ExecStoreMinimalTuple(tuple, slot, batch->sts == NULL);
+		aggstate->tmpcontext->ecxt_outertuple = slot;
+
+		prepare_hash_slot(aggstate);
+		aggstate->hash_pergroup[batch->setno] =
+			lookup_hash_entry(aggstate, hash);
+
+		if (aggstate->hash_pergroup[batch->setno] != NULL)
+		{
+			/* Advance the aggregates (or combine functions) */
+			advance_aggregates(aggstate);
+		}
+		else
+		{
+			if (!spill_initialized)
+			{
+				/*
+				 * Avoid initializing the spill until we actually need it so
+				 * that we don't assign tapes that will never be used.
+				 */
+				spill_initialized = true;
+				hashagg_spill_init(&spill, aggstate->hash_tapeinfo,
+								   batch->used_bits, ngroups_estimate,
+								   aggstate->hashentrysize);
+			}
+			/* no memory for a new group, spill */
+			hashagg_spill_tuple(&spill, slot, hash);
+		}
+
+		/*
+		 * Reset per-input-tuple context after each tuple, but note that the
+		 * hash lookups do this too
+		 */
+		ResetExprContext(aggstate->tmpcontext);
+	}
+
+	if (batch->sts != NULL)
+		sts_end_parallel_scan(batch->sts);
+	else
+		hashagg_tapeinfo_release(aggstate->hash_tapeinfo,
+								 batch->input_tapenum);
+
+	/* change back to phase 0 */
+	aggstate->current_phase = 0;
+	aggstate->phase = &aggstate->phases[aggstate->current_phase];
+
+	if (spill_initialized)
+	{
+		hash_agg_update_metrics(aggstate, true, spill.npartitions);
+		hashagg_spill_finish(aggstate, &spill, batch->setno);
+	}
+	else
+		hash_agg_update_metrics(aggstate, true, 0);
+
+	aggstate->hash_spill_mode = false;
+
+	/* prepare to walk the first hash table */
+	select_current_set(aggstate, batch->setno, true);
+	ResetTupleHashIterator(aggstate->perhash[batch->setno].hashtable,
+						   &aggstate->perhash[batch->setno].hashiter);
+
+	pfree(batch);
+
+	return true;
+}
+
+/*
+ * ExecAgg for hashed case: retrieving groups from hash table
+ *
+ * After exhausting in-memory tuples, also try refilling the hash table using
+ * previously-spilled tuples. Only returns NULL after all in-memory and
+ * spilled tuples are exhausted.
+ */
+static TupleTableSlot *
+agg_retrieve_hash_table(AggState *aggstate)
+{
+	TupleTableSlot *result = NULL;
+
+	while (result == NULL)
+	{
+		result = agg_retrieve_hash_table_in_memory(aggstate);
+		if (result == NULL)
+		{
+			if (!agg_refill_hash_table(aggstate))
+			{
+				aggstate->agg_done = true;
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Retrieve the groups from the in-memory hash tables without considering any
+ * spilled tuples.
+ */
+static TupleTableSlot *
+agg_retrieve_hash_table_in_memory(AggState *aggstate)
+{
+	ExprContext *econtext;
+	AggStatePerAgg peragg;
+	AggStatePerGroup pergroup;
+	TupleHashEntryData *entry;
+	TupleTableSlot *firstSlot;
+	TupleTableSlot *result;
+	AggStatePerHash perhash;
+
+	/*
+	 * get state info from node.
+	 *
+	 * econtext is the per-output-tuple expression context.
+	 */
+	econtext = aggstate->ss.ps.ps_ExprContext;
+	peragg = aggstate->peragg;
+	firstSlot = aggstate->ss.ss_ScanTupleSlot;
 
 	/*
 	 * Note that perhash (and therefore anything accessed through it) can
@@ -1995,7 +2984,7 @@ agg_retrieve_hash_table(AggState *aggstate)
 	 * We loop retrieving groups until we find one satisfying
 	 * aggstate->ss.ps.qual
 	 */
-	while (!aggstate->agg_done)
+	for (;;)
 	{
 		TupleTableSlot *hashslot = perhash->hashslot;
 		int			i;
@@ -2026,8 +3015,6 @@ agg_retrieve_hash_table(AggState *aggstate)
 			}
 			else
 			{
-				/* No more hashtables, so done */
-				aggstate->agg_done = true;
 				return NULL;
 			}
 		}
@@ -2084,6 +3071,343 @@ agg_retrieve_hash_table(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * Initialize HashTapeInfo
+ */
+static void
+hashagg_tapeinfo_init(AggState *aggstate)
+{
+	HashTapeInfo *tapeinfo = palloc(sizeof(HashTapeInfo));
+	int			init_tapes = 16;	/* expanded dynamically */
+	int			i;
+
+	tapeinfo->tapeset = LogicalTapeSetCreate(init_tapes, NULL, NULL, -1);
+	tapeinfo->ntapes = init_tapes;
+	tapeinfo->nfreetapes = init_tapes;
+	tapeinfo->freetapes_alloc = init_tapes;
+	tapeinfo->freetapes = palloc(init_tapes * sizeof(int));
+	for (i = 0; i < init_tapes; i++)
+		tapeinfo->freetapes[i] = i;
+
+	aggstate->hash_tapeinfo = tapeinfo;
+}
+
+/*
+ * Assign unused tapes to spill partitions, extending the tape set if
+ * necessary.
+ */
+static void
+hashagg_tapeinfo_assign(HashTapeInfo *tapeinfo, int *partitions,
+						int npartitions)
+{
+	int			partidx = 0;
+
+	/* use free tapes if available */
+	while (partidx < npartitions && tapeinfo->nfreetapes > 0)
+		partitions[partidx++] = tapeinfo->freetapes[--tapeinfo->nfreetapes];
+
+	if (partidx < npartitions)
+	{
+		LogicalTapeSetExtend(tapeinfo->tapeset, npartitions - partidx);
+
+		while (partidx < npartitions)
+			partitions[partidx++] = tapeinfo->ntapes++;
+	}
+}
+
+/*
+ * After a tape has already been written to and then read, this function
+ * rewinds it for writing and adds it to the free list.
+ */
+static void
+hashagg_tapeinfo_release(HashTapeInfo *tapeinfo, int tapenum)
+{
+	LogicalTapeRewindForWrite(tapeinfo->tapeset, tapenum);
+	hashagg_tapeinfo_recycle(tapeinfo, tapenum);
+}
+
+/*
+ * Add a tape that is positioned for writing, and holds no data, to the free
+ * list.
+ */
+static void
+hashagg_tapeinfo_recycle(HashTapeInfo *tapeinfo, int tapenum)
+{
+	if (tapeinfo->freetapes_alloc == tapeinfo->nfreetapes)
+	{
+		tapeinfo->freetapes_alloc <<= 1;
+		tapeinfo->freetapes = repalloc(tapeinfo->freetapes,
+									   tapeinfo->freetapes_alloc * sizeof(int));
+	}
+	tapeinfo->freetapes[tapeinfo->nfreetapes++] = tapenum;
+}
+
+/*
+ * hashagg_spill_init
+ *
+ * Called after we determined that spilling is necessary. Chooses the number
+ * of partitions to create, and initializes them.
+ */
+static void
+hashagg_spill_init(HashAggSpill *spill, HashTapeInfo *tapeinfo, int used_bits,
+				   uint64 input_groups, double hashentrysize)
+{
+	int			npartitions;
+	int			partition_bits;
+
+	npartitions = hash_choose_num_partitions(input_groups, hashentrysize,
+											 used_bits, &partition_bits);
+
+	spill->partitions = palloc0(sizeof(int) * npartitions);
+	spill->ntuples = palloc0(sizeof(int64) * npartitions);
+
+	hashagg_tapeinfo_assign(tapeinfo, spill->partitions, npartitions);
+
+	spill->tapeset = tapeinfo->tapeset;
+	spill->shift = 32 - used_bits - partition_bits;
+	spill->mask = (npartitions - 1) << spill->shift;
+	spill->npartitions = npartitions;
+}
+
+/*
+ * hashagg_spill_tuple
+ *
+ * No room for new groups in the hash table. Save for later in the appropriate
+ * partition.
+ */
+static Size
+hashagg_spill_tuple(HashAggSpill *spill, TupleTableSlot *slot, uint32 hash)
+{
+	LogicalTapeSet *tapeset = spill->tapeset;
+	int			partition;
+	MinimalTuple tuple;
+	int			tapenum;
+	int			total_written = 0;
+	bool		shouldFree;
+
+	Assert(spill->partitions != NULL);
+
+	/* XXX: may contain unnecessary attributes, should project */
+	tuple = ExecFetchSlotMinimalTuple(slot, &shouldFree);
+
+	partition = (hash & spill->mask) >> spill->shift;
+	spill->ntuples[partition]++;
+
+	tapenum = spill->partitions[partition];
+
+	LogicalTapeWrite(tapeset, tapenum, (void *) &hash, sizeof(uint32));
+	total_written += sizeof(uint32);
+
+	LogicalTapeWrite(tapeset, tapenum, (void *) tuple, tuple->t_len);
+	total_written += tuple->t_len;
+
+	if (shouldFree)
+		pfree(tuple);
+
+	return total_written;
+}
+
+/*
+ * hashagg_batch_new
+ *
+ * Construct a HashAggBatch item, which represents one iteration of HashAgg to
+ * be done.
+ */
+static HashAggBatch *
+hashagg_batch_new(LogicalTapeSet *tapeset, int tapenum, int setno,
+				  int64 input_tuples, int used_bits)
+{
+	HashAggBatch *batch = palloc0(sizeof(HashAggBatch));
+
+	batch->setno = setno;
+	batch->used_bits = used_bits;
+	batch->tapeset = tapeset;
+	batch->input_tapenum = tapenum;
+	batch->input_tuples = input_tuples;
+
+	return batch;
+}
+
+/*
+ * hashagg_batch_read
+ *		read the next tuple from a batch's tape.  Return NULL if no more.
+ *
+ * If the batch is a shared partition, the tuple is read from its tuplestore
+ * instead, and is only valid until the next call.
+ */
+static MinimalTuple
+hashagg_batch_read(HashAggBatch *batch, uint32 *hashp)
+{
+	LogicalTapeSet *tapeset = batch->tapeset;
+	int			tapenum = batch->input_tapenum;
+	MinimalTuple tuple;
+	uint32		t_len;
+	size_t		nread;
+	uint32		hash;
+
+	if (batch->sts != NULL)
+	{
+		tuple = sts_parallel_scan_next(batch->sts, &hash);
+		if (tuple != NULL && hashp != NULL)
+			*hashp = hash;
+		return tuple;
+	}
+
+	nread = LogicalTapeRead(tapeset, tapenum, &hash, sizeof(uint32));
+	if (nread == 0)
+		return NULL;
+	if (nread != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
+						tapenum, sizeof(uint32), nread)));
+	if (hashp != NULL)
+		*hashp = hash;
+
+	nread = LogicalTapeRead(tapeset, tapenum, &t_len, sizeof(t_len));
+	if (nread != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
+						tapenum, sizeof(uint32), nread)));
+
+	tuple = (MinimalTuple) palloc(t_len);
+	tuple->t_len = t_len;
+
+	nread = LogicalTapeRead(tapeset, tapenum,
+							(void *) ((char *) tuple + sizeof(uint32)),
+							t_len - sizeof(uint32));
+	if (nread != t_len - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("unexpected EOF for tape %d: requested %zu bytes, read %zu bytes",
+						tapenum, t_len - sizeof(uint32), nread)));
+
+	return tuple;
+}
+
+/*
+ * hashagg_finish_initial_spills
+ *
+ * After a HashAggBatch has been processed, it may have spilled tuples to
+ * disk. If so, turn the spilled partitions into new batches that must later
+ * be executed.
+ */
+static void
+hashagg_finish_initial_spills(AggState *aggstate)
+{
+	int			setno;
+	int			total_npartitions = 0;
+
+	if (aggstate->hash_spills != NULL)
+	{
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+
+			total_npartitions += spill->npartitions;
+			hashagg_spill_finish(aggstate, spill, setno);
+		}
+
+		/*
+		 * We're not processing tuples from outer plan any more; only
+		 * processing batches of spilled tuples. The initial spill structures
+		 * are no longer needed.
+		 */
+		pfree(aggstate->hash_spills);
+		aggstate->hash_spills = NULL;
+	}
+
+	hash_agg_update_metrics(aggstate, false, total_npartitions);
+	aggstate->hash_spill_mode = false;
+}
+
+/*
+ * hashagg_spill_finish
+ *
+ * Transform spill partitions into new batches.
+ */
+static void
+hashagg_spill_finish(AggState *aggstate, HashAggSpill *spill, int setno)
+{
+	int			i;
+	int			used_bits = 32 - spill->shift;
+
+	if (spill->npartitions == 0)
+		return;					/* didn't spill */
+
+	for (i = 0; i < spill->npartitions; i++)
+	{
+		int			tapenum = spill->partitions[i];
+		HashAggBatch *new_batch;
+
+		/*
+		 * If the partition is empty, don't create a new batch of work; the
+		 * tape was never written to, so it can be reused as is.
+		 */
+		if (spill->ntuples[i] == 0)
+		{
+			hashagg_tapeinfo_recycle(aggstate->hash_tapeinfo, tapenum);
+			continue;
+		}
+
+		new_batch = hashagg_batch_new(aggstate->hash_tapeinfo->tapeset,
+									  tapenum, setno, spill->ntuples[i],
+									  used_bits);
+		aggstate->hash_batches = lcons(new_batch, aggstate->hash_batches);
+		aggstate->hash_batches_used++;
+	}
+
+	pfree(spill->ntuples);
+	pfree(spill->partitions);
+}
+
+/*
+ * Free resources related to a spilled HashAgg.
+ */
+static void
+hashagg_reset_spill_state(AggState *aggstate)
+{
+	ListCell   *lc;
+
+	/* free spills from initial pass */
+	if (aggstate->hash_spills != NULL)
+	{
+		int			setno;
+
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			HashAggSpill *spill = &aggstate->hash_spills[setno];
+
+			pfree(spill->ntuples);
+			pfree(spill->partitions);
+		}
+		pfree(aggstate->hash_spills);
+		aggstate->hash_spills = NULL;
+	}
+
+	/* free batches */
+	foreach(lc, aggstate->hash_batches)
+	{
+		HashAggBatch *batch = (HashAggBatch *) lfirst(lc);
+
+		pfree(batch);
+	}
+	list_free(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+
+	/* close tape set */
+	if (aggstate->hash_tapeinfo != NULL)
+	{
+		HashTapeInfo *tapeinfo = aggstate->hash_tapeinfo;
+
+		LogicalTapeSetClose(tapeinfo->tapeset);
+		pfree(tapeinfo->freetapes);
+		pfree(tapeinfo);
+		aggstate->hash_tapeinfo = NULL;
+	}
+}
+
 /* -----------------
  * ExecInitAgg
  *
@@ -2228,6 +3552,9 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	outerPlan = outerPlan(node);
 	outerPlanState(aggstate) = ExecInitNode(outerPlan, estate, eflags);
 
+	/* fetch input in batches, if the outer plan supports that */
+	aggstate->batch_input = ExecSupportsBatch(outerPlanState(aggstate));
+
 	/*
 	 * initialize source tuple type.
 	 */
@@ -2463,11 +3790,43 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 */
 	if (use_hashing)
 	{
+		Plan	   *outerplan = outerPlan(node);
+		uint64		totalGroups = 0;
+
+		aggstate->hash_metacxt = AllocSetContextCreate(aggstate->ss.ps.state->es_query_cxt,
+													   "HashAgg meta context",
+													   ALLOCSET_DEFAULT_SIZES);
+		aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate, scanDesc,
+														   &TTSOpsMinimalTuple);
+
 		/* this is an array of pointers, not structures */
 		aggstate->hash_pergroup = pergroups;
 
+		/*
+		 * Estimate the memory needed per group: the hash table entry and
+		 * transition states, plus the representative tuple.  The number of
+		 * distinct transition states isn't known yet, so use the number of
+		 * aggregates as an upper bound.
+		 */
+		aggstate->hashentrysize = hash_agg_entry_size(numaggs) +
+			MAXALIGN(outerplan->plan_width) +
+			MAXALIGN(SizeofMinimalTupleHeader);
+
+		/*
+		 * Consider all of the grouping sets together when setting the limits
+		 * and estimating the number of partitions. This can be inaccurate
+		 * when there is more than one grouping set, but should still be
+		 * reasonable.
+		 */
+		for (i = 0; i < aggstate->num_hashes; i++)
+			totalGroups += aggstate->perhash[i].aggnode->numGroups;
+
+		hash_agg_set_limits(aggstate->hashentrysize, totalGroups, 0,
+							&aggstate->hash_mem_limit,
+							&aggstate->hash_ngroups_limit,
+							&aggstate->hash_planned_partitions);
 		find_hash_columns(aggstate);
-		build_hash_table(aggstate);
+		build_hash_tables(aggstate);
 		aggstate->table_filled = false;
 	}
 
@@ -2873,8 +4232,11 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		else
 			Assert(false);
 
-		phase->evaltrans = ExecBuildAggTrans(aggstate, phase, dosort, dohash);
+		phase->evaltrans = ExecBuildAggTrans(aggstate, phase, dosort, dohash,
+											 false);
 
+		/* cache compiled expression for outer slot without NULL check */
+		phase->evaltrans_cache[0][0] = phase->evaltrans;
 	}
 
 	return aggstate;
@@ -3385,6 +4747,14 @@ ExecEndAgg(AggState *node)
 	if (node->hashcontext)
 		ReScanExprContext(node->hashcontext);
 
+	/* Release any spill files and the hash table metadata */
+	hashagg_reset_spill_state(node);
+	if (node->hash_metacxt != NULL)
+	{
+		MemoryContextDelete(node->hash_metacxt);
+		node->hash_metacxt = NULL;
+	}
+
 	/*
 	 * We don't actually free any ExprContexts here (see comment in
 	 * ExecFreeExprContext), just unlinking the output one from the plan node
@@ -3423,12 +4793,15 @@ ExecReScanAgg(AggState *node)
 			return;
 
 		/*
-		 * If we do have the hash table, and the subplan does not have any
-		 * parameter changes, and none of our own parameter changes affect
-		 * input expressions of the aggregated functions, then we can just
-		 * rescan the existing hash table; no need to build it again.
+		 * If we do have the hash table, and it never spilled, and the subplan
+		 * does not have any parameter changes, and none of our own parameter
+		 * changes affect input expressions of the aggregated functions, then
+		 * we can just rescan the existing hash table; no need to build it
+		 * again.  That's never the case in a Parallel HashAggregate, where
+		 * the hash table only holds the last partition we aggregated.
 		 */
-		if (outerPlan->chgParam == NULL &&
+		if (outerPlan->chgParam == NULL && !node->hash_ever_spilled &&
+			node->parallel_state == NULL &&
 			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams))
 		{
 			ResetTupleHashIterator(node->perhash[0].hashtable,
@@ -3485,11 +4858,19 @@ ExecReScanAgg(AggState *node)
 	 */
 	if (node->aggstrategy == AGG_HASHED || node->aggstrategy == AGG_MIXED)
 	{
+		hashagg_reset_spill_state(node);
+
+		node->hash_ever_spilled = false;
+		node->hash_spill_mode = false;
+		node->hash_ngroups_current = 0;
+
 		ReScanExprContext(node->hashcontext);
 		/* Rebuild an empty hash table */
-		build_hash_table(node);
+		build_hash_tables(node);
 		node->table_filled = false;
 		/* iterator will be reset when the table is filled */
+
+		hashagg_recompile_expressions(node, false, false);
 	}
 
 	if (node->aggstrategy != AGG_HASHED)
@@ -3510,10 +4891,219 @@ ExecReScanAgg(AggState *node)
 		node->projected_set = -1;
 	}
 
+	/* Forget any partially consumed input batch */
+	node->input_batch = NULL;
+	node->input_batch_pos = 0;
+	node->input_batch_done = false;
+
 	if (outerPlan->chgParam == NULL)
 		ExecReScan(outerPlan);
 }
 
+/* ----------------------------------------------------------------
+ *						Parallel HashAggregate Support
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * Size of a ParallelAggState with its partitions.
+ */
+static Size
+parallel_agg_state_size(int nparticipants, int npartitions)
+{
+	Size		size;
+
+	size = MAXALIGN(add_size(offsetof(ParallelAggState, ntuples),
+							 mul_size(npartitions, sizeof(pg_atomic_uint64))));
+	size = add_size(size, mul_size(npartitions,
+								   MAXALIGN(sts_estimate(nparticipants))));
+
+	return size;
+}
+
+/*
+ * Find the SharedTuplestore of a partition.
+ */
+static SharedTuplestore *
+parallel_agg_partition(ParallelAggState *pstate, int partno)
+{
+	char	   *start;
+
+	start = (char *) pstate +
+		MAXALIGN(offsetof(ParallelAggState, ntuples) +
+				 pstate->npartitions * sizeof(pg_atomic_uint64));
+
+	return (SharedTuplestore *)
+		(start + partno * MAXALIGN(sts_estimate(pstate->nparticipants)));
+}
+
+/*
+ * Choose the number of shared partitions for the given number of
+ * participants.  It must be a power of two.
+ */
+static int
+parallel_agg_num_partitions(int nparticipants)
+{
+	int			npartitions;
+
+	npartitions = nparticipants * PARALLEL_HASHAGG_PARTITIONS_PER_PARTICIPANT;
+	npartitions = Max(npartitions, PARALLEL_HASHAGG_MIN_PARTITIONS);
+	npartitions = Min(npartitions, PARALLEL_HASHAGG_MAX_PARTITIONS);
+
+	return 1 << my_log2(npartitions);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggEstimate
+ *
+ *		Estimate space required for the shared partitions of a
+ *		Parallel HashAggregate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggEstimate(AggState *node, ParallelContext *pcxt)
+{
+	int			nparticipants = pcxt->nworkers + 1;
+	int			npartitions = parallel_agg_num_partitions(nparticipants);
+
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   parallel_agg_state_size(nparticipants,
+												   npartitions));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/*
+ * Set up the leader's accessors for the shared partitions.
+ */
+static void
+ExecAggInitializePartitions(AggState *node, ParallelAggState *pstate)
+{
+	MemoryContext oldcontext;
+	int			partno;
+
+	oldcontext = MemoryContextSwitchTo(node->ss.ps.state->es_query_cxt);
+
+	if (node->partition_sts == NULL)
+		node->partition_sts = palloc(sizeof(SharedTuplestoreAccessor *) *
+									 pstate->npartitions);
+
+	for (partno = 0; partno < pstate->npartitions; partno++)
+	{
+		char		name[MAXPGPATH];
+
+		snprintf(name, sizeof(name), "hashagg.p%d", partno);
+		node->partition_sts[partno] =
+			sts_initialize(parallel_agg_partition(pstate, partno),
+						   pstate->nparticipants,
+						   0,
+						   sizeof(uint32),
+						   SHARED_TUPLESTORE_SINGLE_PASS,
+						   &pstate->fileset,
+						   name);
+		pg_atomic_init_u64(&pstate->ntuples[partno], 0);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggInitializeDSM
+ *
+ *		Set up the shared partitions of a Parallel HashAggregate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggInitializeDSM(AggState *node, ParallelContext *pcxt)
+{
+	int			plan_node_id = node->ss.ps.plan->plan_node_id;
+	int			nparticipants = pcxt->nworkers + 1;
+	int			npartitions = parallel_agg_num_partitions(nparticipants);
+	ParallelAggState *pstate;
+
+	Assert(node->aggstrategy == AGG_HASHED && node->num_hashes == 1);
+
+	/*
+	 * Fall back to aggregating in each participant on its own if we failed
+	 * to create a real DSM segment.  There are no workers in that case, so
+	 * the leader sees all of the input anyway.
+	 */
+	if (pcxt->seg == NULL)
+		return;
+
+	pstate = shm_toc_allocate(pcxt->toc,
+							  parallel_agg_state_size(nparticipants,
+													  npartitions));
+	shm_toc_insert(pcxt->toc, plan_node_id, pstate);
+
+	BarrierInit(&pstate->barrier, 0);
+	pstate->nparticipants = nparticipants;
+	pstate->npartitions = npartitions;
+	pstate->partition_bits = my_log2(npartitions);
+	pg_atomic_init_u32(&pstate->next_partition, 0);
+
+	/* Set up the space we'll use for the partitions' files. */
+	SharedFileSetInit(&pstate->fileset, pcxt->seg);
+
+	ExecAggInitializePartitions(node, pstate);
+
+	node->parallel_state = pstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggReInitializeDSM
+ *
+ *		Reset shared state before beginning a fresh scan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggReInitializeDSM(AggState *node, ParallelContext *pcxt)
+{
+	ParallelAggState *pstate = node->parallel_state;
+	int			partno;
+
+	if (pstate == NULL)
+		return;
+
+	/* Forget the old partitions, and start over with empty ones. */
+	for (partno = 0; partno < pstate->npartitions; partno++)
+		pfree(node->partition_sts[partno]);
+	SharedFileSetDeleteAll(&pstate->fileset);
+
+	BarrierInit(&pstate->barrier, 0);
+	pg_atomic_write_u32(&pstate->next_partition, 0);
+
+	ExecAggInitializePartitions(node, pstate);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAggInitializeWorker
+ *
+ *		Attach a worker to the shared partitions.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAggInitializeWorker(AggState *node, ParallelWorkerContext *pwcxt)
+{
+	int			plan_node_id = node->ss.ps.plan->plan_node_id;
+	ParallelAggState *pstate;
+	int			partno;
+
+	pstate = shm_toc_lookup(pwcxt->toc, plan_node_id, false);
+
+	/* Attach to the space for the partitions' files. */
+	SharedFileSetAttach(&pstate->fileset, pwcxt->seg);
+
+	node->partition_sts = palloc(sizeof(SharedTuplestoreAccessor *) *
+								 pstate->npartitions);
+	for (partno = 0; partno < pstate->npartitions; partno++)
+		node->partition_sts[partno] =
+			sts_attach(parallel_agg_partition(pstate, partno),
+					   ParallelWorkerNumber + 1,
+					   &pstate->fileset);
+
+	node->parallel_state = pstate;
+}
+
 
 /***********************************************************************
  * API exposed to aggregate functions
@@ -0,0 +1,498 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeIncrementalSort.c
+ *	  Routines to handle incremental sorting of relations.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeIncrementalSort.c
+ *
+ * DESCRIPTION
+ *
+ *	Incremental sort is an optimized variant of multikey sort for cases
+ *	when the input is already sorted by a prefix of the sort keys.  For
+ *	example when a sort by (key1, key2 ... keyN) is requested, and the
+ *	input is already sorted by (key1, key2 ... keyM), M < N, we can
+ *	divide the input into groups where keys (key1, ... keyM) are equal,
+ *	and only sort on the remaining columns.
+ *
+ *	Consider the following example.  We have input tuples consisting of
+ *	two integers (X, Y) already presorted by X, while it's required to
+ *	sort them by both X and Y.  Let input tuples be following.
+ *
+ *	(1, 5)
+ *	(1, 2)
+ *	(2, 9)
+ *	(2, 1)
+ *	(2, 5)
+ *	(3, 3)
+ *	(3, 7)
+ *
+ *	An incremental sort algorithm would split the input into the following
+ *	groups, which have equal X, and then sort them by Y individually:
+ *
+ *		(1, 5) (1, 2)
+ *		(2, 9) (2, 1) (2, 5)
+ *		(3, 3) (3, 7)
+ *
+ *	After sorting these groups and putting them altogether, we would get
+ *	the following result which is sorted by X and Y, as requested:
+ *
+ *	(1, 2)
+ *	(1, 5)
+ *	(2, 1)
+ *	(2, 5)
+ *	(2, 9)
+ *	(3, 3)
+ *	(3, 7)
+ *
+ *	Incremental sort may be more efficient than plain sort, particularly
+ *	on large datasets, as it reduces the amount of data to sort at once,
+ *	making it more likely it fits into work_mem (eliminating the need to
+ *	spill to disk).  But the main advantage of incremental sort is that
+ *	it can start producing rows early, before sorting the whole dataset,
+ *	which is a significant benefit especially for queries with LIMIT.
+ *
+ *	Since sorting very small groups one at a time would spend most of its
+ *	time in tuplesort setup, we accumulate at least DEFAULT_MIN_GROUP_SIZE
+ *	tuples before looking for a group boundary, and sort all the groups
+ *	collected so far as one batch on the full set of sort keys.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/execdebug.h"
+#include "executor/nodeIncrementalSort.h"
+#include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplesort.h"
+
+/*
+ * Minimum number of tuples to put into a batch before we start looking for
+ * a change in the presorted key values.
+ */
+#define DEFAULT_MIN_GROUP_SIZE 32
+
+
+static void instrumentSortedGroup(IncrementalSortState *node);
+static bool isCurrentGroup(IncrementalSortState *node,
+						   TupleTableSlot *pivot, TupleTableSlot *tuple);
+static void addTupleToBatch(IncrementalSortState *node,
+							TupleTableSlot *slot, int64 *nTuples,
+							int64 minGroupSize);
+
+
+/*
+ * Update instrumentation after sorting a batch.
+ *
+ * tuplesort_get_stats() reports the peak space used by any batch processed
+ * by the tuplesort so far, which is what we want to show.
+ */
+static void
+instrumentSortedGroup(IncrementalSortState *node)
+{
+	IncrementalSortInfo *info = &node->incsort_info;
+	TuplesortInstrumentation sort_instr;
+
+	info->groupCount++;
+
+	tuplesort_get_stats(node->fullsort_state, &sort_instr);
+
+	if (sort_instr.spaceType == SORT_SPACE_TYPE_DISK)
+		info->maxDiskSpaceUsed = Max(info->maxDiskSpaceUsed,
+									 sort_instr.spaceUsed);
+	else
+		info->maxMemorySpaceUsed = Max(info->maxMemorySpaceUsed,
+									   sort_instr.spaceUsed);
+
+	info->sortMethods |= (1 << sort_instr.sortMethod);
+}
+
+/*
+ * Check whether a given tuple belongs to the current group, i.e. whether
+ * its presorted key columns are equal to those of the pivot tuple.
+ */
+static bool
+isCurrentGroup(IncrementalSortState *node,
+			   TupleTableSlot *pivot, TupleTableSlot *tuple)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+
+	econtext->ecxt_innertuple = pivot;
+	econtext->ecxt_outertuple = tuple;
+
+	return ExecQualAndReset(node->presorted_eq, econtext);
+}
+
+/*
+ * Add a tuple to the batch being loaded.  Once the batch reaches the
+ * minimum size, the tuple that completed it becomes the pivot against which
+ * subsequent tuples are compared to find the end of its group.
+ */
+static void
+addTupleToBatch(IncrementalSortState *node, TupleTableSlot *slot,
+				int64 *nTuples, int64 minGroupSize)
+{
+	tuplesort_puttupleslot(node->fullsort_state, slot);
+	(*nTuples)++;
+
+	if (*nTuples == minGroupSize)
+		ExecCopySlot(node->group_pivot, slot);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecIncrementalSort
+ *
+ *		Assuming that the outer subtree returns tuples presorted by some
+ *		prefix of the target sort columns, performs an incremental sort.
+ *		The outer tuples are read in batches, each consisting of at least
+ *		DEFAULT_MIN_GROUP_SIZE tuples (or all the remaining ones) followed
+ *		by the rest of the tuples belonging to the same presorted-key group
+ *		as the last of them.  Each batch is sorted on all the sort columns
+ *		with tuplesort and returned before the next one is read.
+ *
+ *		Conditions:
+ *		  -- none.
+ *
+ *		Initial States:
+ *		  -- the outer child is prepared to return the first tuple.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecIncrementalSort(PlanState *pstate)
+{
+	IncrementalSortState *node = castNode(IncrementalSortState, pstate);
+	EState	   *estate;
+	ScanDirection dir;
+	PlanState  *outerNode;
+	TupleTableSlot *slot;
+	int64		nTuples;
+	int64		minGroupSize;
+
+	CHECK_FOR_INTERRUPTS();
+
+	estate = node->ss.ps.state;
+	dir = estate->es_direction;
+
+	/* Backward scans are not supported; see ExecSupportsBackwardScan */
+	Assert(ScanDirectionIsForward(dir));
+
+	if (node->execution_status == INCSORT_READFULLSORT)
+	{
+		/*
+		 * Return the next tuple of the current batch, if any.  Note that we
+		 * only rely on slot tuple remaining valid until the next fetch from
+		 * the tuplesort.
+		 */
+		slot = node->ss.ps.ps_ResultTupleSlot;
+		if (tuplesort_gettupleslot(node->fullsort_state,
+								   ScanDirectionIsForward(dir),
+								   false, slot, NULL))
+		{
+			if (node->bounded)
+				node->bound_Done++;
+			return slot;
+		}
+
+		/*
+		 * The batch is exhausted.  We're done if the outer plan is, or if
+		 * we've already returned as many tuples as the bound asks for.
+		 */
+		if ((node->outerNodeDone && TupIsNull(node->transfer_tuple)) ||
+			(node->bounded && node->bound_Done >= node->bound))
+			return slot;
+
+		/* Otherwise, prepare to load the next batch. */
+		tuplesort_reset(node->fullsort_state);
+		node->execution_status = INCSORT_LOADFULLSORT;
+	}
+
+	Assert(node->execution_status == INCSORT_LOADFULLSORT);
+
+	SO1_printf("ExecIncrementalSort: %s\n",
+			   "loading next batch");
+
+	outerNode = outerPlanState(node);
+
+	if (node->fullsort_state == NULL)
+	{
+		IncrementalSort *plannode = (IncrementalSort *) node->ss.ps.plan;
+
+		/*
+		 * The same tuplesort is reused for all the batches; tuplesort_reset
+		 * discards the sorted data between them.
+		 */
+		node->fullsort_state = tuplesort_begin_heap(ExecGetResultType(outerNode),
+													plannode->sort.numCols,
+													plannode->sort.sortColIdx,
+													plannode->sort.sortOperators,
+													plannode->sort.collations,
+													plannode->sort.nullsFirst,
+													work_mem,
+													NULL,
+													false);
+	}
+
+	/*
+	 * If bounded, there's no point in sorting more tuples than we still need
+	 * to return, and no point reading more than that before looking for the
+	 * end of the group.
+	 */
+	minGroupSize = DEFAULT_MIN_GROUP_SIZE;
+	if (node->bounded)
+	{
+		int64		remaining = node->bound - node->bound_Done;
+
+		if (remaining <= 0)
+			return ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+
+		tuplesort_set_bound(node->fullsort_state, remaining);
+		minGroupSize = Min(minGroupSize, remaining);
+	}
+
+	nTuples = 0;
+
+	/*
+	 * If the previous batch ended because we read a tuple from a different
+	 * group, that tuple starts this batch.
+	 */
+	if (!TupIsNull(node->transfer_tuple))
+	{
+		addTupleToBatch(node, node->transfer_tuple, &nTuples, minGroupSize);
+		ExecClearTuple(node->transfer_tuple);
+	}
+
+	while (!node->outerNodeDone)
+	{
+		slot = ExecProcNode(outerNode);
+
+		if (TupIsNull(slot))
+		{
+			node->outerNodeDone = true;
+			break;
+		}
+
+		if (nTuples < minGroupSize)
+		{
+			addTupleToBatch(node, slot, &nTuples, minGroupSize);
+			continue;
+		}
+
+		/*
+		 * Keep adding tuples as long as they belong to the same group as
+		 * the pivot.  The first tuple of a different group is saved for the
+		 * next batch.
+		 */
+		if (isCurrentGroup(node, node->group_pivot, slot))
+		{
+			tuplesort_puttupleslot(node->fullsort_state, slot);
+			nTuples++;
+		}
+		else
+		{
+			ExecCopySlot(node->transfer_tuple, slot);
+			break;
+		}
+	}
+
+	ExecClearTuple(node->group_pivot);
+
+	/* Sort the batch, even an empty one, so the tuplesort can be read. */
+	tuplesort_performsort(node->fullsort_state);
+	node->execution_status = INCSORT_READFULLSORT;
+
+	if (node->ss.ps.instrument != NULL && nTuples > 0)
+		instrumentSortedGroup(node);
+
+	SO1_printf("ExecIncrementalSort: %s\n",
+			   "batch sorted");
+
+	slot = node->ss.ps.ps_ResultTupleSlot;
+	if (tuplesort_gettupleslot(node->fullsort_state,
+							   ScanDirectionIsForward(dir),
+							   false, slot, NULL) && node->bounded)
+		node->bound_Done++;
+
+	return slot;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitIncrementalSort
+ *
+ *		Creates the run-time state information for the incremental sort
+ *		node produced by the planner and initializes its outer subtree.
+ * ----------------------------------------------------------------
+ */
+IncrementalSortState *
+ExecInitIncrementalSort(IncrementalSort *node, EState *estate, int eflags)
+{
+	IncrementalSortState *incrsortstate;
+	TupleDesc	outerDesc;
+	Oid		   *eqOperators;
+	int			i;
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "initializing sort node");
+
+	/*
+	 * Incremental sort can't be used with EXEC_FLAG_BACKWARD or
+	 * EXEC_FLAG_MARK, because the current sort state contains only one
+	 * batch of the data.
+	 */
+	Assert((eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)) == 0);
+
+	/*
+	 * create state structure
+	 */
+	incrsortstate = makeNode(IncrementalSortState);
+	incrsortstate->ss.ps.plan = (Plan *) node;
+	incrsortstate->ss.ps.state = estate;
+	incrsortstate->ss.ps.ExecProcNode = ExecIncrementalSort;
+
+	incrsortstate->bounded = false;
+	incrsortstate->bound_Done = 0;
+	incrsortstate->outerNodeDone = false;
+	incrsortstate->execution_status = INCSORT_LOADFULLSORT;
+	incrsortstate->fullsort_state = NULL;
+	memset(&incrsortstate->incsort_info, 0, sizeof(IncrementalSortInfo));
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * We need an ExprContext to evaluate the presorted-key equality test.
+	 */
+	ExecAssignExprContext(estate, &incrsortstate->ss.ps);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * We shield the child node from the need to support REWIND, BACKWARD, or
+	 * MARK/RESTORE.
+	 */
+	eflags &= ~(EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK);
+
+	outerPlanState(incrsortstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	/*
+	 * Initialize scan slot and type.
+	 */
+	ExecCreateScanSlotFromOuterPlan(estate, &incrsortstate->ss, &TTSOpsVirtual);
+
+	/*
+	 * Initialize return slot and type. No need to initialize projection info
+	 * because this node doesn't do projections.
+	 */
+	ExecInitResultTupleSlotTL(&incrsortstate->ss.ps, &TTSOpsMinimalTuple);
+	incrsortstate->ss.ps.ps_ProjInfo = NULL;
+
+	/*
+	 * Initialize the slots remembering the current group's pivot tuple and
+	 * the first tuple of the next batch.
+	 */
+	outerDesc = ExecGetResultType(outerPlanState(incrsortstate));
+	incrsortstate->group_pivot = MakeSingleTupleTableSlot(outerDesc,
+														  &TTSOpsMinimalTuple);
+	incrsortstate->transfer_tuple = MakeSingleTupleTableSlot(outerDesc,
+															 &TTSOpsMinimalTuple);
+
+	/*
+	 * Precompute the equality test for the presorted key columns.
+	 */
+	eqOperators = (Oid *) palloc(node->nPresortedCols * sizeof(Oid));
+	for (i = 0; i < node->nPresortedCols; i++)
+	{
+		Oid			sortop = node->sort.sortOperators[i];
+
+		eqOperators[i] = get_equality_op_for_ordering_op(sortop, NULL);
+		if (!OidIsValid(eqOperators[i]))
+			elog(ERROR, "could not find equality operator for ordering operator %u",
+				 sortop);
+	}
+
+	incrsortstate->presorted_eq =
+		execTuplesMatchPrepare(outerDesc,
+							   node->nPresortedCols,
+							   node->sort.sortColIdx,
+							   eqOperators,
+							   node->sort.collations,
+							   &incrsortstate->ss.ps);
+
+	SO1_printf("ExecInitIncrementalSort: %s\n",
+			   "sort node initialized");
+
+	return incrsortstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndIncrementalSort(node)
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndIncrementalSort(IncrementalSortState *node)
+{
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "shutting down sort node");
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+	/* must drop pointer to sort result tuple */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	/* must drop standalone tuple slots from outer node */
+	ExecDropSingleTupleTableSlot(node->group_pivot);
+	ExecDropSingleTupleTableSlot(node->transfer_tuple);
+
+	/*
+	 * Release tuplesort resources
+	 */
+	if (node->fullsort_state != NULL)
+		tuplesort_end(node->fullsort_state);
+	node->fullsort_state = NULL;
+
+	/*
+	 * Free the exprcontext
+	 */
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+
+	SO1_printf("ExecEndIncrementalSort: %s\n",
+			   "sort node shutdown");
+}
+
+void
+ExecReScanIncrementalSort(IncrementalSortState *node)
+{
+	PlanState  *outerPlan = outerPlanState(node);
+
+	/*
+	 * Incremental sort doesn't keep the whole sorted output, so we always
+	 * have to re-read the subplan and re-sort it batch by batch.
+	 */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->group_pivot);
+	ExecClearTuple(node->transfer_tuple);
+
+	node->outerNodeDone = false;
+	node->bound_Done = 0;
+	node->execution_status = INCSORT_LOADFULLSORT;
+
+	if (node->fullsort_state != NULL)
+		tuplesort_reset(node->fullsort_state);
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (outerPlan->chgParam == NULL)
+		ExecReScan(outerPlan);
+}
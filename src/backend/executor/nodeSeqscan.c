@@ -15,6 +15,7 @@
 /*
  * INTERFACE ROUTINES
  *		ExecSeqScan				sequentially scans a relation.
+ *		ExecSeqScanBatch		same, returning a batch of tuples.
  *		ExecSeqNext				retrieve next tuple in sequential order.
  *		ExecInitSeqScan			creates and initializes a seqscan node.
  *		ExecEndSeqScan			releases any storage allocated.
@@ -29,17 +30,44 @@
 
 #include "access/relscan.h"
 #include "access/tableam.h"
+#include "executor/execBatch.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
+#include "miscadmin.h"
 #include "utils/rel.h"
 
+static TableScanDesc SeqGetScanDesc(SeqScanState *node);
 static TupleTableSlot *SeqNext(SeqScanState *node);
+static void SeqInitBatch(SeqScanState *node);
 
 /* ----------------------------------------------------------------
  *						Scan Support
  * ----------------------------------------------------------------
  */
 
+/*
+ * Return the node's table scan descriptor, starting the scan if necessary.
+ */
+static TableScanDesc
+SeqGetScanDesc(SeqScanState *node)
+{
+	TableScanDesc scandesc = node->ss.ss_currentScanDesc;
+
+	if (scandesc == NULL)
+	{
+		/*
+		 * We reach here if the scan is not parallel, or if we're serially
+		 * executing a scan that was planned to be parallel.
+		 */
+		scandesc = table_beginscan(node->ss.ss_currentRelation,
+								   node->ss.ps.state->es_snapshot,
+								   0, NULL);
+		node->ss.ss_currentScanDesc = scandesc;
+	}
+
+	return scandesc;
+}
+
 /* ----------------------------------------------------------------
  *		SeqNext
  *
@@ -57,23 +85,11 @@ SeqNext(SeqScanState *node)
 	/*
 	 * get information from the estate and scan state
 	 */
-	scandesc = node->ss.ss_currentScanDesc;
+	scandesc = SeqGetScanDesc(node);
 	estate = node->ss.ps.state;
 	direction = estate->es_direction;
 	slot = node->ss.ss_ScanTupleSlot;
 
-	if (scandesc == NULL)
-	{
-		/*
-		 * We reach here if the scan is not parallel, or if we're serially
-		 * executing a scan that was planned to be parallel.
-		 */
-		scandesc = table_beginscan(node->ss.ss_currentRelation,
-								   estate->es_snapshot,
-								   0, NULL);
-		node->ss.ss_currentScanDesc = scandesc;
-	}
-
 	/*
 	 * get the next tuple from the table
 	 */
@@ -114,6 +130,180 @@ ExecSeqScan(PlanState *pstate)
 					(ExecScanRecheckMtd) SeqRecheck);
 }
 
+/*
+ * Set up the state needed for batch mode.  This is done on first use, so
+ * that scans running in row mode don't pay for the extra slots.
+ */
+static void
+SeqInitBatch(SeqScanState *node)
+{
+	EState	   *estate = node->ss.ps.state;
+	Relation	rel = node->ss.ss_currentRelation;
+	Plan	   *plan = node->ss.ps.plan;
+	MemoryContext oldcontext;
+	int			i;
+
+	/* if we project, the batch needs slots to hold the projected rows */
+	if (node->ss.ps.ps_ProjInfo)
+		node->batch = ExecInitTupleBatch(estate,
+										 node->ss.ps.ps_ResultTupleDesc,
+										 &TTSOpsVirtual);
+	else
+		node->batch = ExecInitTupleBatch(estate, NULL, NULL);
+
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	node->batch_scanslots = (TupleTableSlot **)
+		palloc(EXEC_BATCH_SIZE * sizeof(TupleTableSlot *));
+	for (i = 0; i < EXEC_BATCH_SIZE; i++)
+		node->batch_scanslots[i] =
+			ExecAllocTableSlot(&estate->es_tupleTable,
+							   RelationGetDescr(rel),
+							   table_slot_callbacks(rel));
+	MemoryContextSwitchTo(oldcontext);
+
+	/*
+	 * Deform the attributes that our quals and targetlist need for all
+	 * tuples of a batch at once.
+	 */
+	node->batch_lastattr =
+		ExecBatchLastScanAttr(list_make2(plan->qual, plan->targetlist),
+							  ((Scan *) plan)->scanrelid,
+							  RelationGetDescr(rel)->natts);
+
+	/* Evaluate simple comparisons in the qual vectorized, if there are any */
+	node->batch_qual = ExecInitBatchQual(plan->qual, &node->ss.ps,
+										 ((Scan *) plan)->scanrelid);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanBatch(node)
+ *
+ *		Batch mode counterpart of ExecSeqScan: returns up to
+ *		EXEC_BATCH_SIZE qualifying tuples, or NULL at end of scan.
+ * ----------------------------------------------------------------
+ */
+static TupleBatch *
+ExecSeqScanBatch(PlanState *pstate)
+{
+	SeqScanState *node = castNode(SeqScanState, pstate);
+	EState	   *estate = pstate->state;
+	ExprContext *econtext = pstate->ps_ExprContext;
+	ExprState  *qual = pstate->qual;
+	ProjectionInfo *projInfo = pstate->ps_ProjInfo;
+	TableScanDesc scandesc;
+	TupleBatch *batch;
+	TupleTableSlot **scanslots;
+
+	/* EvalPlanQual rechecks and backward scans are done a row at a time */
+	if (estate->es_epqTupleSlot != NULL ||
+		!ScanDirectionIsForward(estate->es_direction))
+		return ExecProcNodeBatchRowMode(pstate);
+
+	if (node->batch == NULL)
+		SeqInitBatch(node);
+	batch = node->batch;
+	scanslots = node->batch_scanslots;
+	scandesc = SeqGetScanDesc(node);
+
+	/*
+	 * Free expression evaluation storage of the previous batch.  The rows we
+	 * return may reference it, so it must not be reset until we're called
+	 * again.
+	 */
+	ResetExprContext(econtext);
+
+	for (;;)
+	{
+		int			ntuples = 0;
+		int			nrows;
+		BlockNumber blkno = InvalidBlockNumber;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * Each scan slot keeps a pin on the page its tuple came from, so a
+		 * batch must not span pages: with few tuples per page, it would pin
+		 * up to EXEC_BATCH_SIZE buffers, far more than a bulk-read ring
+		 * holds.  So end the batch when the scan moves to another page, and
+		 * carry the tuple already read from that page over to the next
+		 * batch.  At most two pages are pinned that way.
+		 */
+		if (node->batch_carry)
+		{
+			node->batch_carry = false;
+			blkno = ItemPointerGetBlockNumber(&scanslots[0]->tts_tid);
+			ntuples = 1;
+		}
+
+		while (ntuples < EXEC_BATCH_SIZE &&
+			   table_scan_getnextslot(scandesc, ForwardScanDirection,
+									  scanslots[ntuples]))
+		{
+			BlockNumber tupblkno;
+
+			tupblkno = ItemPointerGetBlockNumber(&scanslots[ntuples]->tts_tid);
+			if (ntuples > 0 && tupblkno != blkno)
+			{
+				node->batch_carry = true;
+				break;
+			}
+			blkno = tupblkno;
+			ntuples++;
+		}
+
+		if (ntuples == 0)
+			return NULL;
+
+		if (node->batch_lastattr > 0)
+			slot_getsomeattrs_batch(scanslots, ntuples, node->batch_lastattr);
+
+		/*
+		 * Filter the tuples in the batch's slot array, which leaves the
+		 * scan slots in their own array alone.  Without projection, we
+		 * return the qualifying scan slots themselves.
+		 */
+		memcpy(batch->slots, scanslots, ntuples * sizeof(TupleTableSlot *));
+
+		/* Move the carried-over tuple to the front, for the next batch */
+		if (node->batch_carry)
+		{
+			TupleTableSlot *next = scanslots[ntuples];
+
+			scanslots[ntuples] = scanslots[0];
+			scanslots[0] = next;
+		}
+
+		nrows = ntuples;
+		if (node->batch_qual)
+		{
+			nrows = ExecBatchQualEval(node->batch_qual, econtext,
+									  batch->slots, ntuples);
+			InstrCountFiltered1(node, ntuples - nrows);
+		}
+		else if (qual)
+		{
+			nrows = ExecQualBatch(qual, econtext, batch->slots, ntuples);
+			InstrCountFiltered1(node, ntuples - nrows);
+		}
+
+		if (nrows > 0)
+		{
+			if (projInfo)
+			{
+				ExecProjectBatch(projInfo, econtext, batch->slots, nrows,
+								 batch->ownslots);
+				memcpy(batch->slots, batch->ownslots,
+					   nrows * sizeof(TupleTableSlot *));
+			}
+			batch->nrows = nrows;
+			return batch;
+		}
+
+		/* nothing qualified, so free per-tuple memory and try again */
+		ResetExprContext(econtext);
+	}
+}
+
 
 /* ----------------------------------------------------------------
  *		ExecInitSeqScan
@@ -138,6 +328,7 @@ ExecInitSeqScan(SeqScan *node, EState *estate, int eflags)
 	scanstate->ss.ps.plan = (Plan *) node;
 	scanstate->ss.ps.state = estate;
 	scanstate->ss.ps.ExecProcNode = ExecSeqScan;
+	scanstate->ss.ps.ExecProcNodeBatch = ExecSeqScanBatch;
 
 	/*
 	 * Miscellaneous initialization
@@ -231,6 +422,13 @@ ExecReScanSeqScan(SeqScanState *node)
 		table_rescan(scan,		/* scan desc */
 					 NULL);		/* new scan keys */
 
+	/* forget any tuple read ahead by batch mode */
+	if (node->batch_carry)
+	{
+		ExecClearTuple(node->batch_scanslots[0]);
+		node->batch_carry = false;
+	}
+
 	ExecScanReScan((ScanState *) node);
 }
 
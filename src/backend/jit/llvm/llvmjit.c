@@ -16,8 +16,12 @@
 #include "jit/llvmjit.h"
 #include "jit/llvmjit_emit.h"
 
+#include "lib/stringinfo.h"
 #include "miscadmin.h"
+#include "nodes/plannodes.h"
 
+#include "utils/hashutils.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/resowner_private.h"
 #include "portability/instr_time.h"
@@ -47,6 +51,43 @@ typedef struct LLVMJitHandle
 	LLVMOrcModuleHandle orc_handle;
 } LLVMJitHandle;
 
+/*
+ * Code emitted for one plan, to be reused by later executions of it.  See
+ * llvm_use_code_cache().
+ */
+typedef struct LLVMJitCodeCache
+{
+	PlannedStmt *stmt;			/* plan the code was generated for */
+	MemoryContext mcxt;			/* memory context the plan lives in */
+	List	   *entries;		/* LLVMJitCacheEntry's */
+	List	   *handles;		/* handles of the modules emitted */
+	MemoryContextCallback callback; /* frees the code with the plan */
+} LLVMJitCodeCache;
+
+/* A function in an LLVMJitCodeCache */
+typedef struct LLVMJitCacheEntry
+{
+	uint32		hash;			/* hash of key */
+	char	   *key;			/* IR of the function and its helpers */
+	char	   *funcname;		/* name the function is emitted under */
+	size_t		module_generation;	/* module containing the function */
+	bool		emitted;		/* has that module been emitted yet? */
+} LLVMJitCacheEntry;
+
+/* Entry in llvm_code_caches */
+typedef struct LLVMJitCodeCacheLookup
+{
+	PlannedStmt *stmt;			/* hash key, must be first */
+	LLVMJitCodeCache *cache;
+} LLVMJitCodeCacheLookup;
+
+/*
+ * Limit on the number of functions cached per plan, so that a plan whose
+ * code never turns out to be the same across executions doesn't keep
+ * accumulating it.
+ */
+#define LLVM_CODE_CACHE_MAX_ENTRIES 1024
+
 
 /* types & functions commonly needed for JITing */
 LLVMTypeRef TypeSizeT;
@@ -104,12 +145,18 @@ static LLVMTargetRef llvm_targetref;
 static LLVMOrcJITStackRef llvm_opt0_orc;
 static LLVMOrcJITStackRef llvm_opt3_orc;
 
+/* code caches of plans, by PlannedStmt */
+static HTAB *llvm_code_caches = NULL;
+
 
 static void llvm_release_context(JitContext *context);
 static void llvm_session_initialize(void);
 static void llvm_shutdown(int code, Datum arg);
 static void llvm_compile_module(LLVMJitContext *context);
 static void llvm_optimize_module(LLVMJitContext *context, LLVMModuleRef module);
+static void llvm_code_cache_free(void *arg);
+static void llvm_code_cache_forget(LLVMJitCodeCache *cache,
+								   size_t module_generation);
 
 static void llvm_create_types(void);
 static uint64_t llvm_resolve_symbol(const char *name, void *ctx);
@@ -177,6 +224,11 @@ llvm_release_context(JitContext *context)
 	{
 		if (llvm_context->module)
 		{
+			/* code that was never emitted can't be reused */
+			if (llvm_context->cache)
+				llvm_code_cache_forget(llvm_context->cache,
+									   llvm_context->module_generation);
+
 			LLVMDisposeModule(llvm_context->module);
 			llvm_context->module = NULL;
 		}
@@ -248,7 +300,9 @@ llvm_get_function(LLVMJitContext *context, const char *funcname)
 {
 	LLVMOrcTargetAddress addr = 0;
 #if defined(HAVE_DECL_LLVMORCGETSYMBOLADDRESSIN) && HAVE_DECL_LLVMORCGETSYMBOLADDRESSIN
+	List	   *handles;
 	ListCell   *lc;
+	int			i;
 #endif
 
 	llvm_assert_in_fatal_section();
@@ -268,15 +322,26 @@ llvm_get_function(LLVMJitContext *context, const char *funcname)
 	 */
 
 #if defined(HAVE_DECL_LLVMORCGETSYMBOLADDRESSIN) && HAVE_DECL_LLVMORCGETSYMBOLADDRESSIN
-	foreach(lc, context->handles)
+	/* modules with functions to be reused are owned by the code cache */
+	for (i = 0; i < 2; i++)
 	{
-		LLVMJitHandle *handle = (LLVMJitHandle *) lfirst(lc);
+		if (i == 0)
+			handles = context->handles;
+		else if (context->cache)
+			handles = context->cache->handles;
+		else
+			break;
+
+		foreach(lc, handles)
+		{
+			LLVMJitHandle *handle = (LLVMJitHandle *) lfirst(lc);
 
-		addr = 0;
-		if (LLVMOrcGetSymbolAddressIn(handle->stack, &addr, handle->orc_handle, funcname))
-			elog(ERROR, "failed to look up symbol \"%s\"", funcname);
-		if (addr)
-			return (void *) (uintptr_t) addr;
+			addr = 0;
+			if (LLVMOrcGetSymbolAddressIn(handle->stack, &addr, handle->orc_handle, funcname))
+				elog(ERROR, "failed to look up symbol \"%s\"", funcname);
+			if (addr)
+				return (void *) (uintptr_t) addr;
+		}
 	}
 
 #else
@@ -304,6 +369,242 @@ llvm_get_function(LLVMJitContext *context, const char *funcname)
 	return NULL;
 }
 
+/*
+ * Make code generated in context reusable by later executions of stmt.
+ *
+ * The code generator has to avoid embedding pointers to memory belonging to
+ * one execution of the plan in the code, and to check with
+ * llvm_cache_function() whether a function it generated has been emitted
+ * before.  The cache lives as long as the memory context the plan is in,
+ * which for plans kept by plancache.c is that of the CachedPlan.
+ */
+void
+llvm_use_code_cache(LLVMJitContext *context, PlannedStmt *stmt)
+{
+	LLVMJitCodeCacheLookup *lookup;
+
+	if (llvm_code_caches == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(PlannedStmt *);
+		ctl.entrysize = sizeof(LLVMJitCodeCacheLookup);
+
+		llvm_code_caches = hash_create("LLVM JIT code caches", 16, &ctl,
+									   HASH_ELEM | HASH_BLOBS);
+	}
+
+	lookup = (LLVMJitCodeCacheLookup *)
+		hash_search(llvm_code_caches, &stmt, HASH_FIND, NULL);
+
+	if (lookup == NULL)
+	{
+		MemoryContext mcxt = GetMemoryChunkContext(stmt);
+		LLVMJitCodeCache *cache;
+
+		cache = (LLVMJitCodeCache *)
+			MemoryContextAllocZero(mcxt, sizeof(LLVMJitCodeCache));
+		cache->stmt = stmt;
+		cache->mcxt = mcxt;
+		cache->callback.func = llvm_code_cache_free;
+		cache->callback.arg = cache;
+		MemoryContextRegisterResetCallback(mcxt, &cache->callback);
+
+		lookup = (LLVMJitCodeCacheLookup *)
+			hash_search(llvm_code_caches, &stmt, HASH_ENTER, NULL);
+		lookup->cache = cache;
+	}
+
+	context->cache = lookup->cache;
+}
+
+/*
+ * Look for an earlier copy of fn in the context's code cache.
+ *
+ * fn has to be a function just generated in the context's mutable module,
+ * and helpers a list of other functions generated for use by fn alone
+ * (e.g. for deforming).  Functions are compared by their IR, ignoring their
+ * names.
+ *
+ * If the same code has been emitted for an earlier execution of the plan,
+ * fn and helpers are removed from the module, and the name of the earlier
+ * copy, to be passed to llvm_get_function(), is returned.  Otherwise fn is
+ * added to the cache, for later executions to find once it's emitted, and
+ * NULL is returned.
+ */
+const char *
+llvm_cache_function(LLVMJitContext *context, LLVMValueRef fn, List *helpers)
+{
+	LLVMJitCodeCache *cache = context->cache;
+	LLVMJitCacheEntry *entry;
+	StringInfoData key;
+	char	   *funcname;
+	char	  **helpernames;
+	char	   *ir;
+	uint32		hash;
+	ListCell   *lc;
+	ListCell   *lc2;
+	int			i;
+
+	llvm_assert_in_fatal_section();
+	Assert(cache != NULL);
+
+	/*
+	 * Print the functions under fixed names, so the result doesn't depend on
+	 * the module they were generated in.
+	 */
+	funcname = pstrdup(LLVMGetValueName(fn));
+	helpernames = (char **) palloc(sizeof(char *) * (list_length(helpers) + 1));
+
+	LLVMSetValueName(fn, "cached");
+	i = 0;
+	foreach(lc, helpers)
+	{
+		LLVMValueRef helper = (LLVMValueRef) lfirst(lc);
+		char		name[NAMEDATALEN];
+
+		helpernames[i] = pstrdup(LLVMGetValueName(helper));
+		snprintf(name, sizeof(name), "cached.helper.%d", i);
+		LLVMSetValueName(helper, name);
+		i++;
+	}
+
+	initStringInfo(&key);
+	ir = LLVMPrintValueToString(fn);
+	appendStringInfoString(&key, ir);
+	LLVMDisposeMessage(ir);
+	foreach(lc, helpers)
+	{
+		ir = LLVMPrintValueToString((LLVMValueRef) lfirst(lc));
+		appendStringInfoString(&key, ir);
+		LLVMDisposeMessage(ir);
+	}
+
+	LLVMSetValueName(fn, funcname);
+	i = 0;
+	foreach(lc, helpers)
+	{
+		LLVMSetValueName((LLVMValueRef) lfirst(lc), helpernames[i]);
+		pfree(helpernames[i]);
+		i++;
+	}
+	pfree(helpernames);
+
+	hash = DatumGetUInt32(hash_any((unsigned char *) key.data, key.len));
+
+	foreach(lc, cache->entries)
+	{
+		entry = (LLVMJitCacheEntry *) lfirst(lc);
+
+		if (entry->emitted && entry->hash == hash &&
+			strcmp(entry->key, key.data) == 0)
+		{
+			LLVMValueRef f;
+
+			/* the new copy isn't needed, nor counted as created */
+			LLVMDeleteFunction(fn);
+			foreach(lc2, helpers)
+				LLVMDeleteFunction((LLVMValueRef) lfirst(lc2));
+			context->base.instr.created_functions -= 1 + list_length(helpers);
+
+			/*
+			 * If there's no other code pending in the module, there's no
+			 * need to emit it.
+			 */
+			for (f = LLVMGetFirstFunction(context->module);
+				 f != NULL;
+				 f = LLVMGetNextFunction(f))
+			{
+				if (!LLVMIsDeclaration(f))
+					break;
+			}
+			if (f == NULL)
+			{
+				LLVMDisposeModule(context->module);
+				context->module = NULL;
+				context->compiled = true;
+			}
+
+			pfree(key.data);
+			pfree(funcname);
+
+			return entry->funcname;
+		}
+	}
+
+	if (list_length(cache->entries) < LLVM_CODE_CACHE_MAX_ENTRIES)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(cache->mcxt);
+
+		entry = (LLVMJitCacheEntry *) palloc(sizeof(LLVMJitCacheEntry));
+		entry->hash = hash;
+		entry->key = pstrdup(key.data);
+		entry->funcname = pstrdup(funcname);
+		entry->module_generation = context->module_generation;
+		entry->emitted = false;
+
+		cache->entries = lappend(cache->entries, entry);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	pfree(key.data);
+	pfree(funcname);
+
+	return NULL;
+}
+
+/*
+ * Forget the functions of a module that's not going to be emitted.
+ */
+static void
+llvm_code_cache_forget(LLVMJitCodeCache *cache, size_t module_generation)
+{
+	ListCell   *lc;
+
+	foreach(lc, cache->entries)
+	{
+		LLVMJitCacheEntry *entry = (LLVMJitCacheEntry *) lfirst(lc);
+
+		if (!entry->emitted && entry->module_generation == module_generation)
+		{
+			cache->entries = foreach_delete_current(cache->entries, lc);
+			pfree(entry->key);
+			pfree(entry->funcname);
+			pfree(entry);
+		}
+	}
+}
+
+/*
+ * Release a plan's cached code, when the memory context the plan is in goes
+ * away.
+ */
+static void
+llvm_code_cache_free(void *arg)
+{
+	LLVMJitCodeCache *cache = (LLVMJitCodeCache *) arg;
+	ListCell   *lc;
+
+	hash_search(llvm_code_caches, &cache->stmt, HASH_REMOVE, NULL);
+
+	/* as in llvm_release_context(), leave cleanup to process exit */
+	if (proc_exit_inprogress)
+		return;
+
+	llvm_enter_fatal_on_oom();
+
+	foreach(lc, cache->handles)
+	{
+		LLVMJitHandle *jit_handle = (LLVMJitHandle *) lfirst(lc);
+
+		LLVMOrcRemoveModule(jit_handle->stack, jit_handle->orc_handle);
+	}
+
+	llvm_leave_fatal_on_oom();
+}
+
 /*
  * Return declaration for passed function, adding it to the module if
  * necessary.
@@ -584,18 +885,47 @@ llvm_compile_module(LLVMJitContext *context)
 	context->module = NULL;
 	context->compiled = true;
 
-	/* remember emitted code for cleanup and lookups */
-	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	/*
+	 * Remember emitted code for cleanup and lookups.  A module containing
+	 * functions that may be reused by later executions of the plan belongs
+	 * to the plan's code cache, others are released with the context.
+	 */
 	{
 		LLVMJitHandle *handle;
+		bool		cached = false;
+
+		if (context->cache)
+		{
+			ListCell   *lc;
+
+			/* the functions in the module can now be reused */
+			foreach(lc, context->cache->entries)
+			{
+				LLVMJitCacheEntry *entry = (LLVMJitCacheEntry *) lfirst(lc);
+
+				if (entry->module_generation == context->module_generation)
+				{
+					entry->emitted = true;
+					cached = true;
+				}
+			}
+		}
+
+		oldcontext = MemoryContextSwitchTo(cached ?
+										   context->cache->mcxt :
+										   TopMemoryContext);
 
 		handle = (LLVMJitHandle *) palloc(sizeof(LLVMJitHandle));
 		handle->stack = compile_orc;
 		handle->orc_handle = orc_handle;
 
-		context->handles = lappend(context->handles, handle);
+		if (cached)
+			context->cache->handles = lappend(context->cache->handles, handle);
+		else
+			context->handles = lappend(context->handles, handle);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
-	MemoryContextSwitchTo(oldcontext);
 
 	ereport(DEBUG1,
 			(errmsg("time to inline: %.3fs, opt: %.3fs, emit: %.3fs",
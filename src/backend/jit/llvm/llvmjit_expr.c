@@ -58,11 +58,24 @@ static Datum ExecRunCompiledExpr(ExprState *state, ExprContext *econtext, bool *
 
 static LLVMValueRef BuildV1Call(LLVMJitContext *context, LLVMBuilderRef b,
 								LLVMModuleRef mod, FunctionCallInfo fcinfo,
+								LLVMValueRef v_fcinfo,
 								LLVMValueRef *v_fcinfo_isnull);
 static void build_EvalXFunc(LLVMBuilderRef b, LLVMModuleRef mod,
 							const char *funcname,
 							LLVMValueRef v_state, LLVMValueRef v_econtext,
-							ExprEvalStep *op);
+							LLVMValueRef v_op);
+static LLVMValueRef build_AggTmpMemory(LLVMBuilderRef b,
+									   LLVMValueRef v_aggstatep);
+
+/*
+ * Reference a pointer stored in a field of the current step.  Relocatable
+ * code, which may be used by other executions of the same plan, loads it
+ * from the step at runtime; otherwise the pointer is embedded in the code.
+ */
+#define l_op_ptr(field, type) \
+	(relocatable ? \
+	 l_load_offset(b, v_op, offsetof(ExprEvalStep, field), (type), "") : \
+	 l_ptr_const(op->field, (type)))
 static LLVMValueRef create_LifetimeEnd(LLVMModuleRef mod);
 
 
@@ -75,9 +88,16 @@ llvm_compile_expr(ExprState *state)
 	PlanState  *parent = state->parent;
 	int			i;
 	char	   *funcname;
+	const char *cachedname = NULL;
 
 	LLVMJitContext *context = NULL;
 
+	/* can the code be used by other executions of the plan? */
+	bool		relocatable;
+
+	/* deforming functions generated for the expression */
+	List	   *deform_fns = NIL;
+
 	LLVMBuilderRef b;
 	LLVMModuleRef mod;
 	LLVMTypeRef eval_sig;
@@ -88,6 +108,7 @@ llvm_compile_expr(ExprState *state)
 	/* state itself */
 	LLVMValueRef v_state;
 	LLVMValueRef v_econtext;
+	LLVMValueRef v_steps = NULL;
 
 	/* returnvalue */
 	LLVMValueRef v_isnullp;
@@ -133,10 +154,16 @@ llvm_compile_expr(ExprState *state)
 		if (parent)
 		{
 			parent->state->es_jit = &context->base;
+
+			if ((parent->state->es_jit_flags & PGJIT_CACHE) &&
+				parent->state->es_plannedstmt)
+				llvm_use_code_cache(context, parent->state->es_plannedstmt);
 		}
 
 	}
 
+	relocatable = context->cache != NULL;
+
 	INSTR_TIME_SET_CURRENT(starttime);
 
 	mod = llvm_mutable_module(context);
@@ -178,6 +205,12 @@ llvm_compile_expr(ExprState *state)
 									  FIELDNO_EXPRSTATE_RESNULL,
 									  "v.state.resnull");
 
+	/* relocatable code finds the steps via the state */
+	if (relocatable)
+		v_steps = l_load_struct_gep(b, v_state,
+									FIELDNO_EXPRSTATE_STEPS,
+									"v_steps");
+
 	/* build global slots */
 	v_scanslot = l_load_struct_gep(b, v_econtext,
 								   FIELDNO_EXPRCONTEXT_SCANTUPLE,
@@ -238,6 +271,7 @@ llvm_compile_expr(ExprState *state)
 	{
 		ExprEvalStep *op;
 		ExprEvalOp	opcode;
+		LLVMValueRef v_op;
 		LLVMValueRef v_resvaluep;
 		LLVMValueRef v_resnullp;
 
@@ -246,8 +280,17 @@ llvm_compile_expr(ExprState *state)
 		op = &state->steps[i];
 		opcode = ExecEvalStepOp(state, op);
 
-		v_resvaluep = l_ptr_const(op->resvalue, l_ptr(TypeSizeT));
-		v_resnullp = l_ptr_const(op->resnull, l_ptr(TypeStorageBool));
+		if (relocatable)
+		{
+			LLVMValueRef v_opno = l_int32_const(i);
+
+			v_op = LLVMBuildGEP(b, v_steps, &v_opno, 1, "v_op");
+		}
+		else
+			v_op = l_ptr_const(op, l_ptr(StructExprEvalStep));
+
+		v_resvaluep = l_op_ptr(resvalue, l_ptr(TypeSizeT));
+		v_resnullp = l_op_ptr(resnull, l_ptr(TypeStorageBool));
 
 		switch (opcode)
 		{
@@ -325,6 +368,8 @@ llvm_compile_expr(ExprState *state)
 							slot_compile_deform(context, desc,
 												tts_ops,
 												op->d.fetch.last_var);
+						if (l_jit_deform)
+							deform_fns = lappend(deform_fns, l_jit_deform);
 					}
 
 					if (l_jit_deform)
@@ -403,7 +448,7 @@ llvm_compile_expr(ExprState *state)
 						v_slot = v_scanslot;
 
 					v_params[0] = v_state;
-					v_params[1] = l_ptr_const(op, l_ptr(StructExprEvalStep));
+					v_params[1] = v_op;
 					v_params[2] = v_econtext;
 					v_params[3] = v_slot;
 
@@ -417,7 +462,7 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_WHOLEROW:
 				build_EvalXFunc(b, mod, "ExecEvalWholeRowVar",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -553,7 +598,13 @@ llvm_compile_expr(ExprState *state)
 					LLVMValueRef v_constvalue,
 								v_constnull;
 
-					v_constvalue = l_sizet_const(op->d.constval.value);
+					if (relocatable)
+						v_constvalue =
+							l_load_offset(b, v_op,
+										  offsetof(ExprEvalStep, d.constval.value),
+										  TypeSizeT, "");
+					else
+						v_constvalue = l_sizet_const(op->d.constval.value);
 					v_constnull = l_sbool_const(op->d.constval.isnull);
 
 					LLVMBuildStore(b, v_constvalue, v_resvaluep);
@@ -565,7 +616,6 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_FUNCEXPR_STRICT:
 				{
-					FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
 					LLVMBasicBlockRef b_nonull;
 					int			argno;
 					LLVMValueRef v_fcinfo;
@@ -583,7 +633,8 @@ llvm_compile_expr(ExprState *state)
 						elog(ERROR, "argumentless strict functions are pointless");
 
 					v_fcinfo =
-						l_ptr_const(fcinfo, l_ptr(StructFunctionCallInfoData));
+						l_op_ptr(d.func.fcinfo_data,
+								 l_ptr(StructFunctionCallInfoData));
 
 					/*
 					 * set resnull to true, if the function is actually
@@ -633,10 +684,13 @@ llvm_compile_expr(ExprState *state)
 			case EEOP_FUNCEXPR:
 				{
 					FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+					LLVMValueRef v_fcinfo;
 					LLVMValueRef v_fcinfo_isnull;
 					LLVMValueRef v_retval;
 
-					v_retval = BuildV1Call(context, b, mod, fcinfo,
+					v_fcinfo = l_op_ptr(d.func.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
+					v_retval = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
 										   &v_fcinfo_isnull);
 					LLVMBuildStore(b, v_retval, v_resvaluep);
 					LLVMBuildStore(b, v_fcinfo_isnull, v_resnullp);
@@ -647,14 +701,14 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_FUNCEXPR_FUSAGE:
 				build_EvalXFunc(b, mod, "ExecEvalFuncExprFusage",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 
 			case EEOP_FUNCEXPR_STRICT_FUSAGE:
 				build_EvalXFunc(b, mod, "ExecEvalFuncExprStrictFusage",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -662,8 +716,8 @@ llvm_compile_expr(ExprState *state)
 				{
 					LLVMValueRef v_boolanynullp;
 
-					v_boolanynullp = l_ptr_const(op->d.boolexpr.anynull,
-												 l_ptr(TypeStorageBool));
+					v_boolanynullp = l_op_ptr(d.boolexpr.anynull,
+											  l_ptr(TypeStorageBool));
 					LLVMBuildStore(b, l_sbool_const(0), v_boolanynullp);
 
 				}
@@ -698,8 +752,8 @@ llvm_compile_expr(ExprState *state)
 					b_boolcont = l_bb_before_v(opblocks[i + 1],
 											   "b.%d.boolcont", i);
 
-					v_boolanynullp = l_ptr_const(op->d.boolexpr.anynull,
-												 l_ptr(TypeStorageBool));
+					v_boolanynullp = l_op_ptr(d.boolexpr.anynull,
+											  l_ptr(TypeStorageBool));
 
 					v_boolnull = LLVMBuildLoad(b, v_resnullp, "");
 					v_boolvalue = LLVMBuildLoad(b, v_resvaluep, "");
@@ -764,8 +818,8 @@ llvm_compile_expr(ExprState *state)
 				{
 					LLVMValueRef v_boolanynullp;
 
-					v_boolanynullp = l_ptr_const(op->d.boolexpr.anynull,
-												 l_ptr(TypeStorageBool));
+					v_boolanynullp = l_op_ptr(d.boolexpr.anynull,
+											  l_ptr(TypeStorageBool));
 					LLVMBuildStore(b, l_sbool_const(0), v_boolanynullp);
 				}
 				/* FALLTHROUGH */
@@ -800,8 +854,8 @@ llvm_compile_expr(ExprState *state)
 					b_boolcont = l_bb_before_v(opblocks[i + 1],
 											   "b.%d.boolcont", i);
 
-					v_boolanynullp = l_ptr_const(op->d.boolexpr.anynull,
-												 l_ptr(TypeStorageBool));
+					v_boolanynullp = l_op_ptr(d.boolexpr.anynull,
+											  l_ptr(TypeStorageBool));
 
 					v_boolnull = LLVMBuildLoad(b, v_resnullp, "");
 					v_boolvalue = LLVMBuildLoad(b, v_resvaluep, "");
@@ -1028,13 +1082,13 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_NULLTEST_ROWISNULL:
 				build_EvalXFunc(b, mod, "ExecEvalRowNull",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_NULLTEST_ROWISNOTNULL:
 				build_EvalXFunc(b, mod, "ExecEvalRowNotNull",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1105,13 +1159,13 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_PARAM_EXEC:
 				build_EvalXFunc(b, mod, "ExecEvalParamExec",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_PARAM_EXTERN:
 				build_EvalXFunc(b, mod, "ExecEvalParamExtern",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1134,7 +1188,8 @@ llvm_compile_expr(ExprState *state)
 										 l_ptr(v_functype));
 
 					v_params[0] = v_state;
-					v_params[1] = l_ptr_const(op, l_ptr(TypeSizeT));
+					v_params[1] = LLVMBuildBitCast(b, v_op,
+												   l_ptr(TypeSizeT), "");
 					v_params[2] = v_econtext;
 					LLVMBuildCall(b,
 								  v_func,
@@ -1146,19 +1201,19 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_SBSREF_OLD:
 				build_EvalXFunc(b, mod, "ExecEvalSubscriptingRefOld",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_SBSREF_ASSIGN:
 				build_EvalXFunc(b, mod, "ExecEvalSubscriptingRefAssign",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_SBSREF_FETCH:
 				build_EvalXFunc(b, mod, "ExecEvalSubscriptingRefFetch",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1177,10 +1232,10 @@ llvm_compile_expr(ExprState *state)
 					b_notavail = l_bb_before_v(opblocks[i + 1],
 											   "op.%d.notavail", i);
 
-					v_casevaluep = l_ptr_const(op->d.casetest.value,
-											   l_ptr(TypeSizeT));
-					v_casenullp = l_ptr_const(op->d.casetest.isnull,
-											  l_ptr(TypeStorageBool));
+					v_casevaluep = l_op_ptr(d.casetest.value,
+											l_ptr(TypeSizeT));
+					v_casenullp = l_op_ptr(d.casetest.isnull,
+										   l_ptr(TypeStorageBool));
 
 					v_casevaluenull =
 						LLVMBuildICmp(b, LLVMIntEQ,
@@ -1225,8 +1280,8 @@ llvm_compile_expr(ExprState *state)
 					b_notnull = l_bb_before_v(opblocks[i + 1],
 											  "op.%d.readonly.notnull", i);
 
-					v_nullp = l_ptr_const(op->d.make_readonly.isnull,
-										  l_ptr(TypeStorageBool));
+					v_nullp = l_op_ptr(d.make_readonly.isnull,
+									   l_ptr(TypeStorageBool));
 
 					v_null = LLVMBuildLoad(b, v_nullp, "");
 
@@ -1242,8 +1297,8 @@ llvm_compile_expr(ExprState *state)
 					/* if value is not null, convert to RO datum */
 					LLVMPositionBuilderAtEnd(b, b_notnull);
 
-					v_valuep = l_ptr_const(op->d.make_readonly.value,
-										   l_ptr(TypeSizeT));
+					v_valuep = l_op_ptr(d.make_readonly.value,
+										l_ptr(TypeSizeT));
 
 					v_value = LLVMBuildLoad(b, v_valuep, "");
 
@@ -1291,8 +1346,10 @@ llvm_compile_expr(ExprState *state)
 					b_inputcall = l_bb_before_v(opblocks[i + 1],
 												"op.%d.inputcall", i);
 
-					v_fcinfo_out = l_ptr_const(fcinfo_out, l_ptr(StructFunctionCallInfoData));
-					v_fcinfo_in = l_ptr_const(fcinfo_in, l_ptr(StructFunctionCallInfoData));
+					v_fcinfo_out = l_op_ptr(d.iocoerce.fcinfo_data_out,
+											l_ptr(StructFunctionCallInfoData));
+					v_fcinfo_in = l_op_ptr(d.iocoerce.fcinfo_data_in,
+										   l_ptr(StructFunctionCallInfoData));
 					v_fn_addr_out = l_ptr_const(fcinfo_out->flinfo->fn_addr, TypePGFunction);
 					v_fn_addr_in = l_ptr_const(fcinfo_in->flinfo->fn_addr, TypePGFunction);
 
@@ -1416,7 +1473,8 @@ llvm_compile_expr(ExprState *state)
 					b_bothargnull = l_bb_before_v(opblocks[i + 1], "op.%d.bothargnull", i);
 					b_anyargnull = l_bb_before_v(opblocks[i + 1], "op.%d.anyargnull", i);
 
-					v_fcinfo = l_ptr_const(fcinfo, l_ptr(StructFunctionCallInfoData));
+					v_fcinfo = l_op_ptr(d.func.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
 
 					/* load args[0|1].isnull for both arguments */
 					v_argnull0 = l_funcnull(b, v_fcinfo, 0);
@@ -1467,7 +1525,7 @@ llvm_compile_expr(ExprState *state)
 					/* neither argument is null: compare */
 					LLVMPositionBuilderAtEnd(b, b_noargnull);
 
-					v_result = BuildV1Call(context, b, mod, fcinfo,
+					v_result = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
 										   &v_fcinfo_isnull);
 
 					if (opcode == EEOP_DISTINCT)
@@ -1511,7 +1569,8 @@ llvm_compile_expr(ExprState *state)
 					b_argsequal = l_bb_before_v(opblocks[i + 1],
 												"b.%d.argsequal", i);
 
-					v_fcinfo = l_ptr_const(fcinfo, l_ptr(StructFunctionCallInfoData));
+					v_fcinfo = l_op_ptr(d.func.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
 
 					/* if either argument is NULL they can't be equal */
 					v_argnull0 = l_funcnull(b, v_fcinfo, 0);
@@ -1537,7 +1596,8 @@ llvm_compile_expr(ExprState *state)
 					/* build block to invoke function and check result */
 					LLVMPositionBuilderAtEnd(b, b_nonull);
 
-					v_retval = BuildV1Call(context, b, mod, fcinfo, &v_fcinfo_isnull);
+					v_retval = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
+										   &v_fcinfo_isnull);
 
 					/*
 					 * If result not null, and arguments are equal return null
@@ -1568,43 +1628,44 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_SQLVALUEFUNCTION:
 				build_EvalXFunc(b, mod, "ExecEvalSQLValueFunction",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_CURRENTOFEXPR:
 				build_EvalXFunc(b, mod, "ExecEvalCurrentOfExpr",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_NEXTVALUEEXPR:
 				build_EvalXFunc(b, mod, "ExecEvalNextValueExpr",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_ARRAYEXPR:
 				build_EvalXFunc(b, mod, "ExecEvalArrayExpr",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_ARRAYCOERCE:
 				build_EvalXFunc(b, mod, "ExecEvalArrayCoerce",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_ROW:
 				build_EvalXFunc(b, mod, "ExecEvalRow",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_ROWCOMPARE_STEP:
 				{
 					FunctionCallInfo fcinfo = op->d.rowcompare_step.fcinfo_data;
+					LLVMValueRef v_fcinfo;
 					LLVMValueRef v_fcinfo_isnull;
 					LLVMBasicBlockRef b_null;
 					LLVMBasicBlockRef b_compare;
@@ -1621,20 +1682,19 @@ llvm_compile_expr(ExprState *state)
 									  "op.%d.row-compare-result",
 									  i);
 
+					v_fcinfo = l_op_ptr(d.rowcompare_step.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
+
 					/*
 					 * If function is strict, and either arg is null, we're
 					 * done.
 					 */
 					if (op->d.rowcompare_step.finfo->fn_strict)
 					{
-						LLVMValueRef v_fcinfo;
 						LLVMValueRef v_argnull0;
 						LLVMValueRef v_argnull1;
 						LLVMValueRef v_anyargisnull;
 
-						v_fcinfo = l_ptr_const(fcinfo,
-											   l_ptr(StructFunctionCallInfoData));
-
 						v_argnull0 = l_funcnull(b, v_fcinfo, 0);
 						v_argnull1 = l_funcnull(b, v_fcinfo, 1);
 
@@ -1661,7 +1721,7 @@ llvm_compile_expr(ExprState *state)
 					LLVMPositionBuilderAtEnd(b, b_compare);
 
 					/* call function */
-					v_retval = BuildV1Call(context, b, mod, fcinfo,
+					v_retval = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
 										   &v_fcinfo_isnull);
 					LLVMBuildStore(b, v_retval, v_resvaluep);
 
@@ -1753,25 +1813,25 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_MINMAX:
 				build_EvalXFunc(b, mod, "ExecEvalMinMax",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_FIELDSELECT:
 				build_EvalXFunc(b, mod, "ExecEvalFieldSelect",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_FIELDSTORE_DEFORM:
 				build_EvalXFunc(b, mod, "ExecEvalFieldStoreDeForm",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_FIELDSTORE_FORM:
 				build_EvalXFunc(b, mod, "ExecEvalFieldStoreForm",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1785,7 +1845,7 @@ llvm_compile_expr(ExprState *state)
 					v_fn = llvm_get_decl(mod, FuncExecEvalSubscriptingRef);
 
 					v_params[0] = v_state;
-					v_params[1] = l_ptr_const(op, l_ptr(StructExprEvalStep));
+					v_params[1] = v_op;
 					v_ret = LLVMBuildCall(b, v_fn,
 										  v_params, lengthof(v_params), "");
 					v_ret = LLVMBuildZExt(b, v_ret, TypeStorageBool, "");
@@ -1813,10 +1873,10 @@ llvm_compile_expr(ExprState *state)
 					b_notavail = l_bb_before_v(opblocks[i + 1],
 											   "op.%d.notavail", i);
 
-					v_casevaluep = l_ptr_const(op->d.casetest.value,
-											   l_ptr(TypeSizeT));
-					v_casenullp = l_ptr_const(op->d.casetest.isnull,
-											  l_ptr(TypeStorageBool));
+					v_casevaluep = l_op_ptr(d.casetest.value,
+											l_ptr(TypeSizeT));
+					v_casenullp = l_op_ptr(d.casetest.isnull,
+										   l_ptr(TypeStorageBool));
 
 					v_casevaluenull =
 						LLVMBuildICmp(b, LLVMIntEQ,
@@ -1854,31 +1914,31 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_DOMAIN_NOTNULL:
 				build_EvalXFunc(b, mod, "ExecEvalConstraintNotNull",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_DOMAIN_CHECK:
 				build_EvalXFunc(b, mod, "ExecEvalConstraintCheck",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_CONVERT_ROWTYPE:
 				build_EvalXFunc(b, mod, "ExecEvalConvertRowtype",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_SCALARARRAYOP:
 				build_EvalXFunc(b, mod, "ExecEvalScalarArrayOp",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_XMLEXPR:
 				build_EvalXFunc(b, mod, "ExecEvalXmlExpr",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1895,9 +1955,20 @@ llvm_compile_expr(ExprState *state)
 					 * in ExecInitAgg() after initializing the expression). So
 					 * load it from memory each time round.
 					 */
-					v_aggnop = l_ptr_const(&aggref->aggno,
-										   l_ptr(LLVMInt32Type()));
-					v_aggno = LLVMBuildLoad(b, v_aggnop, "v_aggno");
+					if (relocatable)
+					{
+						v_aggnop = l_op_ptr(d.aggref.astate,
+											l_ptr(LLVMInt8Type()));
+						v_aggno = l_load_offset(b, v_aggnop,
+												offsetof(AggrefExprState, aggno),
+												LLVMInt32Type(), "v_aggno");
+					}
+					else
+					{
+						v_aggnop = l_ptr_const(&aggref->aggno,
+											   l_ptr(LLVMInt32Type()));
+						v_aggno = LLVMBuildLoad(b, v_aggnop, "v_aggno");
+					}
 
 					/* load agg value / null */
 					value = l_load_gep1(b, v_aggvalues, v_aggno, "aggvalue");
@@ -1913,7 +1984,7 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_GROUPING_FUNC:
 				build_EvalXFunc(b, mod, "ExecEvalGroupingFunc",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -1930,9 +2001,20 @@ llvm_compile_expr(ExprState *state)
 					 * up in ExecInitWindowAgg() after initializing the
 					 * expression). So load it from memory each time round.
 					 */
-					v_wfuncnop = l_ptr_const(&wfunc->wfuncno,
-											 l_ptr(LLVMInt32Type()));
-					v_wfuncno = LLVMBuildLoad(b, v_wfuncnop, "v_wfuncno");
+					if (relocatable)
+					{
+						v_wfuncnop = l_op_ptr(d.window_func.wfstate,
+											  l_ptr(LLVMInt8Type()));
+						v_wfuncno = l_load_offset(b, v_wfuncnop,
+												  offsetof(WindowFuncExprState, wfuncno),
+												  LLVMInt32Type(), "v_wfuncno");
+					}
+					else
+					{
+						v_wfuncnop = l_ptr_const(&wfunc->wfuncno,
+												 l_ptr(LLVMInt32Type()));
+						v_wfuncno = LLVMBuildLoad(b, v_wfuncnop, "v_wfuncno");
+					}
 
 					/* load window func value / null */
 					value = l_load_gep1(b, v_aggvalues, v_wfuncno,
@@ -1949,19 +2031,18 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_SUBPLAN:
 				build_EvalXFunc(b, mod, "ExecEvalSubPlan",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_ALTERNATIVE_SUBPLAN:
 				build_EvalXFunc(b, mod, "ExecEvalAlternativeSubPlan",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_AGG_STRICT_DESERIALIZE:
 				{
-					FunctionCallInfo fcinfo = op->d.agg_deserialize.fcinfo_data;
 					LLVMValueRef v_fcinfo;
 					LLVMValueRef v_argnull0;
 					LLVMBasicBlockRef b_deserialize;
@@ -1969,8 +2050,8 @@ llvm_compile_expr(ExprState *state)
 					b_deserialize = l_bb_before_v(opblocks[i + 1],
 												  "op.%d.deserialize", i);
 
-					v_fcinfo = l_ptr_const(fcinfo,
-										   l_ptr(StructFunctionCallInfoData));
+					v_fcinfo = l_op_ptr(d.agg_deserialize.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
 					v_argnull0 = l_funcnull(b, v_fcinfo, 0);
 
 					LLVMBuildCondBr(b,
@@ -1990,6 +2071,7 @@ llvm_compile_expr(ExprState *state)
 					AggState   *aggstate;
 					FunctionCallInfo fcinfo;
 
+					LLVMValueRef v_fcinfo;
 					LLVMValueRef v_retval;
 					LLVMValueRef v_fcinfo_isnull;
 					LLVMValueRef v_tmpcontext;
@@ -1998,11 +2080,19 @@ llvm_compile_expr(ExprState *state)
 					aggstate = op->d.agg_deserialize.aggstate;
 					fcinfo = op->d.agg_deserialize.fcinfo_data;
 
-					v_tmpcontext =
-						l_ptr_const(aggstate->tmpcontext->ecxt_per_tuple_memory,
-									l_ptr(StructMemoryContextData));
+					v_fcinfo = l_op_ptr(d.agg_deserialize.fcinfo_data,
+										l_ptr(StructFunctionCallInfoData));
+					if (relocatable)
+						v_tmpcontext =
+							build_AggTmpMemory(b,
+											   l_op_ptr(d.agg_deserialize.aggstate,
+														l_ptr(StructAggState)));
+					else
+						v_tmpcontext =
+							l_ptr_const(aggstate->tmpcontext->ecxt_per_tuple_memory,
+										l_ptr(StructMemoryContextData));
 					v_oldcontext = l_mcxt_switch(mod, b, v_tmpcontext);
-					v_retval = BuildV1Call(context, b, mod, fcinfo,
+					v_retval = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
 										   &v_fcinfo_isnull);
 					l_mcxt_switch(mod, b, v_oldcontext);
 
@@ -2017,8 +2107,6 @@ llvm_compile_expr(ExprState *state)
 			case EEOP_AGG_STRICT_INPUT_CHECK_ARGS:
 				{
 					int			nargs = op->d.agg_strict_input_check.nargs;
-					NullableDatum *args = op->d.agg_strict_input_check.args;
-					bool	   *nulls = op->d.agg_strict_input_check.nulls;
 					int			jumpnull;
 					int			argno;
 
@@ -2029,8 +2117,10 @@ llvm_compile_expr(ExprState *state)
 					Assert(nargs > 0);
 
 					jumpnull = op->d.agg_strict_input_check.jumpnull;
-					v_argsp = l_ptr_const(args, l_ptr(StructNullableDatum));
-					v_nullsp = l_ptr_const(nulls, l_ptr(TypeStorageBool));
+					v_argsp = l_op_ptr(d.agg_strict_input_check.args,
+									   l_ptr(StructNullableDatum));
+					v_nullsp = l_op_ptr(d.agg_strict_input_check.nulls,
+										l_ptr(TypeStorageBool));
 
 					/* create blocks for checking args */
 					b_checknulls = palloc(sizeof(LLVMBasicBlockRef *) * nargs);
@@ -2083,11 +2173,43 @@ llvm_compile_expr(ExprState *state)
 					break;
 				}
 
-			case EEOP_AGG_INIT_TRANS:
+			case EEOP_AGG_PLAIN_PERGROUP_NULLCHECK:
 				{
-					AggState   *aggstate;
-					AggStatePerTrans pertrans;
+					LLVMValueRef v_aggstatep;
+					LLVMValueRef v_allpergroupsp;
+					LLVMValueRef v_pergroup_allaggs;
+					LLVMValueRef v_setoff;
+					int			jumpnull;
+
+					jumpnull = op->d.agg_plain_pergroup_nullcheck.jumpnull;
+					v_aggstatep = l_op_ptr(d.agg_plain_pergroup_nullcheck.aggstate,
+										   l_ptr(StructAggState));
+
+					/*
+					 * pergroup_allaggs = aggstate->all_pergroups
+					 * [op->d.agg_plain_pergroup_nullcheck.setoff];
+					 */
+					v_allpergroupsp =
+						l_load_struct_gep(b, v_aggstatep,
+										  FIELDNO_AGGSTATE_ALL_PERGROUPS,
+										  "aggstate.all_pergroups");
+					v_setoff =
+						l_int32_const(op->d.agg_plain_pergroup_nullcheck.setoff);
+					v_pergroup_allaggs =
+						l_load_gep1(b, v_allpergroupsp, v_setoff, "");
+
+					LLVMBuildCondBr(b,
+									LLVMBuildICmp(b, LLVMIntEQ,
+												  LLVMBuildPtrToInt(b, v_pergroup_allaggs,
+																	TypeSizeT, ""),
+												  l_sizet_const(0), ""),
+									opblocks[jumpnull],
+									opblocks[i + 1]);
+					break;
+				}
 
+			case EEOP_AGG_INIT_TRANS:
+				{
 					LLVMValueRef v_aggstatep;
 					LLVMValueRef v_pertransp;
 
@@ -2102,13 +2224,10 @@ llvm_compile_expr(ExprState *state)
 
 					LLVMBasicBlockRef b_init;
 
-					aggstate = op->d.agg_init_trans.aggstate;
-					pertrans = op->d.agg_init_trans.pertrans;
-
-					v_aggstatep = l_ptr_const(aggstate,
-											  l_ptr(StructAggState));
-					v_pertransp = l_ptr_const(pertrans,
-											  l_ptr(StructAggStatePerTransData));
+					v_aggstatep = l_op_ptr(d.agg_init_trans.aggstate,
+										   l_ptr(StructAggState));
+					v_pertransp = l_op_ptr(d.agg_init_trans.pertrans,
+										   l_ptr(StructAggStatePerTransData));
 
 					/*
 					 * pergroup = &aggstate->all_pergroups
@@ -2148,8 +2267,8 @@ llvm_compile_expr(ExprState *state)
 						LLVMValueRef v_current_set;
 						LLVMValueRef v_aggcontext;
 
-						v_aggcontext = l_ptr_const(op->d.agg_init_trans.aggcontext,
-												   l_ptr(StructExprContext));
+						v_aggcontext = l_op_ptr(d.agg_init_trans.aggcontext,
+												l_ptr(StructExprContext));
 
 						v_current_set =
 							LLVMBuildStructGEP(b,
@@ -2183,7 +2302,6 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_AGG_STRICT_TRANS_CHECK:
 				{
-					AggState   *aggstate;
 					LLVMValueRef v_setoff,
 								v_transno;
 
@@ -2195,8 +2313,8 @@ llvm_compile_expr(ExprState *state)
 
 					int			jumpnull = op->d.agg_strict_trans_check.jumpnull;
 
-					aggstate = op->d.agg_strict_trans_check.aggstate;
-					v_aggstatep = l_ptr_const(aggstate, l_ptr(StructAggState));
+					v_aggstatep = l_op_ptr(d.agg_strict_trans_check.aggstate,
+										   l_ptr(StructAggState));
 
 					/*
 					 * pergroup = &aggstate->all_pergroups
@@ -2268,10 +2386,10 @@ llvm_compile_expr(ExprState *state)
 
 					fcinfo = pertrans->transfn_fcinfo;
 
-					v_aggstatep = l_ptr_const(aggstate,
-											  l_ptr(StructAggState));
-					v_pertransp = l_ptr_const(pertrans,
-											  l_ptr(StructAggStatePerTransData));
+					v_aggstatep = l_op_ptr(d.agg_trans.aggstate,
+										   l_ptr(StructAggState));
+					v_pertransp = l_op_ptr(d.agg_trans.pertrans,
+										   l_ptr(StructAggStatePerTransData));
 
 					/*
 					 * pergroup = &aggstate->all_pergroups
@@ -2289,10 +2407,16 @@ llvm_compile_expr(ExprState *state)
 									 l_load_gep1(b, v_allpergroupsp, v_setoff, ""),
 									 &v_transno, 1, "");
 
-					v_fcinfo = l_ptr_const(fcinfo,
-										   l_ptr(StructFunctionCallInfoData));
-					v_aggcontext = l_ptr_const(op->d.agg_trans.aggcontext,
-											   l_ptr(StructExprContext));
+					if (relocatable)
+						v_fcinfo =
+							l_load_offset(b, v_pertransp,
+										  offsetof(AggStatePerTransData, transfn_fcinfo),
+										  l_ptr(StructFunctionCallInfoData), "");
+					else
+						v_fcinfo = l_ptr_const(fcinfo,
+											   l_ptr(StructFunctionCallInfoData));
+					v_aggcontext = l_op_ptr(d.agg_trans.aggcontext,
+											l_ptr(StructExprContext));
 
 					v_current_setp =
 						LLVMBuildStructGEP(b,
@@ -2317,9 +2441,12 @@ llvm_compile_expr(ExprState *state)
 					LLVMBuildStore(b, v_pertransp, v_current_pertransp);
 
 					/* invoke transition function in per-tuple context */
-					v_tmpcontext =
-						l_ptr_const(aggstate->tmpcontext->ecxt_per_tuple_memory,
-									l_ptr(StructMemoryContextData));
+					if (relocatable)
+						v_tmpcontext = build_AggTmpMemory(b, v_aggstatep);
+					else
+						v_tmpcontext =
+							l_ptr_const(aggstate->tmpcontext->ecxt_per_tuple_memory,
+										l_ptr(StructMemoryContextData));
 					v_oldcontext = l_mcxt_switch(mod, b, v_tmpcontext);
 
 					/* store transvalue in fcinfo->args[0] */
@@ -2340,7 +2467,7 @@ llvm_compile_expr(ExprState *state)
 								   l_funcnullp(b, v_fcinfo, 0));
 
 					/* and invoke transition function */
-					v_retval = BuildV1Call(context, b, mod, fcinfo,
+					v_retval = BuildV1Call(context, b, mod, fcinfo, v_fcinfo,
 										   &v_fcinfo_isnull);
 
 					/*
@@ -2421,13 +2548,13 @@ llvm_compile_expr(ExprState *state)
 
 			case EEOP_AGG_ORDERED_TRANS_DATUM:
 				build_EvalXFunc(b, mod, "ExecEvalAggOrderedTransDatum",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
 			case EEOP_AGG_ORDERED_TRANS_TUPLE:
 				build_EvalXFunc(b, mod, "ExecEvalAggOrderedTransTuple",
-								v_state, v_econtext, op);
+								v_state, v_econtext, v_op);
 				LLVMBuildBr(b, opblocks[i + 1]);
 				break;
 
@@ -2439,6 +2566,13 @@ llvm_compile_expr(ExprState *state)
 
 	LLVMDisposeBuilder(b);
 
+	/*
+	 * If the code can be reused, an earlier execution of the plan may
+	 * already have emitted the same function.
+	 */
+	if (relocatable)
+		cachedname = llvm_cache_function(context, eval_fn, deform_fns);
+
 	/*
 	 * Don't immediately emit function, instead do so the first time the
 	 * expression is actually evaluated. That allows to emit a lot of
@@ -2450,7 +2584,7 @@ llvm_compile_expr(ExprState *state)
 		CompiledExprState *cstate = palloc0(sizeof(CompiledExprState));
 
 		cstate->context = context;
-		cstate->funcname = funcname;
+		cstate->funcname = cachedname ? cachedname : funcname;
 
 		state->evalfunc = ExecRunCompiledExpr;
 		state->evalfunc_private = cstate;
@@ -2496,16 +2630,14 @@ ExecRunCompiledExpr(ExprState *state, ExprContext *econtext, bool *isNull)
 static LLVMValueRef
 BuildV1Call(LLVMJitContext *context, LLVMBuilderRef b,
 			LLVMModuleRef mod, FunctionCallInfo fcinfo,
-			LLVMValueRef *v_fcinfo_isnull)
+			LLVMValueRef v_fcinfo, LLVMValueRef *v_fcinfo_isnull)
 {
 	LLVMValueRef v_fn;
 	LLVMValueRef v_fcinfo_isnullp;
 	LLVMValueRef v_retval;
-	LLVMValueRef v_fcinfo;
 
 	v_fn = llvm_function_reference(context, b, mod, fcinfo);
 
-	v_fcinfo = l_ptr_const(fcinfo, l_ptr(StructFunctionCallInfoData));
 	v_fcinfo_isnullp = LLVMBuildStructGEP(b, v_fcinfo,
 										  FIELDNO_FUNCTIONCALLINFODATA_ISNULL,
 										  "v_fcinfo_isnull");
@@ -2525,11 +2657,16 @@ BuildV1Call(LLVMJitContext *context, LLVMBuilderRef b,
 		LLVMValueRef params[2];
 
 		params[0] = l_int64_const(sizeof(NullableDatum) * fcinfo->nargs);
-		params[1] = l_ptr_const(fcinfo->args, l_ptr(LLVMInt8Type()));
+		params[1] = LLVMBuildBitCast(b,
+									 LLVMBuildStructGEP(b, v_fcinfo,
+														FIELDNO_FUNCTIONCALLINFODATA_ARGS,
+														""),
+									 l_ptr(LLVMInt8Type()), "");
 		LLVMBuildCall(b, v_lifetime, params, lengthof(params), "");
 
 		params[0] = l_int64_const(sizeof(fcinfo->isnull));
-		params[1] = l_ptr_const(&fcinfo->isnull, l_ptr(LLVMInt8Type()));
+		params[1] = LLVMBuildBitCast(b, v_fcinfo_isnullp,
+									 l_ptr(LLVMInt8Type()), "");
 		LLVMBuildCall(b, v_lifetime, params, lengthof(params), "");
 	}
 
@@ -2542,7 +2679,7 @@ BuildV1Call(LLVMJitContext *context, LLVMBuilderRef b,
 static void
 build_EvalXFunc(LLVMBuilderRef b, LLVMModuleRef mod, const char *funcname,
 				LLVMValueRef v_state, LLVMValueRef v_econtext,
-				ExprEvalStep *op)
+				LLVMValueRef v_op)
 {
 	LLVMTypeRef sig;
 	LLVMValueRef v_fn;
@@ -2563,7 +2700,7 @@ build_EvalXFunc(LLVMBuilderRef b, LLVMModuleRef mod, const char *funcname,
 	}
 
 	params[0] = v_state;
-	params[1] = l_ptr_const(op, l_ptr(StructExprEvalStep));
+	params[1] = v_op;
 	params[2] = v_econtext;
 
 	LLVMBuildCall(b,
@@ -2571,6 +2708,23 @@ build_EvalXFunc(LLVMBuilderRef b, LLVMModuleRef mod, const char *funcname,
 				  params, lengthof(params), "");
 }
 
+/*
+ * Return aggstate->tmpcontext->ecxt_per_tuple_memory, for relocatable code.
+ */
+static LLVMValueRef
+build_AggTmpMemory(LLVMBuilderRef b, LLVMValueRef v_aggstatep)
+{
+	LLVMValueRef v_tmpcontext;
+
+	v_tmpcontext = l_load_offset(b, v_aggstatep,
+								 offsetof(AggState, tmpcontext),
+								 l_ptr(StructExprContext), "");
+
+	return l_load_offset(b, v_tmpcontext,
+						 offsetof(ExprContext, ecxt_per_tuple_memory),
+						 l_ptr(StructMemoryContextData), "");
+}
+
 static LLVMValueRef
 create_LifetimeEnd(LLVMModuleRef mod)
 {
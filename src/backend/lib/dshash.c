@@ -17,8 +17,13 @@
  * is only expected to happen a small number of times until a stable size is
  * found, since growth is geometric.
  *
- * Future versions may support iterators and incremental resizing; for now
- * the implementation is minimalist.
+ * The whole table can be scanned with dshash_seq_init/dshash_seq_next.  A
+ * scan locks one partition at a time, acquiring the lock on the next
+ * partition before releasing the current one, so the table can't be resized
+ * while a scan is in progress.
+ *
+ * Future versions may support incremental resizing; for now the
+ * implementation is minimalist.
  *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -153,6 +158,14 @@ struct dshash_table
 #define BUCKET_INDEX_FOR_PARTITION(partition, size_log2)	\
 	((partition) << NUM_SPLITS(size_log2))
 
+/* The partition that a given bucket belongs to. */
+#define PARTITION_FOR_BUCKET_INDEX(bucket_idx, size_log2)	\
+	((bucket_idx) >> NUM_SPLITS(size_log2))
+
+/* The number of buckets at a given size. */
+#define NUM_BUCKETS(size_log2)		\
+	(((size_t) 1) << (size_log2))
+
 /* The head of the active bucket for a given hash value (lvalue). */
 #define BUCKET_FOR_HASH(hash_table, hash)								\
 	(hash_table->buckets[												\
@@ -574,6 +587,137 @@ dshash_release_lock(dshash_table *hash_table, void *entry)
 	LWLockRelease(PARTITION_LOCK(hash_table, partition_index));
 }
 
+/*
+ * Initialize a sequential scan of all entries in a hash table.
+ *
+ * If exclusive is true, the partition locks are taken in exclusive mode, and
+ * the caller may delete the returned entries with dshash_delete_current.  The
+ * caller must not access the same table by other means until the scan has
+ * been ended with dshash_seq_term.
+ */
+void
+dshash_seq_init(dshash_seq_status *status, dshash_table *hash_table,
+				bool exclusive)
+{
+	status->hash_table = hash_table;
+	status->curbucket = 0;
+	status->nbuckets = 0;
+	status->curitem = NULL;
+	status->pnextitem = InvalidDsaPointer;
+	status->curpartition = -1;
+	status->exclusive = exclusive;
+}
+
+/*
+ * Return the next entry of a sequential scan, or NULL when there are no more.
+ * The returned entry is locked; the lock is carried over to the next call, so
+ * the caller mustn't release it.
+ */
+void *
+dshash_seq_next(dshash_seq_status *status)
+{
+	dshash_table *hash_table = status->hash_table;
+	LWLockMode	lockmode = status->exclusive ? LW_EXCLUSIVE : LW_SHARED;
+	dsa_pointer next_item_pointer;
+
+	if (status->curpartition < 0)
+	{
+		Assert(hash_table->control->magic == DSHASH_MAGIC);
+		Assert(!hash_table->find_locked);
+
+		/*
+		 * Bucket 0 always belongs to partition 0.  Once we hold that lock,
+		 * the table can't be resized until the scan ends.
+		 */
+		LWLockAcquire(PARTITION_LOCK(hash_table, 0), lockmode);
+		status->curpartition = 0;
+		ensure_valid_bucket_pointers(hash_table);
+		status->nbuckets = NUM_BUCKETS(hash_table->size_log2);
+
+		hash_table->find_locked = true;
+		hash_table->find_exclusively_locked = status->exclusive;
+
+		next_item_pointer = hash_table->buckets[0];
+	}
+	else
+		next_item_pointer = status->pnextitem;
+
+	Assert(LWLockHeldByMeInMode(PARTITION_LOCK(hash_table,
+											   status->curpartition),
+								lockmode));
+
+	/* Advance to the next non-empty bucket, if this one is done */
+	while (!DsaPointerIsValid(next_item_pointer))
+	{
+		int			next_partition;
+
+		if (++status->curbucket >= status->nbuckets)
+			return NULL;
+
+		next_partition = PARTITION_FOR_BUCKET_INDEX(status->curbucket,
+													hash_table->size_log2);
+		if (next_partition != status->curpartition)
+		{
+			/*
+			 * Lock the next partition before releasing the current one, so
+			 * that no resize can sneak in between.  We lock partitions in
+			 * ascending order, like resize() does, so this can't deadlock.
+			 */
+			LWLockAcquire(PARTITION_LOCK(hash_table, next_partition),
+						  lockmode);
+			LWLockRelease(PARTITION_LOCK(hash_table, status->curpartition));
+			status->curpartition = next_partition;
+		}
+
+		next_item_pointer = hash_table->buckets[status->curbucket];
+	}
+
+	status->curitem = dsa_get_address(hash_table->area, next_item_pointer);
+
+	/* Remember the next item, in case the caller deletes this one */
+	status->pnextitem = status->curitem->next;
+
+	return ENTRY_FROM_ITEM(status->curitem);
+}
+
+/*
+ * End a sequential scan, releasing the partition lock still held.
+ */
+void
+dshash_seq_term(dshash_seq_status *status)
+{
+	dshash_table *hash_table = status->hash_table;
+
+	if (status->curpartition >= 0)
+	{
+		hash_table->find_locked = false;
+		hash_table->find_exclusively_locked = false;
+		LWLockRelease(PARTITION_LOCK(hash_table, status->curpartition));
+		status->curpartition = -1;
+	}
+}
+
+/*
+ * Delete the entry most recently returned by dshash_seq_next.  The scan must
+ * have been started in exclusive mode.
+ */
+void
+dshash_delete_current(dshash_seq_status *status)
+{
+	dshash_table *hash_table = status->hash_table;
+	dshash_table_item *item = status->curitem;
+
+	Assert(status->exclusive);
+	Assert(hash_table->control->magic == DSHASH_MAGIC);
+	Assert(hash_table->find_exclusively_locked);
+	Assert(LWLockHeldByMeInMode(PARTITION_LOCK(hash_table,
+											   PARTITION_FOR_HASH(item->hash)),
+								LW_EXCLUSIVE));
+
+	delete_item(hash_table, item);
+	status->curitem = NULL;
+}
+
 /*
  * A compare function that forwards to memcmp.
  */
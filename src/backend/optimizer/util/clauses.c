@@ -892,6 +892,27 @@ is_parallel_safe(PlannerInfo *root, Node *node)
 	return !max_parallel_hazard_walker(node, &context);
 }
 
+/*
+ * is_parallel_safe_expr
+ *		Detect whether a standalone expression, not part of any query being
+ *		planned, can be evaluated in a parallel worker
+ *
+ * This is for utility commands that evaluate expressions in parallel workers
+ * themselves, such as parallel COPY FROM.  Parallel-restricted constructs are
+ * rejected just as parallel-unsafe ones are.
+ */
+bool
+is_parallel_safe_expr(Node *node)
+{
+	max_parallel_hazard_context context;
+
+	context.max_hazard = PROPARALLEL_SAFE;
+	context.max_interesting = PROPARALLEL_RESTRICTED;
+	context.safe_param_ids = NIL;
+
+	return !max_parallel_hazard_walker(node, &context);
+}
+
 /* core logic for all parallel-hazard checks */
 static bool
 max_parallel_hazard_test(char proparallel, max_parallel_hazard_context *context)
@@ -48,6 +48,7 @@
 #include "pgstat.h"
 #include "postmaster/bgwriter.h"
 #include "replication/syncrep.h"
+#include "storage/aio.h"
 #include "storage/bufmgr.h"
 #include "storage/condition_variable.h"
 #include "storage/fd.h"
@@ -263,6 +264,7 @@ CheckpointerMain(void)
 		LWLockReleaseAll();
 		ConditionVariableCancelSleep();
 		pgstat_report_wait_end();
+		pgaio_release_all_handles();
 		AbortBufferIO();
 		UnlockBuffers();
 		ReleaseAuxProcessResources(false);
@@ -378,6 +380,8 @@ CheckpointerMain(void)
 			ExitOnAnyError = true;
 			/* Close down the database */
 			ShutdownXLOG(0, 0);
+			/* Save the statistics for the next startup */
+			pgstat_save_stats();
 			/* Normal exit from the checkpointer is here */
 			proc_exit(0);		/* done */
 		}
@@ -533,6 +537,7 @@ CheckpointerMain(void)
 		 * stats message types.)
 		 */
 		pgstat_send_bgwriter();
+		pgstat_send_wal();
 
 		/*
 		 * Sleep until we are signaled or it's time for another checkpoint or
@@ -693,6 +698,7 @@ CheckpointWriteDelay(int flags, double progress)
 		 * Report interim activity statistics to the stats collector.
 		 */
 		pgstat_send_bgwriter();
+		pgstat_send_wal();
 
 		/*
 		 * This sleep used to be connected to bgwriter_delay, typically 200ms.
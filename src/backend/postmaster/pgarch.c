@@ -167,9 +167,11 @@ pgarch_start(void)
 			/* Close the postmaster's sockets */
 			ClosePostmasterPorts(false);
 
-			/* Drop our connection to postmaster's shared memory, as well */
+			/*
+			 * Drop our connection to postmaster's dynamic shared memory.  We
+			 * stay attached to the main segment to report statistics.
+			 */
 			dsm_detach_all();
-			PGSharedMemoryDetach();
 
 			PgArchiverMain(0, NULL);
 			break;
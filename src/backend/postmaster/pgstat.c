@@ -1,13 +1,32 @@
 /* ----------
  * pgstat.c
  *
- *	All the statistics collector stuff hacked up in one big, ugly file.
- *
- *	TODO:	- Separate collector, postmaster and backend stuff
+ *	All the statistics collection stuff hacked up in one big, ugly file.
+ *
+ *	Cumulative activity statistics are kept in shared memory, in dshash tables
+ *	living in a DSA area that the postmaster creates at startup: one for
+ *	databases, one for tables and one for functions, the latter two keyed by
+ *	database and object OID.  Backends still accumulate their counts locally
+ *	and batch them up in the message structs declared in pgstat.h, but
+ *	pgstat_send() applies each message to the shared tables directly instead
+ *	of sending it to a collector process.
+ *
+ *	Readers copy the entries they look at into backend-local hash tables, so
+ *	that repeated accesses within a transaction see stable values, just as
+ *	they used to see the contents of one stats file.
+ *
+ *	The statistics are written to a file only at shutdown, by the
+ *	checkpointer, and read back by the startup process at the next clean
+ *	start.  After a crash they are discarded.
+ *
+ *	Archiver, global (bgwriter) and WAL statistics are kept directly in
+ *	StatsShmem under a spinlock, because the archiver has no PGPROC and
+ *	therefore can't use the DSA area, and WAL statistics are sent by
+ *	processes that may not be attached to it.
+ *
+ *	TODO:	- Separate backend status and statistics stuff
  *			  into different files.
  *
- *			- Add some automatic call for pgstat vacuuming.
- *
  *			- Add a pgstat config column to pg_database, so this
  *			  entire thing can be enabled/disabled on a per db basis.
  *
@@ -22,15 +41,8 @@
 #include <fcntl.h>
 #include <sys/param.h>
 #include <sys/time.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <signal.h>
 #include <time.h>
-#ifdef HAVE_SYS_SELECT_H
-#include <sys/select.h>
-#endif
 
 #include "pgstat.h"
 
@@ -42,15 +54,12 @@
 #include "access/xact.h"
 #include "catalog/pg_database.h"
 #include "catalog/pg_proc.h"
-#include "common/ip.h"
+#include "lib/dshash.h"
 #include "libpq/libpq.h"
-#include "libpq/pqsignal.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "pg_trace.h"
 #include "postmaster/autovacuum.h"
-#include "postmaster/fork_process.h"
-#include "postmaster/postmaster.h"
 #include "replication/walsender.h"
 #include "storage/backendid.h"
 #include "storage/dsm.h"
@@ -58,13 +67,15 @@
 #include "storage/ipc.h"
 #include "storage/latch.h"
 #include "storage/lmgr.h"
-#include "storage/pg_shmem.h"
+#include "storage/proc.h"
 #include "storage/procsignal.h"
+#include "storage/shmem.h"
 #include "storage/sinvaladt.h"
+#include "storage/spin.h"
 #include "utils/ascii.h"
+#include "utils/dsa.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
-#include "utils/ps_status.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/timestamp.h"
@@ -74,37 +85,25 @@
  * Timer definitions.
  * ----------
  */
-#define PGSTAT_STAT_INTERVAL	500 /* Minimum time between stats file
-									 * updates; in milliseconds. */
-
-#define PGSTAT_RETRY_DELAY		10	/* How long to wait between checks for a
-									 * new file; in milliseconds. */
-
-#define PGSTAT_MAX_WAIT_TIME	10000	/* Maximum time to wait for a stats
-										 * file update; in milliseconds. */
-
-#define PGSTAT_INQ_INTERVAL		640 /* How often to ping the collector for a
-									 * new file; in milliseconds. */
-
-#define PGSTAT_RESTART_INTERVAL 60	/* How often to attempt to restart a
-									 * failed statistics collector; in
-									 * seconds. */
-
-#define PGSTAT_POLL_LOOP_COUNT	(PGSTAT_MAX_WAIT_TIME / PGSTAT_RETRY_DELAY)
-#define PGSTAT_INQ_LOOP_COUNT	(PGSTAT_INQ_INTERVAL / PGSTAT_RETRY_DELAY)
-
-/* Minimum receive buffer size for the collector's socket. */
-#define PGSTAT_MIN_RCVBUF		(100 * 1024)
+#define PGSTAT_STAT_INTERVAL	500 /* Minimum time between flushes of a
+									 * backend's local counts; in
+									 * milliseconds. */
 
 
 /* ----------
- * The initial size hints for the hash tables used in the collector.
+ * The initial size hints for the backend-local hash tables.
  * ----------
  */
 #define PGSTAT_DB_HASH_SIZE		16
 #define PGSTAT_TAB_HASH_SIZE	512
 #define PGSTAT_FUNCTION_HASH_SIZE	512
 
+/*
+ * Size of the part of the statistics DSA area that is carved out of the main
+ * shared memory segment.  The area grows into DSM segments beyond this.
+ */
+#define PGSTAT_DSA_INITIAL_SIZE	(256 * 1024)
+
 
 /* ----------
  * Total number of backends including auxiliary
@@ -132,8 +131,6 @@ int			pgstat_track_activity_query_size = 1024;
  * ----------
  */
 char	   *pgstat_stat_directory = NULL;
-char	   *pgstat_stat_filename = NULL;
-char	   *pgstat_stat_tmpname = NULL;
 
 /*
  * BgWriter global statistics counters (unused in other processes).
@@ -142,21 +139,83 @@ char	   *pgstat_stat_tmpname = NULL;
  */
 PgStat_MsgBgWriter BgWriterStats;
 
+/*
+ * WAL statistics counters, accumulated by every process that writes WAL and
+ * sent by pgstat_send_wal().  We assume this inits to zeroes.
+ */
+PgStat_MsgWal WalStats;
+
 /* ----------
- * Local data
+ * Shared memory data
+ *
+ * The fixed-size part lives in the main shared memory segment and is followed
+ * by the in-place part of the DSA area holding the dshash tables.
  * ----------
  */
-NON_EXEC_STATIC pgsocket pgStatSock = PGINVALID_SOCKET;
+typedef struct StatsShmemStruct
+{
+	slock_t		mutex;			/* protects global_stats, archiver_stats and
+								 * wal_stats */
+	PgStat_GlobalStats global_stats;
+	PgStat_ArchiverStats archiver_stats;
+	PgStat_WalStats wal_stats;
+
+	dshash_table_handle db_hash_handle;
+	dshash_table_handle tab_hash_handle;
+	dshash_table_handle func_hash_handle;
+} StatsShmemStruct;
+
+#define StatsDsaPlace() \
+	((void *) ((char *) StatsShmem + MAXALIGN(sizeof(StatsShmemStruct))))
 
-static struct sockaddr_storage pgStatAddr;
+NON_EXEC_STATIC StatsShmemStruct *StatsShmem = NULL;
 
-static time_t last_pgstat_start_time;
+/* Our attachment to the DSA area and the hash tables, made on first use */
+static dsa_area *pgStatArea = NULL;
+static dshash_table *db_stats = NULL;
+static dshash_table *tab_stats = NULL;
+static dshash_table *func_stats = NULL;
+
+/*
+ * Key of the table and function hashes.  It must match the leading fields of
+ * PgStat_StatTabEntry and PgStat_StatFuncEntry.
+ */
+typedef struct PgStat_StatObjectKey
+{
+	Oid			databaseid;
+	Oid			objectid;
+} PgStat_StatObjectKey;
+
+static const dshash_parameters dsh_dbparams = {
+	sizeof(Oid),
+	sizeof(PgStat_StatDBEntry),
+	dshash_memcmp,
+	dshash_memhash,
+	LWTRANCHE_STATS_DB
+};
+static const dshash_parameters dsh_tblparams = {
+	sizeof(PgStat_StatObjectKey),
+	sizeof(PgStat_StatTabEntry),
+	dshash_memcmp,
+	dshash_memhash,
+	LWTRANCHE_STATS_TABLE
+};
+static const dshash_parameters dsh_funcparams = {
+	sizeof(PgStat_StatObjectKey),
+	sizeof(PgStat_StatFuncEntry),
+	dshash_memcmp,
+	dshash_memhash,
+	LWTRANCHE_STATS_FUNCTION
+};
 
-static bool pgStatRunningInCollector = false;
+/* ----------
+ * Local data
+ * ----------
+ */
 
 /*
  * Structures in which backends store per-table info that's waiting to be
- * sent to the collector.
+ * applied to the shared statistics.
  *
  * NOTE: once allocated, TabStatusArray structures are never moved or deleted
  * for the life of the backend.  Also, we zero out the t_id fields of the
@@ -191,14 +250,14 @@ typedef struct TabStatHashEntry
 static HTAB *pgStatTabHash = NULL;
 
 /*
- * Backends store per-function info that's waiting to be sent to the collector
- * in this hash table (indexed by function OID).
+ * Backends store per-function info that's waiting to be applied to the shared
+ * statistics in this hash table (indexed by function OID).
  */
 static HTAB *pgStatFunctions = NULL;
 
 /*
  * Indicates if backend has some function stats that it hasn't yet
- * sent to the collector.
+ * sent to the statistics system.
  */
 static bool have_function_stats = false;
 
@@ -238,10 +297,14 @@ typedef struct TwoPhasePgStatRecord
 } TwoPhasePgStatRecord;
 
 /*
- * Info about current "snapshot" of stats file
+ * Info about current "snapshot" of the shared statistics.  Entries are
+ * copied into these hash tables as they are looked up, and stay there until
+ * the end of the transaction.
  */
 static MemoryContext pgStatLocalContext = NULL;
 static HTAB *pgStatDBHash = NULL;
+static HTAB *pgStatSnapshotTabHash = NULL;
+static HTAB *pgStatSnapshotFuncHash = NULL;
 
 /* Status for backends including auxiliary */
 static LocalPgBackendStatus *localBackendStatusTable = NULL;
@@ -250,23 +313,15 @@ static LocalPgBackendStatus *localBackendStatusTable = NULL;
 static int	localNumBackends = 0;
 
 /*
- * Cluster wide statistics, kept in the stats collector.
- * Contains statistics that are not collected per database
- * or per table.
+ * Cluster wide statistics, copied from shared memory.  Contains statistics
+ * that are not collected per database or per table.
  */
 static PgStat_ArchiverStats archiverStats;
 static PgStat_GlobalStats globalStats;
-
-/*
- * List of OIDs of databases we need to write out.  If an entry is InvalidOid,
- * it means to write only the shared-catalog stats ("DB 0"); otherwise, we
- * will write both that DB's data and the shared stats.
- */
-static List *pending_write_requests = NIL;
-
-/* Signal handler flags */
-static volatile bool need_exit = false;
-static volatile bool got_SIGHUP = false;
+static PgStat_WalStats walStats;
+static bool archiverStatsValid = false;
+static bool globalStatsValid = false;
+static bool walStatsValid = false;
 
 /*
  * Total time charged to functions so far in the current backend.
@@ -280,28 +335,20 @@ static instr_time total_func_time;
  * Local function forward declarations
  * ----------
  */
-#ifdef EXEC_BACKEND
-static pid_t pgstat_forkexec(void);
-#endif
-
-NON_EXEC_STATIC void PgstatCollectorMain(int argc, char *argv[]) pg_attribute_noreturn();
-static void pgstat_exit(SIGNAL_ARGS);
+static bool pgstat_attach_shmem(void);
+static void pgstat_detach_shmem(int code, Datum arg);
+static void pgstat_shutdown_hook(int code, Datum arg);
 static void pgstat_beshutdown_hook(int code, Datum arg);
-static void pgstat_sighup_handler(SIGNAL_ARGS);
 
 static PgStat_StatDBEntry *pgstat_get_db_entry(Oid databaseid, bool create);
-static PgStat_StatTabEntry *pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry,
+static PgStat_StatTabEntry *pgstat_get_tab_entry(Oid databaseid,
 												 Oid tableoid, bool create);
-static void pgstat_write_statsfiles(bool permanent, bool allDbs);
-static void pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent);
-static HTAB *pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep);
-static void pgstat_read_db_statsfile(Oid databaseid, HTAB *tabhash, HTAB *funchash, bool permanent);
-static void backend_read_statsfile(void);
+static void pgstat_remove_db_objects(Oid databaseid);
+static void *pgstat_fetch_snapshot_entry(HTAB **snapshot, dshash_table *hash,
+										 const dshash_parameters *params,
+										 const void *key, long nelem);
 static void pgstat_read_current_status(void);
 
-static bool pgstat_write_statsfile_needed(void);
-static bool pgstat_db_requested(Oid databaseid);
-
 static void pgstat_send_tabstat(PgStat_MsgTabstat *tsmsg);
 static void pgstat_send_funcstats(void);
 static HTAB *pgstat_collect_oids(Oid catalogid, AttrNumber anum_oid);
@@ -319,7 +366,6 @@ static const char *pgstat_get_wait_io(WaitEventIO w);
 static void pgstat_setheader(PgStat_MsgHdr *hdr, StatMsgType mtype);
 static void pgstat_send(void *msg, int len);
 
-static void pgstat_recv_inquiry(PgStat_MsgInquiry *msg, int len);
 static void pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len);
 static void pgstat_recv_tabpurge(PgStat_MsgTabpurge *msg, int len);
 static void pgstat_recv_dropdb(PgStat_MsgDropdb *msg, int len);
@@ -331,6 +377,7 @@ static void pgstat_recv_vacuum(PgStat_MsgVacuum *msg, int len);
 static void pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len);
 static void pgstat_recv_archiver(PgStat_MsgArchiver *msg, int len);
 static void pgstat_recv_bgwriter(PgStat_MsgBgWriter *msg, int len);
+static void pgstat_recv_wal(PgStat_MsgWal *msg, int len);
 static void pgstat_recv_funcstat(PgStat_MsgFuncstat *msg, int len);
 static void pgstat_recv_funcpurge(PgStat_MsgFuncpurge *msg, int len);
 static void pgstat_recv_recoveryconflict(PgStat_MsgRecoveryConflict *msg, int len);
@@ -343,292 +390,148 @@ static void pgstat_recv_tempfile(PgStat_MsgTempFile *msg, int len);
  * ------------------------------------------------------------
  */
 
-/* ----------
- * pgstat_init() -
+/*
+ * StatsShmemSize
+ *		Compute space needed for the shared statistics.
+ */
+Size
+StatsShmemSize(void)
+{
+	return add_size(MAXALIGN(sizeof(StatsShmemStruct)),
+					PGSTAT_DSA_INITIAL_SIZE);
+}
+
+/*
+ * StatsShmemInit
+ *		Allocate and initialize the shared statistics.
  *
- *	Called from postmaster at startup. Create the resources required
- *	by the statistics collector process.  If unable to do so, do not
- *	fail --- better to let the postmaster start with stats collection
- *	disabled.
- * ----------
+ * The postmaster creates the DSA area in place and the hash tables in it, and
+ * then detaches again; the area is pinned, so it lives as long as the shared
+ * memory segment.  Processes attach to it on first use.
  */
 void
-pgstat_init(void)
+StatsShmemInit(void)
 {
-	ACCEPT_TYPE_ARG3 alen;
-	struct addrinfo *addrs = NULL,
-			   *addr,
-				hints;
-	int			ret;
-	fd_set		rset;
-	struct timeval tv;
-	char		test_byte;
-	int			sel_res;
-	int			tries = 0;
-
-#define TESTBYTEVAL ((char) 199)
+	bool		found;
 
-	/*
-	 * This static assertion verifies that we didn't mess up the calculations
-	 * involved in selecting maximum payload sizes for our UDP messages.
-	 * Because the only consequence of overrunning PGSTAT_MAX_MSG_SIZE would
-	 * be silent performance loss from fragmentation, it seems worth having a
-	 * compile-time cross-check that we didn't.
-	 */
 	StaticAssertStmt(sizeof(PgStat_Msg) <= PGSTAT_MAX_MSG_SIZE,
 					 "maximum stats message size exceeds PGSTAT_MAX_MSG_SIZE");
+	StaticAssertStmt(offsetof(PgStat_StatTabEntry, tableid) ==
+					 offsetof(PgStat_StatObjectKey, objectid) &&
+					 offsetof(PgStat_StatFuncEntry, functionid) ==
+					 offsetof(PgStat_StatObjectKey, objectid),
+					 "statistics entries must start with their hash key");
 
-	/*
-	 * Create the UDP socket for sending and receiving statistic messages
-	 */
-	hints.ai_flags = AI_PASSIVE;
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_DGRAM;
-	hints.ai_protocol = 0;
-	hints.ai_addrlen = 0;
-	hints.ai_addr = NULL;
-	hints.ai_canonname = NULL;
-	hints.ai_next = NULL;
-	ret = pg_getaddrinfo_all("localhost", NULL, &hints, &addrs);
-	if (ret || !addrs)
-	{
-		ereport(LOG,
-				(errmsg("could not resolve \"localhost\": %s",
-						gai_strerror(ret))));
-		goto startup_failed;
-	}
+	StatsShmem = (StatsShmemStruct *)
+		ShmemInitStruct("Statistics Data", StatsShmemSize(), &found);
 
-	/*
-	 * On some platforms, pg_getaddrinfo_all() may return multiple addresses
-	 * only one of which will actually work (eg, both IPv6 and IPv4 addresses
-	 * when kernel will reject IPv6).  Worse, the failure may occur at the
-	 * bind() or perhaps even connect() stage.  So we must loop through the
-	 * results till we find a working combination. We will generate LOG
-	 * messages, but no error, for bogus combinations.
-	 */
-	for (addr = addrs; addr; addr = addr->ai_next)
+	if (!IsUnderPostmaster)
 	{
-#ifdef HAVE_UNIX_SOCKETS
-		/* Ignore AF_UNIX sockets, if any are returned. */
-		if (addr->ai_family == AF_UNIX)
-			continue;
-#endif
+		dsa_area   *area;
+		dshash_table *dbhash;
+		dshash_table *tabhash;
+		dshash_table *funchash;
+		TimestampTz now = GetCurrentTimestamp();
 
-		if (++tries > 1)
-			ereport(LOG,
-					(errmsg("trying another address for the statistics collector")));
-
-		/*
-		 * Create the socket.
-		 */
-		if ((pgStatSock = socket(addr->ai_family, SOCK_DGRAM, 0)) == PGINVALID_SOCKET)
-		{
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not create socket for statistics collector: %m")));
-			continue;
-		}
+		Assert(!found);
 
-		/*
-		 * Bind it to a kernel assigned port on localhost and get the assigned
-		 * port via getsockname().
-		 */
-		if (bind(pgStatSock, addr->ai_addr, addr->ai_addrlen) < 0)
-		{
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not bind socket for statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+		memset(StatsShmem, 0, sizeof(StatsShmemStruct));
+		SpinLockInit(&StatsShmem->mutex);
+		StatsShmem->global_stats.stat_reset_timestamp = now;
+		StatsShmem->archiver_stats.stat_reset_timestamp = now;
+		StatsShmem->wal_stats.stat_reset_timestamp = now;
 
-		alen = sizeof(pgStatAddr);
-		if (getsockname(pgStatSock, (struct sockaddr *) &pgStatAddr, &alen) < 0)
-		{
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not get address of socket for statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+		area = dsa_create_in_place(StatsDsaPlace(), PGSTAT_DSA_INITIAL_SIZE,
+								   LWTRANCHE_STATS_DSA, NULL);
+		dsa_pin(area);
 
 		/*
-		 * Connect the socket to its own address.  This saves a few cycles by
-		 * not having to respecify the target address on every send. This also
-		 * provides a kernel-level check that only packets from this same
-		 * address will be received.
+		 * The empty hash tables fit in the in-place part; make sure that we
+		 * don't try to create DSM segments in the postmaster.
 		 */
-		if (connect(pgStatSock, (struct sockaddr *) &pgStatAddr, alen) < 0)
-		{
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not connect socket for statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+		dsa_set_size_limit(area, PGSTAT_DSA_INITIAL_SIZE);
 
-		/*
-		 * Try to send and receive a one-byte test message on the socket. This
-		 * is to catch situations where the socket can be created but will not
-		 * actually pass data (for instance, because kernel packet filtering
-		 * rules prevent it).
-		 */
-		test_byte = TESTBYTEVAL;
+		dbhash = dshash_create(area, &dsh_dbparams, NULL);
+		tabhash = dshash_create(area, &dsh_tblparams, NULL);
+		funchash = dshash_create(area, &dsh_funcparams, NULL);
 
-retry1:
-		if (send(pgStatSock, &test_byte, 1, 0) != 1)
-		{
-			if (errno == EINTR)
-				goto retry1;	/* if interrupted, just retry */
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not send test message on socket for statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+		StatsShmem->db_hash_handle = dshash_get_hash_table_handle(dbhash);
+		StatsShmem->tab_hash_handle = dshash_get_hash_table_handle(tabhash);
+		StatsShmem->func_hash_handle = dshash_get_hash_table_handle(funchash);
 
-		/*
-		 * There could possibly be a little delay before the message can be
-		 * received.  We arbitrarily allow up to half a second before deciding
-		 * it's broken.
-		 */
-		for (;;)				/* need a loop to handle EINTR */
-		{
-			FD_ZERO(&rset);
-			FD_SET(pgStatSock, &rset);
+		dsa_set_size_limit(area, (size_t) -1);
 
-			tv.tv_sec = 0;
-			tv.tv_usec = 500000;
-			sel_res = select(pgStatSock + 1, &rset, NULL, NULL, &tv);
-			if (sel_res >= 0 || errno != EINTR)
-				break;
-		}
-		if (sel_res < 0)
-		{
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("select() failed in statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
-		if (sel_res == 0 || !FD_ISSET(pgStatSock, &rset))
-		{
-			/*
-			 * This is the case we actually think is likely, so take pains to
-			 * give a specific message for it.
-			 *
-			 * errno will not be set meaningfully here, so don't use it.
-			 */
-			ereport(LOG,
-					(errcode(ERRCODE_CONNECTION_FAILURE),
-					 errmsg("test message did not get through on socket for statistics collector")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+		dshash_detach(dbhash);
+		dshash_detach(tabhash);
+		dshash_detach(funchash);
+		dsa_detach(area);
+		dsa_release_in_place(StatsDsaPlace());
+	}
+	else
+		Assert(found);
+}
 
-		test_byte++;			/* just make sure variable is changed */
+/* ----------
+ * pgstat_attach_shmem() -
+ *
+ *	Attach to the shared statistics hash tables, if not done already.
+ *	Returns false if this process can't use them, because it isn't connected
+ *	to shared memory as a full participant or is on its way out.
+ * ----------
+ */
+static bool
+pgstat_attach_shmem(void)
+{
+	MemoryContext oldcontext;
 
-retry2:
-		if (recv(pgStatSock, &test_byte, 1, 0) != 1)
-		{
-			if (errno == EINTR)
-				goto retry2;	/* if interrupted, just retry */
-			ereport(LOG,
-					(errcode_for_socket_access(),
-					 errmsg("could not receive test message on socket for statistics collector: %m")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+	if (db_stats != NULL)
+		return true;
 
-		if (test_byte != TESTBYTEVAL)	/* strictly paranoia ... */
-		{
-			ereport(LOG,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("incorrect test message transmission on socket for statistics collector")));
-			closesocket(pgStatSock);
-			pgStatSock = PGINVALID_SOCKET;
-			continue;
-		}
+	if (StatsShmem == NULL || MyProc == NULL || proc_exit_inprogress)
+		return false;
 
-		/* If we get here, we have a working socket */
-		break;
-	}
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
 
-	/* Did we find a working address? */
-	if (!addr || pgStatSock == PGINVALID_SOCKET)
-		goto startup_failed;
+	pgStatArea = dsa_attach_in_place(StatsDsaPlace(), NULL);
+	dsa_pin_mapping(pgStatArea);
 
-	/*
-	 * Set the socket to non-blocking IO.  This ensures that if the collector
-	 * falls behind, statistics messages will be discarded; backends won't
-	 * block waiting to send messages to the collector.
-	 */
-	if (!pg_set_noblock(pgStatSock))
-	{
-		ereport(LOG,
-				(errcode_for_socket_access(),
-				 errmsg("could not set statistics collector socket to nonblocking mode: %m")));
-		goto startup_failed;
-	}
+	db_stats = dshash_attach(pgStatArea, &dsh_dbparams,
+							 StatsShmem->db_hash_handle, NULL);
+	tab_stats = dshash_attach(pgStatArea, &dsh_tblparams,
+							  StatsShmem->tab_hash_handle, NULL);
+	func_stats = dshash_attach(pgStatArea, &dsh_funcparams,
+							   StatsShmem->func_hash_handle, NULL);
+
+	MemoryContextSwitchTo(oldcontext);
 
 	/*
-	 * Try to ensure that the socket's receive buffer is at least
-	 * PGSTAT_MIN_RCVBUF bytes, so that it won't easily overflow and lose
-	 * data.  Use of UDP protocol means that we are willing to lose data under
-	 * heavy load, but we don't want it to happen just because of ridiculously
-	 * small default buffer sizes (such as 8KB on older Windows versions).
+	 * Detach before dsm_backend_shutdown() unmaps the segments the area has
+	 * grown into.
 	 */
-	{
-		int			old_rcvbuf;
-		int			new_rcvbuf;
-		ACCEPT_TYPE_ARG3 rcvbufsize = sizeof(old_rcvbuf);
-
-		if (getsockopt(pgStatSock, SOL_SOCKET, SO_RCVBUF,
-					   (char *) &old_rcvbuf, &rcvbufsize) < 0)
-		{
-			elog(LOG, "getsockopt(SO_RCVBUF) failed: %m");
-			/* if we can't get existing size, always try to set it */
-			old_rcvbuf = 0;
-		}
-
-		new_rcvbuf = PGSTAT_MIN_RCVBUF;
-		if (old_rcvbuf < new_rcvbuf)
-		{
-			if (setsockopt(pgStatSock, SOL_SOCKET, SO_RCVBUF,
-						   (char *) &new_rcvbuf, sizeof(new_rcvbuf)) < 0)
-				elog(LOG, "setsockopt(SO_RCVBUF) failed: %m");
-		}
-	}
-
-	pg_freeaddrinfo_all(hints.ai_family, addrs);
+	before_shmem_exit(pgstat_detach_shmem, 0);
 
-	return;
-
-startup_failed:
-	ereport(LOG,
-			(errmsg("disabling statistics collector for lack of working socket")));
+	return true;
+}
 
-	if (addrs)
-		pg_freeaddrinfo_all(hints.ai_family, addrs);
+/*
+ * Exit hook detaching from the shared statistics
+ */
+static void
+pgstat_detach_shmem(int code, Datum arg)
+{
+	if (db_stats == NULL)
+		return;
 
-	if (pgStatSock != PGINVALID_SOCKET)
-		closesocket(pgStatSock);
-	pgStatSock = PGINVALID_SOCKET;
+	dshash_detach(db_stats);
+	dshash_detach(tab_stats);
+	dshash_detach(func_stats);
+	dsa_detach(pgStatArea);
+	dsa_release_in_place(StatsDsaPlace());
 
-	/*
-	 * Adjust GUC variables to suppress useless activity, and for debugging
-	 * purposes (seeing track_counts off is a clue that we failed here). We
-	 * use PGC_S_OVERRIDE because there is no point in trying to turn it back
-	 * on from postgresql.conf without a restart.
-	 */
-	SetConfigOption("track_counts", "off", PGC_INTERNAL, PGC_S_OVERRIDE);
+	db_stats = NULL;
+	tab_stats = NULL;
+	func_stats = NULL;
+	pgStatArea = NULL;
 }
 
 /*
@@ -648,8 +551,8 @@ pgstat_reset_remove_files(const char *directory)
 		Oid			tmp_oid;
 
 		/*
-		 * Skip directory entries that don't match the file names we write.
-		 * See get_dbstat_filename for the database-specific pattern.
+		 * Skip directory entries that don't match the file names we write,
+		 * or the per-database "db_<oid>" files of earlier releases.
 		 */
 		if (strncmp(entry->d_name, "global.", 7) == 0)
 			nchars = 7;
@@ -680,7 +583,8 @@ pgstat_reset_remove_files(const char *directory)
  * pgstat_reset_all() -
  *
  * Remove the stats files.  This is currently used only if WAL
- * recovery is needed after a crash.
+ * recovery is needed after a crash; the shared statistics start out empty
+ * then anyway.
  */
 void
 pgstat_reset_all(void)
@@ -689,110 +593,6 @@ pgstat_reset_all(void)
 	pgstat_reset_remove_files(PGSTAT_STAT_PERMANENT_DIRECTORY);
 }
 
-#ifdef EXEC_BACKEND
-
-/*
- * pgstat_forkexec() -
- *
- * Format up the arglist for, then fork and exec, statistics collector process
- */
-static pid_t
-pgstat_forkexec(void)
-{
-	char	   *av[10];
-	int			ac = 0;
-
-	av[ac++] = "postgres";
-	av[ac++] = "--forkcol";
-	av[ac++] = NULL;			/* filled in by postmaster_forkexec */
-
-	av[ac] = NULL;
-	Assert(ac < lengthof(av));
-
-	return postmaster_forkexec(ac, av);
-}
-#endif							/* EXEC_BACKEND */
-
-
-/*
- * pgstat_start() -
- *
- *	Called from postmaster at startup or after an existing collector
- *	died.  Attempt to fire up a fresh statistics collector.
- *
- *	Returns PID of child process, or 0 if fail.
- *
- *	Note: if fail, we will be called again from the postmaster main loop.
- */
-int
-pgstat_start(void)
-{
-	time_t		curtime;
-	pid_t		pgStatPid;
-
-	/*
-	 * Check that the socket is there, else pgstat_init failed and we can do
-	 * nothing useful.
-	 */
-	if (pgStatSock == PGINVALID_SOCKET)
-		return 0;
-
-	/*
-	 * Do nothing if too soon since last collector start.  This is a safety
-	 * valve to protect against continuous respawn attempts if the collector
-	 * is dying immediately at launch.  Note that since we will be re-called
-	 * from the postmaster main loop, we will get another chance later.
-	 */
-	curtime = time(NULL);
-	if ((unsigned int) (curtime - last_pgstat_start_time) <
-		(unsigned int) PGSTAT_RESTART_INTERVAL)
-		return 0;
-	last_pgstat_start_time = curtime;
-
-	/*
-	 * Okay, fork off the collector.
-	 */
-#ifdef EXEC_BACKEND
-	switch ((pgStatPid = pgstat_forkexec()))
-#else
-	switch ((pgStatPid = fork_process()))
-#endif
-	{
-		case -1:
-			ereport(LOG,
-					(errmsg("could not fork statistics collector: %m")));
-			return 0;
-
-#ifndef EXEC_BACKEND
-		case 0:
-			/* in postmaster child ... */
-			InitPostmasterChild();
-
-			/* Close the postmaster's sockets */
-			ClosePostmasterPorts(false);
-
-			/* Drop our connection to postmaster's shared memory, as well */
-			dsm_detach_all();
-			PGSharedMemoryDetach();
-
-			PgstatCollectorMain(0, NULL);
-			break;
-#endif
-
-		default:
-			return (int) pgStatPid;
-	}
-
-	/* shouldn't get here */
-	return 0;
-}
-
-void
-allow_immediate_pgstat_restart(void)
-{
-	last_pgstat_start_time = 0;
-}
-
 /* ------------------------------------------------------------
  * Public functions used by backends follow
  *------------------------------------------------------------
@@ -803,17 +603,18 @@ allow_immediate_pgstat_restart(void)
  * pgstat_report_stat() -
  *
  *	Must be called by processes that performs DML: tcop/postgres.c, logical
- *	receiver processes, SPI worker, etc. to send the so far collected
- *	per-table and function usage statistics to the collector.  Note that this
- *	is called only when not within a transaction, so it is fair to use
+ *	receiver processes, SPI worker, etc. to apply the so far collected
+ *	per-table and function usage statistics to shared memory.  Note that
+ *	this is called only when not within a transaction, so it is fair to use
  *	transaction stop time as an approximation of current time.
  * ----------
  */
 void
 pgstat_report_stat(bool force)
 {
-	/* we assume this inits to all zeroes: */
+	/* we assume these init to all zeroes: */
 	static const PgStat_TableCounts all_zeroes;
+	static const PgStat_MsgWal wal_zeroes;
 	static TimestampTz last_report = 0;
 
 	TimestampTz now;
@@ -825,7 +626,8 @@ pgstat_report_stat(bool force)
 	/* Don't expend a clock check if nothing to do */
 	if ((pgStatTabList == NULL || pgStatTabList->tsa_used == 0) &&
 		pgStatXactCommit == 0 && pgStatXactRollback == 0 &&
-		!have_function_stats)
+		!have_function_stats &&
+		memcmp(&WalStats, &wal_zeroes, sizeof(PgStat_MsgWal)) == 0)
 		return;
 
 	/*
@@ -911,6 +713,9 @@ pgstat_report_stat(bool force)
 
 	/* Now, send function statistics */
 	pgstat_send_funcstats();
+
+	/* and the WAL statistics */
+	pgstat_send_wal();
 }
 
 /*
@@ -922,10 +727,6 @@ pgstat_send_tabstat(PgStat_MsgTabstat *tsmsg)
 	int			n;
 	int			len;
 
-	/* It's unlikely we'd get here with no socket, but maybe not impossible */
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	/*
 	 * Report and reset accumulated xact commit/rollback and I/O timings
 	 * whenever we send a normal tabstat message
@@ -1016,7 +817,7 @@ pgstat_send_funcstats(void)
 /* ----------
  * pgstat_vacuum_stat() -
  *
- *	Will tell the collector about objects he can get rid of.
+ *	Will remove the statistics of objects that no longer exist.
  * ----------
  */
 void
@@ -1025,82 +826,84 @@ pgstat_vacuum_stat(void)
 	HTAB	   *htab;
 	PgStat_MsgTabpurge msg;
 	PgStat_MsgFuncpurge f_msg;
-	HASH_SEQ_STATUS hstat;
+	dshash_seq_status dstat;
 	PgStat_StatDBEntry *dbentry;
 	PgStat_StatTabEntry *tabentry;
 	PgStat_StatFuncEntry *funcentry;
+	List	   *deadobjs = NIL;
+	ListCell   *lc;
 	int			len;
 
-	if (pgStatSock == PGINVALID_SOCKET)
+	if (!pgstat_attach_shmem())
 		return;
 
-	/*
-	 * If not done for this transaction, read the statistics collector stats
-	 * file into some hash tables.
-	 */
-	backend_read_statsfile();
-
 	/*
 	 * Read pg_database and make a list of OIDs of all existing databases
 	 */
 	htab = pgstat_collect_oids(DatabaseRelationId, Anum_pg_database_oid);
 
 	/*
-	 * Search the database hash table for dead databases and tell the
-	 * collector to drop them.
+	 * Search the database hash table for dead databases.  We can't drop them
+	 * while we are scanning the hash table, so remember them for now.
 	 */
-	hash_seq_init(&hstat, pgStatDBHash);
-	while ((dbentry = (PgStat_StatDBEntry *) hash_seq_search(&hstat)) != NULL)
+	dshash_seq_init(&dstat, db_stats, false);
+	while ((dbentry = (PgStat_StatDBEntry *) dshash_seq_next(&dstat)) != NULL)
 	{
 		Oid			dbid = dbentry->databaseid;
 
-		CHECK_FOR_INTERRUPTS();
-
 		/* the DB entry for shared tables (with InvalidOid) is never dropped */
 		if (OidIsValid(dbid) &&
 			hash_search(htab, (void *) &dbid, HASH_FIND, NULL) == NULL)
-			pgstat_drop_database(dbid);
+			deadobjs = lappend_oid(deadobjs, dbid);
+	}
+	dshash_seq_term(&dstat);
+
+	foreach(lc, deadobjs)
+	{
+		CHECK_FOR_INTERRUPTS();
+		pgstat_drop_database(lfirst_oid(lc));
 	}
 
 	/* Clean up */
 	hash_destroy(htab);
+	list_free(deadobjs);
+	deadobjs = NIL;
 
 	/*
-	 * Lookup our own database entry; if not found, nothing more to do.
-	 */
-	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												 (void *) &MyDatabaseId,
-												 HASH_FIND, NULL);
-	if (dbentry == NULL || dbentry->tables == NULL)
-		return;
-
-	/*
-	 * Similarly to above, make a list of all known relations in this DB.
+	 * Similarly to above, make a list of all known relations in this DB, and
+	 * look for entries of our database whose relation is gone.
 	 */
 	htab = pgstat_collect_oids(RelationRelationId, Anum_pg_class_oid);
 
+	dshash_seq_init(&dstat, tab_stats, false);
+	while ((tabentry = (PgStat_StatTabEntry *) dshash_seq_next(&dstat)) != NULL)
+	{
+		Oid			tabid = tabentry->tableid;
+
+		if (tabentry->databaseid != MyDatabaseId)
+			continue;
+
+		if (hash_search(htab, (void *) &tabid, HASH_FIND, NULL) == NULL)
+			deadobjs = lappend_oid(deadobjs, tabid);
+	}
+	dshash_seq_term(&dstat);
+
+	/* Clean up */
+	hash_destroy(htab);
+
 	/*
 	 * Initialize our messages table counter to zero
 	 */
 	msg.m_nentries = 0;
 
-	/*
-	 * Check for all tables listed in stats hashtable if they still exist.
-	 */
-	hash_seq_init(&hstat, dbentry->tables);
-	while ((tabentry = (PgStat_StatTabEntry *) hash_seq_search(&hstat)) != NULL)
+	foreach(lc, deadobjs)
 	{
-		Oid			tabid = tabentry->tableid;
-
 		CHECK_FOR_INTERRUPTS();
 
-		if (hash_search(htab, (void *) &tabid, HASH_FIND, NULL) != NULL)
-			continue;
-
 		/*
-		 * Not there, so add this table's Oid to the message
+		 * Add this table's Oid to the message
 		 */
-		msg.m_tableid[msg.m_nentries++] = tabid;
+		msg.m_tableid[msg.m_nentries++] = lfirst_oid(lc);
 
 		/*
 		 * If the message is full, send it out and reinitialize to empty
@@ -1131,15 +934,23 @@ pgstat_vacuum_stat(void)
 		pgstat_send(&msg, len);
 	}
 
-	/* Clean up */
-	hash_destroy(htab);
+	list_free(deadobjs);
+	deadobjs = NIL;
 
 	/*
 	 * Now repeat the above steps for functions.  However, we needn't bother
-	 * in the common case where no function stats are being collected.
+	 * reading pg_proc in the common case where no function stats are being
+	 * collected, so first collect the OIDs of the functions we know about.
 	 */
-	if (dbentry->functions != NULL &&
-		hash_get_num_entries(dbentry->functions) > 0)
+	dshash_seq_init(&dstat, func_stats, false);
+	while ((funcentry = (PgStat_StatFuncEntry *) dshash_seq_next(&dstat)) != NULL)
+	{
+		if (funcentry->databaseid == MyDatabaseId)
+			deadobjs = lappend_oid(deadobjs, funcentry->functionid);
+	}
+	dshash_seq_term(&dstat);
+
+	if (deadobjs != NIL)
 	{
 		htab = pgstat_collect_oids(ProcedureRelationId, Anum_pg_proc_oid);
 
@@ -1147,10 +958,9 @@ pgstat_vacuum_stat(void)
 		f_msg.m_databaseid = MyDatabaseId;
 		f_msg.m_nentries = 0;
 
-		hash_seq_init(&hstat, dbentry->functions);
-		while ((funcentry = (PgStat_StatFuncEntry *) hash_seq_search(&hstat)) != NULL)
+		foreach(lc, deadobjs)
 		{
-			Oid			funcid = funcentry->functionid;
+			Oid			funcid = lfirst_oid(lc);
 
 			CHECK_FOR_INTERRUPTS();
 
@@ -1188,6 +998,7 @@ pgstat_vacuum_stat(void)
 		}
 
 		hash_destroy(htab);
+		list_free(deadobjs);
 	}
 }
 
@@ -1246,7 +1057,7 @@ pgstat_collect_oids(Oid catalogid, AttrNumber anum_oid)
 /* ----------
  * pgstat_drop_database() -
  *
- *	Tell the collector that we just dropped a database.
+ *	Tell the statistics system that we just dropped a database.
  *	(If the message gets lost, we will still clean the dead DB eventually
  *	via future invocations of pgstat_vacuum_stat().)
  * ----------
@@ -1256,9 +1067,6 @@ pgstat_drop_database(Oid databaseid)
 {
 	PgStat_MsgDropdb msg;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_DROPDB);
 	msg.m_databaseid = databaseid;
 	pgstat_send(&msg, sizeof(msg));
@@ -1268,7 +1076,7 @@ pgstat_drop_database(Oid databaseid)
 /* ----------
  * pgstat_drop_relation() -
  *
- *	Tell the collector that we just dropped a relation.
+ *	Tell the statistics system that we just dropped a relation.
  *	(If the message gets lost, we will still clean the dead entry eventually
  *	via future invocations of pgstat_vacuum_stat().)
  *
@@ -1283,9 +1091,6 @@ pgstat_drop_relation(Oid relid)
 	PgStat_MsgTabpurge msg;
 	int			len;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	msg.m_tableid[0] = relid;
 	msg.m_nentries = 1;
 
@@ -1301,7 +1106,7 @@ pgstat_drop_relation(Oid relid)
 /* ----------
  * pgstat_reset_counters() -
  *
- *	Tell the statistics collector to reset counters for our database.
+ *	Tell the statistics system to reset counters for our database.
  *
  *	Permission checking for this function is managed through the normal
  *	GRANT system.
@@ -1312,9 +1117,6 @@ pgstat_reset_counters(void)
 {
 	PgStat_MsgResetcounter msg;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_RESETCOUNTER);
 	msg.m_databaseid = MyDatabaseId;
 	pgstat_send(&msg, sizeof(msg));
@@ -1323,7 +1125,7 @@ pgstat_reset_counters(void)
 /* ----------
  * pgstat_reset_shared_counters() -
  *
- *	Tell the statistics collector to reset cluster-wide shared counters.
+ *	Tell the statistics system to reset cluster-wide shared counters.
  *
  *	Permission checking for this function is managed through the normal
  *	GRANT system.
@@ -1334,18 +1136,17 @@ pgstat_reset_shared_counters(const char *target)
 {
 	PgStat_MsgResetsharedcounter msg;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	if (strcmp(target, "archiver") == 0)
 		msg.m_resettarget = RESET_ARCHIVER;
 	else if (strcmp(target, "bgwriter") == 0)
 		msg.m_resettarget = RESET_BGWRITER;
+	else if (strcmp(target, "wal") == 0)
+		msg.m_resettarget = RESET_WAL;
 	else
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("unrecognized reset target: \"%s\"", target),
-				 errhint("Target must be \"archiver\" or \"bgwriter\".")));
+				 errhint("Target must be \"archiver\", \"bgwriter\" or \"wal\".")));
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_RESETSHAREDCOUNTER);
 	pgstat_send(&msg, sizeof(msg));
@@ -1354,7 +1155,7 @@ pgstat_reset_shared_counters(const char *target)
 /* ----------
  * pgstat_reset_single_counter() -
  *
- *	Tell the statistics collector to reset a single counter.
+ *	Tell the statistics system to reset a single counter.
  *
  *	Permission checking for this function is managed through the normal
  *	GRANT system.
@@ -1365,9 +1166,6 @@ pgstat_reset_single_counter(Oid objoid, PgStat_Single_Reset_Type type)
 {
 	PgStat_MsgResetsinglecounter msg;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_RESETSINGLECOUNTER);
 	msg.m_databaseid = MyDatabaseId;
 	msg.m_resettype = type;
@@ -1389,9 +1187,6 @@ pgstat_report_autovac(Oid dboid)
 {
 	PgStat_MsgAutovacStart msg;
 
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_AUTOVAC_START);
 	msg.m_databaseid = dboid;
 	msg.m_start_time = GetCurrentTimestamp();
@@ -1403,7 +1198,7 @@ pgstat_report_autovac(Oid dboid)
 /* ---------
  * pgstat_report_vacuum() -
  *
- *	Tell the collector about the table we just vacuumed.
+ *	Tell the statistics system about the table we just vacuumed.
  * ---------
  */
 void
@@ -1412,7 +1207,7 @@ pgstat_report_vacuum(Oid tableoid, bool shared,
 {
 	PgStat_MsgVacuum msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_VACUUM);
@@ -1428,7 +1223,7 @@ pgstat_report_vacuum(Oid tableoid, bool shared,
 /* --------
  * pgstat_report_analyze() -
  *
- *	Tell the collector about the table we just analyzed.
+ *	Tell the statistics system about the table we just analyzed.
  *
  * Caller must provide new live- and dead-tuples estimates, as well as a
  * flag indicating whether to reset the changes_since_analyze counter.
@@ -1441,7 +1236,7 @@ pgstat_report_analyze(Relation rel,
 {
 	PgStat_MsgAnalyze msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	/*
@@ -1449,9 +1244,9 @@ pgstat_report_analyze(Relation rel,
 	 * already inserted and/or deleted rows in the target table. ANALYZE will
 	 * have counted such rows as live or dead respectively. Because we will
 	 * report our counts of such rows at transaction end, we should subtract
-	 * off these counts from what we send to the collector now, else they'll
-	 * be double-counted after commit.  (This approach also ensures that the
-	 * collector ends up with the right numbers if we abort instead of
+	 * off these counts from what we report now, else they'll be
+	 * double-counted after commit.  (This approach also ensures that the
+	 * shared statistics end up with the right numbers if we abort instead of
 	 * committing.)
 	 */
 	if (rel->pgstat_info != NULL)
@@ -1484,7 +1279,7 @@ pgstat_report_analyze(Relation rel,
 /* --------
  * pgstat_report_recovery_conflict() -
  *
- *	Tell the collector about a Hot Standby recovery conflict.
+ *	Tell the statistics system about a Hot Standby recovery conflict.
  * --------
  */
 void
@@ -1492,7 +1287,7 @@ pgstat_report_recovery_conflict(int reason)
 {
 	PgStat_MsgRecoveryConflict msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_RECOVERYCONFLICT);
@@ -1504,7 +1299,7 @@ pgstat_report_recovery_conflict(int reason)
 /* --------
  * pgstat_report_deadlock() -
  *
- *	Tell the collector about a deadlock detected.
+ *	Tell the statistics system about a deadlock detected.
  * --------
  */
 void
@@ -1512,7 +1307,7 @@ pgstat_report_deadlock(void)
 {
 	PgStat_MsgDeadlock msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_DEADLOCK);
@@ -1525,7 +1320,7 @@ pgstat_report_deadlock(void)
 /* --------
  * pgstat_report_checksum_failures_in_db() -
  *
- *	Tell the collector about one or more checksum failures.
+ *	Tell the statistics system about one or more checksum failures.
  * --------
  */
 void
@@ -1533,7 +1328,7 @@ pgstat_report_checksum_failures_in_db(Oid dboid, int failurecount)
 {
 	PgStat_MsgChecksumFailure msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_CHECKSUMFAILURE);
@@ -1547,7 +1342,7 @@ pgstat_report_checksum_failures_in_db(Oid dboid, int failurecount)
 /* --------
  * pgstat_report_checksum_failure() -
  *
- *	Tell the collector about a checksum failure.
+ *	Tell the statistics system about a checksum failure.
  * --------
  */
 void
@@ -1559,7 +1354,7 @@ pgstat_report_checksum_failure(void)
 /* --------
  * pgstat_report_tempfile() -
  *
- *	Tell the collector about a temporary file.
+ *	Tell the statistics system about a temporary file.
  * --------
  */
 void
@@ -1567,7 +1362,7 @@ pgstat_report_tempfile(size_t filesize)
 {
 	PgStat_MsgTempFile msg;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_TEMPFILE);
@@ -1577,60 +1372,23 @@ pgstat_report_tempfile(size_t filesize)
 }
 
 
-/* ----------
- * pgstat_ping() -
- *
- *	Send some junk data to the collector to increase traffic.
- * ----------
+/*
+ * Initialize function call usage data.
+ * Called by the executor before invoking a function.
  */
 void
-pgstat_ping(void)
+pgstat_init_function_usage(FunctionCallInfo fcinfo,
+						   PgStat_FunctionCallUsage *fcu)
 {
-	PgStat_MsgDummy msg;
+	PgStat_BackendFunctionEntry *htabent;
+	bool		found;
 
-	if (pgStatSock == PGINVALID_SOCKET)
+	if (pgstat_track_functions <= fcinfo->flinfo->fn_stats)
+	{
+		/* stats not wanted */
+		fcu->fs = NULL;
 		return;
-
-	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_DUMMY);
-	pgstat_send(&msg, sizeof(msg));
-}
-
-/* ----------
- * pgstat_send_inquiry() -
- *
- *	Notify collector that we need fresh data.
- * ----------
- */
-static void
-pgstat_send_inquiry(TimestampTz clock_time, TimestampTz cutoff_time, Oid databaseid)
-{
-	PgStat_MsgInquiry msg;
-
-	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_INQUIRY);
-	msg.clock_time = clock_time;
-	msg.cutoff_time = cutoff_time;
-	msg.databaseid = databaseid;
-	pgstat_send(&msg, sizeof(msg));
-}
-
-
-/*
- * Initialize function call usage data.
- * Called by the executor before invoking a function.
- */
-void
-pgstat_init_function_usage(FunctionCallInfo fcinfo,
-						   PgStat_FunctionCallUsage *fcu)
-{
-	PgStat_BackendFunctionEntry *htabent;
-	bool		found;
-
-	if (pgstat_track_functions <= fcinfo->flinfo->fn_stats)
-	{
-		/* stats not wanted */
-		fcu->fs = NULL;
-		return;
-	}
+	}
 
 	if (!pgStatFunctions)
 	{
@@ -1764,7 +1522,7 @@ pgstat_initstats(Relation rel)
 		return;
 	}
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 	{
 		/* We're not counting at all */
 		rel->pgstat_info = NULL;
@@ -2320,7 +2078,7 @@ AtPrepare_PgStat(void)
  *
  * All we need do here is unlink the transaction stats state from the
  * nontransactional state.  The nontransactional action counts will be
- * reported to the stats collector immediately, while the effects on live
+ * reported to the statistics system immediately, while the effects on live
  * and dead tuple counts are preserved in the 2PC state file.
  *
  * Note: AtEOXact_PgStat is not called during PREPARE.
@@ -2424,25 +2182,19 @@ pgstat_twophase_postabort(TransactionId xid, uint16 info,
  *
  *	Support function for the SQL-callable pgstat* functions. Returns
  *	the collected statistics for one database or NULL. NULL doesn't mean
- *	that the database doesn't exist, it is just not yet known by the
- *	collector, so the caller is better off to report ZERO instead.
+ *	that the database doesn't exist, it is just not yet known to the
+ *	statistics, so the caller is better off to report ZERO instead.
  * ----------
  */
 PgStat_StatDBEntry *
 pgstat_fetch_stat_dbentry(Oid dbid)
 {
-	/*
-	 * If not done for this transaction, read the statistics collector stats
-	 * file into some hash tables.
-	 */
-	backend_read_statsfile();
+	if (!pgstat_attach_shmem())
+		return NULL;
 
-	/*
-	 * Lookup the requested database; return NULL if not found
-	 */
-	return (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-											  (void *) &dbid,
-											  HASH_FIND, NULL);
+	return (PgStat_StatDBEntry *)
+		pgstat_fetch_snapshot_entry(&pgStatDBHash, db_stats, &dsh_dbparams,
+									&dbid, PGSTAT_DB_HASH_SIZE);
 }
 
 
@@ -2451,56 +2203,49 @@ pgstat_fetch_stat_dbentry(Oid dbid)
  *
  *	Support function for the SQL-callable pgstat* functions. Returns
  *	the collected statistics for one table or NULL. NULL doesn't mean
- *	that the table doesn't exist, it is just not yet known by the
- *	collector, so the caller is better off to report ZERO instead.
+ *	that the table doesn't exist, it is just not yet known to the
+ *	statistics, so the caller is better off to report ZERO instead.
  * ----------
  */
 PgStat_StatTabEntry *
 pgstat_fetch_stat_tabentry(Oid relid)
 {
-	Oid			dbid;
-	PgStat_StatDBEntry *dbentry;
 	PgStat_StatTabEntry *tabentry;
 
 	/*
-	 * If not done for this transaction, read the statistics collector stats
-	 * file into some hash tables.
+	 * Look in our database first; if we didn't find it there, maybe it's a
+	 * shared table.
 	 */
-	backend_read_statsfile();
+	tabentry = pgstat_fetch_stat_tabentry_extended(false, relid);
+	if (tabentry == NULL)
+		tabentry = pgstat_fetch_stat_tabentry_extended(true, relid);
 
-	/*
-	 * Lookup our database, then look in its table hash table.
-	 */
-	dbid = MyDatabaseId;
-	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												 (void *) &dbid,
-												 HASH_FIND, NULL);
-	if (dbentry != NULL && dbentry->tables != NULL)
-	{
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													   (void *) &relid,
-													   HASH_FIND, NULL);
-		if (tabentry)
-			return tabentry;
-	}
+	return tabentry;
+}
 
-	/*
-	 * If we didn't find it, maybe it's a shared table.
-	 */
-	dbid = InvalidOid;
-	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												 (void *) &dbid,
-												 HASH_FIND, NULL);
-	if (dbentry != NULL && dbentry->tables != NULL)
-	{
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													   (void *) &relid,
-													   HASH_FIND, NULL);
-		if (tabentry)
-			return tabentry;
-	}
 
-	return NULL;
+/* ----------
+ * pgstat_fetch_stat_tabentry_extended() -
+ *
+ *	Like pgstat_fetch_stat_tabentry(), but looks only among the shared
+ *	catalogs or only among the tables of our own database, as requested.
+ * ----------
+ */
+PgStat_StatTabEntry *
+pgstat_fetch_stat_tabentry_extended(bool shared, Oid relid)
+{
+	PgStat_StatObjectKey key;
+
+	if (!pgstat_attach_shmem())
+		return NULL;
+
+	key.databaseid = shared ? InvalidOid : MyDatabaseId;
+	key.objectid = relid;
+
+	return (PgStat_StatTabEntry *)
+		pgstat_fetch_snapshot_entry(&pgStatSnapshotTabHash, tab_stats,
+									&dsh_tblparams, &key,
+									PGSTAT_TAB_HASH_SIZE);
 }
 
 
@@ -2514,22 +2259,18 @@ pgstat_fetch_stat_tabentry(Oid relid)
 PgStat_StatFuncEntry *
 pgstat_fetch_stat_funcentry(Oid func_id)
 {
-	PgStat_StatDBEntry *dbentry;
-	PgStat_StatFuncEntry *funcentry = NULL;
+	PgStat_StatObjectKey key;
 
-	/* load the stats file if needed */
-	backend_read_statsfile();
+	if (!pgstat_attach_shmem())
+		return NULL;
 
-	/* Lookup our database, then find the requested function.  */
-	dbentry = pgstat_fetch_stat_dbentry(MyDatabaseId);
-	if (dbentry != NULL && dbentry->functions != NULL)
-	{
-		funcentry = (PgStat_StatFuncEntry *) hash_search(dbentry->functions,
-														 (void *) &func_id,
-														 HASH_FIND, NULL);
-	}
+	key.databaseid = MyDatabaseId;
+	key.objectid = func_id;
 
-	return funcentry;
+	return (PgStat_StatFuncEntry *)
+		pgstat_fetch_snapshot_entry(&pgStatSnapshotFuncHash, func_stats,
+									&dsh_funcparams, &key,
+									PGSTAT_FUNCTION_HASH_SIZE);
 }
 
 
@@ -2603,7 +2344,15 @@ pgstat_fetch_stat_numbackends(void)
 PgStat_ArchiverStats *
 pgstat_fetch_stat_archiver(void)
 {
-	backend_read_statsfile();
+	if (!archiverStatsValid && StatsShmem != NULL)
+	{
+		SpinLockAcquire(&StatsShmem->mutex);
+		memcpy(&archiverStats, &StatsShmem->archiver_stats,
+			   sizeof(PgStat_ArchiverStats));
+		SpinLockRelease(&StatsShmem->mutex);
+
+		archiverStatsValid = true;
+	}
 
 	return &archiverStats;
 }
@@ -2620,12 +2369,45 @@ pgstat_fetch_stat_archiver(void)
 PgStat_GlobalStats *
 pgstat_fetch_global(void)
 {
-	backend_read_statsfile();
+	if (!globalStatsValid && StatsShmem != NULL)
+	{
+		SpinLockAcquire(&StatsShmem->mutex);
+		memcpy(&globalStats, &StatsShmem->global_stats,
+			   sizeof(PgStat_GlobalStats));
+		SpinLockRelease(&StatsShmem->mutex);
+
+		globalStats.stats_timestamp = GetCurrentTimestamp();
+		globalStatsValid = true;
+	}
 
 	return &globalStats;
 }
 
 
+/*
+ * ---------
+ * pgstat_fetch_stat_wal() -
+ *
+ *	Support function for the SQL-callable pgstat* functions. Returns
+ *	a pointer to the WAL statistics struct.
+ * ---------
+ */
+PgStat_WalStats *
+pgstat_fetch_stat_wal(void)
+{
+	if (!walStatsValid && StatsShmem != NULL)
+	{
+		SpinLockAcquire(&StatsShmem->mutex);
+		memcpy(&walStats, &StatsShmem->wal_stats, sizeof(PgStat_WalStats));
+		SpinLockRelease(&StatsShmem->mutex);
+
+		walStatsValid = true;
+	}
+
+	return &walStats;
+}
+
+
 /* ------------------------------------------------------------
  * Functions for management of the shared-memory PgBackendStatus array
  * ------------------------------------------------------------
@@ -2836,7 +2618,14 @@ pgstat_initialize(void)
 		MyBEEntry = &BackendStatusArray[MaxBackends + MyAuxProcType];
 	}
 
-	/* Set up a process-exit hook to clean up */
+	/*
+	 * Attach to the shared statistics now, so that the detach hook runs only
+	 * after pgstat_shutdown_hook has flushed our final counts.
+	 */
+	(void) pgstat_attach_shmem();
+
+	/* Set up process-exit hooks to clean up */
+	before_shmem_exit(pgstat_shutdown_hook, 0);
 	on_shmem_exit(pgstat_beshutdown_hook, 0);
 }
 
@@ -3073,25 +2862,33 @@ pgstat_bestart(void)
 /*
  * Shut down a single backend's statistics reporting at process exit.
  *
- * Flush any remaining statistics counts out to the collector.
+ * Flush any remaining statistics counts out to shared memory.
  * Without this, operations triggered during backend exit (such as
- * temp table deletions) won't be counted.
- *
- * Lastly, clear out our entry in the PgBackendStatus array.
+ * temp table deletions) won't be counted.  This has to happen before
+ * dsm_backend_shutdown() detaches the segments of the statistics area.
  */
 static void
-pgstat_beshutdown_hook(int code, Datum arg)
+pgstat_shutdown_hook(int code, Datum arg)
 {
-	volatile PgBackendStatus *beentry = MyBEEntry;
-
 	/*
 	 * If we got as far as discovering our own database ID, we can report what
-	 * we did to the collector.  Otherwise, we'd be sending an invalid
-	 * database ID, so forget it.  (This means that accesses to pg_database
-	 * during failed backend starts might never get counted.)
+	 * we did.  Otherwise, we'd be reporting an invalid database ID, so forget
+	 * it.  (This means that accesses to pg_database during failed backend
+	 * starts might never get counted.)
 	 */
 	if (OidIsValid(MyDatabaseId))
 		pgstat_report_stat(true);
+}
+
+/*
+ * Shut down a single backend's status reporting at process exit.
+ *
+ * Clear out our entry in the PgBackendStatus array.
+ */
+static void
+pgstat_beshutdown_hook(int code, Datum arg)
+{
+	volatile PgBackendStatus *beentry = MyBEEntry;
 
 	/*
 	 * Clear my status entry, following the protocol of bumping st_changecount
@@ -3363,7 +3160,6 @@ pgstat_read_current_status(void)
 #endif
 	int			i;
 
-	Assert(!pgStatRunningInCollector);
 	if (localBackendStatusTable)
 		return;					/* already done */
 
@@ -3652,14 +3448,17 @@ pgstat_get_wait_activity(WaitEventActivity w)
 		case WAIT_EVENT_CHECKPOINTER_MAIN:
 			event_name = "CheckpointerMain";
 			break;
+		case WAIT_EVENT_IO_WORKER_MAIN:
+			event_name = "IoWorkerMain";
+			break;
 		case WAIT_EVENT_LOGICAL_APPLY_MAIN:
 			event_name = "LogicalApplyMain";
 			break;
 		case WAIT_EVENT_LOGICAL_LAUNCHER_MAIN:
 			event_name = "LogicalLauncherMain";
 			break;
-		case WAIT_EVENT_PGSTAT_MAIN:
-			event_name = "PgStatMain";
+		case WAIT_EVENT_LOGICAL_PARALLEL_APPLY_MAIN:
+			event_name = "LogicalParallelApplyMain";
 			break;
 		case WAIT_EVENT_RECOVERY_WAL_ALL:
 			event_name = "RecoveryWalAll";
@@ -3676,6 +3475,9 @@ pgstat_get_wait_activity(WaitEventActivity w)
 		case WAIT_EVENT_WAL_SENDER_MAIN:
 			event_name = "WalSenderMain";
 			break;
+		case WAIT_EVENT_WAL_SUMMARIZER_MAIN:
+			event_name = "WalSummarizerMain";
+			break;
 		case WAIT_EVENT_WAL_WRITER_MAIN:
 			event_name = "WalWriterMain";
 			break;
@@ -3744,6 +3546,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 
 	switch (w)
 	{
+		case WAIT_EVENT_AIO_COMPLETION:
+			event_name = "AioCompletion";
+			break;
 		case WAIT_EVENT_BGWORKER_SHUTDOWN:
 			event_name = "BgWorkerShutdown";
 			break;
@@ -3765,6 +3570,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_EXECUTE_GATHER:
 			event_name = "ExecuteGather";
 			break;
+		case WAIT_EVENT_HASHAGG_PARTITIONING:
+			event_name = "HashAgg/Partitioning";
+			break;
 		case WAIT_EVENT_HASH_BATCH_ALLOCATING:
 			event_name = "Hash/Batch/Allocating";
 			break;
@@ -3810,6 +3618,12 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_HASH_GROW_BUCKETS_REINSERTING:
 			event_name = "Hash/GrowBuckets/Reinserting";
 			break;
+		case WAIT_EVENT_LOGICAL_PARALLEL_APPLY_COMMIT_TURN:
+			event_name = "LogicalParallelApplyCommitTurn";
+			break;
+		case WAIT_EVENT_LOGICAL_PARALLEL_APPLY_WAIT:
+			event_name = "LogicalParallelApplyWait";
+			break;
 		case WAIT_EVENT_LOGICAL_SYNC_DATA:
 			event_name = "LogicalSyncData";
 			break;
@@ -3831,6 +3645,12 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_PARALLEL_BITMAP_SCAN:
 			event_name = "ParallelBitmapScan";
 			break;
+		case WAIT_EVENT_PARALLEL_COPY_CHUNK_FREE:
+			event_name = "ParallelCopyChunkFree";
+			break;
+		case WAIT_EVENT_PARALLEL_COPY_CHUNK_READY:
+			event_name = "ParallelCopyChunkReady";
+			break;
 		case WAIT_EVENT_PARALLEL_CREATE_INDEX_SCAN:
 			event_name = "ParallelCreateIndexScan";
 			break;
@@ -3855,6 +3675,9 @@ pgstat_get_wait_ipc(WaitEventIPC w)
 		case WAIT_EVENT_SYNC_REP:
 			event_name = "SyncRep";
 			break;
+		case WAIT_EVENT_WAL_SUMMARY_READY:
+			event_name = "WalSummaryReady";
+			break;
 			/* no default case, so that compiler will warn */
 	}
 
@@ -3908,6 +3731,9 @@ pgstat_get_wait_io(WaitEventIO w)
 		case WAIT_EVENT_BUFFILE_WRITE:
 			event_name = "BufFileWrite";
 			break;
+		case WAIT_EVENT_BUFFILE_TRUNCATE:
+			event_name = "BufFileTruncate";
+			break;
 		case WAIT_EVENT_CONTROL_FILE_READ:
 			event_name = "ControlFileRead";
 			break;
@@ -4103,6 +3929,15 @@ pgstat_get_wait_io(WaitEventIO w)
 		case WAIT_EVENT_WAL_SYNC_METHOD_ASSIGN:
 			event_name = "WALSyncMethodAssign";
 			break;
+		case WAIT_EVENT_WAL_SUMMARY_READ:
+			event_name = "WALSummaryRead";
+			break;
+		case WAIT_EVENT_WAL_SUMMARY_SYNC:
+			event_name = "WALSummarySync";
+			break;
+		case WAIT_EVENT_WAL_SUMMARY_WRITE:
+			event_name = "WALSummaryWrite";
+			break;
 		case WAIT_EVENT_WAL_WRITE:
 			event_name = "WALWrite";
 			break;
@@ -4334,36 +4169,116 @@ pgstat_setheader(PgStat_MsgHdr *hdr, StatMsgType mtype)
 /* ----------
  * pgstat_send() -
  *
- *		Send out one statistics message to the collector
+ *		Apply one statistics message to the shared statistics
  * ----------
  */
 static void
 pgstat_send(void *msg, int len)
 {
-	int			rc;
+	PgStat_Msg *m = (PgStat_Msg *) msg;
+
+	if (StatsShmem == NULL)
+		return;
 
-	if (pgStatSock == PGINVALID_SOCKET)
+	/*
+	 * Archiver, bgwriter and WAL statistics live in the fixed part of the
+	 * shared memory, which needs no attaching.  Everything else needs the
+	 * hash tables.
+	 */
+	if (m->msg_hdr.m_type != PGSTAT_MTYPE_ARCHIVER &&
+		m->msg_hdr.m_type != PGSTAT_MTYPE_BGWRITER &&
+		m->msg_hdr.m_type != PGSTAT_MTYPE_WAL &&
+		m->msg_hdr.m_type != PGSTAT_MTYPE_RESETSHAREDCOUNTER &&
+		!pgstat_attach_shmem())
 		return;
 
-	((PgStat_MsgHdr *) msg)->m_size = len;
+	m->msg_hdr.m_size = len;
 
-	/* We'll retry after EINTR, but ignore all other failures */
-	do
+	switch (m->msg_hdr.m_type)
 	{
-		rc = send(pgStatSock, msg, len, 0);
-	} while (rc < 0 && errno == EINTR);
+		case PGSTAT_MTYPE_TABSTAT:
+			pgstat_recv_tabstat(&m->msg_tabstat, len);
+			break;
 
-#ifdef USE_ASSERT_CHECKING
-	/* In debug builds, log send failures ... */
-	if (rc < 0)
-		elog(LOG, "could not send to statistics collector: %m");
-#endif
+		case PGSTAT_MTYPE_TABPURGE:
+			pgstat_recv_tabpurge(&m->msg_tabpurge, len);
+			break;
+
+		case PGSTAT_MTYPE_DROPDB:
+			pgstat_recv_dropdb(&m->msg_dropdb, len);
+			break;
+
+		case PGSTAT_MTYPE_RESETCOUNTER:
+			pgstat_recv_resetcounter(&m->msg_resetcounter, len);
+			break;
+
+		case PGSTAT_MTYPE_RESETSHAREDCOUNTER:
+			pgstat_recv_resetsharedcounter(&m->msg_resetsharedcounter, len);
+			break;
+
+		case PGSTAT_MTYPE_RESETSINGLECOUNTER:
+			pgstat_recv_resetsinglecounter(&m->msg_resetsinglecounter, len);
+			break;
+
+		case PGSTAT_MTYPE_AUTOVAC_START:
+			pgstat_recv_autovac(&m->msg_autovacuum_start, len);
+			break;
+
+		case PGSTAT_MTYPE_VACUUM:
+			pgstat_recv_vacuum(&m->msg_vacuum, len);
+			break;
+
+		case PGSTAT_MTYPE_ANALYZE:
+			pgstat_recv_analyze(&m->msg_analyze, len);
+			break;
+
+		case PGSTAT_MTYPE_ARCHIVER:
+			pgstat_recv_archiver(&m->msg_archiver, len);
+			break;
+
+		case PGSTAT_MTYPE_BGWRITER:
+			pgstat_recv_bgwriter(&m->msg_bgwriter, len);
+			break;
+
+		case PGSTAT_MTYPE_WAL:
+			pgstat_recv_wal(&m->msg_wal, len);
+			break;
+
+		case PGSTAT_MTYPE_FUNCSTAT:
+			pgstat_recv_funcstat(&m->msg_funcstat, len);
+			break;
+
+		case PGSTAT_MTYPE_FUNCPURGE:
+			pgstat_recv_funcpurge(&m->msg_funcpurge, len);
+			break;
+
+		case PGSTAT_MTYPE_RECOVERYCONFLICT:
+			pgstat_recv_recoveryconflict(&m->msg_recoveryconflict, len);
+			break;
+
+		case PGSTAT_MTYPE_DEADLOCK:
+			pgstat_recv_deadlock(&m->msg_deadlock, len);
+			break;
+
+		case PGSTAT_MTYPE_TEMPFILE:
+			pgstat_recv_tempfile(&m->msg_tempfile, len);
+			break;
+
+		case PGSTAT_MTYPE_CHECKSUMFAILURE:
+			pgstat_recv_checksum_failure(&m->msg_checksumfailure, len);
+			break;
+
+		default:
+			elog(ERROR, "unrecognized statistics message type: %d",
+				 (int) m->msg_hdr.m_type);
+			break;
+	}
 }
 
 /* ----------
  * pgstat_send_archiver() -
  *
- *	Tell the collector about the WAL file that we successfully
+ *	Tell the statistics system about the WAL file that we successfully
  *	archived or failed to archive.
  * ----------
  */
@@ -4385,7 +4300,7 @@ pgstat_send_archiver(const char *xlog, bool failed)
 /* ----------
  * pgstat_send_bgwriter() -
  *
- *		Send bgwriter statistics to the collector
+ *		Send bgwriter statistics to the statistics system
  * ----------
  */
 void
@@ -4396,8 +4311,7 @@ pgstat_send_bgwriter(void)
 
 	/*
 	 * This function can be called even if nothing at all has happened. In
-	 * this case, avoid sending a completely empty message to the stats
-	 * collector.
+	 * this case, avoid applying a completely empty message.
 	 */
 	if (memcmp(&BgWriterStats, &all_zeroes, sizeof(PgStat_MsgBgWriter)) == 0)
 		return;
@@ -4414,307 +4328,47 @@ pgstat_send_bgwriter(void)
 	MemSet(&BgWriterStats, 0, sizeof(BgWriterStats));
 }
 
-
 /* ----------
- * PgstatCollectorMain() -
+ * pgstat_send_wal() -
  *
- *	Start up the statistics collector process.  This is the body of the
- *	postmaster child process.
+ *		Send WAL statistics to the statistics system
  *
- *	The argc/argv parameters are valid only in EXEC_BACKEND case.
+ *	Backends call this from pgstat_report_stat(); the checkpointer, the
+ *	background writer and the WAL writer call it directly.
  * ----------
  */
-NON_EXEC_STATIC void
-PgstatCollectorMain(int argc, char *argv[])
+void
+pgstat_send_wal(void)
 {
-	int			len;
-	PgStat_Msg	msg;
-	int			wr;
-
-	/*
-	 * Ignore all signals usually bound to some action in the postmaster,
-	 * except SIGHUP and SIGQUIT.  Note we don't need a SIGUSR1 handler to
-	 * support latch operations, because we only use a local latch.
-	 */
-	pqsignal(SIGHUP, pgstat_sighup_handler);
-	pqsignal(SIGINT, SIG_IGN);
-	pqsignal(SIGTERM, SIG_IGN);
-	pqsignal(SIGQUIT, pgstat_exit);
-	pqsignal(SIGALRM, SIG_IGN);
-	pqsignal(SIGPIPE, SIG_IGN);
-	pqsignal(SIGUSR1, SIG_IGN);
-	pqsignal(SIGUSR2, SIG_IGN);
-	/* Reset some signals that are accepted by postmaster but not here */
-	pqsignal(SIGCHLD, SIG_DFL);
-	PG_SETMASK(&UnBlockSig);
-
-	/*
-	 * Identify myself via ps
-	 */
-	init_ps_display("stats collector", "", "", "");
+	/* We assume this initializes to zeroes */
+	static const PgStat_MsgWal all_zeroes;
 
 	/*
-	 * Read in existing stats files or initialize the stats to zero.
+	 * This function can be called even if nothing at all has happened. In
+	 * this case, avoid applying a completely empty message.
 	 */
-	pgStatRunningInCollector = true;
-	pgStatDBHash = pgstat_read_statsfiles(InvalidOid, true, true);
+	if (memcmp(&WalStats, &all_zeroes, sizeof(PgStat_MsgWal)) == 0)
+		return;
 
 	/*
-	 * Loop to process messages until we get SIGQUIT or detect ungraceful
-	 * death of our parent postmaster.
-	 *
-	 * For performance reasons, we don't want to do ResetLatch/WaitLatch after
-	 * every message; instead, do that only after a recv() fails to obtain a
-	 * message.  (This effectively means that if backends are sending us stuff
-	 * like mad, we won't notice postmaster death until things slack off a
-	 * bit; which seems fine.)	To do that, we have an inner loop that
-	 * iterates as long as recv() succeeds.  We do recognize got_SIGHUP inside
-	 * the inner loop, which means that such interrupts will get serviced but
-	 * the latch won't get cleared until next time there is a break in the
-	 * action.
+	 * Prepare and send the message
 	 */
-	for (;;)
-	{
-		/* Clear any already-pending wakeups */
-		ResetLatch(MyLatch);
-
-		/*
-		 * Quit if we get SIGQUIT from the postmaster.
-		 */
-		if (need_exit)
-			break;
-
-		/*
-		 * Inner loop iterates as long as we keep getting messages, or until
-		 * need_exit becomes set.
-		 */
-		while (!need_exit)
-		{
-			/*
-			 * Reload configuration if we got SIGHUP from the postmaster.
-			 */
-			if (got_SIGHUP)
-			{
-				got_SIGHUP = false;
-				ProcessConfigFile(PGC_SIGHUP);
-			}
-
-			/*
-			 * Write the stats file(s) if a new request has arrived that is
-			 * not satisfied by existing file(s).
-			 */
-			if (pgstat_write_statsfile_needed())
-				pgstat_write_statsfiles(false, false);
-
-			/*
-			 * Try to receive and process a message.  This will not block,
-			 * since the socket is set to non-blocking mode.
-			 *
-			 * XXX On Windows, we have to force pgwin32_recv to cooperate,
-			 * despite the previous use of pg_set_noblock() on the socket.
-			 * This is extremely broken and should be fixed someday.
-			 */
-#ifdef WIN32
-			pgwin32_noblock = 1;
-#endif
-
-			len = recv(pgStatSock, (char *) &msg,
-					   sizeof(PgStat_Msg), 0);
-
-#ifdef WIN32
-			pgwin32_noblock = 0;
-#endif
-
-			if (len < 0)
-			{
-				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
-					break;		/* out of inner loop */
-				ereport(ERROR,
-						(errcode_for_socket_access(),
-						 errmsg("could not read statistics message: %m")));
-			}
-
-			/*
-			 * We ignore messages that are smaller than our common header
-			 */
-			if (len < sizeof(PgStat_MsgHdr))
-				continue;
-
-			/*
-			 * The received length must match the length in the header
-			 */
-			if (msg.msg_hdr.m_size != len)
-				continue;
-
-			/*
-			 * O.K. - we accept this message.  Process it.
-			 */
-			switch (msg.msg_hdr.m_type)
-			{
-				case PGSTAT_MTYPE_DUMMY:
-					break;
-
-				case PGSTAT_MTYPE_INQUIRY:
-					pgstat_recv_inquiry(&msg.msg_inquiry, len);
-					break;
-
-				case PGSTAT_MTYPE_TABSTAT:
-					pgstat_recv_tabstat(&msg.msg_tabstat, len);
-					break;
-
-				case PGSTAT_MTYPE_TABPURGE:
-					pgstat_recv_tabpurge(&msg.msg_tabpurge, len);
-					break;
-
-				case PGSTAT_MTYPE_DROPDB:
-					pgstat_recv_dropdb(&msg.msg_dropdb, len);
-					break;
-
-				case PGSTAT_MTYPE_RESETCOUNTER:
-					pgstat_recv_resetcounter(&msg.msg_resetcounter, len);
-					break;
-
-				case PGSTAT_MTYPE_RESETSHAREDCOUNTER:
-					pgstat_recv_resetsharedcounter(
-												   &msg.msg_resetsharedcounter,
-												   len);
-					break;
-
-				case PGSTAT_MTYPE_RESETSINGLECOUNTER:
-					pgstat_recv_resetsinglecounter(
-												   &msg.msg_resetsinglecounter,
-												   len);
-					break;
-
-				case PGSTAT_MTYPE_AUTOVAC_START:
-					pgstat_recv_autovac(&msg.msg_autovacuum_start, len);
-					break;
-
-				case PGSTAT_MTYPE_VACUUM:
-					pgstat_recv_vacuum(&msg.msg_vacuum, len);
-					break;
-
-				case PGSTAT_MTYPE_ANALYZE:
-					pgstat_recv_analyze(&msg.msg_analyze, len);
-					break;
-
-				case PGSTAT_MTYPE_ARCHIVER:
-					pgstat_recv_archiver(&msg.msg_archiver, len);
-					break;
-
-				case PGSTAT_MTYPE_BGWRITER:
-					pgstat_recv_bgwriter(&msg.msg_bgwriter, len);
-					break;
-
-				case PGSTAT_MTYPE_FUNCSTAT:
-					pgstat_recv_funcstat(&msg.msg_funcstat, len);
-					break;
-
-				case PGSTAT_MTYPE_FUNCPURGE:
-					pgstat_recv_funcpurge(&msg.msg_funcpurge, len);
-					break;
-
-				case PGSTAT_MTYPE_RECOVERYCONFLICT:
-					pgstat_recv_recoveryconflict(
-												 &msg.msg_recoveryconflict,
-												 len);
-					break;
-
-				case PGSTAT_MTYPE_DEADLOCK:
-					pgstat_recv_deadlock(&msg.msg_deadlock, len);
-					break;
-
-				case PGSTAT_MTYPE_TEMPFILE:
-					pgstat_recv_tempfile(&msg.msg_tempfile, len);
-					break;
-
-				case PGSTAT_MTYPE_CHECKSUMFAILURE:
-					pgstat_recv_checksum_failure(
-												 &msg.msg_checksumfailure,
-												 len);
-					break;
-
-				default:
-					break;
-			}
-		}						/* end of inner message-processing loop */
-
-		/* Sleep until there's something to do */
-#ifndef WIN32
-		wr = WaitLatchOrSocket(MyLatch,
-							   WL_LATCH_SET | WL_POSTMASTER_DEATH | WL_SOCKET_READABLE,
-							   pgStatSock, -1L,
-							   WAIT_EVENT_PGSTAT_MAIN);
-#else
-
-		/*
-		 * Windows, at least in its Windows Server 2003 R2 incarnation,
-		 * sometimes loses FD_READ events.  Waking up and retrying the recv()
-		 * fixes that, so don't sleep indefinitely.  This is a crock of the
-		 * first water, but until somebody wants to debug exactly what's
-		 * happening there, this is the best we can do.  The two-second
-		 * timeout matches our pre-9.2 behavior, and needs to be short enough
-		 * to not provoke "using stale statistics" complaints from
-		 * backend_read_statsfile.
-		 */
-		wr = WaitLatchOrSocket(MyLatch,
-							   WL_LATCH_SET | WL_POSTMASTER_DEATH | WL_SOCKET_READABLE | WL_TIMEOUT,
-							   pgStatSock,
-							   2 * 1000L /* msec */ ,
-							   WAIT_EVENT_PGSTAT_MAIN);
-#endif
-
-		/*
-		 * Emergency bailout if postmaster has died.  This is to avoid the
-		 * necessity for manual cleanup of all postmaster children.
-		 */
-		if (wr & WL_POSTMASTER_DEATH)
-			break;
-	}							/* end of outer loop */
+	pgstat_setheader(&WalStats.m_hdr, PGSTAT_MTYPE_WAL);
+	pgstat_send(&WalStats, sizeof(WalStats));
 
 	/*
-	 * Save the final stats to reuse at next startup.
+	 * Clear out the statistics buffer, so it can be re-used.
 	 */
-	pgstat_write_statsfiles(true, true);
-
-	exit(0);
-}
-
-
-/* SIGQUIT signal handler for collector process */
-static void
-pgstat_exit(SIGNAL_ARGS)
-{
-	int			save_errno = errno;
-
-	need_exit = true;
-	SetLatch(MyLatch);
-
-	errno = save_errno;
+	MemSet(&WalStats, 0, sizeof(WalStats));
 }
 
-/* SIGHUP handler for collector process */
-static void
-pgstat_sighup_handler(SIGNAL_ARGS)
-{
-	int			save_errno = errno;
-
-	got_SIGHUP = true;
-	SetLatch(MyLatch);
-
-	errno = save_errno;
-}
 
 /*
  * Subroutine to clear stats in a database entry
- *
- * Tables and functions hashes are initialized to empty.
  */
 static void
 reset_dbentry_counters(PgStat_StatDBEntry *dbentry)
 {
-	HASHCTL		hash_ctl;
-
 	dbentry->n_xact_commit = 0;
 	dbentry->n_xact_rollback = 0;
 	dbentry->n_blocks_fetched = 0;
@@ -4739,48 +4393,30 @@ reset_dbentry_counters(PgStat_StatDBEntry *dbentry)
 	dbentry->n_block_write_time = 0;
 
 	dbentry->stat_reset_timestamp = GetCurrentTimestamp();
-	dbentry->stats_timestamp = 0;
-
-	memset(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(Oid);
-	hash_ctl.entrysize = sizeof(PgStat_StatTabEntry);
-	dbentry->tables = hash_create("Per-database table",
-								  PGSTAT_TAB_HASH_SIZE,
-								  &hash_ctl,
-								  HASH_ELEM | HASH_BLOBS);
-
-	hash_ctl.keysize = sizeof(Oid);
-	hash_ctl.entrysize = sizeof(PgStat_StatFuncEntry);
-	dbentry->functions = hash_create("Per-database function",
-									 PGSTAT_FUNCTION_HASH_SIZE,
-									 &hash_ctl,
-									 HASH_ELEM | HASH_BLOBS);
 }
 
 /*
- * Lookup the hash table entry for the specified database. If no hash
+ * Lookup the shared hash table entry for the specified database. If no hash
  * table entry exists, initialize it, if the create parameter is true.
  * Else, return NULL.
+ *
+ * The entry is returned exclusively locked; the caller must release it with
+ * dshash_release_lock() before touching any other statistics entry.
  */
 static PgStat_StatDBEntry *
 pgstat_get_db_entry(Oid databaseid, bool create)
 {
 	PgStat_StatDBEntry *result;
 	bool		found;
-	HASHACTION	action = (create ? HASH_ENTER : HASH_FIND);
 
-	/* Lookup or create the hash table entry for this database */
-	result = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												&databaseid,
-												action, &found);
+	if (!create)
+		return (PgStat_StatDBEntry *) dshash_find(db_stats, &databaseid, true);
 
-	if (!create && !found)
-		return NULL;
+	/* Lookup or create the hash table entry for this database */
+	result = (PgStat_StatDBEntry *)
+		dshash_find_or_insert(db_stats, &databaseid, &found);
 
-	/*
-	 * If not found, initialize the new one.  This creates empty hash tables
-	 * for tables and functions, too.
-	 */
+	/* If not found, initialize the new one. */
 	if (!found)
 		reset_dbentry_counters(result);
 
@@ -4789,24 +4425,28 @@ pgstat_get_db_entry(Oid databaseid, bool create)
 
 
 /*
- * Lookup the hash table entry for the specified table. If no hash
+ * Lookup the shared hash table entry for the specified table. If no hash
  * table entry exists, initialize it, if the create parameter is true.
  * Else, return NULL.
+ *
+ * As with pgstat_get_db_entry(), the entry is returned exclusively locked.
  */
 static PgStat_StatTabEntry *
-pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry, Oid tableoid, bool create)
+pgstat_get_tab_entry(Oid databaseid, Oid tableoid, bool create)
 {
 	PgStat_StatTabEntry *result;
+	PgStat_StatObjectKey key;
 	bool		found;
-	HASHACTION	action = (create ? HASH_ENTER : HASH_FIND);
 
-	/* Lookup or create the hash table entry for this table */
-	result = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-												 &tableoid,
-												 action, &found);
+	key.databaseid = databaseid;
+	key.objectid = tableoid;
 
-	if (!create && !found)
-		return NULL;
+	if (!create)
+		return (PgStat_StatTabEntry *) dshash_find(tab_stats, &key, true);
+
+	/* Lookup or create the hash table entry for this table */
+	result = (PgStat_StatTabEntry *)
+		dshash_find_or_insert(tab_stats, &key, &found);
 
 	/* If not found, initialize the new one. */
 	if (!found)
@@ -4836,188 +4476,116 @@ pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry, Oid tableoid, bool create)
 	return result;
 }
 
-
-/* ----------
- * pgstat_write_statsfiles() -
- *		Write the global statistics file, as well as requested DB files.
- *
- *	'permanent' specifies writing to the permanent files not temporary ones.
- *	When true (happens only when the collector is shutting down), also remove
- *	the temporary files so that backends starting up under a new postmaster
- *	can't read old data before the new collector is ready.
- *
- *	When 'allDbs' is false, only the requested databases (listed in
- *	pending_write_requests) will be written; otherwise, all databases
- *	will be written.
- * ----------
+/*
+ * Remove the table and function entries belonging to the given database.
  */
 static void
-pgstat_write_statsfiles(bool permanent, bool allDbs)
+pgstat_remove_db_objects(Oid databaseid)
 {
-	HASH_SEQ_STATUS hstat;
-	PgStat_StatDBEntry *dbentry;
-	FILE	   *fpout;
-	int32		format_id;
-	const char *tmpfile = permanent ? PGSTAT_STAT_PERMANENT_TMPFILE : pgstat_stat_tmpname;
-	const char *statfile = permanent ? PGSTAT_STAT_PERMANENT_FILENAME : pgstat_stat_filename;
-	int			rc;
-
-	elog(DEBUG2, "writing stats file \"%s\"", statfile);
+	dshash_seq_status dstat;
+	PgStat_StatTabEntry *tabentry;
+	PgStat_StatFuncEntry *funcentry;
 
-	/*
-	 * Open the statistics temp file to write out the current values.
-	 */
-	fpout = AllocateFile(tmpfile, PG_BINARY_W);
-	if (fpout == NULL)
+	dshash_seq_init(&dstat, tab_stats, true);
+	while ((tabentry = (PgStat_StatTabEntry *) dshash_seq_next(&dstat)) != NULL)
 	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not open temporary statistics file \"%s\": %m",
-						tmpfile)));
-		return;
+		if (tabentry->databaseid == databaseid)
+			dshash_delete_current(&dstat);
 	}
+	dshash_seq_term(&dstat);
 
-	/*
-	 * Set the timestamp of the stats file.
-	 */
-	globalStats.stats_timestamp = GetCurrentTimestamp();
-
-	/*
-	 * Write the file header --- currently just a format ID.
-	 */
-	format_id = PGSTAT_FILE_FORMAT_ID;
-	rc = fwrite(&format_id, sizeof(format_id), 1, fpout);
-	(void) rc;					/* we'll check for error with ferror */
-
-	/*
-	 * Write global stats struct
-	 */
-	rc = fwrite(&globalStats, sizeof(globalStats), 1, fpout);
-	(void) rc;					/* we'll check for error with ferror */
-
-	/*
-	 * Write archiver stats struct
-	 */
-	rc = fwrite(&archiverStats, sizeof(archiverStats), 1, fpout);
-	(void) rc;					/* we'll check for error with ferror */
+	dshash_seq_init(&dstat, func_stats, true);
+	while ((funcentry = (PgStat_StatFuncEntry *) dshash_seq_next(&dstat)) != NULL)
+	{
+		if (funcentry->databaseid == databaseid)
+			dshash_delete_current(&dstat);
+	}
+	dshash_seq_term(&dstat);
+}
 
-	/*
-	 * Walk through the database table.
-	 */
-	hash_seq_init(&hstat, pgStatDBHash);
-	while ((dbentry = (PgStat_StatDBEntry *) hash_seq_search(&hstat)) != NULL)
+/* ----------
+ * pgstat_fetch_snapshot_entry() -
+ *
+ *	Look up an entry in one of the shared hash tables, and return a copy of
+ *	it that stays valid until the snapshot is cleared.  Returns NULL if the
+ *	entry doesn't exist.  Entries that have been looked up once are served
+ *	from the backend-local snapshot hash afterwards, so the values don't
+ *	change within a transaction.
+ * ----------
+ */
+static void *
+pgstat_fetch_snapshot_entry(HTAB **snapshot, dshash_table *hash,
+							const dshash_parameters *params,
+							const void *key, long nelem)
+{
+	union
 	{
-		/*
-		 * Write out the table and function stats for this DB into the
-		 * appropriate per-DB stat file, if required.
-		 */
-		if (allDbs || pgstat_db_requested(dbentry->databaseid))
-		{
-			/* Make DB's timestamp consistent with the global stats */
-			dbentry->stats_timestamp = globalStats.stats_timestamp;
+		PgStat_StatDBEntry db;
+		PgStat_StatTabEntry tab;
+		PgStat_StatFuncEntry func;
+	}			buf;
+	void	   *entry;
+	bool		found;
 
-			pgstat_write_db_statsfile(dbentry, permanent);
-		}
+	Assert(params->entry_size <= sizeof(buf));
 
-		/*
-		 * Write out the DB entry. We don't write the tables or functions
-		 * pointers, since they're of no use to any other process.
-		 */
-		fputc('D', fpout);
-		rc = fwrite(dbentry, offsetof(PgStat_StatDBEntry, tables), 1, fpout);
-		(void) rc;				/* we'll check for error with ferror */
-	}
+	if (*snapshot == NULL)
+	{
+		HASHCTL		hash_ctl;
 
-	/*
-	 * No more output to be done. Close the temp file and replace the old
-	 * pgstat.stat with it.  The ferror() check replaces testing for error
-	 * after each individual fputc or fwrite above.
-	 */
-	fputc('E', fpout);
+		pgstat_setup_memcxt();
 
-	if (ferror(fpout))
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not write temporary statistics file \"%s\": %m",
-						tmpfile)));
-		FreeFile(fpout);
-		unlink(tmpfile);
-	}
-	else if (FreeFile(fpout) < 0)
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not close temporary statistics file \"%s\": %m",
-						tmpfile)));
-		unlink(tmpfile);
+		memset(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = params->key_size;
+		hash_ctl.entrysize = params->entry_size;
+		hash_ctl.hcxt = pgStatLocalContext;
+		*snapshot = hash_create("Statistics snapshot", nelem, &hash_ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 	}
-	else if (rename(tmpfile, statfile) < 0)
+	else
 	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not rename temporary statistics file \"%s\" to \"%s\": %m",
-						tmpfile, statfile)));
-		unlink(tmpfile);
+		entry = hash_search(*snapshot, key, HASH_FIND, NULL);
+		if (entry != NULL)
+			return entry;
 	}
 
-	if (permanent)
-		unlink(pgstat_stat_filename);
+	/* Copy the shared entry out, so as not to hold its lock for long */
+	entry = dshash_find(hash, key, false);
+	if (entry == NULL)
+		return NULL;
+	memcpy(&buf, entry, params->entry_size);
+	dshash_release_lock(hash, entry);
 
-	/*
-	 * Now throw away the list of requests.  Note that requests sent after we
-	 * started the write are still waiting on the network socket.
-	 */
-	list_free(pending_write_requests);
-	pending_write_requests = NIL;
-}
+	entry = hash_search(*snapshot, key, HASH_ENTER, &found);
+	Assert(!found);
+	memcpy(entry, &buf, params->entry_size);
 
-/*
- * return the filename for a DB stat file; filename is the output buffer,
- * of length len.
- */
-static void
-get_dbstat_filename(bool permanent, bool tempname, Oid databaseid,
-					char *filename, int len)
-{
-	int			printed;
-
-	/* NB -- pgstat_reset_remove_files knows about the pattern this uses */
-	printed = snprintf(filename, len, "%s/db_%u.%s",
-					   permanent ? PGSTAT_STAT_PERMANENT_DIRECTORY :
-					   pgstat_stat_directory,
-					   databaseid,
-					   tempname ? "tmp" : "stat");
-	if (printed >= len)
-		elog(ERROR, "overlength pgstat path");
+	return entry;
 }
 
 /* ----------
- * pgstat_write_db_statsfile() -
- *		Write the stat file for a single database.
+ * pgstat_save_stats() -
  *
- *	If writing to the permanent file (happens when the collector is
- *	shutting down only), remove the temporary file so that backends
- *	starting up under a new postmaster can't read the old data before
- *	the new collector is ready.
+ *	Write the shared statistics to the permanent stats file, so that they
+ *	survive a clean restart.  Called by the checkpointer after the shutdown
+ *	checkpoint, when no other process is reporting anymore.
  * ----------
  */
-static void
-pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
+void
+pgstat_save_stats(void)
 {
-	HASH_SEQ_STATUS tstat;
-	HASH_SEQ_STATUS fstat;
+	dshash_seq_status dstat;
+	PgStat_StatDBEntry *dbentry;
 	PgStat_StatTabEntry *tabentry;
 	PgStat_StatFuncEntry *funcentry;
 	FILE	   *fpout;
 	int32		format_id;
-	Oid			dbid = dbentry->databaseid;
+	const char *tmpfile = PGSTAT_STAT_PERMANENT_TMPFILE;
+	const char *statfile = PGSTAT_STAT_PERMANENT_FILENAME;
 	int			rc;
-	char		tmpfile[MAXPGPATH];
-	char		statfile[MAXPGPATH];
 
-	get_dbstat_filename(permanent, true, dbid, tmpfile, MAXPGPATH);
-	get_dbstat_filename(permanent, false, dbid, statfile, MAXPGPATH);
+	if (!pgstat_attach_shmem())
+		return;
 
 	elog(DEBUG2, "writing stats file \"%s\"", statfile);
 
@@ -5042,26 +4610,52 @@ pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
 	(void) rc;					/* we'll check for error with ferror */
 
 	/*
-	 * Walk through the database's access stats per table.
+	 * Write global, archiver and WAL stats structs
+	 */
+	SpinLockAcquire(&StatsShmem->mutex);
+	memcpy(&globalStats, &StatsShmem->global_stats, sizeof(globalStats));
+	memcpy(&archiverStats, &StatsShmem->archiver_stats, sizeof(archiverStats));
+	memcpy(&walStats, &StatsShmem->wal_stats, sizeof(walStats));
+	SpinLockRelease(&StatsShmem->mutex);
+
+	globalStats.stats_timestamp = GetCurrentTimestamp();
+
+	rc = fwrite(&globalStats, sizeof(globalStats), 1, fpout);
+	(void) rc;					/* we'll check for error with ferror */
+	rc = fwrite(&archiverStats, sizeof(archiverStats), 1, fpout);
+	(void) rc;					/* we'll check for error with ferror */
+	rc = fwrite(&walStats, sizeof(walStats), 1, fpout);
+	(void) rc;					/* we'll check for error with ferror */
+
+	/*
+	 * Walk through the database, table and function hash tables.
 	 */
-	hash_seq_init(&tstat, dbentry->tables);
-	while ((tabentry = (PgStat_StatTabEntry *) hash_seq_search(&tstat)) != NULL)
+	dshash_seq_init(&dstat, db_stats, false);
+	while ((dbentry = (PgStat_StatDBEntry *) dshash_seq_next(&dstat)) != NULL)
+	{
+		fputc('D', fpout);
+		rc = fwrite(dbentry, sizeof(PgStat_StatDBEntry), 1, fpout);
+		(void) rc;				/* we'll check for error with ferror */
+	}
+	dshash_seq_term(&dstat);
+
+	dshash_seq_init(&dstat, tab_stats, false);
+	while ((tabentry = (PgStat_StatTabEntry *) dshash_seq_next(&dstat)) != NULL)
 	{
 		fputc('T', fpout);
 		rc = fwrite(tabentry, sizeof(PgStat_StatTabEntry), 1, fpout);
 		(void) rc;				/* we'll check for error with ferror */
 	}
+	dshash_seq_term(&dstat);
 
-	/*
-	 * Walk through the database's function stats table.
-	 */
-	hash_seq_init(&fstat, dbentry->functions);
-	while ((funcentry = (PgStat_StatFuncEntry *) hash_seq_search(&fstat)) != NULL)
+	dshash_seq_init(&dstat, func_stats, false);
+	while ((funcentry = (PgStat_StatFuncEntry *) dshash_seq_next(&dstat)) != NULL)
 	{
 		fputc('F', fpout);
 		rc = fwrite(funcentry, sizeof(PgStat_StatFuncEntry), 1, fpout);
 		(void) rc;				/* we'll check for error with ferror */
 	}
+	dshash_seq_term(&dstat);
 
 	/*
 	 * No more output to be done. Close the temp file and replace the old
@@ -5086,462 +4680,57 @@ pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
 				 errmsg("could not close temporary statistics file \"%s\": %m",
 						tmpfile)));
 		unlink(tmpfile);
-	}
-	else if (rename(tmpfile, statfile) < 0)
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not rename temporary statistics file \"%s\" to \"%s\": %m",
-						tmpfile, statfile)));
-		unlink(tmpfile);
-	}
-
-	if (permanent)
-	{
-		get_dbstat_filename(false, false, dbid, statfile, MAXPGPATH);
-
-		elog(DEBUG2, "removing temporary stats file \"%s\"", statfile);
-		unlink(statfile);
-	}
-}
-
-/* ----------
- * pgstat_read_statsfiles() -
- *
- *	Reads in some existing statistics collector files and returns the
- *	databases hash table that is the top level of the data.
- *
- *	If 'onlydb' is not InvalidOid, it means we only want data for that DB
- *	plus the shared catalogs ("DB 0").  We'll still populate the DB hash
- *	table for all databases, but we don't bother even creating table/function
- *	hash tables for other databases.
- *
- *	'permanent' specifies reading from the permanent files not temporary ones.
- *	When true (happens only when the collector is starting up), remove the
- *	files after reading; the in-memory status is now authoritative, and the
- *	files would be out of date in case somebody else reads them.
- *
- *	If a 'deep' read is requested, table/function stats are read, otherwise
- *	the table/function hash tables remain empty.
- * ----------
- */
-static HTAB *
-pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
-{
-	PgStat_StatDBEntry *dbentry;
-	PgStat_StatDBEntry dbbuf;
-	HASHCTL		hash_ctl;
-	HTAB	   *dbhash;
-	FILE	   *fpin;
-	int32		format_id;
-	bool		found;
-	const char *statfile = permanent ? PGSTAT_STAT_PERMANENT_FILENAME : pgstat_stat_filename;
-
-	/*
-	 * The tables will live in pgStatLocalContext.
-	 */
-	pgstat_setup_memcxt();
-
-	/*
-	 * Create the DB hashtable
-	 */
-	memset(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(Oid);
-	hash_ctl.entrysize = sizeof(PgStat_StatDBEntry);
-	hash_ctl.hcxt = pgStatLocalContext;
-	dbhash = hash_create("Databases hash", PGSTAT_DB_HASH_SIZE, &hash_ctl,
-						 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-	/*
-	 * Clear out global and archiver statistics so they start from zero in
-	 * case we can't load an existing statsfile.
-	 */
-	memset(&globalStats, 0, sizeof(globalStats));
-	memset(&archiverStats, 0, sizeof(archiverStats));
-
-	/*
-	 * Set the current timestamp (will be kept only in case we can't load an
-	 * existing statsfile).
-	 */
-	globalStats.stat_reset_timestamp = GetCurrentTimestamp();
-	archiverStats.stat_reset_timestamp = globalStats.stat_reset_timestamp;
-
-	/*
-	 * Try to open the stats file. If it doesn't exist, the backends simply
-	 * return zero for anything and the collector simply starts from scratch
-	 * with empty counters.
-	 *
-	 * ENOENT is a possibility if the stats collector is not running or has
-	 * not yet written the stats file the first time.  Any other failure
-	 * condition is suspicious.
-	 */
-	if ((fpin = AllocateFile(statfile, PG_BINARY_R)) == NULL)
-	{
-		if (errno != ENOENT)
-			ereport(pgStatRunningInCollector ? LOG : WARNING,
-					(errcode_for_file_access(),
-					 errmsg("could not open statistics file \"%s\": %m",
-							statfile)));
-		return dbhash;
-	}
-
-	/*
-	 * Verify it's of the expected format.
-	 */
-	if (fread(&format_id, 1, sizeof(format_id), fpin) != sizeof(format_id) ||
-		format_id != PGSTAT_FILE_FORMAT_ID)
-	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
-				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		goto done;
-	}
-
-	/*
-	 * Read global stats struct
-	 */
-	if (fread(&globalStats, 1, sizeof(globalStats), fpin) != sizeof(globalStats))
-	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
-				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		memset(&globalStats, 0, sizeof(globalStats));
-		goto done;
-	}
-
-	/*
-	 * In the collector, disregard the timestamp we read from the permanent
-	 * stats file; we should be willing to write a temp stats file immediately
-	 * upon the first request from any backend.  This only matters if the old
-	 * file's timestamp is less than PGSTAT_STAT_INTERVAL ago, but that's not
-	 * an unusual scenario.
-	 */
-	if (pgStatRunningInCollector)
-		globalStats.stats_timestamp = 0;
-
-	/*
-	 * Read archiver stats struct
-	 */
-	if (fread(&archiverStats, 1, sizeof(archiverStats), fpin) != sizeof(archiverStats))
-	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
-				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		memset(&archiverStats, 0, sizeof(archiverStats));
-		goto done;
-	}
-
-	/*
-	 * We found an existing collector stats file. Read it and put all the
-	 * hashtable entries into place.
-	 */
-	for (;;)
-	{
-		switch (fgetc(fpin))
-		{
-				/*
-				 * 'D'	A PgStat_StatDBEntry struct describing a database
-				 * follows.
-				 */
-			case 'D':
-				if (fread(&dbbuf, 1, offsetof(PgStat_StatDBEntry, tables),
-						  fpin) != offsetof(PgStat_StatDBEntry, tables))
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				/*
-				 * Add to the DB hash
-				 */
-				dbentry = (PgStat_StatDBEntry *) hash_search(dbhash,
-															 (void *) &dbbuf.databaseid,
-															 HASH_ENTER,
-															 &found);
-				if (found)
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				memcpy(dbentry, &dbbuf, sizeof(PgStat_StatDBEntry));
-				dbentry->tables = NULL;
-				dbentry->functions = NULL;
-
-				/*
-				 * In the collector, disregard the timestamp we read from the
-				 * permanent stats file; we should be willing to write a temp
-				 * stats file immediately upon the first request from any
-				 * backend.
-				 */
-				if (pgStatRunningInCollector)
-					dbentry->stats_timestamp = 0;
-
-				/*
-				 * Don't create tables/functions hashtables for uninteresting
-				 * databases.
-				 */
-				if (onlydb != InvalidOid)
-				{
-					if (dbbuf.databaseid != onlydb &&
-						dbbuf.databaseid != InvalidOid)
-						break;
-				}
-
-				memset(&hash_ctl, 0, sizeof(hash_ctl));
-				hash_ctl.keysize = sizeof(Oid);
-				hash_ctl.entrysize = sizeof(PgStat_StatTabEntry);
-				hash_ctl.hcxt = pgStatLocalContext;
-				dbentry->tables = hash_create("Per-database table",
-											  PGSTAT_TAB_HASH_SIZE,
-											  &hash_ctl,
-											  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-				hash_ctl.keysize = sizeof(Oid);
-				hash_ctl.entrysize = sizeof(PgStat_StatFuncEntry);
-				hash_ctl.hcxt = pgStatLocalContext;
-				dbentry->functions = hash_create("Per-database function",
-												 PGSTAT_FUNCTION_HASH_SIZE,
-												 &hash_ctl,
-												 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-				/*
-				 * If requested, read the data from the database-specific
-				 * file.  Otherwise we just leave the hashtables empty.
-				 */
-				if (deep)
-					pgstat_read_db_statsfile(dbentry->databaseid,
-											 dbentry->tables,
-											 dbentry->functions,
-											 permanent);
-
-				break;
-
-			case 'E':
-				goto done;
-
-			default:
-				ereport(pgStatRunningInCollector ? LOG : WARNING,
-						(errmsg("corrupted statistics file \"%s\"",
-								statfile)));
-				goto done;
-		}
-	}
-
-done:
-	FreeFile(fpin);
-
-	/* If requested to read the permanent file, also get rid of it. */
-	if (permanent)
-	{
-		elog(DEBUG2, "removing permanent stats file \"%s\"", statfile);
-		unlink(statfile);
-	}
-
-	return dbhash;
-}
-
-
-/* ----------
- * pgstat_read_db_statsfile() -
- *
- *	Reads in the existing statistics collector file for the given database,
- *	filling the passed-in tables and functions hash tables.
- *
- *	As in pgstat_read_statsfiles, if the permanent file is requested, it is
- *	removed after reading.
- *
- *	Note: this code has the ability to skip storing per-table or per-function
- *	data, if NULL is passed for the corresponding hashtable.  That's not used
- *	at the moment though.
- * ----------
- */
-static void
-pgstat_read_db_statsfile(Oid databaseid, HTAB *tabhash, HTAB *funchash,
-						 bool permanent)
-{
-	PgStat_StatTabEntry *tabentry;
-	PgStat_StatTabEntry tabbuf;
-	PgStat_StatFuncEntry funcbuf;
-	PgStat_StatFuncEntry *funcentry;
-	FILE	   *fpin;
-	int32		format_id;
-	bool		found;
-	char		statfile[MAXPGPATH];
-
-	get_dbstat_filename(permanent, false, databaseid, statfile, MAXPGPATH);
-
-	/*
-	 * Try to open the stats file. If it doesn't exist, the backends simply
-	 * return zero for anything and the collector simply starts from scratch
-	 * with empty counters.
-	 *
-	 * ENOENT is a possibility if the stats collector is not running or has
-	 * not yet written the stats file the first time.  Any other failure
-	 * condition is suspicious.
-	 */
-	if ((fpin = AllocateFile(statfile, PG_BINARY_R)) == NULL)
-	{
-		if (errno != ENOENT)
-			ereport(pgStatRunningInCollector ? LOG : WARNING,
-					(errcode_for_file_access(),
-					 errmsg("could not open statistics file \"%s\": %m",
-							statfile)));
-		return;
-	}
-
-	/*
-	 * Verify it's of the expected format.
-	 */
-	if (fread(&format_id, 1, sizeof(format_id), fpin) != sizeof(format_id) ||
-		format_id != PGSTAT_FILE_FORMAT_ID)
-	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
-				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		goto done;
-	}
-
-	/*
-	 * We found an existing collector stats file. Read it and put all the
-	 * hashtable entries into place.
-	 */
-	for (;;)
-	{
-		switch (fgetc(fpin))
-		{
-				/*
-				 * 'T'	A PgStat_StatTabEntry follows.
-				 */
-			case 'T':
-				if (fread(&tabbuf, 1, sizeof(PgStat_StatTabEntry),
-						  fpin) != sizeof(PgStat_StatTabEntry))
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				/*
-				 * Skip if table data not wanted.
-				 */
-				if (tabhash == NULL)
-					break;
-
-				tabentry = (PgStat_StatTabEntry *) hash_search(tabhash,
-															   (void *) &tabbuf.tableid,
-															   HASH_ENTER, &found);
-
-				if (found)
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				memcpy(tabentry, &tabbuf, sizeof(tabbuf));
-				break;
-
-				/*
-				 * 'F'	A PgStat_StatFuncEntry follows.
-				 */
-			case 'F':
-				if (fread(&funcbuf, 1, sizeof(PgStat_StatFuncEntry),
-						  fpin) != sizeof(PgStat_StatFuncEntry))
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				/*
-				 * Skip if function data not wanted.
-				 */
-				if (funchash == NULL)
-					break;
-
-				funcentry = (PgStat_StatFuncEntry *) hash_search(funchash,
-																 (void *) &funcbuf.functionid,
-																 HASH_ENTER, &found);
-
-				if (found)
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				memcpy(funcentry, &funcbuf, sizeof(funcbuf));
-				break;
-
-				/*
-				 * 'E'	The EOF marker of a complete stats file.
-				 */
-			case 'E':
-				goto done;
-
-			default:
-				ereport(pgStatRunningInCollector ? LOG : WARNING,
-						(errmsg("corrupted statistics file \"%s\"",
-								statfile)));
-				goto done;
-		}
-	}
-
-done:
-	FreeFile(fpin);
-
-	if (permanent)
+	}
+	else if (rename(tmpfile, statfile) < 0)
 	{
-		elog(DEBUG2, "removing permanent stats file \"%s\"", statfile);
-		unlink(statfile);
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not rename temporary statistics file \"%s\" to \"%s\": %m",
+						tmpfile, statfile)));
+		unlink(tmpfile);
 	}
 }
 
 /* ----------
- * pgstat_read_db_statsfile_timestamp() -
- *
- *	Attempt to determine the timestamp of the last db statfile write.
- *	Returns true if successful; the timestamp is stored in *ts.
+ * pgstat_restore_stats() -
  *
- *	This needs to be careful about handling databases for which no stats file
- *	exists, such as databases without a stat entry or those not yet written:
- *
- *	- if there's a database entry in the global file, return the corresponding
- *	stats_timestamp value.
- *
- *	- if there's no db stat entry (e.g. for a new or inactive database),
- *	there's no stats_timestamp value, but also nothing to write so we return
- *	the timestamp of the global statfile.
+ *	Load the statistics saved by pgstat_save_stats() at the last clean
+ *	shutdown into shared memory.  Called by the startup process before any
+ *	other process can report statistics.  The file is removed afterwards; the
+ *	in-memory statistics are now authoritative, and the file would be out of
+ *	date after a crash.
  * ----------
  */
-static bool
-pgstat_read_db_statsfile_timestamp(Oid databaseid, bool permanent,
-								   TimestampTz *ts)
+void
+pgstat_restore_stats(void)
 {
-	PgStat_StatDBEntry dbentry;
-	PgStat_GlobalStats myGlobalStats;
-	PgStat_ArchiverStats myArchiverStats;
+	PgStat_StatDBEntry dbbuf;
+	PgStat_StatTabEntry tabbuf;
+	PgStat_StatFuncEntry funcbuf;
+	PgStat_GlobalStats globalbuf;
+	PgStat_ArchiverStats archiverbuf;
+	PgStat_WalStats walbuf;
+	void	   *entry;
 	FILE	   *fpin;
 	int32		format_id;
-	const char *statfile = permanent ? PGSTAT_STAT_PERMANENT_FILENAME : pgstat_stat_filename;
+	bool		found;
+	const char *statfile = PGSTAT_STAT_PERMANENT_FILENAME;
+
+	if (!pgstat_attach_shmem())
+		return;
 
 	/*
-	 * Try to open the stats file.  As above, anything but ENOENT is worthy of
-	 * complaining about.
+	 * Try to open the stats file. If it doesn't exist, we simply start from
+	 * scratch with empty counters.
 	 */
 	if ((fpin = AllocateFile(statfile, PG_BINARY_R)) == NULL)
 	{
 		if (errno != ENOENT)
-			ereport(pgStatRunningInCollector ? LOG : WARNING,
+			ereport(LOG,
 					(errcode_for_file_access(),
 					 errmsg("could not open statistics file \"%s\": %m",
 							statfile)));
-		return false;
+		return;
 	}
 
 	/*
@@ -5550,42 +4739,32 @@ pgstat_read_db_statsfile_timestamp(Oid databaseid, bool permanent,
 	if (fread(&format_id, 1, sizeof(format_id), fpin) != sizeof(format_id) ||
 		format_id != PGSTAT_FILE_FORMAT_ID)
 	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
-				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		FreeFile(fpin);
-		return false;
-	}
-
-	/*
-	 * Read global stats struct
-	 */
-	if (fread(&myGlobalStats, 1, sizeof(myGlobalStats),
-			  fpin) != sizeof(myGlobalStats))
-	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
+		ereport(LOG,
 				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		FreeFile(fpin);
-		return false;
+		goto done;
 	}
 
 	/*
-	 * Read archiver stats struct
+	 * Read global, archiver and WAL stats structs
 	 */
-	if (fread(&myArchiverStats, 1, sizeof(myArchiverStats),
-			  fpin) != sizeof(myArchiverStats))
+	if (fread(&globalbuf, 1, sizeof(globalbuf), fpin) != sizeof(globalbuf) ||
+		fread(&archiverbuf, 1, sizeof(archiverbuf), fpin) != sizeof(archiverbuf) ||
+		fread(&walbuf, 1, sizeof(walbuf), fpin) != sizeof(walbuf))
 	{
-		ereport(pgStatRunningInCollector ? LOG : WARNING,
+		ereport(LOG,
 				(errmsg("corrupted statistics file \"%s\"", statfile)));
-		FreeFile(fpin);
-		return false;
+		goto done;
 	}
 
-	/* By default, we're going to return the timestamp of the global file. */
-	*ts = myGlobalStats.stats_timestamp;
+	SpinLockAcquire(&StatsShmem->mutex);
+	memcpy(&StatsShmem->global_stats, &globalbuf, sizeof(globalbuf));
+	memcpy(&StatsShmem->archiver_stats, &archiverbuf, sizeof(archiverbuf));
+	memcpy(&StatsShmem->wal_stats, &walbuf, sizeof(walbuf));
+	SpinLockRelease(&StatsShmem->mutex);
 
 	/*
-	 * We found an existing collector stats file.  Read it and look for a
-	 * record for the requested database.  If found, use its timestamp.
+	 * We found an existing stats file. Read it and put all the hash table
+	 * entries into place.
 	 */
 	for (;;)
 	{
@@ -5596,32 +4775,86 @@ pgstat_read_db_statsfile_timestamp(Oid databaseid, bool permanent,
 				 * follows.
 				 */
 			case 'D':
-				if (fread(&dbentry, 1, offsetof(PgStat_StatDBEntry, tables),
-						  fpin) != offsetof(PgStat_StatDBEntry, tables))
+				if (fread(&dbbuf, 1, sizeof(dbbuf), fpin) != sizeof(dbbuf))
+				{
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									statfile)));
+					goto done;
+				}
+
+				entry = dshash_find_or_insert(db_stats, &dbbuf.databaseid,
+											  &found);
+				if (!found)
+					memcpy(entry, &dbbuf, sizeof(dbbuf));
+				dshash_release_lock(db_stats, entry);
+				if (found)
+				{
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									statfile)));
+					goto done;
+				}
+				break;
+
+				/*
+				 * 'T'	A PgStat_StatTabEntry follows.
+				 */
+			case 'T':
+				if (fread(&tabbuf, 1, sizeof(tabbuf), fpin) != sizeof(tabbuf))
+				{
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									statfile)));
+					goto done;
+				}
+
+				entry = dshash_find_or_insert(tab_stats, &tabbuf, &found);
+				if (!found)
+					memcpy(entry, &tabbuf, sizeof(tabbuf));
+				dshash_release_lock(tab_stats, entry);
+				if (found)
 				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
+					ereport(LOG,
 							(errmsg("corrupted statistics file \"%s\"",
 									statfile)));
 					goto done;
 				}
+				break;
 
 				/*
-				 * If this is the DB we're looking for, save its timestamp and
-				 * we're done.
+				 * 'F'	A PgStat_StatFuncEntry follows.
 				 */
-				if (dbentry.databaseid == databaseid)
+			case 'F':
+				if (fread(&funcbuf, 1, sizeof(funcbuf), fpin) != sizeof(funcbuf))
 				{
-					*ts = dbentry.stats_timestamp;
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									statfile)));
 					goto done;
 				}
 
+				entry = dshash_find_or_insert(func_stats, &funcbuf, &found);
+				if (!found)
+					memcpy(entry, &funcbuf, sizeof(funcbuf));
+				dshash_release_lock(func_stats, entry);
+				if (found)
+				{
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									statfile)));
+					goto done;
+				}
 				break;
 
+				/*
+				 * 'E'	The EOF marker of a complete stats file.
+				 */
 			case 'E':
 				goto done;
 
 			default:
-				ereport(pgStatRunningInCollector ? LOG : WARNING,
+				ereport(LOG,
 						(errmsg("corrupted statistics file \"%s\"",
 								statfile)));
 				goto done;
@@ -5630,139 +4863,9 @@ pgstat_read_db_statsfile_timestamp(Oid databaseid, bool permanent,
 
 done:
 	FreeFile(fpin);
-	return true;
-}
-
-/*
- * If not already done, read the statistics collector stats file into
- * some hash tables.  The results will be kept until pgstat_clear_snapshot()
- * is called (typically, at end of transaction).
- */
-static void
-backend_read_statsfile(void)
-{
-	TimestampTz min_ts = 0;
-	TimestampTz ref_ts = 0;
-	Oid			inquiry_db;
-	int			count;
-
-	/* already read it? */
-	if (pgStatDBHash)
-		return;
-	Assert(!pgStatRunningInCollector);
-
-	/*
-	 * In a normal backend, we check staleness of the data for our own DB, and
-	 * so we send MyDatabaseId in inquiry messages.  In the autovac launcher,
-	 * check staleness of the shared-catalog data, and send InvalidOid in
-	 * inquiry messages so as not to force writing unnecessary data.
-	 */
-	if (IsAutoVacuumLauncherProcess())
-		inquiry_db = InvalidOid;
-	else
-		inquiry_db = MyDatabaseId;
-
-	/*
-	 * Loop until fresh enough stats file is available or we ran out of time.
-	 * The stats inquiry message is sent repeatedly in case collector drops
-	 * it; but not every single time, as that just swamps the collector.
-	 */
-	for (count = 0; count < PGSTAT_POLL_LOOP_COUNT; count++)
-	{
-		bool		ok;
-		TimestampTz file_ts = 0;
-		TimestampTz cur_ts;
-
-		CHECK_FOR_INTERRUPTS();
-
-		ok = pgstat_read_db_statsfile_timestamp(inquiry_db, false, &file_ts);
-
-		cur_ts = GetCurrentTimestamp();
-		/* Calculate min acceptable timestamp, if we didn't already */
-		if (count == 0 || cur_ts < ref_ts)
-		{
-			/*
-			 * We set the minimum acceptable timestamp to PGSTAT_STAT_INTERVAL
-			 * msec before now.  This indirectly ensures that the collector
-			 * needn't write the file more often than PGSTAT_STAT_INTERVAL. In
-			 * an autovacuum worker, however, we want a lower delay to avoid
-			 * using stale data, so we use PGSTAT_RETRY_DELAY (since the
-			 * number of workers is low, this shouldn't be a problem).
-			 *
-			 * We don't recompute min_ts after sleeping, except in the
-			 * unlikely case that cur_ts went backwards.  So we might end up
-			 * accepting a file a bit older than PGSTAT_STAT_INTERVAL.  In
-			 * practice that shouldn't happen, though, as long as the sleep
-			 * time is less than PGSTAT_STAT_INTERVAL; and we don't want to
-			 * tell the collector that our cutoff time is less than what we'd
-			 * actually accept.
-			 */
-			ref_ts = cur_ts;
-			if (IsAutoVacuumWorkerProcess())
-				min_ts = TimestampTzPlusMilliseconds(ref_ts,
-													 -PGSTAT_RETRY_DELAY);
-			else
-				min_ts = TimestampTzPlusMilliseconds(ref_ts,
-													 -PGSTAT_STAT_INTERVAL);
-		}
-
-		/*
-		 * If the file timestamp is actually newer than cur_ts, we must have
-		 * had a clock glitch (system time went backwards) or there is clock
-		 * skew between our processor and the stats collector's processor.
-		 * Accept the file, but send an inquiry message anyway to make
-		 * pgstat_recv_inquiry do a sanity check on the collector's time.
-		 */
-		if (ok && file_ts > cur_ts)
-		{
-			/*
-			 * A small amount of clock skew between processors isn't terribly
-			 * surprising, but a large difference is worth logging.  We
-			 * arbitrarily define "large" as 1000 msec.
-			 */
-			if (file_ts >= TimestampTzPlusMilliseconds(cur_ts, 1000))
-			{
-				char	   *filetime;
-				char	   *mytime;
-
-				/* Copy because timestamptz_to_str returns a static buffer */
-				filetime = pstrdup(timestamptz_to_str(file_ts));
-				mytime = pstrdup(timestamptz_to_str(cur_ts));
-				elog(LOG, "stats collector's time %s is later than backend local time %s",
-					 filetime, mytime);
-				pfree(filetime);
-				pfree(mytime);
-			}
-
-			pgstat_send_inquiry(cur_ts, min_ts, inquiry_db);
-			break;
-		}
-
-		/* Normal acceptance case: file is not older than cutoff time */
-		if (ok && file_ts >= min_ts)
-			break;
 
-		/* Not there or too old, so kick the collector and wait a bit */
-		if ((count % PGSTAT_INQ_LOOP_COUNT) == 0)
-			pgstat_send_inquiry(cur_ts, min_ts, inquiry_db);
-
-		pg_usleep(PGSTAT_RETRY_DELAY * 1000L);
-	}
-
-	if (count >= PGSTAT_POLL_LOOP_COUNT)
-		ereport(LOG,
-				(errmsg("using stale statistics instead of current ones "
-						"because stats collector is not responding")));
-
-	/*
-	 * Autovacuum launcher wants stats about all databases, but a shallow read
-	 * is sufficient.  Regular backends want a deep read for just the tables
-	 * they can see (MyDatabaseId + shared catalogs).
-	 */
-	if (IsAutoVacuumLauncherProcess())
-		pgStatDBHash = pgstat_read_statsfiles(InvalidOid, false, false);
-	else
-		pgStatDBHash = pgstat_read_statsfiles(MyDatabaseId, false, true);
+	elog(DEBUG2, "removing permanent stats file \"%s\"", statfile);
+	unlink(statfile);
 }
 
 
@@ -5802,104 +4905,16 @@ pgstat_clear_snapshot(void)
 	/* Reset variables */
 	pgStatLocalContext = NULL;
 	pgStatDBHash = NULL;
+	pgStatSnapshotTabHash = NULL;
+	pgStatSnapshotFuncHash = NULL;
+	archiverStatsValid = false;
+	globalStatsValid = false;
+	walStatsValid = false;
 	localBackendStatusTable = NULL;
 	localNumBackends = 0;
 }
 
 
-/* ----------
- * pgstat_recv_inquiry() -
- *
- *	Process stat inquiry requests.
- * ----------
- */
-static void
-pgstat_recv_inquiry(PgStat_MsgInquiry *msg, int len)
-{
-	PgStat_StatDBEntry *dbentry;
-
-	elog(DEBUG2, "received inquiry for database %u", msg->databaseid);
-
-	/*
-	 * If there's already a write request for this DB, there's nothing to do.
-	 *
-	 * Note that if a request is found, we return early and skip the below
-	 * check for clock skew.  This is okay, since the only way for a DB
-	 * request to be present in the list is that we have been here since the
-	 * last write round.  It seems sufficient to check for clock skew once per
-	 * write round.
-	 */
-	if (list_member_oid(pending_write_requests, msg->databaseid))
-		return;
-
-	/*
-	 * Check to see if we last wrote this database at a time >= the requested
-	 * cutoff time.  If so, this is a stale request that was generated before
-	 * we updated the DB file, and we don't need to do so again.
-	 *
-	 * If the requestor's local clock time is older than stats_timestamp, we
-	 * should suspect a clock glitch, ie system time going backwards; though
-	 * the more likely explanation is just delayed message receipt.  It is
-	 * worth expending a GetCurrentTimestamp call to be sure, since a large
-	 * retreat in the system clock reading could otherwise cause us to neglect
-	 * to update the stats file for a long time.
-	 */
-	dbentry = pgstat_get_db_entry(msg->databaseid, false);
-	if (dbentry == NULL)
-	{
-		/*
-		 * We have no data for this DB.  Enter a write request anyway so that
-		 * the global stats will get updated.  This is needed to prevent
-		 * backend_read_statsfile from waiting for data that we cannot supply,
-		 * in the case of a new DB that nobody has yet reported any stats for.
-		 * See the behavior of pgstat_read_db_statsfile_timestamp.
-		 */
-	}
-	else if (msg->clock_time < dbentry->stats_timestamp)
-	{
-		TimestampTz cur_ts = GetCurrentTimestamp();
-
-		if (cur_ts < dbentry->stats_timestamp)
-		{
-			/*
-			 * Sure enough, time went backwards.  Force a new stats file write
-			 * to get back in sync; but first, log a complaint.
-			 */
-			char	   *writetime;
-			char	   *mytime;
-
-			/* Copy because timestamptz_to_str returns a static buffer */
-			writetime = pstrdup(timestamptz_to_str(dbentry->stats_timestamp));
-			mytime = pstrdup(timestamptz_to_str(cur_ts));
-			elog(LOG,
-				 "stats_timestamp %s is later than collector's time %s for database %u",
-				 writetime, mytime, dbentry->databaseid);
-			pfree(writetime);
-			pfree(mytime);
-		}
-		else
-		{
-			/*
-			 * Nope, it's just an old request.  Assuming msg's clock_time is
-			 * >= its cutoff_time, it must be stale, so we can ignore it.
-			 */
-			return;
-		}
-	}
-	else if (msg->cutoff_time <= dbentry->stats_timestamp)
-	{
-		/* Stale request, ignore it */
-		return;
-	}
-
-	/*
-	 * We need to write this DB, so create a request.
-	 */
-	pending_write_requests = lappend_oid(pending_write_requests,
-										 msg->databaseid);
-}
-
-
 /* ----------
  * pgstat_recv_tabstat() -
  *
@@ -5911,18 +4926,11 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 {
 	PgStat_StatDBEntry *dbentry;
 	PgStat_StatTabEntry *tabentry;
+	PgStat_StatDBEntry dbdelta;
 	int			i;
 	bool		found;
 
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
-
-	/*
-	 * Update database-wide stats.
-	 */
-	dbentry->n_xact_commit += (PgStat_Counter) (msg->m_xact_commit);
-	dbentry->n_xact_rollback += (PgStat_Counter) (msg->m_xact_rollback);
-	dbentry->n_block_read_time += msg->m_block_read_time;
-	dbentry->n_block_write_time += msg->m_block_write_time;
+	memset(&dbdelta, 0, sizeof(dbdelta));
 
 	/*
 	 * Process all table entries in the message.
@@ -5930,10 +4938,12 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 	for (i = 0; i < msg->m_nentries; i++)
 	{
 		PgStat_TableEntry *tabmsg = &(msg->m_entry[i]);
+		PgStat_StatObjectKey key;
 
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													   (void *) &(tabmsg->t_id),
-													   HASH_ENTER, &found);
+		key.databaseid = msg->m_databaseid;
+		key.objectid = tabmsg->t_id;
+		tabentry = (PgStat_StatTabEntry *)
+			dshash_find_or_insert(tab_stats, &key, &found);
 
 		if (!found)
 		{
@@ -5993,17 +5003,40 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 		/* Likewise for n_dead_tuples */
 		tabentry->n_dead_tuples = Max(tabentry->n_dead_tuples, 0);
 
+		dshash_release_lock(tab_stats, tabentry);
+
 		/*
-		 * Add per-table stats to the per-database entry, too.
+		 * Add per-table stats to the per-database totals, too.
 		 */
-		dbentry->n_tuples_returned += tabmsg->t_counts.t_tuples_returned;
-		dbentry->n_tuples_fetched += tabmsg->t_counts.t_tuples_fetched;
-		dbentry->n_tuples_inserted += tabmsg->t_counts.t_tuples_inserted;
-		dbentry->n_tuples_updated += tabmsg->t_counts.t_tuples_updated;
-		dbentry->n_tuples_deleted += tabmsg->t_counts.t_tuples_deleted;
-		dbentry->n_blocks_fetched += tabmsg->t_counts.t_blocks_fetched;
-		dbentry->n_blocks_hit += tabmsg->t_counts.t_blocks_hit;
+		dbdelta.n_tuples_returned += tabmsg->t_counts.t_tuples_returned;
+		dbdelta.n_tuples_fetched += tabmsg->t_counts.t_tuples_fetched;
+		dbdelta.n_tuples_inserted += tabmsg->t_counts.t_tuples_inserted;
+		dbdelta.n_tuples_updated += tabmsg->t_counts.t_tuples_updated;
+		dbdelta.n_tuples_deleted += tabmsg->t_counts.t_tuples_deleted;
+		dbdelta.n_blocks_fetched += tabmsg->t_counts.t_blocks_fetched;
+		dbdelta.n_blocks_hit += tabmsg->t_counts.t_blocks_hit;
 	}
+
+	/*
+	 * Update database-wide stats.  We do that only now, so that we never
+	 * hold the locks of a database entry and a table entry at the same time.
+	 */
+	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
+
+	dbentry->n_xact_commit += (PgStat_Counter) (msg->m_xact_commit);
+	dbentry->n_xact_rollback += (PgStat_Counter) (msg->m_xact_rollback);
+	dbentry->n_block_read_time += msg->m_block_read_time;
+	dbentry->n_block_write_time += msg->m_block_write_time;
+
+	dbentry->n_tuples_returned += dbdelta.n_tuples_returned;
+	dbentry->n_tuples_fetched += dbdelta.n_tuples_fetched;
+	dbentry->n_tuples_inserted += dbdelta.n_tuples_inserted;
+	dbentry->n_tuples_updated += dbdelta.n_tuples_updated;
+	dbentry->n_tuples_deleted += dbdelta.n_tuples_deleted;
+	dbentry->n_blocks_fetched += dbdelta.n_blocks_fetched;
+	dbentry->n_blocks_hit += dbdelta.n_blocks_hit;
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 
@@ -6016,16 +5049,10 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 static void
 pgstat_recv_tabpurge(PgStat_MsgTabpurge *msg, int len)
 {
-	PgStat_StatDBEntry *dbentry;
+	PgStat_StatObjectKey key;
 	int			i;
 
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, false);
-
-	/*
-	 * No need to purge if we don't even know the database.
-	 */
-	if (!dbentry || !dbentry->tables)
-		return;
+	key.databaseid = msg->m_databaseid;
 
 	/*
 	 * Process all table entries in the message.
@@ -6033,9 +5060,8 @@ pgstat_recv_tabpurge(PgStat_MsgTabpurge *msg, int len)
 	for (i = 0; i < msg->m_nentries; i++)
 	{
 		/* Remove from hashtable if present; we don't care if it's not. */
-		(void) hash_search(dbentry->tables,
-						   (void *) &(msg->m_tableid[i]),
-						   HASH_REMOVE, NULL);
+		key.objectid = msg->m_tableid[i];
+		(void) dshash_delete_key(tab_stats, &key);
 	}
 }
 
@@ -6050,36 +5076,13 @@ static void
 pgstat_recv_dropdb(PgStat_MsgDropdb *msg, int len)
 {
 	Oid			dbid = msg->m_databaseid;
-	PgStat_StatDBEntry *dbentry;
-
-	/*
-	 * Lookup the database in the hashtable.
-	 */
-	dbentry = pgstat_get_db_entry(dbid, false);
 
 	/*
-	 * If found, remove it (along with the db statfile).
+	 * Remove the database entry, if any, along with the entries of its
+	 * tables and functions.
 	 */
-	if (dbentry)
-	{
-		char		statfile[MAXPGPATH];
-
-		get_dbstat_filename(false, false, dbid, statfile, MAXPGPATH);
-
-		elog(DEBUG2, "removing stats file \"%s\"", statfile);
-		unlink(statfile);
-
-		if (dbentry->tables != NULL)
-			hash_destroy(dbentry->tables);
-		if (dbentry->functions != NULL)
-			hash_destroy(dbentry->functions);
-
-		if (hash_search(pgStatDBHash,
-						(void *) &dbid,
-						HASH_REMOVE, NULL) == NULL)
-			ereport(ERROR,
-					(errmsg("database hash table corrupted during cleanup --- abort")));
-	}
+	(void) dshash_delete_key(db_stats, &dbid);
+	pgstat_remove_db_objects(dbid);
 }
 
 
@@ -6103,22 +5106,13 @@ pgstat_recv_resetcounter(PgStat_MsgResetcounter *msg, int len)
 		return;
 
 	/*
-	 * We simply throw away all the database's table entries by recreating a
-	 * new hash table for them.
-	 */
-	if (dbentry->tables != NULL)
-		hash_destroy(dbentry->tables);
-	if (dbentry->functions != NULL)
-		hash_destroy(dbentry->functions);
-
-	dbentry->tables = NULL;
-	dbentry->functions = NULL;
-
-	/*
-	 * Reset database-level stats, too.  This creates empty hash tables for
-	 * tables and functions.
+	 * Reset database-level stats, and throw away all the database's table and
+	 * function entries.
 	 */
 	reset_dbentry_counters(dbentry);
+	dshash_release_lock(db_stats, dbentry);
+
+	pgstat_remove_db_objects(msg->m_databaseid);
 }
 
 /* ----------
@@ -6130,18 +5124,28 @@ pgstat_recv_resetcounter(PgStat_MsgResetcounter *msg, int len)
 static void
 pgstat_recv_resetsharedcounter(PgStat_MsgResetsharedcounter *msg, int len)
 {
+	TimestampTz now = GetCurrentTimestamp();
+
+	SpinLockAcquire(&StatsShmem->mutex);
 	if (msg->m_resettarget == RESET_BGWRITER)
 	{
 		/* Reset the global background writer statistics for the cluster. */
-		memset(&globalStats, 0, sizeof(globalStats));
-		globalStats.stat_reset_timestamp = GetCurrentTimestamp();
+		memset(&StatsShmem->global_stats, 0, sizeof(PgStat_GlobalStats));
+		StatsShmem->global_stats.stat_reset_timestamp = now;
 	}
 	else if (msg->m_resettarget == RESET_ARCHIVER)
 	{
 		/* Reset the archiver statistics for the cluster. */
-		memset(&archiverStats, 0, sizeof(archiverStats));
-		archiverStats.stat_reset_timestamp = GetCurrentTimestamp();
+		memset(&StatsShmem->archiver_stats, 0, sizeof(PgStat_ArchiverStats));
+		StatsShmem->archiver_stats.stat_reset_timestamp = now;
+	}
+	else if (msg->m_resettarget == RESET_WAL)
+	{
+		/* Reset the WAL statistics for the cluster. */
+		memset(&StatsShmem->wal_stats, 0, sizeof(PgStat_WalStats));
+		StatsShmem->wal_stats.stat_reset_timestamp = now;
 	}
+	SpinLockRelease(&StatsShmem->mutex);
 
 	/*
 	 * Presumably the sender of this message validated the target, don't
@@ -6159,6 +5163,7 @@ static void
 pgstat_recv_resetsinglecounter(PgStat_MsgResetsinglecounter *msg, int len)
 {
 	PgStat_StatDBEntry *dbentry;
+	PgStat_StatObjectKey key;
 
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, false);
 
@@ -6167,14 +5172,15 @@ pgstat_recv_resetsinglecounter(PgStat_MsgResetsinglecounter *msg, int len)
 
 	/* Set the reset timestamp for the whole database */
 	dbentry->stat_reset_timestamp = GetCurrentTimestamp();
+	dshash_release_lock(db_stats, dbentry);
 
 	/* Remove object if it exists, ignore it if not */
+	key.databaseid = msg->m_databaseid;
+	key.objectid = msg->m_objectid;
 	if (msg->m_resettype == RESET_TABLE)
-		(void) hash_search(dbentry->tables, (void *) &(msg->m_objectid),
-						   HASH_REMOVE, NULL);
+		(void) dshash_delete_key(tab_stats, &key);
 	else if (msg->m_resettype == RESET_FUNCTION)
-		(void) hash_search(dbentry->functions, (void *) &(msg->m_objectid),
-						   HASH_REMOVE, NULL);
+		(void) dshash_delete_key(func_stats, &key);
 }
 
 /* ----------
@@ -6194,6 +5200,8 @@ pgstat_recv_autovac(PgStat_MsgAutovacStart *msg, int len)
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
 
 	dbentry->last_autovac_time = msg->m_start_time;
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 /* ----------
@@ -6209,11 +5217,13 @@ pgstat_recv_vacuum(PgStat_MsgVacuum *msg, int len)
 	PgStat_StatTabEntry *tabentry;
 
 	/*
-	 * Store the data in the table's hashtable entry.
+	 * Make sure the database is known, then store the data in the table's
+	 * hashtable entry.
 	 */
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
+	dshash_release_lock(db_stats, dbentry);
 
-	tabentry = pgstat_get_tab_entry(dbentry, msg->m_tableoid, true);
+	tabentry = pgstat_get_tab_entry(msg->m_databaseid, msg->m_tableoid, true);
 
 	tabentry->n_live_tuples = msg->m_live_tuples;
 	tabentry->n_dead_tuples = msg->m_dead_tuples;
@@ -6228,6 +5238,8 @@ pgstat_recv_vacuum(PgStat_MsgVacuum *msg, int len)
 		tabentry->vacuum_timestamp = msg->m_vacuumtime;
 		tabentry->vacuum_count++;
 	}
+
+	dshash_release_lock(tab_stats, tabentry);
 }
 
 /* ----------
@@ -6243,11 +5255,13 @@ pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len)
 	PgStat_StatTabEntry *tabentry;
 
 	/*
-	 * Store the data in the table's hashtable entry.
+	 * Make sure the database is known, then store the data in the table's
+	 * hashtable entry.
 	 */
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
+	dshash_release_lock(db_stats, dbentry);
 
-	tabentry = pgstat_get_tab_entry(dbentry, msg->m_tableoid, true);
+	tabentry = pgstat_get_tab_entry(msg->m_databaseid, msg->m_tableoid, true);
 
 	tabentry->n_live_tuples = msg->m_live_tuples;
 	tabentry->n_dead_tuples = msg->m_dead_tuples;
@@ -6270,6 +5284,8 @@ pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len)
 		tabentry->analyze_timestamp = msg->m_analyzetime;
 		tabentry->analyze_count++;
 	}
+
+	dshash_release_lock(tab_stats, tabentry);
 }
 
 
@@ -6282,22 +5298,26 @@ pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len)
 static void
 pgstat_recv_archiver(PgStat_MsgArchiver *msg, int len)
 {
+	PgStat_ArchiverStats *stats = &StatsShmem->archiver_stats;
+
+	SpinLockAcquire(&StatsShmem->mutex);
 	if (msg->m_failed)
 	{
 		/* Failed archival attempt */
-		++archiverStats.failed_count;
-		memcpy(archiverStats.last_failed_wal, msg->m_xlog,
-			   sizeof(archiverStats.last_failed_wal));
-		archiverStats.last_failed_timestamp = msg->m_timestamp;
+		++stats->failed_count;
+		memcpy(stats->last_failed_wal, msg->m_xlog,
+			   sizeof(stats->last_failed_wal));
+		stats->last_failed_timestamp = msg->m_timestamp;
 	}
 	else
 	{
 		/* Successful archival operation */
-		++archiverStats.archived_count;
-		memcpy(archiverStats.last_archived_wal, msg->m_xlog,
-			   sizeof(archiverStats.last_archived_wal));
-		archiverStats.last_archived_timestamp = msg->m_timestamp;
+		++stats->archived_count;
+		memcpy(stats->last_archived_wal, msg->m_xlog,
+			   sizeof(stats->last_archived_wal));
+		stats->last_archived_timestamp = msg->m_timestamp;
 	}
+	SpinLockRelease(&StatsShmem->mutex);
 }
 
 /* ----------
@@ -6309,16 +5329,43 @@ pgstat_recv_archiver(PgStat_MsgArchiver *msg, int len)
 static void
 pgstat_recv_bgwriter(PgStat_MsgBgWriter *msg, int len)
 {
-	globalStats.timed_checkpoints += msg->m_timed_checkpoints;
-	globalStats.requested_checkpoints += msg->m_requested_checkpoints;
-	globalStats.checkpoint_write_time += msg->m_checkpoint_write_time;
-	globalStats.checkpoint_sync_time += msg->m_checkpoint_sync_time;
-	globalStats.buf_written_checkpoints += msg->m_buf_written_checkpoints;
-	globalStats.buf_written_clean += msg->m_buf_written_clean;
-	globalStats.maxwritten_clean += msg->m_maxwritten_clean;
-	globalStats.buf_written_backend += msg->m_buf_written_backend;
-	globalStats.buf_fsync_backend += msg->m_buf_fsync_backend;
-	globalStats.buf_alloc += msg->m_buf_alloc;
+	PgStat_GlobalStats *stats = &StatsShmem->global_stats;
+
+	SpinLockAcquire(&StatsShmem->mutex);
+	stats->timed_checkpoints += msg->m_timed_checkpoints;
+	stats->requested_checkpoints += msg->m_requested_checkpoints;
+	stats->checkpoint_write_time += msg->m_checkpoint_write_time;
+	stats->checkpoint_sync_time += msg->m_checkpoint_sync_time;
+	stats->buf_written_checkpoints += msg->m_buf_written_checkpoints;
+	stats->buf_written_clean += msg->m_buf_written_clean;
+	stats->maxwritten_clean += msg->m_maxwritten_clean;
+	stats->buf_written_backend += msg->m_buf_written_backend;
+	stats->buf_fsync_backend += msg->m_buf_fsync_backend;
+	stats->buf_alloc += msg->m_buf_alloc;
+	SpinLockRelease(&StatsShmem->mutex);
+}
+
+/* ----------
+ * pgstat_recv_wal() -
+ *
+ *	Process a WAL message.
+ * ----------
+ */
+static void
+pgstat_recv_wal(PgStat_MsgWal *msg, int len)
+{
+	PgStat_WalStats *stats = &StatsShmem->wal_stats;
+
+	SpinLockAcquire(&StatsShmem->mutex);
+	stats->wal_records += msg->m_wal_records;
+	stats->wal_fpi += msg->m_wal_fpi;
+	stats->wal_bytes += msg->m_wal_bytes;
+	stats->wal_buffers_full += msg->m_wal_buffers_full;
+	stats->wal_write += msg->m_wal_write;
+	stats->wal_sync += msg->m_wal_sync;
+	stats->wal_write_time += msg->m_wal_write_time;
+	stats->wal_sync_time += msg->m_wal_sync_time;
+	SpinLockRelease(&StatsShmem->mutex);
 }
 
 /* ----------
@@ -6359,6 +5406,8 @@ pgstat_recv_recoveryconflict(PgStat_MsgRecoveryConflict *msg, int len)
 			dbentry->n_conflict_startup_deadlock++;
 			break;
 	}
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 /* ----------
@@ -6375,6 +5424,8 @@ pgstat_recv_deadlock(PgStat_MsgDeadlock *msg, int len)
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
 
 	dbentry->n_deadlocks++;
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 /* ----------
@@ -6392,6 +5443,8 @@ pgstat_recv_checksum_failure(PgStat_MsgChecksumFailure *msg, int len)
 
 	dbentry->n_checksum_failures += msg->m_failurecount;
 	dbentry->last_checksum_failure = msg->m_failure_time;
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 /* ----------
@@ -6409,6 +5462,8 @@ pgstat_recv_tempfile(PgStat_MsgTempFile *msg, int len)
 
 	dbentry->n_temp_bytes += msg->m_filesize;
 	dbentry->n_temp_files += 1;
+
+	dshash_release_lock(db_stats, dbentry);
 }
 
 /* ----------
@@ -6423,19 +5478,24 @@ pgstat_recv_funcstat(PgStat_MsgFuncstat *msg, int len)
 	PgStat_FunctionEntry *funcmsg = &(msg->m_entry[0]);
 	PgStat_StatDBEntry *dbentry;
 	PgStat_StatFuncEntry *funcentry;
+	PgStat_StatObjectKey key;
 	int			i;
 	bool		found;
 
+	/* Make sure the database is known */
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
+	dshash_release_lock(db_stats, dbentry);
+
+	key.databaseid = msg->m_databaseid;
 
 	/*
 	 * Process all function entries in the message.
 	 */
 	for (i = 0; i < msg->m_nentries; i++, funcmsg++)
 	{
-		funcentry = (PgStat_StatFuncEntry *) hash_search(dbentry->functions,
-														 (void *) &(funcmsg->f_id),
-														 HASH_ENTER, &found);
+		key.objectid = funcmsg->f_id;
+		funcentry = (PgStat_StatFuncEntry *)
+			dshash_find_or_insert(func_stats, &key, &found);
 
 		if (!found)
 		{
@@ -6456,6 +5516,8 @@ pgstat_recv_funcstat(PgStat_MsgFuncstat *msg, int len)
 			funcentry->f_total_time += funcmsg->f_total_time;
 			funcentry->f_self_time += funcmsg->f_self_time;
 		}
+
+		dshash_release_lock(func_stats, funcentry);
 	}
 }
 
@@ -6468,16 +5530,10 @@ pgstat_recv_funcstat(PgStat_MsgFuncstat *msg, int len)
 static void
 pgstat_recv_funcpurge(PgStat_MsgFuncpurge *msg, int len)
 {
-	PgStat_StatDBEntry *dbentry;
+	PgStat_StatObjectKey key;
 	int			i;
 
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, false);
-
-	/*
-	 * No need to purge if we don't even know the database.
-	 */
-	if (!dbentry || !dbentry->functions)
-		return;
+	key.databaseid = msg->m_databaseid;
 
 	/*
 	 * Process all function entries in the message.
@@ -6485,53 +5541,11 @@ pgstat_recv_funcpurge(PgStat_MsgFuncpurge *msg, int len)
 	for (i = 0; i < msg->m_nentries; i++)
 	{
 		/* Remove from hashtable if present; we don't care if it's not. */
-		(void) hash_search(dbentry->functions,
-						   (void *) &(msg->m_functionid[i]),
-						   HASH_REMOVE, NULL);
+		key.objectid = msg->m_functionid[i];
+		(void) dshash_delete_key(func_stats, &key);
 	}
 }
 
-/* ----------
- * pgstat_write_statsfile_needed() -
- *
- *	Do we need to write out any stats files?
- * ----------
- */
-static bool
-pgstat_write_statsfile_needed(void)
-{
-	if (pending_write_requests != NIL)
-		return true;
-
-	/* Everything was written recently */
-	return false;
-}
-
-/* ----------
- * pgstat_db_requested() -
- *
- *	Checks whether stats for a particular DB need to be written to a file.
- * ----------
- */
-static bool
-pgstat_db_requested(Oid databaseid)
-{
-	/*
-	 * If any requests are outstanding at all, we should write the stats for
-	 * shared catalogs (the "database" with OID 0).  This ensures that
-	 * backends will see up-to-date stats for shared catalogs, even though
-	 * they send inquiry messages mentioning only their own DB.
-	 */
-	if (databaseid == InvalidOid && pending_write_requests != NIL)
-		return true;
-
-	/* Search to see if there's an open request to write this database. */
-	if (list_member_oid(pending_write_requests, databaseid))
-		return true;
-
-	return false;
-}
-
 /*
  * Convert a potentially unsafely truncated activity string (see
  * PgBackendStatus.st_activity_raw's documentation) into a correctly truncated
@@ -0,0 +1,636 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummarizer.c
+ *	  Background process that summarizes which blocks WAL modifies.
+ *
+ * When summarize_wal is on, the postmaster starts a WAL summarizer once
+ * recovery has finished.  It reads the WAL with an xlogreader as it is
+ * flushed, notes the blocks each record references, and about once per WAL
+ * segment writes the blocks modified in the WAL read since the previous
+ * summary to a summary file (see replication/walsummary.c).  Record types
+ * that create, truncate or drop relation forks, or create or drop whole
+ * databases, are noted as well, since they change files without referencing
+ * their blocks.
+ *
+ * An incremental base backup needs summaries up to its start LSN.  It asks
+ * for them with WaitForWalSummarization(), which wakes us up, so that we
+ * write out what we have as soon as we've caught up with the flushed WAL.
+ *
+ * If WAL we haven't summarized yet is removed before we get to it, we skip
+ * ahead to the current redo pointer.  The summaries then have a gap, and an
+ * incremental backup based on a backup taken before the gap will fail.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/postmaster/walsummarizer.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/rmgr.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogreader.h"
+#include "catalog/storage_xlog.h"
+#include "commands/dbcommands_xlog.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/walsummarizer.h"
+#include "replication/walsummary.h"
+#include "storage/condition_variable.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* How long to sleep when we've caught up with the flushed WAL */
+#define WAL_SUMMARIZER_NAPTIME		1000L	/* ms */
+
+/* How long a backup waits for summarization to make progress */
+#define WAL_SUMMARY_WAIT_TIMEOUT	60000	/* ms */
+
+/*
+ * Shared state of the WAL summarizer.
+ */
+typedef struct WalSummarizerData
+{
+	slock_t		mutex;
+
+	/* End of the WAL covered by the newest summary file */
+	XLogRecPtr	summarized_lsn;
+
+	/* Highest LSN up to which a backend waits for summaries */
+	XLogRecPtr	pending_lsn;
+
+	/* The summarizer's latch, or NULL if it isn't running */
+	Latch	   *summarizer_latch;
+
+	/* Signaled whenever a summary file has been written */
+	ConditionVariable summary_file_cv;
+} WalSummarizerData;
+
+/*
+ * State of our xlogreader's page read callback.
+ */
+typedef struct WalSummarizerReadState
+{
+	int			fd;				/* open WAL segment, or -1 */
+	XLogSegNo	segno;			/* segment number of fd */
+	bool		segment_missing;	/* did we fail to find a segment? */
+} WalSummarizerReadState;
+
+/* GUC variables */
+bool		summarize_wal = false;
+int			wal_summary_keep_time = 10 * 24 * 60;
+
+static WalSummarizerData *WalSummarizerCtl = NULL;
+
+static volatile sig_atomic_t got_SIGHUP = false;
+
+static void wal_summarizer_sighup(SIGNAL_ARGS);
+static void wal_summarizer_shutdown(int code, Datum arg);
+static XLogRecPtr GetSummarizationStart(void);
+static XLogRecPtr FirstRecordAtOrAfter(XLogRecPtr lsn);
+static void SummarizeRecord(XLogReaderState *reader, BlockRefTable *brtab);
+static void SummarizeAllForks(BlockRefTable *brtab, const RelFileNode *rnode);
+static void FinishSummary(BlockRefTable **brtab, XLogRecPtr *summary_start,
+						  XLogRecPtr summary_end);
+static int	WalSummarizerReadPage(XLogReaderState *reader,
+								  XLogRecPtr targetPagePtr, int reqLen,
+								  XLogRecPtr targetRecPtr, char *readBuf,
+								  TimeLineID *pageTLI);
+
+
+/*
+ * Calculate shared memory needed.
+ */
+Size
+WalSummarizerShmemSize(void)
+{
+	return sizeof(WalSummarizerData);
+}
+
+/*
+ * Allocate and initialize shared memory.
+ */
+void
+WalSummarizerShmemInit(void)
+{
+	bool		found;
+
+	WalSummarizerCtl = (WalSummarizerData *)
+		ShmemInitStruct("WAL Summarizer Data", WalSummarizerShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		SpinLockInit(&WalSummarizerCtl->mutex);
+		WalSummarizerCtl->summarized_lsn = InvalidXLogRecPtr;
+		WalSummarizerCtl->pending_lsn = InvalidXLogRecPtr;
+		WalSummarizerCtl->summarizer_latch = NULL;
+		ConditionVariableInit(&WalSummarizerCtl->summary_file_cv);
+	}
+}
+
+/*
+ * WalSummarizerRegister
+ *		Register the WAL summarizer, if summarize_wal is on.
+ *
+ * Called by the postmaster at startup.
+ */
+void
+WalSummarizerRegister(void)
+{
+	BackgroundWorker bgw;
+
+	if (!summarize_wal)
+		return;
+
+	memset(&bgw, 0, sizeof(bgw));
+	bgw.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	bgw.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	snprintf(bgw.bgw_library_name, BGW_MAXLEN, "postgres");
+	snprintf(bgw.bgw_function_name, BGW_MAXLEN, "WalSummarizerMain");
+	snprintf(bgw.bgw_name, BGW_MAXLEN, "WAL summarizer");
+	snprintf(bgw.bgw_type, BGW_MAXLEN, "WAL summarizer");
+	bgw.bgw_restart_time = 5;
+	bgw.bgw_notify_pid = 0;
+	bgw.bgw_main_arg = (Datum) 0;
+
+	RegisterBackgroundWorker(&bgw);
+}
+
+/*
+ * WalSummarizerMain
+ *		Main entry point for the WAL summarizer process.
+ *
+ * Errors are not caught; the process exits, and the postmaster restarts it
+ * after a while, when it carries on after the newest summary file.
+ */
+void
+WalSummarizerMain(Datum main_arg)
+{
+	MemoryContext context;
+	XLogReaderState *reader;
+	WalSummarizerReadState read_state;
+	BlockRefTable *brtab;
+	XLogRecPtr	summary_start;
+	XLogRecPtr	summary_end;
+	bool		first = true;
+
+	pqsignal(SIGHUP, wal_summarizer_sighup);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	context = AllocSetContextCreate(TopMemoryContext,
+									"WAL Summarizer",
+									ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(context);
+
+	/* Make sure ThisTimeLineID is set */
+	(void) RecoveryInProgress();
+
+	summary_start = summary_end = GetSummarizationStart();
+
+	SpinLockAcquire(&WalSummarizerCtl->mutex);
+	WalSummarizerCtl->summarized_lsn = summary_start;
+	WalSummarizerCtl->summarizer_latch = MyLatch;
+	SpinLockRelease(&WalSummarizerCtl->mutex);
+	on_shmem_exit(wal_summarizer_shutdown, (Datum) 0);
+
+	read_state.fd = -1;
+	read_state.segno = 0;
+	read_state.segment_missing = false;
+	reader = XLogReaderAllocate(wal_segment_size, WalSummarizerReadPage,
+								&read_state);
+	if (reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed while allocating a WAL reading processor.")));
+
+	brtab = CreateBlockRefTable();
+
+	for (;;)
+	{
+		XLogRecord *record;
+		char	   *errormsg;
+		XLogRecPtr	pending_lsn;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		record = XLogReadRecord(reader,
+								first ? FirstRecordAtOrAfter(summary_end) :
+								InvalidXLogRecPtr,
+								&errormsg);
+		if (record != NULL)
+		{
+			first = false;
+			SummarizeRecord(reader, brtab);
+			summary_end = reader->EndRecPtr;
+
+			/* Write out a summary for roughly every WAL segment. */
+			if (summary_end - summary_start >= wal_segment_size)
+				FinishSummary(&brtab, &summary_start, summary_end);
+			continue;
+		}
+
+		if (errormsg != NULL)
+			ereport(ERROR,
+					(errmsg("could not read WAL at %X/%X: %s",
+							(uint32) (reader->EndRecPtr >> 32),
+							(uint32) reader->EndRecPtr, errormsg)));
+
+		if (read_state.segment_missing)
+		{
+			XLogRecPtr	redo = GetRedoRecPtr();
+
+			/*
+			 * The WAL we need is gone.  Keep what we have summarized so far,
+			 * and skip ahead.
+			 */
+			if (summary_end > summary_start)
+				FinishSummary(&brtab, &summary_start, summary_end);
+
+			ereport(LOG,
+					(errmsg("WAL needed for summarization at %X/%X has been removed, skipping to %X/%X",
+							(uint32) (summary_end >> 32), (uint32) summary_end,
+							(uint32) (redo >> 32), (uint32) redo)));
+
+			FreeBlockRefTable(brtab);
+			brtab = CreateBlockRefTable();
+			summary_start = summary_end = redo;
+			read_state.segment_missing = false;
+			first = true;
+			continue;
+		}
+
+		/*
+		 * We've caught up with the flushed WAL.  If a backup is waiting for
+		 * summaries, write out what we have.
+		 */
+		SpinLockAcquire(&WalSummarizerCtl->mutex);
+		pending_lsn = WalSummarizerCtl->pending_lsn;
+		SpinLockRelease(&WalSummarizerCtl->mutex);
+
+		if (pending_lsn > summary_start && summary_end > summary_start)
+			FinishSummary(&brtab, &summary_start, summary_end);
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 WAL_SUMMARIZER_NAPTIME,
+						 WAIT_EVENT_WAL_SUMMARIZER_MAIN);
+		ResetLatch(MyLatch);
+	}
+}
+
+/*
+ * Wait until the WAL up to lsn has been summarized.
+ */
+void
+WaitForWalSummarization(XLogRecPtr lsn)
+{
+	XLogRecPtr	last_summarized = InvalidXLogRecPtr;
+	TimestampTz last_progress = GetCurrentTimestamp();
+	Latch	   *latch;
+
+	if (!summarize_wal)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("WAL summarization is not enabled"),
+				 errhint("Set summarize_wal to on, and take a new full backup.")));
+
+	SpinLockAcquire(&WalSummarizerCtl->mutex);
+	if (WalSummarizerCtl->pending_lsn < lsn)
+		WalSummarizerCtl->pending_lsn = lsn;
+	latch = WalSummarizerCtl->summarizer_latch;
+	SpinLockRelease(&WalSummarizerCtl->mutex);
+
+	if (latch != NULL)
+		SetLatch(latch);
+
+	ConditionVariablePrepareToSleep(&WalSummarizerCtl->summary_file_cv);
+	for (;;)
+	{
+		XLogRecPtr	summarized;
+		TimestampTz now;
+
+		SpinLockAcquire(&WalSummarizerCtl->mutex);
+		summarized = WalSummarizerCtl->summarized_lsn;
+		SpinLockRelease(&WalSummarizerCtl->mutex);
+
+		if (summarized >= lsn)
+			break;
+
+		now = GetCurrentTimestamp();
+		if (summarized != last_summarized)
+		{
+			last_summarized = summarized;
+			last_progress = now;
+		}
+		else if (TimestampDifferenceExceeds(last_progress, now,
+											WAL_SUMMARY_WAIT_TIMEOUT))
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("WAL summarization is not progressing"),
+					 errdetail("Summarization is needed through %X/%X, but is stuck at %X/%X.",
+							   (uint32) (lsn >> 32), (uint32) lsn,
+							   (uint32) (summarized >> 32), (uint32) summarized)));
+
+		(void) ConditionVariableTimedSleep(&WalSummarizerCtl->summary_file_cv,
+										   1000L,
+										   WAIT_EVENT_WAL_SUMMARY_READY);
+	}
+	ConditionVariableCancelSleep();
+}
+
+/* SIGHUP: set flag to re-read config file at next convenient time */
+static void
+wal_summarizer_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_SIGHUP = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Stop advertising our latch when exiting.
+ */
+static void
+wal_summarizer_shutdown(int code, Datum arg)
+{
+	SpinLockAcquire(&WalSummarizerCtl->mutex);
+	WalSummarizerCtl->summarizer_latch = NULL;
+	SpinLockRelease(&WalSummarizerCtl->mutex);
+}
+
+/*
+ * Decide where to start summarizing: at the end of the newest summary on
+ * this timeline, if the WAL after it still exists, else at the redo pointer
+ * of the last checkpoint.
+ */
+static XLogRecPtr
+GetSummarizationStart(void)
+{
+	List	   *summaries;
+	XLogRecPtr	start = InvalidXLogRecPtr;
+	XLogRecPtr	redo = GetRedoRecPtr();
+
+	summaries = GetWalSummaries(ThisTimeLineID, InvalidXLogRecPtr,
+								InvalidXLogRecPtr);
+	if (summaries != NIL)
+	{
+		WalSummaryFile *ws = llast(summaries);
+		XLogSegNo	segno;
+
+		start = ws->end_lsn;
+		XLByteToSeg(start, segno, wal_segment_size);
+		if (start > GetFlushRecPtr() || segno <= XLogGetLastRemovedSegno())
+		{
+			ereport(LOG,
+					(errmsg("WAL needed for summarization at %X/%X has been removed, skipping to %X/%X",
+							(uint32) (start >> 32), (uint32) start,
+							(uint32) (redo >> 32), (uint32) redo)));
+			start = InvalidXLogRecPtr;
+		}
+	}
+	list_free_deep(summaries);
+
+	return XLogRecPtrIsInvalid(start) ? redo : start;
+}
+
+/*
+ * The end of a record may be a page boundary, which isn't a valid place for
+ * the xlogreader to start reading; the next record then follows the page
+ * header.
+ */
+static XLogRecPtr
+FirstRecordAtOrAfter(XLogRecPtr lsn)
+{
+	if (XLogSegmentOffset(lsn, wal_segment_size) == 0)
+		return lsn + SizeOfXLogLongPHD;
+	if (lsn % XLOG_BLCKSZ == 0)
+		return lsn + SizeOfXLogShortPHD;
+	return lsn;
+}
+
+/*
+ * Note the blocks and relation forks that a WAL record modifies.
+ */
+static void
+SummarizeRecord(XLogReaderState *reader, BlockRefTable *brtab)
+{
+	uint8		info = XLogRecGetInfo(reader) & ~XLR_INFO_MASK;
+	int			block_id;
+	int			i;
+
+	switch (XLogRecGetRmid(reader))
+	{
+		case RM_SMGR_ID:
+			if (info == XLOG_SMGR_CREATE)
+			{
+				xl_smgr_create *xlrec = (xl_smgr_create *) XLogRecGetData(reader);
+
+				BlockRefTableSetLimitBlock(brtab, &xlrec->rnode,
+										   xlrec->forkNum, 0);
+			}
+			else if (info == XLOG_SMGR_TRUNCATE)
+			{
+				xl_smgr_truncate *xlrec = (xl_smgr_truncate *) XLogRecGetData(reader);
+
+				if ((xlrec->flags & SMGR_TRUNCATE_HEAP) != 0)
+					BlockRefTableSetLimitBlock(brtab, &xlrec->rnode,
+											   MAIN_FORKNUM, xlrec->blkno);
+				if ((xlrec->flags & SMGR_TRUNCATE_FSM) != 0)
+					BlockRefTableSetLimitBlock(brtab, &xlrec->rnode,
+											   FSM_FORKNUM, 0);
+				if ((xlrec->flags & SMGR_TRUNCATE_VM) != 0)
+					BlockRefTableSetLimitBlock(brtab, &xlrec->rnode,
+											   VISIBILITYMAP_FORKNUM, 0);
+			}
+			break;
+
+		case RM_XACT_ID:
+			{
+				uint8		xact_info = info & XLOG_XACT_OPMASK;
+
+				if (xact_info == XLOG_XACT_COMMIT ||
+					xact_info == XLOG_XACT_COMMIT_PREPARED)
+				{
+					xl_xact_parsed_commit parsed;
+
+					ParseCommitRecord(XLogRecGetInfo(reader),
+									  (xl_xact_commit *) XLogRecGetData(reader),
+									  &parsed);
+					for (i = 0; i < parsed.nrels; i++)
+						SummarizeAllForks(brtab, &parsed.xnodes[i]);
+				}
+				else if (xact_info == XLOG_XACT_ABORT ||
+						 xact_info == XLOG_XACT_ABORT_PREPARED)
+				{
+					xl_xact_parsed_abort parsed;
+
+					ParseAbortRecord(XLogRecGetInfo(reader),
+									 (xl_xact_abort *) XLogRecGetData(reader),
+									 &parsed);
+					for (i = 0; i < parsed.nrels; i++)
+						SummarizeAllForks(brtab, &parsed.xnodes[i]);
+				}
+			}
+			break;
+
+		case RM_DBASE_ID:
+			{
+				RelFileNode rnode;
+
+				rnode.relNode = InvalidOid;
+				if (info == XLOG_DBASE_CREATE)
+				{
+					xl_dbase_create_rec *xlrec = (xl_dbase_create_rec *) XLogRecGetData(reader);
+
+					rnode.spcNode = xlrec->tablespace_id;
+					rnode.dbNode = xlrec->db_id;
+					SummarizeAllForks(brtab, &rnode);
+				}
+				else if (info == XLOG_DBASE_DROP)
+				{
+					xl_dbase_drop_rec *xlrec = (xl_dbase_drop_rec *) XLogRecGetData(reader);
+
+					rnode.spcNode = xlrec->tablespace_id;
+					rnode.dbNode = xlrec->db_id;
+					SummarizeAllForks(brtab, &rnode);
+				}
+			}
+			break;
+	}
+
+	for (block_id = 0; block_id <= reader->max_block_id; block_id++)
+	{
+		RelFileNode rnode;
+		ForkNumber	forknum;
+		BlockNumber blkno;
+
+		if (!XLogRecGetBlockTag(reader, block_id, &rnode, &forknum, &blkno))
+			continue;
+		BlockRefTableMarkBlockModified(brtab, &rnode, forknum, blkno);
+	}
+}
+
+/*
+ * Note that every fork of a relation, or of every relation in a database if
+ * relNode is InvalidOid, was created or removed.
+ */
+static void
+SummarizeAllForks(BlockRefTable *brtab, const RelFileNode *rnode)
+{
+	ForkNumber	forknum;
+
+	for (forknum = 0; forknum <= MAX_FORKNUM; forknum++)
+		BlockRefTableSetLimitBlock(brtab, rnode, forknum, 0);
+}
+
+/*
+ * Write out the summary of the WAL from *summary_start to summary_end, and
+ * start a new one.
+ */
+static void
+FinishSummary(BlockRefTable **brtab, XLogRecPtr *summary_start,
+			  XLogRecPtr summary_end)
+{
+	WriteWalSummary(*brtab, ThisTimeLineID, *summary_start, summary_end);
+
+	FreeBlockRefTable(*brtab);
+	*brtab = CreateBlockRefTable();
+	*summary_start = summary_end;
+
+	SpinLockAcquire(&WalSummarizerCtl->mutex);
+	WalSummarizerCtl->summarized_lsn = summary_end;
+	SpinLockRelease(&WalSummarizerCtl->mutex);
+	ConditionVariableBroadcast(&WalSummarizerCtl->summary_file_cv);
+
+	RemoveOldWalSummaries(wal_summary_keep_time);
+}
+
+/*
+ * xlogreader page read callback.  Reads only WAL that has been flushed, and
+ * notes it if a segment we need has been removed.
+ */
+static int
+WalSummarizerReadPage(XLogReaderState *reader, XLogRecPtr targetPagePtr,
+					  int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
+					  TimeLineID *pageTLI)
+{
+	WalSummarizerReadState *read_state = (WalSummarizerReadState *) reader->private_data;
+	XLogRecPtr	flushptr = GetFlushRecPtr();
+	XLogSegNo	targetSegNo;
+	int			count = XLOG_BLCKSZ;
+	int			nread;
+
+	if (targetPagePtr + reqLen > flushptr)
+		return -1;
+	if (targetPagePtr + XLOG_BLCKSZ > flushptr)
+		count = flushptr - targetPagePtr;
+
+	XLByteToSeg(targetPagePtr, targetSegNo, wal_segment_size);
+
+	/* Switch to the right segment file, if necessary */
+	if (read_state->fd < 0 || read_state->segno != targetSegNo)
+	{
+		char		path[MAXPGPATH];
+
+		if (read_state->fd >= 0)
+			close(read_state->fd);
+
+		XLogFilePath(path, ThisTimeLineID, targetSegNo, wal_segment_size);
+		read_state->fd = BasicOpenFile(path, O_RDONLY | PG_BINARY);
+		if (read_state->fd < 0)
+		{
+			if (errno == ENOENT)
+			{
+				read_state->segment_missing = true;
+				return -1;
+			}
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\": %m", path)));
+		}
+		read_state->segno = targetSegNo;
+	}
+
+	pgstat_report_wait_start(WAIT_EVENT_WAL_READ);
+	nread = pg_pread(read_state->fd, readBuf, XLOG_BLCKSZ,
+					 XLogSegmentOffset(targetPagePtr, wal_segment_size));
+	pgstat_report_wait_end();
+	if (nread < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from log segment %s, offset %u: %m",
+						XLogFileNameP(ThisTimeLineID, targetSegNo),
+						(uint32) XLogSegmentOffset(targetPagePtr, wal_segment_size))));
+	if (nread < count)
+		return -1;
+
+	*pageTLI = ThisTimeLineID;
+
+	return count;
+}
@@ -15,8 +15,18 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "access/xlog_internal.h"	/* for pg_start/stop_backup */
+#include "catalog/pg_tablespace_d.h"
 #include "catalog/pg_type.h"
 #include "common/file_perm.h"
 #include "lib/stringinfo.h"
@@ -28,9 +38,11 @@
 #include "pgstat.h"
 #include "port.h"
 #include "postmaster/syslogger.h"
+#include "postmaster/walsummarizer.h"
 #include "replication/basebackup.h"
 #include "replication/walsender.h"
 #include "replication/walsender_private.h"
+#include "replication/walsummary.h"
 #include "storage/bufpage.h"
 #include "storage/checksum.h"
 #include "storage/dsm_impl.h"
@@ -38,11 +50,20 @@
 #include "storage/ipc.h"
 #include "storage/reinit.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "utils/ps_status.h"
 #include "utils/relcache.h"
 #include "utils/timestamp.h"
 
 
+typedef enum
+{
+	BACKUP_COMPRESSION_NONE,
+	BACKUP_COMPRESSION_GZIP,
+	BACKUP_COMPRESSION_LZ4,
+	BACKUP_COMPRESSION_ZSTD
+} BackupCompression;
+
 typedef struct
 {
 	const char *label;
@@ -52,6 +73,9 @@ typedef struct
 	bool		includewal;
 	uint32		maxrate;
 	bool		sendtblspcmapfile;
+	BackupCompression compression;
+	int			compression_level;
+	XLogRecPtr	incremental_lsn;
 } basebackup_options;
 
 
@@ -59,6 +83,9 @@ static int64 sendDir(const char *path, int basepathlen, bool sizeonly,
 					 List *tablespaces, bool sendtblspclinks);
 static bool sendFile(const char *readfilename, const char *tarfilename,
 					 struct stat *statbuf, bool missing_ok, Oid dboid);
+static bool sendIncrementalFile(const char *readfilename,
+								const char *tarfilename, struct stat *statbuf,
+								Oid spcoid, Oid dboid, bool *sent);
 static void sendFileWithContent(const char *filename, const char *content);
 static int64 _tarWriteHeader(const char *filename, const char *linktarget,
 							 struct stat *statbuf, bool sizeonly);
@@ -72,7 +99,13 @@ static void parse_basebackup_options(List *options, basebackup_options *opt);
 static void SendXlogRecPtrResult(XLogRecPtr ptr, TimeLineID tli);
 static int	compareWalFileNames(const void *a, const void *b);
 static void throttle(size_t increment);
+static void send_copy_data(const char *data, size_t len);
+static void start_tar_stream(void);
+static void send_tar_data(const char *data, size_t len);
+static void end_tar_stream(void);
+static void prefetch_file(FILE *fp, pgoff_t offset, pgoff_t len);
 static bool is_checksummed_file(const char *fullpath, const char *filename);
+static BlockRefTable *load_wal_summaries(XLogRecPtr incremental_lsn);
 
 /* Was the backup currently in-progress initiated in recovery mode? */
 static bool backup_started_in_recovery = false;
@@ -85,6 +118,13 @@ static char *statrelpath = NULL;
  */
 #define TAR_SEND_SIZE 32768
 
+/*
+ * How far ahead of the position being sent we ask the kernel to read files,
+ * so that reading overlaps with checksum verification, compression and the
+ * network transfer.
+ */
+#define PREFETCH_DISTANCE (32 * TAR_SEND_SIZE)
+
 /*
  * How frequently to throttle, as a fraction of the specified rate-second.
  */
@@ -111,6 +151,48 @@ static long long int total_checksum_failures;
 /* Do not verify checksums. */
 static bool noverify_checksums = false;
 
+/* Compression of the tar streams requested by the client. */
+static BackupCompression compression = BACKUP_COMPRESSION_NONE;
+static int	compression_level;
+
+#ifdef HAVE_LIBZ
+/* State of the gzip stream of the tar file being sent. */
+static z_stream *zstream = NULL;
+static char *zbuffer = NULL;
+#endif
+
+/*
+ * State of the lz4 or zstd stream of the tar file being sent.  These
+ * libraries allocate their contexts with malloc(), so a context is kept for
+ * the life of the process and reused by later backups rather than leaked
+ * when a backup fails.  The output buffer lives in TopMemoryContext for the
+ * same reason.
+ */
+#ifdef USE_LZ4
+static LZ4F_cctx *lz4_cctx = NULL;
+static char *lz4_buffer = NULL;
+static size_t lz4_buffer_size;
+#endif
+#ifdef USE_ZSTD
+static ZSTD_CCtx *zstd_cctx = NULL;
+static char *zstd_buffer = NULL;
+#endif
+
+/*
+ * For an incremental backup, the blocks modified since the start of the
+ * backup it is based on.  NULL for a full backup.
+ */
+static BlockRefTable *incremental_brtab = NULL;
+
+/* Tablespace whose files are currently being sent */
+static Oid	current_spcoid = InvalidOid;
+
+/*
+ * A relation segment is sent in full rather than incrementally if at least
+ * this fraction of its blocks has been modified.
+ */
+#define INCREMENTAL_MAX_FRACTION	0.9
+
 /*
  * The contents of these directories are removed or recreated during server
  * start so they are not included in backups.  The directories themselves are
@@ -242,6 +324,15 @@ perform_base_backup(basebackup_options *opt)
 
 	total_checksum_failures = 0;
 
+	compression = opt->compression;
+	compression_level = opt->compression_level;
+	incremental_brtab = NULL;
+
+	if (!XLogRecPtrIsInvalid(opt->incremental_lsn) && backup_started_in_recovery)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("incremental backups cannot be taken during recovery")));
+
 	startptr = do_pg_start_backup(opt->label, opt->fastcheckpoint, &starttli,
 								  labelfile, &tablespaces,
 								  tblspc_map_file,
@@ -259,6 +350,29 @@ perform_base_backup(basebackup_options *opt)
 		ListCell   *lc;
 		tablespaceinfo *ti;
 
+		/*
+		 * For an incremental backup, find out which blocks have been modified
+		 * since the start of the backup it's based on, and note that in the
+		 * backup_label file, so that the backup can't be mistaken for a
+		 * complete data directory.
+		 */
+		if (!XLogRecPtrIsInvalid(opt->incremental_lsn))
+		{
+			if (opt->incremental_lsn > startptr)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("incremental backup base %X/%X is later than the backup start location %X/%X",
+								(uint32) (opt->incremental_lsn >> 32),
+								(uint32) opt->incremental_lsn,
+								(uint32) (startptr >> 32), (uint32) startptr)));
+
+			WaitForWalSummarization(startptr);
+			incremental_brtab = load_wal_summaries(opt->incremental_lsn);
+			appendStringInfo(labelfile, "INCREMENTAL FROM LSN: %X/%X\n",
+							 (uint32) (opt->incremental_lsn >> 32),
+							 (uint32) opt->incremental_lsn);
+		}
+
 		SendXlogRecPtrResult(startptr, starttli);
 
 		/*
@@ -309,13 +423,11 @@ perform_base_backup(basebackup_options *opt)
 		foreach(lc, tablespaces)
 		{
 			tablespaceinfo *ti = (tablespaceinfo *) lfirst(lc);
-			StringInfoData buf;
 
-			/* Send CopyOutResponse message */
-			pq_beginmessage(&buf, 'H');
-			pq_sendbyte(&buf, 0);	/* overall format */
-			pq_sendint16(&buf, 0);	/* natts */
-			pq_endmessage(&buf);
+			current_spcoid = ti->path == NULL ? DEFAULTTABLESPACE_OID :
+				atooid(ti->oid);
+
+			start_tar_stream();
 
 			if (ti->path == NULL)
 			{
@@ -358,13 +470,19 @@ perform_base_backup(basebackup_options *opt)
 				Assert(lnext(tablespaces, lc) == NULL);
 			}
 			else
-				pq_putemptymessage('c');	/* CopyDone */
+				end_tar_stream();
 		}
 
 		endptr = do_pg_stop_backup(labelfile->data, !opt->nowait, &endtli);
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(base_backup_cleanup, (Datum) 0);
 
+	if (incremental_brtab != NULL)
+	{
+		FreeBlockRefTable(incremental_brtab);
+		incremental_brtab = NULL;
+	}
+
 
 	if (opt->includewal)
 	{
@@ -538,13 +656,9 @@ perform_base_backup(basebackup_options *opt)
 								fp)) > 0)
 			{
 				CheckXLogRemoved(segno, tli);
-				/* Send the chunk as a CopyData message */
-				if (pq_putmessage('d', buf, cnt))
-					ereport(ERROR,
-							(errmsg("base backup could not send data, aborting backup")));
+				send_tar_data(buf, cnt);
 
 				len += cnt;
-				throttle(cnt);
 
 				if (len == wal_segment_size)
 					break;
@@ -600,7 +714,7 @@ perform_base_backup(basebackup_options *opt)
 		}
 
 		/* Send CopyDone message for the last tar file */
-		pq_putemptymessage('c');
+		end_tar_stream();
 	}
 	SendXlogRecPtrResult(endptr, endtli);
 
@@ -645,8 +759,13 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 	bool		o_maxrate = false;
 	bool		o_tablespace_map = false;
 	bool		o_noverify_checksums = false;
+	bool		o_compression = false;
+	bool		o_compression_level = false;
+	bool		o_incremental = false;
 
 	MemSet(opt, 0, sizeof(*opt));
+	opt->compression = BACKUP_COMPRESSION_NONE;
+	opt->compression_level = -1;	/* the method's default */
 	foreach(lopt, options)
 	{
 		DefElem    *defel = (DefElem *) lfirst(lopt);
@@ -733,12 +852,126 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 			noverify_checksums = true;
 			o_noverify_checksums = true;
 		}
+		else if (strcmp(defel->defname, "compression") == 0)
+		{
+			char	   *method = strVal(defel->arg);
+
+			if (o_compression)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			if (strcmp(method, "none") == 0)
+				opt->compression = BACKUP_COMPRESSION_NONE;
+			else if (strcmp(method, "gzip") == 0)
+			{
+#ifndef HAVE_LIBZ
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("compression method \"%s\" is not supported by this build",
+								method)));
+#endif
+				opt->compression = BACKUP_COMPRESSION_GZIP;
+			}
+			else if (strcmp(method, "lz4") == 0)
+			{
+#ifndef USE_LZ4
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("compression method \"%s\" is not supported by this build",
+								method)));
+#endif
+				opt->compression = BACKUP_COMPRESSION_LZ4;
+			}
+			else if (strcmp(method, "zstd") == 0)
+			{
+#ifndef USE_ZSTD
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("compression method \"%s\" is not supported by this build",
+								method)));
+#endif
+				opt->compression = BACKUP_COMPRESSION_ZSTD;
+			}
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("unrecognized compression method \"%s\"",
+								method)));
+			o_compression = true;
+		}
+		else if (strcmp(defel->defname, "compression_level") == 0)
+		{
+			if (o_compression_level)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			/* The valid range depends on the method, so check it below */
+			opt->compression_level = intVal(defel->arg);
+			o_compression_level = true;
+		}
+		else if (strcmp(defel->defname, "incremental") == 0)
+		{
+			char	   *lsn = strVal(defel->arg);
+			uint32		hi,
+						lo;
+
+			if (o_incremental)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			if (sscanf(lsn, "%X/%X", &hi, &lo) != 2)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid WAL location \"%s\"", lsn)));
+			opt->incremental_lsn = ((uint64) hi) << 32 | lo;
+			if (XLogRecPtrIsInvalid(opt->incremental_lsn))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid WAL location \"%s\"", lsn)));
+			o_incremental = true;
+		}
 		else
 			elog(ERROR, "option \"%s\" not recognized",
 				 defel->defname);
 	}
 	if (opt->label == NULL)
 		opt->label = "base backup";
+	if (o_compression_level)
+	{
+		int			max_level = 0;
+
+		switch (opt->compression)
+		{
+			case BACKUP_COMPRESSION_NONE:
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("COMPRESSION_LEVEL requires a compression method")));
+				break;
+			case BACKUP_COMPRESSION_GZIP:
+				max_level = 9;
+				break;
+			case BACKUP_COMPRESSION_LZ4:
+				/* higher levels use the high compression mode of lz4 */
+				max_level = 12;
+				break;
+			case BACKUP_COMPRESSION_ZSTD:
+#ifdef USE_ZSTD
+				max_level = ZSTD_maxCLevel();
+#endif
+				break;
+		}
+
+		if (opt->compression_level < 1 ||
+			opt->compression_level > max_level)
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("%d is outside the valid range for parameter \"%s\" (%d .. %d)",
+							opt->compression_level, "COMPRESSION_LEVEL",
+							1, max_level)));
+	}
 }
 
 
@@ -939,8 +1172,8 @@ sendFileWithContent(const char *filename, const char *content)
 	statbuf.st_size = len;
 
 	_tarWriteHeader(filename, NULL, &statbuf, false);
-	/* Send the contents as a CopyData message */
-	pq_putmessage('d', content, len);
+	/* Send the contents */
+	send_tar_data(content, len);
 
 	/* Pad to 512 byte boundary, per tar format requirements */
 	pad = ((len + 511) & ~511) - len;
@@ -949,7 +1182,7 @@ sendFileWithContent(const char *filename, const char *content)
 		char		buf[512];
 
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		send_tar_data(buf, pad);
 	}
 }
 
@@ -1296,8 +1529,28 @@ sendDir(const char *path, int basepathlen, bool sizeonly, List *tablespaces,
 			bool		sent = false;
 
 			if (!sizeonly)
-				sent = sendFile(pathbuf, pathbuf + basepathlen + 1, &statbuf,
-								true, isDbDir ? pg_atoi(lastDir + 1, sizeof(Oid), 0) : InvalidOid);
+			{
+				Oid			dboid = isDbDir ? pg_atoi(lastDir + 1, sizeof(Oid), 0) : InvalidOid;
+				bool		done = false;
+
+				/*
+				 * In an incremental backup, relation files in database
+				 * directories and in global/ may be sent incrementally.
+				 */
+				if (incremental_brtab != NULL && isDbDir)
+					done = sendIncrementalFile(pathbuf, pathbuf + basepathlen + 1,
+											   &statbuf, current_spcoid, dboid,
+											   &sent);
+				else if (incremental_brtab != NULL &&
+						 strcmp(path, "./global") == 0)
+					done = sendIncrementalFile(pathbuf, pathbuf + basepathlen + 1,
+											   &statbuf, GLOBALTABLESPACE_OID,
+											   InvalidOid, &sent);
+
+				if (!done)
+					sent = sendFile(pathbuf, pathbuf + basepathlen + 1, &statbuf,
+									true, dboid);
+			}
 
 			if (sent || sizeonly)
 			{
@@ -1341,6 +1594,180 @@ is_checksummed_file(const char *fullpath, const char *filename)
 		return false;
 }
 
+/*
+ * Read the WAL summaries covering the WAL from incremental_lsn to the start
+ * of the backup, and return the blocks they say were modified.
+ */
+static BlockRefTable *
+load_wal_summaries(XLogRecPtr incremental_lsn)
+{
+	List	   *summaries;
+	ListCell   *lc;
+	XLogRecPtr	covered = incremental_lsn;
+	BlockRefTable *brtab;
+
+	summaries = GetWalSummaries(ThisTimeLineID, incremental_lsn, startptr);
+
+	/* Check that there are no gaps between the summaries. */
+	foreach(lc, summaries)
+	{
+		WalSummaryFile *ws = (WalSummaryFile *) lfirst(lc);
+
+		if (ws->start_lsn > covered)
+			break;
+		if (ws->end_lsn > covered)
+			covered = ws->end_lsn;
+	}
+	if (covered < startptr)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("WAL summaries are missing for the WAL from %X/%X to %X/%X on timeline %u",
+						(uint32) (covered >> 32), (uint32) covered,
+						(uint32) (startptr >> 32), (uint32) startptr,
+						ThisTimeLineID),
+				 errhint("Take a new full backup.")));
+
+	brtab = CreateBlockRefTable();
+	foreach(lc, summaries)
+		ReadWalSummary(brtab, (WalSummaryFile *) lfirst(lc));
+	list_free_deep(summaries);
+
+	return brtab;
+}
+
+/*
+ * Send a segment of the main fork of a relation as an incremental file,
+ * containing only the blocks modified since the backup this one is based on.
+ *
+ * Returns false if the file should be sent in full instead, because it isn't
+ * such a segment or too much of it has been modified.  Otherwise, *sent is
+ * set to whether the file was sent, or had disappeared.
+ */
+static bool
+sendIncrementalFile(const char *readfilename, const char *tarfilename,
+					struct stat *statbuf, Oid spcoid, Oid dboid, bool *sent)
+{
+	const char *filename = last_dir_separator(readfilename) + 1;
+	const char *segmentpath;
+	int			relOidChars;
+	ForkNumber	relForkNum;
+	RelFileNode rnode;
+	BlockNumber segment_start;
+	BlockNumber nblocks;
+	BlockNumber *blocks;
+	int			nmodified;
+	IncrementalFileHeader header;
+	char		incrname[MAXPGPATH];
+	struct stat incrstat;
+	char		buf[BLCKSZ];
+	FILE	   *fp;
+	pgoff_t		len;
+	size_t		pad;
+	int			i;
+
+	if (!parse_filename_for_nontemp_relation(filename, &relOidChars,
+											 &relForkNum) ||
+		relForkNum != MAIN_FORKNUM ||
+		statbuf->st_size % BLCKSZ != 0)
+		return false;
+
+	rnode.spcNode = spcoid;
+	rnode.dbNode = dboid;
+	rnode.relNode = atooid(filename);
+
+	segment_start = 0;
+	segmentpath = strchr(filename, '.');
+	if (segmentpath != NULL)
+		segment_start = atoi(segmentpath + 1) * RELSEG_SIZE;
+	nblocks = statbuf->st_size / BLCKSZ;
+
+	blocks = palloc(sizeof(BlockNumber) * Max(nblocks, 1));
+	nmodified = BlockRefTableGetModifiedBlocks(incremental_brtab, &rnode,
+											   MAIN_FORKNUM, segment_start,
+											   segment_start + nblocks,
+											   blocks);
+	if (nmodified >= nblocks * INCREMENTAL_MAX_FRACTION)
+	{
+		pfree(blocks);
+		return false;
+	}
+
+	fp = AllocateFile(readfilename, "rb");
+	if (fp == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\": %m", readfilename)));
+		pfree(blocks);
+		*sent = false;
+		return true;
+	}
+
+	/* Block numbers in the file are relative to the start of the segment. */
+	for (i = 0; i < nmodified; i++)
+		blocks[i] -= segment_start;
+
+	header.magic = INCREMENTAL_MAGIC;
+	header.num_blocks = nmodified;
+	header.truncation_block_length = nblocks;
+
+	snprintf(incrname, sizeof(incrname), "%.*s%s%s",
+			 (int) (strlen(tarfilename) - strlen(filename)), tarfilename,
+			 INCREMENTAL_PREFIX, filename);
+	incrstat = *statbuf;
+	incrstat.st_size = sizeof(header) + sizeof(BlockNumber) * nmodified +
+		(pgoff_t) BLCKSZ * nmodified;
+	_tarWriteHeader(incrname, NULL, &incrstat, false);
+
+	send_tar_data((char *) &header, sizeof(header));
+	send_tar_data((char *) blocks, sizeof(BlockNumber) * nmodified);
+	len = sizeof(header) + sizeof(BlockNumber) * nmodified;
+
+	for (i = 0; i < nmodified; i++)
+	{
+		size_t		cnt;
+
+		if (fseeko(fp, (pgoff_t) blocks[i] * BLCKSZ, SEEK_SET) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in file \"%s\": %m",
+							readfilename)));
+
+		/*
+		 * If the file was truncated while we were sending it, pad it with
+		 * zeros.  WAL replay will take care of it, as for a full file.
+		 */
+		cnt = fread(buf, 1, BLCKSZ, fp);
+		if (cnt < BLCKSZ)
+		{
+			if (ferror(fp))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not read file \"%s\": %m",
+								readfilename)));
+			MemSet(buf + cnt, 0, BLCKSZ - cnt);
+		}
+
+		send_tar_data(buf, BLCKSZ);
+		len += BLCKSZ;
+	}
+
+	/* Pad to 512 byte boundary, per tar format requirements. */
+	pad = ((len + 511) & ~511) - len;
+	if (pad > 0)
+	{
+		MemSet(buf, 0, pad);
+		send_tar_data(buf, pad);
+	}
+
+	FreeFile(fp);
+	pfree(blocks);
+
+	*sent = true;
+	return true;
+}
+
 /*****
  * Functions for handling tar file format
  *
@@ -1391,6 +1818,8 @@ sendFile(const char *readfilename, const char *tarfilename, struct stat *statbuf
 
 	_tarWriteHeader(tarfilename, NULL, statbuf, false);
 
+	prefetch_file(fp, 0, Min(PREFETCH_DISTANCE, statbuf->st_size));
+
 	if (!noverify_checksums && DataChecksumsEnabled())
 	{
 		char	   *filename;
@@ -1528,13 +1957,13 @@ sendFile(const char *readfilename, const char *tarfilename, struct stat *statbuf
 			}
 		}
 
-		/* Send the chunk as a CopyData message */
-		if (pq_putmessage('d', buf, cnt))
-			ereport(ERROR,
-					(errmsg("base backup could not send data, aborting backup")));
+		send_tar_data(buf, cnt);
 
 		len += cnt;
-		throttle(cnt);
+
+		/* Keep the read-ahead window moving. */
+		if (len + PREFETCH_DISTANCE - cnt < statbuf->st_size)
+			prefetch_file(fp, len + PREFETCH_DISTANCE - cnt, cnt);
 
 		if (len >= statbuf->st_size)
 		{
@@ -1554,21 +1983,17 @@ sendFile(const char *readfilename, const char *tarfilename, struct stat *statbuf
 		while (len < statbuf->st_size)
 		{
 			cnt = Min(sizeof(buf), statbuf->st_size - len);
-			pq_putmessage('d', buf, cnt);
+			send_tar_data(buf, cnt);
 			len += cnt;
-			throttle(cnt);
 		}
 	}
 
-	/*
-	 * Pad to 512 byte boundary, per tar format requirements. (This small
-	 * piece of data is probably not worth throttling.)
-	 */
+	/* Pad to 512 byte boundary, per tar format requirements. */
 	pad = ((len + 511) & ~511) - len;
 	if (pad > 0)
 	{
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		send_tar_data(buf, pad);
 	}
 
 	FreeFile(fp);
@@ -1620,7 +2045,7 @@ _tarWriteHeader(const char *filename, const char *linktarget,
 				elog(ERROR, "unrecognized tar error: %d", rc);
 		}
 
-		pq_putmessage('d', h, sizeof(h));
+		send_tar_data(h, sizeof(h));
 	}
 
 	return sizeof(h);
@@ -1718,3 +2143,304 @@ throttle(size_t increment)
 	 */
 	throttled_last = GetCurrentTimestamp();
 }
+
+/*
+ * Send a chunk of the current tar stream to the client as a CopyData message,
+ * throttling as requested.  With compression, this is compressed data.
+ */
+static void
+send_copy_data(const char *data, size_t len)
+{
+	if (pq_putmessage('d', data, len))
+		ereport(ERROR,
+				(errmsg("base backup could not send data, aborting backup")));
+
+	throttle(len);
+}
+
+#ifdef HAVE_LIBZ
+/*
+ * Memory allocation callbacks for zlib, so that its memory is released along
+ * with the memory context even if the backup fails.
+ */
+static void *
+gzip_palloc(void *opaque, unsigned items, unsigned size)
+{
+	return palloc((Size) items * size);
+}
+
+static void
+gzip_pfree(void *opaque, void *address)
+{
+	pfree(address);
+}
+
+/*
+ * Run the data through the deflate stream, sending any output it produces.
+ * With Z_FINISH, the stream is finished.
+ */
+static void
+gzip_deflate(const char *data, size_t len, int flush)
+{
+	int			rc;
+
+	zstream->next_in = (Bytef *) data;
+	zstream->avail_in = len;
+
+	do
+	{
+		zstream->next_out = (Bytef *) zbuffer;
+		zstream->avail_out = TAR_SEND_SIZE;
+
+		rc = deflate(zstream, flush);
+		if (rc == Z_STREAM_ERROR)
+			elog(ERROR, "could not compress data: %s",
+				 zstream->msg ? zstream->msg : "unknown error");
+
+		if (zstream->avail_out < TAR_SEND_SIZE)
+			send_copy_data(zbuffer, TAR_SEND_SIZE - zstream->avail_out);
+	} while (zstream->avail_in > 0 ||
+			 (flush == Z_FINISH && rc != Z_STREAM_END));
+}
+#endif
+
+#ifdef USE_LZ4
+/*
+ * Run the data through the lz4 frame compressor, sending any output it
+ * produces.  The output buffer only has room for the worst case of
+ * TAR_SEND_SIZE bytes of input, so larger inputs are fed in pieces.
+ */
+static void
+lz4_compress(const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		size_t		chunk = Min(len, TAR_SEND_SIZE);
+		size_t		written;
+
+		written = LZ4F_compressUpdate(lz4_cctx, lz4_buffer, lz4_buffer_size,
+									  data, chunk, NULL);
+		if (LZ4F_isError(written))
+			elog(ERROR, "could not compress data: %s",
+				 LZ4F_getErrorName(written));
+
+		if (written > 0)
+			send_copy_data(lz4_buffer, written);
+
+		data += chunk;
+		len -= chunk;
+	}
+}
+#endif
+
+#ifdef USE_ZSTD
+/*
+ * Run the data through the zstd stream, sending any output it produces.
+ * With ZSTD_e_end, the frame is finished.
+ */
+static void
+zstd_compress(const char *data, size_t len, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in = {data, len, 0};
+	size_t		remaining;
+
+	do
+	{
+		ZSTD_outBuffer out = {zstd_buffer, TAR_SEND_SIZE, 0};
+
+		remaining = ZSTD_compressStream2(zstd_cctx, &out, &in, mode);
+		if (ZSTD_isError(remaining))
+			elog(ERROR, "could not compress data: %s",
+				 ZSTD_getErrorName(remaining));
+
+		if (out.pos > 0)
+			send_copy_data(zstd_buffer, out.pos);
+	} while (in.pos < in.size ||
+			 (mode == ZSTD_e_end && remaining != 0));
+}
+#endif
+
+/*
+ * Start sending a tar file: send the CopyOutResponse message, and set up the
+ * compression of the data, if requested.
+ */
+static void
+start_tar_stream(void)
+{
+	StringInfoData buf;
+
+	/* Send CopyOutResponse message */
+	pq_beginmessage(&buf, 'H');
+	pq_sendbyte(&buf, 0);		/* overall format */
+	pq_sendint16(&buf, 0);		/* natts */
+	pq_endmessage(&buf);
+
+#ifdef HAVE_LIBZ
+	if (compression == BACKUP_COMPRESSION_GZIP)
+	{
+		zstream = palloc0(sizeof(z_stream));
+		zstream->zalloc = gzip_palloc;
+		zstream->zfree = gzip_pfree;
+		zbuffer = palloc(TAR_SEND_SIZE);
+
+		/* 15 + 16 selects the default window size with a gzip wrapper */
+		if (deflateInit2(zstream,
+						 compression_level < 0 ? Z_DEFAULT_COMPRESSION : compression_level,
+						 Z_DEFLATED, 15 + 16, 8,
+						 Z_DEFAULT_STRATEGY) != Z_OK)
+			elog(ERROR, "could not initialize compression library: %s",
+				 zstream->msg ? zstream->msg : "unknown error");
+	}
+#endif
+
+#ifdef USE_LZ4
+	if (compression == BACKUP_COMPRESSION_LZ4)
+	{
+		LZ4F_preferences_t prefs;
+		size_t		written;
+
+		if (lz4_buffer == NULL)
+		{
+			/* this is enough for LZ4F_compressBegin and LZ4F_compressEnd too */
+			lz4_buffer_size = LZ4F_compressBound(TAR_SEND_SIZE, NULL);
+			lz4_buffer = MemoryContextAlloc(TopMemoryContext, lz4_buffer_size);
+		}
+		if (lz4_cctx == NULL)
+		{
+			LZ4F_errorCode_t rc;
+
+			rc = LZ4F_createCompressionContext(&lz4_cctx, LZ4F_VERSION);
+			if (LZ4F_isError(rc))
+			{
+				lz4_cctx = NULL;
+				elog(ERROR, "could not initialize compression library: %s",
+					 LZ4F_getErrorName(rc));
+			}
+		}
+
+		/* level 0 selects the default, fast mode */
+		MemSet(&prefs, 0, sizeof(prefs));
+		prefs.compressionLevel = compression_level < 0 ? 0 : compression_level;
+
+		/* this also discards the state of any earlier, unfinished frame */
+		written = LZ4F_compressBegin(lz4_cctx, lz4_buffer, lz4_buffer_size,
+									 &prefs);
+		if (LZ4F_isError(written))
+			elog(ERROR, "could not compress data: %s",
+				 LZ4F_getErrorName(written));
+
+		send_copy_data(lz4_buffer, written);
+	}
+#endif
+
+#ifdef USE_ZSTD
+	if (compression == BACKUP_COMPRESSION_ZSTD)
+	{
+		size_t		rc;
+
+		if (zstd_buffer == NULL)
+			zstd_buffer = MemoryContextAlloc(TopMemoryContext, TAR_SEND_SIZE);
+		if (zstd_cctx == NULL)
+		{
+			zstd_cctx = ZSTD_createCCtx();
+			if (zstd_cctx == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_OUT_OF_MEMORY),
+						 errmsg("out of memory")));
+		}
+
+		/* Discard the state of any earlier, unfinished frame */
+		ZSTD_CCtx_reset(zstd_cctx, ZSTD_reset_session_and_parameters);
+
+		/* level 0 selects the default */
+		rc = ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_compressionLevel,
+									compression_level < 0 ? 0 : compression_level);
+		if (ZSTD_isError(rc))
+			elog(ERROR, "could not set compression level %d: %s",
+				 compression_level, ZSTD_getErrorName(rc));
+	}
+#endif
+}
+
+/*
+ * Add data to the tar file being sent.
+ */
+static void
+send_tar_data(const char *data, size_t len)
+{
+#ifdef HAVE_LIBZ
+	if (compression == BACKUP_COMPRESSION_GZIP)
+	{
+		gzip_deflate(data, len, Z_NO_FLUSH);
+		return;
+	}
+#endif
+#ifdef USE_LZ4
+	if (compression == BACKUP_COMPRESSION_LZ4)
+	{
+		lz4_compress(data, len);
+		return;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (compression == BACKUP_COMPRESSION_ZSTD)
+	{
+		zstd_compress(data, len, ZSTD_e_continue);
+		return;
+	}
+#endif
+
+	send_copy_data(data, len);
+}
+
+/*
+ * Finish the tar file being sent: flush the compressed data, if any, and
+ * send the CopyDone message.
+ */
+static void
+end_tar_stream(void)
+{
+#ifdef HAVE_LIBZ
+	if (compression == BACKUP_COMPRESSION_GZIP)
+	{
+		gzip_deflate(NULL, 0, Z_FINISH);
+		deflateEnd(zstream);
+		pfree(zstream);
+		pfree(zbuffer);
+		zstream = NULL;
+		zbuffer = NULL;
+	}
+#endif
+#ifdef USE_LZ4
+	if (compression == BACKUP_COMPRESSION_LZ4)
+	{
+		size_t		written;
+
+		written = LZ4F_compressEnd(lz4_cctx, lz4_buffer, lz4_buffer_size,
+								   NULL);
+		if (LZ4F_isError(written))
+			elog(ERROR, "could not compress data: %s",
+				 LZ4F_getErrorName(written));
+
+		send_copy_data(lz4_buffer, written);
+	}
+#endif
+#ifdef USE_ZSTD
+	if (compression == BACKUP_COMPRESSION_ZSTD)
+		zstd_compress(NULL, 0, ZSTD_e_end);
+#endif
+
+	pq_putemptymessage('c');	/* CopyDone */
+}
+
+/*
+ * Ask the kernel to start reading the given range of the file, so that it's
+ * likely to be in the page cache by the time we read it.
+ */
+static void
+prefetch_file(FILE *fp, pgoff_t offset, pgoff_t len)
+{
+#if defined(USE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+	(void) posix_fadvise(fileno(fp), offset, len, POSIX_FADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,1698 @@
+/*-------------------------------------------------------------------------
+ * applyparallelworker.c
+ *	   Parallel apply of logical replication transactions
+ *
+ * Copyright (c) 2019, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/replication/logical/applyparallelworker.c
+ *
+ * NOTES
+ *	  This file contains the code used by an apply worker of a subscription
+ *	  with the parallel_apply option to hand remote transactions over to a
+ *	  pool of parallel apply workers, and the main routine of those workers.
+ *
+ *	  The apply worker (the "leader") keeps reading the replication stream.
+ *	  When a transaction begins, it picks an idle parallel apply worker, or
+ *	  launches a new one, up to max_parallel_apply_workers_per_subscription,
+ *	  and forwards all messages of the transaction to it through a shm_mq in
+ *	  a dynamic shared memory segment set up for that worker.  The worker
+ *	  applies the messages using the regular apply code.
+ *
+ *	  Two transactions may only be applied concurrently if they don't modify
+ *	  the same rows.  The leader tracks the rows modified by the transactions
+ *	  in flight by a hash of the relation and the replica identity key of the
+ *	  changed rows.  Before it forwards a change touching a row that an
+ *	  earlier transaction still being applied has modified too, it waits for
+ *	  that transaction to commit.  Changes for which no key can be determined
+ *	  (such as an unchanged, TOASTed key column) and TRUNCATE wait for all
+ *	  earlier transactions instead, and the transaction following a TRUNCATE
+ *	  is only dispatched once the TRUNCATE has been committed.
+ *
+ *	  The values of the other unique indexes of the subscriber's table are
+ *	  tracked the same way, so that a row taking a value that an earlier
+ *	  transaction frees waits for it.  The old values of an updated or
+ *	  deleted row are only known if they are part of the replica identity;
+ *	  otherwise, a later transaction storing any value in that index waits
+ *	  for the earlier one.  Changes of tables with unique indexes that can't
+ *	  be tracked, such as expression or partial indexes, wait for all earlier
+ *	  transactions.
+ *
+ *	  Transactions are committed in the order the publisher committed them:
+ *	  once a worker has applied a transaction, it waits for the leader to
+ *	  allow it to commit, which happens when all earlier transactions have
+ *	  been committed.  Hence the replication origin progress, and the flush
+ *	  position reported to the publisher, never run ahead of a transaction
+ *	  that's not committed yet.
+ *
+ *	  Dependencies that aren't visible through the keys of the rows, for
+ *	  example through triggers or foreign keys of the subscriber, can lead to
+ *	  a worker waiting for a lock held by a worker that is waiting for its
+ *	  turn to commit.  The leader checks for that situation and raises an
+ *	  error, so the apply worker restarts.  It records the commit LSN of the
+ *	  last transaction in flight in shared memory, and after the restart,
+ *	  applies the transactions up to that one serially, so that it doesn't
+ *	  run into the same situation again.
+ *
+ *	  While tables are being synchronized, and for transactions streamed by
+ *	  the publisher, the leader waits for all transactions in flight and then
+ *	  applies the transaction itself.  The same happens if no parallel apply
+ *	  worker can be started.
+ *
+ *	  RELATION and TYPE messages are applied by the leader, which remembers
+ *	  the last one for each relation and type.  Each worker is sent those it
+ *	  hasn't seen yet before a transaction is dispatched to it.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_index.h"
+#include "libpq/pqformat.h"
+#include "libpq/pqsignal.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "replication/logicallauncher.h"
+#include "replication/logicalproto.h"
+#include "replication/logicalrelation.h"
+#include "replication/logicalworker.h"
+#include "replication/origin.h"
+#include "replication/worker_internal.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/lock.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/hashutils.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+
+#define PARALLEL_APPLY_MAGIC			0x50415057
+
+#define PARALLEL_APPLY_KEY_SHARED		1
+#define PARALLEL_APPLY_KEY_MQ			2
+
+/* Size of the queue between the leader and a parallel apply worker. */
+#define PARALLEL_APPLY_QUEUE_SIZE		(16 * 1024 * 1024)
+
+/* Number of tracked rows above which committed ones are forgotten. */
+#define PARALLEL_APPLY_MAX_DEPENDENCIES	65536
+
+/* Max time to sleep before rechecking the state of the workers (1s). */
+#define PARALLEL_APPLY_NAPTIME			1000L
+
+typedef enum ParallelApplyWorkerStatus
+{
+	PARALLEL_APPLY_IDLE,		/* no transaction, or committed the last */
+	PARALLEL_APPLY_BUSY,		/* applying a transaction */
+	PARALLEL_APPLY_READY_TO_COMMIT, /* waiting for its turn to commit */
+	PARALLEL_APPLY_COMMIT_ALLOWED,	/* committing */
+	PARALLEL_APPLY_EXITED		/* worker has exited */
+} ParallelApplyWorkerStatus;
+
+/*
+ * State shared between the leader and a parallel apply worker, in the
+ * worker's dynamic shared memory segment.
+ */
+typedef struct ParallelApplyWorkerShared
+{
+	slock_t		mutex;
+
+	ParallelApplyWorkerStatus status;
+
+	/* End LSNs of the last transaction the worker committed. */
+	XLogRecPtr	remote_end;
+	XLogRecPtr	local_end;
+
+	/* Processes to wake up, for the leader and the worker respectively. */
+	PGPROC	   *leader_proc;
+	PGPROC	   *worker_proc;
+} ParallelApplyWorkerShared;
+
+/* Leader's information about one of its parallel apply workers. */
+typedef struct ParallelApplyWorkerInfo
+{
+	dsm_segment *seg;
+	ParallelApplyWorkerShared *shared;
+	shm_mq_handle *mqh;
+
+	/* Sequence number and commit LSN of the transaction dispatched last. */
+	uint64		seqno;
+	XLogRecPtr	final_lsn;
+
+	/* Is that transaction still to be committed? */
+	bool		in_flight;
+
+	/* Version of the last RELATION or TYPE message the worker was sent. */
+	uint64		schema_version;
+} ParallelApplyWorkerInfo;
+
+/*
+ * RELATION or TYPE message remembered by the leader, so it can be sent to
+ * the workers that haven't seen it.
+ */
+typedef struct ParallelApplySchemaKey
+{
+	char		action;			/* 'R' or 'Y' */
+	Oid			remoteid;		/* remote relation or type id */
+} ParallelApplySchemaKey;
+
+typedef struct ParallelApplySchemaEntry
+{
+	ParallelApplySchemaKey key; /* hash key (must be first) */
+	uint64		version;		/* when the message was received */
+	char	   *data;			/* message, starting with the action byte */
+	int			len;
+	LogicalRepRelation *rel;	/* parsed message, for relations */
+
+	/* Unique indexes of the local table, for relations. */
+	bool		unique_valid;	/* are the fields below valid? */
+	Oid			localreloid;	/* local table, to match invalidations */
+	bool		unique_untracked;	/* any index we can't track? */
+	List	   *unique_keys;	/* ParallelApplyUniqueKey for the others */
+} ParallelApplySchemaEntry;
+
+/* Unique index of a local table, other than the replica identity. */
+typedef struct ParallelApplyUniqueKey
+{
+	Oid			indexoid;
+	Bitmapset  *attkeys;		/* remote attribute numbers of its columns */
+} ParallelApplyUniqueKey;
+
+/* Last transaction in flight that modified a given row. */
+typedef struct ParallelApplyDependency
+{
+	uint32		keyhash;		/* hash of relation and key (hash key) */
+	uint64		seqno;
+} ParallelApplyDependency;
+
+/*
+ * Subscription whose transactions up to the given commit LSN are to be
+ * applied serially, after a parallel apply worker got stuck.
+ */
+typedef struct ParallelApplySerialEntry
+{
+	Oid			subid;			/* InvalidOid if the entry is free */
+	XLogRecPtr	until_lsn;
+} ParallelApplySerialEntry;
+
+/* Shared memory state, surviving restarts of the apply workers. */
+typedef struct ParallelApplyCtlData
+{
+	slock_t		mutex;
+	ParallelApplySerialEntry entries[FLEXIBLE_ARRAY_MEMBER];
+} ParallelApplyCtlData;
+
+static ParallelApplyCtlData *ParallelApplyCtl = NULL;
+
+/* Leader state. */
+static MemoryContext ParallelApplyContext = NULL;
+static List *pa_workers = NIL;	/* all parallel apply workers */
+static List *pa_in_flight = NIL;	/* workers by order of their transactions */
+static ParallelApplyWorkerInfo *pa_current = NULL;	/* receiving changes */
+static uint64 pa_next_seqno = 1;
+static uint64 pa_last_committed_seqno = 0;
+static bool pa_barrier_pending = false;
+static TimestampTz pa_last_launch_failure = 0;
+static HTAB *pa_dependencies = NULL;
+static HTAB *pa_schema_messages = NULL;
+static uint64 pa_schema_version = 0;
+
+/* To detect a transaction stuck at the head of the queue. */
+static uint64 pa_stall_seqno = 0;
+static TimestampTz pa_stall_since = 0;
+
+/* Commit LSN up to which to apply serially, read at the first transaction. */
+static bool pa_serial_checked = false;
+static XLogRecPtr pa_serial_until = InvalidXLogRecPtr;
+
+/* Parallel apply worker state. */
+static ParallelApplyWorkerShared *MyParallelShared = NULL;
+static shm_mq_handle *MyParallelMqh = NULL;
+
+static volatile sig_atomic_t got_SIGHUP = false;
+
+static void pa_wait(void);
+static void pa_wait_for_seqno(uint64 seqno);
+static void pa_check_for_stall(void);
+static XLogRecPtr pa_get_serial_until(void);
+static void pa_set_serial_until(XLogRecPtr until_lsn);
+static bool pa_begin(StringInfo s);
+static ParallelApplyWorkerInfo *pa_get_free_worker(void);
+static ParallelApplyWorkerInfo *pa_launch_worker(void);
+static void pa_prune_dependencies(void);
+static void pa_send(ParallelApplyWorkerInfo *winfo, const char *data, int len);
+static void pa_send_schema_messages(ParallelApplyWorkerInfo *winfo);
+static void pa_save_schema_message(const char *data, int len);
+static void pa_track_change(StringInfo s, char action);
+static void pa_track_tuple(LogicalRepRelId relid, LogicalRepTupleData *tuple,
+						   bool old);
+static bool pa_hash_columns(uint32 hash, Bitmapset *attkeys,
+							LogicalRepTupleData *tuple, uint32 *keyhash,
+							bool *isnull);
+static void pa_track_key(uint32 keyhash);
+static ParallelApplyDependency *pa_get_dependency(uint32 keyhash, bool create);
+static void pa_load_unique_keys(ParallelApplySchemaEntry *relentry);
+static void pa_free_unique_keys(ParallelApplySchemaEntry *relentry);
+static void pa_relcache_callback(Datum arg, Oid relid);
+
+/*
+ * Forward a message received by the apply worker to a parallel apply worker.
+ *
+ * Returns true if the message was forwarded, false if the apply worker has to
+ * apply it itself.
+ */
+bool
+pa_forward_message(StringInfo s, bool in_streamed_transaction)
+{
+	char		action;
+	char	   *data;
+	int			len;
+
+	if (!MySubscription->parallel_apply || am_tablesync_worker())
+		return false;
+
+	data = &s->data[s->cursor];
+	len = s->len - s->cursor;
+	action = data[0];
+
+	/*
+	 * Changes of streamed transactions are spooled by the apply worker, and
+	 * applied when they commit.  Only remember the relations and types, the
+	 * publisher won't send them again.  They carry the transaction ID, which
+	 * is left out.
+	 */
+	if (in_streamed_transaction)
+	{
+		if ((action == 'R' || action == 'Y') && len > 5)
+		{
+			char	   *msg = palloc(len - 4);
+
+			msg[0] = action;
+			memcpy(msg + 1, data + 5, len - 5);
+			pa_save_schema_message(msg, len - 4);
+			pfree(msg);
+		}
+		return false;
+	}
+
+	switch (action)
+	{
+		case 'B':
+			return pa_begin(s);
+
+		case 'C':
+			if (pa_current == NULL)
+				return false;
+			pa_send(pa_current, data, len);
+			pa_current = NULL;
+			in_remote_transaction = false;
+			return true;
+
+		case 'I':
+		case 'U':
+		case 'D':
+			if (pa_current == NULL)
+				return false;
+			pa_track_change(s, action);
+			pa_send(pa_current, data, len);
+			return true;
+
+		case 'T':
+			if (pa_current == NULL)
+				return false;
+
+			/*
+			 * Truncate once all earlier transactions are done, and don't
+			 * start the next transaction before this one is committed.
+			 */
+			pa_wait_for_seqno(pa_current->seqno - 1);
+			pa_barrier_pending = true;
+			pa_send(pa_current, data, len);
+			return true;
+
+		case 'O':
+			if (pa_current == NULL)
+				return false;
+			pa_send(pa_current, data, len);
+			return true;
+
+		case 'R':
+		case 'Y':
+			pa_save_schema_message(data, len);
+			if (pa_current != NULL)
+			{
+				pa_send(pa_current, data, len);
+				pa_current->schema_version = pa_schema_version;
+			}
+			/* the leader needs it, too */
+			return false;
+
+		case 'c':
+			/* streamed transactions are applied by the leader */
+			pa_wait_for_all();
+			return false;
+
+		default:
+			return false;
+	}
+}
+
+/*
+ * Handle BEGIN: dispatch the transaction to a parallel apply worker, or
+ * prepare for the leader to apply it.
+ */
+static bool
+pa_begin(StringInfo s)
+{
+	ParallelApplyWorkerInfo *winfo;
+	MemoryContext oldctx;
+	StringInfoData copy;
+	LogicalRepBeginData begin_data;
+
+	pa_process_worker_states();
+
+	if (pa_barrier_pending)
+	{
+		pa_wait_for_all();
+		pa_barrier_pending = false;
+	}
+
+	if (pa_dependencies != NULL &&
+		hash_get_num_entries(pa_dependencies) > PARALLEL_APPLY_MAX_DEPENDENCIES)
+		pa_prune_dependencies();
+
+	/* Pick up subscription and table state changes. */
+	AcceptInvalidationMessages();
+	maybe_reread_subscription();
+
+	/* Parse a copy of the message, skipping the action byte. */
+	copy = *s;
+	copy.cursor++;
+	logicalrep_read_begin(&copy, &begin_data);
+
+	/*
+	 * After parallel apply workers got stuck, apply serially until past the
+	 * transactions that were in flight.
+	 */
+	if (!pa_serial_checked)
+	{
+		pa_serial_until = pa_get_serial_until();
+		pa_serial_checked = true;
+	}
+	if (!XLogRecPtrIsInvalid(pa_serial_until))
+	{
+		if (begin_data.final_lsn <= pa_serial_until)
+		{
+			pa_wait_for_all();
+			return false;
+		}
+		pa_set_serial_until(InvalidXLogRecPtr);
+		pa_serial_until = InvalidXLogRecPtr;
+	}
+
+	/*
+	 * Table synchronization workers catch up with the apply worker based on
+	 * the transactions it has applied, so apply serially while any table is
+	 * not ready.
+	 */
+	if (!AllTablesyncsReady() ||
+		(winfo = pa_get_free_worker()) == NULL)
+	{
+		pa_wait_for_all();
+		return false;
+	}
+
+	winfo->seqno = pa_next_seqno++;
+	winfo->final_lsn = begin_data.final_lsn;
+	winfo->in_flight = true;
+
+	SpinLockAcquire(&winfo->shared->mutex);
+	winfo->shared->status = PARALLEL_APPLY_BUSY;
+	winfo->shared->remote_end = InvalidXLogRecPtr;
+	winfo->shared->local_end = InvalidXLogRecPtr;
+	SpinLockRelease(&winfo->shared->mutex);
+
+	oldctx = MemoryContextSwitchTo(ParallelApplyContext);
+	pa_in_flight = lappend(pa_in_flight, winfo);
+	MemoryContextSwitchTo(oldctx);
+	pa_current = winfo;
+
+	pa_send_schema_messages(winfo);
+	pa_send(winfo, &s->data[s->cursor], s->len - s->cursor);
+
+	in_remote_transaction = true;
+
+	return true;
+}
+
+/*
+ * Find a parallel apply worker without a transaction in flight, launching a
+ * new one if allowed.  If all are busy, wait for one to become available.
+ *
+ * Returns NULL if no worker could be started.
+ */
+static ParallelApplyWorkerInfo *
+pa_get_free_worker(void)
+{
+	for (;;)
+	{
+		ListCell   *lc;
+		TimestampTz now;
+
+		foreach(lc, pa_workers)
+		{
+			ParallelApplyWorkerInfo *winfo = lfirst(lc);
+
+			if (!winfo->in_flight)
+				return winfo;
+		}
+
+		/*
+		 * Don't retry failed worker launches too often, they may be due to
+		 * running out of worker slots.
+		 */
+		now = GetCurrentTimestamp();
+		if (list_length(pa_workers) < max_parallel_apply_workers_per_subscription &&
+			TimestampDifferenceExceeds(pa_last_launch_failure, now,
+									   wal_retrieve_retry_interval))
+		{
+			ParallelApplyWorkerInfo *winfo = pa_launch_worker();
+
+			if (winfo != NULL)
+				return winfo;
+
+			pa_last_launch_failure = now;
+		}
+
+		if (pa_in_flight == NIL)
+			return NULL;
+
+		pa_wait();
+	}
+}
+
+/*
+ * Set up the shared memory for a new parallel apply worker and start it.
+ */
+static ParallelApplyWorkerInfo *
+pa_launch_worker(void)
+{
+	shm_toc_estimator e;
+	Size		segsize;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	ParallelApplyWorkerShared *shared;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	ParallelApplyWorkerInfo *winfo;
+	MemoryContext oldctx;
+
+	if (ParallelApplyContext == NULL)
+		ParallelApplyContext = AllocSetContextCreate(ApplyContext,
+													 "ParallelApplyContext",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sizeof(ParallelApplyWorkerShared));
+	shm_toc_estimate_chunk(&e, (Size) PARALLEL_APPLY_QUEUE_SIZE);
+	shm_toc_estimate_keys(&e, 2);
+	segsize = shm_toc_estimate(&e);
+
+	seg = dsm_create(segsize, 0);
+	toc = shm_toc_create(PARALLEL_APPLY_MAGIC, dsm_segment_address(seg),
+						 segsize);
+
+	shared = shm_toc_allocate(toc, sizeof(ParallelApplyWorkerShared));
+	SpinLockInit(&shared->mutex);
+	shared->status = PARALLEL_APPLY_IDLE;
+	shared->remote_end = InvalidXLogRecPtr;
+	shared->local_end = InvalidXLogRecPtr;
+	shared->leader_proc = MyProc;
+	shared->worker_proc = NULL;
+	shm_toc_insert(toc, PARALLEL_APPLY_KEY_SHARED, shared);
+
+	mq = shm_mq_create(shm_toc_allocate(toc, (Size) PARALLEL_APPLY_QUEUE_SIZE),
+					   (Size) PARALLEL_APPLY_QUEUE_SIZE);
+	shm_toc_insert(toc, PARALLEL_APPLY_KEY_MQ, mq);
+	shm_mq_set_sender(mq, MyProc);
+
+	oldctx = MemoryContextSwitchTo(ParallelApplyContext);
+	mqh = shm_mq_attach(mq, seg, NULL);
+	MemoryContextSwitchTo(oldctx);
+
+	if (!logicalrep_worker_launch(MyLogicalRepWorker->dbid,
+								  MySubscription->oid,
+								  MySubscription->name,
+								  MyLogicalRepWorker->userid,
+								  InvalidOid,
+								  dsm_segment_handle(seg)))
+	{
+		dsm_detach(seg);
+		return NULL;
+	}
+
+	/* The segment has to stay around until the worker is gone. */
+	dsm_pin_mapping(seg);
+
+	winfo = MemoryContextAllocZero(ParallelApplyContext,
+								   sizeof(ParallelApplyWorkerInfo));
+	winfo->seg = seg;
+	winfo->shared = shared;
+	winfo->mqh = mqh;
+	winfo->in_flight = false;
+	winfo->schema_version = 0;
+
+	oldctx = MemoryContextSwitchTo(ParallelApplyContext);
+	pa_workers = lappend(pa_workers, winfo);
+	MemoryContextSwitchTo(oldctx);
+
+	return winfo;
+}
+
+/*
+ * Send a message to a parallel apply worker.
+ *
+ * While the queue is full, keep letting the workers commit; the worker may be
+ * waiting for that before it reads more messages.
+ */
+static void
+pa_send(ParallelApplyWorkerInfo *winfo, const char *data, int len)
+{
+	for (;;)
+	{
+		shm_mq_result result;
+
+		result = shm_mq_send(winfo->mqh, len, data, true);
+
+		if (result == SHM_MQ_SUCCESS)
+			return;
+		else if (result == SHM_MQ_DETACHED)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("could not send data to logical replication parallel apply worker")));
+
+		pa_wait();
+	}
+}
+
+/*
+ * Send a parallel apply worker the RELATION and TYPE messages received since
+ * it was sent a transaction last.
+ */
+static void
+pa_send_schema_messages(ParallelApplyWorkerInfo *winfo)
+{
+	HASH_SEQ_STATUS status;
+	ParallelApplySchemaEntry *entry;
+
+	if (pa_schema_messages == NULL ||
+		winfo->schema_version == pa_schema_version)
+		return;
+
+	hash_seq_init(&status, pa_schema_messages);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->version > winfo->schema_version)
+			pa_send(winfo, entry->data, entry->len);
+	}
+
+	winfo->schema_version = pa_schema_version;
+}
+
+/*
+ * Remember a RELATION or TYPE message.
+ */
+static void
+pa_save_schema_message(const char *data, int len)
+{
+	ParallelApplySchemaKey key;
+	ParallelApplySchemaEntry *entry;
+	StringInfoData s;
+	MemoryContext oldctx;
+	bool		found;
+
+	if (ParallelApplyContext == NULL)
+		ParallelApplyContext = AllocSetContextCreate(ApplyContext,
+													 "ParallelApplyContext",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	if (pa_schema_messages == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(ParallelApplySchemaKey);
+		ctl.entrysize = sizeof(ParallelApplySchemaEntry);
+		ctl.hcxt = ParallelApplyContext;
+		pa_schema_messages = hash_create("logical replication parallel apply schema messages",
+										 128, &ctl,
+										 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		CacheRegisterRelcacheCallback(pa_relcache_callback, (Datum) 0);
+	}
+
+	oldctx = MemoryContextSwitchTo(ParallelApplyContext);
+
+	s.data = (char *) data;
+	s.len = len;
+	s.cursor = 1;
+	s.maxlen = -1;
+
+	memset(&key, 0, sizeof(key));
+	key.action = data[0];
+	if (key.action == 'R')
+	{
+		LogicalRepRelation *rel = logicalrep_read_rel(&s);
+
+		key.remoteid = rel->remoteid;
+		entry = hash_search(pa_schema_messages, &key, HASH_ENTER, &found);
+		if (found && entry->rel != NULL)
+		{
+			int			i;
+
+			for (i = 0; i < entry->rel->natts; i++)
+				pfree(entry->rel->attnames[i]);
+			if (entry->rel->natts > 0)
+			{
+				pfree(entry->rel->attnames);
+				pfree(entry->rel->atttyps);
+			}
+			pfree(entry->rel->nspname);
+			pfree(entry->rel->relname);
+			bms_free(entry->rel->attkeys);
+			pfree(entry->rel);
+			pa_free_unique_keys(entry);
+		}
+		else
+			entry->unique_keys = NIL;
+		entry->rel = rel;
+		entry->localreloid = InvalidOid;
+		entry->unique_valid = false;
+	}
+	else
+	{
+		key.remoteid = pq_getmsgint(&s, 4);
+		entry = hash_search(pa_schema_messages, &key, HASH_ENTER, &found);
+		entry->rel = NULL;
+		entry->localreloid = InvalidOid;
+	}
+
+	if (found)
+		pfree(entry->data);
+	entry->data = palloc(len);
+	memcpy(entry->data, data, len);
+	entry->len = len;
+	entry->version = ++pa_schema_version;
+
+	MemoryContextSwitchTo(oldctx);
+}
+
+/*
+ * Record the rows modified by an INSERT, UPDATE or DELETE message, waiting
+ * for the earlier transactions in flight that modified the same rows.
+ */
+static void
+pa_track_change(StringInfo s, char action)
+{
+	StringInfoData copy;
+	LogicalRepRelId relid;
+	LogicalRepTupleData oldtup;
+	LogicalRepTupleData newtup;
+	bool		has_oldtup;
+
+	/* Parse a copy of the message, skipping the action byte. */
+	copy = *s;
+	copy.cursor++;
+
+	switch (action)
+	{
+		case 'I':
+			relid = logicalrep_read_insert(&copy, &newtup);
+			pa_track_tuple(relid, &newtup, false);
+			break;
+		case 'U':
+			relid = logicalrep_read_update(&copy, &has_oldtup, &oldtup,
+										   &newtup);
+			/*
+			 * Without an old tuple, the key is the one of the new tuple.  The
+			 * new values go first, to wait for the earlier transactions that
+			 * may have freed them before this one is recorded as doing so.
+			 */
+			pa_track_tuple(relid, &newtup, false);
+			pa_track_tuple(relid, has_oldtup ? &oldtup : &newtup, true);
+			break;
+		case 'D':
+			relid = logicalrep_read_delete(&copy, &oldtup);
+			pa_track_tuple(relid, &oldtup, true);
+			break;
+	}
+}
+
+/*
+ * Record the row identified by the replica identity columns of the given
+ * tuple, and its values in the other unique indexes of the local table, after
+ * waiting for the earlier transactions that modified them.  "old" is true for
+ * the row replaced by an UPDATE or DELETE, of which only the replica identity
+ * columns are known.
+ */
+static void
+pa_track_tuple(LogicalRepRelId relid, LogicalRepTupleData *tuple, bool old)
+{
+	ParallelApplySchemaKey key;
+	ParallelApplySchemaEntry *relentry = NULL;
+	ParallelApplyDependency *dep;
+	uint32		relhash;
+	uint32		keyhash;
+	bool		isnull;
+	ListCell   *lc;
+
+	memset(&key, 0, sizeof(key));
+	key.action = 'R';
+	key.remoteid = relid;
+	if (pa_schema_messages != NULL)
+		relentry = hash_search(pa_schema_messages, &key, HASH_FIND, NULL);
+
+	/* Without the relation's key, we can't know what the change conflicts with. */
+	if (relentry == NULL)
+	{
+		pa_wait_for_seqno(pa_current->seqno - 1);
+		return;
+	}
+
+	if (!relentry->unique_valid)
+		pa_load_unique_keys(relentry);
+	if (relentry->unique_untracked)
+	{
+		pa_wait_for_seqno(pa_current->seqno - 1);
+		return;
+	}
+
+	relhash = DatumGetUInt32(hash_uint32(relid));
+
+	/*
+	 * Rows of relations without replica identity can only be inserted, and
+	 * only conflict through the unique indexes checked below.
+	 */
+	if (!bms_is_empty(relentry->rel->attkeys))
+	{
+		if (!pa_hash_columns(relhash, relentry->rel->attkeys, tuple,
+							 &keyhash, &isnull))
+		{
+			pa_wait_for_seqno(pa_current->seqno - 1);
+			return;
+		}
+		pa_track_key(keyhash);
+	}
+
+	foreach(lc, relentry->unique_keys)
+	{
+		ParallelApplyUniqueKey *ukey = lfirst(lc);
+		uint32		indexhash;
+
+		indexhash = hash_combine(relhash,
+								 DatumGetUInt32(hash_uint32(ukey->indexoid)));
+
+		if (old && !bms_is_subset(ukey->attkeys, relentry->rel->attkeys))
+		{
+			/*
+			 * This transaction may free any value of the index.  Record that
+			 * under the hash of the index alone, for the later transactions
+			 * storing a value in it to wait for.
+			 */
+			dep = pa_get_dependency(indexhash, true);
+			dep->seqno = pa_current->seqno;
+			continue;
+		}
+
+		if (!old)
+		{
+			dep = pa_get_dependency(indexhash, false);
+			if (dep != NULL && dep->seqno < pa_current->seqno)
+				pa_wait_for_seqno(dep->seqno);
+		}
+
+		if (!pa_hash_columns(indexhash, ukey->attkeys, tuple,
+							 &keyhash, &isnull))
+		{
+			pa_wait_for_seqno(pa_current->seqno - 1);
+			return;
+		}
+
+		/* Null values don't conflict with anything. */
+		if (!isnull)
+			pa_track_key(keyhash);
+	}
+}
+
+/*
+ * Combine the hash of the values of the given columns of a tuple into
+ * "hash".  Returns false if a value is not known, because it belongs to an
+ * unchanged TOASTed column.  *isnull is set if any of the values is null.
+ */
+static bool
+pa_hash_columns(uint32 hash, Bitmapset *attkeys, LogicalRepTupleData *tuple,
+				uint32 *keyhash, bool *isnull)
+{
+	int			i;
+
+	*isnull = false;
+	i = -1;
+	while ((i = bms_next_member(attkeys, i)) >= 0)
+	{
+		uint32		colhash = 0;
+
+		if (!tuple->changed[i])
+			return false;
+
+		if (tuple->values[i] != NULL)
+			colhash = DatumGetUInt32(hash_any((unsigned char *) tuple->values[i],
+											  strlen(tuple->values[i])));
+		else
+			*isnull = true;
+		hash = hash_combine(hash, colhash);
+	}
+
+	*keyhash = hash;
+	return true;
+}
+
+/*
+ * Wait for the earlier transaction in flight that modified the row or value
+ * with the given hash, and record the current transaction as modifying it.
+ */
+static void
+pa_track_key(uint32 keyhash)
+{
+	ParallelApplyDependency *dep = pa_get_dependency(keyhash, true);
+
+	if (dep->seqno != 0 && dep->seqno < pa_current->seqno)
+		pa_wait_for_seqno(dep->seqno);
+	dep->seqno = pa_current->seqno;
+}
+
+/*
+ * Look up the dependency entry of the given hash.  If "create" is true, a
+ * missing entry is created, with a seqno of 0; otherwise NULL is returned.
+ */
+static ParallelApplyDependency *
+pa_get_dependency(uint32 keyhash, bool create)
+{
+	ParallelApplyDependency *dep;
+	bool		found;
+
+	if (pa_dependencies == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!create)
+			return NULL;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(uint32);
+		ctl.entrysize = sizeof(ParallelApplyDependency);
+		ctl.hcxt = ParallelApplyContext;
+		pa_dependencies = hash_create("logical replication parallel apply dependencies",
+									  1024, &ctl,
+									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	dep = hash_search(pa_dependencies, &keyhash,
+					  create ? HASH_ENTER : HASH_FIND, &found);
+	if (dep != NULL && !found)
+		dep->seqno = 0;
+
+	return dep;
+}
+
+/*
+ * Look up the unique indexes of the local table of a relation, other than
+ * the one of the replica identity.
+ */
+static void
+pa_load_unique_keys(ParallelApplySchemaEntry *relentry)
+{
+	MemoryContext oldctx = CurrentMemoryContext;
+	LogicalRepRelMapEntry *rel;
+	bool		started_tx = false;
+	List	   *indexoids;
+	ListCell   *lc;
+
+	pa_free_unique_keys(relentry);
+
+	if (!IsTransactionState())
+	{
+		StartTransactionCommand();
+		started_tx = true;
+	}
+
+	rel = logicalrep_rel_open(relentry->key.remoteid, AccessShareLock);
+	relentry->localreloid = RelationGetRelid(rel->localrel);
+
+	MemoryContextSwitchTo(ParallelApplyContext);
+	indexoids = RelationGetIndexList(rel->localrel);
+	foreach(lc, indexoids)
+	{
+		Oid			indexoid = lfirst_oid(lc);
+		HeapTuple	indtup;
+		Form_pg_index index;
+		Bitmapset  *attkeys = NULL;
+		bool		untracked;
+		int			i;
+
+		indtup = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(indexoid));
+		if (!HeapTupleIsValid(indtup))
+			elog(ERROR, "cache lookup failed for index %u", indexoid);
+		index = (Form_pg_index) GETSTRUCT(indtup);
+
+		if (!index->indisunique && !index->indisexclusion)
+		{
+			ReleaseSysCache(indtup);
+			continue;
+		}
+
+		/*
+		 * Exclusion constraints, expressions and predicates can't be checked
+		 * by comparing the values of the columns.
+		 */
+		untracked = index->indisexclusion ||
+			!heap_attisnull(indtup, Anum_pg_index_indexprs, NULL) ||
+			!heap_attisnull(indtup, Anum_pg_index_indpred, NULL);
+
+		for (i = 0; i < index->indnkeyatts && !untracked; i++)
+		{
+			AttrNumber	attnum = index->indkey.values[i];
+
+			/* Columns not sent by the publisher are filled in locally. */
+			if (attnum <= 0 || rel->attrmap[attnum - 1] < 0)
+				untracked = true;
+			else
+				attkeys = bms_add_member(attkeys, rel->attrmap[attnum - 1]);
+		}
+		ReleaseSysCache(indtup);
+
+		if (untracked)
+		{
+			relentry->unique_untracked = true;
+			bms_free(attkeys);
+			break;
+		}
+
+		/* Any conflict on the replica identity is tracked already. */
+		if (!bms_is_empty(relentry->rel->attkeys) &&
+			bms_is_subset(relentry->rel->attkeys, attkeys))
+			bms_free(attkeys);
+		else
+		{
+			ParallelApplyUniqueKey *ukey = palloc(sizeof(ParallelApplyUniqueKey));
+
+			ukey->indexoid = indexoid;
+			ukey->attkeys = attkeys;
+			relentry->unique_keys = lappend(relentry->unique_keys, ukey);
+		}
+	}
+	list_free(indexoids);
+
+	logicalrep_rel_close(rel, AccessShareLock);
+
+	if (started_tx)
+		CommitTransactionCommand();
+	MemoryContextSwitchTo(oldctx);
+
+	relentry->unique_valid = true;
+}
+
+/*
+ * Forget the unique indexes of the local table of a relation.
+ */
+static void
+pa_free_unique_keys(ParallelApplySchemaEntry *relentry)
+{
+	ListCell   *lc;
+
+	foreach(lc, relentry->unique_keys)
+	{
+		ParallelApplyUniqueKey *ukey = lfirst(lc);
+
+		bms_free(ukey->attkeys);
+		pfree(ukey);
+	}
+	list_free(relentry->unique_keys);
+	relentry->unique_keys = NIL;
+	relentry->unique_untracked = false;
+	relentry->unique_valid = false;
+}
+
+/*
+ * Relcache invalidation callback: the indexes of a local table may have
+ * changed.
+ */
+static void
+pa_relcache_callback(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	ParallelApplySchemaEntry *entry;
+
+	hash_seq_init(&status, pa_schema_messages);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || entry->localreloid == relid)
+			entry->unique_valid = false;
+	}
+}
+
+/*
+ * Forget the rows modified by transactions that have been committed.
+ */
+static void
+pa_prune_dependencies(void)
+{
+	HASH_SEQ_STATUS status;
+	ParallelApplyDependency *dep;
+
+	hash_seq_init(&status, pa_dependencies);
+	while ((dep = hash_seq_search(&status)) != NULL)
+	{
+		if (dep->seqno <= pa_last_committed_seqno)
+			hash_search(pa_dependencies, &dep->keyhash, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * Check the state of the parallel apply workers: allow the first transaction
+ * in flight to commit, and collect the committed transactions.
+ */
+void
+pa_process_worker_states(void)
+{
+	ListCell   *lc;
+
+	foreach(lc, pa_workers)
+	{
+		ParallelApplyWorkerInfo *winfo = lfirst(lc);
+		ParallelApplyWorkerStatus status;
+
+		SpinLockAcquire(&winfo->shared->mutex);
+		status = winfo->shared->status;
+		SpinLockRelease(&winfo->shared->mutex);
+
+		if (status != PARALLEL_APPLY_EXITED)
+			continue;
+
+		if (winfo->in_flight)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("logical replication parallel apply worker for subscription \"%s\" exited unexpectedly",
+							MySubscription->name)));
+
+		pa_workers = foreach_delete_current(pa_workers, lc);
+		dsm_detach(winfo->seg);
+		pfree(winfo);
+	}
+
+	while (pa_in_flight != NIL)
+	{
+		ParallelApplyWorkerInfo *winfo = linitial(pa_in_flight);
+		ParallelApplyWorkerShared *shared = winfo->shared;
+		ParallelApplyWorkerStatus status;
+		XLogRecPtr	remote_end;
+		XLogRecPtr	local_end;
+
+		SpinLockAcquire(&shared->mutex);
+		status = shared->status;
+		remote_end = shared->remote_end;
+		local_end = shared->local_end;
+		if (status == PARALLEL_APPLY_READY_TO_COMMIT)
+			shared->status = PARALLEL_APPLY_COMMIT_ALLOWED;
+		SpinLockRelease(&shared->mutex);
+
+		if (status == PARALLEL_APPLY_READY_TO_COMMIT)
+		{
+			SetLatch(&shared->worker_proc->procLatch);
+			break;
+		}
+		else if (status != PARALLEL_APPLY_IDLE)
+			break;
+
+		/* Committed. */
+		pa_in_flight = list_delete_first(pa_in_flight);
+		winfo->in_flight = false;
+		pa_last_committed_seqno = winfo->seqno;
+
+		if (!XLogRecPtrIsInvalid(local_end))
+		{
+			MemoryContext oldctx = CurrentMemoryContext;
+
+			store_flush_position(remote_end, local_end);
+			MemoryContextSwitchTo(oldctx);
+		}
+	}
+
+	/* Nothing left to conflict with. */
+	if (pa_in_flight == NIL && pa_current == NULL && pa_dependencies != NULL)
+	{
+		hash_destroy(pa_dependencies);
+		pa_dependencies = NULL;
+	}
+
+	pa_check_for_stall();
+}
+
+/*
+ * Check whether the first transaction in flight is waiting for a lock held
+ * by a worker applying a later transaction.  The later transaction can't
+ * commit before the first one, so neither would ever make progress.
+ */
+static void
+pa_check_for_stall(void)
+{
+	ParallelApplyWorkerInfo *head;
+	PGPROC	   *head_proc;
+	BlockedProcsData *blocked;
+	TimestampTz now;
+	int			i;
+
+	if (list_length(pa_in_flight) < 2)
+	{
+		pa_stall_since = 0;
+		return;
+	}
+
+	head = linitial(pa_in_flight);
+	now = GetCurrentTimestamp();
+	if (pa_stall_since == 0 || pa_stall_seqno != head->seqno)
+	{
+		pa_stall_seqno = head->seqno;
+		pa_stall_since = now;
+		return;
+	}
+
+	if (!TimestampDifferenceExceeds(pa_stall_since, now, DeadlockTimeout))
+		return;
+	pa_stall_since = now;
+
+	SpinLockAcquire(&head->shared->mutex);
+	head_proc = head->shared->worker_proc;
+	SpinLockRelease(&head->shared->mutex);
+	if (head_proc == NULL)
+		return;
+
+	blocked = GetBlockerStatusData(head_proc->pid);
+
+	for (i = 0; i < blocked->nprocs; i++)
+	{
+		BlockedProcData *bproc = &blocked->procs[i];
+		LockInstanceData *instances = &blocked->locks[bproc->first_lock];
+		LockInstanceData *waiting = NULL;
+		LockMethod	lockMethodTable;
+		int			conflictMask;
+		int			j;
+
+		for (j = 0; j < bproc->num_locks; j++)
+		{
+			if (instances[j].pid == bproc->pid)
+				waiting = &instances[j];
+		}
+		if (waiting == NULL)
+			continue;
+
+		lockMethodTable = GetLockTagsMethodTable(&waiting->locktag);
+		conflictMask = lockMethodTable->conflictTab[waiting->waitLockMode];
+
+		for (j = 0; j < bproc->num_locks; j++)
+		{
+			LockInstanceData *instance = &instances[j];
+			ListCell   *lc;
+
+			if (instance == waiting || !(conflictMask & instance->holdMask))
+				continue;
+
+			for_each_cell(lc, pa_in_flight, list_second_cell(pa_in_flight))
+			{
+				ParallelApplyWorkerInfo *winfo = lfirst(lc);
+				PGPROC	   *proc;
+
+				SpinLockAcquire(&winfo->shared->mutex);
+				proc = winfo->shared->worker_proc;
+				SpinLockRelease(&winfo->shared->mutex);
+
+				if (proc != NULL && proc->pid == instance->pid)
+				{
+					ParallelApplyWorkerInfo *last = llast(pa_in_flight);
+
+					pa_set_serial_until(last->final_lsn);
+					ereport(ERROR,
+							(errcode(ERRCODE_T_R_DEADLOCK_DETECTED),
+							 errmsg("deadlock detected between logical replication parallel apply workers for subscription \"%s\"",
+									MySubscription->name),
+							 errdetail("Process %d waits for a lock held by process %d, which applies a later transaction.",
+									   bproc->pid, instance->pid),
+							 errhint("The transactions conflict on something other than the keys of the rows. "
+									 "They will be applied serially after the restart. "
+									 "If this keeps happening, disable the parallel_apply option of the subscription.")));
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Look up the commit LSN up to which transactions of the subscription are to
+ * be applied serially, or InvalidXLogRecPtr.
+ */
+static XLogRecPtr
+pa_get_serial_until(void)
+{
+	XLogRecPtr	until_lsn = InvalidXLogRecPtr;
+	int			i;
+
+	SpinLockAcquire(&ParallelApplyCtl->mutex);
+	for (i = 0; i < max_logical_replication_workers; i++)
+	{
+		if (ParallelApplyCtl->entries[i].subid == MySubscription->oid)
+		{
+			until_lsn = ParallelApplyCtl->entries[i].until_lsn;
+			break;
+		}
+	}
+	SpinLockRelease(&ParallelApplyCtl->mutex);
+
+	return until_lsn;
+}
+
+/*
+ * Set the commit LSN up to which transactions of the subscription are to be
+ * applied serially, or clear it if InvalidXLogRecPtr is given.
+ */
+static void
+pa_set_serial_until(XLogRecPtr until_lsn)
+{
+	ParallelApplySerialEntry *entry = NULL;
+	int			i;
+
+	SpinLockAcquire(&ParallelApplyCtl->mutex);
+	for (i = 0; i < max_logical_replication_workers; i++)
+	{
+		ParallelApplySerialEntry *cur = &ParallelApplyCtl->entries[i];
+
+		if (cur->subid == MySubscription->oid)
+		{
+			entry = cur;
+			break;
+		}
+		if (entry == NULL && !OidIsValid(cur->subid))
+			entry = cur;
+	}
+
+	/* There is an entry for each apply worker that can run. */
+	if (entry != NULL)
+	{
+		if (XLogRecPtrIsInvalid(until_lsn))
+			entry->subid = InvalidOid;
+		else
+			entry->subid = MySubscription->oid;
+		entry->until_lsn = until_lsn;
+	}
+	SpinLockRelease(&ParallelApplyCtl->mutex);
+}
+
+/*
+ * Report shared memory space needed by ParallelApplyShmemInit.
+ */
+Size
+ParallelApplyShmemSize(void)
+{
+	return add_size(offsetof(ParallelApplyCtlData, entries),
+					mul_size(max_logical_replication_workers,
+							 sizeof(ParallelApplySerialEntry)));
+}
+
+/*
+ * Allocate and initialize the shared memory of parallel apply.
+ */
+void
+ParallelApplyShmemInit(void)
+{
+	bool		found;
+
+	ParallelApplyCtl = (ParallelApplyCtlData *)
+		ShmemInitStruct("Logical Replication Parallel Apply Data",
+						ParallelApplyShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		memset(ParallelApplyCtl, 0, ParallelApplyShmemSize());
+		SpinLockInit(&ParallelApplyCtl->mutex);
+	}
+}
+
+/*
+ * Wait for something to happen to the parallel apply workers.
+ */
+static void
+pa_wait(void)
+{
+	int			rc;
+
+	rc = WaitLatch(MyLatch,
+				   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+				   PARALLEL_APPLY_NAPTIME,
+				   WAIT_EVENT_LOGICAL_PARALLEL_APPLY_WAIT);
+
+	if (rc & WL_LATCH_SET)
+		ResetLatch(MyLatch);
+
+	CHECK_FOR_INTERRUPTS();
+
+	pa_process_worker_states();
+}
+
+/*
+ * Wait until all transactions up to the given one have been committed.
+ */
+static void
+pa_wait_for_seqno(uint64 seqno)
+{
+	pa_process_worker_states();
+
+	while (pa_last_committed_seqno < seqno)
+		pa_wait();
+}
+
+/*
+ * Wait until all transactions dispatched to parallel apply workers have been
+ * committed.
+ */
+void
+pa_wait_for_all(void)
+{
+	Assert(pa_current == NULL);
+
+	pa_process_worker_states();
+
+	while (pa_in_flight != NIL)
+		pa_wait();
+}
+
+/*
+ * Are there transactions dispatched to parallel apply workers that are not
+ * committed yet?
+ */
+bool
+pa_transactions_in_flight(void)
+{
+	return pa_in_flight != NIL;
+}
+
+/*
+ * Called by a parallel apply worker once it has applied a transaction: wait
+ * until the leader allows it to commit.
+ */
+void
+pa_wait_for_commit_turn(void)
+{
+	PGPROC	   *leader_proc;
+
+	Assert(am_parallel_apply_worker());
+
+	SpinLockAcquire(&MyParallelShared->mutex);
+	MyParallelShared->status = PARALLEL_APPLY_READY_TO_COMMIT;
+	leader_proc = MyParallelShared->leader_proc;
+	SpinLockRelease(&MyParallelShared->mutex);
+
+	SetLatch(&leader_proc->procLatch);
+
+	for (;;)
+	{
+		ParallelApplyWorkerStatus status;
+		shm_mq_result result;
+		Size		len;
+		void	   *data;
+		int			rc;
+
+		SpinLockAcquire(&MyParallelShared->mutex);
+		status = MyParallelShared->status;
+		SpinLockRelease(&MyParallelShared->mutex);
+
+		if (status == PARALLEL_APPLY_COMMIT_ALLOWED)
+			break;
+
+		/* Nothing is sent until we commit, but notice if the leader exits. */
+		result = shm_mq_receive(MyParallelMqh, &len, &data, true);
+		if (result == SHM_MQ_DETACHED)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("logical replication apply worker for subscription \"%s\" exited before transaction could be committed",
+							MySubscription->name)));
+		else if (result == SHM_MQ_SUCCESS)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg_internal("unexpected message while waiting to commit")));
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+					   PARALLEL_APPLY_NAPTIME,
+					   WAIT_EVENT_LOGICAL_PARALLEL_APPLY_COMMIT_TURN);
+
+		if (rc & WL_LATCH_SET)
+			ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Called by a parallel apply worker once it has committed a transaction (or
+ * found there was nothing to commit, in which case local_end is invalid).
+ */
+void
+pa_report_commit(XLogRecPtr remote_end, XLogRecPtr local_end)
+{
+	PGPROC	   *leader_proc;
+
+	Assert(am_parallel_apply_worker());
+
+	SpinLockAcquire(&MyParallelShared->mutex);
+	MyParallelShared->remote_end = remote_end;
+	MyParallelShared->local_end = local_end;
+	MyParallelShared->status = PARALLEL_APPLY_IDLE;
+	leader_proc = MyParallelShared->leader_proc;
+	SpinLockRelease(&MyParallelShared->mutex);
+
+	SetLatch(&leader_proc->procLatch);
+}
+
+/*
+ * Let the leader know we're gone.
+ */
+static void
+pa_worker_onexit(int code, Datum arg)
+{
+	PGPROC	   *leader_proc;
+
+	SpinLockAcquire(&MyParallelShared->mutex);
+	MyParallelShared->status = PARALLEL_APPLY_EXITED;
+	leader_proc = MyParallelShared->leader_proc;
+	SpinLockRelease(&MyParallelShared->mutex);
+
+	SetLatch(&leader_proc->procLatch);
+}
+
+/* SIGHUP: set flag to reload configuration at next convenient time */
+static void
+pa_worker_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_SIGHUP = true;
+
+	/* Waken anything waiting on the process latch */
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/* Logical replication parallel apply worker entry point */
+void
+ParallelApplyWorkerMain(Datum main_arg)
+{
+	int			worker_slot = DatumGetInt32(main_arg);
+	dsm_handle	handle;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	shm_mq	   *mq;
+	MemoryContext oldctx;
+	char		originname[NAMEDATALEN];
+	RepOriginId originid;
+
+	/* Attach to slot */
+	logicalrep_worker_attach(worker_slot);
+
+	/* Setup signal handling */
+	pqsignal(SIGHUP, pa_worker_sighup);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Attach to the shared memory set up by the leader. */
+	memcpy(&handle, MyBgworkerEntry->bgw_extra, sizeof(dsm_handle));
+	seg = dsm_attach(handle);
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+
+	toc = shm_toc_attach(PARALLEL_APPLY_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("invalid magic number in dynamic shared memory segment")));
+
+	MyParallelShared = shm_toc_lookup(toc, PARALLEL_APPLY_KEY_SHARED, false);
+	SpinLockAcquire(&MyParallelShared->mutex);
+	MyParallelShared->worker_proc = MyProc;
+	SpinLockRelease(&MyParallelShared->mutex);
+	before_shmem_exit(pa_worker_onexit, (Datum) 0);
+
+	mq = shm_toc_lookup(toc, PARALLEL_APPLY_KEY_MQ, false);
+	shm_mq_set_receiver(mq, MyProc);
+	MyParallelMqh = shm_mq_attach(mq, seg, NULL);
+
+	/* Initialise stats to a sanish value */
+	MyLogicalRepWorker->last_send_time = MyLogicalRepWorker->last_recv_time =
+		MyLogicalRepWorker->reply_time = GetCurrentTimestamp();
+
+	/* Run as replica session replication role. */
+	SetConfigOption("session_replication_role", "replica",
+					PGC_SUSET, PGC_S_OVERRIDE);
+
+	/* Connect to our database. */
+	BackgroundWorkerInitializeConnectionByOid(MyLogicalRepWorker->dbid,
+											  MyLogicalRepWorker->userid,
+											  0);
+
+	/* Load the subscription into persistent memory context. */
+	ApplyContext = AllocSetContextCreate(TopMemoryContext,
+										 "ApplyContext",
+										 ALLOCSET_DEFAULT_SIZES);
+	StartTransactionCommand();
+	oldctx = MemoryContextSwitchTo(ApplyContext);
+
+	MySubscription = GetSubscription(MyLogicalRepWorker->subid, true);
+	if (!MySubscription)
+	{
+		ereport(LOG,
+				(errmsg("logical replication parallel apply worker for subscription %u will not "
+						"start because the subscription was removed during startup",
+						MyLogicalRepWorker->subid)));
+		proc_exit(0);
+	}
+
+	MySubscriptionValid = true;
+	MemoryContextSwitchTo(oldctx);
+
+	/* Setup synchronous commit according to the user's wishes */
+	SetConfigOption("synchronous_commit", MySubscription->synccommit,
+					PGC_BACKEND, PGC_S_OVERRIDE);
+
+	/* Keep us informed about subscription changes. */
+	CacheRegisterSyscacheCallback(SUBSCRIPTIONOID,
+								  subscription_change_cb,
+								  (Datum) 0);
+
+	/* Commit with the replication origin of the leader. */
+	snprintf(originname, sizeof(originname), "pg_%u", MySubscription->oid);
+	originid = replorigin_by_name(originname, false);
+	replorigin_session_setup(originid, MyLogicalRepWorker->leader_pid);
+	replorigin_session_origin = originid;
+
+	ereport(DEBUG1,
+			(errmsg("logical replication parallel apply worker for subscription \"%s\" has started",
+					MySubscription->name)));
+
+	CommitTransactionCommand();
+
+	ApplyMessageContext = AllocSetContextCreate(ApplyContext,
+												"ApplyMessageContext",
+												ALLOCSET_DEFAULT_SIZES);
+
+	/* mark as idle, before starting to loop */
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	for (;;)
+	{
+		shm_mq_result result;
+		Size		len;
+		void	   *data;
+		int			rc;
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContextSwitchTo(ApplyMessageContext);
+
+		result = shm_mq_receive(MyParallelMqh, &len, &data, true);
+
+		if (result == SHM_MQ_SUCCESS)
+		{
+			StringInfoData s;
+
+			s.data = data;
+			s.len = len;
+			s.cursor = 0;
+			s.maxlen = -1;
+
+			apply_dispatch(&s);
+
+			MemoryContextReset(ApplyMessageContext);
+			continue;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			if (in_remote_transaction)
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						 errmsg("logical replication apply worker for subscription \"%s\" exited before transaction could be committed",
+								MySubscription->name)));
+
+			/* The leader is gone, and so are we. */
+			proc_exit(0);
+		}
+
+		if (!in_remote_transaction)
+		{
+			/* Pick up subscription changes, such as synchronous_commit. */
+			AcceptInvalidationMessages();
+			maybe_reread_subscription();
+		}
+
+		MemoryContextSwitchTo(TopMemoryContext);
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+					   PARALLEL_APPLY_NAPTIME,
+					   WAIT_EVENT_LOGICAL_PARALLEL_APPLY_MAIN);
+
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+	}
+}
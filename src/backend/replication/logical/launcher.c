@@ -60,6 +60,7 @@
 
 int			max_logical_replication_workers = 4;
 int			max_sync_workers_per_subscription = 2;
+int			max_parallel_apply_workers_per_subscription = 2;
 
 LogicalRepWorker *MyLogicalRepWorker = NULL;
 
@@ -179,7 +180,7 @@ get_subscription_list(void)
  * This is only needed for cleaning up the shared memory in case the worker
  * fails to attach.
  */
-static void
+static bool
 WaitForReplicationWorkerAttach(LogicalRepWorker *worker,
 							   uint16 generation,
 							   BackgroundWorkerHandle *handle)
@@ -198,8 +199,10 @@ WaitForReplicationWorkerAttach(LogicalRepWorker *worker,
 		/* Worker either died or has started; no need to do anything. */
 		if (!worker->in_use || worker->proc)
 		{
+			bool		started = worker->in_use;
+
 			LWLockRelease(LogicalRepWorkerLock);
-			return;
+			return started;
 		}
 
 		LWLockRelease(LogicalRepWorkerLock);
@@ -214,7 +217,7 @@ WaitForReplicationWorkerAttach(LogicalRepWorker *worker,
 			if (generation == worker->generation)
 				logicalrep_worker_cleanup(worker);
 			LWLockRelease(LogicalRepWorkerLock);
-			return;
+			return false;
 		}
 
 		/*
@@ -231,13 +234,14 @@ WaitForReplicationWorkerAttach(LogicalRepWorker *worker,
 			CHECK_FOR_INTERRUPTS();
 		}
 	}
-
-	return;
 }
 
 /*
  * Walks the workers array and searches for one that matches given
  * subscription id and relid.
+ *
+ * Parallel apply workers are never returned; they are owned by the apply
+ * worker of the subscription rather than the launcher.
  */
 LogicalRepWorker *
 logicalrep_worker_find(Oid subid, Oid relid, bool only_running)
@@ -253,7 +257,7 @@ logicalrep_worker_find(Oid subid, Oid relid, bool only_running)
 		LogicalRepWorker *w = &LogicalRepCtx->workers[i];
 
 		if (w->in_use && w->subid == subid && w->relid == relid &&
-			(!only_running || w->proc))
+			w->leader_pid == InvalidPid && (!only_running || w->proc))
 		{
 			res = w;
 			break;
@@ -289,10 +293,16 @@ logicalrep_workers_find(Oid subid, bool only_running)
 
 /*
  * Start new apply background worker, if possible.
+ *
+ * If subworker_dsm is valid, a parallel apply worker is started for the
+ * calling apply worker; the handle is passed to the new worker so it can
+ * attach to the shared memory set up by its leader.
+ *
+ * Returns true if the worker was started and attached to its slot.
  */
-void
+bool
 logicalrep_worker_launch(Oid dbid, Oid subid, const char *subname, Oid userid,
-						 Oid relid)
+						 Oid relid, dsm_handle subworker_dsm)
 {
 	BackgroundWorker bgw;
 	BackgroundWorkerHandle *bgw_handle;
@@ -301,7 +311,12 @@ logicalrep_worker_launch(Oid dbid, Oid subid, const char *subname, Oid userid,
 	int			slot = 0;
 	LogicalRepWorker *worker = NULL;
 	int			nsyncworkers;
+	int			nparallelworkers;
 	TimestampTz now;
+	bool		is_parallel_apply_worker = (subworker_dsm != DSM_HANDLE_INVALID);
+
+	/* A parallel apply worker never synchronizes a table. */
+	Assert(!is_parallel_apply_worker || !OidIsValid(relid));
 
 	ereport(DEBUG1,
 			(errmsg("starting logical replication worker for subscription \"%s\"",
@@ -334,6 +349,7 @@ retry:
 	}
 
 	nsyncworkers = logicalrep_sync_worker_count(subid);
+	nparallelworkers = logicalrep_parallel_apply_worker_count(subid);
 
 	now = GetCurrentTimestamp();
 
@@ -342,7 +358,8 @@ retry:
 	 * reason we do this is because if some worker failed to start up and its
 	 * parent has crashed while waiting, the in_use state was never cleared.
 	 */
-	if (worker == NULL || nsyncworkers >= max_sync_workers_per_subscription)
+	if (worker == NULL || nsyncworkers >= max_sync_workers_per_subscription ||
+		nparallelworkers >= max_parallel_apply_workers_per_subscription)
 	{
 		bool		did_cleanup = false;
 
@@ -376,10 +393,19 @@ retry:
 	 * silently as we might get here because of an otherwise harmless race
 	 * condition.
 	 */
-	if (nsyncworkers >= max_sync_workers_per_subscription)
+	if (!is_parallel_apply_worker &&
+		nsyncworkers >= max_sync_workers_per_subscription)
 	{
 		LWLockRelease(LogicalRepWorkerLock);
-		return;
+		return false;
+	}
+
+	/* Likewise for the parallel apply worker limit. */
+	if (is_parallel_apply_worker &&
+		nparallelworkers >= max_parallel_apply_workers_per_subscription)
+	{
+		LWLockRelease(LogicalRepWorkerLock);
+		return false;
 	}
 
 	/*
@@ -393,7 +419,7 @@ retry:
 				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
 				 errmsg("out of logical replication worker slots"),
 				 errhint("You might need to increase max_logical_replication_workers.")));
-		return;
+		return false;
 	}
 
 	/* Prepare the worker slot. */
@@ -405,6 +431,7 @@ retry:
 	worker->userid = userid;
 	worker->subid = subid;
 	worker->relid = relid;
+	worker->leader_pid = is_parallel_apply_worker ? MyProcPid : InvalidPid;
 	worker->relstate = SUBREL_STATE_UNKNOWN;
 	worker->relstate_lsn = InvalidXLogRecPtr;
 	worker->last_lsn = InvalidXLogRecPtr;
@@ -424,10 +451,16 @@ retry:
 		BGWORKER_BACKEND_DATABASE_CONNECTION;
 	bgw.bgw_start_time = BgWorkerStart_RecoveryFinished;
 	snprintf(bgw.bgw_library_name, BGW_MAXLEN, "postgres");
-	snprintf(bgw.bgw_function_name, BGW_MAXLEN, "ApplyWorkerMain");
+	if (is_parallel_apply_worker)
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN, "ParallelApplyWorkerMain");
+	else
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN, "ApplyWorkerMain");
 	if (OidIsValid(relid))
 		snprintf(bgw.bgw_name, BGW_MAXLEN,
 				 "logical replication worker for subscription %u sync %u", subid, relid);
+	else if (is_parallel_apply_worker)
+		snprintf(bgw.bgw_name, BGW_MAXLEN,
+				 "logical replication parallel apply worker for subscription %u", subid);
 	else
 		snprintf(bgw.bgw_name, BGW_MAXLEN,
 				 "logical replication worker for subscription %u", subid);
@@ -437,6 +470,9 @@ retry:
 	bgw.bgw_notify_pid = MyProcPid;
 	bgw.bgw_main_arg = Int32GetDatum(slot);
 
+	if (is_parallel_apply_worker)
+		memcpy(bgw.bgw_extra, &subworker_dsm, sizeof(dsm_handle));
+
 	if (!RegisterDynamicBackgroundWorker(&bgw, &bgw_handle))
 	{
 		/* Failed to start worker, so clean up the worker slot. */
@@ -449,11 +485,11 @@ retry:
 				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
 				 errmsg("out of background worker slots"),
 				 errhint("You might need to increase max_worker_processes.")));
-		return;
+		return false;
 	}
 
 	/* Now wait until it attaches. */
-	WaitForReplicationWorkerAttach(worker, generation, bgw_handle);
+	return WaitForReplicationWorkerAttach(worker, generation, bgw_handle);
 }
 
 /*
@@ -694,6 +730,7 @@ logicalrep_worker_cleanup(LogicalRepWorker *worker)
 	worker->userid = InvalidOid;
 	worker->subid = InvalidOid;
 	worker->relid = InvalidOid;
+	worker->leader_pid = InvalidPid;
 }
 
 /*
@@ -762,6 +799,29 @@ logicalrep_sync_worker_count(Oid subid)
 	return res;
 }
 
+/*
+ * Count the number of registered (not necessarily running) parallel apply
+ * workers for a subscription.
+ */
+int
+logicalrep_parallel_apply_worker_count(Oid subid)
+{
+	int			i;
+	int			res = 0;
+
+	Assert(LWLockHeldByMe(LogicalRepWorkerLock));
+
+	for (i = 0; i < max_logical_replication_workers; i++)
+	{
+		LogicalRepWorker *w = &LogicalRepCtx->workers[i];
+
+		if (w->in_use && w->subid == subid && w->leader_pid != InvalidPid)
+			res++;
+	}
+
+	return res;
+}
+
 /*
  * ApplyLauncherShmemSize
  *		Compute space needed for replication launcher shared memory
@@ -836,6 +896,7 @@ ApplyLauncherShmemInit(void)
 			LogicalRepWorker *worker = &LogicalRepCtx->workers[slot];
 
 			memset(worker, 0, sizeof(LogicalRepWorker));
+			worker->leader_pid = InvalidPid;
 			SpinLockInit(&worker->relmutex);
 		}
 	}
@@ -1025,21 +1086,29 @@ ApplyLauncherMain(Datum main_arg)
 			{
 				Subscription *sub = (Subscription *) lfirst(lc);
 				LogicalRepWorker *w;
+				int			nparallelworkers;
 
 				if (!sub->enabled)
 					continue;
 
 				LWLockAcquire(LogicalRepWorkerLock, LW_SHARED);
 				w = logicalrep_worker_find(sub->oid, InvalidOid, false);
+				nparallelworkers = logicalrep_parallel_apply_worker_count(sub->oid);
 				LWLockRelease(LogicalRepWorkerLock);
 
-				if (w == NULL)
+				/*
+				 * Parallel apply workers left over from an apply worker that
+				 * exited must be gone before a new one starts, as they share
+				 * its replication origin.
+				 */
+				if (w == NULL && nparallelworkers == 0)
 				{
 					last_start_time = now;
 					wait_time = wal_retrieve_retry_interval;
 
 					logicalrep_worker_launch(sub->dbid, sub->oid, sub->name,
-											 sub->owner, InvalidOid);
+											 sub->owner, InvalidOid,
+											 DSM_HANDLE_INVALID);
 				}
 			}
 
@@ -1096,7 +1165,7 @@ IsLogicalLauncher(void)
 Datum
 pg_stat_get_subscription(PG_FUNCTION_ARGS)
 {
-#define PG_STAT_GET_SUBSCRIPTION_COLS	8
+#define PG_STAT_GET_SUBSCRIPTION_COLS	9
 	Oid			subid = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
 	int			i;
 	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
@@ -1180,6 +1249,10 @@ pg_stat_get_subscription(PG_FUNCTION_ARGS)
 			nulls[7] = true;
 		else
 			values[7] = TimestampTzGetDatum(worker.reply_time);
+		if (worker.leader_pid == InvalidPid)
+			nulls[8] = true;
+		else
+			values[8] = Int32GetDatum(worker.leader_pid);
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 
@@ -1052,9 +1052,14 @@ ReplicationOriginExitCleanup(int code, Datum arg)
  * Obviously only one such cached origin can exist per process and the current
  * cached value can only be set again after the previous value is torn down
  * with replorigin_session_reset().
+ *
+ * Normally the origin must not be in use by any other process.  A parallel
+ * apply worker instead passes the PID of its leader as acquired_by; the
+ * origin must then already be acquired by that process, and is shared with
+ * it rather than taken over.
  */
 void
-replorigin_session_setup(RepOriginId node)
+replorigin_session_setup(RepOriginId node, int acquired_by)
 {
 	static bool registered_cleanup;
 	int			i;
@@ -1096,7 +1101,7 @@ replorigin_session_setup(RepOriginId node)
 		if (curstate->roident != node)
 			continue;
 
-		else if (curstate->acquired_by != 0)
+		else if (curstate->acquired_by != 0 && acquired_by == 0)
 		{
 			ereport(ERROR,
 					(errcode(ERRCODE_OBJECT_IN_USE),
@@ -1115,6 +1120,11 @@ replorigin_session_setup(RepOriginId node)
 				 errmsg("could not find free replication state slot for replication origin with OID %u",
 						node),
 				 errhint("Increase max_replication_slots and try again.")));
+	else if (session_replication_state == NULL && acquired_by != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("replication origin with OID %u is not active for PID %d",
+						node, acquired_by)));
 	else if (session_replication_state == NULL)
 	{
 		/* initialize new slot */
@@ -1127,7 +1137,18 @@ replorigin_session_setup(RepOriginId node)
 
 	Assert(session_replication_state->roident != InvalidRepOriginId);
 
-	session_replication_state->acquired_by = MyProcPid;
+	if (acquired_by == 0)
+		session_replication_state->acquired_by = MyProcPid;
+	else if (session_replication_state->acquired_by != acquired_by)
+	{
+		int			holder = session_replication_state->acquired_by;
+
+		session_replication_state = NULL;
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("replication origin with OID %u is active for PID %d, not %d",
+						node, holder, acquired_by)));
+	}
 
 	LWLockRelease(ReplicationOriginLock);
 
@@ -1155,7 +1176,9 @@ replorigin_session_reset(void)
 
 	LWLockAcquire(ReplicationOriginLock, LW_EXCLUSIVE);
 
-	session_replication_state->acquired_by = 0;
+	/* Origins shared with another process are left acquired by it. */
+	if (session_replication_state->acquired_by == MyProcPid)
+		session_replication_state->acquired_by = 0;
 	cv = &session_replication_state->origin_cv;
 	session_replication_state = NULL;
 
@@ -1311,7 +1334,7 @@ pg_replication_origin_session_setup(PG_FUNCTION_ARGS)
 
 	name = text_to_cstring((text *) DatumGetPointer(PG_GETARG_DATUM(0)));
 	origin = replorigin_by_name(name, false);
-	replorigin_session_setup(origin);
+	replorigin_session_setup(origin, 0);
 
 	replorigin_session_origin = origin;
 
@@ -22,8 +22,10 @@
 #include "catalog/pg_subscription_rel.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
+#include "optimizer/optimizer.h"
 #include "replication/logicalrelation.h"
 #include "replication/worker_internal.h"
+#include "rewrite/rewriteHandler.h"
 #include "utils/builtins.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
@@ -115,6 +117,23 @@ logicalrep_relmap_init(void)
 								  (Datum) 0);
 }
 
+/*
+ * Forget the cached default expressions of a relation map entry.
+ */
+static void
+logicalrep_rel_free_defaults(LogicalRepRelMapEntry *entry)
+{
+	if (entry->defcxt)
+		MemoryContextDelete(entry->defcxt);
+
+	entry->defaults_valid = false;
+	entry->defcxt = NULL;
+	entry->num_defaults = 0;
+	entry->defmap = NULL;
+	entry->defexprs = NULL;
+	entry->volatile_defaults = false;
+}
+
 /*
  * Free the entry of a relation map cache.
  */
@@ -142,6 +161,8 @@ logicalrep_relmap_free_entry(LogicalRepRelMapEntry *entry)
 
 	if (entry->attrmap)
 		pfree(entry->attrmap);
+
+	logicalrep_rel_free_defaults(entry);
 }
 
 /*
@@ -245,6 +266,9 @@ logicalrep_rel_open(LogicalRepRelId remoteid, LOCKMODE lockmode)
 
 		remoterel = &entry->remoterel;
 
+		/* The default expressions may have changed as well. */
+		logicalrep_rel_free_defaults(entry);
+
 		/* Try to find and lock the relation by name. */
 		relid = RangeVarGetRelid(makeRangeVar(remoterel->nspname,
 											  remoterel->relname, -1),
@@ -371,6 +395,74 @@ logicalrep_rel_close(LogicalRepRelMapEntry *rel, LOCKMODE lockmode)
 	rel->localrel = NULL;
 }
 
+/*
+ * Load the default expressions of the local columns that are not sent by the
+ * publisher into the relation map entry, if not done yet.
+ *
+ * They are kept until the entry is invalidated, so that inserts don't have to
+ * look up and plan them for every row.  Planning may evaluate functions, so
+ * the caller must have an active snapshot.
+ */
+void
+logicalrep_rel_load_defaults(LogicalRepRelMapEntry *entry)
+{
+	TupleDesc	desc = RelationGetDescr(entry->localrel);
+	MemoryContext oldctx;
+	int			attnum;
+
+	if (entry->defaults_valid)
+		return;
+
+	/* Clean up after a previous attempt that failed, if any. */
+	logicalrep_rel_free_defaults(entry);
+
+	/* We get all the data via replication, no need to evaluate anything. */
+	if (desc->natts == entry->remoterel.natts)
+	{
+		entry->defaults_valid = true;
+		return;
+	}
+
+	entry->defcxt = AllocSetContextCreate(LogicalRepRelMapContext,
+										  "logical replication defaults",
+										  ALLOCSET_SMALL_SIZES);
+	entry->defmap = MemoryContextAlloc(entry->defcxt,
+									   desc->natts * sizeof(int));
+	entry->defexprs = MemoryContextAlloc(entry->defcxt,
+										 desc->natts * sizeof(Expr *));
+
+	for (attnum = 0; attnum < desc->natts; attnum++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(desc, attnum);
+		Expr	   *defexpr;
+
+		if (attr->attisdropped || attr->attgenerated)
+			continue;
+
+		if (entry->attrmap[attnum] >= 0)
+			continue;
+
+		defexpr = (Expr *) build_column_default(entry->localrel, attnum + 1);
+
+		if (defexpr != NULL)
+		{
+			/* Run the expression through planner */
+			defexpr = expression_planner(defexpr);
+
+			if (contain_volatile_functions_not_nextval((Node *) defexpr))
+				entry->volatile_defaults = true;
+
+			oldctx = MemoryContextSwitchTo(entry->defcxt);
+			entry->defexprs[entry->num_defaults] = copyObject(defexpr);
+			MemoryContextSwitchTo(oldctx);
+			entry->defmap[entry->num_defaults] = attnum;
+			entry->num_defaults++;
+		}
+	}
+
+	entry->defaults_valid = true;
+}
+
 /*
  * Free the type map cache entry data.
  */
@@ -34,7 +34,11 @@
  *	  big as the available memory - this module supports spooling the contents
  *	  of a large transactions to disk. When the transaction is replayed the
  *	  contents of individual (sub-)transactions will be read from disk in
- *	  chunks.
+ *	  chunks.  The memory used by all transactions is limited by
+ *	  logical_decoding_work_mem; once it's exceeded, the largest transaction
+ *	  is evicted.  If the output plugin supports it, a transaction without
+ *	  catalog changes is evicted by streaming its changes so far, instead of
+ *	  spooling them to disk (cf. ReorderBufferStreamTXN()).
  *
  *	  This module also has to deal with reassembling toast records from the
  *	  individual chunks stored in WAL. When a new (or initial) version of a
@@ -69,7 +73,7 @@
 #include "replication/logical.h"
 #include "replication/reorderbuffer.h"
 #include "replication/slot.h"
-#include "replication/snapbuild.h"	/* just for SnapBuildSnapDecRefcount */
+#include "replication/snapbuild.h"
 #include "storage/bufmgr.h"
 #include "storage/fd.h"
 #include "storage/sinval.h"
@@ -143,19 +147,16 @@ typedef struct ReorderBufferDiskChange
 } ReorderBufferDiskChange;
 
 /*
- * Maximum number of changes kept in memory, per transaction. After that,
- * changes are spooled to disk.
- *
- * The current value should be sufficient to decode the entire transaction
- * without hitting disk in OLTP workloads, while starting to spool to disk in
- * other workloads reasonably fast.
- *
- * At some point in the future it probably makes sense to have a more elaborate
- * resource management here, but it's not entirely clear what that would look
- * like.
+ * Maximum number of changes restored from disk into memory at once, per
+ * (sub)transaction, when replaying a transaction that has been spooled.
+ * How much decoded data is kept in memory is controlled by
+ * logical_decoding_work_mem instead.
  */
 static const Size max_changes_in_memory = 4096;
 
+/* GUC variable */
+int			logical_decoding_work_mem;
+
 /* ---------------------------------------
  * primary reorderbuffer support routines
  * ---------------------------------------
@@ -183,13 +184,35 @@ static ReorderBufferChange *ReorderBufferIterTXNNext(ReorderBuffer *rb, ReorderB
 static void ReorderBufferIterTXNFinish(ReorderBuffer *rb,
 									   ReorderBufferIterTXNState *state);
 static void ReorderBufferExecuteInvalidations(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+									XLogRecPtr commit_lsn,
+									volatile Snapshot snapshot_now,
+									volatile CommandId command_id,
+									bool streaming);
+
+/* ---------------------------------------
+ * memory accounting and streaming of in-progress transactions
+ * ---------------------------------------
+ */
+static Size ReorderBufferChangeSize(ReorderBufferChange *change);
+static void ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+											ReorderBufferChange *change,
+											bool addition);
+static void ReorderBufferCheckMemoryLimit(ReorderBuffer *rb);
+static ReorderBufferTXN *ReorderBufferLargestTXN(ReorderBuffer *rb);
+static ReorderBufferTXN *ReorderBufferLargestTopTXN(ReorderBuffer *rb);
+static bool ReorderBufferCanStartStreaming(ReorderBuffer *rb);
+static bool ReorderBufferTXNIsStreamable(ReorderBufferTXN *txn);
+static bool ReorderBufferTXNIsStreamed(ReorderBufferTXN *txn);
+static void ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+								   XLogRecPtr commit_lsn);
+static void ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 
 /*
  * ---------------------------------------
  * Disk serialization support functions
  * ---------------------------------------
  */
-static void ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 										 int fd, ReorderBufferChange *change);
@@ -269,6 +292,7 @@ ReorderBufferAllocate(void)
 
 	buffer->outbuf = NULL;
 	buffer->outbufsize = 0;
+	buffer->size = 0;
 
 	buffer->current_restart_decoding_lsn = InvalidXLogRecPtr;
 
@@ -374,6 +398,10 @@ ReorderBufferGetChange(ReorderBuffer *rb)
 void
 ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 {
+	/* update memory accounting info */
+	if (change->txn != NULL)
+		ReorderBufferChangeMemoryUpdate(rb, change, false);
+
 	/* free contained data */
 	switch (change->action)
 	{
@@ -578,19 +606,59 @@ ReorderBufferTXNByXid(ReorderBuffer *rb, TransactionId xid, bool create,
  */
 void
 ReorderBufferQueueChange(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn,
-						 ReorderBufferChange *change)
+						 ReorderBufferChange *change, bool toast_insert)
 {
 	ReorderBufferTXN *txn;
+	ReorderBufferTXN *toptxn;
 
 	txn = ReorderBufferTXNByXid(rb, xid, true, NULL, lsn, true);
+	toptxn = txn->is_known_as_subxact ? txn->toptxn : txn;
+
+	/*
+	 * Keep track of whether the transaction ends with an incomplete change,
+	 * in which case it can't be streamed before more changes arrive.  Toast
+	 * chunks are reassembled once an insert or update on the main table
+	 * tells us they're not needed anymore, speculative insertions are
+	 * resolved by the next insert, update or delete (or confirmation).
+	 */
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			if (toast_insert)
+				toptxn->has_partial_toast = true;
+			else if (change->data.tp.clear_toast_afterwards)
+				toptxn->has_partial_toast = false;
+			toptxn->has_partial_specinsert = false;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+			/* the confirmed insertion consumes its toast chunks */
+			toptxn->has_partial_toast = false;
+			toptxn->has_partial_specinsert = false;
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
+			toptxn->has_partial_specinsert = false;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			toptxn->has_partial_specinsert = true;
+			break;
+		default:
+			break;
+	}
 
 	change->lsn = lsn;
+	change->txn = txn;
+
 	Assert(InvalidXLogRecPtr != lsn);
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries++;
 	txn->nentries_mem++;
 
-	ReorderBufferCheckSerializeTXN(rb, txn);
+	/* update memory accounting information */
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
+
+	/* check the memory limits and evict something if needed */
+	ReorderBufferCheckMemoryLimit(rb);
 }
 
 /*
@@ -618,7 +686,7 @@ ReorderBufferQueueMessage(ReorderBuffer *rb, TransactionId xid,
 		change->data.msg.message = palloc(message_size);
 		memcpy(change->data.msg.message, message, message_size);
 
-		ReorderBufferQueueChange(rb, xid, lsn, change);
+		ReorderBufferQueueChange(rb, xid, lsn, change, false);
 
 		MemoryContextSwitchTo(oldcontext);
 	}
@@ -801,8 +869,13 @@ ReorderBufferAssignChild(ReorderBuffer *rb, TransactionId xid,
 
 	subtxn->is_known_as_subxact = true;
 	subtxn->toplevel_xid = xid;
+	subtxn->toptxn = txn;
 	Assert(subtxn->nsubtxns == 0);
 
+	/* incomplete changes are only tracked in the toplevel txn */
+	txn->has_partial_toast |= subtxn->has_partial_toast;
+	txn->has_partial_specinsert |= subtxn->has_partial_specinsert;
+
 	/* add to subtransaction list */
 	dlist_push_tail(&txn->subtxns, &subtxn->node);
 	txn->nsubtxns++;
@@ -1192,6 +1265,12 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	bool		found;
 	dlist_mutable_iter iter;
 
+	/*
+	 * Free leftover toast chunks first, they might belong to one of the
+	 * subtransactions.
+	 */
+	ReorderBufferToastReset(rb, txn);
+
 	/* cleanup subtransactions & their changes */
 	dlist_foreach_modify(iter, &txn->subtxns)
 	{
@@ -1242,6 +1321,14 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		dlist_delete(&txn->base_snapshot_node);
 	}
 
+	/* and the snapshot a previously streamed chunk ended with */
+	if (txn->snapshot_now != NULL)
+	{
+		Assert(txn->snapshot_now->copied);
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
+	}
+
 	/*
 	 * Remove TXN from its containing list.
 	 *
@@ -1267,6 +1354,52 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	ReorderBufferReturnTXN(rb, txn);
 }
 
+/*
+ * Discard the changes of a transaction and its subtransactions after they
+ * have been streamed, both in memory and on disk.  Unlike
+ * ReorderBufferCleanupTXN(), the transaction itself is kept around, as more
+ * changes may arrive for it until it commits or aborts.
+ */
+static void
+ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	dlist_mutable_iter iter;
+
+	/* truncate subtransactions */
+	dlist_foreach_modify(iter, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, iter.cur);
+
+		Assert(subtxn->is_known_as_subxact);
+		Assert(subtxn->nsubtxns == 0);
+
+		ReorderBufferTruncateTXN(rb, subtxn);
+	}
+
+	/* free the changes in this transaction */
+	dlist_foreach_modify(iter, &txn->changes)
+	{
+		ReorderBufferChange *change;
+
+		change = dlist_container(ReorderBufferChange, node, iter.cur);
+
+		dlist_delete(&change->node);
+		ReorderBufferReturnChange(rb, change);
+	}
+
+	/* remove entries spilled to disk, they have been streamed as well */
+	if (txn->serialized)
+	{
+		ReorderBufferRestoreCleanup(rb, txn);
+		txn->serialized = false;
+	}
+
+	txn->nentries = 0;
+	txn->nentries_mem = 0;
+}
+
 /*
  * Build a hash with a (relfilenode, ctid) -> (cmin, cmax) mapping for use by
  * HeapTupleSatisfiesHistoricMVCC.
@@ -1437,10 +1570,6 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					RepOriginId origin_id, XLogRecPtr origin_lsn)
 {
 	ReorderBufferTXN *txn;
-	volatile Snapshot snapshot_now;
-	volatile CommandId command_id = FirstCommandId;
-	bool		using_subtxn;
-	ReorderBufferIterTXNState *volatile iterstate = NULL;
 
 	txn = ReorderBufferTXNByXid(rb, xid, false, NULL, InvalidXLogRecPtr,
 								false);
@@ -1468,7 +1597,42 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		return;
 	}
 
-	snapshot_now = txn->base_snapshot;
+	/*
+	 * If parts of the transaction have been streamed already, stream the rest
+	 * of it and tell the output plugin it committed.
+	 */
+	if (txn->streamed)
+	{
+		ReorderBufferStreamTXN(rb, txn, commit_lsn);
+		return;
+	}
+
+	ReorderBufferProcessTXN(rb, txn, commit_lsn, txn->base_snapshot,
+							FirstCommandId, false);
+}
+
+/*
+ * Replay the changes of a transaction and its subtransactions (see
+ * ReorderBufferCommit()), starting with the given snapshot and command id.
+ *
+ * When streaming, the changes are passed to the output plugin's stream
+ * callbacks instead.  If commit_lsn is valid, this is the final part of a
+ * streamed transaction and the stream commit callback is invoked, otherwise
+ * the transaction is still in progress: the changes are discarded after
+ * being sent, while the transaction is kept around, remembering where to
+ * continue with the next part.
+ */
+static void
+ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn,
+						volatile Snapshot snapshot_now,
+						volatile CommandId command_id,
+						bool streaming)
+{
+	bool		using_subtxn;
+	ReorderBufferIterTXNState *volatile iterstate = NULL;
+	volatile bool stream_started = false;
+	volatile XLogRecPtr prev_lsn = InvalidXLogRecPtr;
 
 	/* build data to be able to lookup the CommandIds of catalog tuples */
 	ReorderBufferBuildTupleCidHash(rb, txn);
@@ -1498,7 +1662,8 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		else
 			StartTransactionCommand();
 
-		rb->begin(rb, txn);
+		if (!streaming)
+			rb->begin(rb, txn);
 
 		iterstate = ReorderBufferIterTXNInit(rb, txn);
 		while ((change = ReorderBufferIterTXNNext(rb, iterstate)) != NULL)
@@ -1506,6 +1671,14 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 			Relation	relation = NULL;
 			Oid			reloid;
 
+			/* open the stream block lazily, with the first change in it */
+			if (streaming && !stream_started)
+			{
+				rb->stream_start(rb, txn, change->lsn);
+				stream_started = true;
+			}
+			prev_lsn = change->lsn;
+
 			switch (change->action)
 			{
 				case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
@@ -1582,7 +1755,10 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					if (!IsToastRelation(relation))
 					{
 						ReorderBufferToastReplace(rb, txn, relation, change);
-						rb->apply_change(rb, txn, relation, change);
+						if (streaming)
+							rb->stream_change(rb, txn, relation, change);
+						else
+							rb->apply_change(rb, txn, relation, change);
 
 						/*
 						 * Only clear reassembled toast chunks if we're sure
@@ -1680,7 +1856,12 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 							relations[nrelations++] = relation;
 						}
 
-						rb->apply_truncate(rb, txn, nrelations, relations, change);
+						if (streaming)
+							rb->stream_truncate(rb, txn, nrelations, relations,
+												change);
+						else
+							rb->apply_truncate(rb, txn, nrelations, relations,
+											   change);
 
 						for (i = 0; i < nrelations; i++)
 							RelationClose(relations[i]);
@@ -1689,10 +1870,16 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					}
 
 				case REORDER_BUFFER_CHANGE_MESSAGE:
-					rb->message(rb, txn, change->lsn, true,
-								change->data.msg.prefix,
-								change->data.msg.message_size,
-								change->data.msg.message);
+					if (streaming)
+						rb->stream_message(rb, txn, change->lsn, true,
+										   change->data.msg.prefix,
+										   change->data.msg.message_size,
+										   change->data.msg.message);
+					else
+						rb->message(rb, txn, change->lsn, true,
+									change->data.msg.prefix,
+									change->data.msg.message_size,
+									change->data.msg.message);
 					break;
 
 				case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
@@ -1778,8 +1965,21 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		ReorderBufferIterTXNFinish(rb, iterstate);
 		iterstate = NULL;
 
-		/* call commit callback */
-		rb->commit(rb, txn, commit_lsn);
+		if (streaming)
+		{
+			if (stream_started)
+				rb->stream_stop(rb, txn, prev_lsn);
+			txn->streamed = true;
+
+			/* call the stream commit callback, if the transaction is done */
+			if (commit_lsn != InvalidXLogRecPtr)
+				rb->stream_commit(rb, txn, commit_lsn);
+		}
+		else
+		{
+			/* call commit callback */
+			rb->commit(rb, txn, commit_lsn);
+		}
 
 		/* this is just a sanity check against bad output plugin behaviour */
 		if (GetCurrentTransactionIdIfAny() != InvalidTransactionId)
@@ -1803,11 +2003,33 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		if (using_subtxn)
 			RollbackAndReleaseCurrentSubTransaction();
 
-		if (snapshot_now->copied)
-			ReorderBufferFreeSnap(rb, snapshot_now);
+		/*
+		 * If the transaction is still in progress, remember the snapshot and
+		 * command id to continue from with its next part, and discard the
+		 * changes streamed so far.  Toast chunks are always reassembled by
+		 * now, as transactions ending with incomplete changes aren't
+		 * streamed.
+		 */
+		if (streaming && commit_lsn == InvalidXLogRecPtr)
+		{
+			txn->snapshot_now = ReorderBufferCopySnap(rb, snapshot_now,
+													  txn, command_id);
+			txn->command_id = command_id;
 
-		/* remove potential on-disk data, and deallocate */
-		ReorderBufferCleanupTXN(rb, txn);
+			if (snapshot_now->copied)
+				ReorderBufferFreeSnap(rb, snapshot_now);
+
+			ReorderBufferToastReset(rb, txn);
+			ReorderBufferTruncateTXN(rb, txn);
+		}
+		else
+		{
+			if (snapshot_now->copied)
+				ReorderBufferFreeSnap(rb, snapshot_now);
+
+			/* remove potential on-disk data, and deallocate */
+			ReorderBufferCleanupTXN(rb, txn);
+		}
 	}
 	PG_CATCH();
 	{
@@ -1867,6 +2089,10 @@ ReorderBufferAbort(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/* cosmetic... */
 	txn->final_lsn = lsn;
 
+	/* tell the output plugin to discard what has been streamed already */
+	if (ReorderBufferTXNIsStreamed(txn))
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -1899,22 +2125,16 @@ ReorderBufferAbortOld(ReorderBuffer *rb, TransactionId oldestRunningXid)
 		if (TransactionIdPrecedes(txn->xid, oldestRunningXid))
 		{
 			/*
-			 * We set final_lsn on a transaction when we decode its commit or
-			 * abort record, but we never see those records for crashed
-			 * transactions.  To ensure cleanup of these transactions, set
-			 * final_lsn to that of their last change; this causes
-			 * ReorderBufferRestoreCleanup to do the right thing.
+			 * We never see commit or abort records for crashed transactions,
+			 * but ReorderBufferSerializeTXN has set final_lsn to the last
+			 * change spilled to disk, so ReorderBufferRestoreCleanup will do
+			 * the right thing.
 			 */
-			if (txn->serialized && txn->final_lsn == 0)
-			{
-				ReorderBufferChange *last =
-				dlist_tail_element(ReorderBufferChange, node, &txn->changes);
-
-				txn->final_lsn = last->lsn;
-			}
-
 			elog(DEBUG2, "aborting old transaction %u", txn->xid);
 
+			if (txn->streamed)
+				rb->stream_abort(rb, txn, txn->final_lsn);
+
 			/* remove potential on-disk data, and deallocate this tx */
 			ReorderBufferCleanupTXN(rb, txn);
 		}
@@ -1962,6 +2182,10 @@ ReorderBufferForget(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	else
 		Assert(txn->ninvalidations == 0);
 
+	/* parts of it may have been streamed, which have to be discarded */
+	if (ReorderBufferTXNIsStreamed(txn))
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -2030,7 +2254,7 @@ ReorderBufferAddSnapshot(ReorderBuffer *rb, TransactionId xid,
 	change->data.snapshot = snap;
 	change->action = REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT;
 
-	ReorderBufferQueueChange(rb, xid, lsn, change);
+	ReorderBufferQueueChange(rb, xid, lsn, change, false);
 }
 
 /*
@@ -2079,7 +2303,7 @@ ReorderBufferAddNewCommandId(ReorderBuffer *rb, TransactionId xid,
 	change->data.command_id = cid;
 	change->action = REORDER_BUFFER_CHANGE_INTERNAL_COMMAND_ID;
 
-	ReorderBufferQueueChange(rb, xid, lsn, change);
+	ReorderBufferQueueChange(rb, xid, lsn, change, false);
 }
 
 
@@ -2205,6 +2429,286 @@ ReorderBufferXidHasBaseSnapshot(ReorderBuffer *rb, TransactionId xid)
 }
 
 
+/*
+ * ---------------------------------------
+ * Memory accounting and streaming of in-progress transactions
+ * ---------------------------------------
+ */
+
+/*
+ * Size of a change in memory, including the data it points to.
+ */
+static Size
+ReorderBufferChangeSize(ReorderBufferChange *change)
+{
+	Size		sz = sizeof(ReorderBufferChange);
+
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		case REORDER_BUFFER_CHANGE_DELETE:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			if (change->data.tp.oldtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.oldtuple->alloc_tuple_size;
+			if (change->data.tp.newtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.newtuple->alloc_tuple_size;
+			break;
+		case REORDER_BUFFER_CHANGE_MESSAGE:
+			sz += strlen(change->data.msg.prefix) + 1 +
+				change->data.msg.message_size;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
+			{
+				Snapshot	snap = change->data.snapshot;
+
+				sz += sizeof(SnapshotData) +
+					sizeof(TransactionId) * snap->xcnt +
+					sizeof(TransactionId) * snap->subxcnt;
+				break;
+			}
+		case REORDER_BUFFER_CHANGE_TRUNCATE:
+			sz += sizeof(Oid) * change->data.truncate.nrelids;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+		case REORDER_BUFFER_CHANGE_INTERNAL_COMMAND_ID:
+		case REORDER_BUFFER_CHANGE_INTERNAL_TUPLECID:
+			/* no data in addition to the struct itself */
+			break;
+	}
+
+	return sz;
+}
+
+/*
+ * Account for a change being added to or removed from its transaction.
+ *
+ * The amount is tracked both per (sub)transaction and for the whole reorder
+ * buffer, the former to pick a transaction to evict, the latter to decide
+ * whether eviction is needed at all.
+ */
+static void
+ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+								ReorderBufferChange *change,
+								bool addition)
+{
+	ReorderBufferTXN *txn = change->txn;
+	Size		sz = ReorderBufferChangeSize(change);
+
+	if (addition)
+	{
+		txn->size += sz;
+		rb->size += sz;
+	}
+	else
+	{
+		Assert(txn->size >= sz && rb->size >= sz);
+		txn->size -= sz;
+		rb->size -= sz;
+	}
+}
+
+/*
+ * Find the (sub)transaction using the most memory, the one to spill to disk.
+ */
+static ReorderBufferTXN *
+ReorderBufferLargestTXN(ReorderBuffer *rb)
+{
+	HASH_SEQ_STATUS hash_seq;
+	ReorderBufferTXNByIdEnt *ent;
+	ReorderBufferTXN *largest = NULL;
+
+	hash_seq_init(&hash_seq, rb->by_txn);
+	while ((ent = hash_seq_search(&hash_seq)) != NULL)
+	{
+		ReorderBufferTXN *txn = ent->txn;
+
+		if (largest == NULL || txn->size > largest->size)
+			largest = txn;
+	}
+
+	Assert(largest != NULL && largest->size > 0);
+
+	return largest;
+}
+
+/*
+ * Find the toplevel transaction that can be streamed and uses the most
+ * memory, counting its subtransactions, or NULL if there's none.
+ */
+static ReorderBufferTXN *
+ReorderBufferLargestTopTXN(ReorderBuffer *rb)
+{
+	dlist_iter	iter;
+	ReorderBufferTXN *largest = NULL;
+	Size		largest_size = 0;
+
+	dlist_foreach(iter, &rb->toplevel_by_lsn)
+	{
+		ReorderBufferTXN *txn;
+		dlist_iter	subiter;
+		Size		size;
+
+		txn = dlist_container(ReorderBufferTXN, node, iter.cur);
+
+		if (!ReorderBufferTXNIsStreamable(txn))
+			continue;
+
+		size = txn->size;
+		dlist_foreach(subiter, &txn->subtxns)
+		{
+			ReorderBufferTXN *subtxn;
+
+			subtxn = dlist_container(ReorderBufferTXN, node, subiter.cur);
+			size += subtxn->size;
+		}
+
+		if (size > largest_size)
+		{
+			largest = txn;
+			largest_size = size;
+		}
+	}
+
+	return largest;
+}
+
+/*
+ * Check whether the changes of the reorder buffer exceed the memory limit,
+ * and evict transactions until they don't anymore.
+ *
+ * If the output plugin supports streaming, the largest toplevel transaction
+ * is sent downstream while still in progress.  Otherwise, or if it can't be
+ * streamed yet, the largest (sub)transaction is spilled to disk.
+ */
+static void
+ReorderBufferCheckMemoryLimit(ReorderBuffer *rb)
+{
+	while (rb->size >= logical_decoding_work_mem * 1024L)
+	{
+		ReorderBufferTXN *txn = NULL;
+		Size		size = rb->size;
+
+		if (ReorderBufferCanStartStreaming(rb))
+			txn = ReorderBufferLargestTopTXN(rb);
+
+		if (txn != NULL)
+			ReorderBufferStreamTXN(rb, txn, InvalidXLogRecPtr);
+		else
+			ReorderBufferSerializeTXN(rb, ReorderBufferLargestTXN(rb));
+
+		/* protect against looping if nothing could be evicted */
+		if (rb->size >= size)
+			break;
+	}
+}
+
+/*
+ * Can in-progress transactions be streamed to the output plugin right now?
+ *
+ * That requires the plugin to support it, and decoding to have reached the
+ * point from which on changes are actually to be sent.
+ */
+static bool
+ReorderBufferCanStartStreaming(ReorderBuffer *rb)
+{
+	LogicalDecodingContext *ctx = rb->private_data;
+	SnapBuild  *builder = ctx->snapshot_builder;
+
+	if (!ctx->streaming)
+		return false;
+
+	if (SnapBuildCurrentState(builder) < SNAPBUILD_CONSISTENT)
+		return false;
+
+	return !SnapBuildXactNeedsSkip(builder, ctx->reader->EndRecPtr);
+}
+
+/*
+ * Can the changes of an in-progress toplevel transaction be streamed?
+ *
+ * As cache invalidations are only known at commit, we can't decode the
+ * changes of a transaction following a catalog change made by it before
+ * that.  Incomplete changes can't be decoded before the rest arrives.
+ */
+static bool
+ReorderBufferTXNIsStreamable(ReorderBufferTXN *txn)
+{
+	dlist_iter	iter;
+
+	Assert(!txn->is_known_as_subxact);
+
+	if (txn->base_snapshot == NULL)
+		return false;
+
+	if (txn->has_partial_toast || txn->has_partial_specinsert)
+		return false;
+
+	if (txn->has_catalog_changes)
+		return false;
+
+	dlist_foreach(iter, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, iter.cur);
+		if (subtxn->has_catalog_changes)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Have parts of the (toplevel transaction of the) transaction been streamed?
+ */
+static bool
+ReorderBufferTXNIsStreamed(ReorderBufferTXN *txn)
+{
+	if (txn->is_known_as_subxact)
+		txn = txn->toptxn;
+
+	return txn->streamed;
+}
+
+/*
+ * Send the changes of a toplevel transaction queued so far to the output
+ * plugin's stream callbacks, continuing where the previously streamed part
+ * ended, if any.  A valid commit_lsn marks the final part, see
+ * ReorderBufferProcessTXN().
+ */
+static void
+ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+					   XLogRecPtr commit_lsn)
+{
+	Snapshot	snapshot_now;
+	CommandId	command_id;
+
+	Assert(!txn->is_known_as_subxact);
+	Assert(txn->base_snapshot != NULL);
+
+	if (txn->snapshot_now == NULL)
+	{
+		command_id = FirstCommandId;
+		snapshot_now = ReorderBufferCopySnap(rb, txn->base_snapshot,
+											 txn, command_id);
+	}
+	else
+	{
+		/* copy again, there may be new subtransactions */
+		command_id = txn->command_id;
+		snapshot_now = ReorderBufferCopySnap(rb, txn->snapshot_now,
+											 txn, command_id);
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
+	}
+
+	ReorderBufferProcessTXN(rb, txn, commit_lsn, snapshot_now, command_id,
+							true);
+}
+
 /*
  * ---------------------------------------
  * Disk serialization support
@@ -2229,23 +2733,6 @@ ReorderBufferSerializeReserve(ReorderBuffer *rb, Size sz)
 	}
 }
 
-/*
- * Check whether the transaction tx should spill its data to disk.
- */
-static void
-ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
-{
-	/*
-	 * TODO: improve accounting so we cheaply can take subtransactions into
-	 * account here.
-	 */
-	if (txn->nentries_mem >= max_changes_in_memory)
-	{
-		ReorderBufferSerializeTXN(rb, txn);
-		Assert(txn->nentries_mem == 0);
-	}
-}
-
 /*
  * Spill data of a large transaction (and its subtransactions) to disk.
  */
@@ -2309,6 +2796,14 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		}
 
 		ReorderBufferSerializeChange(rb, txn, fd, change);
+
+		/*
+		 * Remember the last spilled change, so that the files can be found
+		 * again (and removed) even before the transaction's end is known.
+		 */
+		if (txn->final_lsn < change->lsn)
+			txn->final_lsn = change->lsn;
+
 		dlist_delete(&change->node);
 		ReorderBufferReturnChange(rb, change);
 
@@ -2318,7 +2813,8 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	Assert(spilled == txn->nentries_mem);
 	Assert(dlist_is_empty(&txn->changes));
 	txn->nentries_mem = 0;
-	txn->serialized = true;
+	if (spilled > 0)
+		txn->serialized = true;
 
 	if (fd != -1)
 		CloseTransientFile(fd);
@@ -2784,6 +3280,10 @@ ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries_mem++;
+
+	/* the restored change uses memory again */
+	change->txn = txn;
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
 }
 
 /*
@@ -3122,7 +3622,7 @@ ReorderBufferToastReplace(ReorderBuffer *rb, ReorderBufferTXN *txn,
 				   VARSIZE(chunk) - VARHDRSZ);
 			data_done += VARSIZE(chunk) - VARHDRSZ;
 		}
-		Assert(data_done == toast_pointer.va_extsize);
+		Assert(data_done == VARATT_EXTERNAL_GET_EXTSIZE(toast_pointer));
 
 		/* make sure its marked as compressed or not */
 		if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
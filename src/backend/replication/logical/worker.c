@@ -18,6 +18,23 @@
  *	  This module includes server facing code and shares libpqwalreceiver
  *	  module with walreceiver for providing the libpq specific functionality.
  *
+ *	  With the streaming option, the publisher may send the changes of large
+ *	  transactions before they commit, in blocks delimited by STREAM START
+ *	  and STREAM STOP messages.  We spool those to a temporary file per
+ *	  transaction (removing changes of aborted subtransactions), and apply
+ *	  them in one go on STREAM COMMIT, or throw them away on STREAM ABORT.
+ *	  So streaming saves memory and disk space on the publisher and spreads
+ *	  the network transfer, while the apply itself still happens at commit.
+ *
+ *	  With the parallel_apply option, the apply worker acts as the leader of
+ *	  a pool of parallel apply workers and hands each remote transaction to
+ *	  one of them, see applyparallelworker.c.
+ *
+ *	  Consecutive inserts into the same relation are not applied one by one,
+ *	  but buffered and written out with table_multi_insert(), like COPY FROM
+ *	  does.  The buffer is flushed before any other message is handled, so
+ *	  the order of changes within a transaction is preserved.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -58,6 +75,7 @@
 #include "replication/walreceiver.h"
 #include "replication/worker_internal.h"
 #include "rewrite/rewriteHandler.h"
+#include "storage/buffile.h"
 #include "storage/bufmgr.h"
 #include "storage/ipc.h"
 #include "storage/lmgr.h"
@@ -87,6 +105,32 @@ typedef struct FlushPosition
 
 static dlist_head lsn_mapping = DLIST_STATIC_INIT(lsn_mapping);
 
+/*
+ * No more than this many inserts are buffered before they are flushed, and no
+ * more than this many bytes of protocol messages.  These are the limits COPY
+ * FROM uses for its multi-insert buffers.
+ */
+#define MAX_BUFFERED_INSERTS		1000
+#define MAX_BUFFERED_INSERT_BYTES	65535
+
+/*
+ * Inserts into one relation waiting to be written by table_multi_insert().
+ * It lives in TopTransactionContext, as it must survive resetting the message
+ * context but not the end of the transaction.
+ */
+typedef struct ApplyInsertBuffer
+{
+	Relation	localrel;		/* target relation, open until flushed */
+	EState	   *estate;			/* executor state for the whole batch */
+	TupleTableSlot *remoteslot; /* scratch slot to build tuples in */
+	ExprState **defexprs;		/* initialized default expressions */
+	TupleTableSlot *slots[MAX_BUFFERED_INSERTS];	/* buffered tuples */
+	int			nused;			/* number of 'slots' in use */
+	Size		bytes;			/* size of the buffered messages */
+} ApplyInsertBuffer;
+
+static ApplyInsertBuffer *insert_buffer = NULL;
+
 typedef struct SlotErrCallbackArg
 {
 	LogicalRepRelMapEntry *rel;
@@ -94,7 +138,7 @@ typedef struct SlotErrCallbackArg
 	int			remote_attnum;
 } SlotErrCallbackArg;
 
-static MemoryContext ApplyMessageContext = NULL;
+MemoryContext ApplyMessageContext = NULL;
 MemoryContext ApplyContext = NULL;
 
 WalReceiverConn *wrconn = NULL;
@@ -105,11 +149,51 @@ bool		MySubscriptionValid = false;
 bool		in_remote_transaction = false;
 static XLogRecPtr remote_final_lsn = InvalidXLogRecPtr;
 
-static void send_feedback(XLogRecPtr recvpos, bool force, bool requestReply);
+/*
+ * Where the changes of a subtransaction of a streamed transaction start in
+ * its spool file.
+ */
+typedef struct StreamSubXactEntry
+{
+	TransactionId xid;			/* subtransaction xid (hash key) */
+	int			index;			/* position in StreamXidEntry.subxids */
+	int			fileno;			/* spool file position of first change */
+	off_t		offset;
+} StreamSubXactEntry;
 
-static void store_flush_position(XLogRecPtr remote_lsn);
+/*
+ * Spool file of a transaction streamed by the publisher.
+ *
+ * Subtransactions are strictly nested, so when one aborts, all changes
+ * spooled since its first one belong to it or to its own subtransactions,
+ * and the file is simply truncated there.  To that end we remember where
+ * each subtransaction's changes start, and the order the subtransactions
+ * first appeared in.
+ */
+typedef struct StreamXidEntry
+{
+	TransactionId xid;			/* toplevel xid on the publisher (hash key) */
+	BufFile    *file;			/* spooled changes */
+	HTAB	   *subxacts;		/* StreamSubXactEntry by xid, or NULL */
+	TransactionId *subxids;		/* subtransactions in order of appearance */
+	int			nsubxids;
+	int			maxsubxids;
+	TransactionId last_subxid;	/* subtransaction of the last change */
+} StreamXidEntry;
+
+static HTAB *stream_xids = NULL;
+
+/* the streamed transaction we're receiving changes for, if any */
+static StreamXidEntry *stream_xid_entry = NULL;
+
+static void send_feedback(XLogRecPtr recvpos, bool force, bool requestReply);
 
-static void maybe_reread_subscription(void);
+static void apply_handle_commit_internal(LogicalRepCommitData *commit_data);
+static void apply_insert_buffer_flush(void);
+static StreamXidEntry *stream_get_entry(TransactionId xid, bool create);
+static void stream_drop_entry(StreamXidEntry *entry);
+static void stream_add_subxact(StreamXidEntry *entry, TransactionId subxid);
+static void stream_abort_subxact(StreamXidEntry *entry, TransactionId subxid);
 
 /* Flags set by signal handlers */
 static volatile sig_atomic_t got_SIGHUP = false;
@@ -203,6 +287,31 @@ create_estate_for_relation(LogicalRepRelMapEntry *rel)
 	return estate;
 }
 
+/*
+ * Initialize the default expressions of the relation's columns that we can't
+ * map to remote relation columns, for use with slot_fill_defaults().
+ *
+ * The expressions are planned once and cached in the relation map entry, so
+ * this only needs to build their executable state.
+ */
+static ExprState **
+init_default_exprs(LogicalRepRelMapEntry *rel)
+{
+	ExprState **defexprs;
+	int			i;
+
+	logicalrep_rel_load_defaults(rel);
+
+	if (rel->num_defaults == 0)
+		return NULL;
+
+	defexprs = (ExprState **) palloc(rel->num_defaults * sizeof(ExprState *));
+	for (i = 0; i < rel->num_defaults; i++)
+		defexprs[i] = ExecInitExpr(rel->defexprs[i], NULL);
+
+	return defexprs;
+}
+
 /*
  * Executes default values for columns for which we can't map to remote
  * relation columns.
@@ -211,55 +320,19 @@ create_estate_for_relation(LogicalRepRelMapEntry *rel)
  * than on the upstream.
  */
 static void
-slot_fill_defaults(LogicalRepRelMapEntry *rel, EState *estate,
-				   TupleTableSlot *slot)
+slot_fill_defaults(LogicalRepRelMapEntry *rel, ExprState **defexprs,
+				   EState *estate, TupleTableSlot *slot)
 {
-	TupleDesc	desc = RelationGetDescr(rel->localrel);
-	int			num_phys_attrs = desc->natts;
+	ExprContext *econtext = GetPerTupleExprContext(estate);
 	int			i;
-	int			attnum,
-				num_defaults = 0;
-	int		   *defmap;
-	ExprState **defexprs;
-	ExprContext *econtext;
-
-	econtext = GetPerTupleExprContext(estate);
-
-	/* We got all the data via replication, no need to evaluate anything. */
-	if (num_phys_attrs == rel->remoterel.natts)
-		return;
-
-	defmap = (int *) palloc(num_phys_attrs * sizeof(int));
-	defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
 
-	for (attnum = 0; attnum < num_phys_attrs; attnum++)
+	for (i = 0; i < rel->num_defaults; i++)
 	{
-		Expr	   *defexpr;
-
-		if (TupleDescAttr(desc, attnum)->attisdropped || TupleDescAttr(desc, attnum)->attgenerated)
-			continue;
-
-		if (rel->attrmap[attnum] >= 0)
-			continue;
-
-		defexpr = (Expr *) build_column_default(rel->localrel, attnum + 1);
-
-		if (defexpr != NULL)
-		{
-			/* Run the expression through planner */
-			defexpr = expression_planner(defexpr);
-
-			/* Initialize executable expression in copycontext */
-			defexprs[num_defaults] = ExecInitExpr(defexpr, NULL);
-			defmap[num_defaults] = attnum;
-			num_defaults++;
-		}
+		int			attnum = rel->defmap[i];
 
+		slot->tts_values[attnum] =
+			ExecEvalExpr(defexprs[i], econtext, &slot->tts_isnull[attnum]);
 	}
-
-	for (i = 0; i < num_defaults; i++)
-		slot->tts_values[defmap[i]] =
-			ExecEvalExpr(defexprs[i], econtext, &slot->tts_isnull[defmap[i]]);
 }
 
 /*
@@ -462,6 +535,24 @@ apply_handle_commit(StringInfo s)
 
 	Assert(commit_data.commit_lsn == remote_final_lsn);
 
+	apply_handle_commit_internal(&commit_data);
+}
+
+/*
+ * Common part of handling COMMIT and STREAM COMMIT messages.
+ */
+static void
+apply_handle_commit_internal(LogicalRepCommitData *commit_data)
+{
+	XLogRecPtr	local_end = InvalidXLogRecPtr;
+
+	/* Write out any inserts still buffered. */
+	apply_insert_buffer_flush();
+
+	/* Transactions applied in parallel must commit in the remote order. */
+	if (am_parallel_apply_worker())
+		pa_wait_for_commit_turn();
+
 	/* The synchronization worker runs in single transaction. */
 	if (IsTransactionState() && !am_tablesync_worker())
 	{
@@ -469,13 +560,15 @@ apply_handle_commit(StringInfo s)
 		 * Update origin state so we can restart streaming from correct
 		 * position in case of crash.
 		 */
-		replorigin_session_origin_lsn = commit_data.end_lsn;
-		replorigin_session_origin_timestamp = commit_data.committime;
+		replorigin_session_origin_lsn = commit_data->end_lsn;
+		replorigin_session_origin_timestamp = commit_data->committime;
 
 		CommitTransactionCommand();
 		pgstat_report_stat(false);
 
-		store_flush_position(commit_data.end_lsn);
+		local_end = XactLastCommitEnd;
+		if (!am_parallel_apply_worker())
+			store_flush_position(commit_data->end_lsn, local_end);
 	}
 	else
 	{
@@ -486,8 +579,17 @@ apply_handle_commit(StringInfo s)
 
 	in_remote_transaction = false;
 
-	/* Process any tables that are being synchronized in parallel. */
-	process_syncing_tables(commit_data.end_lsn);
+	/*
+	 * A parallel apply worker leaves flush tracking and table
+	 * synchronization to its leader.
+	 */
+	if (am_parallel_apply_worker())
+		pa_report_commit(commit_data->end_lsn, local_end);
+	else
+	{
+		/* Process any tables that are being synchronized in parallel. */
+		process_syncing_tables(commit_data->end_lsn);
+	}
 
 	pgstat_report_activity(STATE_IDLE, NULL);
 }
@@ -561,8 +663,98 @@ GetRelationIdentityOrPK(Relation rel)
 	return idxoid;
 }
 
+/*
+ * Can inserts into the relation be buffered?
+ *
+ * Like COPY FROM, we don't buffer when BEFORE ROW or INSTEAD OF triggers
+ * could modify or skip the tuples, or when volatile default expressions
+ * could query the table we're inserting into.
+ */
+static bool
+can_buffer_inserts(LogicalRepRelMapEntry *rel)
+{
+	TriggerDesc *trigdesc = rel->localrel->trigdesc;
+
+	if (trigdesc != NULL &&
+		(trigdesc->trig_insert_before_row ||
+		 trigdesc->trig_insert_instead_row))
+		return false;
+
+	return !rel->volatile_defaults;
+}
+
+/*
+ * Set up a new insert buffer for the relation.
+ */
+static ApplyInsertBuffer *
+apply_insert_buffer_create(LogicalRepRelMapEntry *rel)
+{
+	ApplyInsertBuffer *buffer;
+	MemoryContext oldctx;
+
+	oldctx = MemoryContextSwitchTo(TopTransactionContext);
+
+	buffer = (ApplyInsertBuffer *) palloc0(sizeof(ApplyInsertBuffer));
+	buffer->localrel = table_open(rel->localreloid, NoLock);
+	buffer->estate = create_estate_for_relation(rel);
+
+	MemoryContextSwitchTo(buffer->estate->es_query_cxt);
+
+	buffer->remoteslot = ExecInitExtraTupleSlot(buffer->estate,
+												RelationGetDescr(buffer->localrel),
+												&TTSOpsVirtual);
+	buffer->defexprs = init_default_exprs(rel);
+
+	ExecOpenIndices(buffer->estate->es_result_relation_info, false);
+
+	MemoryContextSwitchTo(oldctx);
+
+	return buffer;
+}
+
+/*
+ * Write out the buffered inserts, if any, and release the buffer.
+ */
+static void
+apply_insert_buffer_flush(void)
+{
+	ApplyInsertBuffer *buffer = insert_buffer;
+	EState	   *estate;
+
+	if (buffer == NULL)
+		return;
+
+	insert_buffer = NULL;
+	estate = buffer->estate;
+
+	Assert(buffer->nused > 0);
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* Do the inserts. */
+	ExecSimpleRelationMultiInsert(estate, buffer->slots, buffer->nused);
+
+	/* Cleanup. */
+	ExecCloseIndices(estate->es_result_relation_info);
+	PopActiveSnapshot();
+
+	/* Handle queued AFTER triggers. */
+	AfterTriggerEndQuery(estate);
+
+	ExecResetTupleTable(estate->es_tupleTable, false);
+	FreeExecutorState(estate);
+
+	table_close(buffer->localrel, NoLock);
+	pfree(buffer);
+
+	CommandCounterIncrement();
+}
+
 /*
  * Handle INSERT message.
+ *
+ * The new tuple is added to the insert buffer if the relation allows it, and
+ * inserted right away otherwise.
  */
 static void
 apply_handle_insert(StringInfo s)
@@ -572,6 +764,7 @@ apply_handle_insert(StringInfo s)
 	LogicalRepRelId relid;
 	EState	   *estate;
 	TupleTableSlot *remoteslot;
+	ExprState **defexprs;
 	MemoryContext oldctx;
 
 	ensure_transaction();
@@ -588,19 +781,74 @@ apply_handle_insert(StringInfo s)
 		return;
 	}
 
+	/*
+	 * Flush the inserts buffered for another relation, or for this one if its
+	 * relation map entry has been rebuilt since, which discards the default
+	 * expressions the buffer was set up with.
+	 */
+	if (insert_buffer != NULL &&
+		(RelationGetRelid(insert_buffer->localrel) != rel->localreloid ||
+		 !rel->defaults_valid))
+		apply_insert_buffer_flush();
+
+	/* Input functions may need an active snapshot, so get one */
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	logicalrep_rel_load_defaults(rel);
+
+	if (insert_buffer == NULL && can_buffer_inserts(rel))
+		insert_buffer = apply_insert_buffer_create(rel);
+
+	if (insert_buffer != NULL)
+	{
+		ApplyInsertBuffer *buffer = insert_buffer;
+		TupleTableSlot *batchslot;
+
+		estate = buffer->estate;
+
+		batchslot = buffer->slots[buffer->nused];
+		if (batchslot == NULL)
+		{
+			oldctx = MemoryContextSwitchTo(estate->es_query_cxt);
+			batchslot = table_slot_create(buffer->localrel,
+										  &estate->es_tupleTable);
+			buffer->slots[buffer->nused] = batchslot;
+			MemoryContextSwitchTo(oldctx);
+		}
+
+		/* Process remote tuple and store a copy of it in the buffer */
+		oldctx = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+		slot_store_cstrings(buffer->remoteslot, rel, newtup.values);
+		slot_fill_defaults(rel, buffer->defexprs, estate, buffer->remoteslot);
+		MemoryContextSwitchTo(oldctx);
+
+		ExecCopySlot(batchslot, buffer->remoteslot);
+		ResetPerTupleExprContext(estate);
+
+		buffer->nused++;
+		buffer->bytes += s->len;
+
+		PopActiveSnapshot();
+		logicalrep_rel_close(rel, NoLock);
+
+		if (buffer->nused >= MAX_BUFFERED_INSERTS ||
+			buffer->bytes >= MAX_BUFFERED_INSERT_BYTES)
+			apply_insert_buffer_flush();
+
+		return;
+	}
+
 	/* Initialize the executor state. */
 	estate = create_estate_for_relation(rel);
 	remoteslot = ExecInitExtraTupleSlot(estate,
 										RelationGetDescr(rel->localrel),
 										&TTSOpsVirtual);
 
-	/* Input functions may need an active snapshot, so get one */
-	PushActiveSnapshot(GetTransactionSnapshot());
-
 	/* Process and store remote tuple in the slot */
 	oldctx = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	defexprs = init_default_exprs(rel);
 	slot_store_cstrings(remoteslot, rel, newtup.values);
-	slot_fill_defaults(rel, estate, remoteslot);
+	slot_fill_defaults(rel, defexprs, estate, remoteslot);
 	MemoryContextSwitchTo(oldctx);
 
 	ExecOpenIndices(estate->es_result_relation_info, false);
@@ -942,13 +1190,390 @@ apply_handle_truncate(StringInfo s)
 
 
 /*
- * Logical replication protocol message dispatcher.
+ * Look up the spool file entry of a streamed transaction, creating it (and
+ * the file) if requested.
+ */
+static StreamXidEntry *
+stream_get_entry(TransactionId xid, bool create)
+{
+	StreamXidEntry *entry;
+	bool		found;
+
+	if (stream_xids == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!create)
+			return NULL;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(TransactionId);
+		ctl.entrysize = sizeof(StreamXidEntry);
+		ctl.hcxt = ApplyContext;
+		stream_xids = hash_create("logical replication streamed transactions",
+								  16, &ctl,
+								  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = hash_search(stream_xids, &xid,
+						create ? HASH_ENTER : HASH_FIND, &found);
+
+	if (create && !found)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(ApplyContext);
+
+		/* the file has to survive until the transaction commits remotely */
+		entry->file = BufFileCreateTemp(true);
+		entry->subxacts = NULL;
+		entry->subxids = NULL;
+		entry->nsubxids = 0;
+		entry->maxsubxids = 0;
+		entry->last_subxid = InvalidTransactionId;
+		MemoryContextSwitchTo(oldctx);
+	}
+
+	return entry;
+}
+
+/*
+ * Remove the spool file of a streamed transaction.
+ */
+static void
+stream_drop_entry(StreamXidEntry *entry)
+{
+	TransactionId xid = entry->xid;
+
+	BufFileClose(entry->file);
+	if (entry->subxacts != NULL)
+	{
+		hash_destroy(entry->subxacts);
+		pfree(entry->subxids);
+	}
+	hash_search(stream_xids, &xid, HASH_REMOVE, NULL);
+}
+
+/*
+ * Remember where the changes of a subtransaction start in the spool file, if
+ * this is its first change.
+ */
+static void
+stream_add_subxact(StreamXidEntry *entry, TransactionId subxid)
+{
+	StreamSubXactEntry *subxact;
+	bool		found;
+
+	/* changes of the same subtransaction usually come in runs */
+	if (subxid == entry->xid || subxid == entry->last_subxid)
+		return;
+	entry->last_subxid = subxid;
+
+	if (entry->subxacts == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(TransactionId);
+		ctl.entrysize = sizeof(StreamSubXactEntry);
+		ctl.hcxt = ApplyContext;
+		entry->subxacts = hash_create("logical replication streamed subtransactions",
+									  16, &ctl,
+									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		entry->maxsubxids = 16;
+		entry->subxids = MemoryContextAlloc(ApplyContext,
+											entry->maxsubxids * sizeof(TransactionId));
+	}
+
+	subxact = hash_search(entry->subxacts, &subxid, HASH_ENTER, &found);
+	if (found)
+		return;
+
+	if (entry->nsubxids >= entry->maxsubxids)
+	{
+		entry->maxsubxids *= 2;
+		entry->subxids = repalloc(entry->subxids,
+								  entry->maxsubxids * sizeof(TransactionId));
+	}
+	subxact->index = entry->nsubxids;
+	entry->subxids[entry->nsubxids++] = subxid;
+	BufFileTell(entry->file, &subxact->fileno, &subxact->offset);
+}
+
+/*
+ * Discard the spooled changes of an aborted subtransaction, along with those
+ * of all subtransactions that appeared after it, which are its own.
+ */
+static void
+stream_abort_subxact(StreamXidEntry *entry, TransactionId subxid)
+{
+	StreamSubXactEntry *subxact;
+	int			i;
+
+	/* nothing to do if we never got changes for it */
+	if (entry->subxacts == NULL)
+		return;
+	subxact = hash_search(entry->subxacts, &subxid, HASH_FIND, NULL);
+	if (subxact == NULL)
+		return;
+
+	BufFileTruncate(entry->file, subxact->fileno, subxact->offset);
+
+	for (i = entry->nsubxids - 1; i >= subxact->index; i--)
+		hash_search(entry->subxacts, &entry->subxids[i], HASH_REMOVE, NULL);
+	entry->nsubxids = i + 1;
+	entry->last_subxid = InvalidTransactionId;
+}
+
+/*
+ * Handle STREAM START message.
+ */
+static void
+apply_handle_stream_start(StringInfo s)
+{
+	TransactionId xid;
+	bool		first_segment;
+	StreamXidEntry *entry;
+
+	if (stream_xid_entry != NULL || in_remote_transaction)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("STREAM START message sent out of order")));
+
+	xid = logicalrep_read_stream_start(s, &first_segment);
+
+	if (!TransactionIdIsValid(xid))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("invalid transaction ID in streamed replication transaction")));
+
+	entry = stream_get_entry(xid, false);
+
+	/*
+	 * The first block of a transaction replaces anything left over from an
+	 * earlier, interrupted attempt to stream it.
+	 */
+	if (first_segment && entry != NULL)
+	{
+		stream_drop_entry(entry);
+		entry = NULL;
+	}
+
+	if (entry == NULL)
+	{
+		if (!first_segment)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg_internal("no earlier changes received for streamed transaction %u",
+									 xid)));
+		entry = stream_get_entry(xid, true);
+	}
+
+	stream_xid_entry = entry;
+
+	pgstat_report_activity(STATE_RUNNING, NULL);
+}
+
+/*
+ * Handle STREAM STOP message.
  */
 static void
+apply_handle_stream_stop(StringInfo s)
+{
+	if (stream_xid_entry == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("STREAM STOP message sent out of order")));
+
+	stream_xid_entry = NULL;
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/*
+ * Handle a message within a block of streamed changes.
+ *
+ * Changes are tagged with the (sub)transaction they belong to; they're
+ * spooled to the transaction's file as length and the message without the
+ * xid, noting where each subtransaction's changes start.  Relation and type
+ * information is applied right away, there's no need to wait for the commit
+ * with that.
+ */
+static void
+apply_handle_streamed_change(StringInfo s, char action)
+{
+	TransactionId xid;
+	int			len;
+
+	switch (action)
+	{
+		case 'I':
+		case 'U':
+		case 'D':
+		case 'T':
+			break;
+		case 'R':
+		case 'Y':
+			(void) pq_getmsgint(s, 4);	/* xid */
+			if (action == 'R')
+				apply_handle_relation(s);
+			else
+				apply_handle_type(s);
+			return;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid logical replication message type \"%c\" in streamed transaction",
+							action)));
+	}
+
+	xid = pq_getmsgint(s, 4);
+
+	/* the action byte plus the rest of the message */
+	len = 1 + s->len - s->cursor;
+
+	stream_add_subxact(stream_xid_entry, xid);
+
+	BufFileWrite(stream_xid_entry->file, &len, sizeof(len));
+	BufFileWrite(stream_xid_entry->file, &action, sizeof(action));
+	BufFileWrite(stream_xid_entry->file, &s->data[s->cursor], len - 1);
+}
+
+/*
+ * Handle STREAM ABORT message, of a toplevel transaction or one of its
+ * subtransactions.
+ */
+static void
+apply_handle_stream_abort(StringInfo s)
+{
+	TransactionId xid;
+	TransactionId subxid;
+	StreamXidEntry *entry;
+
+	if (stream_xid_entry != NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("STREAM ABORT message sent out of order")));
+
+	logicalrep_read_stream_abort(s, &xid, &subxid);
+
+	/* nothing to do if we never got changes for it */
+	entry = stream_get_entry(xid, false);
+	if (entry == NULL)
+		return;
+
+	if (xid == subxid)
+		stream_drop_entry(entry);
+	else
+		stream_abort_subxact(entry, subxid);
+}
+
+/*
+ * Handle STREAM COMMIT message: apply the spooled changes of the
+ * transaction, then commit like for a COMMIT message.
+ */
+static void
+apply_handle_stream_commit(StringInfo s)
+{
+	TransactionId xid;
+	LogicalRepCommitData commit_data;
+	StreamXidEntry *entry;
+	StringInfoData change;
+	int			nchanges = 0;
+
+	if (stream_xid_entry != NULL || in_remote_transaction)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("STREAM COMMIT message sent out of order")));
+
+	xid = logicalrep_read_stream_commit(s, &commit_data);
+
+	entry = stream_get_entry(xid, false);
+	if (entry == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg_internal("no changes received for streamed transaction %u",
+								 xid)));
+
+	/* act as if a BEGIN had been received */
+	remote_final_lsn = commit_data.commit_lsn;
+	in_remote_transaction = true;
+	pgstat_report_activity(STATE_RUNNING, NULL);
+
+	if (BufFileSeek(entry->file, 0, 0, SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rewind spool file of streamed transaction %u: %m",
+						xid)));
+
+	/* the buffer has to survive resetting the message context */
+	change.data = MemoryContextAlloc(ApplyContext, BLCKSZ);
+	change.maxlen = BLCKSZ;
+
+	for (;;)
+	{
+		int			len;
+		size_t		nread;
+
+		CHECK_FOR_INTERRUPTS();
+
+		nread = BufFileRead(entry->file, &len, sizeof(len));
+		if (nread == 0)
+			break;
+		if (nread != sizeof(len))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from spool file of streamed transaction %u",
+							xid)));
+
+		if (len > change.maxlen)
+		{
+			pfree(change.data);
+			change.data = MemoryContextAlloc(ApplyContext, len);
+			change.maxlen = len;
+		}
+
+		if (BufFileRead(entry->file, change.data, len) != len)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from spool file of streamed transaction %u",
+							xid)));
+
+		change.len = len;
+		change.cursor = 0;
+		apply_dispatch(&change);
+		nchanges++;
+
+		/* don't let memory used by the individual changes pile up */
+		MemoryContextReset(ApplyMessageContext);
+	}
+
+	pfree(change.data);
+	stream_drop_entry(entry);
+
+	elog(DEBUG1, "applied %d changes of streamed transaction %u",
+		 nchanges, xid);
+
+	apply_handle_commit_internal(&commit_data);
+}
+
+/*
+ * Logical replication protocol message dispatcher.
+ */
+void
 apply_dispatch(StringInfo s)
 {
 	char		action = pq_getmsgbyte(s);
 
+	/* within a block of streamed changes, these get spooled for later */
+	if (stream_xid_entry != NULL && action != 'E')
+	{
+		apply_handle_streamed_change(s, action);
+		return;
+	}
+
+	/* any other change must see the rows inserted before it */
+	if (action != 'I')
+		apply_insert_buffer_flush();
+
 	switch (action)
 	{
 			/* BEGIN */
@@ -987,6 +1612,22 @@ apply_dispatch(StringInfo s)
 		case 'O':
 			apply_handle_origin(s);
 			break;
+			/* STREAM START */
+		case 'S':
+			apply_handle_stream_start(s);
+			break;
+			/* STREAM STOP */
+		case 'E':
+			apply_handle_stream_stop(s);
+			break;
+			/* STREAM ABORT */
+		case 'A':
+			apply_handle_stream_abort(s);
+			break;
+			/* STREAM COMMIT */
+		case 'c':
+			apply_handle_stream_commit(s);
+			break;
 		default:
 			ereport(ERROR,
 					(errcode(ERRCODE_PROTOCOL_VIOLATION),
@@ -1051,8 +1692,8 @@ get_flush_position(XLogRecPtr *write, XLogRecPtr *flush,
 /*
  * Store current remote/local lsn pair in the tracking list.
  */
-static void
-store_flush_position(XLogRecPtr remote_lsn)
+void
+store_flush_position(XLogRecPtr remote_lsn, XLogRecPtr local_lsn)
 {
 	FlushPosition *flushpos;
 
@@ -1061,7 +1702,7 @@ store_flush_position(XLogRecPtr remote_lsn)
 
 	/* Track commit lsn  */
 	flushpos = (FlushPosition *) palloc(sizeof(FlushPosition));
-	flushpos->local_end = XactLastCommitEnd;
+	flushpos->local_end = local_lsn;
 	flushpos->remote_end = remote_lsn;
 
 	dlist_push_tail(&lsn_mapping, &flushpos->node);
@@ -1172,7 +1813,9 @@ LogicalRepApplyLoop(XLogRecPtr last_received)
 
 						UpdateWorkerStats(last_received, send_time, false);
 
-						apply_dispatch(&s);
+						/* Let a parallel apply worker take it, if possible. */
+						if (!pa_forward_message(&s, stream_xid_entry != NULL))
+							apply_dispatch(&s);
 					}
 					else if (c == 'k')
 					{
@@ -1199,10 +1842,13 @@ LogicalRepApplyLoop(XLogRecPtr last_received)
 			}
 		}
 
+		/* Collect the transactions committed by parallel apply workers. */
+		pa_process_worker_states();
+
 		/* confirm all writes so far */
 		send_feedback(last_received, false, false);
 
-		if (!in_remote_transaction)
+		if (!in_remote_transaction && !pa_transactions_in_flight())
 		{
 			/*
 			 * If we didn't get any transactions for a while there might be
@@ -1236,7 +1882,7 @@ LogicalRepApplyLoop(XLogRecPtr last_received)
 		 * no particular urgency about waking up unless we get data or a
 		 * signal.
 		 */
-		if (!dlist_is_empty(&lsn_mapping))
+		if (!dlist_is_empty(&lsn_mapping) || pa_transactions_in_flight())
 			wait_time = WalWriterDelay;
 		else
 			wait_time = NAPTIME_PER_CYCLE;
@@ -1345,9 +1991,10 @@ send_feedback(XLogRecPtr recvpos, bool force, bool requestReply)
 
 	/*
 	 * No outstanding transactions to flush, we can report the latest received
-	 * position. This is important for synchronous replication.
+	 * position. This is important for synchronous replication.  That doesn't
+	 * hold while parallel apply workers still have transactions to commit.
 	 */
-	if (!have_pending_txes)
+	if (!have_pending_txes && !pa_transactions_in_flight())
 		flushpos = writepos = recvpos;
 
 	if (writepos < last_writepos)
@@ -1404,7 +2051,7 @@ send_feedback(XLogRecPtr recvpos, bool force, bool requestReply)
 /*
  * Reread subscription info if needed. Most changes will be exit.
  */
-static void
+void
 maybe_reread_subscription(void)
 {
 	MemoryContext oldctx;
@@ -1514,6 +2161,34 @@ maybe_reread_subscription(void)
 		proc_exit(0);
 	}
 
+	/*
+	 * Exit if the streaming option was changed, it's passed to the publisher
+	 * when starting replication.  The launcher will start new worker.
+	 */
+	if (newsub->stream != MySubscription->stream)
+	{
+		ereport(LOG,
+				(errmsg("logical replication apply worker for subscription \"%s\" will "
+						"restart because the streaming option was changed",
+						MySubscription->name)));
+
+		proc_exit(0);
+	}
+
+	/*
+	 * Exit if the parallel_apply option was changed, so the new worker
+	 * starts with (or without) a pool of parallel apply workers.
+	 */
+	if (newsub->parallel_apply != MySubscription->parallel_apply)
+	{
+		ereport(LOG,
+				(errmsg("logical replication apply worker for subscription \"%s\" will "
+						"restart because the parallel_apply option was changed",
+						MySubscription->name)));
+
+		proc_exit(0);
+	}
+
 	/* Check for other changes that should never happen too. */
 	if (newsub->dbid != MySubscription->dbid)
 	{
@@ -1540,7 +2215,7 @@ maybe_reread_subscription(void)
 /*
  * Callback from subscription syscache invalidation.
  */
-static void
+void
 subscription_change_cb(Datum arg, int cacheid, uint32 hashvalue)
 {
 	MySubscriptionValid = false;
@@ -1692,7 +2367,7 @@ ApplyWorkerMain(Datum main_arg)
 		originid = replorigin_by_name(originname, true);
 		if (!OidIsValid(originid))
 			originid = replorigin_create(originname);
-		replorigin_session_setup(originid);
+		replorigin_session_setup(originid, 0);
 		replorigin_session_origin = originid;
 		origin_startpos = replorigin_session_get_progress(false);
 		CommitTransactionCommand();
@@ -1723,9 +2398,14 @@ ApplyWorkerMain(Datum main_arg)
 	options.logical = true;
 	options.startpoint = origin_startpos;
 	options.slotname = myslotname;
-	options.proto.logical.proto_version = LOGICALREP_PROTO_VERSION_NUM;
 	options.proto.logical.publication_names = MySubscription->publications;
 
+	/* streaming of large transactions needs a newer protocol version */
+	options.proto.logical.streaming = MySubscription->stream &&
+		walrcv_server_version(wrconn) >= 130000;
+	options.proto.logical.proto_version = options.proto.logical.streaming ?
+		LOGICALREP_PROTO_STREAM_VERSION_NUM : LOGICALREP_PROTO_VERSION_NUM;
+
 	/* Start normal logical streaming replication. */
 	walrcv_startstreaming(wrconn, &options);
 
@@ -19,6 +19,7 @@
 #include "replication/origin.h"
 #include "replication/pgoutput.h"
 
+#include "utils/builtins.h"
 #include "utils/inval.h"
 #include "utils/int8.h"
 #include "utils/memutils.h"
@@ -44,6 +45,16 @@ static void pgoutput_truncate(LogicalDecodingContext *ctx,
 							  ReorderBufferChange *change);
 static bool pgoutput_origin_filter(LogicalDecodingContext *ctx,
 								   RepOriginId origin_id);
+static void pgoutput_stream_start(LogicalDecodingContext *ctx,
+								  ReorderBufferTXN *txn);
+static void pgoutput_stream_stop(LogicalDecodingContext *ctx,
+								 ReorderBufferTXN *txn);
+static void pgoutput_stream_abort(LogicalDecodingContext *ctx,
+								  ReorderBufferTXN *txn,
+								  XLogRecPtr abort_lsn);
+static void pgoutput_stream_commit(LogicalDecodingContext *ctx,
+								   ReorderBufferTXN *txn,
+								   XLogRecPtr commit_lsn);
 
 static bool publications_valid;
 
@@ -51,11 +62,19 @@ static List *LoadPublications(List *pubnames);
 static void publication_invalidation_cb(Datum arg, int cacheid,
 										uint32 hashvalue);
 
-/* Entry in the map used to remember which relation schemas we sent. */
+/*
+ * Entry in the map used to remember which relation schemas we sent.
+ *
+ * A schema sent within a streamed transaction only reaches the subscriber if
+ * that transaction commits, so until then it's tracked per transaction, in
+ * streamed_txns (a list of toplevel xids).
+ */
 typedef struct RelationSyncEntry
 {
 	Oid			relid;			/* relation oid */
 	bool		schema_sent;	/* did we send the schema? */
+	List	   *streamed_txns;	/* streamed toplevel transactions that sent
+								 * the schema */
 	bool		replicate_valid;
 	PublicationActions pubactions;
 } RelationSyncEntry;
@@ -68,6 +87,7 @@ static RelationSyncEntry *get_rel_sync_entry(PGOutputData *data, Oid relid);
 static void rel_sync_cache_relation_cb(Datum arg, Oid relid);
 static void rel_sync_cache_publication_cb(Datum arg, int cacheid,
 										  uint32 hashvalue);
+static void cleanup_rel_sync_cache(TransactionId xid, bool is_commit);
 
 /*
  * Specify output plugin callbacks
@@ -84,15 +104,26 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->commit_cb = pgoutput_commit_txn;
 	cb->filter_by_origin_cb = pgoutput_origin_filter;
 	cb->shutdown_cb = pgoutput_shutdown;
+
+	/* transaction streaming */
+	cb->stream_start_cb = pgoutput_stream_start;
+	cb->stream_stop_cb = pgoutput_stream_stop;
+	cb->stream_abort_cb = pgoutput_stream_abort;
+	cb->stream_commit_cb = pgoutput_stream_commit;
+	cb->stream_change_cb = pgoutput_change;
+	cb->stream_truncate_cb = pgoutput_truncate;
 }
 
 static void
 parse_output_parameters(List *options, uint32 *protocol_version,
-						List **publication_names)
+						List **publication_names, bool *enable_streaming)
 {
 	ListCell   *lc;
 	bool		protocol_version_given = false;
 	bool		publication_names_given = false;
+	bool		streaming_given = false;
+
+	*enable_streaming = false;
 
 	foreach(lc, options)
 	{
@@ -138,6 +169,20 @@ parse_output_parameters(List *options, uint32 *protocol_version,
 						(errcode(ERRCODE_INVALID_NAME),
 						 errmsg("invalid publication_names syntax")));
 		}
+		else if (strcmp(defel->defname, "streaming") == 0)
+		{
+			if (streaming_given)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			streaming_given = true;
+
+			if (!parse_bool(strVal(defel->arg), enable_streaming))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid value for streaming option: \"%s\"",
+								strVal(defel->arg))));
+		}
 		else
 			elog(ERROR, "unrecognized pgoutput option: %s", defel->defname);
 	}
@@ -172,14 +217,15 @@ pgoutput_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 		/* Parse the params and ERROR if we see any we don't recognize */
 		parse_output_parameters(ctx->output_plugin_options,
 								&data->protocol_version,
-								&data->publication_names);
+								&data->publication_names,
+								&data->streaming);
 
 		/* Check if we support requested protocol */
-		if (data->protocol_version > LOGICALREP_PROTO_VERSION_NUM)
+		if (data->protocol_version > LOGICALREP_PROTO_MAX_VERSION_NUM)
 			ereport(ERROR,
 					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 					 errmsg("client sent proto_version=%d but we only support protocol %d or lower",
-							data->protocol_version, LOGICALREP_PROTO_VERSION_NUM)));
+							data->protocol_version, LOGICALREP_PROTO_MAX_VERSION_NUM)));
 
 		if (data->protocol_version < LOGICALREP_PROTO_MIN_VERSION_NUM)
 			ereport(ERROR,
@@ -192,6 +238,17 @@ pgoutput_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					 errmsg("publication_names parameter missing")));
 
+		/* Streaming needs a protocol version that knows about it. */
+		if (data->streaming &&
+			data->protocol_version < LOGICALREP_PROTO_STREAM_VERSION_NUM)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("requested proto_version=%d does not support streaming, need %d or higher",
+							data->protocol_version, LOGICALREP_PROTO_STREAM_VERSION_NUM)));
+
+		/* only stream in-progress transactions if the client asked for it */
+		ctx->streaming = data->streaming;
+
 		/* Init publication state. */
 		data->publications = NIL;
 		publications_valid = false;
@@ -202,6 +259,11 @@ pgoutput_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt,
 		/* Initialize relation schema cache. */
 		init_rel_sync_cache(CacheMemoryContext);
 	}
+	else
+	{
+		/* nothing is streamed while the slot is being created */
+		ctx->streaming = false;
+	}
 }
 
 /*
@@ -256,12 +318,21 @@ pgoutput_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 
 /*
  * Write the relation schema if the current schema hasn't been sent yet.
+ *
+ * When streaming, xid is the toplevel transaction being streamed, otherwise
+ * it's invalid.
  */
 static void
-maybe_send_schema(LogicalDecodingContext *ctx,
+maybe_send_schema(LogicalDecodingContext *ctx, TransactionId xid,
 				  Relation relation, RelationSyncEntry *relentry)
 {
-	if (!relentry->schema_sent)
+	bool		schema_sent = relentry->schema_sent;
+
+	/* a schema sent earlier in the same streamed transaction will do, too */
+	if (!schema_sent && TransactionIdIsValid(xid))
+		schema_sent = list_member_int(relentry->streamed_txns, (int) xid);
+
+	if (!schema_sent)
 	{
 		TupleDesc	desc;
 		int			i;
@@ -287,14 +358,24 @@ maybe_send_schema(LogicalDecodingContext *ctx,
 				continue;
 
 			OutputPluginPrepareWrite(ctx, false);
-			logicalrep_write_typ(ctx->out, att->atttypid);
+			logicalrep_write_typ(ctx->out, xid, att->atttypid);
 			OutputPluginWrite(ctx, false);
 		}
 
 		OutputPluginPrepareWrite(ctx, false);
-		logicalrep_write_rel(ctx->out, relation);
+		logicalrep_write_rel(ctx->out, xid, relation);
 		OutputPluginWrite(ctx, false);
-		relentry->schema_sent = true;
+
+		if (TransactionIdIsValid(xid))
+		{
+			MemoryContext oldctx = MemoryContextSwitchTo(CacheMemoryContext);
+
+			relentry->streamed_txns = lappend_int(relentry->streamed_txns,
+												  (int) xid);
+			MemoryContextSwitchTo(oldctx);
+		}
+		else
+			relentry->schema_sent = true;
 	}
 }
 
@@ -308,10 +389,22 @@ pgoutput_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	PGOutputData *data = (PGOutputData *) ctx->output_plugin_private;
 	MemoryContext old;
 	RelationSyncEntry *relentry;
+	TransactionId topxid = InvalidTransactionId;
+	TransactionId xid = InvalidTransactionId;
 
 	if (!is_publishable_relation(relation))
 		return;
 
+	/*
+	 * When streaming, tag the change with its (sub)transaction, so the
+	 * subscriber can discard it if that subtransaction aborts.
+	 */
+	if (data->in_streaming)
+	{
+		topxid = txn->xid;
+		xid = change->txn->xid;
+	}
+
 	relentry = get_rel_sync_entry(data, RelationGetRelid(relation));
 
 	/* First check the table filter */
@@ -336,14 +429,14 @@ pgoutput_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	/* Avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
-	maybe_send_schema(ctx, relation, relentry);
+	maybe_send_schema(ctx, topxid, relation, relentry);
 
 	/* Send the data */
 	switch (change->action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
 			OutputPluginPrepareWrite(ctx, true);
-			logicalrep_write_insert(ctx->out, relation,
+			logicalrep_write_insert(ctx->out, xid, relation,
 									&change->data.tp.newtuple->tuple);
 			OutputPluginWrite(ctx, true);
 			break;
@@ -353,7 +446,7 @@ pgoutput_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 				&change->data.tp.oldtuple->tuple : NULL;
 
 				OutputPluginPrepareWrite(ctx, true);
-				logicalrep_write_update(ctx->out, relation, oldtuple,
+				logicalrep_write_update(ctx->out, xid, relation, oldtuple,
 										&change->data.tp.newtuple->tuple);
 				OutputPluginWrite(ctx, true);
 				break;
@@ -362,7 +455,7 @@ pgoutput_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 			if (change->data.tp.oldtuple)
 			{
 				OutputPluginPrepareWrite(ctx, true);
-				logicalrep_write_delete(ctx->out, relation,
+				logicalrep_write_delete(ctx->out, xid, relation,
 										&change->data.tp.oldtuple->tuple);
 				OutputPluginWrite(ctx, true);
 			}
@@ -388,6 +481,14 @@ pgoutput_truncate(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	int			i;
 	int			nrelids;
 	Oid		   *relids;
+	TransactionId topxid = InvalidTransactionId;
+	TransactionId xid = InvalidTransactionId;
+
+	if (data->in_streaming)
+	{
+		topxid = txn->xid;
+		xid = change->txn->xid;
+	}
 
 	old = MemoryContextSwitchTo(data->context);
 
@@ -408,13 +509,14 @@ pgoutput_truncate(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 			continue;
 
 		relids[nrelids++] = relid;
-		maybe_send_schema(ctx, relation, relentry);
+		maybe_send_schema(ctx, topxid, relation, relentry);
 	}
 
 	if (nrelids > 0)
 	{
 		OutputPluginPrepareWrite(ctx, true);
 		logicalrep_write_truncate(ctx->out,
+								  xid,
 								  nrelids,
 								  relids,
 								  change->data.truncate.cascade,
@@ -436,6 +538,89 @@ pgoutput_origin_filter(LogicalDecodingContext *ctx,
 	return false;
 }
 
+/*
+ * START STREAM callback
+ */
+static void
+pgoutput_stream_start(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PGOutputData *data = (PGOutputData *) ctx->output_plugin_private;
+
+	/* we can't nest streaming of transactions */
+	Assert(!data->in_streaming);
+
+	OutputPluginPrepareWrite(ctx, true);
+	logicalrep_write_stream_start(ctx->out, txn->xid, !txn->streamed);
+	OutputPluginWrite(ctx, true);
+
+	data->in_streaming = true;
+}
+
+/*
+ * STOP STREAM callback
+ */
+static void
+pgoutput_stream_stop(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PGOutputData *data = (PGOutputData *) ctx->output_plugin_private;
+
+	Assert(data->in_streaming);
+
+	OutputPluginPrepareWrite(ctx, true);
+	logicalrep_write_stream_stop(ctx->out);
+	OutputPluginWrite(ctx, true);
+
+	data->in_streaming = false;
+}
+
+/*
+ * STREAM ABORT callback, for a toplevel transaction or a subtransaction
+ */
+static void
+pgoutput_stream_abort(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					  XLogRecPtr abort_lsn)
+{
+	PGOutputData *data PG_USED_FOR_ASSERTS_ONLY =
+	(PGOutputData *) ctx->output_plugin_private;
+	ReorderBufferTXN *toptxn;
+
+	/* aborts are sent outside of streaming blocks */
+	Assert(!data->in_streaming);
+
+	toptxn = txn->is_known_as_subxact ? txn->toptxn : txn;
+
+	OutputPluginPrepareWrite(ctx, true);
+	logicalrep_write_stream_abort(ctx->out, toptxn->xid, txn->xid);
+	OutputPluginWrite(ctx, true);
+
+	/* schemas sent within the transaction never reached the subscriber */
+	if (toptxn == txn)
+		cleanup_rel_sync_cache(toptxn->xid, false);
+}
+
+/*
+ * STREAM COMMIT callback
+ */
+static void
+pgoutput_stream_commit(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					   XLogRecPtr commit_lsn)
+{
+	PGOutputData *data PG_USED_FOR_ASSERTS_ONLY =
+	(PGOutputData *) ctx->output_plugin_private;
+
+	Assert(!data->in_streaming);
+	Assert(!txn->is_known_as_subxact);
+
+	OutputPluginUpdateProgress(ctx);
+
+	OutputPluginPrepareWrite(ctx, true);
+	logicalrep_write_stream_commit(ctx->out, txn, commit_lsn);
+	OutputPluginWrite(ctx, true);
+
+	/* schemas sent within the transaction are known downstream now */
+	cleanup_rel_sync_cache(txn->xid, true);
+}
+
 /*
  * Shutdown the output plugin.
  *
@@ -592,11 +777,40 @@ get_rel_sync_entry(PGOutputData *data, Oid relid)
 	}
 
 	if (!found)
+	{
 		entry->schema_sent = false;
+		entry->streamed_txns = NIL;
+	}
 
 	return entry;
 }
 
+/*
+ * Forget about the schemas sent within a streamed transaction, marking them
+ * as sent for good if it committed.
+ */
+static void
+cleanup_rel_sync_cache(TransactionId xid, bool is_commit)
+{
+	HASH_SEQ_STATUS hash_seq;
+	RelationSyncEntry *entry;
+
+	Assert(RelationSyncCache != NULL);
+
+	hash_seq_init(&hash_seq, RelationSyncCache);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (!list_member_int(entry->streamed_txns, (int) xid))
+			continue;
+
+		if (is_commit)
+			entry->schema_sent = true;
+
+		entry->streamed_txns = list_delete_int(entry->streamed_txns,
+											   (int) xid);
+	}
+}
+
 /*
  * Relcache invalidation callback
  */
@@ -629,10 +843,15 @@ rel_sync_cache_relation_cb(Datum arg, Oid relid)
 											  HASH_FIND, NULL);
 
 	/*
-	 * Reset schema sent status as the relation definition may have changed.
+	 * Reset schema sent status as the relation definition may have changed,
+	 * also within streamed transactions.
 	 */
 	if (entry != NULL)
+	{
 		entry->schema_sent = false;
+		list_free(entry->streamed_txns);
+		entry->streamed_txns = NIL;
+	}
 }
 
 /*
@@ -78,6 +78,9 @@ static SQLCmd *make_sqlcmd(void);
 %token K_WAL
 %token K_TABLESPACE_MAP
 %token K_NOVERIFY_CHECKSUMS
+%token K_COMPRESSION
+%token K_COMPRESSION_LEVEL
+%token K_INCREMENTAL
 %token K_TIMELINE
 %token K_PHYSICAL
 %token K_LOGICAL
@@ -156,6 +159,7 @@ var_name:	IDENT	{ $$ = $1; }
 /*
  * BASE_BACKUP [LABEL '<label>'] [PROGRESS] [FAST] [WAL] [NOWAIT]
  * [MAX_RATE %d] [TABLESPACE_MAP] [NOVERIFY_CHECKSUMS]
+ * [COMPRESSION '<method>'] [COMPRESSION_LEVEL %d] [INCREMENTAL '<lsn>']
  */
 base_backup:
 			K_BASE_BACKUP base_backup_opt_list
@@ -214,6 +218,21 @@ base_backup_opt:
 				  $$ = makeDefElem("noverify_checksums",
 								   (Node *)makeInteger(true), -1);
 				}
+			| K_COMPRESSION SCONST
+				{
+				  $$ = makeDefElem("compression",
+								   (Node *)makeString($2), -1);
+				}
+			| K_COMPRESSION_LEVEL UCONST
+				{
+				  $$ = makeDefElem("compression_level",
+								   (Node *)makeInteger($2), -1);
+				}
+			| K_INCREMENTAL SCONST
+				{
+				  $$ = makeDefElem("incremental",
+								   (Node *)makeString($2), -1);
+				}
 			;
 
 create_replication_slot:
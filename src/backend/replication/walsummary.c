@@ -0,0 +1,670 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummary.c
+ *	  Tracking of modified blocks, and WAL summary files.
+ *
+ * The WAL summarizer records which blocks of which relation forks a range
+ * of WAL modifies in a BlockRefTable, and writes it out as a summary file
+ * in pg_wal/summaries.  An incremental base backup reads back the summaries
+ * covering the WAL since the backup it's based on, to find out which blocks
+ * it has to send.
+ *
+ * A summary file consists of a header, one entry per relation fork giving
+ * the fork's limit block and its modified blocks as a list of ranges, and a
+ * CRC of everything before it.  Files are named after the timeline and the
+ * range of WAL they cover.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/replication/walsummary.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/pg_crc32c.h"
+#include "replication/walsummary.h"
+#include "storage/fd.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#define WAL_SUMMARY_MAGIC	0x5753554D	/* "WSUM" */
+
+typedef struct BlockRefTableKey
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} BlockRefTableKey;
+
+typedef struct BlockRefTableEntry
+{
+	BlockRefTableKey key;		/* hash key ... must be first */
+	BlockNumber limit_block;	/* InvalidBlockNumber if none */
+	BlockNumber *blocks;		/* modified blocks */
+	uint32		nblocks;
+	uint32		maxblocks;
+	bool		sorted;			/* blocks[] sorted and free of duplicates? */
+} BlockRefTableEntry;
+
+struct BlockRefTable
+{
+	MemoryContext mcxt;
+	HTAB	   *hash;
+};
+
+/* On-disk format of a summary file */
+typedef struct WalSummaryHeader
+{
+	uint32		magic;
+	TimeLineID	tli;
+	XLogRecPtr	start_lsn;
+	XLogRecPtr	end_lsn;
+	uint32		nentries;
+} WalSummaryHeader;
+
+typedef struct WalSummaryEntry
+{
+	BlockRefTableKey key;
+	BlockNumber limit_block;
+	uint32		nranges;
+	/* followed by nranges pairs of start and end (exclusive) blocks */
+} WalSummaryEntry;
+
+static BlockRefTableEntry *GetBlockRefTableEntry(BlockRefTable *brtab,
+												 const RelFileNode *rnode,
+												 ForkNumber forknum);
+static void SortBlockRefTableEntry(BlockRefTableEntry *entry);
+static int	compare_block_numbers(const void *a, const void *b);
+static int	compare_wal_summaries(const void *a, const void *b);
+static void WalSummaryFilePath(char *path, TimeLineID tli,
+							   XLogRecPtr start_lsn, XLogRecPtr end_lsn);
+
+
+/*
+ * Create an empty BlockRefTable, in a memory context of its own below the
+ * current one.
+ */
+BlockRefTable *
+CreateBlockRefTable(void)
+{
+	MemoryContext mcxt;
+	BlockRefTable *brtab;
+	HASHCTL		ctl;
+
+	mcxt = AllocSetContextCreate(CurrentMemoryContext,
+								 "BlockRefTable",
+								 ALLOCSET_DEFAULT_SIZES);
+	brtab = MemoryContextAlloc(mcxt, sizeof(BlockRefTable));
+	brtab->mcxt = mcxt;
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(BlockRefTableKey);
+	ctl.entrysize = sizeof(BlockRefTableEntry);
+	ctl.hcxt = mcxt;
+	brtab->hash = hash_create("BlockRefTable", 256, &ctl,
+							  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	return brtab;
+}
+
+/*
+ * Release all memory used by a BlockRefTable.
+ */
+void
+FreeBlockRefTable(BlockRefTable *brtab)
+{
+	MemoryContextDelete(brtab->mcxt);
+}
+
+/*
+ * Does the table record nothing at all?
+ */
+bool
+BlockRefTableIsEmpty(BlockRefTable *brtab)
+{
+	return hash_get_num_entries(brtab->hash) == 0;
+}
+
+/*
+ * Record that a block was modified.
+ */
+void
+BlockRefTableMarkBlockModified(BlockRefTable *brtab, const RelFileNode *rnode,
+							   ForkNumber forknum, BlockNumber blknum)
+{
+	BlockRefTableEntry *entry;
+
+	entry = GetBlockRefTableEntry(brtab, rnode, forknum);
+
+	/* Blocks past the limit block count as modified anyway. */
+	if (blknum >= entry->limit_block)
+		return;
+
+	/* Runs of records often modify the same block; don't repeat it. */
+	if (entry->nblocks > 0)
+	{
+		BlockNumber last = entry->blocks[entry->nblocks - 1];
+
+		if (last == blknum)
+			return;
+		if (last > blknum)
+			entry->sorted = false;
+	}
+
+	if (entry->nblocks >= entry->maxblocks)
+	{
+		entry->maxblocks *= 2;
+		entry->blocks = repalloc(entry->blocks,
+								 sizeof(BlockNumber) * entry->maxblocks);
+	}
+	entry->blocks[entry->nblocks++] = blknum;
+}
+
+/*
+ * Record that all blocks at or beyond limit_block must be regarded as
+ * modified, because the fork was truncated to that length, or created or
+ * dropped if limit_block is 0.
+ */
+void
+BlockRefTableSetLimitBlock(BlockRefTable *brtab, const RelFileNode *rnode,
+						   ForkNumber forknum, BlockNumber limit_block)
+{
+	BlockRefTableEntry *entry;
+
+	entry = GetBlockRefTableEntry(brtab, rnode, forknum);
+	if (limit_block < entry->limit_block)
+		entry->limit_block = limit_block;
+}
+
+/*
+ * Store the numbers of the modified blocks of the given fork that lie
+ * between start_blkno and stop_blkno (exclusive) in ascending order in
+ * blocks[], which must have room for stop_blkno - start_blkno entries, and
+ * return how many there are.
+ */
+int
+BlockRefTableGetModifiedBlocks(BlockRefTable *brtab, const RelFileNode *rnode,
+							   ForkNumber forknum, BlockNumber start_blkno,
+							   BlockNumber stop_blkno, BlockNumber *blocks)
+{
+	BlockRefTableKey key;
+	BlockRefTableEntry *entry;
+	BlockRefTableEntry *dbentry;
+	BlockNumber limit_block = stop_blkno;
+	BlockNumber blkno;
+	int			nresults = 0;
+
+	Assert(start_blkno <= stop_blkno);
+
+	memset(&key, 0, sizeof(key));
+	key.rnode = *rnode;
+	key.forknum = forknum;
+	entry = hash_search(brtab->hash, &key, HASH_FIND, NULL);
+
+	/* The whole database may have been created or dropped, too. */
+	key.rnode.relNode = InvalidOid;
+	dbentry = hash_search(brtab->hash, &key, HASH_FIND, NULL);
+	if (dbentry != NULL && dbentry->limit_block < limit_block)
+		limit_block = dbentry->limit_block;
+
+	if (entry != NULL)
+	{
+		uint32		lo = 0;
+		uint32		hi;
+
+		if (entry->limit_block < limit_block)
+			limit_block = entry->limit_block;
+
+		SortBlockRefTableEntry(entry);
+
+		/* Binary search for the first block >= start_blkno */
+		hi = entry->nblocks;
+		while (lo < hi)
+		{
+			uint32		mid = lo + (hi - lo) / 2;
+
+			if (entry->blocks[mid] < start_blkno)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (; lo < entry->nblocks; lo++)
+		{
+			blkno = entry->blocks[lo];
+			if (blkno >= stop_blkno || blkno >= limit_block)
+				break;
+			blocks[nresults++] = blkno;
+		}
+	}
+
+	for (blkno = Max(start_blkno, limit_block); blkno < stop_blkno; blkno++)
+		blocks[nresults++] = blkno;
+
+	return nresults;
+}
+
+/*
+ * Write the contents of a BlockRefTable out as the summary of the WAL
+ * between start_lsn and end_lsn.
+ */
+void
+WriteWalSummary(BlockRefTable *brtab, TimeLineID tli, XLogRecPtr start_lsn,
+				XLogRecPtr end_lsn)
+{
+	StringInfoData buf;
+	WalSummaryHeader header;
+	HASH_SEQ_STATUS status;
+	BlockRefTableEntry *entry;
+	pg_crc32c	crc;
+	char		path[MAXPGPATH];
+	char		tmppath[MAXPGPATH];
+	int			fd;
+
+	initStringInfo(&buf);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = WAL_SUMMARY_MAGIC;
+	header.tli = tli;
+	header.start_lsn = start_lsn;
+	header.end_lsn = end_lsn;
+	header.nentries = hash_get_num_entries(brtab->hash);
+	appendBinaryStringInfo(&buf, (char *) &header, sizeof(header));
+
+	hash_seq_init(&status, brtab->hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		WalSummaryEntry sentry;
+		int			offset;
+		uint32		i;
+
+		SortBlockRefTableEntry(entry);
+
+		memset(&sentry, 0, sizeof(sentry));
+		sentry.key = entry->key;
+		sentry.limit_block = entry->limit_block;
+		offset = buf.len;
+		appendBinaryStringInfo(&buf, (char *) &sentry, sizeof(sentry));
+
+		/* Coalesce consecutive blocks into ranges */
+		i = 0;
+		while (i < entry->nblocks)
+		{
+			BlockNumber range[2];
+
+			range[0] = entry->blocks[i];
+			range[1] = range[0] + 1;
+			while (++i < entry->nblocks && entry->blocks[i] == range[1])
+				range[1]++;
+
+			appendBinaryStringInfo(&buf, (char *) range, sizeof(range));
+			sentry.nranges++;
+		}
+		memcpy(buf.data + offset, &sentry, sizeof(sentry));
+	}
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, buf.data, buf.len);
+	FIN_CRC32C(crc);
+	appendBinaryStringInfo(&buf, (char *) &crc, sizeof(crc));
+
+	if (MakePGDirectory(WAL_SUMMARY_DIR) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m",
+						WAL_SUMMARY_DIR)));
+
+	WalSummaryFilePath(path, tli, start_lsn, end_lsn);
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	fd = OpenTransientFile(tmppath, O_RDWR | O_CREAT | O_TRUNC | PG_BINARY);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", tmppath)));
+
+	errno = 0;
+	pgstat_report_wait_start(WAIT_EVENT_WAL_SUMMARY_WRITE);
+	if (write(fd, buf.data, buf.len) != buf.len)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m", tmppath)));
+	}
+	pgstat_report_wait_end();
+
+	pgstat_report_wait_start(WAIT_EVENT_WAL_SUMMARY_SYNC);
+	if (pg_fsync(fd) != 0)
+		ereport(data_sync_elevel(ERROR),
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m", tmppath)));
+	pgstat_report_wait_end();
+
+	if (CloseTransientFile(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", tmppath)));
+
+	(void) durable_rename(tmppath, path, ERROR);
+
+	pfree(buf.data);
+}
+
+/*
+ * Read a summary file, and add its contents to a BlockRefTable.
+ */
+void
+ReadWalSummary(BlockRefTable *brtab, WalSummaryFile *ws)
+{
+	char		path[MAXPGPATH];
+	struct stat st;
+	char	   *data;
+	char	   *p;
+	char	   *end;
+	WalSummaryHeader header;
+	pg_crc32c	crc;
+	pg_crc32c	filecrc;
+	uint32		i;
+	int			fd;
+	int			r;
+
+	WalSummaryFilePath(path, ws->tli, ws->start_lsn, ws->end_lsn);
+
+	fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", path)));
+	if (fstat(fd, &st) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", path)));
+
+	if (st.st_size < sizeof(WalSummaryHeader) + sizeof(pg_crc32c))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("WAL summary file \"%s\" is too short", path)));
+
+	data = palloc(st.st_size);
+	pgstat_report_wait_start(WAIT_EVENT_WAL_SUMMARY_READ);
+	r = read(fd, data, st.st_size);
+	pgstat_report_wait_end();
+	if (r != st.st_size)
+	{
+		if (r < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", path)));
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("could not read file \"%s\": read %d of %zu",
+							path, r, (Size) st.st_size)));
+	}
+
+	if (CloseTransientFile(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", path)));
+
+	end = data + st.st_size - sizeof(pg_crc32c);
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, data, end - data);
+	FIN_CRC32C(crc);
+	memcpy(&filecrc, end, sizeof(pg_crc32c));
+	if (!EQ_CRC32C(crc, filecrc))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("calculated CRC checksum does not match value stored in file \"%s\"",
+						path)));
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != WAL_SUMMARY_MAGIC)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("WAL summary file \"%s\" has invalid magic number %08X",
+						path, header.magic)));
+
+	p = data + sizeof(header);
+	for (i = 0; i < header.nentries; i++)
+	{
+		WalSummaryEntry sentry;
+		uint32		j;
+
+		if (end - p < sizeof(sentry))
+			break;
+		memcpy(&sentry, p, sizeof(sentry));
+		p += sizeof(sentry);
+
+		if (sentry.limit_block != InvalidBlockNumber)
+			BlockRefTableSetLimitBlock(brtab, &sentry.key.rnode,
+									   sentry.key.forknum,
+									   sentry.limit_block);
+
+		if ((end - p) / (2 * sizeof(BlockNumber)) < sentry.nranges)
+			break;
+		for (j = 0; j < sentry.nranges; j++)
+		{
+			BlockNumber range[2];
+			BlockNumber blkno;
+
+			memcpy(range, p, sizeof(range));
+			p += sizeof(range);
+			for (blkno = range[0]; blkno < range[1]; blkno++)
+				BlockRefTableMarkBlockModified(brtab, &sentry.key.rnode,
+											   sentry.key.forknum, blkno);
+		}
+	}
+
+	if (i < header.nentries || p != end)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("WAL summary file \"%s\" is corrupt", path)));
+
+	pfree(data);
+}
+
+/*
+ * Return a list of the summary files on timeline tli that overlap with the
+ * WAL between start_lsn and end_lsn, sorted by start LSN.  A tli of 0 matches
+ * any timeline, and an end_lsn of InvalidXLogRecPtr means no upper bound.
+ */
+List *
+GetWalSummaries(TimeLineID tli, XLogRecPtr start_lsn, XLogRecPtr end_lsn)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	List	   *result = NIL;
+	List	   *sorted;
+
+	dir = AllocateDir(WAL_SUMMARY_DIR);
+	if (dir == NULL && errno == ENOENT)
+		return NIL;				/* nothing summarized yet */
+
+	while ((de = ReadDir(dir, WAL_SUMMARY_DIR)) != NULL)
+	{
+		WalSummaryFile *ws;
+		uint32		file_tli;
+		uint32		start_hi,
+					start_lo,
+					end_hi,
+					end_lo;
+		XLogRecPtr	file_start_lsn;
+		XLogRecPtr	file_end_lsn;
+
+		if (strlen(de->d_name) != 40 + strlen(".summary") ||
+			strspn(de->d_name, "0123456789ABCDEF") != 40 ||
+			strcmp(de->d_name + 40, ".summary") != 0)
+			continue;
+
+		if (sscanf(de->d_name, "%08X%08X%08X%08X%08X", &file_tli,
+				   &start_hi, &start_lo, &end_hi, &end_lo) != 5)
+			continue;
+		file_start_lsn = ((uint64) start_hi) << 32 | start_lo;
+		file_end_lsn = ((uint64) end_hi) << 32 | end_lo;
+
+		if (tli != 0 && file_tli != tli)
+			continue;
+		if (file_end_lsn <= start_lsn)
+			continue;
+		if (!XLogRecPtrIsInvalid(end_lsn) && file_start_lsn >= end_lsn)
+			continue;
+
+		ws = palloc(sizeof(WalSummaryFile));
+		ws->tli = file_tli;
+		ws->start_lsn = file_start_lsn;
+		ws->end_lsn = file_end_lsn;
+		result = lappend(result, ws);
+	}
+	FreeDir(dir);
+
+	sorted = list_qsort(result, compare_wal_summaries);
+	list_free(result);
+
+	return sorted;
+}
+
+/*
+ * Remove summary files that were written more than keep_minutes ago,
+ * except the newest one, which tells the summarizer where to carry on.
+ */
+void
+RemoveOldWalSummaries(int keep_minutes)
+{
+	List	   *summaries;
+	ListCell   *lc;
+	time_t		cutoff;
+
+	if (keep_minutes <= 0)
+		return;
+
+	cutoff = time(NULL) - (time_t) keep_minutes * SECS_PER_MINUTE;
+
+	summaries = GetWalSummaries(0, InvalidXLogRecPtr, InvalidXLogRecPtr);
+	foreach(lc, summaries)
+	{
+		WalSummaryFile *ws = lfirst(lc);
+		char		path[MAXPGPATH];
+		struct stat st;
+
+		/* The list is in order of start LSN, so the newest comes last. */
+		if (lnext(summaries, lc) == NULL)
+			break;
+
+		WalSummaryFilePath(path, ws->tli, ws->start_lsn, ws->end_lsn);
+		if (stat(path, &st) != 0 || st.st_mtime >= cutoff)
+			continue;
+
+		ereport(DEBUG1,
+				(errmsg("removing WAL summary file \"%s\"", path)));
+		if (unlink(path) != 0 && errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not remove file \"%s\": %m", path)));
+	}
+	list_free_deep(summaries);
+}
+
+/*
+ * Look up the entry for a relation fork, creating it if necessary.
+ */
+static BlockRefTableEntry *
+GetBlockRefTableEntry(BlockRefTable *brtab, const RelFileNode *rnode,
+					  ForkNumber forknum)
+{
+	BlockRefTableKey key;
+	BlockRefTableEntry *entry;
+	bool		found;
+
+	memset(&key, 0, sizeof(key));
+	key.rnode = *rnode;
+	key.forknum = forknum;
+
+	entry = hash_search(brtab->hash, &key, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->limit_block = InvalidBlockNumber;
+		entry->maxblocks = 16;
+		entry->blocks = MemoryContextAlloc(brtab->mcxt,
+										   sizeof(BlockNumber) * entry->maxblocks);
+		entry->nblocks = 0;
+		entry->sorted = true;
+	}
+
+	return entry;
+}
+
+/*
+ * Sort an entry's modified blocks, and remove duplicates.
+ */
+static void
+SortBlockRefTableEntry(BlockRefTableEntry *entry)
+{
+	uint32		i;
+	uint32		n = 0;
+
+	if (entry->sorted)
+		return;
+
+	qsort(entry->blocks, entry->nblocks, sizeof(BlockNumber),
+		  compare_block_numbers);
+	for (i = 0; i < entry->nblocks; i++)
+	{
+		if (n == 0 || entry->blocks[n - 1] != entry->blocks[i])
+			entry->blocks[n++] = entry->blocks[i];
+	}
+	entry->nblocks = n;
+	entry->sorted = true;
+}
+
+static int
+compare_block_numbers(const void *a, const void *b)
+{
+	BlockNumber ba = *(const BlockNumber *) a;
+	BlockNumber bb = *(const BlockNumber *) b;
+
+	if (ba < bb)
+		return -1;
+	if (ba > bb)
+		return 1;
+	return 0;
+}
+
+/* list_qsort comparator, sorting WalSummaryFiles by start LSN */
+static int
+compare_wal_summaries(const void *a, const void *b)
+{
+	WalSummaryFile *wa = lfirst(*(ListCell *const *) a);
+	WalSummaryFile *wb = lfirst(*(ListCell *const *) b);
+
+	if (wa->start_lsn < wb->start_lsn)
+		return -1;
+	if (wa->start_lsn > wb->start_lsn)
+		return 1;
+	if (wa->end_lsn < wb->end_lsn)
+		return -1;
+	if (wa->end_lsn > wb->end_lsn)
+		return 1;
+	return 0;
+}
+
+static void
+WalSummaryFilePath(char *path, TimeLineID tli, XLogRecPtr start_lsn,
+				   XLogRecPtr end_lsn)
+{
+	snprintf(path, MAXPGPATH, WAL_SUMMARY_DIR "/%08X%08X%08X%08X%08X.summary",
+			 tli,
+			 (uint32) (start_lsn >> 32), (uint32) start_lsn,
+			 (uint32) (end_lsn >> 32), (uint32) end_lsn);
+}
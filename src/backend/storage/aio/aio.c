@@ -0,0 +1,762 @@
+/*-------------------------------------------------------------------------
+ *
+ * aio.c
+ *	  Asynchronous I/O for shared buffers.
+ *
+ * Reads into and writes out of shared buffers can be queued here instead of
+ * being performed synchronously by the backend that needs them.  Queued
+ * requests are executed by io worker processes (see aio_worker.c), which
+ * perform them with the ordinary buffer manager routines, so all the usual
+ * buffer I/O interlocks apply.  This lets a single backend keep several
+ * reads in flight at once -- the backend later finds the block already in
+ * shared buffers, or waits for the worker's in-progress read to finish --
+ * and lets the checkpointer overlap its writes.
+ *
+ * Reads are fire-and-forget: they act as prefetch requests, and nobody
+ * waits for them.  Writes return a handle that the submitter must pass to
+ * pgaio_wait() to learn the outcome.  If no io worker is running, or the
+ * request queue is full, submission fails and the caller is expected to
+ * perform the I/O itself.  Requests that a worker could not complete are
+ * reported as failed; the submitter then repeats the I/O synchronously, so
+ * that any error is raised in its own context.
+ *
+ * Requests live in a fixed-size array in shared memory, protected by
+ * AioCtlLock.  Free slots and pending requests are kept on doubly-linked
+ * lists, so that queueing and unqueueing are O(1).  Each process keeps track
+ * of the handles it owns, and reads are tracked by relation in a shared hash
+ * table, so that error cleanup and dropping relations only visit the
+ * requests concerned rather than every slot; io_max_concurrency may be
+ * large.  Each request has a condition variable that is broadcast when the
+ * request completes.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/storage/aio/aio.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "catalog/pg_class.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/aio_internal.h"
+#include "storage/bufmgr.h"
+#include "lib/ilist.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+/*
+ * Readahead distance cap for scans using a buffer access strategy.  io
+ * workers read such blocks into a bulk-read ring of their own for each scan,
+ * which must not recycle a buffer before the scan gets around to it.
+ */
+#define PGAIO_RING_READAHEAD	16
+
+typedef enum PgAioState
+{
+	PGAIO_STATE_FREE,			/* on the free list */
+	PGAIO_STATE_PENDING,		/* queued, not yet picked up by a worker */
+	PGAIO_STATE_INFLIGHT,		/* being executed by a worker */
+	PGAIO_STATE_DONE			/* finished, waiting to be reaped */
+} PgAioState;
+
+/*
+ * Entry of the hash table of relations with reads queued or in flight.
+ */
+typedef struct PgAioRelEntry
+{
+	RelFileNode rnode;			/* hash key */
+	dlist_head	requests;		/* its read requests, via rel_node */
+} PgAioRelEntry;
+
+typedef struct PgAioRequest
+{
+	PgAioState	state;
+	bool		detached;		/* nobody will wait for this request */
+	bool		failed;			/* did the worker fail to execute it? */
+	int			result;			/* op-specific result */
+	dlist_node	node;			/* free list or pending queue link */
+	dlist_node	owner_node;		/* link in submitter's my_handles */
+	PgAioRelEntry *rel_entry;	/* read: relation entry, or NULL */
+	dlist_node	rel_node;		/* read: link in rel_entry->requests */
+	PgAioRequestData data;
+	ConditionVariable cv;		/* broadcast when request completes */
+} PgAioRequest;
+
+/*
+ * Shared state.  All fields, as well as the requests and the relation hash
+ * table, are protected by AioCtlLock.
+ */
+typedef struct PgAioCtlData
+{
+	int			nworkers;		/* number of running io workers */
+	dlist_head	freelist;		/* free requests */
+	dlist_head	pending;		/* pending requests, oldest first */
+	ConditionVariable submit_cv;	/* io workers sleep here */
+	PgAioRequest requests[FLEXIBLE_ARRAY_MEMBER];
+} PgAioCtlData;
+
+static PgAioCtlData *PgAioCtl = NULL;
+static HTAB *PgAioRelHash = NULL;
+
+/* GUC variables */
+int			io_method = IO_METHOD_SYNC;
+int			io_workers = 3;
+int			io_max_concurrency = 128;
+
+/* Request the current io worker is executing, or -1 */
+static int	my_inflight = -1;
+
+/*
+ * Requests this process submitted and will wait for, via owner_node.  Only
+ * the owner ever links or unlinks these, always while holding AioCtlLock.
+ */
+static dlist_head my_handles = DLIST_STATIC_INIT(my_handles);
+
+/* Have we registered pgaio_release_all_handles() to run at exit? */
+static bool handle_cleanup_registered = false;
+
+static int	pgaio_submit(const PgAioRequestData *data, bool detached);
+static void pgaio_release_locked(PgAioRequest *req);
+static void pgaio_forget_entry_locked(PgAioRelEntry *entry, int *wait_idx);
+static void pgaio_forget_matching(const RelFileNode *rnodes, int nnodes,
+								  Oid dbid);
+static void pgaio_at_exit(int code, Datum arg);
+static void pgaio_worker_detach(int code, Datum arg);
+
+
+/*
+ * AioShmemSize
+ *		Compute space needed for the asynchronous I/O request queue.
+ */
+Size
+AioShmemSize(void)
+{
+	Size		size;
+
+	size = offsetof(PgAioCtlData, requests);
+	size = add_size(size, mul_size(io_max_concurrency, sizeof(PgAioRequest)));
+	size = add_size(size, hash_estimate_size(io_max_concurrency,
+											 sizeof(PgAioRelEntry)));
+
+	return size;
+}
+
+/*
+ * AioShmemInit
+ *		Allocate and initialize the asynchronous I/O request queue.
+ */
+void
+AioShmemInit(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	PgAioCtl = (PgAioCtlData *)
+		ShmemInitStruct("Asynchronous I/O Control",
+						add_size(offsetof(PgAioCtlData, requests),
+								 mul_size(io_max_concurrency,
+										  sizeof(PgAioRequest))),
+						&found);
+
+	if (!found)
+	{
+		int			i;
+
+		PgAioCtl->nworkers = 0;
+		dlist_init(&PgAioCtl->freelist);
+		dlist_init(&PgAioCtl->pending);
+		ConditionVariableInit(&PgAioCtl->submit_cv);
+
+		for (i = 0; i < io_max_concurrency; i++)
+		{
+			PgAioRequest *req = &PgAioCtl->requests[i];
+
+			req->state = PGAIO_STATE_FREE;
+			req->rel_entry = NULL;
+			dlist_push_tail(&PgAioCtl->freelist, &req->node);
+			ConditionVariableInit(&req->cv);
+		}
+	}
+
+	/* Every relation in the table has at least one request */
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(RelFileNode);
+	info.entrysize = sizeof(PgAioRelEntry);
+	PgAioRelHash = ShmemInitHash("Asynchronous I/O Relations",
+								 io_max_concurrency, io_max_concurrency,
+								 &info,
+								 HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * pgaio_readahead_distance
+ *		How many blocks ahead should a sequential reader prefetch?
+ *
+ * Returns 0 when I/O is performed synchronously, since kernel readahead
+ * already serves sequential access patterns as well as posix_fadvise hints
+ * could.  use_ring indicates whether the reader uses a buffer access
+ * strategy.
+ */
+int
+pgaio_readahead_distance(bool use_ring)
+{
+	int			distance;
+
+	if (io_method == IO_METHOD_SYNC)
+		return 0;
+
+	distance = Min(target_prefetch_pages, io_max_concurrency);
+	if (use_ring)
+		distance = Min(distance, PGAIO_RING_READAHEAD);
+
+	return distance;
+}
+
+/*
+ * pgaio_submit_read
+ *		Queue a read of the given block into shared buffers.
+ *
+ * This is a prefetch: nobody waits for the read, and it's harmless if it
+ * never happens.  If the caller is going to read the block through a buffer
+ * access strategy, the io worker confines itself to a ring set aside for
+ * that strategy.  Returns false if the request could not be queued.
+ */
+bool
+pgaio_submit_read(RelFileNode rnode, char relpersistence, ForkNumber forknum,
+				  BlockNumber blocknum, BufferAccessStrategy strategy)
+{
+	PgAioRequestData data;
+
+	Assert(relpersistence != RELPERSISTENCE_TEMP);
+
+	data.op = PGAIO_OP_READ;
+	data.ring_owner = (strategy != NULL) ? MyProcPid : 0;
+	data.ring_id = (uint64) (uintptr_t) strategy;
+	data.relpersistence = relpersistence;
+	data.rnode = rnode;
+	data.forknum = forknum;
+	data.blocknum = blocknum;
+	data.buf_id = -1;
+
+	return pgaio_submit(&data, true) >= 0;
+}
+
+/*
+ * pgaio_submit_write
+ *		Queue a write of the given shared buffer, if it is dirty.
+ *
+ * Returns a handle that must be passed to pgaio_wait(), or
+ * InvalidPgAioHandle if the request could not be queued.  The result
+ * reported by pgaio_wait() is that of SyncOneBuffer().
+ */
+PgAioHandle
+pgaio_submit_write(int buf_id)
+{
+	PgAioRequestData data;
+
+	data.op = PGAIO_OP_WRITE;
+	data.ring_owner = 0;
+	data.ring_id = 0;
+	data.relpersistence = RELPERSISTENCE_PERMANENT;
+	data.rnode.spcNode = InvalidOid;
+	data.rnode.dbNode = InvalidOid;
+	data.rnode.relNode = InvalidOid;
+	data.forknum = InvalidForkNumber;
+	data.blocknum = InvalidBlockNumber;
+	data.buf_id = buf_id;
+
+	if (!handle_cleanup_registered)
+	{
+		before_shmem_exit(pgaio_at_exit, 0);
+		handle_cleanup_registered = true;
+	}
+
+	return pgaio_submit(&data, false);
+}
+
+/*
+ * pgaio_wait
+ *		Wait for a request returned by pgaio_submit_write() to complete.
+ *
+ * Returns false if the request failed, in which case the caller must
+ * perform the I/O itself.  Otherwise *result is set to the op-specific
+ * result.  Either way, the handle may not be used again.
+ */
+bool
+pgaio_wait(PgAioHandle handle, int *result)
+{
+	PgAioRequest *req;
+	bool		ok;
+
+	Assert(handle >= 0 && handle < io_max_concurrency);
+	req = &PgAioCtl->requests[handle];
+
+	ConditionVariablePrepareToSleep(&req->cv);
+	for (;;)
+	{
+		LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+		Assert(!req->detached && req->state != PGAIO_STATE_FREE);
+		if (req->state == PGAIO_STATE_DONE)
+		{
+			ok = !req->failed;
+			*result = req->result;
+			dlist_delete(&req->owner_node);
+			pgaio_release_locked(req);
+			LWLockRelease(AioCtlLock);
+			break;
+		}
+		LWLockRelease(AioCtlLock);
+
+		ConditionVariableSleep(&req->cv, WAIT_EVENT_AIO_COMPLETION);
+	}
+	ConditionVariableCancelSleep();
+
+	return ok;
+}
+
+/*
+ * pgaio_release_all_handles
+ *		Give up on all requests this process submitted but hasn't waited for.
+ *
+ * Used during error recovery.  Completed requests are freed immediately;
+ * the others are freed by the worker once it finishes them.
+ */
+void
+pgaio_release_all_handles(void)
+{
+	dlist_mutable_iter iter;
+
+	if (dlist_is_empty(&my_handles))
+		return;
+
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	dlist_foreach_modify(iter, &my_handles)
+	{
+		PgAioRequest *req = dlist_container(PgAioRequest, owner_node,
+											iter.cur);
+
+		Assert(!req->detached && req->state != PGAIO_STATE_FREE);
+		dlist_delete(&req->owner_node);
+		if (req->state == PGAIO_STATE_DONE)
+			pgaio_release_locked(req);
+		else
+			req->detached = true;
+	}
+	LWLockRelease(AioCtlLock);
+}
+
+/*
+ * pgaio_forget_relfilenodes
+ *		Discard queued reads of the given relations, and wait for any such
+ *		reads already in progress to finish.
+ *
+ * This must be called before dropping a relation's buffers, so that an io
+ * worker can't bring a block of a dropped or truncated relation back into
+ * shared buffers afterwards.  The caller must hold a lock that prevents new
+ * reads of the relations from being queued.
+ */
+void
+pgaio_forget_relfilenodes(const RelFileNode *rnodes, int nnodes)
+{
+	if (nnodes > 0)
+		pgaio_forget_matching(rnodes, nnodes, InvalidOid);
+}
+
+/*
+ * pgaio_forget_database
+ *		Like pgaio_forget_relfilenodes, for all relations of a database.
+ */
+void
+pgaio_forget_database(Oid dbid)
+{
+	pgaio_forget_matching(NULL, 0, dbid);
+}
+
+/*
+ * pgaio_worker_attach
+ *		Register the calling process as an io worker.
+ */
+void
+pgaio_worker_attach(void)
+{
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	PgAioCtl->nworkers++;
+	LWLockRelease(AioCtlLock);
+
+	on_shmem_exit(pgaio_worker_detach, 0);
+}
+
+/*
+ * pgaio_worker_dequeue
+ *		Fetch the oldest pending request for execution.
+ *
+ * Copies the request's parameters into *req and returns its index, which
+ * must later be passed to pgaio_worker_complete().  If the queue is empty,
+ * returns -1, after sleeping until new requests are submitted if wait is
+ * true.
+ */
+int
+pgaio_worker_dequeue(PgAioRequestData *req, bool wait)
+{
+	int			idx;
+	bool		more;
+
+	Assert(my_inflight < 0);
+
+	if (wait)
+		ConditionVariablePrepareToSleep(&PgAioCtl->submit_cv);
+
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	if (!dlist_is_empty(&PgAioCtl->pending))
+	{
+		PgAioRequest *r = dlist_container(PgAioRequest, node,
+										  dlist_pop_head_node(&PgAioCtl->pending));
+
+		idx = r - PgAioCtl->requests;
+		r->state = PGAIO_STATE_INFLIGHT;
+		*req = r->data;
+		my_inflight = idx;
+	}
+	else
+		idx = -1;
+	more = !dlist_is_empty(&PgAioCtl->pending);
+	LWLockRelease(AioCtlLock);
+
+	if (idx >= 0)
+	{
+		if (wait)
+			ConditionVariableCancelSleep();
+
+		/*
+		 * A single wakeup may have been consumed by us while more work is
+		 * queued, so pass it on to another worker.
+		 */
+		if (more)
+			ConditionVariableSignal(&PgAioCtl->submit_cv);
+	}
+	else if (wait)
+	{
+		ConditionVariableSleep(&PgAioCtl->submit_cv, WAIT_EVENT_IO_WORKER_MAIN);
+		ConditionVariableCancelSleep();
+	}
+
+	return idx;
+}
+
+/*
+ * pgaio_worker_complete
+ *		Report completion of a request obtained from pgaio_worker_dequeue().
+ */
+void
+pgaio_worker_complete(int idx, bool failed, int result)
+{
+	PgAioRequest *req = &PgAioCtl->requests[idx];
+
+	Assert(idx == my_inflight);
+
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	Assert(req->state == PGAIO_STATE_INFLIGHT);
+	req->failed = failed;
+	req->result = result;
+	if (req->detached)
+		pgaio_release_locked(req);
+	else
+		req->state = PGAIO_STATE_DONE;
+	my_inflight = -1;
+	LWLockRelease(AioCtlLock);
+
+	ConditionVariableBroadcast(&req->cv);
+}
+
+/*
+ * Queue a request, unless there's no worker to execute it or no free slot.
+ * Returns the request's index, or -1.
+ */
+static int
+pgaio_submit(const PgAioRequestData *data, bool detached)
+{
+	PgAioRequest *req;
+	PgAioRelEntry *entry = NULL;
+	int			idx;
+
+	if (io_method != IO_METHOD_WORKER || !IsUnderPostmaster ||
+		MyProc == NULL)
+		return -1;
+
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	if (PgAioCtl->nworkers == 0 || dlist_is_empty(&PgAioCtl->freelist))
+	{
+		LWLockRelease(AioCtlLock);
+		return -1;
+	}
+
+	/* Look up the relation entry first, so that failure leaks nothing */
+	if (data->op == PGAIO_OP_READ)
+	{
+		bool		found;
+
+		entry = (PgAioRelEntry *) hash_search(PgAioRelHash, &data->rnode,
+											  HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			LWLockRelease(AioCtlLock);
+			return -1;
+		}
+		if (!found)
+			dlist_init(&entry->requests);
+	}
+
+	req = dlist_container(PgAioRequest, node,
+						  dlist_pop_head_node(&PgAioCtl->freelist));
+	idx = req - PgAioCtl->requests;
+
+	req->state = PGAIO_STATE_PENDING;
+	req->detached = detached;
+	req->failed = false;
+	req->result = 0;
+	req->data = *data;
+
+	if (!detached)
+		dlist_push_tail(&my_handles, &req->owner_node);
+
+	req->rel_entry = entry;
+	if (entry != NULL)
+		dlist_push_tail(&entry->requests, &req->rel_node);
+
+	dlist_push_tail(&PgAioCtl->pending, &req->node);
+	LWLockRelease(AioCtlLock);
+
+	ConditionVariableSignal(&PgAioCtl->submit_cv);
+
+	return idx;
+}
+
+/*
+ * Return a request to the free list.  Caller must hold AioCtlLock, and must
+ * already have unlinked the request from the pending queue and from its
+ * owner's handles.
+ */
+static void
+pgaio_release_locked(PgAioRequest *req)
+{
+	PgAioRelEntry *entry = req->rel_entry;
+
+	if (entry != NULL)
+	{
+		dlist_delete(&req->rel_node);
+		req->rel_entry = NULL;
+		if (dlist_is_empty(&entry->requests))
+			hash_search(PgAioRelHash, &entry->rnode, HASH_REMOVE, NULL);
+	}
+
+	req->state = PGAIO_STATE_FREE;
+	req->detached = false;
+	dlist_push_head(&PgAioCtl->freelist, &req->node);
+}
+
+/*
+ * Discard the pending reads of one relation.  If a read of it is in flight,
+ * sets *wait_idx to that request, unless already set.  The entry is removed
+ * from the hash table if no reads remain.  Caller must hold AioCtlLock.
+ */
+static void
+pgaio_forget_entry_locked(PgAioRelEntry *entry, int *wait_idx)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &entry->requests)
+	{
+		PgAioRequest *req = dlist_container(PgAioRequest, rel_node,
+											iter.cur);
+
+		if (req->state == PGAIO_STATE_PENDING)
+		{
+			/*
+			 * Reads are always detached, so just free it.  Unlink it from
+			 * the entry here, so that the entry stays around while we're
+			 * iterating over it.
+			 */
+			Assert(req->detached);
+			dlist_delete(&req->rel_node);
+			req->rel_entry = NULL;
+			dlist_delete(&req->node);
+			pgaio_release_locked(req);
+		}
+		else if (*wait_idx < 0)
+		{
+			Assert(req->state == PGAIO_STATE_INFLIGHT);
+			*wait_idx = req - PgAioCtl->requests;
+		}
+	}
+
+	if (dlist_is_empty(&entry->requests))
+		hash_search(PgAioRelHash, &entry->rnode, HASH_REMOVE, NULL);
+}
+
+/*
+ * Does a read request concern one of the given relations, or (when dbid is
+ * valid) any relation of the given database?
+ */
+static bool
+pgaio_read_matches(PgAioRequest *req, const RelFileNode *rnodes, int nnodes,
+				   Oid dbid)
+{
+	int			i;
+
+	if (req->data.op != PGAIO_OP_READ)
+		return false;
+
+	if (OidIsValid(dbid))
+		return req->data.rnode.dbNode == dbid;
+
+	for (i = 0; i < nnodes; i++)
+	{
+		if (RelFileNodeEquals(req->data.rnode, rnodes[i]))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Workhorse for pgaio_forget_relfilenodes and pgaio_forget_database.
+ *
+ * If dbid is valid, rnodes is ignored and all relations of that database
+ * are forgotten.
+ */
+static void
+pgaio_forget_matching(const RelFileNode *rnodes, int nnodes, Oid dbid)
+{
+	if (io_method != IO_METHOD_WORKER)
+		return;
+
+	for (;;)
+	{
+		int			wait_idx = -1;
+		int			i;
+
+		LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+		if (OidIsValid(dbid))
+		{
+			HASH_SEQ_STATUS status;
+			PgAioRelEntry *entry;
+
+			hash_seq_init(&status, PgAioRelHash);
+			while ((entry = (PgAioRelEntry *) hash_seq_search(&status)) != NULL)
+			{
+				if (entry->rnode.dbNode == dbid)
+					pgaio_forget_entry_locked(entry, &wait_idx);
+			}
+		}
+		else
+		{
+			for (i = 0; i < nnodes; i++)
+			{
+				PgAioRelEntry *entry;
+
+				entry = (PgAioRelEntry *) hash_search(PgAioRelHash, &rnodes[i],
+													  HASH_FIND, NULL);
+				if (entry != NULL)
+					pgaio_forget_entry_locked(entry, &wait_idx);
+			}
+		}
+		LWLockRelease(AioCtlLock);
+
+		if (wait_idx < 0)
+			break;
+
+		/*
+		 * Wait for the in-progress read to finish, then look again.  Once it
+		 * has completed, the slot may have been reused for anything, but
+		 * then it's no longer our read.
+		 */
+		ConditionVariablePrepareToSleep(&PgAioCtl->requests[wait_idx].cv);
+		for (;;)
+		{
+			PgAioRequest *req = &PgAioCtl->requests[wait_idx];
+			bool		busy;
+
+			LWLockAcquire(AioCtlLock, LW_SHARED);
+			busy = (req->state == PGAIO_STATE_INFLIGHT &&
+					pgaio_read_matches(req, rnodes, nnodes, dbid));
+			LWLockRelease(AioCtlLock);
+
+			if (!busy)
+				break;
+			ConditionVariableSleep(&req->cv, WAIT_EVENT_AIO_COMPLETION);
+		}
+		ConditionVariableCancelSleep();
+	}
+}
+
+/*
+ * before_shmem_exit callback for processes that submitted writes.
+ */
+static void
+pgaio_at_exit(int code, Datum arg)
+{
+	pgaio_release_all_handles();
+}
+
+/*
+ * on_shmem_exit callback for io workers.
+ *
+ * If we die while executing a request, report it as failed.  If we are the
+ * last worker, fail all pending requests too, since nobody else is going to
+ * execute them; their submitters will perform the I/O themselves.
+ */
+static void
+pgaio_worker_detach(int code, Datum arg)
+{
+	int			inflight = my_inflight;
+
+	ConditionVariableCancelSleep();
+
+	LWLockAcquire(AioCtlLock, LW_EXCLUSIVE);
+	if (inflight >= 0)
+	{
+		PgAioRequest *req = &PgAioCtl->requests[inflight];
+
+		req->failed = true;
+		if (req->detached)
+			pgaio_release_locked(req);
+		else
+			req->state = PGAIO_STATE_DONE;
+		my_inflight = -1;
+	}
+
+	PgAioCtl->nworkers--;
+	if (PgAioCtl->nworkers == 0)
+	{
+		while (!dlist_is_empty(&PgAioCtl->pending))
+		{
+			PgAioRequest *req = dlist_container(PgAioRequest, node,
+												dlist_pop_head_node(&PgAioCtl->pending));
+
+			/*
+			 * Nobody waits for a pending detached request, but the owner of
+			 * any other one may be.
+			 */
+			req->failed = true;
+			if (req->detached)
+				pgaio_release_locked(req);
+			else
+			{
+				req->state = PGAIO_STATE_DONE;
+				ConditionVariableBroadcast(&req->cv);
+			}
+		}
+	}
+	LWLockRelease(AioCtlLock);
+
+	/* Wake up anyone waiting for the request we were executing */
+	if (inflight >= 0)
+		ConditionVariableBroadcast(&PgAioCtl->requests[inflight].cv);
+}
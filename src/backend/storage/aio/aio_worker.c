@@ -0,0 +1,273 @@
+/*-------------------------------------------------------------------------
+ *
+ * aio_worker.c
+ *	  io worker processes, which execute queued asynchronous I/O requests.
+ *
+ * When io_method is "worker", the postmaster starts io_workers background
+ * workers at startup.  Each one repeatedly takes the oldest request from the
+ * shared queue maintained by aio.c and executes it with the ordinary buffer
+ * manager routines.  An io worker holds no locks or pins between requests.
+ *
+ * Errors while executing a request are caught and reported as a failed
+ * request; the submitter, if it is waiting, then repeats the I/O itself.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/storage/aio/aio_worker.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <signal.h>
+
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/bgwriter.h"
+#include "storage/aio_internal.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "storage/condition_variable.h"
+#include "storage/fd.h"
+#include "storage/lwlock.h"
+#include "storage/smgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+/*
+ * Reads on behalf of scans that use a buffer access strategy go through a
+ * bulk-read ring of our own, so that they don't wipe out the rest of the
+ * buffer pool.  Each such scan gets a separate ring, so that concurrent scans
+ * don't recycle each other's prefetched buffers before their submitters get
+ * around to them.  We keep rings for up to IO_WORKER_MAX_RINGS scans, and
+ * hand the least recently used one over to a scan we haven't seen yet.
+ */
+#define IO_WORKER_MAX_RINGS		16
+
+typedef struct IoWorkerRing
+{
+	int			owner;			/* pid of the submitter, or 0 if unused */
+	uint64		id;				/* submitter's identifier for its ring */
+	uint64		last_used;		/* ring_clock value when last used */
+	BufferAccessStrategy strategy;	/* NULL until first used */
+} IoWorkerRing;
+
+static IoWorkerRing rings[IO_WORKER_MAX_RINGS];
+static uint64 ring_clock = 0;
+
+static volatile sig_atomic_t got_SIGHUP = false;
+
+static BufferAccessStrategy io_worker_get_ring(int owner, uint64 id);
+static void io_worker_sighup(SIGNAL_ARGS);
+
+
+/*
+ * AioWorkersRegister
+ *		Register the io worker processes, if io_method calls for them.
+ *
+ * Called by the postmaster at startup.
+ */
+void
+AioWorkersRegister(void)
+{
+	BackgroundWorker bgw;
+	int			i;
+
+	if (io_method != IO_METHOD_WORKER)
+		return;
+
+	for (i = 0; i < io_workers; i++)
+	{
+		memset(&bgw, 0, sizeof(bgw));
+		bgw.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		bgw.bgw_start_time = BgWorkerStart_PostmasterStart;
+		snprintf(bgw.bgw_library_name, BGW_MAXLEN, "postgres");
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN, "IoWorkerMain");
+		snprintf(bgw.bgw_name, BGW_MAXLEN, "io worker %d", i);
+		snprintf(bgw.bgw_type, BGW_MAXLEN, "io worker");
+		bgw.bgw_restart_time = 1;
+		bgw.bgw_notify_pid = 0;
+		bgw.bgw_main_arg = Int32GetDatum(i);
+
+		RegisterBackgroundWorker(&bgw);
+	}
+}
+
+/*
+ * IoWorkerMain
+ *		Main entry point for io worker processes.
+ */
+void
+IoWorkerMain(Datum main_arg)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext io_worker_context;
+	WritebackContext wb_context;
+	volatile int current = -1;
+
+	pqsignal(SIGHUP, io_worker_sighup);
+	pqsignal(SIGTERM, die);
+
+	InitBufferPoolBackend();
+	CreateAuxProcessResourceOwner();
+
+	io_worker_context = AllocSetContextCreate(TopMemoryContext,
+											  "IO Worker",
+											  ALLOCSET_DEFAULT_SIZES);
+	MemoryContextSwitchTo(io_worker_context);
+
+	WritebackContextInit(&wb_context, &checkpoint_flush_after);
+
+	pgaio_worker_attach();
+
+	/*
+	 * If an exception is encountered, processing resumes here.
+	 *
+	 * See notes in postgres.c about the design of this coding.
+	 */
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		/* Since not using PG_TRY, must reset error stack by hand */
+		error_context_stack = NULL;
+
+		/* Prevent interrupts while cleaning up */
+		HOLD_INTERRUPTS();
+
+		/* Report the error to the server log */
+		EmitErrorReport();
+
+		/* A minimal subset of AbortTransaction(), as in bgwriter */
+		LWLockReleaseAll();
+		ConditionVariableCancelSleep();
+		AbortBufferIO();
+		UnlockBuffers();
+		ReleaseAuxProcessResources(false);
+		AtEOXact_Buffers(false);
+		AtEOXact_SMgr();
+		AtEOXact_Files(false);
+		AtEOXact_HashTables(false);
+
+		MemoryContextSwitchTo(io_worker_context);
+		FlushErrorState();
+
+		/* The submitter will have to perform the I/O itself */
+		if (current >= 0)
+			pgaio_worker_complete(current, true, 0);
+		current = -1;
+
+		WritebackContextInit(&wb_context, &checkpoint_flush_after);
+		smgrcloseall();
+
+		/* Now we can allow interrupts again */
+		RESUME_INTERRUPTS();
+
+		/* Report wait end here, when there is no further possibility of wait */
+		pgstat_report_wait_end();
+	}
+
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	BackgroundWorkerUnblockSignals();
+
+	for (;;)
+	{
+		PgAioRequestData req;
+		int			result = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		current = pgaio_worker_dequeue(&req, false);
+		if (current < 0)
+		{
+			/*
+			 * Nothing to do.  Before going to sleep, issue any writeback
+			 * requests we've accumulated, and close files so that we don't
+			 * keep dropped relations' files open indefinitely.
+			 */
+			IssuePendingWritebacks(&wb_context);
+			smgrcloseall();
+
+			current = pgaio_worker_dequeue(&req, true);
+			if (current < 0)
+				continue;
+		}
+
+		switch (req.op)
+		{
+			case PGAIO_OP_READ:
+				ReadBufferForAio(req.rnode, req.relpersistence, req.forknum,
+								 req.blocknum,
+								 req.ring_owner != 0 ?
+								 io_worker_get_ring(req.ring_owner, req.ring_id) :
+								 NULL);
+				break;
+			case PGAIO_OP_WRITE:
+				result = WriteBufferForAio(req.buf_id, &wb_context);
+				break;
+		}
+
+		pgaio_worker_complete(current, false, result);
+		current = -1;
+	}
+}
+
+/*
+ * Return the buffer ring to use for reads on behalf of the given submitter's
+ * scan, taking over the least recently used ring if it has none yet.
+ */
+static BufferAccessStrategy
+io_worker_get_ring(int owner, uint64 id)
+{
+	IoWorkerRing *victim = &rings[0];
+	int			i;
+
+	for (i = 0; i < IO_WORKER_MAX_RINGS; i++)
+	{
+		IoWorkerRing *ring = &rings[i];
+
+		if (ring->owner == owner && ring->id == id)
+		{
+			ring->last_used = ++ring_clock;
+			return ring->strategy;
+		}
+		if (ring->last_used < victim->last_used)
+			victim = ring;
+	}
+
+	/*
+	 * The buffers the ring held for its previous scan are simply recycled
+	 * for the new one, as they would be by the previous scan itself.
+	 */
+	if (victim->strategy == NULL)
+		victim->strategy = GetAccessStrategy(BAS_BULKREAD);
+	victim->owner = owner;
+	victim->id = id;
+	victim->last_used = ++ring_clock;
+
+	return victim->strategy;
+}
+
+/* SIGHUP: set flag to re-read config file at next convenient time */
+static void
+io_worker_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_SIGHUP = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
@@ -9,6 +9,14 @@
  * in most cases the caller needs to adjust the buffer header contents
  * before the lock is released (see notes in README).
  *
+ * The exception is BufTableLookupOptimistic, which probes the table without
+ * any lock.  To let it detect concurrent changes, each partition has a
+ * change counter that BufTableInsert and BufTableDelete advance before and
+ * after modifying the table, so that it is odd while a change is in
+ * progress.  This works because the partitioned hash table never expands
+ * and never frees its entries: an unlocked reader can follow stale links,
+ * but only into other entries, never into freed memory.
+ *
  *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -32,7 +40,15 @@ typedef struct
 	int			id;				/* Associated buffer ID */
 } BufferLookupEnt;
 
+/* per-partition change counter, padded to avoid false sharing */
+typedef union
+{
+	pg_atomic_uint32 changecount;
+	char		pad[PG_CACHE_LINE_SIZE];
+} BufTablePartitionSeq;
+
 static HTAB *SharedBufHash;
+static BufTablePartitionSeq *SharedBufSeq;
 
 
 /*
@@ -42,7 +58,15 @@ static HTAB *SharedBufHash;
 Size
 BufTableShmemSize(int size)
 {
-	return hash_estimate_size(size, sizeof(BufferLookupEnt));
+	Size		sz;
+
+	sz = hash_estimate_size(size, sizeof(BufferLookupEnt));
+	sz = add_size(sz, mul_size(NUM_BUFFER_PARTITIONS,
+							   sizeof(BufTablePartitionSeq)));
+	/* to allow aligning the counters on a cache line boundary */
+	sz = add_size(sz, PG_CACHE_LINE_SIZE);
+
+	return sz;
 }
 
 /*
@@ -53,6 +77,7 @@ void
 InitBufTable(int size)
 {
 	HASHCTL		info;
+	bool		found;
 
 	/* assume no locking is needed yet */
 
@@ -65,6 +90,20 @@ InitBufTable(int size)
 								  size, size,
 								  &info,
 								  HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+
+	SharedBufSeq = (BufTablePartitionSeq *)
+		CACHELINEALIGN(ShmemInitStruct("Shared Buffer Lookup Change Counters",
+									   NUM_BUFFER_PARTITIONS *
+									   sizeof(BufTablePartitionSeq) +
+									   PG_CACHE_LINE_SIZE,
+									   &found));
+	if (!found)
+	{
+		int			i;
+
+		for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
+			pg_atomic_init_u32(&SharedBufSeq[i].changecount, 0);
+	}
 }
 
 /*
@@ -106,6 +145,69 @@ BufTableLookup(BufferTag *tagPtr, uint32 hashcode)
 	return result->id;
 }
 
+/*
+ * BufTableLookupOptimistic
+ *		Lookup the given BufferTag without holding any lock
+ *
+ * Returns false if the tag's partition was being modified concurrently, in
+ * which case the caller must retry with BufTableLookup under the partition
+ * lock.  Otherwise sets *buf_id to the buffer ID, or -1 if not found.
+ *
+ * Even when true is returned, the answer may be out of date by the time the
+ * caller looks at it, since nothing prevents the mapping from changing
+ * right afterwards.  A caller that wants to use the buffer must pin it and
+ * then verify that it still holds the tag; see BufferAlloc.
+ */
+bool
+BufTableLookupOptimistic(BufferTag *tagPtr, uint32 hashcode, int *buf_id)
+{
+	pg_atomic_uint32 *changecount;
+	BufferLookupEnt *result;
+	uint32		before;
+	int			id = -1;
+
+	changecount = &SharedBufSeq[BufTableHashPartition(hashcode)].changecount;
+
+	before = pg_atomic_read_u32(changecount);
+	if (before & 1)
+		return false;
+	pg_read_barrier();
+
+	result = (BufferLookupEnt *)
+		hash_search_with_hash_value(SharedBufHash,
+									(void *) tagPtr,
+									hashcode,
+									HASH_FIND,
+									NULL);
+	if (result)
+		id = result->id;
+
+	pg_read_barrier();
+	if (pg_atomic_read_u32(changecount) != before)
+		return false;
+
+	/* a torn read is caught above, but be paranoid about the range */
+	if (id < -1 || id >= NBuffers)
+		return false;
+
+	*buf_id = id;
+	return true;
+}
+
+/*
+ * Advance the change counter of the tag's partition.  Called before and
+ * after each modification, for the benefit of BufTableLookupOptimistic.
+ * The atomic increment acts as a full memory barrier.
+ */
+static inline void
+BufTableAdvanceChangeCount(uint32 hashcode)
+{
+	BufTablePartitionSeq *seq;
+
+	seq = &SharedBufSeq[BufTableHashPartition(hashcode)];
+	pg_atomic_fetch_add_u32(&seq->changecount, 1);
+}
+
 /*
  * BufTableInsert
  *		Insert a hashtable entry for given tag and buffer ID,
@@ -125,6 +227,8 @@ BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id)
 	Assert(buf_id >= 0);		/* -1 is reserved for not-in-table */
 	Assert(tagPtr->blockNum != P_NEW);	/* invalid tag */
 
+	BufTableAdvanceChangeCount(hashcode);
+
 	result = (BufferLookupEnt *)
 		hash_search_with_hash_value(SharedBufHash,
 									(void *) tagPtr,
@@ -132,11 +236,14 @@ BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id)
 									HASH_ENTER,
 									&found);
 
+	if (!found)
+		result->id = buf_id;
+
+	BufTableAdvanceChangeCount(hashcode);
+
 	if (found)					/* found something already in the table */
 		return result->id;
 
-	result->id = buf_id;
-
 	return -1;
 }
 
@@ -151,6 +258,8 @@ BufTableDelete(BufferTag *tagPtr, uint32 hashcode)
 {
 	BufferLookupEnt *result;
 
+	BufTableAdvanceChangeCount(hashcode);
+
 	result = (BufferLookupEnt *)
 		hash_search_with_hash_value(SharedBufHash,
 									(void *) tagPtr,
@@ -158,6 +267,8 @@ BufTableDelete(BufferTag *tagPtr, uint32 hashcode)
 									HASH_REMOVE,
 									NULL);
 
+	BufTableAdvanceChangeCount(hashcode);
+
 	if (!result)				/* shouldn't happen */
 		elog(ERROR, "shared buffer hash table corrupted");
 }
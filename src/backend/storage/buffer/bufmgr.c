@@ -43,6 +43,7 @@
 #include "pg_trace.h"
 #include "pgstat.h"
 #include "postmaster/bgwriter.h"
+#include "storage/aio.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
 #include "storage/ipc.h"
@@ -440,6 +441,8 @@ static void BufferSync(int flags);
 static uint32 WaitBufHdrUnlocked(BufferDesc *buf);
 static int	SyncOneBuffer(int buf_id, bool skip_recently_used,
 						  WritebackContext *wb_context);
+static bool BufferSyncComplete(PgAioHandle handle, int buf_id,
+							   WritebackContext *wb_context);
 static void WaitIO(BufferDesc *buf);
 static bool StartBufferIO(BufferDesc *buf, bool forInput);
 static void TerminateBufferIO(BufferDesc *buf, bool clear_dirty,
@@ -529,6 +532,22 @@ ComputeIoConcurrency(int io_concurrency, double *target)
  */
 void
 PrefetchBuffer(Relation reln, ForkNumber forkNum, BlockNumber blockNum)
+{
+	PrefetchBufferExtended(reln, forkNum, blockNum, NULL);
+}
+
+/*
+ * PrefetchBufferExtended -- like PrefetchBuffer, for callers that will read
+ *		the block using a buffer access strategy
+ *
+ * When asynchronous I/O is available, the block is read into shared buffers
+ * by an io worker, rather than merely hinted to the kernel.  The io worker
+ * reads blocks for a strategy through a buffer ring of its own, set aside
+ * for that strategy.
+ */
+void
+PrefetchBufferExtended(Relation reln, ForkNumber forkNum, BlockNumber blockNum,
+					   BufferAccessStrategy strategy)
 {
 #ifdef USE_PREFETCH
 	Assert(RelationIsValid(reln));
@@ -549,42 +568,74 @@ PrefetchBuffer(Relation reln, ForkNumber forkNum, BlockNumber blockNum)
 		LocalPrefetchBuffer(reln->rd_smgr, forkNum, blockNum);
 	}
 	else
-	{
-		BufferTag	newTag;		/* identity of requested block */
-		uint32		newHash;	/* hash value for newTag */
-		LWLock	   *newPartitionLock;	/* buffer partition lock for it */
-		int			buf_id;
+		PrefetchSharedBuffer(reln->rd_smgr, reln->rd_rel->relpersistence,
+							 forkNum, blockNum, strategy);
+#endif							/* USE_PREFETCH */
+}
 
-		/* create a tag so we can lookup the buffer */
-		INIT_BUFFERTAG(newTag, reln->rd_smgr->smgr_rnode.node,
-					   forkNum, blockNum);
+/*
+ * PrefetchSharedBuffer -- initiate asynchronous read of a block of a
+ *		relation that uses shared buffers, given only its smgr relation
+ *
+ * This is the workhorse of PrefetchBufferExtended, and is also used during
+ * recovery, where there is no relcache entry.  Returns true if the block
+ * wasn't found in shared buffers, so that an I/O was initiated (or would
+ * have been, if prefetching were supported).
+ */
+bool
+PrefetchSharedBuffer(SMgrRelation smgr_reln, char relpersistence,
+					 ForkNumber forkNum, BlockNumber blockNum,
+					 BufferAccessStrategy strategy)
+{
+	BufferTag	newTag;			/* identity of requested block */
+	uint32		newHash;		/* hash value for newTag */
+	LWLock	   *newPartitionLock;	/* buffer partition lock for it */
+	int			buf_id;
+
+	Assert(BlockNumberIsValid(blockNum));
 
-		/* determine its hash code and partition lock ID */
-		newHash = BufTableHashCode(&newTag);
-		newPartitionLock = BufMappingPartitionLock(newHash);
+	/* create a tag so we can lookup the buffer */
+	INIT_BUFFERTAG(newTag, smgr_reln->smgr_rnode.node, forkNum, blockNum);
+
+	/* determine its hash code and partition lock ID */
+	newHash = BufTableHashCode(&newTag);
+	newPartitionLock = BufMappingPartitionLock(newHash);
 
-		/* see if the block is in the buffer pool already */
+	/*
+	 * See if the block is in the buffer pool already.  This is only a hint,
+	 * so an unlocked lookup is good enough unless it ran into a concurrent
+	 * change.
+	 */
+	if (!BufTableLookupOptimistic(&newTag, newHash, &buf_id))
+	{
 		LWLockAcquire(newPartitionLock, LW_SHARED);
 		buf_id = BufTableLookup(&newTag, newHash);
 		LWLockRelease(newPartitionLock);
+	}
 
-		/* If not in buffers, initiate prefetch */
-		if (buf_id < 0)
-			smgrprefetch(reln->rd_smgr, forkNum, blockNum);
+	/*
+	 * If the block *is* in buffers, we do nothing.  This is not really ideal:
+	 * the block might be just about to be evicted, which would be stupid
+	 * since we know we are going to need it soon.  But the only easy answer
+	 * is to bump the usage_count, which does not seem like a great solution:
+	 * when the caller does ultimately touch the block, usage_count would get
+	 * bumped again, resulting in too much favoritism for blocks that are
+	 * involved in a prefetch sequence. A real fix would involve some
+	 * additional per-buffer state, and it's not clear that there's enough of
+	 * a problem to justify that.
+	 */
+	if (buf_id >= 0)
+		return false;
 
-		/*
-		 * If the block *is* in buffers, we do nothing.  This is not really
-		 * ideal: the block might be just about to be evicted, which would be
-		 * stupid since we know we are going to need it soon.  But the only
-		 * easy answer is to bump the usage_count, which does not seem like a
-		 * great solution: when the caller does ultimately touch the block,
-		 * usage_count would get bumped again, resulting in too much
-		 * favoritism for blocks that are involved in a prefetch sequence. A
-		 * real fix would involve some additional per-buffer state, and it's
-		 * not clear that there's enough of a problem to justify that.
-		 */
-	}
-#endif							/* USE_PREFETCH */
+	/*
+	 * Not in buffers, so initiate prefetch: queue an asynchronous read, or
+	 * failing that ask the kernel to start reading the block.
+	 */
+	if (!pgaio_submit_read(smgr_reln->smgr_rnode.node, relpersistence,
+						   forkNum, blockNum, strategy))
+		smgrprefetch(smgr_reln, forkNum, blockNum);
+
+	return true;
 }
 
 
@@ -696,6 +747,46 @@ ReadBufferWithoutRelcache(RelFileNode rnode, ForkNumber forkNum,
 }
 
 
+/*
+ * ReadBufferForAio -- read a block into shared buffers on behalf of an
+ *		asynchronous read request
+ *
+ * This is used by io workers, which have no relcache entry for the relation,
+ * to execute a prefetch queued by PrefetchBufferExtended.  The buffer is
+ * released again immediately.
+ */
+void
+ReadBufferForAio(RelFileNode rnode, char relpersistence, ForkNumber forkNum,
+				 BlockNumber blockNum, BufferAccessStrategy strategy)
+{
+	SMgrRelation smgr = smgropen(rnode, InvalidBackendId);
+	Buffer		buf;
+	bool		hit;
+
+	Assert(relpersistence != RELPERSISTENCE_TEMP);
+
+	buf = ReadBuffer_common(smgr, relpersistence, forkNum, blockNum,
+							RBM_NORMAL, strategy, &hit);
+	ReleaseBuffer(buf);
+}
+
+/*
+ * WriteBufferForAio -- write out a shared buffer on behalf of an
+ *		asynchronous write request
+ *
+ * This is used by io workers to execute writes queued by BufferSync.
+ * Returns the result of SyncOneBuffer().
+ */
+int
+WriteBufferForAio(int buf_id, WritebackContext *wb_context)
+{
+	/* Make sure we can handle the pin inside SyncOneBuffer */
+	ResourceOwnerEnlargeBuffers(CurrentResourceOwner);
+
+	return SyncOneBuffer(buf_id, false, wb_context);
+}
+
+
 /*
  * ReadBuffer_common -- common logic for all ReadBuffer variants
  *
@@ -1005,8 +1096,9 @@ BufferAlloc(SMgrRelation smgr, char relpersistence, ForkNumber forkNum,
 	LWLock	   *oldPartitionLock;	/* buffer partition lock for it */
 	uint32		oldFlags;
 	int			buf_id;
-	BufferDesc *buf;
-	bool		valid;
+	BufferDesc *buf = NULL;		/* keep compiler quiet */
+	bool		found;
+	bool		valid = false;
 	uint32		buf_state;
 
 	/* create a tag so we can lookup the buffer */
@@ -1016,23 +1108,60 @@ BufferAlloc(SMgrRelation smgr, char relpersistence, ForkNumber forkNum,
 	newHash = BufTableHashCode(&newTag);
 	newPartitionLock = BufMappingPartitionLock(newHash);
 
-	/* see if the block is in the buffer pool already */
-	LWLockAcquire(newPartitionLock, LW_SHARED);
-	buf_id = BufTableLookup(&newTag, newHash);
-	if (buf_id >= 0)
+	/*
+	 * See if the block is in the buffer pool already.  Most lookups find it
+	 * there, so first try without taking the mapping lock, to avoid
+	 * contention on the partition lock's cache line.
+	 */
+	found = BufTableLookupOptimistic(&newTag, newHash, &buf_id);
+	if (found && buf_id >= 0)
 	{
 		/*
-		 * Found it.  Now, pin the buffer so no one can steal it from the
-		 * buffer pool, and check to see if the correct data has been loaded
-		 * into the buffer.
+		 * Pin the buffer.  Since we don't hold the mapping lock, it might
+		 * have been reassigned to another page before we got the pin.  But
+		 * nobody can change the tag of a buffer that we hold pinned (see
+		 * the refcount checks in the victim selection code below and in
+		 * InvalidateBuffer), so once pinned, it's safe to check the tag
+		 * without the buffer header lock.
 		 */
 		buf = GetBufferDescriptor(buf_id);
 
 		valid = PinBuffer(buf, strategy);
 
+		if (!(pg_atomic_read_u32(&buf->state) & BM_TAG_VALID) ||
+			!BUFFERTAGS_EQUAL(buf->tag, newTag))
+		{
+			/* lost the race; do it the slow way */
+			UnpinBuffer(buf, true);
+			found = false;
+		}
+	}
+
+	if (!found)
+	{
+		LWLockAcquire(newPartitionLock, LW_SHARED);
+		buf_id = BufTableLookup(&newTag, newHash);
+		if (buf_id >= 0)
+		{
+			/*
+			 * Found it.  Now, pin the buffer so no one can steal it from the
+			 * buffer pool.
+			 */
+			buf = GetBufferDescriptor(buf_id);
+
+			valid = PinBuffer(buf, strategy);
+		}
+
 		/* Can release the mapping lock as soon as we've pinned it */
 		LWLockRelease(newPartitionLock);
+	}
 
+	if (buf_id >= 0)
+	{
+		/*
+		 * Found and pinned it.  Check to see if the correct data has been
+		 * loaded into the buffer.
+		 */
 		*foundPtr = true;
 
 		if (!valid)
@@ -1059,9 +1188,10 @@ BufferAlloc(SMgrRelation smgr, char relpersistence, ForkNumber forkNum,
 
 	/*
 	 * Didn't find it in the buffer pool.  We'll have to initialize a new
-	 * buffer.  Remember to unlock the mapping lock while doing the work.
+	 * buffer.  We don't hold the mapping lock while doing the work; if
+	 * somebody else loads the page meanwhile, we'll notice when we try to
+	 * insert our hashtable entry below.
 	 */
-	LWLockRelease(newPartitionLock);
 
 	/* Loop here in case we have to try another victim buffer */
 	for (;;)
@@ -1797,10 +1927,27 @@ BufferSync(int flags)
 	int			i;
 	int			mask = BM_DIRTY;
 	WritebackContext wb_context;
+	int			max_inflight;
+	int			ninflight = 0;
+	int			inflight_head = 0;
+	PgAioHandle *inflight_handles = NULL;
+	int		   *inflight_buf_ids = NULL;
 
 	/* Make sure we can handle the pin inside SyncOneBuffer */
 	ResourceOwnerEnlargeBuffers(CurrentResourceOwner);
 
+	/*
+	 * If io workers are available, we hand writes off to them and only wait
+	 * for a write when too many are in flight.  Leave half the request queue
+	 * for reads.
+	 */
+	max_inflight = (io_method == IO_METHOD_WORKER) ? io_max_concurrency / 2 : 0;
+	if (max_inflight > 0)
+	{
+		inflight_handles = (PgAioHandle *) palloc(max_inflight * sizeof(PgAioHandle));
+		inflight_buf_ids = (int *) palloc(max_inflight * sizeof(int));
+	}
+
 	/*
 	 * Unless this is a shutdown checkpoint or we have been explicitly told,
 	 * we write only permanent, dirty buffers.  But at shutdown or end of
@@ -1989,7 +2136,38 @@ BufferSync(int flags)
 		 */
 		if (pg_atomic_read_u32(&bufHdr->state) & BM_CHECKPOINT_NEEDED)
 		{
-			if (SyncOneBuffer(buf_id, false, &wb_context) & BUF_WRITTEN)
+			PgAioHandle handle = InvalidPgAioHandle;
+
+			if (max_inflight > 0)
+			{
+				/* Wait for the oldest write, if too many are in flight */
+				if (ninflight == max_inflight)
+				{
+					int			oldest_buf_id = inflight_buf_ids[inflight_head];
+
+					if (BufferSyncComplete(inflight_handles[inflight_head],
+										   oldest_buf_id, &wb_context))
+					{
+						TRACE_POSTGRESQL_BUFFER_SYNC_WRITTEN(oldest_buf_id);
+						BgWriterStats.m_buf_written_checkpoints++;
+						num_written++;
+					}
+					inflight_head = (inflight_head + 1) % max_inflight;
+					ninflight--;
+				}
+
+				handle = pgaio_submit_write(buf_id);
+			}
+
+			if (handle != InvalidPgAioHandle)
+			{
+				int			slot = (inflight_head + ninflight) % max_inflight;
+
+				inflight_handles[slot] = handle;
+				inflight_buf_ids[slot] = buf_id;
+				ninflight++;
+			}
+			else if (SyncOneBuffer(buf_id, false, &wb_context) & BUF_WRITTEN)
 			{
 				TRACE_POSTGRESQL_BUFFER_SYNC_WRITTEN(buf_id);
 				BgWriterStats.m_buf_written_checkpoints++;
@@ -2022,9 +2200,30 @@ BufferSync(int flags)
 		CheckpointWriteDelay(flags, (double) num_processed / num_to_scan);
 	}
 
+	/* wait for all writes still in flight */
+	while (ninflight > 0)
+	{
+		int			oldest_buf_id = inflight_buf_ids[inflight_head];
+
+		if (BufferSyncComplete(inflight_handles[inflight_head],
+							   oldest_buf_id, &wb_context))
+		{
+			TRACE_POSTGRESQL_BUFFER_SYNC_WRITTEN(oldest_buf_id);
+			BgWriterStats.m_buf_written_checkpoints++;
+			num_written++;
+		}
+		inflight_head = (inflight_head + 1) % max_inflight;
+		ninflight--;
+	}
+
 	/* issue all pending flushes */
 	IssuePendingWritebacks(&wb_context);
 
+	if (max_inflight > 0)
+	{
+		pfree(inflight_handles);
+		pfree(inflight_buf_ids);
+	}
 	pfree(per_ts_stat);
 	per_ts_stat = NULL;
 	binaryheap_free(ts_heap);
@@ -2336,6 +2535,24 @@ BgBufferSync(WritebackContext *wb_context)
 	return (bufs_to_lap == 0 && recent_alloc == 0);
 }
 
+/*
+ * BufferSyncComplete -- wait for a checkpoint write handed to an io worker
+ *
+ * If the io worker failed to perform the write, we do it ourselves, so that
+ * any error is reported by the checkpointer.  Returns true if the buffer was
+ * written.
+ */
+static bool
+BufferSyncComplete(PgAioHandle handle, int buf_id, WritebackContext *wb_context)
+{
+	int			result;
+
+	if (!pgaio_wait(handle, &result))
+		result = SyncOneBuffer(buf_id, false, wb_context);
+
+	return (result & BUF_WRITTEN) != 0;
+}
+
 /*
  * SyncOneBuffer -- process a single buffer during syncing.
  *
@@ -2937,6 +3154,9 @@ DropRelFileNodeBuffers(RelFileNodeBackend rnode, ForkNumber forkNum,
 		return;
 	}
 
+	/* Make sure no io worker is about to read blocks of the relation */
+	pgaio_forget_relfilenodes(&rnode.node, 1);
+
 	for (i = 0; i < NBuffers; i++)
 	{
 		BufferDesc *bufHdr = GetBufferDescriptor(i);
@@ -3015,6 +3235,9 @@ DropRelFileNodesAllBuffers(RelFileNodeBackend *rnodes, int nnodes)
 		return;
 	}
 
+	/* Make sure no io worker is about to read blocks of the relations */
+	pgaio_forget_relfilenodes(nodes, n);
+
 	/*
 	 * For low number of relations to drop just use a simple walk through, to
 	 * save the bsearch overhead. The threshold to use is rather a guess than
@@ -3093,6 +3316,9 @@ DropDatabaseBuffers(Oid dbid)
 	 * database isn't our own.
 	 */
 
+	/* Make sure no io worker is about to read blocks of the database */
+	pgaio_forget_database(dbid);
+
 	for (i = 0; i < NBuffers; i++)
 	{
 		BufferDesc *bufHdr = GetBufferDescriptor(i);
@@ -737,6 +737,55 @@ BufFileTell(BufFile *file, int *fileno, off_t *offset)
 	*offset = file->curOffset + file->pos;
 }
 
+/*
+ * BufFileTruncate
+ *
+ * Discard the contents of the file from the given position, as returned by
+ * BufFileTell, onwards.  The current position is moved to the new end of
+ * the file.  ereport()s on failure.
+ */
+void
+BufFileTruncate(BufFile *file, int fileno, off_t offset)
+{
+	int			i;
+
+	Assert(!file->readOnly);
+	Assert(fileno >= 0 && fileno < file->numFiles);
+	Assert(offset >= 0 && offset <= MAX_PHYSICAL_FILESIZE);
+
+	/* Write out the buffer first, so that we can simply forget it */
+	if (BufFileFlush(file) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to temporary file: %m")));
+
+	/* Drop the segments after the new end, then truncate the last one */
+	for (i = file->numFiles - 1; i > fileno; i--)
+	{
+		FileClose(file->files[i]);
+		if (file->fileset != NULL)
+		{
+			char		segment_name[MAXPGPATH];
+
+			SharedSegmentName(segment_name, file->name, i);
+			SharedFileSetDelete(file->fileset, segment_name, true);
+		}
+	}
+	file->numFiles = fileno + 1;
+
+	if (FileTruncate(file->files[fileno], offset,
+					 WAIT_EVENT_BUFFILE_TRUNCATE) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not truncate file \"%s\": %m",
+						FilePathName(file->files[fileno]))));
+
+	file->curFile = fileno;
+	file->curOffset = offset;
+	file->pos = 0;
+	file->nbytes = 0;
+}
+
 /*
  * BufFileSeekBlock --- block-oriented seek
  *
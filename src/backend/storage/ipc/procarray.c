@@ -32,6 +32,14 @@
  * happen, it would tie up KnownAssignedXids indefinitely, so we protect
  * ourselves by pruning the array when a valid list of running XIDs arrives.
  *
+ * Taking a snapshot must be cheap even with thousands of backends, so
+ * GetSnapshotData() avoids looking at every PGXACT: it scans the dense copy
+ * of the running XIDs in ProcGlobal->xids, and leaves computing the global
+ * xmin horizons, which requires every backend's xmin, to the callers that
+ * actually need up-to-date values (see UpdateRecentGlobalXmin()).  Moreover,
+ * if no transaction has completed since a snapshot was built, its contents
+ * are still accurate and GetSnapshotData() reuses them.
+ *
  * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -92,6 +100,14 @@ typedef struct ProcArrayStruct
 	/* oldest catalog xmin of any replication slot */
 	TransactionId replication_slot_catalog_xmin;
 
+	/*
+	 * The RecentGlobalXmin and RecentGlobalDataXmin values most recently
+	 * computed by any backend.  These are read and written without locking;
+	 * stale values are still valid horizons, just not the latest ones.
+	 */
+	TransactionId lastGlobalXmin;
+	TransactionId lastGlobalDataXmin;
+
 	/* indexes into allPgXact[], has PROCARRAY_MAXPROCS entries */
 	int			pgprocnos[FLEXIBLE_ARRAY_MEMBER];
 } ProcArrayStruct;
@@ -115,6 +131,12 @@ static TransactionId latestObservedXid = InvalidTransactionId;
  */
 static TransactionId standbySnapshotPendingXmin;
 
+/*
+ * Have RecentGlobalXmin and RecentGlobalDataXmin been computed since the
+ * latest snapshot was taken?
+ */
+static bool RecentGlobalXminIsCurrent = false;
+
 #ifdef XIDCACHE_DEBUG
 
 /* counters for XidCache measurement */
@@ -172,6 +194,9 @@ static void KnownAssignedXidsReset(void);
 static inline void ProcArrayEndTransactionInternal(PGPROC *proc,
 												   PGXACT *pgxact, TransactionId latestXid);
 static void ProcArrayGroupClearXid(PGPROC *proc, TransactionId latestXid);
+static bool GetSnapshotDataReuse(Snapshot snapshot);
+static void GetSnapshotDataInitOldSnapshot(Snapshot snapshot);
+static void ComputeRecentGlobalXmin(void);
 
 /*
  * Report shared-memory space needed by CreateSharedProcArray.
@@ -246,6 +271,8 @@ CreateSharedProcArray(void)
 		procArray->lastOverflowedXid = InvalidTransactionId;
 		procArray->replication_slot_xmin = InvalidTransactionId;
 		procArray->replication_slot_catalog_xmin = InvalidTransactionId;
+		procArray->lastGlobalXmin = InvalidTransactionId;
+		procArray->lastGlobalDataXmin = InvalidTransactionId;
 	}
 
 	allProcs = ProcGlobal->allProcs;
@@ -277,8 +304,14 @@ ProcArrayAdd(PGPROC *proc)
 {
 	ProcArrayStruct *arrayP = procArray;
 	int			index;
+	int			i;
 
+	/*
+	 * GetNewTransactionId() writes to ProcGlobal->xids while holding only
+	 * XidGenLock, so we need that as well to move the entries around.
+	 */
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	LWLockAcquire(XidGenLock, LW_EXCLUSIVE);
 
 	if (arrayP->numProcs >= arrayP->maxProcs)
 	{
@@ -287,6 +320,7 @@ ProcArrayAdd(PGPROC *proc)
 		 * fixed supply of PGPROC structs too, and so we should have failed
 		 * earlier.)
 		 */
+		LWLockRelease(XidGenLock);
 		LWLockRelease(ProcArrayLock);
 		ereport(FATAL,
 				(errcode(ERRCODE_TOO_MANY_CONNECTIONS),
@@ -314,9 +348,17 @@ ProcArrayAdd(PGPROC *proc)
 
 	memmove(&arrayP->pgprocnos[index + 1], &arrayP->pgprocnos[index],
 			(arrayP->numProcs - index) * sizeof(int));
+	memmove(&ProcGlobal->xids[index + 1], &ProcGlobal->xids[index],
+			(arrayP->numProcs - index) * sizeof(TransactionId));
 	arrayP->pgprocnos[index] = proc->pgprocno;
+	ProcGlobal->xids[index] = allPgXact[proc->pgprocno].xid;
 	arrayP->numProcs++;
 
+	/* Adjust the dense array offsets of the procs we moved, and ours */
+	for (i = index; i < arrayP->numProcs; i++)
+		allProcs[arrayP->pgprocnos[i]].pgxactoff = i;
+
+	LWLockRelease(XidGenLock);
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -335,6 +377,7 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 {
 	ProcArrayStruct *arrayP = procArray;
 	int			index;
+	int			i;
 
 #ifdef XIDCACHE_DEBUG
 	/* dump stats at backend shutdown, but not prepared-xact end */
@@ -342,7 +385,9 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 		DisplayXidCache();
 #endif
 
+	/* See ProcArrayAdd() */
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	LWLockAcquire(XidGenLock, LW_EXCLUSIVE);
 
 	if (TransactionIdIsValid(latestXid))
 	{
@@ -352,6 +397,9 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 		if (TransactionIdPrecedes(ShmemVariableCache->latestCompletedXid,
 								  latestXid))
 			ShmemVariableCache->latestCompletedXid = latestXid;
+
+		/* Existing snapshots are now out of date */
+		ShmemVariableCache->xactCompletionCount++;
 	}
 	else
 	{
@@ -366,14 +414,25 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 			/* Keep the PGPROC array sorted. See notes above */
 			memmove(&arrayP->pgprocnos[index], &arrayP->pgprocnos[index + 1],
 					(arrayP->numProcs - index - 1) * sizeof(int));
+			memmove(&ProcGlobal->xids[index], &ProcGlobal->xids[index + 1],
+					(arrayP->numProcs - index - 1) * sizeof(TransactionId));
 			arrayP->pgprocnos[arrayP->numProcs - 1] = -1;	/* for debugging */
+			ProcGlobal->xids[arrayP->numProcs - 1] = InvalidTransactionId;
 			arrayP->numProcs--;
+
+			/* Adjust the dense array offsets of the procs we moved */
+			for (i = index; i < arrayP->numProcs; i++)
+				allProcs[arrayP->pgprocnos[i]].pgxactoff = i;
+			proc->pgxactoff = -1;
+
+			LWLockRelease(XidGenLock);
 			LWLockRelease(ProcArrayLock);
 			return;
 		}
 	}
 
 	/* Oops */
+	LWLockRelease(XidGenLock);
 	LWLockRelease(ProcArrayLock);
 
 	elog(LOG, "failed to find proc %p in ProcArray", proc);
@@ -452,6 +511,7 @@ ProcArrayEndTransactionInternal(PGPROC *proc, PGXACT *pgxact,
 								TransactionId latestXid)
 {
 	pgxact->xid = InvalidTransactionId;
+	ProcGlobal->xids[proc->pgxactoff] = InvalidTransactionId;
 	proc->lxid = InvalidLocalTransactionId;
 	pgxact->xmin = InvalidTransactionId;
 	/* must be cleared with xid/xmin: */
@@ -467,6 +527,9 @@ ProcArrayEndTransactionInternal(PGPROC *proc, PGXACT *pgxact,
 	if (TransactionIdPrecedes(ShmemVariableCache->latestCompletedXid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
+
+	/* Existing snapshots are now out of date */
+	ShmemVariableCache->xactCompletionCount++;
 }
 
 /*
@@ -602,12 +665,17 @@ ProcArrayClearTransaction(PGPROC *proc)
 	PGXACT	   *pgxact = &allPgXact[proc->pgprocno];
 
 	/*
-	 * We can skip locking ProcArrayLock here, because this action does not
-	 * actually change anyone's view of the set of running XIDs: our entry is
-	 * duplicate with the gxact that has already been inserted into the
-	 * ProcArray.
+	 * This action does not actually change anyone's view of the set of
+	 * running XIDs: our entry is duplicate with the gxact that has already
+	 * been inserted into the ProcArray.  But our own snapshots omitted our
+	 * XID, so they must not be reused now that the XID belongs to the gxact;
+	 * hence we advance the completion count, which requires ProcArrayLock.
+	 * We need the lock to write to ProcGlobal->xids, too.
 	 */
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+
 	pgxact->xid = InvalidTransactionId;
+	ProcGlobal->xids[proc->pgxactoff] = InvalidTransactionId;
 	proc->lxid = InvalidLocalTransactionId;
 	pgxact->xmin = InvalidTransactionId;
 	proc->recoveryConflictPending = false;
@@ -619,6 +687,10 @@ ProcArrayClearTransaction(PGPROC *proc)
 	/* Clear the subtransaction-XID cache too */
 	pgxact->nxids = 0;
 	pgxact->overflowed = false;
+
+	ShmemVariableCache->xactCompletionCount++;
+
+	LWLockRelease(ProcArrayLock);
 }
 
 /*
@@ -878,6 +950,9 @@ ProcArrayApplyRecoveryInfo(RunningTransactions running)
 
 	Assert(TransactionIdIsNormal(ShmemVariableCache->latestCompletedXid));
 
+	/* Existing snapshots are now out of date */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 
 	/* ShmemVariableCache->nextFullXid must be beyond any observed xid. */
@@ -1060,25 +1135,33 @@ TransactionIdIsInProgress(TransactionId xid)
 		return true;
 	}
 
-	/* No shortcuts, gotta grovel through the array */
+	/*
+	 * No shortcuts, gotta grovel through the array.  Scan the dense copy of
+	 * the XIDs, so that we only need to look at the PGXACTs and PGPROCs of
+	 * backends that have one.
+	 */
 	for (i = 0; i < arrayP->numProcs; i++)
 	{
-		int			pgprocno = arrayP->pgprocnos[i];
-		PGPROC	   *proc = &allProcs[pgprocno];
-		PGXACT	   *pgxact = &allPgXact[pgprocno];
+		int			pgprocno;
+		PGPROC	   *proc;
+		PGXACT	   *pgxact;
 		TransactionId pxid;
 		int			pxids;
 
-		/* Ignore my own proc --- dealt with it above */
-		if (proc == MyProc)
-			continue;
-
 		/* Fetch xid just once - see GetNewTransactionId */
-		pxid = UINT32_ACCESS_ONCE(pgxact->xid);
+		pxid = UINT32_ACCESS_ONCE(ProcGlobal->xids[i]);
 
 		if (!TransactionIdIsValid(pxid))
 			continue;
 
+		/* Ignore my own proc --- dealt with it above */
+		if (i == MyProc->pgxactoff)
+			continue;
+
+		pgprocno = arrayP->pgprocnos[i];
+		proc = &allProcs[pgprocno];
+		pgxact = &allPgXact[pgprocno];
+
 		/*
 		 * Step 1: check the main Xid
 		 */
@@ -1498,6 +1581,13 @@ GetMaxSnapshotSubxidCount(void)
  *			GetOldestXmin(NULL, PROCARRAY_FLAGS_VACUUM).
  *		RecentGlobalDataXmin: the global xmin for non-catalog tables
  *			>= RecentGlobalXmin
+ * However, we don't compute the last two afresh, since that requires looking
+ * at the xmin of every backend; we only adopt the newest values computed by
+ * any backend.  Those are still valid horizons, but may be older than
+ * necessary.  Callers needing better values use UpdateRecentGlobalXmin().
+ *
+ * If no transaction has completed since the passed-in snapshot was built by
+ * an earlier call, its contents are still correct, and we just reuse it.
  *
  * Note: this function should probably not be called with an argument that's
  * not statically allocated (see xip allocation below).
@@ -1506,15 +1596,16 @@ Snapshot
 GetSnapshotData(Snapshot snapshot)
 {
 	ProcArrayStruct *arrayP = procArray;
+	TransactionId *xids = ProcGlobal->xids;
 	TransactionId xmin;
 	TransactionId xmax;
-	TransactionId globalxmin;
 	int			index;
 	int			count = 0;
 	int			subcount = 0;
 	bool		suboverflowed = false;
-	TransactionId replication_slot_xmin = InvalidTransactionId;
-	TransactionId replication_slot_catalog_xmin = InvalidTransactionId;
+	TransactionId lastGlobalXmin;
+	TransactionId lastGlobalDataXmin;
+	uint64		curXactCompletionCount;
 
 	Assert(snapshot != NULL);
 
@@ -1556,13 +1647,22 @@ GetSnapshotData(Snapshot snapshot)
 	 */
 	LWLockAcquire(ProcArrayLock, LW_SHARED);
 
+	if (GetSnapshotDataReuse(snapshot))
+	{
+		LWLockRelease(ProcArrayLock);
+		RecentGlobalXminIsCurrent = false;
+		return snapshot;
+	}
+
+	curXactCompletionCount = ShmemVariableCache->xactCompletionCount;
+
 	/* xmax is always latestCompletedXid + 1 */
 	xmax = ShmemVariableCache->latestCompletedXid;
 	Assert(TransactionIdIsNormal(xmax));
 	TransactionIdAdvance(xmax);
 
 	/* initialize xmin calculation with xmax */
-	globalxmin = xmin = xmax;
+	xmin = xmax;
 
 	snapshot->takenDuringRecovery = RecoveryInProgress();
 
@@ -1570,35 +1670,22 @@ GetSnapshotData(Snapshot snapshot)
 	{
 		int		   *pgprocnos = arrayP->pgprocnos;
 		int			numProcs;
+		int			myoff = MyProc->pgxactoff;
 
 		/*
-		 * Spin over procArray checking xid, xmin, and subxids.  The goal is
-		 * to gather all active xids, find the lowest xmin, and try to record
-		 * subxids.
+		 * Spin over the dense copy of the running XIDs.  The goal is to
+		 * gather all active xids, find the lowest one, and try to record
+		 * subxids.  Only backends that have an XID need to be examined any
+		 * further.
 		 */
 		numProcs = arrayP->numProcs;
 		for (index = 0; index < numProcs; index++)
 		{
-			int			pgprocno = pgprocnos[index];
-			PGXACT	   *pgxact = &allPgXact[pgprocno];
+			PGXACT	   *pgxact;
 			TransactionId xid;
 
-			/*
-			 * Skip over backends doing logical decoding which manages xmin
-			 * separately (check below) and ones running LAZY VACUUM.
-			 */
-			if (pgxact->vacuumFlags &
-				(PROC_IN_LOGICAL_DECODING | PROC_IN_VACUUM))
-				continue;
-
-			/* Update globalxmin to be the smallest valid xmin */
-			xid = UINT32_ACCESS_ONCE(pgxact->xmin);
-			if (TransactionIdIsNormal(xid) &&
-				NormalTransactionIdPrecedes(xid, globalxmin))
-				globalxmin = xid;
-
 			/* Fetch xid just once - see GetNewTransactionId */
-			xid = UINT32_ACCESS_ONCE(pgxact->xid);
+			xid = UINT32_ACCESS_ONCE(xids[index]);
 
 			/*
 			 * If the transaction has no XID assigned, we can skip it; it
@@ -1610,13 +1697,23 @@ GetSnapshotData(Snapshot snapshot)
 				|| !NormalTransactionIdPrecedes(xid, xmax))
 				continue;
 
+			pgxact = &allPgXact[pgprocnos[index]];
+
+			/*
+			 * Skip over backends doing logical decoding which manages xmin
+			 * separately (check below) and ones running LAZY VACUUM.
+			 */
+			if (pgxact->vacuumFlags &
+				(PROC_IN_LOGICAL_DECODING | PROC_IN_VACUUM))
+				continue;
+
 			/*
 			 * We don't include our own XIDs (if any) in the snapshot, but we
 			 * must include them in xmin.
 			 */
 			if (NormalTransactionIdPrecedes(xid, xmin))
 				xmin = xid;
-			if (pgxact == MyPgXact)
+			if (index == myoff)
 				continue;
 
 			/* Add XID to snapshot. */
@@ -1647,7 +1744,7 @@ GetSnapshotData(Snapshot snapshot)
 
 					if (nxids > 0)
 					{
-						PGPROC	   *proc = &allProcs[pgprocno];
+						PGPROC	   *proc = &allProcs[pgprocnos[index]];
 
 						pg_read_barrier();	/* pairs with GetNewTransactionId */
 
@@ -1698,48 +1795,35 @@ GetSnapshotData(Snapshot snapshot)
 			suboverflowed = true;
 	}
 
-
-	/*
-	 * Fetch into local variable while ProcArrayLock is held - the
-	 * LWLockRelease below is a barrier, ensuring this happens inside the
-	 * lock.
-	 */
-	replication_slot_xmin = procArray->replication_slot_xmin;
-	replication_slot_catalog_xmin = procArray->replication_slot_catalog_xmin;
-
 	if (!TransactionIdIsValid(MyPgXact->xmin))
 		MyPgXact->xmin = TransactionXmin = xmin;
 
-	LWLockRelease(ProcArrayLock);
-
 	/*
-	 * Update globalxmin to include actual process xids.  This is a slightly
-	 * different way of computing it than GetOldestXmin uses, but should give
-	 * the same result.
+	 * Any horizon computed before now is still valid for use with this
+	 * snapshot, since everything older was already invisible to everyone.
 	 */
-	if (TransactionIdPrecedes(xmin, globalxmin))
-		globalxmin = xmin;
-
-	/* Update global variables too */
-	RecentGlobalXmin = globalxmin - vacuum_defer_cleanup_age;
-	if (!TransactionIdIsNormal(RecentGlobalXmin))
-		RecentGlobalXmin = FirstNormalTransactionId;
-
-	/* Check whether there's a replication slot requiring an older xmin. */
-	if (TransactionIdIsValid(replication_slot_xmin) &&
-		NormalTransactionIdPrecedes(replication_slot_xmin, RecentGlobalXmin))
-		RecentGlobalXmin = replication_slot_xmin;
+	lastGlobalXmin = arrayP->lastGlobalXmin;
+	lastGlobalDataXmin = arrayP->lastGlobalDataXmin;
 
-	/* Non-catalog tables can be vacuumed if older than this xid */
-	RecentGlobalDataXmin = RecentGlobalXmin;
+	LWLockRelease(ProcArrayLock);
 
 	/*
-	 * Check whether there's a replication slot requiring an older catalog
-	 * xmin.
+	 * Adopt the newest horizons computed by any backend; if no horizon was
+	 * ever computed in this backend, compute it now so that the globals are
+	 * valid.
 	 */
-	if (TransactionIdIsNormal(replication_slot_catalog_xmin) &&
-		NormalTransactionIdPrecedes(replication_slot_catalog_xmin, RecentGlobalXmin))
-		RecentGlobalXmin = replication_slot_catalog_xmin;
+	RecentGlobalXminIsCurrent = false;
+	if (!TransactionIdIsValid(RecentGlobalXmin))
+		ComputeRecentGlobalXmin();
+	else
+	{
+		if (TransactionIdIsValid(lastGlobalXmin) &&
+			TransactionIdFollows(lastGlobalXmin, RecentGlobalXmin))
+			RecentGlobalXmin = lastGlobalXmin;
+		if (TransactionIdIsValid(lastGlobalDataXmin) &&
+			TransactionIdFollows(lastGlobalDataXmin, RecentGlobalDataXmin))
+			RecentGlobalDataXmin = lastGlobalDataXmin;
+	}
 
 	RecentXmin = xmin;
 
@@ -1748,6 +1832,7 @@ GetSnapshotData(Snapshot snapshot)
 	snapshot->xcnt = count;
 	snapshot->subxcnt = subcount;
 	snapshot->suboverflowed = suboverflowed;
+	snapshot->snapXactCompletionCount = curXactCompletionCount;
 
 	snapshot->curcid = GetCurrentCommandId(false);
 
@@ -1759,6 +1844,59 @@ GetSnapshotData(Snapshot snapshot)
 	snapshot->regd_count = 0;
 	snapshot->copied = false;
 
+	GetSnapshotDataInitOldSnapshot(snapshot);
+
+	return snapshot;
+}
+
+/*
+ * Helper function for GetSnapshotData() that checks whether the contents of
+ * a previously built snapshot are still accurate, and if so, prepares it for
+ * reuse.  Caller must hold ProcArrayLock.
+ *
+ * The snapshot is accurate if no transaction has stopped being shown as
+ * running since it was built: the set of running XIDs below its xmax is
+ * unchanged, and any XIDs assigned in the meantime are >= xmax.
+ */
+static bool
+GetSnapshotDataReuse(Snapshot snapshot)
+{
+	Assert(LWLockHeldByMe(ProcArrayLock));
+
+	if (snapshot->snapXactCompletionCount == 0 ||
+		snapshot->snapXactCompletionCount !=
+		ShmemVariableCache->xactCompletionCount)
+		return false;
+
+	/*
+	 * If we don't have an xmin yet, the snapshot's xmin is safe to use: since
+	 * no transaction completed, the XID it came from is still running (or is
+	 * still >= latestCompletedXid + 1), so nobody can have computed a horizon
+	 * newer than it.
+	 */
+	if (!TransactionIdIsValid(MyPgXact->xmin))
+		MyPgXact->xmin = TransactionXmin = snapshot->xmin;
+
+	RecentXmin = snapshot->xmin;
+	Assert(TransactionIdPrecedesOrEquals(TransactionXmin, RecentXmin));
+
+	snapshot->curcid = GetCurrentCommandId(false);
+	snapshot->active_count = 0;
+	snapshot->regd_count = 0;
+	snapshot->copied = false;
+
+	GetSnapshotDataInitOldSnapshot(snapshot);
+
+	return true;
+}
+
+/*
+ * Helper function for GetSnapshotData() that fills in the fields used by the
+ * "snapshot too old" feature.
+ */
+static void
+GetSnapshotDataInitOldSnapshot(Snapshot snapshot)
+{
 	if (old_snapshot_threshold < 0)
 	{
 		/*
@@ -1777,10 +1915,140 @@ GetSnapshotData(Snapshot snapshot)
 		 */
 		snapshot->lsn = GetXLogInsertRecPtr();
 		snapshot->whenTaken = GetSnapshotCurrentTimestamp();
-		MaintainOldSnapshotTimeMapping(snapshot->whenTaken, xmin);
+		MaintainOldSnapshotTimeMapping(snapshot->whenTaken, snapshot->xmin);
 	}
+}
 
-	return snapshot;
+/*
+ * ComputeRecentGlobalXmin -- compute RecentGlobalXmin and RecentGlobalDataXmin
+ *
+ * This is the part of taking a snapshot that has to look at every backend's
+ * xmin, so GetSnapshotData() leaves it to UpdateRecentGlobalXmin().  The
+ * results are also published for other backends to adopt.
+ */
+static void
+ComputeRecentGlobalXmin(void)
+{
+	ProcArrayStruct *arrayP = procArray;
+	TransactionId globalxmin;
+	TransactionId replication_slot_xmin;
+	TransactionId replication_slot_catalog_xmin;
+	int			index;
+
+	LWLockAcquire(ProcArrayLock, LW_SHARED);
+
+	/* initialize the calculation with latestCompletedXid + 1, see GetOldestXmin */
+	globalxmin = ShmemVariableCache->latestCompletedXid;
+	Assert(TransactionIdIsNormal(globalxmin));
+	TransactionIdAdvance(globalxmin);
+
+	for (index = 0; index < arrayP->numProcs; index++)
+	{
+		PGXACT	   *pgxact = &allPgXact[arrayP->pgprocnos[index]];
+		TransactionId xid;
+
+		/*
+		 * Skip over backends doing logical decoding which manages xmin
+		 * separately (check below) and ones running LAZY VACUUM.
+		 */
+		if (pgxact->vacuumFlags &
+			(PROC_IN_LOGICAL_DECODING | PROC_IN_VACUUM))
+			continue;
+
+		/* Consider both the XID and the xmin, as GetOldestXmin does */
+		xid = UINT32_ACCESS_ONCE(ProcGlobal->xids[index]);
+		if (TransactionIdIsNormal(xid) &&
+			NormalTransactionIdPrecedes(xid, globalxmin))
+			globalxmin = xid;
+
+		xid = UINT32_ACCESS_ONCE(pgxact->xmin);
+		if (TransactionIdIsNormal(xid) &&
+			NormalTransactionIdPrecedes(xid, globalxmin))
+			globalxmin = xid;
+	}
+
+	/* In hot standby, transactions running on the master count too */
+	if (RecoveryInProgress())
+	{
+		TransactionId kaxmin = KnownAssignedXidsGetOldestXmin();
+
+		if (TransactionIdIsNormal(kaxmin) &&
+			NormalTransactionIdPrecedes(kaxmin, globalxmin))
+			globalxmin = kaxmin;
+	}
+
+	/*
+	 * Fetch into local variable while ProcArrayLock is held - the
+	 * LWLockRelease below is a barrier, ensuring this happens inside the
+	 * lock.
+	 */
+	replication_slot_xmin = arrayP->replication_slot_xmin;
+	replication_slot_catalog_xmin = arrayP->replication_slot_catalog_xmin;
+
+	LWLockRelease(ProcArrayLock);
+
+	/* Update global variables too */
+	RecentGlobalXmin = globalxmin - vacuum_defer_cleanup_age;
+	if (!TransactionIdIsNormal(RecentGlobalXmin))
+		RecentGlobalXmin = FirstNormalTransactionId;
+
+	/* Check whether there's a replication slot requiring an older xmin. */
+	if (TransactionIdIsValid(replication_slot_xmin) &&
+		NormalTransactionIdPrecedes(replication_slot_xmin, RecentGlobalXmin))
+		RecentGlobalXmin = replication_slot_xmin;
+
+	/* Non-catalog tables can be vacuumed if older than this xid */
+	RecentGlobalDataXmin = RecentGlobalXmin;
+
+	/*
+	 * Check whether there's a replication slot requiring an older catalog
+	 * xmin.
+	 */
+	if (TransactionIdIsNormal(replication_slot_catalog_xmin) &&
+		NormalTransactionIdPrecedes(replication_slot_catalog_xmin, RecentGlobalXmin))
+		RecentGlobalXmin = replication_slot_catalog_xmin;
+
+	/* Let other backends adopt these values */
+	arrayP->lastGlobalXmin = RecentGlobalXmin;
+	arrayP->lastGlobalDataXmin = RecentGlobalDataXmin;
+
+	RecentGlobalXminIsCurrent = true;
+}
+
+/*
+ * UpdateRecentGlobalXmin -- bring RecentGlobalXmin and RecentGlobalDataXmin
+ *		up to date
+ *
+ * GetSnapshotData() doesn't compute these horizons itself, so they can be
+ * older than necessary.  Callers for which they're not good enough, such as
+ * when deciding whether a page can be pruned, use this to recompute them.
+ * To bound the cost, that's done at most once per snapshot taken; returns
+ * false if they were already computed since the latest snapshot.
+ */
+bool
+UpdateRecentGlobalXmin(void)
+{
+	if (RecentGlobalXminIsCurrent)
+		return false;
+
+	ComputeRecentGlobalXmin();
+	return true;
+}
+
+/*
+ * TransactionIdPrecedesRecentGlobalXmin -- is xid older than the global xmin?
+ *
+ * This tests xid against RecentGlobalXmin, updating the latter first if it's
+ * not recent enough to give a positive answer.
+ */
+bool
+TransactionIdPrecedesRecentGlobalXmin(TransactionId xid)
+{
+	if (TransactionIdPrecedes(xid, RecentGlobalXmin))
+		return true;
+
+	return UpdateRecentGlobalXmin() &&
+		TransactionIdPrecedes(xid, RecentGlobalXmin);
 }
 
 /*
@@ -3103,6 +3371,9 @@ XidCacheRemoveRunningXids(TransactionId xid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
 
+	/* Existing snapshots are now out of date */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3284,6 +3555,9 @@ ExpireTreeKnownAssignedTransactionIds(TransactionId xid, int nsubxids,
 							  max_xid))
 		ShmemVariableCache->latestCompletedXid = max_xid;
 
+	/* ... and invalidate existing snapshots */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3296,6 +3570,7 @@ ExpireAllKnownAssignedTransactionIds(void)
 {
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	KnownAssignedXidsRemovePreceding(InvalidTransactionId);
+	ShmemVariableCache->xactCompletionCount++;
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3308,6 +3583,7 @@ ExpireOldKnownAssignedTransactionIds(TransactionId xid)
 {
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	KnownAssignedXidsRemovePreceding(xid);
+	ShmemVariableCache->xactCompletionCount++;
 	LWLockRelease(ProcArrayLock);
 }
 
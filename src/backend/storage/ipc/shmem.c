@@ -144,6 +144,7 @@ InitShmemAllocation(void)
 	ShmemVariableCache = (VariableCache)
 		ShmemAlloc(sizeof(*ShmemVariableCache));
 	memset(ShmemVariableCache, 0, sizeof(*ShmemVariableCache));
+	ShmemVariableCache->xactCompletionCount = 1;
 }
 
 /*
@@ -1405,6 +1405,21 @@ LockCheckConflicts(LockMethod lockMethodTable,
 		return STATUS_FOUND;
 	}
 
+	/*
+	 * Relation extension and page locks protect physical structures that
+	 * parallel workers writing to the same relation (as in parallel COPY
+	 * FROM) must not modify concurrently, so they conflict even between
+	 * members of a lock group.  Such locks are never held while waiting for
+	 * another heavyweight lock, so this cannot create an undetected deadlock.
+	 */
+	if (lock->tag.locktag_type == LOCKTAG_RELATION_EXTEND ||
+		lock->tag.locktag_type == LOCKTAG_PAGE)
+	{
+		PROCLOCK_PRINT("LockCheckConflicts: conflicting (group)",
+					   proclock);
+		return STATUS_FOUND;
+	}
+
 	/*
 	 * Locks held in conflicting modes by members of our own lock group are
 	 * not real conflicts; we can subtract those out and see if we still have
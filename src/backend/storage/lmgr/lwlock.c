@@ -522,6 +522,10 @@ RegisterLWLockTranches(void)
 	LWLockRegisterTranche(LWTRANCHE_PARALLEL_APPEND, "parallel_append");
 	LWLockRegisterTranche(LWTRANCHE_PARALLEL_HASH_JOIN, "parallel_hash_join");
 	LWLockRegisterTranche(LWTRANCHE_SXACT, "serializable_xact");
+	LWLockRegisterTranche(LWTRANCHE_STATS_DSA, "stats_dsa");
+	LWLockRegisterTranche(LWTRANCHE_STATS_DB, "stats_db");
+	LWLockRegisterTranche(LWTRANCHE_STATS_TABLE, "stats_table");
+	LWLockRegisterTranche(LWTRANCHE_STATS_FUNCTION, "stats_function");
 
 	/* Register named tranches. */
 	for (i = 0; i < NamedLWLockTrancheRequests; i++)
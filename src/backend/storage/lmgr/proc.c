@@ -119,6 +119,10 @@ ProcGlobalShmemSize(void)
 	size = add_size(size, mul_size(NUM_AUXILIARY_PROCS, sizeof(PGXACT)));
 	size = add_size(size, mul_size(max_prepared_xacts, sizeof(PGXACT)));
 
+	/* ProcGlobal->xids */
+	size = add_size(size, mul_size(MaxBackends + NUM_AUXILIARY_PROCS + max_prepared_xacts,
+								   sizeof(TransactionId)));
+
 	return size;
 }
 
@@ -217,6 +221,11 @@ InitProcGlobal(void)
 	MemSet(pgxacts, 0, TotalProcs * sizeof(PGXACT));
 	ProcGlobal->allPgXact = pgxacts;
 
+	/* The dense copy of the ProcArray's XIDs; see PROC_HDR */
+	ProcGlobal->xids =
+		(TransactionId *) ShmemAlloc(TotalProcs * sizeof(TransactionId));
+	MemSet(ProcGlobal->xids, 0, TotalProcs * sizeof(TransactionId));
+
 	for (i = 0; i < TotalProcs; i++)
 	{
 		/* Common initialization for all PGPROCs, regardless of type. */
@@ -233,6 +242,7 @@ InitProcGlobal(void)
 			LWLockInitialize(&(procs[i].backendLock), LWTRANCHE_PROC);
 		}
 		procs[i].pgprocno = i;
+		procs[i].pgxactoff = -1;
 
 		/*
 		 * Newly created PGPROCs for normal backends, autovacuum and bgworkers
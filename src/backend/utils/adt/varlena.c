@@ -1922,6 +1922,29 @@ bttextcmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(result);
 }
 
+/*
+ * Deduplication support for text (and name/bpchar) btree opclasses.
+ *
+ * Deduplication is only safe when the index collation is deterministic,
+ * since a nondeterministic collation can consider strings equal even though
+ * they are not bitwise identical.
+ */
+Datum
+btvarstrequalimage(PG_FUNCTION_ARGS)
+{
+	/* Oid		opcintype = PG_GETARG_OID(0); */
+	Oid			collid = PG_GET_COLLATION();
+
+	check_collation_set(collid);
+
+	if (lc_collate_is_c(collid) ||
+		collid == DEFAULT_COLLATION_OID ||
+		get_collation_isdeterministic(collid))
+		PG_RETURN_BOOL(true);
+	else
+		PG_RETURN_BOOL(false);
+}
+
 Datum
 bttextsortsupport(PG_FUNCTION_ARGS)
 {
@@ -5106,6 +5129,52 @@ pg_column_size(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(result);
 }
 
+/*
+ * Return the compression method of a datum, or NULL if it isn't compressed
+ *
+ * Works on any data type
+ */
+Datum
+pg_column_compression(PG_FUNCTION_ARGS)
+{
+	int			typlen;
+	ToastCompressionId cmid;
+
+	/* On first call, get the input type's typlen, and save at *fn_extra */
+	if (fcinfo->flinfo->fn_extra == NULL)
+	{
+		/* Lookup the datatype of the supplied argument */
+		Oid			argtypeid = get_fn_expr_argtype(fcinfo->flinfo, 0);
+
+		typlen = get_typlen(argtypeid);
+		if (typlen == 0)		/* should not happen */
+			elog(ERROR, "cache lookup failed for type %u", argtypeid);
+
+		fcinfo->flinfo->fn_extra = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+													  sizeof(int));
+		*((int *) fcinfo->flinfo->fn_extra) = typlen;
+	}
+	else
+		typlen = *((int *) fcinfo->flinfo->fn_extra);
+
+	/* only varlena datums can be compressed */
+	if (typlen != -1)
+		PG_RETURN_NULL();
+
+	cmid = toast_get_compression_id((struct varlena *)
+									DatumGetPointer(PG_GETARG_DATUM(0)));
+
+	switch (cmid)
+	{
+		case TOAST_PGLZ_COMPRESSION_ID:
+			PG_RETURN_TEXT_P(cstring_to_text("pglz"));
+		case TOAST_LZ4_COMPRESSION_ID:
+			PG_RETURN_TEXT_P(cstring_to_text("lz4"));
+		default:
+			PG_RETURN_NULL();
+	}
+}
+
 /*
  * string_agg - Concatenates values and returns string.
  *
@@ -59,6 +59,7 @@
 #include "access/transam.h"
 #include "catalog/namespace.h"
 #include "executor/executor.h"
+#include "jit/jit.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/optimizer.h"
@@ -97,6 +98,7 @@ static dlist_head saved_plan_list = DLIST_STATIC_INIT(saved_plan_list);
 static dlist_head cached_expression_list = DLIST_STATIC_INIT(cached_expression_list);
 
 static void ReleaseGenericPlan(CachedPlanSource *plansource);
+static void EnableJitCaching(CachedPlan *plan);
 static List *RevalidateCachedQuery(CachedPlanSource *plansource,
 								   QueryEnvironment *queryEnv);
 static bool CheckCachedPlan(CachedPlanSource *plansource);
@@ -535,6 +537,26 @@ ReleaseGenericPlan(CachedPlanSource *plansource)
 	}
 }
 
+/*
+ * EnableJitCaching: let executions of a generic plan share JIT-compiled code.
+ *
+ * The JIT provider keeps the code with the plan's PlannedStmts, so it is
+ * released along with the plan.
+ */
+static void
+EnableJitCaching(CachedPlan *plan)
+{
+	ListCell   *lc;
+
+	foreach(lc, plan->stmt_list)
+	{
+		PlannedStmt *stmt = lfirst_node(PlannedStmt, lc);
+
+		if (stmt->jitFlags & PGJIT_PERFORM)
+			stmt->jitFlags |= PGJIT_CACHE;
+	}
+}
+
 /*
  * RevalidateCachedQuery: ensure validity of analyzed-and-rewritten query tree.
  *
@@ -1187,6 +1209,8 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 			}
 			/* Update generic_cost whenever we make a new generic plan */
 			plansource->generic_cost = cached_plan_cost(plan, false);
+			/* Later executions of the plan can reuse its JIT-compiled code */
+			EnableJitCaching(plan);
 
 			/*
 			 * If, based on the now-known value of generic_cost, we'd not have
@@ -462,6 +462,31 @@ MemoryContextIsEmpty(MemoryContext context)
 	return context->methods->is_empty(context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Find the memory allocated to blocks for this memory context. If
+ *		recurse is true, also include children.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total = context->mem_allocated;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
@@ -734,6 +759,7 @@ MemoryContextCreate(MemoryContext node,
 	node->type = tag;
 	node->isReset = true;
 	node->methods = methods;
+	node->mem_allocated = 0;
 	node->parent = parent;
 	node->firstchild = NULL;
 	node->prevchild = NULL;
@@ -25,6 +25,12 @@
 #ifdef HAVE_LIBZ
 #include <zlib.h>
 #endif
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "access/xlog_internal.h"
 #include "common/file_perm.h"
@@ -72,6 +78,16 @@ typedef struct TablespaceList
  */
 #define MINIMUM_VERSION_FOR_RECOVERY_GUC 120000
 
+/*
+ * Server-side compression of the backup is supported from version 13.
+ */
+#define MINIMUM_VERSION_FOR_SERVER_COMPRESSION 130000
+
+/*
+ * Incremental backups are supported from version 13.
+ */
+#define MINIMUM_VERSION_FOR_INCREMENTAL_BACKUP 130000
+
 /*
  * Different ways to include WAL
  */
@@ -82,6 +98,25 @@ typedef enum
 	STREAM_WAL
 } IncludeWal;
 
+/*
+ * Methods the server can compress the backup with
+ */
+typedef enum
+{
+	SERVER_COMPRESSION_NONE,
+	SERVER_COMPRESSION_GZIP,
+	SERVER_COMPRESSION_LZ4,
+	SERVER_COMPRESSION_ZSTD
+} ServerCompression;
+
+/* Names of the methods in BASE_BACKUP, and suffixes of their tar files */
+static const char *const server_compression_names[] = {
+	"none", "gzip", "lz4", "zstd"
+};
+static const char *const server_compression_suffixes[] = {
+	"", ".gz", ".lz4", ".zst"
+};
+
 /* Global options */
 static char *basedir = NULL;
 static TablespaceList tablespace_dirs = {NULL, NULL};
@@ -93,6 +128,8 @@ static bool checksum_failure = false;
 static bool showprogress = false;
 static int	verbose = 0;
 static int	compresslevel = 0;
+static ServerCompression server_compress = SERVER_COMPRESSION_NONE;
+static int	server_compresslevel = 0;	/* 0 means the server's default */
 static IncludeWal includewal = STREAM_WAL;
 static bool fastcheckpoint = false;
 static bool writerecoveryconf = false;
@@ -101,6 +138,8 @@ static int	standby_message_timeout = 10 * 1000;	/* 10 sec = default */
 static pg_time_t last_progress_report = 0;
 static int32 maxrate = 0;		/* no limit by default */
 static char *replication_slot = NULL;
+static char *incremental_from = NULL;	/* backup an incremental one is
+										 * based on */
 static bool temp_replication_slot = true;
 static bool create_slot = false;
 static bool no_slot = false;
@@ -140,6 +179,44 @@ static volatile LONG has_xlogendptr = 0;
 /* Contents of configuration file to be generated */
 static PQExpBuffer recoveryconfcontents = NULL;
 
+/* Largest piece of a server-compressed stream we decompress at once */
+#define INFLATE_BUFFER_SIZE 65536
+
+/* State for decompressing a tar file compressed by the server */
+static char *inflate_input = NULL;	/* CopyData message being decompressed */
+static size_t inflate_input_len;
+static size_t inflate_input_pos;
+static bool inflate_pending;	/* may have more output without more input */
+static bool inflate_done;
+static char inflate_buffer[INFLATE_BUFFER_SIZE];
+#ifdef HAVE_LIBZ
+static z_stream inflate_stream;
+#endif
+#ifdef USE_LZ4
+static LZ4F_dctx *lz4_dctx = NULL;
+#endif
+#ifdef USE_ZSTD
+static ZSTD_DCtx *zstd_dctx = NULL;
+#endif
+
+/*
+ * State for writing a tar file compressed with lz4 or zstd: used when a
+ * stream the server compressed that way has to be decompressed to inject
+ * the configuration files, and for the trailer added to a stream that is
+ * written out as it is.
+ */
+static ServerCompression tar_compress = SERVER_COMPRESSION_NONE;
+static char *tar_compress_buffer = NULL;
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+static size_t tar_compress_buffer_size;
+#endif
+#ifdef USE_LZ4
+static LZ4F_cctx *lz4_cctx = NULL;
+#endif
+#ifdef USE_ZSTD
+static ZSTD_CCtx *zstd_cctx = NULL;
+#endif
+
 /* Function headers */
 static void usage(void);
 static void verify_dir_is_empty_or_create(char *dirname, bool *created, bool *found);
@@ -320,6 +397,111 @@ get_gz_error(gzFile gzf)
 }
 #endif
 
+/*
+ * Parse the argument of --server-compress, METHOD[:LEVEL].
+ */
+static void
+parse_server_compression(char *src)
+{
+	char	   *sep = strchr(src, ':');
+	int			max_level = 0;
+
+	if (sep != NULL)
+		*sep = '\0';
+
+	if (strcmp(src, "gzip") == 0)
+	{
+		server_compress = SERVER_COMPRESSION_GZIP;
+		max_level = 9;
+	}
+	else if (strcmp(src, "lz4") == 0)
+	{
+#ifndef USE_LZ4
+		pg_log_error("this build does not support compression with %s", "lz4");
+		exit(1);
+#endif
+		server_compress = SERVER_COMPRESSION_LZ4;
+		max_level = 12;
+	}
+	else if (strcmp(src, "zstd") == 0)
+	{
+#ifndef USE_ZSTD
+		pg_log_error("this build does not support compression with %s", "zstd");
+		exit(1);
+#else
+		max_level = ZSTD_maxCLevel();
+#endif
+		server_compress = SERVER_COMPRESSION_ZSTD;
+	}
+	else if (strcmp(src, "none") == 0 && sep == NULL)
+		server_compress = SERVER_COMPRESSION_NONE;
+	else
+	{
+		pg_log_error("invalid compression method \"%s\", must be \"gzip\", \"lz4\", \"zstd\" or \"none\"",
+					 src);
+		exit(1);
+	}
+
+	if (sep != NULL)
+	{
+		char	   *endptr;
+		long		level;
+
+		errno = 0;
+		level = strtol(sep + 1, &endptr, 10);
+		if (sep[1] == '\0' || *endptr != '\0' || errno != 0 ||
+			level < 1 || level > max_level)
+		{
+			pg_log_error("invalid compression level \"%s\" for method \"%s\"",
+						 sep + 1, src);
+			exit(1);
+		}
+		server_compresslevel = (int) level;
+	}
+}
+
+/*
+ * Read the start WAL location of the plain-format backup in directory dir,
+ * on which an incremental backup is to be based.
+ */
+static char *
+get_backup_start_lsn(const char *dir)
+{
+	char		path[MAXPGPATH];
+	char		line[MAXPGPATH];
+	FILE	   *fp;
+	uint32		hi,
+				lo;
+	char	   *result = NULL;
+
+	snprintf(path, sizeof(path), "%s/backup_label", dir);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		pg_log_error("could not open file \"%s\": %m", path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (sscanf(line, "START WAL LOCATION: %X/%X", &hi, &lo) == 2)
+		{
+			result = psprintf("%X/%X", hi, lo);
+			break;
+		}
+	}
+	fclose(fp);
+
+	if (result == NULL)
+	{
+		pg_log_error("could not find START WAL LOCATION in file \"%s\"",
+					 path);
+		exit(1);
+	}
+
+	return result;
+}
+
 static void
 usage(void)
 {
@@ -341,6 +523,11 @@ usage(void)
 			 "                         include required WAL files with specified method\n"));
 	printf(_("  -z, --gzip             compress tar output\n"));
 	printf(_("  -Z, --compress=0-9     compress tar output with given compression level\n"));
+	printf(_("      --server-compress=METHOD[:LEVEL]\n"
+			 "                         have the server compress the backup with METHOD\n"
+			 "                         (gzip, lz4, zstd)\n"));
+	printf(_("      --incremental=OLDDIR\n"
+			 "                         take an incremental backup based on the backup in OLDDIR\n"));
 	printf(_("\nGeneral options:\n"));
 	printf(_("  -c, --checkpoint=fast|spread\n"
 			 "                         set fast or spread checkpointing\n"));
@@ -876,6 +1063,191 @@ parse_max_rate(char *src)
 	return (int32) result;
 }
 
+#if defined(USE_LZ4) || defined(USE_ZSTD)
+/*
+ * Write compressed data produced by lz4 or zstd to the tar file
+ */
+static void
+writeCompressedOutput(FILE *tarfile, char *buf, size_t len, char *current_file)
+{
+	if (len > 0 && fwrite(buf, len, 1, tarfile) != 1)
+	{
+		pg_log_error("could not write to file \"%s\": %m", current_file);
+		exit(1);
+	}
+}
+#endif
+
+/*
+ * Compress a piece of tar data with lz4 or zstd, writing the output to the
+ * tar file.  With "finish", the frame is ended after the data.
+ */
+static void
+compressTarData(FILE *tarfile, char *buf, size_t len, bool finish,
+				char *current_file)
+{
+#ifdef USE_LZ4
+	if (tar_compress == SERVER_COMPRESSION_LZ4)
+	{
+		size_t		written;
+
+		/* The buffer only has room for INFLATE_BUFFER_SIZE bytes of input */
+		while (len > 0)
+		{
+			size_t		chunk = Min(len, INFLATE_BUFFER_SIZE);
+
+			written = LZ4F_compressUpdate(lz4_cctx, tar_compress_buffer,
+										  tar_compress_buffer_size,
+										  buf, chunk, NULL);
+			if (LZ4F_isError(written))
+			{
+				pg_log_error("could not compress data: %s",
+							 LZ4F_getErrorName(written));
+				exit(1);
+			}
+			writeCompressedOutput(tarfile, tar_compress_buffer, written,
+								  current_file);
+			buf += chunk;
+			len -= chunk;
+		}
+
+		if (finish)
+		{
+			written = LZ4F_compressEnd(lz4_cctx, tar_compress_buffer,
+									   tar_compress_buffer_size, NULL);
+			if (LZ4F_isError(written))
+			{
+				pg_log_error("could not compress data: %s",
+							 LZ4F_getErrorName(written));
+				exit(1);
+			}
+			writeCompressedOutput(tarfile, tar_compress_buffer, written,
+								  current_file);
+		}
+	}
+#endif
+#ifdef USE_ZSTD
+	if (tar_compress == SERVER_COMPRESSION_ZSTD)
+	{
+		ZSTD_inBuffer in = {buf, len, 0};
+		size_t		remaining;
+
+		do
+		{
+			ZSTD_outBuffer out = {tar_compress_buffer, tar_compress_buffer_size, 0};
+
+			remaining = ZSTD_compressStream2(zstd_cctx, &out, &in,
+											 finish ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(remaining))
+			{
+				pg_log_error("could not compress data: %s",
+							 ZSTD_getErrorName(remaining));
+				exit(1);
+			}
+			writeCompressedOutput(tarfile, tar_compress_buffer, out.pos,
+								  current_file);
+		} while (in.pos < in.size || (finish && remaining != 0));
+	}
+#endif
+}
+
+/*
+ * Start compressing the tar data written with writeTarData() with lz4 or
+ * zstd, at the given level, or the method's default for level 0.  This
+ * starts a new frame, which is ended by EndTarCompression().
+ */
+static void
+StartTarCompression(ServerCompression method, int level, FILE *tarfile,
+					char *current_file)
+{
+	tar_compress = method;
+
+#ifdef USE_LZ4
+	if (method == SERVER_COMPRESSION_LZ4)
+	{
+		LZ4F_preferences_t prefs;
+		size_t		written;
+
+		written = LZ4F_createCompressionContext(&lz4_cctx, LZ4F_VERSION);
+		if (LZ4F_isError(written))
+		{
+			pg_log_error("could not initialize compression library: %s",
+						 LZ4F_getErrorName(written));
+			exit(1);
+		}
+
+		/* this is enough for LZ4F_compressBegin and LZ4F_compressEnd too */
+		tar_compress_buffer_size = LZ4F_compressBound(INFLATE_BUFFER_SIZE, NULL);
+		tar_compress_buffer = pg_malloc(tar_compress_buffer_size);
+
+		memset(&prefs, 0, sizeof(prefs));
+		prefs.compressionLevel = level;
+		written = LZ4F_compressBegin(lz4_cctx, tar_compress_buffer,
+									 tar_compress_buffer_size, &prefs);
+		if (LZ4F_isError(written))
+		{
+			pg_log_error("could not compress data: %s",
+						 LZ4F_getErrorName(written));
+			exit(1);
+		}
+		writeCompressedOutput(tarfile, tar_compress_buffer, written,
+							  current_file);
+	}
+#endif
+#ifdef USE_ZSTD
+	if (method == SERVER_COMPRESSION_ZSTD)
+	{
+		size_t		rc;
+
+		zstd_cctx = ZSTD_createCCtx();
+		if (zstd_cctx == NULL)
+		{
+			pg_log_error("could not initialize compression library");
+			exit(1);
+		}
+
+		rc = ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_compressionLevel, level);
+		if (ZSTD_isError(rc))
+		{
+			pg_log_error("could not set compression level %d: %s",
+						 level, ZSTD_getErrorName(rc));
+			exit(1);
+		}
+
+		tar_compress_buffer_size = ZSTD_CStreamOutSize();
+		tar_compress_buffer = pg_malloc(tar_compress_buffer_size);
+	}
+#endif
+}
+
+/*
+ * End the frame started by StartTarCompression()
+ */
+static void
+EndTarCompression(FILE *tarfile, char *current_file)
+{
+	compressTarData(tarfile, NULL, 0, true, current_file);
+
+#ifdef USE_LZ4
+	if (tar_compress == SERVER_COMPRESSION_LZ4)
+	{
+		LZ4F_freeCompressionContext(lz4_cctx);
+		lz4_cctx = NULL;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (tar_compress == SERVER_COMPRESSION_ZSTD)
+	{
+		ZSTD_freeCCtx(zstd_cctx);
+		zstd_cctx = NULL;
+	}
+#endif
+
+	pg_free(tar_compress_buffer);
+	tar_compress_buffer = NULL;
+	tar_compress = SERVER_COMPRESSION_NONE;
+}
+
 /*
  * Write a piece of tar data
  */
@@ -886,6 +1258,12 @@ writeTarData(
 #endif
 			 FILE *tarfile, char *buf, int r, char *current_file)
 {
+	if (tar_compress != SERVER_COMPRESSION_NONE)
+	{
+		compressTarData(tarfile, buf, r, false, current_file);
+		return;
+	}
+
 #ifdef HAVE_LIBZ
 	if (ztarfile != NULL)
 	{
@@ -913,13 +1291,292 @@ writeTarData(
 #define WRITE_TAR_DATA(buf, sz) writeTarData(tarfile, buf, sz, filename)
 #endif
 
+/*
+ * Prepare to decompress a tar stream that the server has compressed.
+ */
+static void
+StartDecompression(void)
+{
+	inflate_input = NULL;
+	inflate_input_len = 0;
+	inflate_input_pos = 0;
+	inflate_pending = false;
+	inflate_done = false;
+
+#ifdef HAVE_LIBZ
+	if (server_compress == SERVER_COMPRESSION_GZIP)
+	{
+		memset(&inflate_stream, 0, sizeof(inflate_stream));
+		if (inflateInit2(&inflate_stream, 15 + 16) != Z_OK)
+		{
+			pg_log_error("could not initialize decompression library: %s",
+						 inflate_stream.msg ? inflate_stream.msg : "unknown error");
+			exit(1);
+		}
+	}
+#endif
+#ifdef USE_LZ4
+	if (server_compress == SERVER_COMPRESSION_LZ4)
+	{
+		size_t		rc;
+
+		rc = LZ4F_createDecompressionContext(&lz4_dctx, LZ4F_VERSION);
+		if (LZ4F_isError(rc))
+		{
+			pg_log_error("could not initialize decompression library: %s",
+						 LZ4F_getErrorName(rc));
+			exit(1);
+		}
+	}
+#endif
+#ifdef USE_ZSTD
+	if (server_compress == SERVER_COMPRESSION_ZSTD)
+	{
+		zstd_dctx = ZSTD_createDCtx();
+		if (zstd_dctx == NULL)
+		{
+			pg_log_error("could not initialize decompression library");
+			exit(1);
+		}
+	}
+#endif
+}
+
+/*
+ * Decompress the *inlen bytes at "in" into "out", which has room for
+ * "outlen" bytes.  Returns the number of bytes produced, and sets *inlen to
+ * the number of bytes consumed.  Sets inflate_done when the end of the
+ * compressed stream has been reached.
+ */
+static size_t
+DecompressCopyData(char *in, size_t *inlen, char *out, size_t outlen)
+{
+	size_t		produced = 0;
+
+#ifdef HAVE_LIBZ
+	if (server_compress == SERVER_COMPRESSION_GZIP)
+	{
+		int			zr;
+
+		inflate_stream.next_in = (Bytef *) in;
+		inflate_stream.avail_in = *inlen;
+		inflate_stream.next_out = (Bytef *) out;
+		inflate_stream.avail_out = outlen;
+
+		/* Z_BUF_ERROR only means that no progress was possible */
+		zr = inflate(&inflate_stream, Z_NO_FLUSH);
+		if (zr == Z_STREAM_END)
+			inflate_done = true;
+		else if (zr != Z_OK && zr != Z_BUF_ERROR)
+		{
+			pg_log_error("could not decompress COPY data: %s",
+						 inflate_stream.msg ? inflate_stream.msg : "unknown error");
+			exit(1);
+		}
+
+		*inlen -= inflate_stream.avail_in;
+		produced = outlen - inflate_stream.avail_out;
+	}
+#endif
+#ifdef USE_LZ4
+	if (server_compress == SERVER_COMPRESSION_LZ4)
+	{
+		size_t		hint;
+
+		produced = outlen;
+		hint = LZ4F_decompress(lz4_dctx, out, &produced, in, inlen, NULL);
+		if (LZ4F_isError(hint))
+		{
+			pg_log_error("could not decompress COPY data: %s",
+						 LZ4F_getErrorName(hint));
+			exit(1);
+		}
+		if (hint == 0)
+			inflate_done = true;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (server_compress == SERVER_COMPRESSION_ZSTD)
+	{
+		ZSTD_inBuffer zin = {in, *inlen, 0};
+		ZSTD_outBuffer zout = {out, outlen, 0};
+		size_t		rc;
+
+		rc = ZSTD_decompressStream(zstd_dctx, &zout, &zin);
+		if (ZSTD_isError(rc))
+		{
+			pg_log_error("could not decompress COPY data: %s",
+						 ZSTD_getErrorName(rc));
+			exit(1);
+		}
+		if (rc == 0)
+			inflate_done = true;
+
+		*inlen = zin.pos;
+		produced = zout.pos;
+	}
+#endif
+
+	return produced;
+}
+
+/*
+ * Release the state used for decompressing a tar stream.
+ */
+static void
+EndDecompression(void)
+{
+	if (inflate_input != NULL)
+	{
+		PQfreemem(inflate_input);
+		inflate_input = NULL;
+	}
+
+#ifdef HAVE_LIBZ
+	if (server_compress == SERVER_COMPRESSION_GZIP)
+		inflateEnd(&inflate_stream);
+#endif
+#ifdef USE_LZ4
+	if (server_compress == SERVER_COMPRESSION_LZ4)
+	{
+		LZ4F_freeDecompressionContext(lz4_dctx);
+		lz4_dctx = NULL;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (server_compress == SERVER_COMPRESSION_ZSTD)
+	{
+		ZSTD_freeDCtx(zstd_dctx);
+		zstd_dctx = NULL;
+	}
+#endif
+}
+
+/*
+ * Read up to "want" bytes of decompressed data from the COPY stream.
+ *
+ * Fewer than "want" bytes are only returned at the end of the stream, so
+ * callers can read tar headers and file contents in exactly the pieces the
+ * server would have sent them in without compression.  *buffer is set to
+ * point to a static buffer, which must not be freed.  Returns -1 when the
+ * stream is exhausted.
+ */
+static int
+GetDecompressedCopyData(PGconn *conn, char **buffer, int want)
+{
+	int			r = 0;
+
+	Assert(want > 0 && want <= INFLATE_BUFFER_SIZE);
+
+	if (inflate_done)
+		return -1;
+
+	while (r < want && !inflate_done)
+	{
+		size_t		consumed;
+		size_t		produced;
+
+		/*
+		 * Read the next CopyData message once the current one is used up,
+		 * unless the last call filled the output: the decompressor may then
+		 * still hold output for input it has already consumed.
+		 */
+		if (inflate_input_pos == inflate_input_len && !inflate_pending)
+		{
+			int			len;
+
+			if (inflate_input != NULL)
+			{
+				PQfreemem(inflate_input);
+				inflate_input = NULL;
+			}
+
+			len = PQgetCopyData(conn, &inflate_input, 0);
+			if (len == -1)
+			{
+				pg_log_error("compressed COPY data stream ended unexpectedly");
+				exit(1);
+			}
+			else if (len == -2)
+			{
+				pg_log_error("could not read COPY data: %s",
+							 PQerrorMessage(conn));
+				exit(1);
+			}
+			inflate_input_len = len;
+			inflate_input_pos = 0;
+		}
+
+		consumed = inflate_input_len - inflate_input_pos;
+		produced = DecompressCopyData(inflate_input + inflate_input_pos,
+									  &consumed,
+									  inflate_buffer + r, want - r);
+		inflate_input_pos += consumed;
+		inflate_pending = (produced == want - r);
+		r += produced;
+	}
+
+	if (inflate_done)
+	{
+		int			len;
+
+		/* The compressed stream must be the last thing in the COPY stream */
+		if (inflate_input_pos != inflate_input_len)
+		{
+			pg_log_error("unexpected data after end of compressed COPY data stream");
+			exit(1);
+		}
+		if (inflate_input != NULL)
+		{
+			PQfreemem(inflate_input);
+			inflate_input = NULL;
+		}
+
+		len = PQgetCopyData(conn, &inflate_input, 0);
+		if (len == -2)
+		{
+			pg_log_error("could not read COPY data: %s",
+						 PQerrorMessage(conn));
+			exit(1);
+		}
+		else if (len != -1)
+		{
+			pg_log_error("unexpected data after end of compressed COPY data stream");
+			exit(1);
+		}
+		EndDecompression();
+	}
+
+	*buffer = inflate_buffer;
+	return (r > 0 ? r : -1);
+}
+
+/*
+ * Read the next piece of the COPY stream for a tablespace, decompressing it
+ * if "decompress" is set.  When decompressing, at most "want" bytes are
+ * returned; otherwise, a whole CopyData message is returned, which the caller
+ * must free with PQfreemem().
+ */
+static int
+GetCopyData(PGconn *conn, char **buffer, bool decompress, int want)
+{
+	if (decompress)
+		return GetDecompressedCopyData(conn, buffer, want);
+	return PQgetCopyData(conn, buffer, 0);
+}
+
 /*
  * Receive a tar format file from the connection to the server, and write
  * the data from this file directly into a tar file. If compression is
  * enabled, the data will be compressed while written to the file.
  *
- * The file will be named base.tar[.gz] if it's for the main data directory
- * or <tablespaceoid>.tar[.gz] if it's for another tablespace.
+ * If the server compresses the stream, it is written out as it is, unless
+ * configuration files have to be injected into it; in that case it is
+ * decompressed and compressed again with the same method and level.
+ *
+ * The file will be named base.tar[.gz|.lz4|.zst] if it's for the main data
+ * directory or <tablespaceoid>.tar[.gz|.lz4|.zst] if it's for another
+ * tablespace.
  *
  * No attempt to inspect or validate the contents of the file is done.
  */
@@ -939,15 +1596,42 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 	int			file_padding_len = 0;
 	size_t		tarhdrsz = 0;
 	pgoff_t		filesz = 0;
+	bool		passthrough;
+	bool		decompress;
+	bool		recompress;
+	const char *suffix;
 
 #ifdef HAVE_LIBZ
 	gzFile		ztarfile = NULL;
+	int			level;
 #endif
 
 	/* recovery.conf is integrated into postgresql.conf in 12 and newer */
 	if (PQserverVersion(conn) < MINIMUM_VERSION_FOR_RECOVERY_GUC)
 		is_recovery_guc_supported = false;
 
+	/*
+	 * A stream compressed by the server only has to be decompressed if we
+	 * must look inside it.
+	 */
+	passthrough = server_compress != SERVER_COMPRESSION_NONE &&
+		!(basetablespace && writerecoveryconf);
+	decompress = server_compress != SERVER_COMPRESSION_NONE && !passthrough;
+
+	/* lz4 and zstd are compressed again by StartTarCompression() */
+	recompress = decompress && server_compress != SERVER_COMPRESSION_GZIP;
+	suffix = (passthrough || recompress) ?
+		server_compression_suffixes[server_compress] : "";
+
+#ifdef HAVE_LIBZ
+	if (passthrough || recompress)
+		level = 0;
+	else if (decompress)
+		level = server_compresslevel != 0 ? server_compresslevel : Z_DEFAULT_COMPRESSION;
+	else
+		level = compresslevel;
+#endif
+
 	if (basetablespace)
 	{
 		/*
@@ -960,14 +1644,14 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 #endif
 
 #ifdef HAVE_LIBZ
-			if (compresslevel != 0)
+			if (level != 0)
 			{
 				ztarfile = gzdopen(dup(fileno(stdout)), "wb");
-				if (gzsetparams(ztarfile, compresslevel,
+				if (gzsetparams(ztarfile, level,
 								Z_DEFAULT_STRATEGY) != Z_OK)
 				{
 					pg_log_error("could not set compression level %d: %s",
-								 compresslevel, get_gz_error(ztarfile));
+								 level, get_gz_error(ztarfile));
 					exit(1);
 				}
 			}
@@ -979,22 +1663,23 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		else
 		{
 #ifdef HAVE_LIBZ
-			if (compresslevel != 0)
+			if (level != 0)
 			{
 				snprintf(filename, sizeof(filename), "%s/base.tar.gz", basedir);
 				ztarfile = gzopen(filename, "wb");
-				if (gzsetparams(ztarfile, compresslevel,
+				if (gzsetparams(ztarfile, level,
 								Z_DEFAULT_STRATEGY) != Z_OK)
 				{
 					pg_log_error("could not set compression level %d: %s",
-								 compresslevel, get_gz_error(ztarfile));
+								 level, get_gz_error(ztarfile));
 					exit(1);
 				}
 			}
 			else
 #endif
 			{
-				snprintf(filename, sizeof(filename), "%s/base.tar", basedir);
+				snprintf(filename, sizeof(filename), "%s/base.tar%s", basedir,
+						 suffix);
 				tarfile = fopen(filename, "wb");
 			}
 		}
@@ -1005,30 +1690,30 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		 * Specific tablespace
 		 */
 #ifdef HAVE_LIBZ
-		if (compresslevel != 0)
+		if (level != 0)
 		{
 			snprintf(filename, sizeof(filename), "%s/%s.tar.gz", basedir,
 					 PQgetvalue(res, rownum, 0));
 			ztarfile = gzopen(filename, "wb");
-			if (gzsetparams(ztarfile, compresslevel,
+			if (gzsetparams(ztarfile, level,
 							Z_DEFAULT_STRATEGY) != Z_OK)
 			{
 				pg_log_error("could not set compression level %d: %s",
-							 compresslevel, get_gz_error(ztarfile));
+							 level, get_gz_error(ztarfile));
 				exit(1);
 			}
 		}
 		else
 #endif
 		{
-			snprintf(filename, sizeof(filename), "%s/%s.tar", basedir,
-					 PQgetvalue(res, rownum, 0));
+			snprintf(filename, sizeof(filename), "%s/%s.tar%s", basedir,
+					 PQgetvalue(res, rownum, 0), suffix);
 			tarfile = fopen(filename, "wb");
 		}
 	}
 
 #ifdef HAVE_LIBZ
-	if (compresslevel != 0)
+	if (level != 0)
 	{
 		if (!ztarfile)
 		{
@@ -1041,7 +1726,7 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 	else
 #endif
 	{
-		/* Either no zlib support, or zlib support but compresslevel = 0 */
+		/* Either no zlib support, or zlib support but level = 0 */
 		if (!tarfile)
 		{
 			pg_log_error("could not create file \"%s\": %m", filename);
@@ -1049,6 +1734,10 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		}
 	}
 
+	if (recompress)
+		StartTarCompression(server_compress, server_compresslevel, tarfile,
+							filename);
+
 	/*
 	 * Get the COPY data stream
 	 */
@@ -1060,17 +1749,21 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		exit(1);
 	}
 
+	if (decompress)
+		StartDecompression();
+
 	while (1)
 	{
 		int			r;
 
 		if (copybuf != NULL)
 		{
-			PQfreemem(copybuf);
+			if (!decompress)
+				PQfreemem(copybuf);
 			copybuf = NULL;
 		}
 
-		r = PQgetCopyData(conn, &copybuf, 0);
+		r = GetCopyData(conn, &copybuf, decompress, INFLATE_BUFFER_SIZE);
 		if (r == -1)
 		{
 			/*
@@ -1132,9 +1825,38 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 				}
 			}
 
+			/*
+			 * The server's compressed stream is complete, so add the trailer
+			 * as a gzip member or lz4 or zstd frame of its own.
+			 */
+			if (passthrough && server_compress != SERVER_COMPRESSION_GZIP)
+				StartTarCompression(server_compress, server_compresslevel,
+									tarfile, filename);
+#ifdef HAVE_LIBZ
+			if (passthrough && server_compress == SERVER_COMPRESSION_GZIP)
+			{
+				if (fflush(tarfile) != 0)
+				{
+					pg_log_error("could not write to file \"%s\": %m",
+								 filename);
+					exit(1);
+				}
+				ztarfile = gzdopen(dup(fileno(tarfile)), "wb");
+				if (!ztarfile)
+				{
+					pg_log_error("could not create compressed file \"%s\": %s",
+								 filename, get_gz_error(ztarfile));
+					exit(1);
+				}
+			}
+#endif
+
 			/* 2 * 512 bytes empty data at end of file */
 			WRITE_TAR_DATA(zerobuf, sizeof(zerobuf));
 
+			if (tar_compress != SERVER_COMPRESSION_NONE)
+				EndTarCompression(tarfile, filename);
+
 #ifdef HAVE_LIBZ
 			if (ztarfile != NULL)
 			{
@@ -1145,17 +1867,14 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 					exit(1);
 				}
 			}
-			else
 #endif
+			if (tarfile != NULL && strcmp(basedir, "-") != 0)
 			{
-				if (strcmp(basedir, "-") != 0)
+				if (fclose(tarfile) != 0)
 				{
-					if (fclose(tarfile) != 0)
-					{
-						pg_log_error("could not close file \"%s\": %m",
-									 filename);
-						exit(1);
-					}
+					pg_log_error("could not close file \"%s\": %m",
+								 filename);
+					exit(1);
 				}
 			}
 
@@ -1343,7 +2062,7 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 	}							/* while (1) */
 	progress_report(rownum, filename, true);
 
-	if (copybuf != NULL)
+	if (copybuf != NULL && !decompress)
 		PQfreemem(copybuf);
 
 	/* sync the resulting tar file, errors are not considered fatal */
@@ -1394,6 +2113,7 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 	bool		basetablespace;
 	char	   *copybuf = NULL;
 	FILE	   *file = NULL;
+	bool		decompress = server_compress != SERVER_COMPRESSION_NONE;
 
 	basetablespace = PQgetisnull(res, rownum, 0);
 	if (basetablespace)
@@ -1414,17 +2134,33 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 		exit(1);
 	}
 
+	if (decompress)
+		StartDecompression();
+
 	while (1)
 	{
 		int			r;
+		int			want;
 
 		if (copybuf != NULL)
 		{
-			PQfreemem(copybuf);
+			if (!decompress)
+				PQfreemem(copybuf);
 			copybuf = NULL;
 		}
 
-		r = PQgetCopyData(conn, &copybuf, 0);
+		/*
+		 * When decompressing, ask for the same pieces the server sends
+		 * uncompressed: a tar header, the file contents, or its padding.
+		 */
+		if (file == NULL)
+			want = 512;
+		else if (current_len_left == 0)
+			want = current_padding;
+		else
+			want = Min(current_len_left, INFLATE_BUFFER_SIZE);
+
+		r = GetCopyData(conn, &copybuf, decompress, want);
 
 		if (r == -1)
 		{
@@ -1617,7 +2353,7 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 		exit(1);
 	}
 
-	if (copybuf != NULL)
+	if (copybuf != NULL && !decompress)
 		PQfreemem(copybuf);
 
 	if (basetablespace && writerecoveryconf)
@@ -1790,6 +2526,8 @@ BaseBackup(void)
 	char	   *basebkp;
 	char		escaped_label[MAXPGPATH];
 	char	   *maxrate_clause = NULL;
+	char	   *compression_clause = NULL;
+	char	   *incremental_clause = NULL;
 	int			i;
 	char		xlogstart[64];
 	char		xlogend[64];
@@ -1831,6 +2569,28 @@ BaseBackup(void)
 		exit(1);
 	}
 
+	/* Likewise for compression done by the server */
+	if (server_compress != SERVER_COMPRESSION_NONE &&
+		serverVersion < MINIMUM_VERSION_FOR_SERVER_COMPRESSION)
+	{
+		const char *serverver = PQparameterStatus(conn, "server_version");
+
+		pg_log_error("incompatible server version %s for server-side compression",
+					 serverver ? serverver : "'unknown'");
+		exit(1);
+	}
+
+	/* And for incremental backups */
+	if (incremental_from &&
+		serverVersion < MINIMUM_VERSION_FOR_INCREMENTAL_BACKUP)
+	{
+		const char *serverver = PQparameterStatus(conn, "server_version");
+
+		pg_log_error("incompatible server version %s for incremental backup",
+					 serverver ? serverver : "'unknown'");
+		exit(1);
+	}
+
 	/*
 	 * Build contents of configuration file if requested
 	 */
@@ -1851,6 +2611,21 @@ BaseBackup(void)
 	if (maxrate > 0)
 		maxrate_clause = psprintf("MAX_RATE %u", maxrate);
 
+	if (server_compress != SERVER_COMPRESSION_NONE)
+	{
+		const char *method = server_compression_names[server_compress];
+
+		if (server_compresslevel != 0)
+			compression_clause = psprintf("COMPRESSION '%s' COMPRESSION_LEVEL %d",
+										  method, server_compresslevel);
+		else
+			compression_clause = psprintf("COMPRESSION '%s'", method);
+	}
+
+	if (incremental_from)
+		incremental_clause = psprintf("INCREMENTAL '%s'",
+									  get_backup_start_lsn(incremental_from));
+
 	if (verbose)
 		pg_log_info("initiating base backup, waiting for checkpoint to complete");
 
@@ -1864,7 +2639,7 @@ BaseBackup(void)
 	}
 
 	basebkp =
-		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s %s",
+		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s %s %s %s",
 				 escaped_label,
 				 showprogress ? "PROGRESS" : "",
 				 includewal == FETCH_WAL ? "WAL" : "",
@@ -1872,7 +2647,9 @@ BaseBackup(void)
 				 includewal == NO_WAL ? "" : "NOWAIT",
 				 maxrate_clause ? maxrate_clause : "",
 				 format == 't' ? "TABLESPACE_MAP" : "",
-				 verify_checksums ? "" : "NOVERIFY_CHECKSUMS");
+				 verify_checksums ? "" : "NOVERIFY_CHECKSUMS",
+				 compression_clause ? compression_clause : "",
+				 incremental_clause ? incremental_clause : "");
 
 	if (PQsendQuery(conn, basebkp) == 0)
 	{
@@ -2191,6 +2968,8 @@ main(int argc, char **argv)
 		{"waldir", required_argument, NULL, 1},
 		{"no-slot", no_argument, NULL, 2},
 		{"no-verify-checksums", no_argument, NULL, 3},
+		{"server-compress", required_argument, NULL, 4},
+		{"incremental", required_argument, NULL, 5},
 		{NULL, 0, NULL, 0}
 	};
 	int			c;
@@ -2359,6 +3138,12 @@ main(int argc, char **argv)
 			case 3:
 				verify_checksums = false;
 				break;
+			case 4:
+				parse_server_compression(optarg);
+				break;
+			case 5:
+				incremental_from = pg_strdup(optarg);
+				break;
 			default:
 
 				/*
@@ -2404,6 +3189,14 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (server_compress != SERVER_COMPRESSION_NONE && compresslevel != 0)
+	{
+		pg_log_error("--compress and --server-compress are incompatible options");
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"),
+				progname);
+		exit(1);
+	}
+
 	if (format == 't' && includewal == STREAM_WAL && strcmp(basedir, "-") == 0)
 	{
 		pg_log_error("cannot stream write-ahead logs in tar mode to stdout");
@@ -2474,7 +3267,7 @@ main(int argc, char **argv)
 	}
 
 #ifndef HAVE_LIBZ
-	if (compresslevel != 0)
+	if (compresslevel != 0 || server_compress == SERVER_COMPRESSION_GZIP)
 	{
 		pg_log_error("this build does not support compression");
 		exit(1);
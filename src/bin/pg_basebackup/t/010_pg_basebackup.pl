@@ -6,7 +6,7 @@ use File::Basename qw(basename dirname);
 use File::Path qw(rmtree);
 use PostgresNode;
 use TestLib;
-use Test::More tests => 106;
+use Test::More tests => 125;
 
 program_help_ok('pg_basebackup');
 program_version_ok('pg_basebackup');
@@ -369,6 +369,86 @@ like(
 	qr/^primary_conninfo = '.*port=$port.*'\n/m,
 	'postgresql.auto.conf sets primary_conninfo');
 
+$node->command_fails(
+	[
+		'pg_basebackup', '-D', "$tempdir/backup_sc", '-Ft',
+		'--server-compress=foo'
+	],
+	'--server-compress with unknown method fails');
+
+SKIP:
+{
+	skip "postgres was not built with ZLIB support", 6
+	  if (!check_pg_config("#define HAVE_LIBZ 1"));
+
+	$node->command_ok(
+		[
+			'pg_basebackup', '-D', "$tempdir/backup_scp",
+			'--server-compress=gzip'
+		],
+		'pg_basebackup --server-compress runs in plain mode');
+	ok(-f "$tempdir/backup_scp/PG_VERSION", 'backup was created');
+	rmtree("$tempdir/backup_scp");
+
+	$node->command_ok(
+		[
+			'pg_basebackup', '-D', "$tempdir/backup_sct", '-Ft',
+			'--server-compress=gzip:1'
+		],
+		'pg_basebackup --server-compress runs in tar mode');
+	ok(-f "$tempdir/backup_sct/base.tar.gz", 'compressed tar was created');
+	rmtree("$tempdir/backup_sct");
+
+	$node->command_ok(
+		[
+			'pg_basebackup', '-D', "$tempdir/backup_sctr", '-Ft', '-R',
+			'--server-compress=gzip'
+		],
+		'pg_basebackup --server-compress runs in tar mode with -R');
+	ok(-f "$tempdir/backup_sctr/base.tar.gz", 'compressed tar was created');
+	rmtree("$tempdir/backup_sctr");
+}
+
+foreach my $method ([ 'lz4', 'USE_LZ4', 'lz4' ], [ 'zstd', 'USE_ZSTD', 'zst' ])
+{
+	my ($name, $symbol, $suffix) = @$method;
+
+  SKIP:
+	{
+		skip "postgres was not built with $name support", 6
+		  if (!check_pg_config("#define $symbol 1"));
+
+		$node->command_ok(
+			[
+				'pg_basebackup', '-D', "$tempdir/backup_scp",
+				"--server-compress=$name"
+			],
+			"pg_basebackup --server-compress=$name runs in plain mode");
+		ok(-f "$tempdir/backup_scp/PG_VERSION", 'backup was created');
+		rmtree("$tempdir/backup_scp");
+
+		$node->command_ok(
+			[
+				'pg_basebackup', '-D', "$tempdir/backup_sct", '-Ft',
+				"--server-compress=$name:1"
+			],
+			"pg_basebackup --server-compress=$name runs in tar mode");
+		ok(-f "$tempdir/backup_sct/base.tar.$suffix",
+			'compressed tar was created');
+		rmtree("$tempdir/backup_sct");
+
+		$node->command_ok(
+			[
+				'pg_basebackup', '-D', "$tempdir/backup_sctr", '-Ft', '-R',
+				"--server-compress=$name"
+			],
+			"pg_basebackup --server-compress=$name runs in tar mode with -R");
+		ok(-f "$tempdir/backup_sctr/base.tar.$suffix",
+			'compressed tar was created');
+		rmtree("$tempdir/backup_sctr");
+	}
+}
+
 $node->command_ok(
 	[ 'pg_basebackup', '-D', "$tempdir/backupxd" ],
 	'pg_basebackup runs in default xlog mode');
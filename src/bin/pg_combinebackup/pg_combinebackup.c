@@ -0,0 +1,749 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_combinebackup.c
+ *	  Reconstruct a full backup from a full backup and a chain of
+ *	  incremental backups taken after it
+ *
+ * Each incremental backup holds the relation segments that were modified
+ * since the backup it is based on as INCREMENTAL.* files, which contain only
+ * the modified blocks.  We copy the newest backup, and rebuild each of those
+ * segments by taking every block from the newest backup in the chain that
+ * has it.
+ *
+ * Copyright (c) 2010-2019, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/bin/pg_combinebackup/pg_combinebackup.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "catalog/pg_control.h"
+#include "common/controldata_utils.h"
+#include "common/file_perm.h"
+#include "common/file_utils.h"
+#include "common/logging.h"
+#include "getopt_long.h"
+#include "replication/basebackup.h"
+#include "storage/block.h"
+
+
+/*
+ * A backup in the chain, with the WAL locations from its backup_label.
+ */
+typedef struct BackupInfo
+{
+	char	   *dir;
+	XLogRecPtr	start_lsn;		/* START WAL LOCATION */
+	XLogRecPtr	incremental_lsn;	/* INCREMENTAL FROM LSN, or invalid */
+} BackupInfo;
+
+/*
+ * A version of a relation segment in one of the backups, from which blocks
+ * of the reconstructed segment may be taken.
+ */
+typedef struct SegmentSource
+{
+	char		path[MAXPGPATH];
+	int			fd;				/* -1 if the backup has no such file */
+	bool		incremental;
+	BlockNumber nblocks;		/* length of the file, or truncation block
+								 * length of an incremental file */
+	uint32		num_blocks;		/* incremental file: number of blocks */
+	BlockNumber *blocks;		/* incremental file: their block numbers */
+	off_t		data_offset;	/* incremental file: offset of first block */
+} SegmentSource;
+
+static const char *progname;
+
+static BackupInfo *backups;
+static int	nbackups;
+static char *output_dir = NULL;
+static bool do_sync = true;
+static bool verbose = false;
+
+static void usage(void);
+static void read_backup_label(BackupInfo *backup);
+static void check_backup_chain(void);
+static void copy_directory(const char *relpath);
+static void copy_file(const char *src, const char *dst);
+static void write_backup_label(const char *src, const char *dst);
+static void reconstruct_file(const char *relpath, const char *incrname);
+static void open_segment_source(SegmentSource *source, const char *dir,
+								const char *relpath, const char *filename);
+static void read_segment_block(SegmentSource *source, BlockNumber blkno,
+							   char *buf);
+static int	compare_block_numbers(const void *a, const void *b);
+
+
+static void
+usage(void)
+{
+	printf(_("%s reconstructs a full backup from incremental backups.\n\n"), progname);
+	printf(_("Usage:\n"));
+	printf(_("  %s [OPTION]... FULLBACKUP INCREMENTALBACKUP...\n"), progname);
+	printf(_("\nOptions:\n"));
+	printf(_("  -o, --output=DIRECTORY  write the reconstructed backup into DIRECTORY\n"));
+	printf(_("  -N, --no-sync           do not wait for changes to be written safely to disk\n"));
+	printf(_("  -v, --verbose           output verbose messages\n"));
+	printf(_("  -V, --version           output version information, then exit\n"));
+	printf(_("  -?, --help              show this help, then exit\n"));
+	printf(_("\nThe backups must be given in the order they were taken, each incremental\n"
+			 "backup being based on the one before it.\n\n"));
+	printf(_("Report bugs to <pgsql-bugs@lists.postgresql.org>.\n"));
+}
+
+/*
+ * Read the WAL locations of a backup from its backup_label file.
+ */
+static void
+read_backup_label(BackupInfo *backup)
+{
+	char		path[MAXPGPATH];
+	char		line[MAXPGPATH];
+	FILE	   *fp;
+	uint32		hi,
+				lo;
+
+	snprintf(path, sizeof(path), "%s/backup_label", backup->dir);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		pg_log_error("could not open file \"%s\": %m", path);
+		exit(1);
+	}
+
+	backup->start_lsn = InvalidXLogRecPtr;
+	backup->incremental_lsn = InvalidXLogRecPtr;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (sscanf(line, "START WAL LOCATION: %X/%X", &hi, &lo) == 2)
+			backup->start_lsn = ((uint64) hi) << 32 | lo;
+		else if (sscanf(line, "INCREMENTAL FROM LSN: %X/%X", &hi, &lo) == 2)
+			backup->incremental_lsn = ((uint64) hi) << 32 | lo;
+	}
+	fclose(fp);
+
+	if (XLogRecPtrIsInvalid(backup->start_lsn))
+	{
+		pg_log_error("could not find START WAL LOCATION in file \"%s\"",
+					 path);
+		exit(1);
+	}
+}
+
+/*
+ * Check that the backups form a chain: the first one is a full backup, each
+ * of the others is an incremental backup based on the one before it, and all
+ * are of the same cluster.  Tablespaces are not supported.
+ */
+static void
+check_backup_chain(void)
+{
+	uint64		system_identifier = 0;
+	int			i;
+
+	for (i = 0; i < nbackups; i++)
+	{
+		BackupInfo *backup = &backups[i];
+		ControlFileData *ControlFile;
+		bool		crc_ok;
+		char		path[MAXPGPATH];
+		DIR		   *dir;
+		struct dirent *de;
+
+		read_backup_label(backup);
+
+		if (i == 0 && !XLogRecPtrIsInvalid(backup->incremental_lsn))
+		{
+			pg_log_error("backup \"%s\" is an incremental backup, but the first backup must be a full backup",
+						 backup->dir);
+			exit(1);
+		}
+		if (i > 0 && XLogRecPtrIsInvalid(backup->incremental_lsn))
+		{
+			pg_log_error("backup \"%s\" is a full backup, but only the first backup should be a full backup",
+						 backup->dir);
+			exit(1);
+		}
+		if (i > 0 && backup->incremental_lsn != backups[i - 1].start_lsn)
+		{
+			pg_log_error("backup \"%s\" is based on the backup starting at %X/%X, but backup \"%s\" starts at %X/%X",
+						 backup->dir,
+						 (uint32) (backup->incremental_lsn >> 32),
+						 (uint32) backup->incremental_lsn,
+						 backups[i - 1].dir,
+						 (uint32) (backups[i - 1].start_lsn >> 32),
+						 (uint32) backups[i - 1].start_lsn);
+			exit(1);
+		}
+
+		ControlFile = get_controlfile(backup->dir, &crc_ok);
+		if (!crc_ok)
+		{
+			pg_log_error("pg_control CRC value is incorrect in backup \"%s\"",
+						 backup->dir);
+			exit(1);
+		}
+		if (ControlFile->blcksz != BLCKSZ ||
+			ControlFile->relseg_size != RELSEG_SIZE)
+		{
+			pg_log_error("backup \"%s\" is not compatible with this version of pg_combinebackup",
+						 backup->dir);
+			exit(1);
+		}
+		if (i > 0 && ControlFile->system_identifier != system_identifier)
+		{
+			pg_log_error("backup \"%s\" is from a different database system than backup \"%s\"",
+						 backup->dir, backups[0].dir);
+			exit(1);
+		}
+		system_identifier = ControlFile->system_identifier;
+		pfree(ControlFile);
+
+		snprintf(path, sizeof(path), "%s/pg_tblspc", backup->dir);
+		dir = opendir(path);
+		if (dir == NULL)
+		{
+			pg_log_error("could not open directory \"%s\": %m", path);
+			exit(1);
+		}
+		while (errno = 0, (de = readdir(dir)) != NULL)
+		{
+			if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+				continue;
+			pg_log_error("backup \"%s\" contains tablespaces, which are not supported",
+						 backup->dir);
+			exit(1);
+		}
+		if (errno)
+		{
+			pg_log_error("could not read directory \"%s\": %m", path);
+			exit(1);
+		}
+		closedir(dir);
+	}
+}
+
+/*
+ * Copy the directory relpath of the newest backup into the output directory,
+ * reconstructing incremental files.  An empty relpath means the top-level
+ * directory.
+ */
+static void
+copy_directory(const char *relpath)
+{
+	char		srcdir[MAXPGPATH];
+	char		dstdir[MAXPGPATH];
+	DIR		   *dir;
+	struct dirent *de;
+
+	snprintf(srcdir, sizeof(srcdir), "%s%s%s", backups[nbackups - 1].dir,
+			 relpath[0] != '\0' ? "/" : "", relpath);
+	snprintf(dstdir, sizeof(dstdir), "%s%s%s", output_dir,
+			 relpath[0] != '\0' ? "/" : "", relpath);
+
+	if (mkdir(dstdir, pg_dir_create_mode) != 0 && errno != EEXIST)
+	{
+		pg_log_error("could not create directory \"%s\": %m", dstdir);
+		exit(1);
+	}
+
+	dir = opendir(srcdir);
+	if (dir == NULL)
+	{
+		pg_log_error("could not open directory \"%s\": %m", srcdir);
+		exit(1);
+	}
+
+	while (errno = 0, (de = readdir(dir)) != NULL)
+	{
+		char		src[MAXPGPATH];
+		char		dst[MAXPGPATH];
+		char		subpath[MAXPGPATH];
+		struct stat st;
+
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		snprintf(src, sizeof(src), "%s/%s", srcdir, de->d_name);
+		snprintf(dst, sizeof(dst), "%s/%s", dstdir, de->d_name);
+		snprintf(subpath, sizeof(subpath), "%s%s%s", relpath,
+				 relpath[0] != '\0' ? "/" : "", de->d_name);
+
+		if (stat(src, &st) != 0)
+		{
+			pg_log_error("could not stat file \"%s\": %m", src);
+			exit(1);
+		}
+
+		if (S_ISDIR(st.st_mode))
+			copy_directory(subpath);
+		else if (strncmp(de->d_name, INCREMENTAL_PREFIX,
+						 strlen(INCREMENTAL_PREFIX)) == 0)
+			reconstruct_file(relpath, de->d_name);
+		else if (strcmp(subpath, "backup_label") == 0)
+			write_backup_label(src, dst);
+		else
+			copy_file(src, dst);
+	}
+
+	if (errno)
+	{
+		pg_log_error("could not read directory \"%s\": %m", srcdir);
+		exit(1);
+	}
+	closedir(dir);
+}
+
+/*
+ * Copy a file unchanged.
+ */
+static void
+copy_file(const char *src, const char *dst)
+{
+	char		buf[BLCKSZ * 4];
+	int			srcfd;
+	int			dstfd;
+	int			nread;
+
+	if (verbose)
+		pg_log_info("copying \"%s\"", src);
+
+	srcfd = open(src, O_RDONLY | PG_BINARY, 0);
+	if (srcfd < 0)
+	{
+		pg_log_error("could not open file \"%s\": %m", src);
+		exit(1);
+	}
+	dstfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | PG_BINARY,
+				 pg_file_create_mode);
+	if (dstfd < 0)
+	{
+		pg_log_error("could not create file \"%s\": %m", dst);
+		exit(1);
+	}
+
+	while ((nread = read(srcfd, buf, sizeof(buf))) > 0)
+	{
+		errno = 0;
+		if (write(dstfd, buf, nread) != nread)
+		{
+			/* if write didn't set errno, assume problem is no disk space */
+			if (errno == 0)
+				errno = ENOSPC;
+			pg_log_error("could not write file \"%s\": %m", dst);
+			exit(1);
+		}
+	}
+	if (nread < 0)
+	{
+		pg_log_error("could not read file \"%s\": %m", src);
+		exit(1);
+	}
+
+	if (close(dstfd) != 0)
+	{
+		pg_log_error("could not close file \"%s\": %m", dst);
+		exit(1);
+	}
+	close(srcfd);
+}
+
+/*
+ * Write the backup_label file of the newest backup, without the line that
+ * marks it as an incremental backup.
+ */
+static void
+write_backup_label(const char *src, const char *dst)
+{
+	char		line[MAXPGPATH];
+	FILE	   *in;
+	FILE	   *out;
+
+	in = fopen(src, "r");
+	if (in == NULL)
+	{
+		pg_log_error("could not open file \"%s\": %m", src);
+		exit(1);
+	}
+	out = fopen(dst, "w");
+	if (out == NULL)
+	{
+		pg_log_error("could not create file \"%s\": %m", dst);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		if (strncmp(line, "INCREMENTAL FROM LSN: ",
+					strlen("INCREMENTAL FROM LSN: ")) == 0)
+			continue;
+		if (fputs(line, out) == EOF)
+		{
+			pg_log_error("could not write file \"%s\": %m", dst);
+			exit(1);
+		}
+	}
+
+	if (ferror(in))
+	{
+		pg_log_error("could not read file \"%s\": %m", src);
+		exit(1);
+	}
+	fclose(in);
+	if (fclose(out) != 0)
+	{
+		pg_log_error("could not close file \"%s\": %m", dst);
+		exit(1);
+	}
+}
+
+/*
+ * Reconstruct the relation segment that the newest backup holds as the
+ * incremental file relpath/incrname.  Each block is taken from the newest
+ * backup containing it: a full copy of the segment contains all of its
+ * blocks, and blocks beyond its end are zeros; an incremental file contains
+ * the blocks it lists, and blocks at or beyond its truncation block length
+ * are zeros; any other block comes from an older backup.
+ */
+static void
+reconstruct_file(const char *relpath, const char *incrname)
+{
+	const char *filename = incrname + strlen(INCREMENTAL_PREFIX);
+	SegmentSource *sources;
+	char		dst[MAXPGPATH];
+	char		buf[BLCKSZ];
+	BlockNumber nblocks;
+	BlockNumber blkno;
+	int			dstfd;
+	int			i;
+
+	sources = pg_malloc0(sizeof(SegmentSource) * nbackups);
+	for (i = 0; i < nbackups; i++)
+		open_segment_source(&sources[i], backups[i].dir, relpath, filename);
+
+	Assert(sources[nbackups - 1].incremental);
+	nblocks = sources[nbackups - 1].nblocks;
+
+	snprintf(dst, sizeof(dst), "%s/%s/%s", output_dir, relpath, filename);
+	if (verbose)
+		pg_log_info("reconstructing \"%s\"", dst);
+
+	dstfd = open(dst, O_WRONLY | O_CREAT | O_EXCL | PG_BINARY,
+				 pg_file_create_mode);
+	if (dstfd < 0)
+	{
+		pg_log_error("could not create file \"%s\": %m", dst);
+		exit(1);
+	}
+
+	for (blkno = 0; blkno < nblocks; blkno++)
+	{
+		MemSet(buf, 0, BLCKSZ);
+
+		for (i = nbackups - 1; i >= 0; i--)
+		{
+			SegmentSource *source = &sources[i];
+
+			if (source->fd < 0 || blkno >= source->nblocks)
+				break;			/* it's zeros */
+
+			if (source->incremental &&
+				bsearch(&blkno, source->blocks, source->num_blocks,
+						sizeof(BlockNumber), compare_block_numbers) == NULL)
+				continue;		/* look in the older backup */
+
+			read_segment_block(source, blkno, buf);
+			break;
+		}
+
+		errno = 0;
+		if (write(dstfd, buf, BLCKSZ) != BLCKSZ)
+		{
+			/* if write didn't set errno, assume problem is no disk space */
+			if (errno == 0)
+				errno = ENOSPC;
+			pg_log_error("could not write file \"%s\": %m", dst);
+			exit(1);
+		}
+	}
+
+	if (close(dstfd) != 0)
+	{
+		pg_log_error("could not close file \"%s\": %m", dst);
+		exit(1);
+	}
+
+	for (i = 0; i < nbackups; i++)
+	{
+		if (sources[i].fd >= 0)
+			close(sources[i].fd);
+		if (sources[i].blocks != NULL)
+			pg_free(sources[i].blocks);
+	}
+	pg_free(sources);
+}
+
+/*
+ * Open the version of relation segment relpath/filename in the backup in
+ * directory dir, whether it's stored in full or as an incremental file.
+ */
+static void
+open_segment_source(SegmentSource *source, const char *dir,
+					const char *relpath, const char *filename)
+{
+	IncrementalFileHeader header;
+	struct stat st;
+	size_t		size;
+	int			r;
+
+	source->fd = -1;
+
+	snprintf(source->path, sizeof(source->path), "%s/%s/%s",
+			 dir, relpath, filename);
+	source->fd = open(source->path, O_RDONLY | PG_BINARY, 0);
+	if (source->fd >= 0)
+	{
+		if (fstat(source->fd, &st) != 0)
+		{
+			pg_log_error("could not stat file \"%s\": %m", source->path);
+			exit(1);
+		}
+		source->incremental = false;
+		source->nblocks = st.st_size / BLCKSZ;
+		return;
+	}
+	if (errno != ENOENT)
+	{
+		pg_log_error("could not open file \"%s\": %m", source->path);
+		exit(1);
+	}
+
+	snprintf(source->path, sizeof(source->path), "%s/%s/%s%s",
+			 dir, relpath, INCREMENTAL_PREFIX, filename);
+	source->fd = open(source->path, O_RDONLY | PG_BINARY, 0);
+	if (source->fd < 0)
+	{
+		if (errno != ENOENT)
+		{
+			pg_log_error("could not open file \"%s\": %m", source->path);
+			exit(1);
+		}
+		/* The segment didn't exist yet when this backup was taken. */
+		return;
+	}
+
+	r = read(source->fd, &header, sizeof(header));
+	if (r != sizeof(header))
+	{
+		if (r < 0)
+			pg_log_error("could not read file \"%s\": %m", source->path);
+		else
+			pg_log_error("could not read file \"%s\": read %d of %zu",
+						 source->path, r, sizeof(header));
+		exit(1);
+	}
+	if (header.magic != INCREMENTAL_MAGIC)
+	{
+		pg_log_error("file \"%s\" has bad incremental magic number (0x%x not 0x%x)",
+					 source->path, header.magic, INCREMENTAL_MAGIC);
+		exit(1);
+	}
+	if (header.num_blocks > RELSEG_SIZE ||
+		header.truncation_block_length > RELSEG_SIZE)
+	{
+		pg_log_error("file \"%s\" is corrupt", source->path);
+		exit(1);
+	}
+
+	source->incremental = true;
+	source->nblocks = header.truncation_block_length;
+	source->num_blocks = header.num_blocks;
+	size = sizeof(BlockNumber) * header.num_blocks;
+	source->blocks = pg_malloc(Max(size, 1));
+	r = read(source->fd, source->blocks, size);
+	if (r != size)
+	{
+		if (r < 0)
+			pg_log_error("could not read file \"%s\": %m", source->path);
+		else
+			pg_log_error("could not read file \"%s\": read %d of %zu",
+						 source->path, r, size);
+		exit(1);
+	}
+	source->data_offset = sizeof(header) + size;
+}
+
+/*
+ * Read a block of a relation segment from a backup.
+ */
+static void
+read_segment_block(SegmentSource *source, BlockNumber blkno, char *buf)
+{
+	off_t		offset;
+	int			r;
+
+	if (source->incremental)
+	{
+		BlockNumber *entry;
+
+		entry = bsearch(&blkno, source->blocks, source->num_blocks,
+						sizeof(BlockNumber), compare_block_numbers);
+		Assert(entry != NULL);
+		offset = source->data_offset +
+			(off_t) (entry - source->blocks) * BLCKSZ;
+	}
+	else
+		offset = (off_t) blkno * BLCKSZ;
+
+	r = pg_pread(source->fd, buf, BLCKSZ, offset);
+	if (r != BLCKSZ)
+	{
+		if (r < 0)
+			pg_log_error("could not read file \"%s\": %m", source->path);
+		else
+			pg_log_error("could not read block %u in file \"%s\": read %d of %d",
+						 blkno, source->path, r, BLCKSZ);
+		exit(1);
+	}
+}
+
+static int
+compare_block_numbers(const void *a, const void *b)
+{
+	BlockNumber ba = *(const BlockNumber *) a;
+	BlockNumber bb = *(const BlockNumber *) b;
+
+	if (ba < bb)
+		return -1;
+	if (ba > bb)
+		return 1;
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static struct option long_options[] = {
+		{"output", required_argument, NULL, 'o'},
+		{"no-sync", no_argument, NULL, 'N'},
+		{"verbose", no_argument, NULL, 'v'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int			c;
+	int			option_index;
+	int			i;
+
+	pg_logging_init(argv[0]);
+	set_pglocale_pgservice(argv[0], PG_TEXTDOMAIN("pg_combinebackup"));
+	progname = get_progname(argv[0]);
+
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0)
+		{
+			usage();
+			exit(0);
+		}
+		if (strcmp(argv[1], "--version") == 0 || strcmp(argv[1], "-V") == 0)
+		{
+			puts("pg_combinebackup (PostgreSQL) " PG_VERSION);
+			exit(0);
+		}
+	}
+
+	while ((c = getopt_long(argc, argv, "No:v", long_options, &option_index)) != -1)
+	{
+		switch (c)
+		{
+			case 'N':
+				do_sync = false;
+				break;
+			case 'o':
+				output_dir = pg_strdup(optarg);
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			default:
+				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
+				exit(1);
+		}
+	}
+
+	if (output_dir == NULL)
+	{
+		pg_log_error("no output directory specified");
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
+		exit(1);
+	}
+
+	if (argc - optind < 2)
+	{
+		pg_log_error("at least two backups must be specified");
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
+		exit(1);
+	}
+
+	nbackups = argc - optind;
+	backups = pg_malloc0(sizeof(BackupInfo) * nbackups);
+	for (i = 0; i < nbackups; i++)
+	{
+		backups[i].dir = pg_strdup(argv[optind + i]);
+		canonicalize_path(backups[i].dir);
+	}
+	canonicalize_path(output_dir);
+
+	check_backup_chain();
+
+	switch (pg_check_dir(output_dir))
+	{
+		case 0:
+			/* Does not exist, so create */
+			if (pg_mkdir_p(output_dir, pg_dir_create_mode) == -1)
+			{
+				pg_log_error("could not create directory \"%s\": %m",
+							 output_dir);
+				exit(1);
+			}
+			break;
+		case 1:
+			/* Exists, empty */
+			break;
+		case 2:
+		case 3:
+		case 4:
+			/* Exists, not empty */
+			pg_log_error("directory \"%s\" exists but is not empty",
+						 output_dir);
+			exit(1);
+		case -1:
+			/* Access problem */
+			pg_log_error("could not access directory \"%s\": %m",
+						 output_dir);
+			exit(1);
+	}
+
+	copy_directory("");
+
+	if (do_sync)
+	{
+		if (verbose)
+			pg_log_info("syncing data to disk ...");
+		fsync_pgdata(output_dir, PG_VERSION_NUM);
+	}
+
+	if (verbose)
+		pg_log_info("backups combined");
+
+	return 0;
+}
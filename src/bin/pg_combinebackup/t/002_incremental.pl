@@ -0,0 +1,85 @@
+# Take a full backup and two incremental backups, combine them, and check
+# that a server started from the result has the right contents.
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 10;
+
+my $primary = get_new_node('primary');
+$primary->init(allows_streaming => 1);
+$primary->append_conf('postgresql.conf', "summarize_wal = on\n");
+$primary->start;
+my $backup_dir = $primary->backup_dir;
+
+$primary->safe_psql(
+	'postgres', q{
+	CREATE TABLE t (a int, b text) WITH (autovacuum_enabled = off);
+	INSERT INTO t SELECT g, repeat('x', 100) FROM generate_series(1, 10000) g;
+	CREATE TABLE gone (a int);
+	INSERT INTO gone VALUES (1);
+});
+
+$primary->command_ok([ 'pg_basebackup', '-D', "$backup_dir/full", '--no-sync' ],
+	'full backup');
+
+$primary->safe_psql(
+	'postgres', q{
+	UPDATE t SET b = 'y' WHERE a <= 10;
+	DROP TABLE gone;
+	CREATE TABLE created AS SELECT 1 AS a;
+});
+
+$primary->command_ok(
+	[
+		'pg_basebackup', '-D', "$backup_dir/incr1", '--no-sync',
+		"--incremental=$backup_dir/full"
+	],
+	'first incremental backup');
+
+$primary->safe_psql('postgres', q{UPDATE t SET b = 'z' WHERE a > 9990;});
+
+$primary->command_ok(
+	[
+		'pg_basebackup', '-D', "$backup_dir/incr2", '--no-sync',
+		"--incremental=$backup_dir/incr1"
+	],
+	'second incremental backup');
+
+my $relpath = $primary->safe_psql('postgres', q{SELECT pg_relation_filepath('t')});
+$relpath =~ s{([^/]+)$}{INCREMENTAL.$1};
+ok(-f "$backup_dir/incr2/$relpath", 'modified table is sent incrementally');
+
+my $expected = $primary->safe_psql('postgres',
+	q{SELECT string_agg(a || ':' || b, ',' ORDER BY a) FROM t});
+
+command_fails_like(
+	[
+		'pg_combinebackup', '-o', "$backup_dir/bad",
+		"$backup_dir/full", "$backup_dir/incr2"
+	],
+	qr/is based on the backup starting at/,
+	'fails with a gap in the chain');
+
+command_ok(
+	[
+		'pg_combinebackup', '-o', "$backup_dir/combined", '--no-sync',
+		"$backup_dir/full", "$backup_dir/incr1", "$backup_dir/incr2"
+	],
+	'combine backups');
+
+my $restored = get_new_node('restored');
+$restored->init_from_backup($primary, 'combined');
+$restored->start;
+
+is( $restored->safe_psql(
+		'postgres',
+		q{SELECT string_agg(a || ':' || b, ',' ORDER BY a) FROM t}),
+	$expected,
+	'combined backup has the modified rows');
+is($restored->safe_psql('postgres', q{SELECT a FROM created}),
+	'1', 'combined backup has the created table');
+is( $restored->safe_psql(
+		'postgres', q{SELECT count(*) FROM pg_class WHERE relname = 'gone'}),
+	'0',
+	'combined backup lacks the dropped table');
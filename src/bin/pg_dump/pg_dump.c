@@ -4101,6 +4101,8 @@ getSubscriptions(Archive *fout)
 	int			i_subslotname;
 	int			i_subsynccommit;
 	int			i_subpublications;
+	int			i_substream;
+	int			i_subparallelapply;
 	int			i,
 				ntups;
 
@@ -4132,11 +4134,20 @@ getSubscriptions(Archive *fout)
 					  "SELECT s.tableoid, s.oid, s.subname,"
 					  "(%s s.subowner) AS rolname, "
 					  " s.subconninfo, s.subslotname, s.subsynccommit, "
-					  " s.subpublications "
-					  "FROM pg_subscription s "
-					  "WHERE s.subdbid = (SELECT oid FROM pg_database"
-					  "                   WHERE datname = current_database())",
+					  " s.subpublications, ",
 					  username_subquery);
+
+	if (fout->remoteVersion >= 130000)
+		appendPQExpBufferStr(query,
+							 " s.substream, s.subparallelapply\n");
+	else
+		appendPQExpBufferStr(query,
+							 " false AS substream, false AS subparallelapply\n");
+
+	appendPQExpBufferStr(query,
+						 "FROM pg_subscription s "
+						 "WHERE s.subdbid = (SELECT oid FROM pg_database"
+						 "                   WHERE datname = current_database())");
 	res = ExecuteSqlQuery(fout, query->data, PGRES_TUPLES_OK);
 
 	ntups = PQntuples(res);
@@ -4149,6 +4160,8 @@ getSubscriptions(Archive *fout)
 	i_subslotname = PQfnumber(res, "subslotname");
 	i_subsynccommit = PQfnumber(res, "subsynccommit");
 	i_subpublications = PQfnumber(res, "subpublications");
+	i_substream = PQfnumber(res, "substream");
+	i_subparallelapply = PQfnumber(res, "subparallelapply");
 
 	subinfo = pg_malloc(ntups * sizeof(SubscriptionInfo));
 
@@ -4170,6 +4183,10 @@ getSubscriptions(Archive *fout)
 			pg_strdup(PQgetvalue(res, i, i_subsynccommit));
 		subinfo[i].subpublications =
 			pg_strdup(PQgetvalue(res, i, i_subpublications));
+		subinfo[i].substream =
+			pg_strdup(PQgetvalue(res, i, i_substream));
+		subinfo[i].subparallelapply =
+			pg_strdup(PQgetvalue(res, i, i_subparallelapply));
 
 		if (strlen(subinfo[i].rolname) == 0)
 			pg_log_warning("owner of subscription \"%s\" appears to be invalid",
@@ -4241,6 +4258,12 @@ dumpSubscription(Archive *fout, SubscriptionInfo *subinfo)
 	if (strcmp(subinfo->subsynccommit, "off") != 0)
 		appendPQExpBuffer(query, ", synchronous_commit = %s", fmtId(subinfo->subsynccommit));
 
+	if (strcmp(subinfo->substream, "f") != 0)
+		appendPQExpBufferStr(query, ", streaming = on");
+
+	if (strcmp(subinfo->subparallelapply, "f") != 0)
+		appendPQExpBufferStr(query, ", parallel_apply = on");
+
 	appendPQExpBufferStr(query, ");\n");
 
 	ArchiveEntry(fout, subinfo->dobj.catId, subinfo->dobj.dumpId,
@@ -8213,6 +8236,7 @@ getTableAttrs(Archive *fout, TableInfo *tblinfo, int numTables)
 	int			i_attstattarget;
 	int			i_attstorage;
 	int			i_typstorage;
+	int			i_attcompression;
 	int			i_attnotnull;
 	int			i_atthasdef;
 	int			i_attidentity;
@@ -8269,6 +8293,13 @@ getTableAttrs(Archive *fout, TableInfo *tblinfo, int numTables)
 							 "a.attislocal,\n"
 							 "pg_catalog.format_type(t.oid, a.atttypmod) AS atttypname,\n");
 
+		if (fout->remoteVersion >= 130000)
+			appendPQExpBufferStr(q,
+								 "a.attcompression,\n");
+		else
+			appendPQExpBufferStr(q,
+								 "'' AS attcompression,\n");
+
 		if (fout->remoteVersion >= 120000)
 			appendPQExpBufferStr(q,
 								 "a.attgenerated,\n");
@@ -8345,6 +8376,7 @@ getTableAttrs(Archive *fout, TableInfo *tblinfo, int numTables)
 		i_attstattarget = PQfnumber(res, "attstattarget");
 		i_attstorage = PQfnumber(res, "attstorage");
 		i_typstorage = PQfnumber(res, "typstorage");
+		i_attcompression = PQfnumber(res, "attcompression");
 		i_attnotnull = PQfnumber(res, "attnotnull");
 		i_atthasdef = PQfnumber(res, "atthasdef");
 		i_attidentity = PQfnumber(res, "attidentity");
@@ -8365,6 +8397,7 @@ getTableAttrs(Archive *fout, TableInfo *tblinfo, int numTables)
 		tbinfo->attstattarget = (int *) pg_malloc(ntups * sizeof(int));
 		tbinfo->attstorage = (char *) pg_malloc(ntups * sizeof(char));
 		tbinfo->typstorage = (char *) pg_malloc(ntups * sizeof(char));
+		tbinfo->attcompression = (char *) pg_malloc(ntups * sizeof(char));
 		tbinfo->attidentity = (char *) pg_malloc(ntups * sizeof(char));
 		tbinfo->attgenerated = (char *) pg_malloc(ntups * sizeof(char));
 		tbinfo->attisdropped = (bool *) pg_malloc(ntups * sizeof(bool));
@@ -8391,6 +8424,7 @@ getTableAttrs(Archive *fout, TableInfo *tblinfo, int numTables)
 			tbinfo->attstattarget[j] = atoi(PQgetvalue(res, j, i_attstattarget));
 			tbinfo->attstorage[j] = *(PQgetvalue(res, j, i_attstorage));
 			tbinfo->typstorage[j] = *(PQgetvalue(res, j, i_typstorage));
+			tbinfo->attcompression[j] = *(PQgetvalue(res, j, i_attcompression));
 			tbinfo->attidentity[j] = *(PQgetvalue(res, j, i_attidentity));
 			tbinfo->attgenerated[j] = *(PQgetvalue(res, j, i_attgenerated));
 			tbinfo->needs_override = tbinfo->needs_override || (tbinfo->attidentity[j] == ATTRIBUTE_IDENTITY_ALWAYS);
@@ -16093,6 +16127,37 @@ dumpTableSchema(Archive *fout, TableInfo *tbinfo)
 				}
 			}
 
+			/*
+			 * Dump per-column compression method.  The statement is only
+			 * dumped if a method has been chosen for the column.
+			 */
+			if (tbinfo->attcompression[j] != '\0')
+			{
+				const char *cmname;
+
+				switch (tbinfo->attcompression[j])
+				{
+					case 'p':
+						cmname = "pglz";
+						break;
+					case 'l':
+						cmname = "lz4";
+						break;
+					default:
+						cmname = NULL;
+				}
+
+				if (cmname != NULL)
+				{
+					appendPQExpBuffer(q, "ALTER TABLE ONLY %s ",
+									  qualrelname);
+					appendPQExpBuffer(q, "ALTER COLUMN %s ",
+									  fmtId(tbinfo->attnames[j]));
+					appendPQExpBuffer(q, "SET COMPRESSION %s;\n",
+									  cmname);
+				}
+			}
+
 			/*
 			 * Dump per-column attributes.
 			 */
@@ -308,6 +308,7 @@ typedef struct _tableInfo
 	int		   *attstattarget;	/* attribute statistics targets */
 	char	   *attstorage;		/* attribute storage scheme */
 	char	   *typstorage;		/* type storage scheme */
+	char	   *attcompression; /* per-attribute compression method */
 	bool	   *attisdropped;	/* true if attr is dropped; don't dump it */
 	char	   *attidentity;
 	char	   *attgenerated;
@@ -625,6 +626,8 @@ typedef struct _SubscriptionInfo
 	char	   *subslotname;
 	char	   *subsynccommit;
 	char	   *subpublications;
+	char	   *substream;
+	char	   *subparallelapply;
 } SubscriptionInfo;
 
 /*
@@ -72,6 +72,36 @@ pgbench(
 		  "CREATE TYPE pg_temp.e AS ENUM ($labels); DROP TYPE pg_temp.e;"
 	});
 
+# Test lookups of shared buffers, which usually don't take the buffer mapping
+# lock, racing with the replacement of buffers by other clients.  With
+# shared_buffers this small, the table doesn't fit, and the clients keep
+# evicting each other's blocks.
+$node->safe_psql('postgres', "ALTER SYSTEM SET shared_buffers = '1MB'");
+$node->restart;
+$node->safe_psql('postgres',
+	    'CREATE TABLE buf_lookup (a int PRIMARY KEY, b int, c text); '
+	  . "INSERT INTO buf_lookup SELECT g, 0, repeat('x', 100) FROM generate_series(1, 20000) g;"
+);
+pgbench(
+	'--no-vacuum --client=5 --protocol=prepared --transactions=50',
+	0,
+	[qr{processed: 250/250}],
+	[qr{^$}],
+	'concurrent buffer lookups and replacements',
+	{
+		'001_pgbench_buffer_lookup' => q{
+\set id random(1, 20000)
+UPDATE buf_lookup SET b = b + 1 WHERE a = :id;
+SELECT 1 / (count(*) = 1)::int FROM buf_lookup WHERE a = :id;
+SELECT 1 / (count(*) = 20000)::int FROM buf_lookup;
+}
+	});
+is($node->safe_psql('postgres', 'SELECT count(*), sum(b) FROM buf_lookup'),
+	'20000|250', 'buffer lookups and replacements lost no rows or updates');
+$node->safe_psql('postgres', 'DROP TABLE buf_lookup');
+$node->safe_psql('postgres', 'ALTER SYSTEM RESET shared_buffers');
+$node->restart;
+
 # Trigger various connection errors
 pgbench(
 	'no-such-database',
@@ -5903,7 +5903,7 @@ describeSubscriptions(const char *pattern, bool verbose)
 	PGresult   *res;
 	printQueryOpt myopt = pset.popt;
 	static const bool translate_columns[] = {false, false, false, false,
-	false, false};
+	false, false, false, false};
 
 	if (pset.sversion < 100000)
 	{
@@ -5929,6 +5929,17 @@ describeSubscriptions(const char *pattern, bool verbose)
 
 	if (verbose)
 	{
+		/*
+		 * Streaming of in-progress transactions and parallel apply are only
+		 * supported in v13+
+		 */
+		if (pset.sversion >= 130000)
+			appendPQExpBuffer(&buf,
+							  ",  substream AS \"%s\"\n"
+							  ",  subparallelapply AS \"%s\"\n",
+							  gettext_noop("Streaming"),
+							  gettext_noop("Parallel apply"));
+
 		appendPQExpBuffer(&buf,
 						  ",  subsynccommit AS \"%s\"\n"
 						  ",  subconninfo AS \"%s\"\n",
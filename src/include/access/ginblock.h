@@ -135,7 +135,7 @@ typedef struct GinMetaPageData
 #define GinPageGetDeleteXid(page) ( ((PageHeader) (page))->pd_prune_xid )
 #define GinPageSetDeleteXid(page, xid) ( ((PageHeader) (page))->pd_prune_xid = xid)
 #define GinPageIsRecyclable(page) ( PageIsNew(page) || (GinPageIsDeleted(page) \
-	&& TransactionIdPrecedes(GinPageGetDeleteXid(page), RecentGlobalXmin)))
+	&& TransactionIdPrecedesRecentGlobalXmin(GinPageGetDeleteXid(page))))
 
 /*
  * We use our own ItemPointerGet(BlockNumber|OffsetNumber)
@@ -805,6 +805,14 @@ extern HeapTuple heap_modify_tuple_by_cols(HeapTuple tuple,
 										   bool *replIsnull);
 extern void heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 							  Datum *values, bool *isnull);
+extern void heap_deform_tuples(TupleDesc tupleDesc, int ntuples,
+							   HeapTuple *tuples, int natts,
+							   Datum **values, bool **isnull,
+							   uint32 *offsets);
+extern void heap_deform_tuples_rowwise(TupleDesc tupleDesc, int ntuples,
+									   HeapTuple *tuples, int natts,
+									   Datum **values, bool **isnull,
+									   uint32 *offsets);
 extern void heap_freetuple(HeapTuple htup);
 extern MinimalTuple heap_form_minimal_tuple(TupleDesc tupleDescriptor,
 											Datum *values, bool *isnull);
@@ -35,6 +35,18 @@
 /* Maximum length of an SLRU name */
 #define SLRU_MAX_NAME_LENGTH	32
 
+/*
+ * Buffer slots are divided into banks of SLRU_BANK_SIZE slots each.  A page
+ * can only be held in the bank selected by its page number, so a lookup
+ * needs to examine only that bank's slots, and the page can be protected by
+ * a lock that covers just that bank.  The number of buffers given to
+ * SimpleLruInit must be a multiple of SLRU_BANK_SIZE.
+ */
+#define SLRU_BANK_SIZE			16
+
+/* Limits for the configurable SLRU buffer pool sizes, in buffers */
+#define SLRU_MAX_ALLOWED_BUFFERS	((1024 * 1024 * 1024) / BLCKSZ)
+
 /*
  * Page status codes.  Note that these do not include the "dirty" bit.
  * page_dirty can be true only in the VALID or WRITE_IN_PROGRESS states;
@@ -54,11 +66,19 @@ typedef enum
  */
 typedef struct SlruSharedData
 {
+	/*
+	 * If ControlLock is not NULL, it protects the whole SLRU.  Otherwise each
+	 * bank of buffer slots is protected by its own lock in bank_locks[]; see
+	 * SimpleLruGetBankLock().
+	 */
 	LWLock	   *ControlLock;
 
 	/* Number of buffers managed by this SLRU structure */
 	int			num_slots;
 
+	/* Number of banks, that is num_slots / SLRU_BANK_SIZE */
+	int			num_banks;
+
 	/*
 	 * Arrays holding info for each buffer slot.  Page number is undefined
 	 * when status is EMPTY, as is page_lru_count.
@@ -81,27 +101,35 @@ typedef struct SlruSharedData
 	int			lsn_groups_per_page;
 
 	/*----------
-	 * We mark a page "most recently used" by setting
-	 *		page_lru_count[slotno] = ++cur_lru_count;
-	 * The oldest page is therefore the one with the highest value of
-	 *		cur_lru_count - page_lru_count[slotno]
+	 * LRU bookkeeping is done separately for each bank.  We mark a page
+	 * "most recently used" by setting
+	 *		page_lru_count[slotno] = ++bank_cur_lru_count[bankno];
+	 * The oldest page in the bank is therefore the one with the highest value
+	 * of
+	 *		bank_cur_lru_count[bankno] - page_lru_count[slotno]
 	 * The counts will eventually wrap around, but this calculation still
 	 * works as long as no page's age exceeds INT_MAX counts.
 	 *----------
 	 */
-	int			cur_lru_count;
+	int		   *bank_cur_lru_count;
 
 	/*
 	 * latest_page_number is the page number of the current end of the log;
 	 * this is not critical data, since we use it only to avoid swapping out
-	 * the latest page.
+	 * the latest page and as a sanity check in SimpleLruTruncate.  It is
+	 * atomic because updaters need not hold the lock of any particular bank.
 	 */
-	int			latest_page_number;
+	pg_atomic_uint32 latest_page_number;
 
 	/* LWLocks */
 	int			lwlock_tranche_id;
 	char		lwlock_tranche_name[SLRU_MAX_NAME_LENGTH];
 	LWLockPadded *buffer_locks;
+
+	/* Per-bank locks, if ControlLock is NULL */
+	int			bank_tranche_id;
+	char		bank_tranche_name[SLRU_MAX_NAME_LENGTH];
+	LWLockPadded *bank_locks;
 } SlruSharedData;
 
 typedef SlruSharedData *SlruShared;
@@ -136,10 +164,33 @@ typedef struct SlruCtlData
 
 typedef SlruCtlData *SlruCtl;
 
+/*
+ * Get the lock protecting the buffer bank that holds, or would hold, the
+ * given page.
+ */
+static inline LWLock *
+SimpleLruGetBankLock(SlruCtl ctl, int pageno)
+{
+	SlruShared	shared = ctl->shared;
+
+	if (shared->ControlLock != NULL)
+		return shared->ControlLock;
+	return &shared->bank_locks[pageno % shared->num_banks].lock;
+}
+
+/* Read and set latest_page_number */
+#define SimpleLruGetLatestPage(ctl) \
+	((int) pg_atomic_read_u32(&(ctl)->shared->latest_page_number))
+#define SimpleLruSetLatestPage(ctl, pageno) \
+	pg_atomic_write_u32(&(ctl)->shared->latest_page_number, (uint32) (pageno))
+
 
 extern Size SimpleLruShmemSize(int nslots, int nlsns);
+extern int	SimpleLruAutotuneBuffers(int divisor, int max);
+extern bool check_slru_buffers(const char *name, int *newval);
 extern void SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
-						  LWLock *ctllock, const char *subdir, int tranche_id);
+						  LWLock *ctllock, const char *subdir, int tranche_id,
+						  int bank_tranche_id);
 extern int	SimpleLruZeroPage(SlruCtl ctl, int pageno);
 extern int	SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 							  TransactionId xid);
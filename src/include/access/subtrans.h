@@ -11,8 +11,8 @@
 #ifndef SUBTRANS_H
 #define SUBTRANS_H
 
-/* Number of SLRU buffers to use for subtrans */
-#define NUM_SUBTRANS_BUFFERS	32
+/* GUC variable: number of SLRU buffers to use for subtrans, or 0 for auto */
+extern int	subtransaction_buffers;
 
 extern void SubTransSetParent(TransactionId xid, TransactionId parent);
 extern TransactionId SubTransGetParent(TransactionId xid);
@@ -217,7 +217,9 @@ typedef struct TableAmRoutine
 								bool allow_sync, bool allow_pagemode);
 
 	/*
-	 * Return next tuple from `scan`, store in slot.
+	 * Return next tuple from `scan`, store in slot.  The slot's contents must
+	 * remain valid when later tuples of the scan are stored in other slots,
+	 * so that callers can collect a batch of tuples (see execBatch.c).
 	 */
 	bool		(*scan_getnextslot) (TableScanDesc scan,
 									 ScanDirection direction,
@@ -182,6 +182,14 @@ typedef struct VariableCacheData
 	TransactionId latestCompletedXid;	/* newest XID that has committed or
 										 * aborted */
 
+	/*
+	 * Number of times a transaction with an XID has stopped being shown as
+	 * running, by committing, aborting or being prepared.  GetSnapshotData()
+	 * compares this with the value saved in a snapshot to tell whether the
+	 * snapshot's contents are still current.  Starts at 1.
+	 */
+	uint64		xactCompletionCount;
+
 	/*
 	 * These fields are protected by CLogTruncationLock
 	 */
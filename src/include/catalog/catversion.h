@@ -53,6 +53,6 @@
  */
 
 /*							yyyymmddN */
-#define CATALOG_VERSION_NO	201907142
+#define CATALOG_VERSION_NO	201912191
 
 #endif
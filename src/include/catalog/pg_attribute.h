@@ -128,6 +128,14 @@ CATALOG(pg_attribute,1249,AttributeRelationId) BKI_BOOTSTRAP BKI_ROWTYPE_OID(75,
 	 */
 	char		attalign;
 
+	/*
+	 * attcompression is the compression method used for compressible values
+	 * stored in this column (see TOAST_*_COMPRESSION), or '\0' to use the
+	 * default method.  Each compressed value records the method it was
+	 * compressed with, so this only affects values stored later.
+	 */
+	char		attcompression BKI_DEFAULT('\0');
+
 	/* This flag represents the "NOT NULL" constraint */
 	bool		attnotnull;
 
@@ -20,7 +20,7 @@
 /*
  * The number of SLRU page buffers we use for the notification queue.
  */
-#define NUM_ASYNC_BUFFERS	8
+#define NUM_ASYNC_BUFFERS	16
 
 extern bool Trace_notify;
 extern volatile sig_atomic_t notifyInterruptPending;
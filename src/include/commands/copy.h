@@ -17,6 +17,8 @@
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
 #include "parser/parse_node.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
 #include "tcop/dest.h"
 
 /* CopyStateData is private in commands/copy.c */
@@ -38,6 +40,7 @@ extern bool NextCopyFromRawFields(CopyState cstate,
 extern void CopyFromErrorCallback(void *arg);
 
 extern uint64 CopyFrom(CopyState cstate);
+extern void ParallelCopyMain(dsm_segment *seg, shm_toc *toc);
 
 extern DestReceiver *CreateCopyDestReceiver(void);
 
@@ -0,0 +1,64 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.h
+ *	  Support for batch-at-a-time execution of plan nodes
+ *
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/execBatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXECBATCH_H
+#define EXECBATCH_H
+
+#include "nodes/execnodes.h"
+
+/* Maximum number of rows a node returns per batch */
+#define EXEC_BATCH_SIZE		1024
+
+/*
+ * TupleBatch
+ *
+ * A set of rows returned by a node's ExecProcNodeBatch function.  As with a
+ * slot returned by ExecProcNode, the batch belongs to the node that returned
+ * it, and its rows remain valid only until the next call on that node.
+ *
+ * slots[] points to the rows; a node may fill it with pointers to its own
+ * slots in any order.  ownslots[], if not NULL, holds EXEC_BATCH_SIZE slots
+ * that were created along with the batch, for nodes that form new rows.
+ */
+typedef struct TupleBatch
+{
+	int			nrows;			/* number of valid entries in slots[] */
+	TupleTableSlot **slots;		/* the rows */
+	TupleTableSlot **ownslots;	/* slots owned by the batch, or NULL */
+} TupleBatch;
+
+/* A qual prepared for vectorized evaluation; private to execBatchQual.c */
+typedef struct BatchQual BatchQual;
+
+/* GUC variable */
+extern PGDLLIMPORT bool enable_batch_execution;
+
+extern TupleBatch *ExecInitTupleBatch(EState *estate, TupleDesc desc,
+									  const TupleTableSlotOps *tts_ops);
+extern bool ExecSupportsBatch(PlanState *node);
+extern TupleBatch *ExecProcNodeBatch(PlanState *node);
+extern TupleBatch *ExecProcNodeBatchRowMode(PlanState *node);
+extern int	ExecQualBatch(ExprState *qual, ExprContext *econtext,
+						  TupleTableSlot **slots, int nrows);
+extern void ExecProjectBatch(ProjectionInfo *projInfo, ExprContext *econtext,
+							 TupleTableSlot **inslots, int nrows,
+							 TupleTableSlot **outslots);
+extern int	ExecBatchLastScanAttr(List *exprs, Index varno, int natts);
+
+/* in execBatchQual.c */
+extern BatchQual *ExecInitBatchQual(List *qual, PlanState *parent,
+									Index scanrelid);
+extern int	ExecBatchQualEval(BatchQual *bq, ExprContext *econtext,
+							  TupleTableSlot **slots, int nrows);
+
+#endif							/* EXECBATCH_H */
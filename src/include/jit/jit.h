@@ -22,6 +22,7 @@
 #define PGJIT_INLINE   (1 << 2)
 #define PGJIT_EXPR	   (1 << 3)
 #define PGJIT_DEFORM   (1 << 4)
+#define PGJIT_CACHE	   (1 << 5)	/* code may be reused by later executions */
 
 
 typedef struct JitInstrumentation
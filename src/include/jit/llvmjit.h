@@ -55,6 +55,9 @@ typedef struct LLVMJitContext
 
 	/* list of handles for code emitted via Orc */
 	List	   *handles;
+
+	/* cache of code shared with other executions of the plan, or NULL */
+	struct LLVMJitCodeCache *cache;
 } LLVMJitContext;
 
 
@@ -97,6 +100,11 @@ extern void llvm_reset_after_error(void);
 extern void llvm_assert_in_fatal_section(void);
 
 extern LLVMJitContext *llvm_create_context(int jitFlags);
+struct PlannedStmt;
+extern void llvm_use_code_cache(LLVMJitContext *context,
+								struct PlannedStmt *stmt);
+extern const char *llvm_cache_function(LLVMJitContext *context,
+									   LLVMValueRef fn, List *helpers);
 extern LLVMModuleRef llvm_mutable_module(LLVMJitContext *context);
 extern char *llvm_expand_funcname(LLVMJitContext *context, const char *basename);
 extern void *llvm_get_function(LLVMJitContext *context, const char *funcname);
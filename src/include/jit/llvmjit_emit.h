@@ -126,6 +126,24 @@ l_load_gep1(LLVMBuilderRef b, LLVMValueRef v, LLVMValueRef idx, const char *name
 	return LLVMBuildLoad(b, v_ptr, name);
 }
 
+/*
+ * Load a member of type t at byte offset off from a struct, for members of
+ * structs that LLVM doesn't know the layout of (e.g. ExprEvalStep's union).
+ */
+static inline LLVMValueRef
+l_load_offset(LLVMBuilderRef b, LLVMValueRef v, size_t off, LLVMTypeRef t,
+			  const char *name)
+{
+	LLVMValueRef v_off = l_sizet_const(off);
+	LLVMValueRef v_ptr;
+
+	v_ptr = LLVMBuildBitCast(b, v, l_ptr(LLVMInt8Type()), "");
+	v_ptr = LLVMBuildGEP(b, v_ptr, &v_off, 1, "");
+	v_ptr = LLVMBuildBitCast(b, v_ptr, l_ptr(t), "");
+
+	return LLVMBuildLoad(b, v_ptr, name);
+}
+
 /* separate, because pg_attribute_printf(2, 3) can't appear in definition */
 static inline LLVMBasicBlockRef l_bb_before_v(LLVMBasicBlockRef r, const char *fmt,...) pg_attribute_printf(2, 3);
 
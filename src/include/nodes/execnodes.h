@@ -82,6 +82,7 @@ typedef struct ExprState
 	/*
 	 * Instructions to compute expression's return value.
 	 */
+#define FIELDNO_EXPRSTATE_STEPS 5
 	struct ExprEvalStep *steps;
 
 	/*
@@ -931,6 +932,17 @@ typedef struct DomainConstraintState
  */
 typedef TupleTableSlot *(*ExecProcNodeMtd) (struct PlanState *pstate);
 
+/* ----------------
+ *	 ExecProcNodeBatchMtd
+ *
+ * This is the method called by ExecProcNodeBatch to return the next batch
+ * of tuples from an executor node that supports batch mode (see
+ * execBatch.c).  It returns NULL if no more tuples are available.
+ * ----------------
+ */
+struct TupleBatch;
+typedef struct TupleBatch *(*ExecProcNodeBatchMtd) (struct PlanState *pstate);
+
 /* ----------------
  *		PlanState node
  *
@@ -951,6 +963,9 @@ typedef struct PlanState
 	ExecProcNodeMtd ExecProcNode;	/* function to return next tuple */
 	ExecProcNodeMtd ExecProcNodeReal;	/* actual function, if above is a
 										 * wrapper */
+	ExecProcNodeBatchMtd ExecProcNodeBatch; /* function to return next
+											 * batch, or NULL if batch mode
+											 * is not supported */
 
 	Instrumentation *instrument;	/* Optional runtime stats for this node */
 	WorkerInstrumentation *worker_instrument;	/* per-worker instrumentation */
@@ -981,6 +996,8 @@ typedef struct PlanState
 	 */
 	TupleDesc	ps_ResultTupleDesc; /* node's return type */
 	TupleTableSlot *ps_ResultTupleSlot; /* slot for my result tuples */
+	struct TupleBatch *ps_ResultBatch;	/* batch for my result tuples in
+										 * row-mode batches, if needed */
 	ExprContext *ps_ExprContext;	/* node's expression-evaluation context */
 	ProjectionInfo *ps_ProjInfo;	/* info for doing tuple projection */
 
@@ -1291,6 +1308,13 @@ typedef struct SeqScanState
 {
 	ScanState	ss;				/* its first field is NodeTag */
 	Size		pscan_len;		/* size of parallel heap scan descriptor */
+	/* batch mode state, set up on first use */
+	struct TupleBatch *batch;	/* batch returned by ExecSeqScanBatch */
+	TupleTableSlot **batch_scanslots;	/* slots scanned tuples go into */
+	int			batch_lastattr; /* attributes to deform for quals etc */
+	struct BatchQual *batch_qual;	/* vectorized form of qual, or NULL */
+	bool		batch_carry;	/* batch_scanslots[0] holds the first tuple
+								 * of the next batch? */
 } SeqScanState;
 
 /* ----------------
@@ -1952,6 +1976,47 @@ typedef struct SortState
 	SharedSortInfo *shared_info;	/* one entry per worker */
 } SortState;
 
+/* ----------------
+ *	 Instrumentation information for IncrementalSort
+ * ----------------
+ */
+typedef struct IncrementalSortInfo
+{
+	int64		groupCount;		/* number of batches sorted */
+	int64		maxDiskSpaceUsed;	/* peak disk usage of any batch, in kB */
+	int64		maxMemorySpaceUsed; /* peak memory usage of any batch, in kB */
+	bits32		sortMethods;	/* bitmask of TuplesortMethod values used */
+} IncrementalSortInfo;
+
+typedef enum
+{
+	INCSORT_LOADFULLSORT,
+	INCSORT_READFULLSORT
+} IncrementalSortExecutionStatus;
+
+/* ----------------
+ *	 IncrementalSortState information
+ *
+ *		Tuples are read from the outer plan in batches that end on a boundary
+ *		between groups of the presorted key columns; each batch is sorted on
+ *		the remaining columns and returned before the next one is read.
+ * ----------------
+ */
+typedef struct IncrementalSortState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	bool		bounded;		/* is the result set bounded? */
+	int64		bound;			/* if bounded, how many tuples are needed */
+	int64		bound_Done;		/* tuples already returned, if bounded */
+	bool		outerNodeDone;	/* finished fetching tuples from outer node */
+	IncrementalSortExecutionStatus execution_status;
+	Tuplesortstate *fullsort_state; /* private state of tuplesort.c */
+	ExprState  *presorted_eq;	/* equality test on the presorted columns */
+	TupleTableSlot *group_pivot;	/* tuple identifying the current group */
+	TupleTableSlot *transfer_tuple; /* first tuple of the next batch */
+	IncrementalSortInfo incsort_info;	/* instrumentation */
+} IncrementalSortState;
+
 /* ---------------------
  *	GroupState information
  * ---------------------
@@ -2027,11 +2092,43 @@ typedef struct AggState
 	AggStatePerGroup *hash_pergroup;	/* grouping set indexed array of
 										 * per-group pointers */
 
+	/* support for spilling hash tables to disk: */
+	MemoryContext hash_metacxt; /* memory for hash table itself */
+	struct HashTapeInfo *hash_tapeinfo; /* metadata for spill tapes */
+	struct HashAggSpill *hash_spills;	/* HashAggSpill for each grouping set,
+										 * exists only during first pass */
+	TupleTableSlot *hash_spill_slot;	/* for reading spill files */
+	List	   *hash_batches;	/* hash batches remaining to be processed */
+	bool		hash_ever_spilled;	/* ever spilled during this execution? */
+	bool		hash_spill_mode;	/* we hit a limit during the current batch
+									 * and we must not create new groups */
+	Size		hash_mem_limit; /* limit before spilling hash table */
+	uint64		hash_ngroups_limit; /* limit before spilling hash table */
+	int			hash_planned_partitions;	/* number of partitions planned
+											 * for first pass */
+	double		hashentrysize;	/* estimate revised during execution */
+	Size		hash_mem_peak;	/* peak hash table memory usage */
+	uint64		hash_ngroups_current;	/* number of groups currently in
+										 * memory in all hash tables */
+	uint64		hash_disk_used; /* kB of disk space used */
+	int			hash_batches_used;	/* batches used during entire execution */
+
 	/* support for evaluation of agg input expressions: */
-#define FIELDNO_AGGSTATE_ALL_PERGROUPS 34
+#define FIELDNO_AGGSTATE_ALL_PERGROUPS 49
 	AggStatePerGroup *all_pergroups;	/* array of first ->pergroups, than
 										 * ->hash_pergroup */
 	ProjectionInfo *combinedproj;	/* projection machinery */
+
+	/* support for fetching input rows in batch mode: */
+	bool		batch_input;	/* use ExecProcNodeBatch on outer plan? */
+	struct TupleBatch *input_batch; /* current input batch, or NULL */
+	int			input_batch_pos;	/* next row of input_batch to return */
+	bool		input_batch_done;	/* has outer plan returned NULL? */
+
+	/* support for Parallel HashAggregate: */
+	struct ParallelAggState *parallel_state;	/* shared state, or NULL */
+	struct SharedTuplestoreAccessor **partition_sts;	/* accessor for each
+														 * shared partition */
 } AggState;
 
 /* ----------------
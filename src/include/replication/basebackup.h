@@ -20,6 +20,24 @@
 #define MAX_RATE_LOWER	32
 #define MAX_RATE_UPPER	1048576
 
+/*
+ * In an incremental backup, a relation segment of which only some blocks
+ * have been modified is sent as a file named INCREMENTAL_PREFIX followed by
+ * the segment's file name.  It holds an IncrementalFileHeader, the numbers of
+ * the blocks it contains relative to the start of the segment in ascending
+ * order, and then the blocks themselves.  The blocks it doesn't contain are
+ * to be taken from the backup it is based on.
+ */
+#define INCREMENTAL_PREFIX		"INCREMENTAL."
+#define INCREMENTAL_MAGIC		0xd3ae1f0d
+
+typedef struct IncrementalFileHeader
+{
+	uint32		magic;
+	uint32		num_blocks;		/* number of blocks in the file */
+	uint32		truncation_block_length;	/* length of segment in blocks */
+} IncrementalFileHeader;
+
 
 typedef struct
 {
@@ -55,6 +55,12 @@ typedef struct LogicalDecodingContext
 	OutputPluginCallbacks callbacks;
 	OutputPluginOptions options;
 
+	/*
+	 * Does the output plugin support streaming of in-progress transactions,
+	 * and is it enabled?  The plugin's startup callback may turn this off.
+	 */
+	bool		streaming;
+
 	/*
 	 * User specified options
 	 */
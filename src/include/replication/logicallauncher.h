@@ -14,6 +14,7 @@
 
 extern int	max_logical_replication_workers;
 extern int	max_sync_workers_per_subscription;
+extern int	max_parallel_apply_workers_per_subscription;
 
 extern void ApplyLauncherRegister(void);
 extern void ApplyLauncherMain(Datum main_arg);
@@ -21,6 +22,9 @@ extern void ApplyLauncherMain(Datum main_arg);
 extern Size ApplyLauncherShmemSize(void);
 extern void ApplyLauncherShmemInit(void);
 
+extern Size ParallelApplyShmemSize(void);
+extern void ParallelApplyShmemInit(void);
+
 extern void ApplyLauncherWakeupAtCommit(void);
 extern bool XactManipulatesLogicalReplicationWorkers(void);
 extern void AtEOXact_ApplyLauncher(bool isCommit);
@@ -24,6 +24,17 @@ typedef struct LogicalRepRelMapEntry
 	AttrNumber *attrmap;		/* map of local attributes to remote ones */
 	bool		updatable;		/* Can apply updates/deletes? */
 
+	/*
+	 * Planned default expressions of the local columns that the publisher
+	 * doesn't send, filled by logicalrep_rel_load_defaults().
+	 */
+	bool		defaults_valid; /* are the fields below valid? */
+	MemoryContext defcxt;		/* context holding the expressions, or NULL */
+	int			num_defaults;	/* number of default expressions */
+	int		   *defmap;			/* local attribute offset of each */
+	Expr	  **defexprs;		/* the expressions */
+	bool		volatile_defaults;	/* any of them volatile (but nextval)? */
+
 	/* Sync state. */
 	char		state;
 	XLogRecPtr	statelsn;
@@ -35,6 +46,7 @@ extern LogicalRepRelMapEntry *logicalrep_rel_open(LogicalRepRelId remoteid,
 												  LOCKMODE lockmode);
 extern void logicalrep_rel_close(LogicalRepRelMapEntry *rel,
 								 LOCKMODE lockmode);
+extern void logicalrep_rel_load_defaults(LogicalRepRelMapEntry *entry);
 
 extern void logicalrep_typmap_update(LogicalRepTyp *remotetyp);
 extern char *logicalrep_typmap_gettypname(Oid remoteid);
@@ -25,6 +25,9 @@ typedef struct PGOutputData
 
 	List	   *publication_names;
 	List	   *publications;
+	bool		streaming;		/* stream large in-progress transactions? */
+
+	bool		in_streaming;	/* within a block of streamed changes? */
 } PGOutputData;
 
 #endif							/* PGOUTPUT_H */
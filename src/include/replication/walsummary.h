@@ -0,0 +1,69 @@
+/*-------------------------------------------------------------------------
+ *
+ * walsummary.h
+ *	  Tracking of modified blocks, and WAL summary files.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ *
+ * src/include/replication/walsummary.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef WALSUMMARY_H
+#define WALSUMMARY_H
+
+#include "access/xlogdefs.h"
+#include "nodes/pg_list.h"
+#include "storage/block.h"
+#include "storage/relfilenode.h"
+
+/* Directory holding WAL summary files, relative to the data directory */
+#define WAL_SUMMARY_DIR		"pg_wal/summaries"
+
+/*
+ * A WAL summary file, identified by the range of WAL it summarizes.  The
+ * range runs from the start of the first record summarized to the end of
+ * the last one.
+ */
+typedef struct WalSummaryFile
+{
+	TimeLineID	tli;
+	XLogRecPtr	start_lsn;
+	XLogRecPtr	end_lsn;
+} WalSummaryFile;
+
+/*
+ * A BlockRefTable records, for each relation fork, which blocks were
+ * modified, and the "limit block": the fork was created, dropped or
+ * truncated such that every block at or beyond the limit block must be
+ * regarded as modified.  A relation OID of InvalidOid stands for every
+ * relation in the database, which is how database creation is recorded.
+ */
+typedef struct BlockRefTable BlockRefTable;
+
+extern BlockRefTable *CreateBlockRefTable(void);
+extern void FreeBlockRefTable(BlockRefTable *brtab);
+extern bool BlockRefTableIsEmpty(BlockRefTable *brtab);
+extern void BlockRefTableMarkBlockModified(BlockRefTable *brtab,
+										   const RelFileNode *rnode,
+										   ForkNumber forknum,
+										   BlockNumber blknum);
+extern void BlockRefTableSetLimitBlock(BlockRefTable *brtab,
+									   const RelFileNode *rnode,
+									   ForkNumber forknum,
+									   BlockNumber limit_block);
+extern int	BlockRefTableGetModifiedBlocks(BlockRefTable *brtab,
+										   const RelFileNode *rnode,
+										   ForkNumber forknum,
+										   BlockNumber start_blkno,
+										   BlockNumber stop_blkno,
+										   BlockNumber *blocks);
+
+extern void WriteWalSummary(BlockRefTable *brtab, TimeLineID tli,
+							XLogRecPtr start_lsn, XLogRecPtr end_lsn);
+extern void ReadWalSummary(BlockRefTable *brtab, WalSummaryFile *ws);
+extern List *GetWalSummaries(TimeLineID tli, XLogRecPtr start_lsn,
+							 XLogRecPtr end_lsn);
+extern void RemoveOldWalSummaries(int keep_minutes);
+
+#endif							/* WALSUMMARY_H */
@@ -17,6 +17,9 @@
 #include "access/xlogdefs.h"
 #include "catalog/pg_subscription.h"
 #include "datatype/timestamp.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "storage/dsm.h"
 #include "storage/lock.h"
 
 typedef struct LogicalRepWorker
@@ -42,6 +45,12 @@ typedef struct LogicalRepWorker
 	/* Subscription id for the worker. */
 	Oid			subid;
 
+	/*
+	 * PID of the apply worker that launched this parallel apply worker, or
+	 * InvalidPid if this is not a parallel apply worker.
+	 */
+	pid_t		leader_pid;
+
 	/* Used for initial table synchronization. */
 	Oid			relid;
 	char		relstate;
@@ -64,27 +73,47 @@ extern struct WalReceiverConn *wrconn;
 
 /* Worker and subscription objects. */
 extern Subscription *MySubscription;
+extern bool MySubscriptionValid;
 extern LogicalRepWorker *MyLogicalRepWorker;
 
 extern bool in_remote_transaction;
 
+/* Memory context for the message currently being applied. */
+extern MemoryContext ApplyMessageContext;
+
 extern void logicalrep_worker_attach(int slot);
 extern LogicalRepWorker *logicalrep_worker_find(Oid subid, Oid relid,
 												bool only_running);
 extern List *logicalrep_workers_find(Oid subid, bool only_running);
-extern void logicalrep_worker_launch(Oid dbid, Oid subid, const char *subname,
-									 Oid userid, Oid relid);
+extern bool logicalrep_worker_launch(Oid dbid, Oid subid, const char *subname,
+									 Oid userid, Oid relid,
+									 dsm_handle subworker_dsm);
 extern void logicalrep_worker_stop(Oid subid, Oid relid);
 extern void logicalrep_worker_stop_at_commit(Oid subid, Oid relid);
 extern void logicalrep_worker_wakeup(Oid subid, Oid relid);
 extern void logicalrep_worker_wakeup_ptr(LogicalRepWorker *worker);
 
 extern int	logicalrep_sync_worker_count(Oid subid);
+extern int	logicalrep_parallel_apply_worker_count(Oid subid);
 
 extern char *LogicalRepSyncTableStart(XLogRecPtr *origin_startpos);
 void		process_syncing_tables(XLogRecPtr current_lsn);
 void		invalidate_syncing_table_states(Datum arg, int cacheid,
 											uint32 hashvalue);
+extern bool AllTablesyncsReady(void);
+
+extern void apply_dispatch(StringInfo s);
+extern void store_flush_position(XLogRecPtr remote_lsn, XLogRecPtr local_lsn);
+extern void maybe_reread_subscription(void);
+extern void subscription_change_cb(Datum arg, int cacheid, uint32 hashvalue);
+
+/* Parallel apply, see applyparallelworker.c */
+extern bool pa_forward_message(StringInfo s, bool in_streamed_transaction);
+extern void pa_process_worker_states(void);
+extern void pa_wait_for_all(void);
+extern bool pa_transactions_in_flight(void);
+extern void pa_wait_for_commit_turn(void);
+extern void pa_report_commit(XLogRecPtr remote_end, XLogRecPtr local_end);
 
 static inline bool
 am_tablesync_worker(void)
@@ -92,4 +121,10 @@ am_tablesync_worker(void)
 	return OidIsValid(MyLogicalRepWorker->relid);
 }
 
+static inline bool
+am_parallel_apply_worker(void)
+{
+	return MyLogicalRepWorker->leader_pid != InvalidPid;
+}
+
 #endif							/* WORKER_INTERNAL_H */
@@ -0,0 +1,61 @@
+/*-------------------------------------------------------------------------
+ *
+ * aio.h
+ *	  Asynchronous I/O for shared buffers.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/storage/aio.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef AIO_H
+#define AIO_H
+
+#include "storage/block.h"
+#include "storage/buf.h"
+#include "storage/relfilenode.h"
+
+/*
+ * Supported values of the io_method GUC.
+ */
+typedef enum IoMethod
+{
+	IO_METHOD_SYNC,				/* issue all I/O synchronously */
+	IO_METHOD_WORKER			/* hand I/O off to io worker processes */
+} IoMethod;
+
+/*
+ * A handle identifies an I/O request whose completion the submitter is going
+ * to wait for.  Fire-and-forget requests (reads used as prefetches) do not
+ * get a handle.
+ */
+typedef int PgAioHandle;
+
+#define InvalidPgAioHandle	(-1)
+
+/* GUC variables */
+extern int	io_method;
+extern int	io_workers;
+extern int	io_max_concurrency;
+
+/* aio.c */
+extern Size AioShmemSize(void);
+extern void AioShmemInit(void);
+
+extern int	pgaio_readahead_distance(bool use_ring);
+extern bool pgaio_submit_read(RelFileNode rnode, char relpersistence,
+							  ForkNumber forknum, BlockNumber blocknum,
+							  BufferAccessStrategy strategy);
+extern PgAioHandle pgaio_submit_write(int buf_id);
+extern bool pgaio_wait(PgAioHandle handle, int *result);
+extern void pgaio_release_all_handles(void);
+extern void pgaio_forget_relfilenodes(const RelFileNode *rnodes, int nnodes);
+extern void pgaio_forget_database(Oid dbid);
+
+/* aio_worker.c */
+extern void AioWorkersRegister(void);
+extern void IoWorkerMain(Datum main_arg);
+
+#endif							/* AIO_H */
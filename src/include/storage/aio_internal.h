@@ -0,0 +1,48 @@
+/*-------------------------------------------------------------------------
+ *
+ * aio_internal.h
+ *	  Internal declarations shared by the asynchronous I/O modules.
+ *
+ * Portions Copyright (c) 1996-2019, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/storage/aio_internal.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef AIO_INTERNAL_H
+#define AIO_INTERNAL_H
+
+#include "storage/aio.h"
+
+/*
+ * Kinds of I/O that can be queued.
+ */
+typedef enum PgAioOp
+{
+	PGAIO_OP_READ,				/* read a block into shared buffers */
+	PGAIO_OP_WRITE				/* write out a dirty shared buffer */
+} PgAioOp;
+
+/*
+ * The parameters of a request, as handed to the process executing it.
+ */
+typedef struct PgAioRequestData
+{
+	PgAioOp		op;
+	int			ring_owner;		/* read: pid of the submitter if it reads
+								 * through a buffer ring, else 0 */
+	uint64		ring_id;		/* read: identifies the submitter's ring */
+	char		relpersistence; /* read: persistence of the relation */
+	RelFileNode rnode;			/* read: block to read */
+	ForkNumber	forknum;
+	BlockNumber blocknum;
+	int			buf_id;			/* write: buffer to write */
+} PgAioRequestData;
+
+/* aio.c, for use by io workers */
+extern void pgaio_worker_attach(void);
+extern int	pgaio_worker_dequeue(PgAioRequestData *req, bool wait);
+extern void pgaio_worker_complete(int idx, bool failed, int result);
+
+#endif							/* AIO_INTERNAL_H */
@@ -304,6 +304,10 @@ extern CkptSortItem *CkptBufferIds;
 extern void WritebackContextInit(WritebackContext *context, int *max_pending);
 extern void IssuePendingWritebacks(WritebackContext *context);
 extern void ScheduleBufferTagForWriteback(WritebackContext *context, BufferTag *tag);
+extern void ReadBufferForAio(RelFileNode rnode, char relpersistence,
+							 ForkNumber forkNum, BlockNumber blockNum,
+							 BufferAccessStrategy strategy);
+extern int	WriteBufferForAio(int buf_id, WritebackContext *wb_context);
 
 /* freelist.c */
 extern BufferDesc *StrategyGetBuffer(BufferAccessStrategy strategy,
@@ -324,6 +328,8 @@ extern Size BufTableShmemSize(int size);
 extern void InitBufTable(int size);
 extern uint32 BufTableHashCode(BufferTag *tagPtr);
 extern int	BufTableLookup(BufferTag *tagPtr, uint32 hashcode);
+extern bool BufTableLookupOptimistic(BufferTag *tagPtr, uint32 hashcode,
+									 int *buf_id);
 extern int	BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id);
 extern void BufTableDelete(BufferTag *tagPtr, uint32 hashcode);
 
@@ -158,12 +158,22 @@ extern PGDLLIMPORT int32 *LocalRefCount;
  */
 #define BufferGetPage(buffer) ((Page)BufferGetBlock(buffer))
 
+/* forward declared, to avoid having to expose smgr.h here */
+struct SMgrRelationData;
+
 /*
  * prototypes for functions in bufmgr.c
  */
 extern bool ComputeIoConcurrency(int io_concurrency, double *target);
 extern void PrefetchBuffer(Relation reln, ForkNumber forkNum,
 						   BlockNumber blockNum);
+extern void PrefetchBufferExtended(Relation reln, ForkNumber forkNum,
+								   BlockNumber blockNum,
+								   BufferAccessStrategy strategy);
+extern bool PrefetchSharedBuffer(struct SMgrRelationData *smgr_reln,
+								 char relpersistence, ForkNumber forkNum,
+								 BlockNumber blockNum,
+								 BufferAccessStrategy strategy);
 extern Buffer ReadBuffer(Relation reln, BlockNumber blockNum);
 extern Buffer ReadBufferExtended(Relation reln, ForkNumber forkNum,
 								 BlockNumber blockNum, ReadBufferMode mode,
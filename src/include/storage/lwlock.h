@@ -202,6 +202,10 @@ typedef enum BuiltinTrancheIds
 	LWTRANCHE_MXACTMEMBER_BUFFERS,
 	LWTRANCHE_ASYNC_BUFFERS,
 	LWTRANCHE_OLDSERXID_BUFFERS,
+	LWTRANCHE_CLOG_BANKS,
+	LWTRANCHE_SUBTRANS_BANKS,
+	LWTRANCHE_MXACTOFFSET_BANKS,
+	LWTRANCHE_MXACTMEMBER_BANKS,
 	LWTRANCHE_WAL_INSERT,
 	LWTRANCHE_BUFFER_CONTENT,
 	LWTRANCHE_BUFFER_IO_IN_PROGRESS,
@@ -220,6 +224,10 @@ typedef enum BuiltinTrancheIds
 	LWTRANCHE_TBM,
 	LWTRANCHE_PARALLEL_APPEND,
 	LWTRANCHE_SXACT,
+	LWTRANCHE_STATS_DSA,
+	LWTRANCHE_STATS_DB,
+	LWTRANCHE_STATS_TABLE,
+	LWTRANCHE_STATS_FUNCTION,
 	LWTRANCHE_FIRST_USER_DEFINED
 }			BuiltinTrancheIds;
 
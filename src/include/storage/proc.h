@@ -108,6 +108,9 @@ struct PGPROC
 								 * else InvalidLocalTransactionId */
 	int			pid;			/* Backend's process ID; 0 if prepared xact */
 	int			pgprocno;
+	int			pgxactoff;		/* index into ProcGlobal->xids, which is this
+								 * proc's position in the ProcArray; -1 if not
+								 * in the ProcArray */
 
 	/* These fields are zero while a backend is still starting up: */
 	BackendId	backendId;		/* This backend's backend ID (if assigned) */
@@ -247,6 +250,14 @@ typedef struct PROC_HDR
 	PGPROC	   *allProcs;
 	/* Array of PGXACT structures (not including dummies for prepared txns) */
 	PGXACT	   *allPgXact;
+
+	/*
+	 * Copy of PGXACT.xid for every proc in the ProcArray, in ProcArray order
+	 * (see PGPROC.pgxactoff), so that the running XIDs can be scanned without
+	 * touching each PGXACT.  Protected like PGXACT.xid; in addition, entries
+	 * only move while both ProcArrayLock and XidGenLock are held exclusively.
+	 */
+	TransactionId *xids;
 	/* Length of allProcs array */
 	uint32		allProcCount;
 	/* Head of list of free PGPROC structures */
@@ -132,6 +132,9 @@ get_altertable_subcmdtypes(PG_FUNCTION_ARGS)
 			case AT_SetStorage:
 				strtype = "SET STORAGE";
 				break;
+			case AT_SetCompression:
+				strtype = "SET COMPRESSION";
+				break;
 			case AT_DropColumn:
 				strtype = "DROP COLUMN";
 				break;
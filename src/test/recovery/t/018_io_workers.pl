@@ -0,0 +1,111 @@
+# Test asynchronous I/O with io_method = worker: reads queued by scans,
+# buffer writes handed off by the checkpointer, and an io worker failing a
+# read that its submitter then performs itself.
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 8;
+
+my $node = get_new_node('main');
+$node->init;
+
+# Keep shared_buffers small, so that the large table is scanned through a
+# buffer ring and most of its pages have to be read back from disk.
+$node->append_conf(
+	'postgresql.conf', qq(
+io_method = worker
+io_workers = 2
+effective_io_concurrency = 16
+shared_buffers = 1MB
+autovacuum = off
+));
+$node->start;
+
+is( $node->safe_psql(
+		'postgres',
+		"SELECT count(*) FROM pg_stat_activity WHERE backend_type = 'io worker'"),
+	'2',
+	'io workers are running');
+
+# Reads: sequential scans read ahead through the io workers, two of them
+# at the same time so that their buffer rings are in use concurrently.
+$node->safe_psql(
+	'postgres', qq(
+CREATE TABLE big (a int, b text);
+INSERT INTO big SELECT g, md5(g::text) FROM generate_series(1, 100000) g;
+CREATE TABLE big2 AS SELECT * FROM big;
+));
+my $expected = '100000|5000050000';
+$node->restart;
+
+my ($bg_stdout, $bg_stderr) = ('', '');
+my $bg = IPC::Run::start(
+	[
+		'psql', '-XAtq', '-d', $node->connstr('postgres'),
+		'-c', 'SELECT count(*), sum(a) FROM big2'
+	],
+	'>', \$bg_stdout, '2>', \$bg_stderr);
+is($node->safe_psql('postgres', 'SELECT count(*), sum(a) FROM big'),
+	$expected, 'sequential scan with io workers returns all rows');
+$bg->finish;
+chomp($bg_stdout);
+is($bg_stdout, $expected, 'concurrent scan with io workers returns all rows');
+
+# Writes: the checkpointer hands its writes to the io workers.  After an
+# immediate shutdown, recovery starts from the checkpoint, so anything the
+# io workers failed to write would be lost.
+$node->safe_psql(
+	'postgres', qq(
+UPDATE big SET b = 'updated' WHERE a % 3 = 0;
+CHECKPOINT;
+));
+$node->stop('immediate');
+$node->start;
+is( $node->safe_psql(
+		'postgres',
+		"SELECT count(*) FROM big WHERE b = 'updated'"),
+	'33333',
+	'buffers written by io workers survive an immediate restart');
+
+# A failed read: corrupt the header of one page of a small table, then scan
+# the table with zero_damaged_pages on.  The io worker reading the page
+# ahead of the scan doesn't zero it, so it fails the read, and the scan must
+# read the page itself.  The scan sleeps on each row, to be sure that the
+# io worker gets to the damaged page first.
+$node->safe_psql(
+	'postgres', qq(
+CREATE TABLE damaged (a int, b text);
+INSERT INTO damaged SELECT g, repeat('x', 1000) FROM generate_series(1, 140) g;
+));
+my $blocksize = $node->safe_psql('postgres', 'SHOW block_size');
+my $file = $node->safe_psql('postgres',
+	"SELECT pg_relation_filepath('damaged')");
+my $on_page = $node->safe_psql('postgres',
+	"SELECT count(*) FROM damaged WHERE (ctid::text::point)[0] = 10");
+$node->stop;
+
+open(my $fh, '+<:raw', $node->data_dir . '/' . $file)
+  or die "could not open $file: $!";
+seek($fh, 10 * $blocksize, 0) or die "could not seek in $file: $!";
+print $fh "\xff" x 24;
+close($fh);
+
+$node->start;
+my ($ret, $stdout, $stderr) = $node->psql(
+	'postgres', qq(
+SET zero_damaged_pages = on;
+SELECT count(pg_sleep(0.01)) FROM damaged;
+));
+is($ret, 0, 'scan of damaged table succeeds');
+is($stdout, 140 - $on_page, 'damaged page was zeroed by the scan');
+like(
+	$stderr,
+	qr/invalid page in block 10 of relation .*; zeroing out page/,
+	'scan read the damaged page itself');
+like(
+	slurp_file($node->logfile),
+	qr/ERROR:  invalid page in block 10 of relation/,
+	'io worker failed to read the damaged page');
+
+$node->stop;
@@ -0,0 +1,66 @@
+# Test prefetching of the blocks referenced by WAL during recovery, both in
+# crash recovery and on a streaming standby.
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 3;
+
+# Without full-page writes, the records modifying a block after a checkpoint
+# don't carry an image of it, so replay has to read the block.  Keep
+# shared_buffers small, so that most blocks have to be read from disk.
+my $node_primary = get_new_node('primary');
+$node_primary->init(allows_streaming => 1);
+$node_primary->append_conf(
+	'postgresql.conf', qq(
+full_page_writes = off
+max_recovery_prefetch_distance = 256kB
+shared_buffers = 1MB
+autovacuum = off
+log_min_messages = debug1
+));
+$node_primary->start;
+
+$node_primary->backup('my_backup');
+
+# The standby passes the blocks to prefetch to io workers.
+my $node_standby = get_new_node('standby');
+$node_standby->init_from_backup($node_primary, 'my_backup',
+	has_streaming => 1);
+$node_standby->append_conf('postgresql.conf', 'io_method = worker');
+$node_standby->start;
+
+$node_primary->safe_psql(
+	'postgres', qq(
+CREATE TABLE prefetch_tab (id int, val int, pad text) WITH (fillfactor = 50);
+INSERT INTO prefetch_tab SELECT g, 0, repeat('x', 200) FROM generate_series(1, 20000) g;
+CHECKPOINT;
+));
+
+# Updates spread over the whole table, so that the records reference blocks
+# all over it.
+$node_primary->safe_psql('postgres',
+	"UPDATE prefetch_tab SET val = id % 7 WHERE id % 5 = 0");
+
+my $query = "SELECT count(*), sum(val) FROM prefetch_tab WHERE val > 0";
+my $expected = $node_primary->safe_psql('postgres', $query);
+
+# Standby: replay the updates as they are streamed.
+$node_primary->wait_for_catchup($node_standby, 'replay',
+	$node_primary->lsn('insert'));
+is($node_standby->safe_psql('postgres', $query),
+	$expected, 'standby replayed the updates with prefetching');
+
+# Crash recovery: replay the updates from the last checkpoint, with nothing
+# in shared buffers.
+$node_primary->stop('immediate');
+$node_primary->start;
+is($node_primary->safe_psql('postgres', $query),
+	$expected, 'crash recovery replayed the updates with prefetching');
+like(
+	slurp_file($node_primary->logfile),
+	qr/recovery prefetch: [1-9][0-9]* blocks prefetched/,
+	'crash recovery prefetched blocks');
+
+$node_standby->stop;
+$node_primary->stop;
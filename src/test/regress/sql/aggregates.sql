@@ -1017,3 +1017,102 @@ select v||'a', case when v||'a' = 'aa' then 1 else 0 end, count(*)
 explain (costs off)
   select 1 from tenk1
    where (hundred, thousand) in (select twothousand, twothousand from onek);
+
+--
+-- Hash Aggregation Spill tests
+--
+
+create table agg_data as select g from generate_series(0, 19999) g;
+analyze agg_data;
+
+set work_mem = '64kB';
+
+-- produce results with hashing, forcing the hash table to spill
+set enable_hashagg = true;
+set enable_sort = false;
+
+create table agg_hash_1 as
+select g % 10000 as c1, sum(g::numeric) as c2, count(*) as c3
+  from agg_data group by g % 10000;
+
+create table agg_hash_2 as
+select g % 100 as c1, array_agg(g % 10) as c2
+  from agg_data group by g % 100;
+
+-- produce results with sorting
+set enable_hashagg = false;
+set enable_sort = true;
+
+create table agg_group_1 as
+select g % 10000 as c1, sum(g::numeric) as c2, count(*) as c3
+  from agg_data group by g % 10000;
+
+create table agg_group_2 as
+select g % 100 as c1, array_agg(g % 10) as c2
+  from agg_data group by g % 100;
+
+reset enable_hashagg;
+reset enable_sort;
+reset work_mem;
+
+-- the results must be the same
+(select * from agg_hash_1 except select * from agg_group_1)
+  union all
+(select * from agg_group_1 except select * from agg_hash_1);
+
+select c1, array_length(c2, 1) from agg_hash_2
+  except
+select c1, array_length(c2, 1) from agg_group_2;
+
+select count(*) from agg_hash_1;
+
+drop table agg_data;
+drop table agg_hash_1;
+drop table agg_hash_2;
+drop table agg_group_1;
+drop table agg_group_2;
+
+--
+-- Test aggregation over scans running in batch mode
+--
+
+create temp table batch_data as
+select i as a, 'row ' || i as b,
+       case when i % 10 = 0 then null else i * 2 end as c
+  from generate_series(1, 5000) i;
+
+set enable_batch_execution = on;
+
+select count(*), sum(a), count(c), sum(c), max(length(b)) from batch_data;
+select count(*), sum(a) from batch_data where a % 7 = 0 and c is not null;
+select a % 3 as g, count(*), sum(c) from batch_data group by 1 order by 1;
+
+-- with a dropped column, the scan has to project
+alter table batch_data drop column b;
+select count(*), sum(a + c) from batch_data where a > 4000;
+select count(*), sum(a) from batch_data where a % 7 = 0 and c is not null;
+
+-- simple comparisons with constants are evaluated vectorized
+select count(*), sum(c) from batch_data where c >= 9000;
+select count(*) from batch_data where 10 > a;
+select count(*), sum(a) from batch_data where a > 4000 and a % 3 = 0 and c <> 8004;
+
+create temp table batch_types as
+select i::int2 as s, i::int8 * 1000000000 as l,
+       case when i % 100 = 0 then 'NaN'::float8 else i / 4.0 end as f,
+       date '2019-01-01' + i as d,
+       timestamptz '2019-01-01 00:00+00' + i * interval '1 hour' as t
+  from generate_series(1, 3000) i;
+select count(*) from batch_types where s > 1000 and s <= 2000::int8;
+select count(*), min(l), max(l) from batch_types
+  where l >= 2500000000000 and l < 2600000000000;
+select count(*) from batch_types where l > 10;
+select count(*) from batch_types where f > 700;
+select count(*) from batch_types where f = 'NaN';
+select count(*), sum(f) from batch_types where f < 10 and f >= 2.5;
+select count(*) from batch_types where d between '2019-02-01' and '2019-02-28';
+select count(*) from batch_types where t < '2019-01-02 00:00+00';
+
+reset enable_batch_execution;
+drop table batch_data;
+drop table batch_types;
@@ -1463,6 +1463,21 @@ select reltoastrelid <> 0 as has_toast_table
 from pg_class
 where oid = 'test_storage'::regclass;
 
+-- SET COMPRESSION only affects values compressed later
+create table test_compression (a text, b int);
+alter table test_compression alter a set compression pglz;
+select attcompression from pg_attribute
+where attrelid = 'test_compression'::regclass and attname = 'a';
+alter table test_compression alter b set compression pglz; -- fails
+alter table test_compression alter a set compression foo; -- fails
+insert into test_compression values (repeat('1234567890', 1000), 1);
+select pg_column_compression(a), pg_column_compression(b) from test_compression;
+alter table test_compression alter a set compression default;
+select attcompression = '' as is_default from pg_attribute
+where attrelid = 'test_compression'::regclass and attname = 'a';
+select pg_column_compression(a) from test_compression;
+drop table test_compression;
+
 -- ALTER COLUMN TYPE with a check constraint and a child table (bug #13779)
 CREATE TABLE test_inh_check (a float check (a > 10.2), b float);
 CREATE TABLE test_inh_check_child() INHERITS(test_inh_check);
@@ -140,3 +140,32 @@ VACUUM delete_test_table;
 -- The vacuum above should've turned the leaf page into a fast root. We just
 -- need to insert some rows to cause the fast root page to split.
 INSERT INTO delete_test_table SELECT i, 1, 2, 3 FROM generate_series(1,1000) i;
+
+--
+-- Test deduplication within a leaf page, and the deduplicate_items
+-- storage parameter
+--
+CREATE TABLE dedup_test (a int, b text);
+CREATE INDEX dedup_test_a_idx ON dedup_test (a);
+CREATE INDEX dedup_test_b_idx ON dedup_test (b) WITH (deduplicate_items = off);
+select reloptions from pg_class WHERE oid = 'dedup_test_b_idx'::regclass;
+ALTER INDEX dedup_test_b_idx SET (deduplicate_items = on);
+select reloptions from pg_class WHERE oid = 'dedup_test_b_idx'::regclass;
+-- Fail while setting improper value
+ALTER INDEX dedup_test_b_idx SET (deduplicate_items = 'string');
+-- Insert enough duplicates to deduplicate leaf pages, and to split posting
+-- lists in passing
+INSERT INTO dedup_test SELECT i % 10, 'value' || (i % 10) FROM generate_series(1, 5000) i;
+INSERT INTO dedup_test SELECT i % 10, 'value' || (i % 10) FROM generate_series(1, 5000) i;
+DELETE FROM dedup_test WHERE a = 3;
+VACUUM dedup_test;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SELECT count(*) FROM dedup_test WHERE a = 5;
+SELECT count(*) FROM dedup_test WHERE a = 3;
+SELECT count(*) FROM dedup_test WHERE b = 'value7';
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+REINDEX INDEX dedup_test_a_idx;
+SELECT count(*) FROM dedup_test WHERE a BETWEEN 4 AND 6;
+DROP TABLE dedup_test;
@@ -0,0 +1,39 @@
+--
+-- COMPRESSION
+--
+-- Tests for per-column TOAST compression methods.  lz4 is only available in
+-- builds configured --with-lz4; compression_1.out is the expected output for
+-- builds without it.
+--
+
+create table cmdata (f1 text);
+alter table cmdata alter f1 set compression lz4;
+select attcompression from pg_attribute
+where attrelid = 'cmdata'::regclass and attname = 'f1';
+
+-- a compressible value is compressed and kept inline
+insert into cmdata values (repeat('1234567890', 1000));
+select pg_column_compression(f1), length(f1), substr(f1, 200, 5) from cmdata;
+select f1 = repeat('1234567890', 1000) as same from cmdata;
+select pg_relation_size(reltoastrelid) as toast_size from pg_class
+where oid = 'cmdata'::regclass;
+
+-- a value that is still too large once compressed is stored externally
+create function large_val() returns text language sql as
+'select array_agg(md5(g::text))::text from generate_series(1, 256) g';
+create table cmdata2 (f1 text);
+alter table cmdata2 alter f1 set compression lz4;
+insert into cmdata2 select large_val() || repeat('a', 4000);
+select pg_column_compression(f1), length(f1), substr(f1, 200, 5) from cmdata2;
+select f1 = large_val() || repeat('a', 4000) as same from cmdata2;
+select pg_relation_size(reltoastrelid) > 0 as toasted from pg_class
+where oid = 'cmdata2'::regclass;
+
+-- values already stored keep their method when the column's method changes
+alter table cmdata alter f1 set compression pglz;
+insert into cmdata values (repeat('123456789', 1000));
+select pg_column_compression(f1), length(f1) from cmdata order by length(f1);
+
+drop table cmdata;
+drop table cmdata2;
+drop function large_val();
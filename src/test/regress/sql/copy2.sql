@@ -440,6 +440,27 @@ test1
 SELECT * FROM instead_of_insert_tbl;
 COMMIT;
 
+-- Test parallel COPY FROM
+CREATE TABLE parallel_copy_tbl (a int PRIMARY KEY, b text, c int DEFAULT 42);
+COPY parallel_copy_tbl (a, b) FROM stdin WITH (PARALLEL 2);
+1	one
+2	two
+3	three
+\.
+COPY parallel_copy_tbl FROM stdin WITH (FORMAT csv, HEADER, PARALLEL 2);
+a,b,c
+4,"four, 4",4
+5,five,5
+\.
+SELECT * FROM parallel_copy_tbl ORDER BY a;
+COPY parallel_copy_tbl FROM stdin WITH (FORMAT binary, PARALLEL 2);
+COPY parallel_copy_tbl TO stdout WITH (PARALLEL 2);
+CREATE TEMP TABLE parallel_copy_temp (a int);
+COPY parallel_copy_temp FROM stdin WITH (PARALLEL 2);
+1
+\.
+SELECT * FROM parallel_copy_temp;
+
 -- clean up
 DROP TABLE forcetest;
 DROP TABLE vistest;
@@ -454,3 +475,4 @@ DROP TABLE instead_of_insert_tbl;
 DROP VIEW instead_of_insert_tbl_view;
 DROP VIEW instead_of_insert_tbl_view_2;
 DROP FUNCTION fun_instead_of_insert_tbl();
+DROP TABLE parallel_copy_tbl;
@@ -0,0 +1,61 @@
+--
+-- INCREMENTAL SORT
+--
+
+-- When we have to sort the entire table, incremental sort will
+-- be slower than plain sort, so it should not be used.
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten;
+
+-- When there is a LIMIT clause, incremental sort is beneficial because
+-- it only has to sort some of the groups, and not the entire table.
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten
+limit 1;
+
+-- When work_mem is not enough to sort the entire table, incremental sort
+-- may be faster if individual groups still fit into work_mem.
+set work_mem to '2MB';
+explain (costs off)
+select * from (select * from tenk1 order by four) t order by four, ten;
+reset work_mem;
+
+-- Many small groups: the executor sorts them in batches.
+create table incsort_t (a int, b int);
+insert into incsort_t select i % 100, i from generate_series(1, 1000) i;
+analyze incsort_t;
+
+explain (costs off)
+select * from (select * from incsort_t order by a) s order by a, b;
+
+-- The output must be ordered by both columns.
+select count(*) as rows,
+       count(*) filter (where (pa, pb) > (a, b)) as out_of_order
+from (select a, b, lag(a) over () as pa, lag(b) over () as pb
+      from (select * from (select * from incsort_t order by a) s
+            order by a, b) x) y;
+
+-- Bounded sort crossing a group boundary.
+explain (costs off)
+select * from (select * from incsort_t order by a) s order by a, b limit 12;
+select * from (select * from incsort_t order by a) s order by a, b limit 12;
+
+-- Large groups, spanning several minimum-size batches.
+select count(*) as rows,
+       count(*) filter (where (pa, pb) > (four, ten)) as out_of_order
+from (select four, ten, lag(four) over () as pa, lag(ten) over () as pb
+      from (select * from (select * from tenk1 order by four) t
+            order by four, ten limit 5000) x) y;
+
+-- Correlated subquery, evaluated once per outer row.
+select i, (select b from (select * from (select * from incsort_t order by a) s
+                          where a = i order by a, b limit 1) x)
+from generate_series(1, 3) i;
+
+-- Disabling incremental sort falls back to a full sort.
+set enable_incrementalsort = off;
+explain (costs off)
+select * from (select * from incsort_t order by a) s order by a, b;
+reset enable_incrementalsort;
+
+drop table incsort_t;
@@ -0,0 +1,50 @@
+--
+-- JIT compilation
+--
+-- Code generated for the expressions of a generic plan is reused by later
+-- executions of the plan.  The checks of the number of functions generated
+-- pass trivially if the server doesn't support JIT compilation.
+--
+
+CREATE TABLE jit_tab (a int, b int, c text);
+INSERT INTO jit_tab SELECT g, g % 10, 'row ' || g FROM generate_series(1, 1000) g;
+ANALYZE jit_tab;
+
+SET jit = on;
+SET jit_above_cost = 0;
+SET max_parallel_workers_per_gather = 0;
+SET plan_cache_mode = force_generic_plan;
+
+-- number of functions generated for a query, according to EXPLAIN
+CREATE FUNCTION jit_functions(query text) RETURNS int LANGUAGE plpgsql AS $$
+DECLARE
+  plan json;
+BEGIN
+  EXECUTE 'EXPLAIN (ANALYZE, FORMAT JSON) ' || query INTO plan;
+  RETURN coalesce((plan->0->'JIT'->>'Functions')::int, 0);
+END
+$$;
+
+PREPARE jit_q(int) AS
+  SELECT b, count(*), sum(a), max(c COLLATE "C")
+  FROM jit_tab WHERE a > $1 GROUP BY b ORDER BY b;
+
+-- the first execution generates the code
+SELECT jit_functions('EXECUTE jit_q(0)') AS first_functions \gset
+SELECT NOT pg_jit_available() OR :first_functions > 0 AS generated;
+
+-- the later ones reuse it
+EXECUTE jit_q(0);
+EXECUTE jit_q(500);
+EXECUTE jit_q(990);
+SELECT NOT pg_jit_available() OR
+  jit_functions('EXECUTE jit_q(100)') < :first_functions AS reused;
+EXECUTE jit_q(500);
+
+DEALLOCATE jit_q;
+DROP FUNCTION jit_functions(text);
+DROP TABLE jit_tab;
+RESET jit;
+RESET jit_above_cost;
+RESET max_parallel_workers_per_gather;
+RESET plan_cache_mode;
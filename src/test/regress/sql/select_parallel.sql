@@ -304,6 +304,24 @@ reset enable_material;
 
 reset enable_hashagg;
 
+-- test parallel hash aggregation, finalizing partitions in the workers
+set enable_sort = false;
+
+explain (costs off)
+   select fivethous, count(*) from tenk1 group by fivethous;
+
+select count(*), sum(c) from
+  (select fivethous, count(*) as c from tenk1 group by fivethous) ss;
+
+-- and with partitions that don't fit in work_mem
+set work_mem = '64kB';
+
+select count(*), sum(c) from
+  (select fivethous, count(*) as c from tenk1 group by fivethous) ss;
+
+reset work_mem;
+reset enable_sort;
+
 -- check parallelized int8 aggregate (bug #14897)
 explain (costs off)
 select avg(unique1::int8) from tenk1;
@@ -96,6 +96,22 @@ ALTER SUBSCRIPTION regress_testsub_foo SET (synchronous_commit = foobar);
 -- rename back to keep the rest simple
 ALTER SUBSCRIPTION regress_testsub_foo RENAME TO regress_testsub;
 
+-- fail - streaming must be boolean
+ALTER SUBSCRIPTION regress_testsub SET (streaming = foo);
+ALTER SUBSCRIPTION regress_testsub SET (streaming = true);
+
+\dRs+
+
+ALTER SUBSCRIPTION regress_testsub SET (streaming = false);
+
+-- fail - parallel_apply must be boolean
+ALTER SUBSCRIPTION regress_testsub SET (parallel_apply = foo);
+ALTER SUBSCRIPTION regress_testsub SET (parallel_apply = true);
+
+\dRs+
+
+ALTER SUBSCRIPTION regress_testsub SET (parallel_apply = false);
+
 -- fail - new owner must be superuser
 ALTER SUBSCRIPTION regress_testsub OWNER TO regress_subscription_user2;
 ALTER ROLE regress_subscription_user2 SUPERUSER;
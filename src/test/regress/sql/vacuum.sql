@@ -121,6 +121,63 @@ SELECT pg_relation_size('vac_truncate_test') = 0;
 VACUUM (TRUNCATE FALSE, FULL TRUE) vac_truncate_test;
 DROP TABLE vac_truncate_test;
 
+-- PARALLEL option
+CREATE TABLE pvactst (i INT, a INT[], p POINT) with (autovacuum_enabled = off);
+INSERT INTO pvactst SELECT i, array[1,2,3], point(i, i+1) FROM generate_series(1,1000) i;
+CREATE INDEX btree_pvactst ON pvactst USING btree (i);
+CREATE INDEX hash_pvactst ON pvactst USING hash (i);
+CREATE INDEX brin_pvactst ON pvactst USING brin (i);
+CREATE INDEX gin_pvactst ON pvactst USING gin (a);
+CREATE INDEX gist_pvactst ON pvactst USING gist (p);
+CREATE INDEX spgist_pvactst ON pvactst USING spgist (p);
+
+-- VACUUM invokes parallel index cleanup
+SET min_parallel_index_scan_size to 0;
+VACUUM (PARALLEL 2) pvactst;
+
+-- VACUUM invokes parallel bulk-deletion
+UPDATE pvactst SET i = i WHERE i < 1000;
+VACUUM (PARALLEL 2) pvactst;
+
+UPDATE pvactst SET i = i WHERE i < 1000;
+VACUUM (PARALLEL 0) pvactst; -- disable parallel vacuum
+
+VACUUM (PARALLEL -1) pvactst; -- error
+VACUUM (PARALLEL 2, INDEX_CLEANUP FALSE) pvactst;
+VACUUM (PARALLEL 2, FULL TRUE) pvactst; -- error, cannot use both PARALLEL and FULL
+VACUUM (PARALLEL) pvactst; -- error, cannot use PARALLEL option without parallel degree
+ANALYZE (PARALLEL 2) pvactst; -- error, PARALLEL is a VACUUM-only option
+
+-- Test different combinations of parallel and full options for temporary tables
+CREATE TEMPORARY TABLE tmp (a int PRIMARY KEY);
+CREATE INDEX tmp_idx1 ON tmp (a);
+VACUUM (PARALLEL 1, FULL FALSE) tmp; -- parallel vacuum disabled for temp tables
+VACUUM (PARALLEL 0, FULL TRUE) tmp; -- can specify parallel disabled (even though that's implied by FULL)
+RESET min_parallel_index_scan_size;
+DROP TABLE pvactst;
+
+-- Dead tuple storage, with pages holding many dead tuples mixed with pages
+-- holding only a few
+CREATE TABLE vac_deadtuples (id int, filler text) WITH (autovacuum_enabled = off);
+INSERT INTO vac_deadtuples SELECT g, repeat('x', 20) FROM generate_series(1, 150000) g;
+CREATE INDEX vac_deadtuples_idx ON vac_deadtuples (id);
+DELETE FROM vac_deadtuples WHERE id <= 20000 AND id % 10 <> 0;
+DELETE FROM vac_deadtuples WHERE id > 20000 AND id % 97 = 0;
+DELETE FROM vac_deadtuples WHERE id BETWEEN 60001 AND 70000 AND id % 7 = 0;
+VACUUM vac_deadtuples;
+-- Refill the freed space, so any index entry left behind for a removed
+-- tuple would now lead to one of the new rows
+INSERT INTO vac_deadtuples SELECT -g, 'y' FROM generate_series(1, 30000) g;
+SELECT count(*), sum(id) FROM vac_deadtuples WHERE id > 0;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SELECT count(*), sum(id) FROM vac_deadtuples WHERE id > 0;
+SELECT count(*) FROM vac_deadtuples WHERE id > 0 AND filler <> repeat('x', 20);
+SELECT count(*) FROM vac_deadtuples WHERE id < 0;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+DROP TABLE vac_deadtuples;
+
 -- partitioned table
 CREATE TABLE vacparted (a int, b char) PARTITION BY LIST (a);
 CREATE TABLE vacparted1 PARTITION OF vacparted FOR VALUES IN (1);
@@ -0,0 +1,192 @@
+# Test applying transactions with parallel apply workers
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 8;
+
+# Create publisher node
+my $node_publisher = get_new_node('publisher');
+$node_publisher->init(allows_streaming => 'logical');
+$node_publisher->start;
+
+# Create subscriber node
+my $node_subscriber = get_new_node('subscriber');
+$node_subscriber->init(allows_streaming => 'logical');
+$node_subscriber->append_conf('postgresql.conf',
+	'max_parallel_apply_workers_per_subscription = 2');
+$node_subscriber->start;
+
+# Create some preexisting content on publisher
+$node_publisher->safe_psql('postgres',
+	"CREATE TABLE test_tab (a int primary key, b int)");
+$node_publisher->safe_psql('postgres',
+	"INSERT INTO test_tab SELECT i, 0 FROM generate_series(1, 10) s(i)");
+$node_publisher->safe_psql('postgres',
+	"CREATE TABLE uniq_tab (id int primary key, u int UNIQUE)");
+$node_publisher->safe_psql('postgres',
+	"INSERT INTO uniq_tab SELECT i, i FROM generate_series(1, 100) s(i)");
+$node_publisher->safe_psql('postgres',
+	"CREATE TABLE stall_tab (a int primary key)");
+
+# Setup structure on subscriber
+$node_subscriber->safe_psql('postgres',
+	"CREATE TABLE test_tab (a int primary key, b int)");
+$node_subscriber->safe_psql('postgres',
+	"CREATE TABLE uniq_tab (id int primary key, u int UNIQUE)");
+
+# A trigger on the subscriber makes all inserts into stall_tab update the
+# same row, a dependency the leader can't see.  The insert of a = 1 sleeps
+# first, so that the next transaction gets to the row before it.
+$node_subscriber->safe_psql(
+	'postgres', q{
+CREATE TABLE stall_tab (a int primary key);
+CREATE TABLE stall_count (n int);
+INSERT INTO stall_count VALUES (0);
+CREATE FUNCTION stall_count_trig() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  IF NEW.a = 1 THEN
+    PERFORM pg_sleep(2);
+  END IF;
+  UPDATE stall_count SET n = n + 1;
+  RETURN NULL;
+END
+$$;
+CREATE TRIGGER stall_count_trig AFTER INSERT ON stall_tab
+  FOR EACH ROW EXECUTE FUNCTION stall_count_trig();
+ALTER TABLE stall_tab ENABLE ALWAYS TRIGGER stall_count_trig;
+});
+
+# Setup logical replication
+my $publisher_connstr = $node_publisher->connstr . ' dbname=postgres';
+$node_publisher->safe_psql('postgres',
+	"CREATE PUBLICATION tap_pub FOR TABLE test_tab, uniq_tab, stall_tab");
+
+my $appname = 'tap_sub';
+$node_subscriber->safe_psql('postgres',
+	"CREATE SUBSCRIPTION tap_sub CONNECTION '$publisher_connstr application_name=$appname' PUBLICATION tap_pub WITH (parallel_apply = on)"
+);
+
+$node_publisher->wait_for_catchup($appname);
+
+# Also wait for initial table sync to finish
+my $synced_query =
+  "SELECT count(1) = 0 FROM pg_subscription_rel WHERE srsubstate NOT IN ('r', 's');";
+$node_subscriber->poll_query_until('postgres', $synced_query)
+  or die "Timed out while waiting for subscriber to synchronize data";
+
+my $result =
+  $node_subscriber->safe_psql('postgres', "SELECT count(*) FROM test_tab");
+is($result, qq(10), 'check initial data was copied to subscriber');
+
+# Many small independent transactions, which can be applied concurrently.
+$node_publisher->safe_psql(
+	'postgres', q{
+DO $$
+BEGIN
+  FOR i IN 11..500 LOOP
+    INSERT INTO test_tab VALUES (i, 0);
+    COMMIT;
+  END LOOP;
+END
+$$;
+});
+
+$node_publisher->wait_for_catchup($appname);
+
+$result =
+  $node_subscriber->safe_psql('postgres', "SELECT count(*), sum(b) FROM test_tab");
+is($result, qq(500|0), 'check independent transactions were applied');
+
+# Transactions that repeatedly change the same rows must be applied in
+# commit order.
+$node_publisher->safe_psql(
+	'postgres', q{
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    UPDATE test_tab SET b = b + 1 WHERE a <= 10;
+    COMMIT;
+    DELETE FROM test_tab WHERE a = 500 + i;
+    INSERT INTO test_tab VALUES (500 + i, i);
+    COMMIT;
+  END LOOP;
+END
+$$;
+});
+
+$node_publisher->wait_for_catchup($appname);
+
+$result =
+  $node_subscriber->safe_psql('postgres',
+	"SELECT sum(b) FILTER (WHERE a <= 10), sum(b) FILTER (WHERE a > 500) FROM test_tab");
+is($result, qq(2000|20100), 'check dependent transactions were applied in order');
+
+# The replication origin must reflect everything applied so far, so that no
+# transaction is applied again after a restart.
+$node_subscriber->restart;
+
+$node_publisher->safe_psql('postgres',
+	"UPDATE test_tab SET b = b + 1 WHERE a = 1");
+
+$node_publisher->wait_for_catchup($appname);
+
+my $table_query = "SELECT count(*), sum(a), sum(b) FROM test_tab";
+is( $node_subscriber->safe_psql('postgres', $table_query),
+	$node_publisher->safe_psql('postgres', $table_query),
+	'check subscriber matches publisher after restart');
+
+# Transactions that free a value of a unique index other than the replica
+# identity, followed by transactions that take it.  The later transactions
+# must wait for the earlier ones, or they fail with a unique violation.
+$node_publisher->safe_psql(
+	'postgres', q{
+DO $$
+BEGIN
+  FOR i IN 1..100 LOOP
+    UPDATE uniq_tab SET u = u + 1000 WHERE id = i;
+    COMMIT;
+    INSERT INTO uniq_tab VALUES (1000 + i, i);
+    COMMIT;
+    DELETE FROM uniq_tab WHERE id = 1000 + i;
+    COMMIT;
+    UPDATE uniq_tab SET u = i WHERE id = i;
+    COMMIT;
+  END LOOP;
+END
+$$;
+});
+
+$node_publisher->wait_for_catchup($appname);
+
+$table_query = "SELECT count(*), sum(id), sum(u) FROM uniq_tab";
+is( $node_subscriber->safe_psql('postgres', $table_query),
+	$node_publisher->safe_psql('postgres', $table_query),
+	'check transactions reusing unique values were applied');
+unlike(
+	slurp_file($node_subscriber->logfile),
+	qr/duplicate key value violates unique constraint/,
+	'check no unique violation happened on the subscriber');
+
+# The first transaction waits for the lock held by the second, which waits
+# for the first to commit.  The leader detects that and restarts, and then
+# applies both transactions serially instead of running into the same
+# situation again.
+$node_publisher->safe_psql(
+	'postgres', q{
+INSERT INTO stall_tab VALUES (1);
+INSERT INTO stall_tab VALUES (2);
+});
+
+$node_publisher->wait_for_catchup($appname);
+
+$result = $node_subscriber->safe_psql('postgres',
+	"SELECT (SELECT count(*) FROM stall_tab), n FROM stall_count");
+is($result, qq(2|2), 'check stuck transactions were applied after restart');
+
+my @stalls = slurp_file($node_subscriber->logfile) =~
+  /deadlock detected between logical replication parallel apply workers/g;
+is(scalar(@stalls), 1, 'check stuck transactions were applied serially');
+
+$node_subscriber->stop;
+$node_publisher->stop;
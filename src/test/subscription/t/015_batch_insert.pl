@@ -0,0 +1,115 @@
+# Test applying inserts through the insert buffer
+use strict;
+use warnings;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 5;
+use Time::HiRes qw(usleep);
+
+# Initialize publisher node
+my $node_publisher = get_new_node('publisher');
+$node_publisher->init(allows_streaming => 'logical');
+$node_publisher->start;
+
+# Create subscriber node
+my $node_subscriber = get_new_node('subscriber');
+$node_subscriber->init(allows_streaming => 'logical');
+$node_subscriber->start;
+
+# Setup structure on publisher
+$node_publisher->safe_psql('postgres',
+	"CREATE TABLE tab1 (a int PRIMARY KEY, b text)");
+$node_publisher->safe_psql('postgres',
+	"CREATE TABLE tab2 (a int PRIMARY KEY, b text)");
+
+# Setup structure on subscriber: tab1 has an extra column with a stable
+# default and an AFTER ROW trigger, tab2 an extra column with a volatile
+# default, which makes the apply worker insert its rows one by one.
+$node_subscriber->safe_psql(
+	'postgres', qq{
+CREATE TABLE tab1 (a int PRIMARY KEY, b text, c int DEFAULT 42);
+CREATE TABLE tab2 (a int PRIMARY KEY, b text, c float8 DEFAULT random());
+CREATE TABLE tab1_log (a int);
+CREATE FUNCTION tab1_log_fn() RETURNS TRIGGER AS \$\$
+BEGIN
+    INSERT INTO tab1_log VALUES (NEW.a);
+    RETURN NULL;
+END;
+\$\$ LANGUAGE plpgsql;
+CREATE TRIGGER tab1_log_trg
+    AFTER INSERT ON tab1
+    FOR EACH ROW EXECUTE PROCEDURE tab1_log_fn();
+ALTER TABLE tab1 ENABLE REPLICA TRIGGER tab1_log_trg;
+});
+
+# Setup logical replication
+my $publisher_connstr = $node_publisher->connstr . ' dbname=postgres';
+$node_publisher->safe_psql('postgres',
+	"CREATE PUBLICATION tap_pub FOR ALL TABLES");
+
+my $appname = 'tap_sub';
+$node_subscriber->safe_psql('postgres',
+	"CREATE SUBSCRIPTION tap_sub CONNECTION '$publisher_connstr application_name=$appname' PUBLICATION tap_pub"
+);
+
+$node_publisher->wait_for_catchup($appname);
+
+# More inserts than fit in one buffer, interleaved with changes that must
+# see the rows inserted before them.
+$node_publisher->safe_psql(
+	'postgres', q{
+BEGIN;
+INSERT INTO tab1 SELECT i, 'row ' || i FROM generate_series(1, 2500) s(i);
+UPDATE tab1 SET b = 'updated' WHERE a % 10 = 0;
+INSERT INTO tab1 SELECT i, 'row ' || i FROM generate_series(2501, 3000) s(i);
+INSERT INTO tab2 SELECT i, 'row ' || i FROM generate_series(1, 100) s(i);
+INSERT INTO tab1 SELECT i, 'row ' || i FROM generate_series(3001, 3100) s(i);
+DELETE FROM tab1 WHERE a > 3050;
+COMMIT;
+});
+
+$node_publisher->wait_for_catchup($appname);
+
+my $result = $node_subscriber->safe_psql('postgres',
+	"SELECT count(*), count(*) FILTER (WHERE b = 'updated'), min(c), max(c) FROM tab1"
+);
+is($result, qq(3050|250|42|42),
+	'check buffered inserts were applied in order');
+
+$result = $node_subscriber->safe_psql('postgres',
+	"SELECT count(*), count(DISTINCT a) FROM tab1_log");
+is($result, qq(3100|3100), 'check AFTER ROW trigger fired for every insert');
+
+$result = $node_subscriber->safe_psql('postgres',
+	"SELECT count(*), count(c) FROM tab2");
+is($result, qq(100|100), 'check inserts with volatile default were applied');
+
+# A duplicate key in a buffered insert must still be caught.
+$node_subscriber->safe_psql('postgres',
+	"INSERT INTO tab1 VALUES (5000, 'local')");
+$node_publisher->safe_psql('postgres',
+	"INSERT INTO tab1 SELECT i, 'row ' || i FROM generate_series(4990, 5000) s(i)"
+);
+
+my $logfile;
+foreach my $i (1 .. 1800)
+{
+	$logfile = slurp_file($node_subscriber->logfile);
+	last if $logfile =~ /duplicate key value violates unique constraint "tab1_pkey"/;
+	usleep(100_000);
+}
+like(
+	$logfile,
+	qr/duplicate key value violates unique constraint "tab1_pkey"/,
+	'check duplicate key in buffered inserts is reported');
+
+$node_subscriber->safe_psql('postgres', "DELETE FROM tab1 WHERE a = 5000");
+
+$node_publisher->wait_for_catchup($appname);
+
+$result = $node_subscriber->safe_psql('postgres',
+	"SELECT count(*) FROM tab1 WHERE a BETWEEN 4990 AND 5000");
+is($result, qq(11), 'check transaction is applied after conflict is resolved');
+
+$node_subscriber->stop('fast');
+$node_publisher->stop('fast');